@@ -14,15 +14,95 @@
 
 #include <hal/cpu.h>
 #include <kernel/cpu/cpu.h>
+#include <kernel/sched.h>
+#include <kernel/sched/sched_latency.h>
+#include <kernel/task.h>
+#include <kernel/thread.h>
 
 static void print_usage(void) {
-	printf("Usage: mpstat -P ALL\n");
+	printf("Usage: mpstat -P ALL\n"
+			"       mpstat -L [-t] [-r]\n");
+}
+
+static void print_latency_row(const char *name, int id,
+		const struct sched_latency_stat *stat) {
+	printf("%6s %3d %8lu %8lu %9lu %9lu %9lu\n",
+			name, id, stat->runs, stat->wakeups,
+			stat->runs ? (unsigned long) (stat->delay_total
+					/ stat->runs / 1000) : 0,
+			(unsigned long) stat->delay_max / 1000,
+			(unsigned long) stat->wakeup_max / 1000);
+}
+
+static void print_latency_hist(const unsigned long *hist) {
+	printf("\nwakeup latency, us\n");
+	for (int i = 0; i < SCHED_LATENCY_BUCKETS; i++) {
+		if (!hist[i]) {
+			continue;
+		}
+		if (i == SCHED_LATENCY_BUCKETS - 1) {
+			printf("  >=%-6lu %lu\n", 1UL << (i - 1), hist[i]);
+		} else {
+			printf("   <%-6lu %lu\n", 1UL << i, hist[i]);
+		}
+	}
+}
+
+static int print_latency(int threads, int reset) {
+	struct sched_latency_stat stat;
+	unsigned long hist[SCHED_LATENCY_BUCKETS] = { 0 };
+	int groups = sched_latency_prio_groups();
+
+	if (!groups) {
+		printf("Scheduler latency accounting is disabled "
+				"(embox.kernel.sched.latency.latency_hist)\n");
+		return -ENOSYS;
+	}
+
+	printf("%6s %3s %8s %8s %9s %9s %9s\n", "", "id", "runs", "wakeups",
+			"avg(us)", "max(us)", "wmax(us)");
+
+	for (int i = 0; i < groups; i++) {
+		if (sched_latency_prio_get(i, &stat) || !stat.runs) {
+			continue;
+		}
+		print_latency_row("prio", i * SCHED_PRIORITY_TOTAL / groups, &stat);
+		for (int j = 0; j < SCHED_LATENCY_BUCKETS; j++) {
+			hist[j] += stat.hist[j];
+		}
+	}
+
+	if (threads) {
+		struct task *task;
+		struct thread *t;
+
+		sched_lock();
+		{
+			task_foreach(task) {
+				task_foreach_thread(t, task) {
+					if (!sched_latency_get(&t->schedee, &stat)) {
+						print_latency_row("thread", t->id, &stat);
+					}
+				}
+			}
+		}
+		sched_unlock();
+	}
+
+	print_latency_hist(hist);
+
+	if (reset) {
+		sched_latency_reset();
+	}
+
+	return ENOERR;
 }
 
 int main(int argc, char **argv) {
 	int opt;
 	clock_t atotal = 0;
 	clock_t aidle = 0;
+	int latency = 0, threads = 0, reset = 0;
 
 	if (argc <= 1) {
 		print_usage();
@@ -31,7 +111,7 @@ int main(int argc, char **argv) {
 
 	getopt_init();
 
-	while (-1 != (opt = getopt(argc, argv, "Ph"))) {
+	while (-1 != (opt = getopt(argc, argv, "PLtrh"))) {
 		switch (opt) {
 		case '?':
 			printf("Invalid command line option\n");
@@ -60,12 +140,25 @@ int main(int argc, char **argv) {
 					(int) (aidle * 100 / atotal));
 
 			return ENOERR;
+		case 'L':
+			latency = 1;
+			break;
+		case 't':
+			threads = 1;
+			break;
+		case 'r':
+			reset = 1;
+			break;
 		default:
 			print_usage();
 			return -EINVAL;
 		}
 	}
 
+	if (latency) {
+		return print_latency(threads, reset);
+	}
+
 	print_usage();
 	return -EINVAL;
 }
@@ -31,7 +31,7 @@ static int print_arp_entity(const struct neighbour *n,
 	assert(n != NULL);
 
 	if ((in_dev == NULL) || (in_dev->dev == n->dev)) {
-		if (!n->incomplete) {
+		if (n->state != NEIGHBOUR_INCOMPLETE) {
 			macaddr_print(hw_addr, &n->haddr[0]);
 		}
 		else {
@@ -140,6 +140,7 @@ int main(int argc, char **argv) {
 		}
 		assert(ci.ci_addrlen == inaddrlen);
 		ci.ci_basedir = basedir;
+		ci.ci_prefetch_len = 0;
 
 		if (USE_PARALLEL_CGI) {
 			while (0 < httpd_wait_cgi_child(-1, WNOHANG)) {
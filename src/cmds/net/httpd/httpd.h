@@ -11,6 +11,7 @@
 
 #include <stdio.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 #include "httpd_log.h"
 
@@ -29,6 +30,10 @@ struct client_info {
 	int ci_index;
 
 	const char *ci_basedir;
+
+	/* Request body already read from the socket, goes to CGI first */
+	const char *ci_prefetch;
+	size_t ci_prefetch_len;
 };
 
 struct http_req_uri {
@@ -39,8 +44,12 @@ struct http_req_uri {
 struct http_req {
 	struct http_req_uri uri;
 	char *method;
+	char *version;
 	char *content_len;
 	char *content_type;
+	char *connection;
+	char *if_none_match;
+	char *accept_encoding;
 };
 
 extern char *httpd_parse_request(char *str, struct http_req *hreq);
@@ -53,6 +62,16 @@ extern pid_t httpd_try_respond_cmd(const struct client_info *cinfo, const struct
 extern int httpd_try_respond_file(const struct client_info *cinfo, const struct http_req *hreq,
 		char *buf, size_t buf_sz);
 
+/* Contents of a static file kept in memory, valid while referenced */
+struct httpd_cache_ent {
+	const char *data;
+	size_t size;
+};
+
+/* Returns NULL if the file can't be cached, @a st describes it */
+extern struct httpd_cache_ent *httpd_cache_get(const char *path, const struct stat *st);
+extern void httpd_cache_put(struct httpd_cache_ent *ent);
+
 extern const char *httpd_filename2content_type(const char *filename);
 extern int httpd_header(const struct client_info *cinfo, int st, const char *msg);
 
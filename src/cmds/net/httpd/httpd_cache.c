@@ -0,0 +1,150 @@
+/**
+ * @file
+ * @brief In-memory cache of static files
+ *
+ * Files are kept whole and checked against size and modification time of
+ * the file on each lookup. The least recently used unreferenced entries are
+ * evicted to make room. Not thread-safe, the event loop is the only user.
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "httpd.h"
+
+#ifdef __EMBUILD_MOD__
+#	include <framework/mod/options.h>
+#	define CACHE_SIZE       OPTION_GET(NUMBER,cache_size)
+#	define CACHE_ENTRIES    OPTION_GET(NUMBER,cache_entries)
+#	define CACHE_FILE_MAX   OPTION_GET(NUMBER,cache_file_max)
+#endif /* __EMBUILD_MOD__ */
+
+struct httpd_cache_slot {
+	struct httpd_cache_ent ent;
+	char path[HTTPD_MAX_PATH];
+	time_t mtime;
+	int refcnt;
+	unsigned long used;
+};
+
+static struct httpd_cache_slot httpd_cache[CACHE_ENTRIES];
+static size_t httpd_cache_bytes;
+static unsigned long httpd_cache_tick;
+
+static void httpd_cache_drop(struct httpd_cache_slot *slot) {
+	httpd_cache_bytes -= slot->ent.size;
+	free((void *) slot->ent.data);
+	slot->ent.data = NULL;
+	slot->path[0] = '\0';
+}
+
+static int httpd_cache_load(struct httpd_cache_slot *slot, const char *path,
+		const struct stat *st) {
+	char *data;
+	size_t done;
+	ssize_t nbyte;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -errno;
+	}
+
+	data = malloc(st->st_size ? st->st_size : 1);
+	if (!data) {
+		close(fd);
+		return -ENOMEM;
+	}
+
+	for (done = 0; done < st->st_size; done += nbyte) {
+		nbyte = read(fd, data + done, st->st_size - done);
+		if (nbyte <= 0) {
+			close(fd);
+			free(data);
+			return nbyte < 0 ? -errno : -EIO;
+		}
+	}
+	close(fd);
+
+	strcpy(slot->path, path);
+	slot->ent.data = data;
+	slot->ent.size = st->st_size;
+	slot->mtime = st->st_mtime;
+	httpd_cache_bytes += st->st_size;
+	return 0;
+}
+
+/* Frees a slot and @a size bytes, returns NULL if in use entries hold them */
+static struct httpd_cache_slot *httpd_cache_evict(size_t size) {
+	struct httpd_cache_slot *slot, *lru;
+	int i;
+
+	for (;;) {
+		lru = NULL;
+		for (i = 0; i < ARRAY_SIZE(httpd_cache); i++) {
+			slot = &httpd_cache[i];
+			if (!slot->ent.data) {
+				if (httpd_cache_bytes + size <= CACHE_SIZE) {
+					return slot;
+				}
+				continue;
+			}
+			if (!slot->refcnt && (!lru || slot->used < lru->used)) {
+				lru = slot;
+			}
+		}
+
+		if (!lru) {
+			return NULL;
+		}
+		httpd_cache_drop(lru);
+	}
+}
+
+struct httpd_cache_ent *httpd_cache_get(const char *path, const struct stat *st) {
+	struct httpd_cache_slot *slot;
+	int i;
+
+	if (!S_ISREG(st->st_mode) || st->st_size > CACHE_FILE_MAX
+			|| strlen(path) >= HTTPD_MAX_PATH) {
+		return NULL;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(httpd_cache); i++) {
+		slot = &httpd_cache[i];
+		if (!slot->ent.data || strcmp(slot->path, path)) {
+			continue;
+		}
+
+		if (slot->ent.size == st->st_size && slot->mtime == st->st_mtime) {
+			goto found;
+		}
+		/* Changed, reloaded once the last user of the old one is done */
+		if (slot->refcnt) {
+			return NULL;
+		}
+		httpd_cache_drop(slot);
+		break;
+	}
+
+	slot = httpd_cache_evict(st->st_size);
+	if (!slot || httpd_cache_load(slot, path, st)) {
+		return NULL;
+	}
+
+found:
+	slot->refcnt++;
+	slot->used = ++httpd_cache_tick;
+	return &slot->ent;
+}
+
+void httpd_cache_put(struct httpd_cache_ent *ent) {
+	struct httpd_cache_slot *slot = (struct httpd_cache_slot *) ent;
+
+	slot->refcnt--;
+}
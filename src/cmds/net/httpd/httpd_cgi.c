@@ -18,7 +18,8 @@
 
 #include "httpd.h"
 
-static char httpd_g_envbuf[256];
+#define HTTPD_ENVBUF_SZ 256
+#define HTTPD_FEEDBUF_SZ 256
 
 struct cgi_env_descr {
 	char *name;
@@ -44,13 +45,15 @@ static int httpd_execve(const char *path, char *const argv[], char *const envp[]
 	return execv(path, argv);
 }
 
-static int httpd_fill_env(const struct http_req *hreq, char *envp[], int envp_len) {
+/* @a envbuf is per call, CGI may be started from several threads */
+static int httpd_fill_env(const struct http_req *hreq, char *envp[], int envp_len,
+		char *envbuf, size_t envbuf_sz) {
 	char *ebp;
 	size_t env_sz;
 	int i_ce, n_ce;
 
-	ebp = httpd_g_envbuf;
-	env_sz = sizeof(httpd_g_envbuf);
+	ebp = envbuf;
+	env_sz = envbuf_sz;
 	n_ce = 0;
 
 	assert(envp_len >= ARRAY_SIZE(cgi_env));
@@ -80,31 +83,102 @@ static int httpd_fill_env(const struct http_req *hreq, char *envp[], int envp_le
 	return n_ce;
 }
 
+static int httpd_write_all(int fd, const char *buf, size_t len) {
+	ssize_t ret;
+
+	for (; len > 0; buf += ret, len -= ret) {
+		ret = write(fd, buf, len);
+		if (ret < 0) {
+			return -errno;
+		}
+	}
+
+	return 0;
+}
+
+/* Passes the request body to the script: the part already read by the
+ * server and then the rest of Content-Length from the socket */
+static int httpd_cgi_feed(const struct client_info *cinfo, const struct http_req *hreq,
+		int fd) {
+	char buf[HTTPD_FEEDBUF_SZ];
+	size_t left;
+	ssize_t nbyte;
+	int err;
+
+	err = httpd_write_all(fd, cinfo->ci_prefetch, cinfo->ci_prefetch_len);
+	if (err) {
+		return err;
+	}
+
+	left = hreq->content_len ? atol(hreq->content_len) : 0;
+	left = left > cinfo->ci_prefetch_len ? left - cinfo->ci_prefetch_len : 0;
+	while (left > 0) {
+		nbyte = read(cinfo->ci_sock, buf, left < sizeof(buf) ? left : sizeof(buf));
+		if (nbyte <= 0) {
+			return nbyte < 0 ? -errno : -EPIPE;
+		}
+		err = httpd_write_all(fd, buf, nbyte);
+		if (err) {
+			return err;
+		}
+		left -= nbyte;
+	}
+
+	return 0;
+}
+
 static pid_t httpd_response_cgi(const struct client_info *cinfo, const struct http_req *hreq,
 		char *path) {
+	int feed[2] = { -1, -1 };
 	pid_t pid;
+	int err;
+
+	/* Script can't read the prefetched part from the socket */
+	if (cinfo->ci_prefetch_len && -1 == pipe(feed)) {
+		err = errno;
+		httpd_error("pipe() error(%d): %s", err, strerror(err));
+		return -err;
+	}
 
 	pid = vfork();
 	if (pid < 0) {
-		int err = errno;
+		err = errno;
 		httpd_error("vfork() error(%d): %s", err, strerror(err));
+		if (feed[0] != -1) {
+			close(feed[0]);
+			close(feed[1]);
+		}
 		return -err;
 	}
 
 	if (pid == 0) {
 		char *argv[] = { path, NULL };
 		char *envp[ARRAY_SIZE(cgi_env) + 1];
+		char envbuf[HTTPD_ENVBUF_SZ];
 
-		httpd_fill_env(hreq, envp, ARRAY_SIZE(envp));
+		httpd_fill_env(hreq, envp, ARRAY_SIZE(envp), envbuf, sizeof(envbuf));
 
-		dup2(cinfo->ci_sock, STDIN_FILENO);
+		dup2(feed[0] != -1 ? feed[0] : cinfo->ci_sock, STDIN_FILENO);
 		dup2(cinfo->ci_sock, STDOUT_FILENO);
 		close(cinfo->ci_sock);
+		if (feed[0] != -1) {
+			close(feed[0]);
+			close(feed[1]);
+		}
 
 		httpd_execve(path, argv, envp);
 		exit(1);
 	}
 
+	if (feed[0] != -1) {
+		close(feed[0]);
+		err = httpd_cgi_feed(cinfo, hreq, feed[1]);
+		if (err) {
+			httpd_error("can't pass request body to script: %s", strerror(-err));
+		}
+		close(feed[1]);
+	}
+
 	return pid;
 }
 
@@ -0,0 +1,678 @@
+/**
+ * @file
+ * @brief Event-driven HTTP server
+ *
+ * One thread polls the listening socket and all the connections, which are
+ * non-blocking. HTTP/1.1 connections are kept alive and pipelined requests
+ * are answered in order. Static files are served from httpd_cache.c when
+ * they fit, precompressed "<file>.gz" is preferred if the client accepts
+ * gzip. CGI requests are handed to a fixed pool of threads with their
+ * connection, which is closed after the script.
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "httpd.h"
+
+#ifdef __EMBUILD_MOD__
+#	include <framework/mod/options.h>
+#	define USE_IP_VER        OPTION_GET(NUMBER,use_ip_ver)
+#	define USE_REAL_CMD      OPTION_GET(BOOLEAN,use_real_cmd)
+#	define USE_GZIP          OPTION_GET(BOOLEAN,use_gzip)
+#	define MAX_CONNS         OPTION_GET(NUMBER,max_conns)
+#	define KEEPALIVE_TIMEOUT OPTION_GET(NUMBER,keepalive_timeout)
+#	define CGI_WORKERS       OPTION_GET(NUMBER,cgi_workers)
+#	define CGI_QUEUE         OPTION_GET(NUMBER,cgi_queue)
+#endif /* __EMBUILD_MOD__ */
+
+#define BUFF_SZ     1024
+#define OUT_BUFF_SZ 2048
+#define PAGE_INDEX  "index.html"
+
+enum httpd_conn_state {
+	CONN_FREE,
+	CONN_READ,  /* waits for a request */
+	CONN_WRITE, /* sends a response */
+	CONN_CGI,   /* belongs to a CGI worker */
+};
+
+struct httpd_conn {
+	enum httpd_conn_state state;
+	struct client_info ci;
+	unsigned long last_ms;
+
+	char in[BUFF_SZ];
+	size_t in_len;
+	size_t body_skip; /* body of the last request not read yet */
+
+	char req[BUFF_SZ + 1];
+	struct http_req hreq;
+	int keep_alive;
+
+	/* Response: out[out_off, out_len), then body, then file */
+	char out[OUT_BUFF_SZ];
+	size_t out_off, out_len;
+	struct httpd_cache_ent *ent;
+	const char *body;
+	size_t body_len;
+	int fd;
+	size_t file_left;
+};
+
+static struct httpd_conn httpd_conns[MAX_CONNS];
+static const char *httpd_basedir;
+
+/* Workers report connections they are done with through the pipe */
+static int httpd_wake[2];
+
+static struct httpd_conn *httpd_cgi_q[CGI_QUEUE];
+static int httpd_cgi_q_head, httpd_cgi_q_len;
+static pthread_mutex_t httpd_cgi_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t httpd_cgi_cond = PTHREAD_COND_INITIALIZER;
+
+static unsigned long httpd_now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int httpd_set_nonblock(int fd, int on) {
+	int flags;
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags == -1) {
+		return -errno;
+	}
+	flags = on ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+	return fcntl(fd, F_SETFL, flags) == -1 ? -errno : 0;
+}
+
+static const char *httpd_status_msg(int st) {
+	switch (st) {
+	case 200: return "OK";
+	case 304: return "Not Modified";
+	case 400: return "Bad Request";
+	case 404: return "Not Found";
+	case 405: return "Method Not Allowed";
+	case 500: return "Internal Server Error";
+	case 503: return "Service Unavailable";
+	default:  return "";
+	}
+}
+
+/* Response without a body */
+static void httpd_ev_status(struct httpd_conn *c, int st) {
+	c->out_len = snprintf(c->out, sizeof(c->out),
+			"HTTP/1.1 %d %s\r\n"
+			"Content-Length: 0\r\n"
+			"Connection: %s\r\n"
+			"\r\n",
+			st, httpd_status_msg(st), c->keep_alive ? "keep-alive" : "close");
+}
+
+static void httpd_ev_release(struct httpd_conn *c) {
+	if (c->ent) {
+		httpd_cache_put(c->ent);
+		c->ent = NULL;
+	}
+	if (c->fd >= 0) {
+		close(c->fd);
+		c->fd = -1;
+	}
+	c->body_len = c->file_left = 0;
+	c->out_off = c->out_len = 0;
+}
+
+static void httpd_ev_close(struct httpd_conn *c) {
+	httpd_ev_release(c);
+	close(c->ci.ci_sock);
+	c->state = CONN_FREE;
+}
+
+static int httpd_etag_match(const struct http_req *hreq, const char *etag) {
+	const char *inm = hreq->if_none_match;
+
+	return inm && (0 == strcmp(inm, "*") || strstr(inm, etag));
+}
+
+/* Prepares the response with the file of @a hreq, returns status code if
+ * there is nothing to send but the status */
+static int httpd_ev_file(struct httpd_conn *c, const struct http_req *hreq) {
+	char path[HTTPD_MAX_PATH + sizeof(".gz")];
+	char etag[32];
+	const char *uri_path, *type;
+	struct stat st;
+	int path_len, gzip, head;
+
+	if (0 != strcmp(hreq->method, "GET") && 0 != strcmp(hreq->method, "HEAD")) {
+		return 405;
+	}
+
+	uri_path = 0 == strcmp(hreq->uri.target, "/") ? PAGE_INDEX : hreq->uri.target;
+	path_len = snprintf(path, HTTPD_MAX_PATH, "%s/%s", httpd_basedir, uri_path);
+	if (path_len >= HTTPD_MAX_PATH) {
+		return 404;
+	}
+
+	gzip = 0;
+	if (USE_GZIP && hreq->accept_encoding && strstr(hreq->accept_encoding, "gzip")) {
+		strcpy(path + path_len, ".gz");
+		gzip = 0 == stat(path, &st) && S_ISREG(st.st_mode);
+		if (!gzip) {
+			path[path_len] = '\0';
+		}
+	}
+	if (!gzip && (0 != stat(path, &st) || !S_ISREG(st.st_mode))) {
+		return 404;
+	}
+	/* Type of the original file for the compressed one */
+	path[path_len] = '\0';
+	type = httpd_filename2content_type(path);
+	if (gzip) {
+		path[path_len] = '.';
+	}
+
+	snprintf(etag, sizeof(etag), "\"%lx-%lx%s\"", (unsigned long) st.st_mtime,
+			(unsigned long) st.st_size, gzip ? "-gz" : "");
+	if (httpd_etag_match(hreq, etag)) {
+		c->out_len = snprintf(c->out, sizeof(c->out),
+				"HTTP/1.1 304 Not Modified\r\n"
+				"ETag: %s\r\n"
+				"Connection: %s\r\n"
+				"\r\n",
+				etag, c->keep_alive ? "keep-alive" : "close");
+		return 0;
+	}
+
+	head = 0 == strcmp(hreq->method, "HEAD");
+	if (!head) {
+		c->ent = httpd_cache_get(path, &st);
+		if (!c->ent) {
+			c->fd = open(path, O_RDONLY);
+			if (c->fd < 0) {
+				return 404;
+			}
+		}
+	}
+
+	c->out_len = snprintf(c->out, sizeof(c->out),
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: %s\r\n"
+			"Content-Length: %lu\r\n"
+			"ETag: %s\r\n"
+			"%s"
+			"Connection: %s\r\n"
+			"\r\n",
+			type, (unsigned long) st.st_size, etag,
+			gzip ? "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n" : "",
+			c->keep_alive ? "keep-alive" : "close");
+
+	if (head) {
+		return 0;
+	}
+
+	if (c->ent) {
+		c->body = c->ent->data;
+		c->body_len = c->ent->size;
+	} else {
+		c->file_left = st.st_size;
+	}
+	return 0;
+}
+
+static int httpd_ev_cgi_queue(struct httpd_conn *c) {
+	int ret;
+
+	pthread_mutex_lock(&httpd_cgi_lock);
+	if (httpd_cgi_q_len < CGI_QUEUE) {
+		httpd_cgi_q[(httpd_cgi_q_head + httpd_cgi_q_len++) % CGI_QUEUE] = c;
+		pthread_cond_signal(&httpd_cgi_cond);
+		ret = 0;
+	} else {
+		ret = -EBUSY;
+	}
+	pthread_mutex_unlock(&httpd_cgi_lock);
+
+	return ret;
+}
+
+/* Routes the parsed request, the response is in c->out after that */
+static void httpd_ev_respond(struct httpd_conn *c) {
+	struct http_req *hreq = &c->hreq;
+	const char *conn = hreq->connection;
+	size_t body;
+	int st;
+
+	httpd_debug("method=%s uri_target=%s uri_query=%s",
+			hreq->method, hreq->uri.target, hreq->uri.query);
+
+	if (conn && strcasestr(conn, "close")) {
+		c->keep_alive = 0;
+	} else if (hreq->version && 0 == strcmp(hreq->version, "HTTP/1.1")) {
+		c->keep_alive = 1;
+	} else {
+		c->keep_alive = conn && strcasestr(conn, "keep-alive");
+	}
+
+	body = hreq->content_len ? atol(hreq->content_len) : 0;
+
+	if (0 == strncmp(hreq->uri.target, CGI_PREFIX, strlen(CGI_PREFIX))) {
+		c->ci.ci_prefetch = c->in;
+		c->ci.ci_prefetch_len = c->in_len < body ? c->in_len : body;
+		if (0 == httpd_ev_cgi_queue(c)) {
+			c->state = CONN_CGI;
+			return;
+		}
+		httpd_error("all CGI workers are busy");
+		c->keep_alive = 0;
+		httpd_ev_status(c, 503);
+		c->state = CONN_WRITE;
+		return;
+	}
+
+	/* Body of a request to a file is dropped */
+	c->body_skip = body;
+
+	st = httpd_ev_file(c, hreq);
+	if (st) {
+		httpd_ev_release(c);
+		httpd_ev_status(c, st);
+	}
+	c->state = CONN_WRITE;
+}
+
+/* Length of the header block at the start of @a buf or 0 if incomplete */
+static size_t httpd_ev_header_len(const char *buf, size_t len) {
+	size_t i;
+
+	for (i = 3; i < len; i++) {
+		if (buf[i] == '\n' && buf[i - 1] == '\r'
+				&& buf[i - 2] == '\n' && buf[i - 3] == '\r') {
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+static void httpd_ev_consume(struct httpd_conn *c, size_t len) {
+	c->in_len -= len;
+	memmove(c->in, c->in + len, c->in_len);
+}
+
+/* Takes the next request from the input, returns 0 if it's incomplete */
+static int httpd_ev_next_request(struct httpd_conn *c) {
+	size_t len;
+
+	if (c->body_skip) {
+		len = c->in_len < c->body_skip ? c->in_len : c->body_skip;
+		httpd_ev_consume(c, len);
+		c->body_skip -= len;
+		if (c->body_skip) {
+			return 0;
+		}
+	}
+
+	len = httpd_ev_header_len(c->in, c->in_len);
+	if (!len) {
+		if (c->in_len == sizeof(c->in)) {
+			httpd_error("request header is too long");
+			c->keep_alive = 0;
+			httpd_ev_status(c, 400);
+			c->state = CONN_WRITE;
+			return 1;
+		}
+		return 0;
+	}
+
+	memcpy(c->req, c->in, len);
+	c->req[len] = '\0';
+	httpd_ev_consume(c, len);
+
+	memset(&c->hreq, 0, sizeof(c->hreq));
+	if (NULL == httpd_parse_request(c->req, &c->hreq)) {
+		httpd_error("can't parse request");
+		c->keep_alive = 0;
+		httpd_ev_status(c, 400);
+		c->state = CONN_WRITE;
+		return 1;
+	}
+
+	httpd_ev_respond(c);
+	return 1;
+}
+
+/* Sends what it can, returns -errno if the connection is broken */
+static int httpd_ev_write(struct httpd_conn *c) {
+	ssize_t nbyte;
+	size_t len;
+
+	for (;;) {
+		if (c->out_off < c->out_len) {
+			/* Headers go in one segment with the body */
+			nbyte = send(c->ci.ci_sock, c->out + c->out_off, c->out_len - c->out_off,
+					MSG_NOSIGNAL | (c->body_len || c->file_left ? MSG_MORE : 0));
+			if (nbyte < 0) {
+				break;
+			}
+			c->out_off += nbyte;
+		} else if (c->body_len) {
+			nbyte = send(c->ci.ci_sock, c->body, c->body_len, MSG_NOSIGNAL);
+			if (nbyte < 0) {
+				break;
+			}
+			c->body += nbyte;
+			c->body_len -= nbyte;
+		} else if (c->file_left) {
+			len = c->file_left < sizeof(c->out) ? c->file_left : sizeof(c->out);
+			nbyte = read(c->fd, c->out, len);
+			if (nbyte <= 0) {
+				return nbyte < 0 ? -errno : -EIO;
+			}
+			c->out_off = 0;
+			c->out_len = nbyte;
+			c->file_left -= nbyte;
+		} else {
+			httpd_ev_release(c);
+			c->state = CONN_READ;
+			return 0;
+		}
+	}
+
+	return errno == EAGAIN ? 0 : -errno;
+}
+
+/* Answers requests while they are complete and the socket takes data */
+static void httpd_ev_process(struct httpd_conn *c) {
+	for (;;) {
+		if (c->state == CONN_READ && !httpd_ev_next_request(c)) {
+			return;
+		}
+		if (c->state != CONN_WRITE) {
+			return;
+		}
+		if (0 > httpd_ev_write(c)) {
+			httpd_ev_close(c);
+			return;
+		}
+		if (c->state == CONN_WRITE) {
+			return;
+		}
+		if (!c->keep_alive) {
+			httpd_ev_close(c);
+			return;
+		}
+	}
+}
+
+static void httpd_ev_read(struct httpd_conn *c) {
+	ssize_t nbyte;
+
+	nbyte = recv(c->ci.ci_sock, c->in + c->in_len, sizeof(c->in) - c->in_len, 0);
+	if (nbyte <= 0) {
+		if (nbyte == 0 || errno != EAGAIN) {
+			httpd_ev_close(c);
+		}
+		return;
+	}
+	c->in_len += nbyte;
+
+	httpd_ev_process(c);
+}
+
+static void httpd_ev_accept(int host, socklen_t addrlen) {
+	struct httpd_conn *c;
+	int i;
+
+	for (i = 0; i < MAX_CONNS; i++) {
+		c = &httpd_conns[i];
+		if (c->state != CONN_FREE) {
+			continue;
+		}
+
+		c->ci.ci_addrlen = addrlen;
+		c->ci.ci_sock = accept(host, &c->ci.ci_addr, &c->ci.ci_addrlen);
+		if (c->ci.ci_sock == -1) {
+			if (errno != EAGAIN && errno != EINTR) {
+				httpd_error("accept() failure: %s", strerror(errno));
+			}
+			return;
+		}
+		if (0 > httpd_set_nonblock(c->ci.ci_sock, 1)) {
+			close(c->ci.ci_sock);
+			continue;
+		}
+
+		c->ci.ci_index = i;
+		c->ci.ci_basedir = httpd_basedir;
+		c->ci.ci_prefetch_len = 0;
+		c->in_len = c->body_skip = 0;
+		c->out_off = c->out_len = 0;
+		c->body_len = c->file_left = 0;
+		c->ent = NULL;
+		c->fd = -1;
+		c->state = CONN_READ;
+		c->last_ms = httpd_now_ms();
+	}
+}
+
+/* Runs the script with blocking socket, then closes the connection */
+static void httpd_ev_cgi(struct httpd_conn *c) {
+	pid_t child;
+
+	httpd_set_nonblock(c->ci.ci_sock, 0);
+
+	child = httpd_try_respond_script(&c->ci, &c->hreq);
+	if (!child && USE_REAL_CMD) {
+		child = httpd_try_respond_cmd(&c->ci, &c->hreq);
+	}
+
+	if (child > 0) {
+		while (-1 == waitpid(child, NULL, 0) && errno == EINTR) {
+		}
+		return;
+	}
+
+	c->keep_alive = 0;
+	httpd_ev_status(c, child ? 500 : 404);
+	if (0 > send(c->ci.ci_sock, c->out, c->out_len, MSG_NOSIGNAL)) {
+		httpd_error("can't send CGI status: %s", strerror(errno));
+	}
+}
+
+static void *httpd_cgi_worker(void *arg) {
+	struct httpd_conn *c;
+	unsigned char index;
+
+	for (;;) {
+		pthread_mutex_lock(&httpd_cgi_lock);
+		while (!httpd_cgi_q_len) {
+			pthread_cond_wait(&httpd_cgi_cond, &httpd_cgi_lock);
+		}
+		c = httpd_cgi_q[httpd_cgi_q_head];
+		httpd_cgi_q_head = (httpd_cgi_q_head + 1) % CGI_QUEUE;
+		httpd_cgi_q_len--;
+		pthread_mutex_unlock(&httpd_cgi_lock);
+
+		httpd_ev_cgi(c);
+
+		/* The event loop frees the slot */
+		index = c->ci.ci_index;
+		while (-1 == write(httpd_wake[1], &index, 1) && errno == EINTR) {
+		}
+	}
+
+	return NULL;
+}
+
+static void httpd_ev_wakeup(void) {
+	unsigned char index[MAX_CONNS];
+	ssize_t nbyte;
+	int i;
+
+	while (0 < (nbyte = read(httpd_wake[0], index, sizeof(index)))) {
+		for (i = 0; i < nbyte; i++) {
+			httpd_ev_close(&httpd_conns[index[i]]);
+		}
+	}
+}
+
+static void httpd_ev_loop(int host, socklen_t addrlen) {
+	struct pollfd fds[MAX_CONNS + 2];
+	struct httpd_conn *fd_conn[MAX_CONNS];
+	struct httpd_conn *c;
+	unsigned long now, idle;
+	int i, n, nconn, timeout, has_free;
+
+	for (;;) {
+		fds[0].fd = httpd_wake[0];
+		fds[0].events = POLLIN;
+		n = 1;
+		nconn = 0;
+		has_free = 0;
+		timeout = -1;
+		now = httpd_now_ms();
+
+		for (i = 0; i < MAX_CONNS; i++) {
+			c = &httpd_conns[i];
+			if (c->state == CONN_FREE) {
+				has_free = 1;
+				continue;
+			}
+			if (c->state == CONN_CGI) {
+				continue;
+			}
+
+			idle = now - c->last_ms;
+			if (idle >= KEEPALIVE_TIMEOUT) {
+				httpd_ev_close(c);
+				has_free = 1;
+				continue;
+			}
+			if (timeout == -1 || KEEPALIVE_TIMEOUT - idle < timeout) {
+				timeout = KEEPALIVE_TIMEOUT - idle;
+			}
+
+			fds[n].fd = c->ci.ci_sock;
+			fds[n].events = c->state == CONN_READ ? POLLIN : POLLOUT;
+			fd_conn[nconn++] = c;
+			n++;
+		}
+
+		/* New connections wait in the backlog while all slots are busy */
+		if (has_free) {
+			fds[n].fd = host;
+			fds[n].events = POLLIN;
+			n++;
+		}
+
+		if (0 > poll(fds, n, timeout)) {
+			if (errno != EINTR) {
+				httpd_error("poll() failure: %s", strerror(errno));
+			}
+			continue;
+		}
+
+		if (fds[0].revents) {
+			httpd_ev_wakeup();
+		}
+
+		now = httpd_now_ms();
+		for (i = 0; i < nconn; i++) {
+			c = fd_conn[i];
+			if (!fds[i + 1].revents || c->state == CONN_FREE) {
+				continue;
+			}
+			c->last_ms = now;
+			if (c->state == CONN_READ) {
+				httpd_ev_read(c);
+			} else {
+				httpd_ev_process(c);
+			}
+		}
+
+		if (has_free && fds[n - 1].revents) {
+			httpd_ev_accept(host, addrlen);
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	pthread_t thread;
+	int host, i, err;
+#if USE_IP_VER == 4
+	struct sockaddr_in inaddr;
+	const size_t inaddrlen = sizeof(inaddr);
+	const int family = AF_INET;
+
+	inaddr.sin_family = AF_INET;
+	inaddr.sin_port= htons(80);
+	inaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+#elif USE_IP_VER == 6
+	struct sockaddr_in6 inaddr;
+	const size_t inaddrlen = sizeof(inaddr);
+	const int family = AF_INET6;
+
+	inaddr.sin6_family = AF_INET6;
+	inaddr.sin6_port= htons(80);
+	memcpy(&inaddr.sin6_addr, &in6addr_any, sizeof(inaddr.sin6_addr));
+#else
+#error Unknown USE_IP_VER
+#endif
+
+	httpd_basedir = argc > 1 ? argv[1] : "/";
+
+	if (-1 == pipe(httpd_wake)) {
+		httpd_error("pipe() failure: %s", strerror(errno));
+		return -errno;
+	}
+	httpd_set_nonblock(httpd_wake[0], 1);
+
+	for (i = 0; i < CGI_WORKERS; i++) {
+		err = pthread_create(&thread, NULL, httpd_cgi_worker, NULL);
+		if (err) {
+			httpd_error("can't start CGI worker: %s", strerror(err));
+			return -err;
+		}
+		pthread_detach(thread);
+	}
+
+	host = socket(family, SOCK_STREAM, IPPROTO_TCP);
+	if (host == -1) {
+		httpd_error("socket() failure: %s", strerror(errno));
+		return -errno;
+	}
+
+	if (-1 == bind(host, (struct sockaddr *) &inaddr, inaddrlen)) {
+		httpd_error("bind() failure: %s", strerror(errno));
+		close(host);
+		return -errno;
+	}
+
+	if (-1 == listen(host, MAX_CONNS)) {
+		httpd_error("listen() failure: %s", strerror(errno));
+		close(host);
+		return -errno;
+	}
+	httpd_set_nonblock(host, 1);
+
+	httpd_ev_loop(host, inaddrlen);
+
+	close(host);
+
+	return 0;
+}
@@ -7,8 +7,11 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/sendfile.h>
 #include "httpd.h"
 
 #define PAGE_INDEX  "index.html"
@@ -17,9 +20,8 @@ int httpd_try_respond_file(const struct client_info *cinfo, const struct http_re
 		char *buf, size_t buf_sz) {
 	char path[HTTPD_MAX_PATH];
 	char *uri_path;
-	size_t read_bytes;
-	FILE *file;
-	int path_len, retcode, cbyte;
+	ssize_t sent_bytes;
+	int path_len, retcode, cbyte, fd;
 
 	if (0 == strcmp(hreq->uri.target, "/")) {
 		uri_path = PAGE_INDEX;
@@ -34,8 +36,8 @@ int httpd_try_respond_file(const struct client_info *cinfo, const struct http_re
 
 	httpd_debug("requested: %s, on fs: %s", hreq->uri.target, path);
 
-	file = fopen(path, "r");
-	if (!file) {
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
 		httpd_debug("file couldn't be opened (%d)", errno);
 		return 0;
 	}
@@ -52,27 +54,15 @@ int httpd_try_respond_file(const struct client_info *cinfo, const struct http_re
 		goto out;
 	}
 
+	/* File goes to the socket without passing through buf */
 	retcode = 1;
-	while (0 != (read_bytes = fread(buf, 1, buf_sz, file))) {
-		const char *pb;
-		int remain_send_bytes;
-
-		pb = buf;
-		remain_send_bytes = read_bytes;
-		while (remain_send_bytes) {
-			int sent_bytes;
-
-			if (0 > (sent_bytes = write(cinfo->ci_sock, pb, read_bytes))) {
-				retcode = sent_bytes;
-				break;
-			}
-
-			pb += sent_bytes;
-			remain_send_bytes -= sent_bytes;
+	while (0 != (sent_bytes = sendfile(cinfo->ci_sock, fd, NULL, INT_MAX))) {
+		if (sent_bytes < 0) {
+			retcode = -errno;
+			break;
 		}
 	}
 out:
-	fclose(file);
+	close(fd);
 	return retcode;
 }
-
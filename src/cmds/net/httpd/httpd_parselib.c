@@ -19,6 +19,9 @@ static const struct http_header_desc {
 } http_headers[] = {
 	{ .name = "Content-Length: ", .hreq_offset = offsetof(struct http_req, content_len), },
 	{ .name = "Content-Type: ", .hreq_offset = offsetof(struct http_req, content_type), },
+	{ .name = "Connection: ", .hreq_offset = offsetof(struct http_req, connection), },
+	{ .name = "If-None-Match: ", .hreq_offset = offsetof(struct http_req, if_none_match), },
+	{ .name = "Accept-Encoding: ", .hreq_offset = offsetof(struct http_req, accept_encoding), },
 };
 
 static char *httpd_parse_uri(char *str, struct http_req_uri *huri) {
@@ -63,11 +66,13 @@ static char *httpd_parse_request_line(char *str, struct http_req *hreq) {
 		return NULL;
 	}
 
+	hreq->version = pb;
 	pb = strstr(pb, "\r\n");
 	if (!pb) {
 		httpd_error("can't find sentinel");
 		return NULL;
 	}
+	*pb = '\0';
 
 	return pb + strlen("\r\n");
 }
@@ -0,0 +1,92 @@
+/**
+ * @file
+ * @brief Latency benchmark for fork() and fork()+exec()
+ *
+ * @date 19.10.2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <kernel/time/ktime.h>
+
+static void print_usage(void) {
+	printf("Usage: fork_bench [-h] [-n iterations] [-e command]\n");
+}
+
+static int fork_wait_once(char *exec_cmd) {
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid < 0) {
+		return pid;
+	}
+
+	if (pid == 0) {
+		if (exec_cmd) {
+			char *argv[] = { exec_cmd, NULL };
+
+			execv(exec_cmd, argv);
+		}
+		_exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) != pid) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int opt, i;
+	int iters = 100;
+	char *exec_cmd = NULL;
+	uint64_t start, t, total = 0, max = 0;
+
+	while (-1 != (opt = getopt(argc, argv, "hn:e:"))) {
+		switch (opt) {
+		case 'n':
+			iters = strtol(optarg, NULL, 0);
+			break;
+		case 'e':
+			exec_cmd = optarg;
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return 0;
+		}
+	}
+
+	if (iters <= 0) {
+		print_usage();
+		return -1;
+	}
+
+	for (i = 0; i < iters; i++) {
+		start = ktime_get_ns();
+		if (fork_wait_once(exec_cmd)) {
+			printf("fork_bench: iteration %d failed\n", i);
+			return -1;
+		}
+		t = ktime_get_ns() - start;
+
+		total += t;
+		if (t > max) {
+			max = t;
+		}
+	}
+
+	printf("%s: %d iterations, avg %u us, max %u us\n",
+			exec_cmd ? "fork+exec" : "fork",
+			iters,
+			(unsigned) (total / iters / 1000),
+			(unsigned) (max / 1000));
+
+	return 0;
+}
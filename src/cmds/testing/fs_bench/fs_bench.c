@@ -0,0 +1,200 @@
+/**
+ * @file
+ * @brief Sequential and random file read/write throughput benchmark
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <kernel/time/ktime.h>
+
+static void print_usage(void) {
+	printf("Usage: fs_bench [-h] [-s size] [-b block] [-r count] file\n");
+}
+
+static void print_result(const char *pass, size_t bytes, uint64_t ns) {
+	uint64_t us = ns / 1000;
+
+	if (!us) {
+		us = 1;
+	}
+
+	printf("%-8s %8u bytes %8u us %8u KiB/s\n", pass,
+			(unsigned) bytes, (unsigned) us,
+			(unsigned) ((uint64_t) bytes * 1000000 / us / 1024));
+}
+
+static int bench_write(const char *path, char *buf, size_t size, size_t block) {
+	uint64_t start;
+	size_t done;
+	int fd, ret = 0;
+
+	fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+	if (fd < 0) {
+		return -errno;
+	}
+
+	start = ktime_get_ns();
+	for (done = 0; done < size; done += block) {
+		if (write(fd, buf, block) != (ssize_t) block) {
+			ret = -EIO;
+			break;
+		}
+	}
+	close(fd);
+
+	if (!ret) {
+		print_result("seq-wr", size, ktime_get_ns() - start);
+	}
+	return ret;
+}
+
+static int bench_read(const char *path, char *buf, size_t size, size_t block) {
+	uint64_t start;
+	size_t done;
+	int fd, ret = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -errno;
+	}
+
+	start = ktime_get_ns();
+	for (done = 0; done < size; done += block) {
+		if (read(fd, buf, block) != (ssize_t) block) {
+			ret = -EIO;
+			break;
+		}
+	}
+	close(fd);
+
+	if (!ret) {
+		print_result("seq-rd", size, ktime_get_ns() - start);
+	}
+	return ret;
+}
+
+static int bench_rand_read(const char *path, char *buf, size_t size,
+		size_t block, int count) {
+	uint64_t start;
+	off_t off;
+	int fd, i, ret = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -errno;
+	}
+
+	srand(1);
+	start = ktime_get_ns();
+	for (i = 0; i < count; i++) {
+		off = (off_t) (rand() % (size / block)) * block;
+		if (lseek(fd, off, SEEK_SET) != off
+				|| read(fd, buf, block) != (ssize_t) block) {
+			ret = -EIO;
+			break;
+		}
+	}
+	close(fd);
+
+	if (!ret) {
+		print_result("rand-rd", (size_t) count * block, ktime_get_ns() - start);
+	}
+	return ret;
+}
+
+static int bench_rand_write(const char *path, char *buf, size_t size,
+		size_t block, int count) {
+	uint64_t start;
+	off_t off;
+	int fd, i, ret = 0;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0) {
+		return -errno;
+	}
+
+	srand(2);
+	start = ktime_get_ns();
+	for (i = 0; i < count; i++) {
+		off = (off_t) (rand() % (size / block)) * block;
+		if (lseek(fd, off, SEEK_SET) != off
+				|| write(fd, buf, block) != (ssize_t) block) {
+			ret = -EIO;
+			break;
+		}
+	}
+	close(fd);
+
+	if (!ret) {
+		print_result("rand-wr", (size_t) count * block, ktime_get_ns() - start);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	int opt, ret;
+	size_t i, size = 256 * 1024;
+	size_t block = 4096;
+	int count = 256;
+	const char *path;
+	char *buf;
+
+	while (-1 != (opt = getopt(argc, argv, "hs:b:r:"))) {
+		switch (opt) {
+		case 's':
+			size = strtol(optarg, NULL, 0);
+			break;
+		case 'b':
+			block = strtol(optarg, NULL, 0);
+			break;
+		case 'r':
+			count = strtol(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return 0;
+		}
+	}
+
+	if (optind >= argc || !block || size < block || count < 0) {
+		print_usage();
+		return -EINVAL;
+	}
+	path = argv[optind];
+	size -= size % block;
+
+	buf = malloc(block);
+	if (!buf) {
+		return -ENOMEM;
+	}
+	for (i = 0; i < block; i++) {
+		buf[i] = i;
+	}
+
+	ret = bench_write(path, buf, size, block);
+	if (!ret) {
+		ret = bench_read(path, buf, size, block);
+	}
+	if (!ret) {
+		ret = bench_rand_read(path, buf, size, block, count);
+	}
+	if (!ret) {
+		ret = bench_rand_write(path, buf, size, block, count);
+	}
+	if (ret) {
+		printf("fs_bench: %s: error %d\n", path, ret);
+	}
+
+	unlink(path);
+	free(buf);
+
+	return ret;
+}
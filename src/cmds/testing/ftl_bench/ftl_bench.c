@@ -0,0 +1,155 @@
+/**
+ * @file
+ * @brief Random write rate and write amplification of flash translation layer
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <drivers/block_dev.h>
+#include <drivers/flash/flash.h>
+#include <drivers/flash/ftl.h>
+#include <kernel/time/ktime.h>
+#include <util/err.h>
+
+static char sector[4096];
+
+static void print_usage(void) {
+	printf("Usage: ftl_bench [-h] [-u percent] [-w count] flash_dev\n");
+}
+
+static struct flash_dev *flash_by_name(const char *name) {
+	struct flash_dev *fdev;
+	int i;
+
+	for (i = 0; i < flash_max_id(); i++) {
+		fdev = flash_by_id(i);
+		if (fdev && fdev->bdev && !strcmp(fdev->bdev->name, name)) {
+			return fdev;
+		}
+	}
+	return NULL;
+}
+
+/* Driver is called directly to keep the buffer cache out of measurements */
+static int bench_write(struct block_dev *bdev, blkno_t blkno) {
+	memset(sector, blkno, bdev->block_size);
+	if (bdev->driver->write(bdev, sector, bdev->block_size, blkno)
+			!= bdev->block_size) {
+		return -EIO;
+	}
+	return 0;
+}
+
+static int ftl_bench(struct block_dev *bdev, int used_pct, int writes) {
+	struct ftl_stats before, after;
+	blkno_t blk, used;
+	uint64_t start, ns;
+	uint32_t host, prog;
+	int i, ret;
+
+	if (bdev->block_size > sizeof(sector)) {
+		return -EINVAL;
+	}
+
+	used = (bdev->size / bdev->block_size) * used_pct / 100;
+	if (!used) {
+		return -EINVAL;
+	}
+
+	for (blk = 0; blk < used; blk++) {
+		if ((ret = bench_write(bdev, blk))) {
+			return ret;
+		}
+	}
+	if ((ret = ftl_sync(bdev))) {
+		return ret;
+	}
+	ftl_get_stats(bdev, &before);
+
+	start = ktime_get_ns();
+	for (i = 0; i < writes; i++) {
+		if ((ret = bench_write(bdev, rand() % used))) {
+			return ret;
+		}
+	}
+	if ((ret = ftl_sync(bdev))) {
+		return ret;
+	}
+	ns = ktime_get_ns() - start;
+	ftl_get_stats(bdev, &after);
+
+	if (!ns) {
+		ns = 1;
+	}
+	host = after.host_writes - before.host_writes;
+	prog = after.flash_writes - before.flash_writes;
+
+	printf("%u of %u sectors used, %d random writes\n",
+			(unsigned) used, (unsigned) (bdev->size / bdev->block_size),
+			writes);
+	printf("rate     %8u writes/s\n",
+			(unsigned) ((uint64_t) writes * 1000000000 / ns));
+	printf("WA       %5u.%02u (%u programmed, %u moved by GC)\n",
+			prog / host, prog * 100 / host % 100, prog,
+			after.gc_copies - before.gc_copies);
+	printf("erases   %8u (erase counts %u..%u)\n",
+			after.erases - before.erases, after.erase_min, after.erase_max);
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	struct flash_dev *flash;
+	struct block_dev *bdev;
+	int used_pct = 75;
+	int writes = 4096;
+	int opt, ret;
+
+	while (-1 != (opt = getopt(argc, argv, "hu:w:"))) {
+		switch (opt) {
+		case 'u':
+			used_pct = atoi(optarg);
+			break;
+		case 'w':
+			writes = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return 0;
+		}
+	}
+
+	if (optind >= argc || used_pct <= 0 || used_pct > 100 || writes <= 0) {
+		print_usage();
+		return -EINVAL;
+	}
+
+	flash = flash_by_name(argv[optind]);
+	if (!flash) {
+		printf("Flash device \"%s\" not found\n", argv[optind]);
+		return -ENOENT;
+	}
+
+	bdev = ftl_create("ftlbench", flash);
+	if (err(bdev)) {
+		printf("Failed to create FTL: %d\n", err(bdev));
+		return err(bdev);
+	}
+
+	ret = ftl_bench(bdev, used_pct, writes);
+	if (ret) {
+		printf("Benchmark failed: %d\n", ret);
+	}
+
+	ftl_delete(bdev);
+
+	return ret;
+}
@@ -0,0 +1,358 @@
+/**
+ * @file
+ * @brief HTTP load generator in the manner of wrk
+ *
+ * Keeps a number of keep-alive connections busy from one poll() loop, with
+ * up to a pipeline depth of requests in flight on each, and counts the
+ * responses and their latency.
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define CONNS_MAX    32
+#define PIPELINE_MAX 16
+#define REQ_SIZE     256
+#define BUF_SIZE     4096
+
+struct bench_conn {
+	int sock;
+	char buf[BUF_SIZE + 1];
+	size_t len;
+	int in_body;
+	size_t body_left;    /* body of the response being read */
+	int status;
+	int closing;         /* server said Connection: close */
+	int inflight;
+	uint64_t sent[PIPELINE_MAX]; /* start times of requests in flight */
+	int sent_head;
+};
+
+struct bench_stats {
+	unsigned long requests;
+	unsigned long bad_status;
+	unsigned long errors;
+	unsigned long reconnects;
+	uint64_t bytes;
+	uint64_t lat_sum;
+	uint64_t lat_max;
+};
+
+static struct bench_conn conns[CONNS_MAX];
+static struct bench_stats stats;
+static struct sockaddr_in bench_addr;
+static char bench_req[REQ_SIZE];
+static size_t bench_req_len;
+static int bench_pipeline;
+
+static void print_usage(void) {
+	printf("Usage: http_bench [-h] [-z] [-c conns] [-d seconds] "
+			"[-p pipeline] [-a addr] [-P port] [path]\n");
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int conn_send(struct bench_conn *c) {
+	ssize_t ret;
+	size_t done;
+
+	for (done = 0; done < bench_req_len; done += ret) {
+		ret = send(c->sock, bench_req + done, bench_req_len - done, 0);
+		if (ret < 0) {
+			return -errno;
+		}
+	}
+
+	c->sent[(c->sent_head + c->inflight) % PIPELINE_MAX] = now_ns();
+	c->inflight++;
+	return 0;
+}
+
+static int conn_open(struct bench_conn *c) {
+	int ret;
+
+	c->sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (c->sock < 0) {
+		return -errno;
+	}
+	if (connect(c->sock, (struct sockaddr *) &bench_addr, sizeof(bench_addr))) {
+		ret = -errno;
+		close(c->sock);
+		c->sock = -1;
+		return ret;
+	}
+
+	c->len = c->body_left = 0;
+	c->in_body = c->status = c->closing = 0;
+	c->inflight = c->sent_head = 0;
+
+	while (c->inflight < bench_pipeline) {
+		ret = conn_send(c);
+		if (ret) {
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static void conn_close(struct bench_conn *c) {
+	close(c->sock);
+	c->sock = -1;
+}
+
+/* Parses the header at the start of the buffer, returns its length or 0 */
+static size_t conn_header(struct bench_conn *c) {
+	char *end, *cl;
+	size_t len;
+
+	c->buf[c->len] = '\0';
+	end = strstr(c->buf, "\r\n\r\n");
+	if (!end) {
+		return 0;
+	}
+	len = end + 4 - c->buf;
+	*end = '\0';
+
+	c->status = 0;
+	sscanf(c->buf, "HTTP/%*d.%*d %d", &c->status);
+
+	c->body_left = 0;
+	cl = strcasestr(c->buf, "\r\nContent-Length:");
+	if (cl) {
+		c->body_left = strtoul(cl + strlen("\r\nContent-Length:"), NULL, 10);
+	}
+	c->closing = NULL != strcasestr(c->buf, "\r\nConnection: close");
+
+	return len;
+}
+
+static void conn_done(struct bench_conn *c) {
+	uint64_t lat;
+
+	lat = now_ns() - c->sent[c->sent_head];
+	c->sent_head = (c->sent_head + 1) % PIPELINE_MAX;
+	c->inflight--;
+
+	stats.requests++;
+	stats.lat_sum += lat;
+	if (lat > stats.lat_max) {
+		stats.lat_max = lat;
+	}
+	if (c->status < 200 || c->status >= 400) {
+		stats.bad_status++;
+	}
+}
+
+/* Takes the responses out of the buffer and sends a request for each */
+static int conn_process(struct bench_conn *c) {
+	size_t len;
+	int ret;
+
+	for (;;) {
+		if (!c->in_body) {
+			len = conn_header(c);
+			if (!len) {
+				return c->len == BUF_SIZE ? -EMSGSIZE : 0;
+			}
+			c->len -= len;
+			memmove(c->buf, c->buf + len, c->len);
+			c->in_body = 1;
+		}
+
+		len = c->len < c->body_left ? c->len : c->body_left;
+		c->len -= len;
+		memmove(c->buf, c->buf + len, c->len);
+		c->body_left -= len;
+		if (c->body_left) {
+			return 0;
+		}
+
+		conn_done(c);
+		c->in_body = 0;
+		if (c->closing) {
+			return -ECONNRESET;
+		}
+		ret = conn_send(c);
+		if (ret) {
+			return ret;
+		}
+	}
+}
+
+static int conn_read(struct bench_conn *c) {
+	ssize_t nbyte;
+
+	nbyte = recv(c->sock, c->buf + c->len, BUF_SIZE - c->len, 0);
+	if (nbyte <= 0) {
+		return nbyte < 0 ? -errno : -ECONNRESET;
+	}
+	c->len += nbyte;
+	stats.bytes += nbyte;
+
+	return conn_process(c);
+}
+
+static int http_bench(int nconns, int seconds) {
+	struct pollfd fds[CONNS_MAX];
+	uint64_t start, end, ns;
+	int i, ret;
+
+	for (i = 0; i < nconns; i++) {
+		ret = conn_open(&conns[i]);
+		if (ret) {
+			while (i >= 0) {
+				if (conns[i].sock >= 0) {
+					conn_close(&conns[i]);
+				}
+				i--;
+			}
+			return ret;
+		}
+	}
+
+	start = now_ns();
+	end = start + (uint64_t) seconds * 1000000000;
+	while (now_ns() < end) {
+		for (i = 0; i < nconns; i++) {
+			fds[i].fd = conns[i].sock;
+			fds[i].events = POLLIN;
+		}
+		if (0 > poll(fds, nconns, 100)) {
+			if (errno != EINTR) {
+				break;
+			}
+			continue;
+		}
+
+		for (i = 0; i < nconns; i++) {
+			if (!fds[i].revents) {
+				continue;
+			}
+			ret = conn_read(&conns[i]);
+			if (!ret) {
+				continue;
+			}
+
+			/* Closed by the server is not an error if it said so */
+			if (ret != -ECONNRESET || conns[i].inflight) {
+				stats.errors++;
+			} else {
+				stats.reconnects++;
+			}
+			conn_close(&conns[i]);
+			ret = conn_open(&conns[i]);
+			if (ret) {
+				printf("can't reconnect: %d\n", ret);
+				end = 0;
+				break;
+			}
+		}
+	}
+	ns = now_ns() - start;
+
+	for (i = 0; i < nconns; i++) {
+		if (conns[i].sock >= 0) {
+			conn_close(&conns[i]);
+		}
+	}
+
+	printf("  %lu requests in %u.%02us, %lu KB read\n", stats.requests,
+			(unsigned) (ns / 1000000000), (unsigned) (ns / 10000000 % 100),
+			(unsigned long) (stats.bytes / 1024));
+	printf("  Latency avg %lu us, max %lu us\n",
+			(unsigned long) (stats.requests ? stats.lat_sum / stats.requests / 1000 : 0),
+			(unsigned long) (stats.lat_max / 1000));
+	printf("  Non-2xx or 3xx responses: %lu, errors: %lu, reconnects: %lu\n",
+			stats.bad_status, stats.errors, stats.reconnects);
+	printf("Requests/sec: %lu\n",
+			(unsigned long) ((uint64_t) stats.requests * 1000000000 / ns));
+	printf("Transfer/sec: %lu KB\n",
+			(unsigned long) (stats.bytes * 1000000000 / ns / 1024));
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	const char *addr = "127.0.0.1", *path = "/";
+	int nconns = 4, seconds = 5, port = 80, gzip = 0;
+	int opt, ret;
+
+	bench_pipeline = 1;
+	while (-1 != (opt = getopt(argc, argv, "hzc:d:p:a:P:"))) {
+		switch (opt) {
+		case 'z':
+			gzip = 1;
+			break;
+		case 'c':
+			nconns = atoi(optarg);
+			break;
+		case 'd':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			bench_pipeline = atoi(optarg);
+			break;
+		case 'a':
+			addr = optarg;
+			break;
+		case 'P':
+			port = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return 0;
+		}
+	}
+	if (optind < argc) {
+		path = argv[optind];
+	}
+
+	memset(&bench_addr, 0, sizeof(bench_addr));
+	bench_addr.sin_family = AF_INET;
+	bench_addr.sin_port = htons(port);
+	if (nconns <= 0 || nconns > CONNS_MAX || seconds <= 0
+			|| bench_pipeline <= 0 || bench_pipeline > PIPELINE_MAX
+			|| port <= 0 || port > 0xffff
+			|| !inet_aton(addr, &bench_addr.sin_addr)) {
+		print_usage();
+		return -EINVAL;
+	}
+
+	bench_req_len = snprintf(bench_req, sizeof(bench_req),
+			"GET %s HTTP/1.1\r\n"
+			"Host: %s\r\n"
+			"%s"
+			"\r\n",
+			path, addr, gzip ? "Accept-Encoding: gzip\r\n" : "");
+	if (bench_req_len >= sizeof(bench_req)) {
+		print_usage();
+		return -EINVAL;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	printf("Running %ds test @ %s:%d%s\n", seconds, addr, port, path);
+	printf("  %d connections, pipeline %d\n", nconns, bench_pipeline);
+	ret = http_bench(nconns, seconds);
+	if (ret) {
+		printf("Benchmark failed: %d\n", ret);
+	}
+
+	return ret;
+}
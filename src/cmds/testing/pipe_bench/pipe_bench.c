@@ -0,0 +1,145 @@
+/**
+ * @file
+ * @brief Pipe throughput for block sizes from 1 byte to 64 KiB
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <kernel/time/ktime.h>
+#include <util/math.h>
+
+#define MAX_BLOCK 0x10000
+/* Keeps 1-byte runs from taking forever */
+#define MAX_CALLS 0x10000
+
+static char wbuf[MAX_BLOCK];
+static char rbuf[MAX_BLOCK];
+
+struct bench_writer {
+	int fd;
+	size_t block;
+	size_t total;
+	int err;
+};
+
+static void print_usage(void) {
+	printf("Usage: pipe_bench [-h] [-s pipe_size] [-t total_bytes]\n");
+}
+
+static void *writer(void *arg) {
+	struct bench_writer *w = arg;
+	size_t done;
+	ssize_t ret;
+
+	for (done = 0; done < w->total; done += ret) {
+		ret = write(w->fd, wbuf, min(w->block, w->total - done));
+		if (ret <= 0) {
+			w->err = -errno;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static int bench_block(size_t block, size_t total, int pipe_size) {
+	struct bench_writer w;
+	pthread_t thread;
+	uint64_t start, ns;
+	size_t done;
+	ssize_t ret;
+	int fd[2];
+
+	if (pipe(fd)) {
+		return -errno;
+	}
+	if (pipe_size && 0 > fcntl(fd[1], F_SETPIPE_SZ, pipe_size)) {
+		ret = -errno;
+		goto out;
+	}
+
+	w.fd = fd[1];
+	w.block = block;
+	w.total = min(total, block * MAX_CALLS);
+	w.err = 0;
+
+	start = ktime_get_ns();
+	if ((ret = pthread_create(&thread, NULL, writer, &w))) {
+		ret = -ret;
+		goto out;
+	}
+
+	for (done = 0; done < w.total; done += ret) {
+		ret = read(fd[0], rbuf, block);
+		if (ret <= 0) {
+			break;
+		}
+	}
+	ns = ktime_get_ns() - start;
+
+	pthread_join(thread, NULL);
+
+	if (w.err) {
+		ret = w.err;
+		goto out;
+	}
+	if (!ns) {
+		ns = 1;
+	}
+
+	printf("%6u %10u %10u %10u\n", (unsigned) block, (unsigned) w.total,
+			(unsigned) ((uint64_t) w.total * 1000000000 / ns / 1024),
+			(unsigned) ((uint64_t) (w.total / block) * 1000000000 / ns));
+	ret = 0;
+
+out:
+	close(fd[0]);
+	close(fd[1]);
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	size_t total = 0x1000000;
+	int pipe_size = 0;
+	size_t block;
+	int opt, ret;
+
+	while (-1 != (opt = getopt(argc, argv, "hs:t:"))) {
+		switch (opt) {
+		case 's':
+			pipe_size = atoi(optarg);
+			break;
+		case 't':
+			total = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return 0;
+		}
+	}
+
+	if (pipe_size < 0 || total == 0) {
+		print_usage();
+		return -EINVAL;
+	}
+
+	printf("%6s %10s %10s %10s\n", "block", "bytes", "KiB/s", "writes/s");
+	for (block = 1; block <= MAX_BLOCK; block *= 4) {
+		ret = bench_block(block, total, pipe_size);
+		if (ret) {
+			printf("Benchmark failed: %d\n", ret);
+			return ret;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,238 @@
+/**
+ * @file
+ * @brief Throughput of lock-free rings against a spinlocked ring_buff
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <hal/cpu.h>
+#include <kernel/sched/affinity.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <kernel/time/ktime.h>
+#include <util/err.h>
+#include <util/math.h>
+#include <util/mpmc_ring.h>
+#include <util/ring_buff.h>
+#include <util/spsc_ring.h>
+
+#define RING_LEN   1024
+#define MAX_BULK   32
+#define MAX_THREADS 16
+
+enum bench_type {
+	BENCH_SPSC,
+	BENCH_MPMC,
+	BENCH_LOCK,
+};
+
+static enum bench_type type;
+static unsigned int bulk;
+static unsigned int per_producer;
+static unsigned int total;
+static unsigned int consumed;
+
+static uint32_t spsc_storage[RING_LEN];
+static struct spsc_ring spsc;
+
+static uint64_t mpmc_storage[MPMC_RING_STORAGE_SIZE(sizeof(uint32_t), RING_LEN)
+	/ sizeof(uint64_t)];
+static struct mpmc_ring mpmc;
+
+static uint32_t lock_storage[RING_LEN + 1];
+static struct ring_buff lock_rbuff;
+static spinlock_t lock_rbuff_lock = SPIN_STATIC_UNLOCKED;
+
+static void print_usage(void) {
+	printf("Usage: ring_bench [-h] [-t spsc|mpmc|lock] [-p producers] "
+			"[-c consumers] [-b bulk] [-n count]\n");
+}
+
+static unsigned int bench_put(uint32_t *elems, unsigned int n) {
+	unsigned int cnt;
+	ipl_t ipl;
+
+	switch (type) {
+	case BENCH_SPSC:
+		return spsc_ring_enqueue(&spsc, elems, n);
+	case BENCH_MPMC:
+		return mpmc_ring_enqueue(&mpmc, elems, n);
+	default:
+		ipl = spin_lock_ipl(&lock_rbuff_lock);
+		cnt = ring_buff_enqueue(&lock_rbuff, elems, n);
+		spin_unlock_ipl(&lock_rbuff_lock, ipl);
+		return cnt;
+	}
+}
+
+static unsigned int bench_get(uint32_t *elems, unsigned int n) {
+	unsigned int cnt;
+	ipl_t ipl;
+
+	switch (type) {
+	case BENCH_SPSC:
+		return spsc_ring_dequeue(&spsc, elems, n);
+	case BENCH_MPMC:
+		return mpmc_ring_dequeue(&mpmc, elems, n);
+	default:
+		ipl = spin_lock_ipl(&lock_rbuff_lock);
+		cnt = ring_buff_dequeue(&lock_rbuff, elems, n);
+		spin_unlock_ipl(&lock_rbuff_lock, ipl);
+		return cnt;
+	}
+}
+
+static void *producer(void *arg) {
+	uint32_t elems[MAX_BULK];
+	unsigned int done, cnt;
+
+	memset(elems, 0, sizeof(elems));
+
+	for (done = 0; done < per_producer; done += cnt) {
+		cnt = bench_put(elems, min(bulk, per_producer - done));
+		if (!cnt) {
+			/* Let the consumer run if it shares the CPU */
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+static void *consumer(void *arg) {
+	uint32_t elems[MAX_BULK];
+	unsigned int cnt;
+
+	while (__atomic_load_n(&consumed, __ATOMIC_RELAXED) < total) {
+		cnt = bench_get(elems, bulk);
+		if (!cnt) {
+			sched_yield();
+			continue;
+		}
+		__atomic_add_fetch(&consumed, cnt, __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+static int ring_bench(int producers, int consumers) {
+	struct thread *threads[MAX_THREADS];
+	uint64_t start, ns;
+	int i, nthreads, ret = 0;
+
+	spsc_ring_init(&spsc, spsc_storage, sizeof(uint32_t), RING_LEN);
+	mpmc_ring_init(&mpmc, mpmc_storage, sizeof(uint32_t), RING_LEN);
+	ring_buff_init(&lock_rbuff, sizeof(uint32_t), RING_LEN + 1, lock_storage);
+
+	total = producers * per_producer;
+	consumed = 0;
+
+	nthreads = 0;
+	for (i = 0; i < producers + consumers; i++) {
+		threads[i] = thread_create(THREAD_FLAG_SUSPENDED,
+				i < producers ? producer : consumer, NULL);
+		if (err(threads[i])) {
+			ret = err(threads[i]);
+			break;
+		}
+		/* Spread producers and consumers over the CPUs */
+		sched_affinity_set(&threads[i]->schedee.affinity, 1 << (i % NCPU));
+		nthreads++;
+	}
+
+	start = ktime_get_ns();
+	for (i = 0; i < nthreads; i++) {
+		thread_launch(threads[i]);
+	}
+	if (ret) {
+		/* Nobody would stop the consumers */
+		total = 0;
+	}
+	for (i = 0; i < nthreads; i++) {
+		thread_join(threads[i], NULL);
+	}
+	ns = ktime_get_ns() - start;
+
+	if (ret) {
+		return ret;
+	}
+	if (!ns) {
+		ns = 1;
+	}
+
+	printf("%d producers, %d consumers, bulk %u, %d CPUs\n",
+			producers, consumers, bulk, NCPU);
+	printf("%u elements in %u us, %u ops/s\n", total,
+			(unsigned) (ns / 1000),
+			(unsigned) ((uint64_t) total * 1000000000 / ns));
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int producers = 1, consumers = 1;
+	int opt, ret;
+
+	type = BENCH_SPSC;
+	bulk = 1;
+	per_producer = 1000000;
+
+	while (-1 != (opt = getopt(argc, argv, "ht:p:c:b:n:"))) {
+		switch (opt) {
+		case 't':
+			if (!strcmp(optarg, "spsc")) {
+				type = BENCH_SPSC;
+			} else if (!strcmp(optarg, "mpmc")) {
+				type = BENCH_MPMC;
+			} else if (!strcmp(optarg, "lock")) {
+				type = BENCH_LOCK;
+			} else {
+				print_usage();
+				return -EINVAL;
+			}
+			break;
+		case 'p':
+			producers = atoi(optarg);
+			break;
+		case 'c':
+			consumers = atoi(optarg);
+			break;
+		case 'b':
+			bulk = atoi(optarg);
+			break;
+		case 'n':
+			per_producer = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return 0;
+		}
+	}
+
+	if (producers <= 0 || consumers <= 0
+			|| producers + consumers > MAX_THREADS
+			|| bulk == 0 || bulk > MAX_BULK || per_producer == 0) {
+		print_usage();
+		return -EINVAL;
+	}
+	if (type == BENCH_SPSC && (producers != 1 || consumers != 1)) {
+		printf("SPSC ring takes one producer and one consumer\n");
+		return -EINVAL;
+	}
+
+	ret = ring_bench(producers, consumers);
+	if (ret) {
+		printf("Benchmark failed: %d\n", ret);
+	}
+
+	return ret;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file
+ * @brief Latency benchmark for starting ELF executables
+ *
+ * @date 19.10.2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <kernel/task.h>
+#include <kernel/time/ktime.h>
+
+extern int execve_syscall(const char *filename, char *const argv[], char *const envp[]);
+
+static void print_usage(void) {
+	printf("Usage: spawn_bench [-h] [-n iterations] <filename>\n");
+}
+
+static void *spawn_bench_entry(void *filename) {
+	char *argv[2] = {filename, NULL};
+	char *envp[1] = {NULL};
+
+	execve_syscall(filename, argv, envp);
+
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	int opt, i, pid;
+	int iters = 10;
+	char *filename;
+	uint64_t start, t, first = 0, total = 0, max = 0;
+
+	while (-1 != (opt = getopt(argc, argv, "hn:"))) {
+		switch (opt) {
+		case 'n':
+			iters = strtol(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return 0;
+		}
+	}
+
+	if (optind >= argc || iters <= 0) {
+		print_usage();
+		return -1;
+	}
+	filename = argv[optind];
+
+	for (i = 0; i < iters; i++) {
+		start = ktime_get_ns();
+		pid = new_task(filename, spawn_bench_entry, filename);
+		if (pid < 0) {
+			printf("spawn_bench: failed to start %s\n", filename);
+			return pid;
+		}
+		task_waitpid(pid);
+		t = ktime_get_ns() - start;
+
+		if (i == 0) {
+			first = t;
+			continue;
+		}
+
+		total += t;
+		if (t > max) {
+			max = t;
+		}
+	}
+
+	printf("%s: first start %u us\n", filename, (unsigned) (first / 1000));
+	if (iters > 1) {
+		printf("%s: %d restarts, avg %u us, max %u us\n", filename, iters - 1,
+				(unsigned) (total / (iters - 1) / 1000),
+				(unsigned) (max / 1000));
+	}
+
+	return 0;
+}
@@ -0,0 +1,187 @@
+/**
+ * @file
+ * @brief TCP throughput over the loopback with a given congestion control
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <kernel/time/ktime.h>
+#include <util/math.h>
+
+#define BLOCK 0x4000
+
+static char wbuf[BLOCK];
+static char rbuf[BLOCK];
+
+struct bench_sink {
+	int sock;
+	size_t received;
+	int err;
+};
+
+static void print_usage(void) {
+	printf("Usage: tcp_bench [-h] [-c algorithm] [-p port] "
+			"[-t total_bytes]\n");
+}
+
+static void *sink(void *arg) {
+	struct bench_sink *s = arg;
+	ssize_t ret;
+	int conn;
+
+	conn = accept(s->sock, NULL, NULL);
+	if (conn < 0) {
+		s->err = -errno;
+		return NULL;
+	}
+
+	while (0 < (ret = recv(conn, rbuf, sizeof(rbuf), 0))) {
+		s->received += ret;
+	}
+	if (ret < 0) {
+		s->err = -errno;
+	}
+
+	close(conn);
+	return NULL;
+}
+
+static int tcp_bench(const char *cong, int port, size_t total) {
+	struct bench_sink s;
+	struct sockaddr_in addr;
+	char name[TCP_CA_NAME_MAX];
+	socklen_t name_len;
+	pthread_t thread;
+	uint64_t start, ns;
+	size_t done;
+	ssize_t ret;
+	int sock;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	memset(&s, 0, sizeof(s));
+	s.sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s.sock < 0) {
+		return -errno;
+	}
+	if (bind(s.sock, (struct sockaddr *) &addr, sizeof(addr))
+			|| listen(s.sock, 1)) {
+		ret = -errno;
+		close(s.sock);
+		return ret;
+	}
+
+	sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock < 0) {
+		ret = -errno;
+		close(s.sock);
+		return ret;
+	}
+	if (cong && setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, cong,
+				strlen(cong))) {
+		ret = -errno;
+		goto out;
+	}
+	name_len = sizeof(name);
+	if (getsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, name, &name_len)) {
+		ret = -errno;
+		goto out;
+	}
+
+	if ((ret = pthread_create(&thread, NULL, sink, &s))) {
+		ret = -ret;
+		goto out;
+	}
+
+	start = ktime_get_ns();
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr))) {
+		ret = -errno;
+		close(sock);
+		sock = -1;
+		pthread_join(thread, NULL);
+		goto out;
+	}
+	for (done = 0; done < total; done += ret) {
+		ret = send(sock, wbuf, min((size_t) BLOCK, total - done), 0);
+		if (ret <= 0) {
+			break;
+		}
+	}
+	close(sock);
+	sock = -1;
+
+	pthread_join(thread, NULL);
+	ns = ktime_get_ns() - start;
+
+	if (s.err) {
+		ret = s.err;
+		goto out;
+	}
+	if (!ns) {
+		ns = 1;
+	}
+
+	printf("%-8s %10u %10u\n", name, (unsigned) s.received,
+			(unsigned) ((uint64_t) s.received * 1000000000 / ns / 1024));
+	ret = 0;
+
+out:
+	if (sock >= 0) {
+		close(sock);
+	}
+	close(s.sock);
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	const char *cong = NULL;
+	size_t total = 0x400000;
+	int port = 5001;
+	int opt, ret;
+
+	while (-1 != (opt = getopt(argc, argv, "hc:p:t:"))) {
+		switch (opt) {
+		case 'c':
+			cong = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 't':
+			total = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return 0;
+		}
+	}
+
+	if (port <= 0 || port > 0xffff || total == 0) {
+		print_usage();
+		return -EINVAL;
+	}
+
+	printf("%-8s %10s %10s\n", "cc", "bytes", "KiB/s");
+	ret = tcp_bench(cong, port, total);
+	if (ret) {
+		printf("Benchmark failed: %d\n", ret);
+	}
+
+	return ret;
+}
@@ -0,0 +1,250 @@
+/**
+ * @file
+ * @brief TCP connections per second over the loopback
+ *
+ * Each connection is connect, request, response, close, as HTTP/1.0
+ * clients do.
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <kernel/time/ktime.h>
+
+#define LISTENERS_MAX 8
+#define BACKLOG       16
+#define BUF_SIZE      0x400
+
+#define REQUEST "GET / HTTP/1.0\r\n\r\n"
+/* Request that stops a listener */
+#define QUIT    "QUIT\r\n\r\n"
+
+static const char response[] = "HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain\r\n"
+		"Content-Length: 3\r\n"
+		"\r\n"
+		"ok\n";
+
+struct crr_server {
+	int sock;
+	int accepted;
+	int quit;
+	int err;
+	char buf[BUF_SIZE];
+};
+
+static struct crr_server servers[LISTENERS_MAX];
+
+static void print_usage(void) {
+	printf("Usage: tcp_crr [-h] [-e] [-l listeners] [-n count] [-p port]\n");
+}
+
+/* Serves connections one by one until QUIT */
+static void *serve(void *arg) {
+	struct crr_server *s = arg;
+	ssize_t ret;
+	int conn;
+
+	while (!s->quit) {
+		conn = accept(s->sock, NULL, NULL);
+		if (conn < 0) {
+			s->err = -errno;
+			s->quit = 1;
+			return NULL;
+		}
+		s->accepted++;
+
+		ret = recv(conn, s->buf, sizeof(s->buf) - 1, 0);
+		if (ret > 0) {
+			s->quit = !strncmp(s->buf, QUIT, ret);
+			if (send(conn, response, sizeof(response) - 1, 0) < 0) {
+				s->err = -errno;
+			}
+		}
+		else if (ret < 0) {
+			s->err = -errno;
+		}
+
+		close(conn);
+	}
+
+	return NULL;
+}
+
+static int server_open(struct crr_server *s, const struct sockaddr_in *addr,
+		int reuseport) {
+	int ret;
+
+	memset(s, 0, sizeof(*s));
+	s->sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s->sock < 0) {
+		return -errno;
+	}
+	if ((reuseport && setsockopt(s->sock, SOL_SOCKET, SO_REUSEPORT,
+					&reuseport, sizeof(reuseport)))
+			|| bind(s->sock, (const struct sockaddr *) addr, sizeof(*addr))
+			|| listen(s->sock, BACKLOG)) {
+		ret = -errno;
+		close(s->sock);
+		return ret;
+	}
+
+	return 0;
+}
+
+/* Returns bytes of the response or -errno */
+static ssize_t request(const struct sockaddr_in *addr, const char *req,
+		char *buf, size_t len) {
+	ssize_t ret, done;
+	int sock;
+
+	sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock < 0) {
+		return -errno;
+	}
+	if (connect(sock, (const struct sockaddr *) addr, sizeof(*addr))
+			|| send(sock, req, strlen(req), 0) < 0) {
+		ret = -errno;
+		close(sock);
+		return ret;
+	}
+
+	/* Response is read up to EOF, the rest of it is thrown away */
+	done = 0;
+	while (0 < (ret = recv(sock, buf, len, 0))) {
+		done += ret;
+	}
+	if (ret < 0) {
+		done = -errno;
+	}
+
+	close(sock);
+	return done;
+}
+
+static int tcp_crr(int port, int count, int listeners, int external) {
+	static char buf[BUF_SIZE];
+	struct sockaddr_in addr;
+	pthread_t threads[LISTENERS_MAX];
+	uint64_t start, ns;
+	ssize_t len;
+	int ret, i, running;
+
+	ret = 0;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	/* Several listeners share the port with SO_REUSEPORT */
+	for (running = 0; !external && running < listeners; running++) {
+		ret = server_open(&servers[running], &addr, listeners > 1);
+		if (ret == 0) {
+			ret = -pthread_create(&threads[running], NULL, serve,
+					&servers[running]);
+			if (ret != 0) {
+				close(servers[running].sock);
+			}
+		}
+		if (ret != 0) {
+			break;
+		}
+	}
+	listeners = running;
+	if (ret != 0) {
+		goto out;
+	}
+
+	start = ktime_get_ns();
+	for (i = 0; i < count; i++) {
+		len = request(&addr, REQUEST, buf, sizeof(buf));
+		if (len <= 0) {
+			ret = len < 0 ? len : -EPIPE;
+			break;
+		}
+	}
+	ns = ktime_get_ns() - start;
+
+	if (!ret) {
+		if (!ns) {
+			ns = 1;
+		}
+		printf("%10d %10u\n", count,
+				(unsigned) ((uint64_t) count * 1000000000 / ns));
+	}
+
+out:
+	/* Listeners take connections by hash of the ports, so QUIT is sent
+	 * until each of them got it */
+	while (running > 0) {
+		if (request(&addr, QUIT, buf, sizeof(buf)) < 0) {
+			break;
+		}
+		for (i = 0, running = 0; i < listeners; i++) {
+			running += !servers[i].quit;
+		}
+	}
+
+	for (i = 0; i < listeners; i++) {
+		pthread_join(threads[i], NULL);
+		if (!ret && servers[i].err) {
+			ret = servers[i].err;
+		}
+		if (listeners > 1) {
+			printf("listener %d: %d connections\n", i, servers[i].accepted);
+		}
+		close(servers[i].sock);
+	}
+
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	int count = 1000, port = 5003, listeners = 1, external = 0;
+	int opt, ret;
+
+	while (-1 != (opt = getopt(argc, argv, "hel:n:p:"))) {
+		switch (opt) {
+		case 'e':
+			external = 1;
+			break;
+		case 'l':
+			listeners = atoi(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return 0;
+		}
+	}
+
+	if (port <= 0 || port > 0xffff || count <= 0 || listeners <= 0
+			|| listeners > LISTENERS_MAX) {
+		print_usage();
+		return -EINVAL;
+	}
+
+	printf("%10s %10s\n", "conns", "conns/s");
+	ret = tcp_crr(port, count, listeners, external);
+	if (ret) {
+		printf("Benchmark failed: %d\n", ret);
+	}
+
+	return ret;
+}
@@ -0,0 +1,252 @@
+/**
+ * @file
+ * @brief TCP request/response rate and packets per message over the loopback
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <kernel/time/ktime.h>
+#include <net/netdevice.h>
+
+#define MSG_SIZE_MAX 0x4000
+
+static char cbuf[MSG_SIZE_MAX];
+static char sbuf[MSG_SIZE_MAX];
+
+struct rr_server {
+	int sock;
+	size_t size;
+	int nodelay;
+	int err;
+};
+
+static void print_usage(void) {
+	printf("Usage: tcp_rr [-h] [-c] [-d] [-n count] [-p port] [-s size] "
+			"[-w writes]\n");
+}
+
+/* Returns @a len, zero on EOF or -errno */
+static ssize_t recv_all(int sock, char *buf, size_t len) {
+	size_t done;
+	ssize_t ret;
+
+	for (done = 0; done < len; done += ret) {
+		ret = recv(sock, buf + done, len - done, 0);
+		if (ret <= 0) {
+			return ret < 0 ? -errno : 0;
+		}
+	}
+	return len;
+}
+
+static void *echo(void *arg) {
+	struct rr_server *s = arg;
+	ssize_t ret;
+	int conn;
+
+	conn = accept(s->sock, NULL, NULL);
+	if (conn < 0) {
+		s->err = -errno;
+		return NULL;
+	}
+	if (s->nodelay && setsockopt(conn, IPPROTO_TCP, TCP_NODELAY,
+				&s->nodelay, sizeof(s->nodelay))) {
+		s->err = -errno;
+		close(conn);
+		return NULL;
+	}
+
+	while (0 < (ret = recv_all(conn, sbuf, s->size))) {
+		if (send(conn, sbuf, s->size, 0) != (ssize_t) s->size) {
+			ret = -errno;
+			break;
+		}
+	}
+	if (ret < 0) {
+		s->err = ret;
+	}
+
+	close(conn);
+	return NULL;
+}
+
+static unsigned long lo_packets(void) {
+	struct net_device *lo;
+
+	lo = netdev_get_by_name("lo");
+	return lo != NULL ? lo->stats.tx_packets : 0;
+}
+
+static int set_cork(int sock, int val) {
+	return setsockopt(sock, IPPROTO_TCP, TCP_CORK, &val, sizeof(val));
+}
+
+static int request(int sock, size_t size, int writes, int cork) {
+	size_t pos, part;
+	int i;
+
+	if (cork && set_cork(sock, 1)) {
+		return -errno;
+	}
+	for (i = 0, pos = 0; i < writes; i++, pos += part) {
+		part = i == writes - 1 ? size - pos : size / writes;
+		if (send(sock, cbuf + pos, part, 0) != (ssize_t) part) {
+			return -errno;
+		}
+	}
+	if (cork && set_cork(sock, 0)) {
+		return -errno;
+	}
+
+	return recv_all(sock, cbuf, size) == (ssize_t) size ? 0 : -EPIPE;
+}
+
+static int tcp_rr(int port, int count, size_t size, int writes,
+		int nodelay, int cork) {
+	struct rr_server s;
+	struct sockaddr_in addr;
+	pthread_t thread;
+	uint64_t start, ns;
+	unsigned long packets;
+	int ret, sock, i;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	memset(&s, 0, sizeof(s));
+	s.size = size;
+	s.nodelay = nodelay;
+	s.sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s.sock < 0) {
+		return -errno;
+	}
+	if (bind(s.sock, (struct sockaddr *) &addr, sizeof(addr))
+			|| listen(s.sock, 1)) {
+		ret = -errno;
+		close(s.sock);
+		return ret;
+	}
+
+	sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock < 0) {
+		ret = -errno;
+		close(s.sock);
+		return ret;
+	}
+	if (nodelay && setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay,
+				sizeof(nodelay))) {
+		ret = -errno;
+		goto out;
+	}
+
+	if ((ret = pthread_create(&thread, NULL, echo, &s))) {
+		ret = -ret;
+		goto out;
+	}
+
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr))) {
+		ret = -errno;
+		close(sock);
+		sock = -1;
+		pthread_join(thread, NULL);
+		goto out;
+	}
+
+	packets = lo_packets();
+	start = ktime_get_ns();
+	for (i = 0; i < count; i++) {
+		ret = request(sock, size, writes, cork);
+		if (ret) {
+			break;
+		}
+	}
+	ns = ktime_get_ns() - start;
+	packets = lo_packets() - packets;
+
+	close(sock);
+	sock = -1;
+	pthread_join(thread, NULL);
+
+	if (ret || s.err) {
+		ret = ret ? ret : s.err;
+		goto out;
+	}
+	if (!ns) {
+		ns = 1;
+	}
+
+	printf("%10d %10u %10u.%02u\n", count,
+			(unsigned) ((uint64_t) count * 1000000000 / ns),
+			(unsigned) (packets / count),
+			(unsigned) (packets * 100 / count % 100));
+	ret = 0;
+
+out:
+	if (sock >= 0) {
+		close(sock);
+	}
+	close(s.sock);
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	int count = 10000, port = 5002, writes = 1;
+	int nodelay = 0, cork = 0;
+	size_t size = 64;
+	int opt, ret;
+
+	while (-1 != (opt = getopt(argc, argv, "hcdn:p:s:w:"))) {
+		switch (opt) {
+		case 'c':
+			cork = 1;
+			break;
+		case 'd':
+			nodelay = 1;
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		case 'w':
+			writes = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return 0;
+		}
+	}
+
+	if (port <= 0 || port > 0xffff || count <= 0 || size == 0
+			|| size > MSG_SIZE_MAX || writes <= 0 || (size_t) writes > size) {
+		print_usage();
+		return -EINVAL;
+	}
+
+	printf("%10s %10s %13s\n", "messages", "msg/s", "packets/msg");
+	ret = tcp_rr(port, count, size, writes, nodelay, cork);
+	if (ret) {
+		printf("Benchmark failed: %d\n", ret);
+	}
+
+	return ret;
+}
@@ -0,0 +1,270 @@
+/**
+ * @file
+ * @brief AF_UNIX stream sockets against TCP over the loopback
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <kernel/time/ktime.h>
+
+#define MSG_SIZE_MAX 0x4000
+
+/* Abstract name, no file is created for it */
+#define BENCH_UNIX_NAME "\0unix_bench"
+
+static char cbuf[MSG_SIZE_MAX];
+static char sbuf[MSG_SIZE_MAX];
+
+struct bench_server {
+	int conn;
+	size_t size;     /* Request size, zero for the stream test */
+	int err;
+};
+
+static void print_usage(void) {
+	printf("Usage: unix_bench [-h] [-n count] [-p port] [-s size] "
+			"[-b bytes]\n");
+}
+
+/* Returns @a len, zero on EOF or -errno */
+static ssize_t recv_all(int sock, char *buf, size_t len) {
+	size_t done;
+	ssize_t ret;
+
+	for (done = 0; done < len; done += ret) {
+		ret = recv(sock, buf + done, len - done, 0);
+		if (ret <= 0) {
+			return ret < 0 ? -errno : 0;
+		}
+	}
+	return len;
+}
+
+static ssize_t send_all(int sock, const char *buf, size_t len) {
+	size_t done;
+	ssize_t ret;
+
+	for (done = 0; done < len; done += ret) {
+		ret = send(sock, buf + done, len - done, 0);
+		if (ret < 0) {
+			return -errno;
+		}
+	}
+	return len;
+}
+
+static void *serve(void *arg) {
+	struct bench_server *s = arg;
+	ssize_t ret;
+
+	if (s->size != 0) {
+		/* Echo */
+		while (0 < (ret = recv_all(s->conn, sbuf, s->size))) {
+			ret = send_all(s->conn, sbuf, s->size);
+			if (ret < 0) {
+				break;
+			}
+		}
+	}
+	else {
+		/* Sink */
+		while (0 < (ret = recv(s->conn, sbuf, sizeof(sbuf), 0)));
+		ret = ret < 0 ? -errno : 0;
+	}
+
+	if (ret < 0) {
+		s->err = ret;
+	}
+	return NULL;
+}
+
+/* Connects @a client to @a server, both are stream sockets of @a family */
+static int bench_connect(int family, int port, int *client, int *server) {
+	union {
+		struct sockaddr sa;
+		struct sockaddr_in in;
+		struct sockaddr_un un;
+	} addr;
+	socklen_t addrlen;
+	int lsock, ret;
+
+	memset(&addr, 0, sizeof(addr));
+	if (family == AF_UNIX) {
+		addr.un.sun_family = AF_UNIX;
+		memcpy(addr.un.sun_path, BENCH_UNIX_NAME, sizeof(BENCH_UNIX_NAME) - 1);
+		addrlen = offsetof(struct sockaddr_un, sun_path)
+				+ sizeof(BENCH_UNIX_NAME) - 1;
+	}
+	else {
+		addr.in.sin_family = AF_INET;
+		addr.in.sin_port = htons(port);
+		addr.in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addrlen = sizeof(addr.in);
+	}
+
+	lsock = socket(family, SOCK_STREAM, 0);
+	if (lsock < 0) {
+		return -errno;
+	}
+	*client = socket(family, SOCK_STREAM, 0);
+	if (*client < 0) {
+		ret = -errno;
+		close(lsock);
+		return ret;
+	}
+
+	/* The connection waits in the backlog, so no thread is needed */
+	if (bind(lsock, &addr.sa, addrlen) || listen(lsock, 1)
+			|| connect(*client, &addr.sa, addrlen)
+			|| (0 > (*server = accept(lsock, NULL, NULL)))) {
+		ret = -errno;
+		close(*client);
+		close(lsock);
+		return ret;
+	}
+
+	close(lsock);
+	return 0;
+}
+
+/* Runs the request/response test if @a size is set, the stream test of
+ * @a bytes otherwise. Returns nanoseconds taken or -errno */
+static int64_t bench_run(int family, int port, int count, size_t size,
+		size_t bytes) {
+	struct bench_server s;
+	pthread_t thread;
+	uint64_t start, ns;
+	size_t part;
+	int64_t ret;
+	int sock, i;
+
+	memset(&s, 0, sizeof(s));
+	s.size = size;
+	ret = bench_connect(family, port, &sock, &s.conn);
+	if (ret) {
+		return ret;
+	}
+
+	if ((ret = pthread_create(&thread, NULL, serve, &s))) {
+		close(sock);
+		close(s.conn);
+		return -ret;
+	}
+
+	start = ktime_get_ns();
+	if (size != 0) {
+		for (i = 0; i < count; i++) {
+			if ((0 > (ret = send_all(sock, cbuf, size)))
+					|| (size != (ret = recv_all(sock, cbuf, size)))) {
+				ret = ret < 0 ? ret : -EPIPE;
+				break;
+			}
+			ret = 0;
+		}
+	}
+	else {
+		for (; bytes != 0; bytes -= part) {
+			part = bytes < sizeof(cbuf) ? bytes : sizeof(cbuf);
+			ret = send_all(sock, cbuf, part);
+			if (ret < 0) {
+				break;
+			}
+			ret = 0;
+		}
+		/* The sink has read everything when it sees EOF */
+		shutdown(sock, SHUT_WR);
+	}
+
+	if (size != 0) {
+		close(sock);
+	}
+	pthread_join(thread, NULL);
+	ns = ktime_get_ns() - start;
+
+	if (size == 0) {
+		close(sock);
+	}
+	close(s.conn);
+
+	if (ret || s.err) {
+		return ret ? ret : s.err;
+	}
+	return ns ? ns : 1;
+}
+
+static int bench(const char *name, int family, int port, int count,
+		size_t size, size_t bytes) {
+	int64_t rr, stream;
+
+	rr = bench_run(family, port, count, size, 0);
+	if (rr < 0) {
+		return rr;
+	}
+	stream = bench_run(family, port, 0, 0, bytes);
+	if (stream < 0) {
+		return stream;
+	}
+
+	printf("%-8s %10u %10u %12u\n", name,
+			(unsigned) ((uint64_t) count * 1000000000 / rr),
+			(unsigned) (rr / count),
+			(unsigned) ((uint64_t) bytes * 1000000000 / 1024 / stream));
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int count = 10000, port = 5003;
+	size_t size = 64, bytes = 4 * 1024 * 1024;
+	int opt, ret;
+
+	while (-1 != (opt = getopt(argc, argv, "hn:p:s:b:"))) {
+		switch (opt) {
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		case 'b':
+			bytes = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return 0;
+		}
+	}
+
+	if (port <= 0 || port > 0xffff || count <= 0 || size == 0
+			|| size > MSG_SIZE_MAX || bytes == 0) {
+		print_usage();
+		return -EINVAL;
+	}
+
+	printf("%-8s %10s %10s %12s\n", "family", "msg/s", "ns/msg", "KB/s");
+	ret = bench("unix", AF_UNIX, port, count, size, bytes);
+	if (!ret) {
+		ret = bench("tcp", AF_INET, port, count, size, bytes);
+	}
+	if (ret) {
+		printf("Benchmark failed: %d\n", ret);
+	}
+
+	return ret;
+}
@@ -0,0 +1,285 @@
+/**
+ * @file
+ * @brief POSIX asynchronous I/O on top of aioq
+ *
+ * All requests of the system go through one aioq. The address of the
+ * aiocb is the user data of its request, whoever reaps a completion
+ * fills the aiocb it belongs to.
+ *
+ * @date 19.10.2026
+ */
+
+#include <aio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <framework/mod/options.h>
+#include <fs/aioq.h>
+#include <kernel/sched.h>
+#include <kernel/thread/sync/mutex.h>
+#include <kernel/thread/waitq.h>
+#include <util/array.h>
+#include <util/err.h>
+#include <util/math.h>
+
+#define AIO_QUEUE_SIZE OPTION_GET(NUMBER, queue_size)
+
+static struct aioq *aio_queue;
+static struct mutex aio_lock = MUTEX_INIT(aio_lock);
+
+static struct aioq *aio_queue_get(void) {
+	struct aioq *q;
+
+	mutex_lock(&aio_lock);
+	if (!aio_queue) {
+		q = aioq_create(AIO_QUEUE_SIZE);
+		if (!err(q)) {
+			aio_queue = q;
+		}
+	}
+	mutex_unlock(&aio_lock);
+
+	return aio_queue;
+}
+
+static void aio_reap(int min, int timeout) {
+	struct aioq_cqe cqes[8];
+	struct aiocb *cb;
+	int i, n, total = 0;
+
+	if (!aio_queue) {
+		return;
+	}
+
+	do {
+		n = aioq_reap(aio_queue, cqes, min, ARRAY_SIZE(cqes), timeout);
+		for (i = 0; i < n; i++) {
+			cb = (struct aiocb *) (uintptr_t) cqes[i].user_data;
+			cb->__return = cqes[i].res < 0 ? -1 : cqes[i].res;
+			/* __error is what others look at, so it goes last */
+			__atomic_store_n(&cb->__error,
+					cqes[i].res < 0 ? -cqes[i].res : 0, __ATOMIC_RELEASE);
+		}
+		total += max(n, 0);
+		min = 0;
+	} while (n == ARRAY_SIZE(cqes));
+
+	if (total) {
+		/* Others in aio_suspend() may wait for what was reaped here */
+		waitq_wakeup_all(&aio_queue->cq_wait.not_empty);
+	}
+
+	if (!spsc_ring_empty(&aio_queue->sq)) {
+		/* Kernel ran out of requests at submission, completions above
+		 * have returned some */
+		mutex_lock(&aio_lock);
+		aioq_submit(aio_queue);
+		mutex_unlock(&aio_lock);
+	}
+}
+
+/* Offset is only for the descriptors which have one */
+static off_t aio_offset(struct aiocb *cb, int write) {
+	struct stat st;
+
+	if (fstat(cb->aio_fildes, &st)
+			|| !(S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+		return -1;
+	}
+	if (write && (fcntl(cb->aio_fildes, F_GETFL) & O_APPEND)) {
+		return -1;
+	}
+	return cb->aio_offset;
+}
+
+static int aio_prepare(struct aiocb *cb, int opcode, struct aioq_sqe *sqe) {
+	if (cb->aio_sigevent.sigev_notify != SIGEV_NONE) {
+		return -EINVAL;
+	}
+
+	sqe->opcode = opcode;
+	sqe->fd = cb->aio_fildes;
+	sqe->addr = (void *) cb->aio_buf;
+	sqe->len = cb->aio_nbytes;
+	sqe->user_data = (uintptr_t) cb;
+
+	switch (opcode) {
+	case AIOQ_OP_READ:
+		sqe->off = aio_offset(cb, 0);
+		break;
+	case AIOQ_OP_WRITE:
+		sqe->off = aio_offset(cb, 1);
+		break;
+	default:
+		sqe->off = -1;
+		break;
+	}
+
+	cb->__return = 0;
+	cb->__error = EINPROGRESS;
+
+	return 0;
+}
+
+/* Queues and submits all @a n, none if there is no room for them */
+static int aio_submit(struct aioq_sqe *sqes, int n) {
+	struct aioq *q;
+	int ret;
+
+	q = aio_queue_get();
+	if (!q) {
+		return -EAGAIN;
+	}
+
+	mutex_lock(&aio_lock);
+	if (spsc_ring_space(&q->sq) < n) {
+		ret = -EAGAIN;
+	} else {
+		aioq_queue(q, sqes, n);
+		ret = aioq_submit(q);
+		/* What is left is taken by the next submission */
+		ret = ret < 0 && ret != -EAGAIN ? ret : 0;
+	}
+	mutex_unlock(&aio_lock);
+
+	return ret;
+}
+
+static int aio_start(struct aiocb *cb, int opcode) {
+	struct aioq_sqe sqe;
+	int ret;
+
+	if ((ret = aio_prepare(cb, opcode, &sqe))
+			|| (ret = aio_submit(&sqe, 1))) {
+		return SET_ERRNO(-ret);
+	}
+
+	return 0;
+}
+
+int aio_read(struct aiocb *aiocbp) {
+	return aio_start(aiocbp, AIOQ_OP_READ);
+}
+
+int aio_write(struct aiocb *aiocbp) {
+	return aio_start(aiocbp, AIOQ_OP_WRITE);
+}
+
+int aio_fsync(int op, struct aiocb *aiocbp) {
+	if (op != O_SYNC && op != O_DSYNC) {
+		return SET_ERRNO(EINVAL);
+	}
+	return aio_start(aiocbp, AIOQ_OP_FSYNC);
+}
+
+int aio_error(const struct aiocb *aiocbp) {
+	int error;
+
+	error = __atomic_load_n(&aiocbp->__error, __ATOMIC_ACQUIRE);
+	if (error == EINPROGRESS) {
+		aio_reap(0, 0);
+		error = __atomic_load_n(&aiocbp->__error, __ATOMIC_ACQUIRE);
+	}
+
+	return error;
+}
+
+ssize_t aio_return(struct aiocb *aiocbp) {
+	if (aio_error(aiocbp) == EINPROGRESS) {
+		return SET_ERRNO(EINVAL);
+	}
+	if (aiocbp->__error) {
+		return SET_ERRNO(aiocbp->__error);
+	}
+	return aiocbp->__return;
+}
+
+static int aio_any_done(const struct aiocb *const list[], int nent) {
+	int i;
+
+	for (i = 0; i < nent; i++) {
+		if (list[i] && __atomic_load_n(&list[i]->__error, __ATOMIC_ACQUIRE)
+				!= EINPROGRESS) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int aio_suspend(const struct aiocb *const list[], int nent,
+		const struct timespec *timeout) {
+	int ms, ret;
+
+	ms = timeout ? timeout->tv_sec * 1000 + timeout->tv_nsec / 1000000
+		: SCHED_TIMEOUT_INFINITE;
+
+	if (!aio_queue) {
+		return SET_ERRNO(EAGAIN);
+	}
+
+	/* Completions reaped here may belong to others, so loop */
+	while (aio_reap(0, 0), !aio_any_done(list, nent)) {
+		ret = WAITQ_WAIT_TIMEOUT(&aio_queue->cq_wait.not_empty,
+				mpmc_ring_can_dequeue(&aio_queue->cq)
+					|| aio_any_done(list, nent),
+				ms);
+		if (ret) {
+			return SET_ERRNO(ret == -ETIMEDOUT ? EAGAIN : EINTR);
+		}
+	}
+
+	return 0;
+}
+
+int aio_cancel(int fd, struct aiocb *aiocbp) {
+	if (aiocbp && aio_error(aiocbp) != EINPROGRESS) {
+		return AIO_ALLDONE;
+	}
+	if (!aiocbp && (!aio_queue
+			|| !__atomic_load_n(&aio_queue->inflight, __ATOMIC_ACQUIRE))) {
+		return AIO_ALLDONE;
+	}
+	/* Requests are handed to the workers at once and can't be taken back */
+	return AIO_NOTCANCELED;
+}
+
+int lio_listio(int mode, struct aiocb *const list[], int nent,
+		struct sigevent *sig) {
+	struct aioq_sqe sqes[nent];
+	int i, n, ret;
+
+	if ((mode != LIO_WAIT && mode != LIO_NOWAIT)
+			|| (sig && sig->sigev_notify != SIGEV_NONE)) {
+		return SET_ERRNO(EINVAL);
+	}
+
+	for (i = 0, n = 0; i < nent; i++) {
+		if (!list[i] || list[i]->aio_lio_opcode == LIO_NOP) {
+			continue;
+		}
+		ret = aio_prepare(list[i], list[i]->aio_lio_opcode == LIO_READ
+				? AIOQ_OP_READ : AIOQ_OP_WRITE, &sqes[n]);
+		if (ret) {
+			return SET_ERRNO(-ret);
+		}
+		n++;
+	}
+
+	/* One submission for the whole list */
+	if (n && (ret = aio_submit(sqes, n))) {
+		return SET_ERRNO(-ret);
+	}
+
+	if (mode == LIO_WAIT) {
+		for (i = 0; i < nent; i++) {
+			while (list[i] && list[i]->aio_lio_opcode != LIO_NOP
+					&& aio_error(list[i]) == EINPROGRESS) {
+				aio_reap(1, SCHED_TIMEOUT_INFINITE);
+			}
+		}
+	}
+
+	return 0;
+}
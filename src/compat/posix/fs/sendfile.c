@@ -0,0 +1,70 @@
+/**
+ * @file
+ * @brief sendfile() and splice() over idesc_splice()
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/sendfile.h>
+
+#include <fs/index_descriptor.h>
+#include <fs/idesc.h>
+#include <kernel/task/resource/idesc_table.h>
+
+static struct idesc *splice_idesc_get(int fd) {
+	if (!idesc_index_valid(fd)) {
+		return NULL;
+	}
+	return index_descriptor_get(fd);
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+	struct idesc *in, *out;
+	ssize_t ret;
+
+	if (NULL == (in = splice_idesc_get(in_fd))
+			|| NULL == (out = splice_idesc_get(out_fd))) {
+		return SET_ERRNO(EBADF);
+	}
+
+	ret = idesc_splice(in, offset, out, count);
+	if (ret < 0) {
+		return SET_ERRNO(-ret);
+	}
+
+	return ret;
+}
+
+/* Unlike Linux neither end has to be a pipe. Writing at an offset is
+ * not supported.
+ */
+ssize_t splice(int fd_in, loff_t *off_in, int fd_out,
+		loff_t *off_out, size_t len, unsigned int flags) {
+	struct idesc *in, *out;
+	off_t off;
+	ssize_t ret;
+
+	if (NULL == (in = splice_idesc_get(fd_in))
+			|| NULL == (out = splice_idesc_get(fd_out))) {
+		return SET_ERRNO(EBADF);
+	}
+	if (off_out) {
+		return SET_ERRNO(ESPIPE);
+	}
+
+	if (off_in) {
+		off = *off_in;
+		ret = idesc_splice(in, &off, out, len);
+		*off_in = off;
+	} else {
+		ret = idesc_splice(in, NULL, out, len);
+	}
+	if (ret < 0) {
+		return SET_ERRNO(-ret);
+	}
+
+	return ret;
+}
@@ -9,36 +9,64 @@
  */
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
 
-#include <util/ring_buff.h>
+#include <util/math.h>
 
 #include <framework/mod/options.h>
 #include <kernel/thread/sync/mutex.h>
 #include <kernel/task.h>
 #include <kernel/task/resource/idesc_table.h>
+#include <kernel/task/resource/mmap.h>
 #include <fs/idesc.h>
 #include <fs/idesc_event.h>
+#include <fs/index_descriptor.h>
 
 #include <kernel/thread/thread_sched_wait.h>
 
 #include <kernel/sched.h>
+#include <mem/mmap.h>
+#include <mem/page.h>
+#include <mem/phymem.h>
 #include <mem/sysmalloc.h>
 
-
+#include <module/embox/kernel/addr_space.h>
+#ifdef __MODULE__embox__compat__posix__proc__fork_copy_addr_space__H_
+#include <kernel/task/resource/task_fork.h>
+#endif
+
+/*
+ * Data is kept in a ring of page-sized buffers. A writer appends to the
+ * newest buffer while it has room and takes a new page after that, a
+ * reader frees a buffer as soon as it's drained, so an idle pipe holds
+ * no pages except one spare. Capacity is a number of buffers, set by
+ * F_SETPIPE_SZ.
+ *
+ * A reader which found the pipe empty leaves its iovec in the pipe, the
+ * next writer copies straight into it and wakes it up, data never goes
+ * through the pages then. That is only done when the writer sees the
+ * reader's memory as it is: both tasks are in one vmem context and
+ * neither has memory swapped in and out by fork_nommu. Otherwise the
+ * reader copies out of the pages itself.
+ *
+ * The other side is only woken when it can make progress: the reader
+ * when the pipe stops being empty, the writer when the number of used
+ * buffers drops to the half of the capacity.
+ */
 
 #define DEFAULT_PIPE_BUFFER_SIZE OPTION_GET(NUMBER, pipe_buffer_size)
 #define MAX_PIPE_BUFFER_SIZE     OPTION_GET(NUMBER, max_pipe_buffer_size)
 
-
 #define idesc_to_pipe(desc) ((struct idesc_pipe *) desc)->pipe
 
-struct ring_buff;
 struct idesc;
 struct pipe;
 
@@ -47,9 +75,35 @@ struct idesc_pipe {
 	struct pipe *pipe;
 };
 
+struct pipe_buf {
+	char *page;
+	unsigned int off;               /**< Of the first unread byte */
+	unsigned int len;               /**< Unread bytes */
+};
+
+/* Position in an iovec array */
+struct pipe_iter {
+	const struct iovec *iov;
+	int cnt;
+	size_t off;                     /**< In iov[0] */
+};
+
+/* Reader blocked on the empty pipe */
+struct pipe_reader {
+	struct pipe_iter it;
+	struct task *task;              /**< Owner of the buffer */
+	size_t done;                    /**< Bytes put by a writer directly */
+};
+
 struct pipe {
-	struct ring_buff *buff;         /**< Buffer to store data */
-	size_t buf_size;                /**< Size of buffer. May be changed by pipe_set_buf_size() */
+	struct pipe_buf *bufs;
+	unsigned int nbufs;             /**< Capacity in buffers */
+	unsigned int head;              /**< Oldest buffer */
+	unsigned int used;              /**< Buffers holding data */
+	size_t count;                   /**< Bytes in the pipe */
+	char *spare;                    /**< Page kept for the next write */
+
+	struct pipe_reader *reader;     /**< Waits for a direct copy */
 	struct mutex mutex;             /**< Global pipe mutex */
 
 	struct idesc_pipe read_desc;    /**< Reading end of pipe */
@@ -58,6 +112,37 @@ struct pipe {
 
 static const struct idesc_ops idesc_pipe_ops;
 
+static void pipe_free(struct pipe *pipe);
+
+static inline unsigned int pipe_wake_writer_mark(struct pipe *pipe) {
+	return pipe->nbufs / 2;
+}
+
+static void pipe_iter_init(struct pipe_iter *it, const struct iovec *iov,
+		int cnt) {
+	it->iov = iov;
+	it->cnt = cnt;
+	it->off = 0;
+}
+
+/* Current contiguous chunk of the iovec array, NULL at the end */
+static char *pipe_iter_chunk(struct pipe_iter *it, size_t *len) {
+	while (it->cnt && it->off == it->iov->iov_len) {
+		it->iov++;
+		it->cnt--;
+		it->off = 0;
+	}
+	if (!it->cnt) {
+		return NULL;
+	}
+	*len = it->iov->iov_len - it->off;
+	return (char *) it->iov->iov_base + it->off;
+}
+
+static inline void pipe_iter_advance(struct pipe_iter *it, size_t n) {
+	it->off += n;
+}
+
 static int idesc_pipe_isclosed(struct idesc_pipe *ipipe) {
 	return ipipe->idesc.idesc_amode == 0;
 }
@@ -97,9 +182,7 @@ static void pipe_close(struct idesc *idesc) {
 	ret = idesc_pipe_close(cur, other);
 	mutex_unlock(&pipe->mutex);
 	if (ret) {
-		sysfree(pipe->buff->storage);
-		sysfree(pipe->buff);
-		sysfree(pipe);
+		pipe_free(pipe);
 	}
 }
 
@@ -112,43 +195,196 @@ static int pipe_wait(struct idesc *idesc, struct pipe *pipe, int flags) {
 		mutex_lock(&pipe->mutex));
 }
 
+static char *pipe_page_get(struct pipe *pipe) {
+	char *page;
+
+	if (pipe->spare) {
+		page = pipe->spare;
+		pipe->spare = NULL;
+		return page;
+	}
+	return phymem_alloc(1);
+}
+
+static void pipe_page_put(struct pipe *pipe, char *page) {
+	if (!pipe->spare) {
+		pipe->spare = page;
+	} else {
+		phymem_free(page, 1);
+	}
+}
+
+static inline struct pipe_buf *pipe_buf_at(struct pipe *pipe, unsigned int i) {
+	return &pipe->bufs[(pipe->head + i) % pipe->nbufs];
+}
+
+/* Room at the end of the newest buffer or in a new one */
+static struct pipe_buf *pipe_buf_tail(struct pipe *pipe) {
+	struct pipe_buf *buf;
+
+	if (pipe->used) {
+		buf = pipe_buf_at(pipe, pipe->used - 1);
+		if (buf->off + buf->len < PAGE_SIZE()) {
+			return buf;
+		}
+	}
+	if (pipe->used == pipe->nbufs) {
+		return NULL;
+	}
+
+	buf = pipe_buf_at(pipe, pipe->used);
+	buf->page = pipe_page_get(pipe);
+	if (!buf->page) {
+		return NULL;
+	}
+	buf->off = buf->len = 0;
+	pipe->used++;
+
+	return buf;
+}
+
+static size_t pipe_copy_in(struct pipe *pipe, struct pipe_iter *it) {
+	struct pipe_buf *buf;
+	size_t len, n, res = 0;
+	char *src;
+
+	while ((src = pipe_iter_chunk(it, &len))) {
+		buf = pipe_buf_tail(pipe);
+		if (!buf) {
+			break;
+		}
+		n = min(len, PAGE_SIZE() - (buf->off + buf->len));
+		memcpy(buf->page + buf->off + buf->len, src, n);
+		buf->len += n;
+		pipe_iter_advance(it, n);
+		res += n;
+	}
+
+	if (res && pipe->count == 0) {
+		idesc_notify(&pipe->read_desc.idesc, POLLIN);
+	}
+	pipe->count += res;
+
+	return res;
+}
+
+static size_t pipe_copy_out(struct pipe *pipe, struct pipe_iter *it) {
+	unsigned int used = pipe->used;
+	struct pipe_buf *buf;
+	size_t len, n, res = 0;
+	char *dst;
+
+	while (pipe->used && (dst = pipe_iter_chunk(it, &len))) {
+		buf = pipe_buf_at(pipe, 0);
+		n = min(len, buf->len);
+		memcpy(dst, buf->page + buf->off, n);
+		buf->off += n;
+		buf->len -= n;
+		pipe_iter_advance(it, n);
+		res += n;
+
+		if (!buf->len) {
+			pipe_page_put(pipe, buf->page);
+			buf->page = NULL;
+			pipe->head = (pipe->head + 1) % pipe->nbufs;
+			pipe->used--;
+		}
+	}
+	pipe->count -= res;
+
+	if (used > pipe_wake_writer_mark(pipe)
+			&& pipe->used <= pipe_wake_writer_mark(pipe)
+			&& !idesc_pipe_isclosed(&pipe->write_desc)) {
+		idesc_notify(&pipe->write_desc.idesc, POLLOUT);
+	}
+
+	return res;
+}
+
+/* Whether the current task can write to the memory of @a task */
+static int pipe_task_shares_memory(struct task *task) {
+	if (task == task_self()) {
+		return 1;
+	}
+
+#ifdef __MODULE__embox__compat__posix__proc__fork_copy_addr_space__H_
+	if (fork_addr_space_get(task) || fork_addr_space_get(task_self())) {
+		return 0;
+	}
+#endif
+
+	return task_resource_mmap(task)->ctx == task_self_resource_mmap()->ctx;
+}
+
+/* Copies from the writer straight into the blocked reader */
+static size_t pipe_handoff(struct pipe *pipe, struct pipe_iter *it) {
+	struct pipe_reader *reader = pipe->reader;
+	size_t slen, dlen, n, res = 0;
+	char *src, *dst;
+
+	while ((src = pipe_iter_chunk(it, &slen))
+			&& (dst = pipe_iter_chunk(&reader->it, &dlen))) {
+		n = min(slen, dlen);
+		memcpy(dst, src, n);
+		pipe_iter_advance(it, n);
+		pipe_iter_advance(&reader->it, n);
+		res += n;
+	}
+
+	if (res) {
+		/* The reader is done with one call, like after a read */
+		reader->done = res;
+		pipe->reader = NULL;
+		idesc_notify(&pipe->read_desc.idesc, POLLIN);
+	}
+
+	return res;
+}
+
 static ssize_t pipe_read(struct idesc *idesc, const struct iovec *iov, int cnt) {
+	struct pipe_reader reader;
+	struct pipe_iter it;
 	struct pipe *pipe;
+	size_t len;
 	ssize_t res;
-	void *buf;
-	size_t nbyte;
 
 	assert(iov);
-	buf = iov->iov_base;
-	assert(cnt == 1);
-	nbyte = iov->iov_len;
-	assert(buf);
 	assert(idesc);
 	assert(idesc->idesc_ops == &idesc_pipe_ops);
 	assert(idesc->idesc_amode == S_IROTH);
 
-	if (!nbyte) {
+	pipe_iter_init(&it, iov, cnt);
+	if (!pipe_iter_chunk(&it, &len)) {
 		return 0;
 	}
 
 	pipe = idesc_to_pipe(idesc);
 	mutex_lock(&pipe->mutex);
 	do {
-		res = ring_buff_dequeue(pipe->buff, buf, nbyte);
+		res = pipe_copy_out(pipe, &it);
+		if (res > 0) {
+			break;
+		}
 
 		if (idesc_pipe_isclosed(&pipe->write_desc)) {
 			/* Nothing to do, what's read, that's read */
 			break;
 		}
 
-		if (res > 0) {
-			/* Smth read, notify write end (can't be closed,
- 			 * checked already) */
-			idesc_notify(&pipe->write_desc.idesc, POLLOUT);
-			break;
-		}
+		reader.it = it;
+		reader.task = task_self();
+		reader.done = 0;
+		pipe->reader = &reader;
 
 		res = pipe_wait(idesc, pipe, POLLIN | POLLERR);
+
+		if (pipe->reader == &reader) {
+			pipe->reader = NULL;
+		}
+		if (reader.done) {
+			res = reader.done;
+			break;
+		}
 	} while (res == 0);
 	mutex_unlock(&pipe->mutex);
 
@@ -156,25 +392,22 @@ static ssize_t pipe_read(struct idesc *idesc, const struct iovec *iov, int cnt)
 }
 
 static ssize_t pipe_write(struct idesc *idesc, const struct iovec *iov, int cnt) {
-	size_t nbyte;
+	struct pipe_iter it;
 	struct pipe *pipe;
-	const void *cbuf;
-	int len;
+	size_t len, done;
 	ssize_t res;
 
 	assert(iov);
-	assert(iov->iov_base);
-	assert(cnt == 1);
 	assert(idesc);
 	assert(idesc->idesc_ops == &idesc_pipe_ops);
 	assert(idesc->idesc_amode == S_IWOTH);
 
-	cbuf = iov->iov_base;
-	nbyte = iov->iov_len;
+	pipe_iter_init(&it, iov, cnt);
 	/* nbyte == 0 is ok to passthrough */
 
 	pipe = idesc_to_pipe(idesc);
 	mutex_lock(&pipe->mutex);
+	done = 0;
 	do {
 		/* No data can be readed at all */
 		if (idesc_pipe_isclosed(&pipe->read_desc)) {
@@ -182,20 +415,15 @@ static ssize_t pipe_write(struct idesc *idesc, const struct iovec *iov, int cnt)
 			break;
 		}
 
-		/* Try to write some data */
-		len = ring_buff_enqueue(pipe->buff, (void *) cbuf, nbyte);
-		if (len > 0) {
-			/* Notzero was written, adjust pointers and notify
- 			 * (read end can't be closed) */
-			cbuf += len;
-			nbyte -= len;
-
-			idesc_notify(&pipe->read_desc.idesc, POLLIN);
+		if (pipe->reader && !pipe->count
+				&& pipe_task_shares_memory(pipe->reader->task)) {
+			done += pipe_handoff(pipe, &it);
 		}
+		done += pipe_copy_in(pipe, &it);
 
 		/* Have nothing to write, exit*/
-		if (!nbyte) {
-			res = cbuf - iov->iov_base;
+		if (!pipe_iter_chunk(&it, &len)) {
+			res = 0;
 			break;
 		}
 
@@ -203,61 +431,92 @@ static ssize_t pipe_write(struct idesc *idesc, const struct iovec *iov, int cnt)
 	} while (res == 0);
 	mutex_unlock(&pipe->mutex);
 
-	return res;
+	return done ? done : res;
 }
 
-static int pipe_fcntl(struct idesc *data, int cmd, void * args) {
-	return 0;
+static int pipe_set_size(struct pipe *pipe, size_t size) {
+	struct pipe_buf *bufs;
+	unsigned int nbufs, i;
+
+	if (size > MAX_PIPE_BUFFER_SIZE) {
+		return -EPERM;
+	}
+	nbufs = max((size + PAGE_SIZE() - 1) / PAGE_SIZE(), 1);
+	if (nbufs < pipe->used) {
+		return -EBUSY;
+	}
+
+	bufs = sysmalloc(nbufs * sizeof(*bufs));
+	if (!bufs) {
+		return -ENOMEM;
+	}
+	for (i = 0; i < pipe->used; i++) {
+		bufs[i] = *pipe_buf_at(pipe, i);
+	}
+
+	if (pipe->bufs) {
+		sysfree(pipe->bufs);
+	}
+	pipe->bufs = bufs;
+	pipe->nbufs = nbufs;
+	pipe->head = 0;
+
+	if (pipe->used < nbufs && !idesc_pipe_isclosed(&pipe->write_desc)) {
+		idesc_notify(&pipe->write_desc.idesc, POLLOUT);
+	}
+
+	return nbufs * PAGE_SIZE();
 }
 
-static int idesc_pipe_status(struct idesc *idesc, int mask) {
+static int pipe_fcntl(struct idesc *idesc, int cmd, void *args) {
 	struct pipe *pipe;
 	int res;
 
-	assert(idesc);
+	pipe = idesc_to_pipe(idesc);
 
-	if (!mask) {
+	switch (cmd) {
+	case F_GETPIPE_SZ:
+		return pipe->nbufs * PAGE_SIZE();
+	case F_SETPIPE_SZ:
+		mutex_lock(&pipe->mutex);
+		res = pipe_set_size(pipe, (uintptr_t) args);
+		mutex_unlock(&pipe->mutex);
+		return res;
+	default:
 		return 0;
 	}
+}
+
+static int idesc_pipe_status(struct idesc *idesc, int mask) {
+	struct pipe *pipe;
+	struct pipe_buf *buf;
+	int res;
+
+	assert(idesc);
+
 	pipe = idesc_to_pipe(idesc);
 	assert(pipe);
 
 	res = 0;
 	mutex_lock(&pipe->mutex);
-	switch (mask) {
-	case POLLIN:
-		/* how many we can read */
-		res = ring_buff_get_cnt(pipe->buff);
-		goto out;
-	case POLLOUT:
-		/* how many we can write */
-		res = pipe->buf_size - ring_buff_get_cnt(pipe->buff);
-		goto out;
-	case POLLERR:
-		/* is there any exeptions */
-		res = 0; //TODO Where is errors counter
-		goto out;
-	default:
-		res = 0;
-		break;
-	}
-
 	if (mask & POLLIN) {
 		/* how many we can read */
-		res += ring_buff_get_cnt(pipe->buff);
+		res += pipe->count;
 	}
 
 	if (mask & POLLOUT) {
 		/* how many we can write */
-		res += pipe->buf_size - ring_buff_get_cnt(pipe->buff);
+		res += (pipe->nbufs - pipe->used) * PAGE_SIZE();
+		if (pipe->used) {
+			buf = pipe_buf_at(pipe, pipe->used - 1);
+			res += PAGE_SIZE() - (buf->off + buf->len);
+		}
 	}
 
 	if (mask & POLLERR) {
 		/* is there any exeptions */
 		res += 0; //TODO Where is errors counter
 	}
-
-out:
 	mutex_unlock(&pipe->mutex);
 
 	return res;
@@ -285,40 +544,70 @@ static int idesc_pipe_init(struct idesc_pipe *pdesc, struct pipe *pipe,
 
 static struct pipe *pipe_alloc(void) {
 	struct pipe *pipe;
-	struct ring_buff *pipe_buff;
-	void *storage;
 
-	storage = sysmalloc(DEFAULT_PIPE_BUFFER_SIZE);
-	if (!storage) {
-		return NULL;
-	}
 	pipe = sysmalloc(sizeof(struct pipe));
 	if (!pipe) {
-		sysfree(storage);
 		return NULL;
 	}
-	pipe_buff = sysmalloc(sizeof(struct ring_buff));
-	if (!pipe_buff) {
-		sysfree(storage);
+	memset(pipe, 0, sizeof(*pipe));
+
+	if (0 > pipe_set_size(pipe, DEFAULT_PIPE_BUFFER_SIZE)) {
 		sysfree(pipe);
 		return NULL;
 	}
 
-	pipe->buff = pipe_buff;
-	pipe->buf_size = DEFAULT_PIPE_BUFFER_SIZE - 1;
-	ring_buff_init(pipe_buff, 1, DEFAULT_PIPE_BUFFER_SIZE, storage);
-
 	mutex_init(&pipe->mutex);
 
 	return pipe;
 }
 
 static void pipe_free(struct pipe *pipe) {
-	sysfree(pipe->buff->storage);
-	sysfree(pipe->buff);
+	while (pipe->used) {
+		phymem_free(pipe_buf_at(pipe, 0)->page, 1);
+		pipe->head = (pipe->head + 1) % pipe->nbufs;
+		pipe->used--;
+	}
+	if (pipe->spare) {
+		phymem_free(pipe->spare, 1);
+	}
+	sysfree(pipe->bufs);
 	sysfree(pipe);
 }
 
+ssize_t vmsplice(int fd, const struct iovec *iov, unsigned long nr_segs,
+		unsigned int flags) {
+	struct idesc *idesc;
+	unsigned long i;
+	ssize_t res, done;
+
+	idesc = index_descriptor_get(fd);
+	if (!idesc || idesc->idesc_ops != &idesc_pipe_ops
+			|| idesc->idesc_amode != S_IWOTH) {
+		return SET_ERRNO(EBADF);
+	}
+
+	done = 0;
+	for (i = 0; i < nr_segs; i++) {
+		/* SPLICE_F_GIFT is only a hint. Nothing tells a page from a
+		 * single-page phymem_alloc() from part of a bigger chunk, a heap
+		 * block or a static, so the pipe can't take them to free later */
+		res = pipe_write(idesc, &iov[i], 1);
+
+		if (res < 0) {
+			if (!done) {
+				return SET_ERRNO(-res);
+			}
+			break;
+		}
+		done += res;
+		if ((size_t) res < iov[i].iov_len) {
+			break;
+		}
+	}
+
+	return done;
+}
+
 int pipe(int pipefd[2]) {
 	return pipe2(pipefd, 0);
 }
@@ -280,7 +280,7 @@ static int pty_master_status(struct idesc *idesc, int mask) {
 		res = ring_can_read(&pty_to_tty(pty)->o_ring, TTY_IO_BUFF_SZ, 1);
 		break;
 	case POLLOUT:
-		res = ring_can_write(&pty_to_tty(pty)->rx_ring, TTY_RX_BUFF_SZ, 1);
+		res = spsc_ring_space(&pty_to_tty(pty)->rx_ring) != 0;
 		break;
 	default:
 	case POLLERR:
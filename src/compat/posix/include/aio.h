@@ -0,0 +1,61 @@
+/**
+ * @file
+ * @brief POSIX asynchronous I/O
+ *
+ * Only SIGEV_NONE notification is supported, completion is checked with
+ * aio_error() or waited for with aio_suspend().
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef POSIX_AIO_H_
+#define POSIX_AIO_H_
+
+#include <signal.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+
+struct aiocb {
+	int             aio_fildes;
+	off_t           aio_offset;
+	volatile void  *aio_buf;
+	size_t          aio_nbytes;
+	int             aio_reqprio;   /* Ignored */
+	struct sigevent aio_sigevent;
+	int             aio_lio_opcode;
+
+	/* Private */
+	int             __error;
+	ssize_t         __return;
+};
+
+#define AIO_CANCELED    0
+#define AIO_NOTCANCELED 1
+#define AIO_ALLDONE     2
+
+#define LIO_NOP    0
+#define LIO_READ   1
+#define LIO_WRITE  2
+
+#define LIO_WAIT   0
+#define LIO_NOWAIT 1
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+extern int aio_read(struct aiocb *aiocbp);
+extern int aio_write(struct aiocb *aiocbp);
+extern int aio_error(const struct aiocb *aiocbp);
+extern ssize_t aio_return(struct aiocb *aiocbp);
+extern int aio_suspend(const struct aiocb *const list[], int nent,
+		const struct timespec *timeout);
+extern int aio_cancel(int fd, struct aiocb *aiocbp);
+extern int aio_fsync(int op, struct aiocb *aiocbp);
+extern int lio_listio(int mode, struct aiocb *const list[], int nent,
+		struct sigevent *sig);
+
+__END_DECLS
+
+#endif /* POSIX_AIO_H_ */
@@ -29,6 +29,21 @@ extern int creat(const char *pathname, mode_t mode);
 
 extern int fcntl(int fd, int cmd, ...);
 
+/* TODO not POSIX */
+extern ssize_t splice(int fd_in, loff_t *off_in, int fd_out,
+		loff_t *off_out, size_t len, unsigned int flags);
+
+struct iovec;
+/* TODO not POSIX */
+extern ssize_t vmsplice(int fd, const struct iovec *iov,
+		unsigned long nr_segs, unsigned int flags);
+
+/* splice flags, accepted and ignored */
+#define SPLICE_F_MOVE      0x01
+#define SPLICE_F_NONBLOCK  0x02
+#define SPLICE_F_MORE      0x04
+#define SPLICE_F_GIFT      0x08
+
 /* fcntl commands */
 #define F_GETFD            0
 #define F_SETFD            1
@@ -76,6 +91,10 @@ extern int fcntl(int fd, int cmd, ...);
 /* If path names a symbolic link, fail and set errno to [ELOOP] */
 #define O_NOFOLLOW         0x8000
 
+/* Accepted and ignored, writes are not cached above the file system */
+#define O_SYNC             0x20000
+#define O_DSYNC            0x40000
+
 /* file descriptor flags */
 #define FD_CLOEXEC         0x0010
 /* TODO not POSIX */
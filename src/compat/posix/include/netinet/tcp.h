@@ -13,5 +13,13 @@
 
 /* Options specific for tcp socket */
 #define TCP_NODELAY 0
+#define TCP_CORK       3 /* Send only full segments until uncorked */
+#define TCP_KEEPIDLE   4 /* Seconds of idle before keepalive probes */
+#define TCP_KEEPINTVL  5 /* Seconds between keepalive probes */
+#define TCP_KEEPCNT    6 /* Unanswered probes to drop the connection */
+#define TCP_QUICKACK   12 /* Don't delay the next ACKs */
+#define TCP_CONGESTION 13 /* Congestion control algorithm by name */
+
+#define TCP_CA_NAME_MAX 16
 
 #endif /* NETINET_TCP_H_ */
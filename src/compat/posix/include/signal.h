@@ -88,6 +88,18 @@ union sigval {
 	void *sival_ptr;
 };
 
+#define SIGEV_NONE   0
+#define SIGEV_SIGNAL 1
+#define SIGEV_THREAD 2
+
+struct sigevent {
+	int           sigev_notify;
+	int           sigev_signo;
+	union sigval  sigev_value;
+	void        (*sigev_notify_function)(union sigval);
+	void         *sigev_notify_attributes;
+};
+
 typedef struct {
 	int           si_signo;
 	int           si_code;
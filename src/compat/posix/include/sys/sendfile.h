@@ -0,0 +1,20 @@
+/**
+ * @file
+ * @brief Transfer data between file descriptors
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef SYS_SENDFILE_H_
+#define SYS_SENDFILE_H_
+
+#include <sys/types.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+extern ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+
+__END_DECLS
+
+#endif /* SYS_SENDFILE_H_ */
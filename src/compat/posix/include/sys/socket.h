@@ -47,8 +47,45 @@ struct cmsghdr {
 	socklen_t     cmsg_len;       /* data byte count, including the cmsghdr */
 	int           cmsg_level;     /* originating protocol */
 	int           cmsg_type;      /* protocol-specific type */
+	/* followed by unsigned char cmsg_data[] */
 };
 
+#define CMSG_ALIGN(len) \
+	(((len) + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1))
+#define CMSG_SPACE(len) \
+	(CMSG_ALIGN(sizeof(struct cmsghdr)) + CMSG_ALIGN(len))
+#define CMSG_LEN(len) \
+	(CMSG_ALIGN(sizeof(struct cmsghdr)) + (len))
+#define CMSG_DATA(cmsg) \
+	((unsigned char *)(cmsg) + CMSG_ALIGN(sizeof(struct cmsghdr)))
+#define CMSG_FIRSTHDR(mhdr) \
+	((size_t)(mhdr)->msg_controllen >= sizeof(struct cmsghdr) \
+		? (struct cmsghdr *)(mhdr)->msg_control : (struct cmsghdr *)NULL)
+#define CMSG_NXTHDR(mhdr, cmsg) \
+	__cmsg_nxthdr(mhdr, cmsg)
+
+static inline struct cmsghdr *__cmsg_nxthdr(const struct msghdr *mhdr,
+		const struct cmsghdr *cmsg) {
+	const char *next, *end;
+
+	if ((size_t)cmsg->cmsg_len < sizeof(struct cmsghdr)) {
+		return NULL;
+	}
+
+	next = (const char *)cmsg + CMSG_ALIGN(cmsg->cmsg_len);
+	end = (const char *)mhdr->msg_control + mhdr->msg_controllen;
+	if ((next + sizeof(struct cmsghdr) > end)
+			|| (next + CMSG_ALIGN(((const struct cmsghdr *)next)->cmsg_len)
+				> end)) {
+		return NULL;
+	}
+
+	return (struct cmsghdr *)next;
+}
+
+/* cmsg_type of SOL_SOCKET level */
+#define SCM_RIGHTS 0x01 /* int[], descriptors passed over AF_UNIX socket */
+
 struct linger {
 	int         l_onoff;          /* indicates whether linger option is enabled */
 	int         l_linger;         /* linger time, in seconds */
@@ -161,7 +198,8 @@ SO_TYPE    Socket type.
 #define SO_BINDTODEVICE 16/* Bind socket to send packet from specified device */
 #define SO_DOMAIN       17 /* int */ /* Socket domain */
 #define SO_PROTOCOL     18 /* int */ /* Socket protocol */
-#define SO_POSIX_MAX    19
+#define SO_REUSEPORT    19 /* int */ /* Non-zero allows several sockets to bind the same address and port */
+#define SO_POSIX_MAX    20
 /* }; */
 
 
@@ -278,6 +316,14 @@ __BEGIN_DECLS
  */
 extern int socket(int domain, int type, int protocol);
 
+/**
+ * create a pair of connected sockets.
+ * @param domain only AF_UNIX is supported
+ * @param sv descriptors of the sockets on return
+ * @return 0 on success. -1 on failure with errno indicating error.
+ */
+extern int socketpair(int domain, int type, int protocol, int sv[2]);
+
 /**
  * bind a socket to an address.
  * @param sockfd socket file descriptor
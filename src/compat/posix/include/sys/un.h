@@ -0,0 +1,18 @@
+/**
+ * @file
+ * @brief Addresses of the UNIX domain sockets
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef COMPAT_POSIX_SYS_UN_H_
+#define COMPAT_POSIX_SYS_UN_H_
+
+#include <sys/socket.h>
+
+struct sockaddr_un {
+	sa_family_t sun_family; /* AF_UNIX */
+	char sun_path[108];     /* Path name, abstract one if starts with zero */
+};
+
+#endif /* COMPAT_POSIX_SYS_UN_H_ */
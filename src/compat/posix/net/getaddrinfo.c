@@ -13,6 +13,7 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <net/lib/dns.h>
 #include <net/util/servent.h>
 
 #include <mem/misc/pool.h>
@@ -164,6 +165,55 @@ static int ai_make(int family, int socktype, int protocol,
 	return 0;
 }
 
+static int explore_hosts(const char *nodename, struct dns_addrs *out_addrs) {
+	struct hostent *he;
+	char **aliases, **he_addr;
+	struct dns_addr *addr;
+
+	sethostent(1);
+
+	while ((he = gethostent()) != NULL) {
+		/* mb it's the official name? */
+		if (strcmp(nodename, he->h_name) == 0) {
+			break;
+		}
+		/* mb it's one of the alternative name? */
+		for (aliases = he->h_aliases; *aliases != NULL; ++aliases) {
+			if (strcmp(nodename, *aliases) == 0) {
+				break;
+			}
+		}
+		if (*aliases != NULL) {
+			break;
+		}
+	}
+
+	if (he != NULL) {
+		out_addrs->count = 0;
+		for (he_addr = he->h_addr_list; (*he_addr != NULL)
+				&& (out_addrs->count < DNS_ADDRS_MAX); ++he_addr) {
+			addr = &out_addrs->addr[out_addrs->count];
+			if ((he->h_addrtype == AF_INET)
+					&& (he->h_length == sizeof addr->addr.in)) {
+				memcpy(&addr->addr.in, *he_addr, sizeof addr->addr.in);
+			}
+			else if ((he->h_addrtype == AF_INET6)
+					&& (he->h_length == sizeof addr->addr.in6)) {
+				memcpy(&addr->addr.in6, *he_addr, sizeof addr->addr.in6);
+			}
+			else {
+				continue;
+			}
+			addr->family = he->h_addrtype;
+			++out_addrs->count;
+		}
+	}
+
+	endhostent();
+
+	return he != NULL ? 0 : -ENOENT;
+}
+
 static int explore_node(const char *nodename,
 		const struct addrinfo *hints, const struct servent *se,
 		struct addrinfo **out_ai) {
@@ -182,9 +232,8 @@ static int explore_node(const char *nodename,
 	} addr;
 	struct sockaddr *sa;
 	socklen_t salen;
-	int ret;
-	struct hostent *he;
-	char **he_addr;
+	int ret, i;
+	struct dns_addrs addrs;
 
 	assert(hints != NULL);
 	assert(se != NULL);
@@ -241,19 +290,23 @@ static int explore_node(const char *nodename,
 		return 0;
 	}
 
-	if (hints->ai_flags & AI_NUMERICHOST) {
-		if (1 == inet_pton(AF_INET, nodename, &addr.in.sin_addr)) {
-			sa = (struct sockaddr *)&addr.in;
-			salen = sizeof addr.in;
-		}
-		else if (1 == inet_pton(AF_INET6, nodename,
-					&addr.in6.sin6_addr)) {
-			sa = (struct sockaddr *)&addr.in6;
-			salen = sizeof addr.in6;
-		}
-		else {
-			return EAI_NONAME;
-		}
+	if (1 == inet_pton(AF_INET, nodename, &addr.in.sin_addr)) {
+		sa = (struct sockaddr *)&addr.in;
+		salen = sizeof addr.in;
+	}
+	else if (1 == inet_pton(AF_INET6, nodename,
+				&addr.in6.sin6_addr)) {
+		sa = (struct sockaddr *)&addr.in6;
+		salen = sizeof addr.in6;
+	}
+	else if (hints->ai_flags & AI_NUMERICHOST) {
+		return EAI_NONAME;
+	}
+	else {
+		sa = NULL;
+	}
+
+	if (sa != NULL) {
 		for (family = family_set; *family != -1; ++family) {
 			for (socktype = socktype_set, protocol = protocol_set;
 					*socktype != -1; ++socktype, ++protocol) {
@@ -273,41 +326,30 @@ static int explore_node(const char *nodename,
 		return 0;
 	}
 
-	he = gethostbyname(nodename);
-	if (he == NULL) {
-		switch (h_errno) {
-		default:
-		case NO_RECOVERY:
-			return EAI_FAIL;
-		case HOST_NOT_FOUND:
-		case NO_DATA:
-			return EAI_NONAME;
-		case TRY_AGAIN:
-			return EAI_AGAIN;
-		}
+	/* the resolver caches answers, both families are queried at once */
+	ret = explore_hosts(nodename, &addrs);
+	if (ret != 0) {
+		ret = dns_lookup(nodename, hints->ai_family, &addrs);
+	}
+	if (ret != 0) {
+		return EAI_NONAME;
 	}
 
-	for (he_addr = he->h_addr_list; *he_addr != NULL; ++he_addr) {
+	for (i = 0; i < addrs.count; ++i) {
 		for (family = family_set; *family != -1; ++family) {
 			for (socktype = socktype_set, protocol = protocol_set;
 					*socktype != -1; ++socktype, ++protocol) {
-				if (*family != he->h_addrtype) {
+				if (*family != addrs.addr[i].family) {
 					continue;
 				}
 				if (*family == AF_INET) {
-					if (he->h_length != sizeof(addr.in.sin_addr)) {
-						continue;
-					}
-					addr.in.sin_addr = *((struct in_addr *)*he_addr);
+					addr.in.sin_addr = addrs.addr[i].addr.in;
 					sa = (struct sockaddr *)&addr.in;
 					salen = sizeof addr.in;
 				}
 				else {
 					assert(*family == AF_INET6);
-					if (he->h_length != sizeof(addr.in6.sin6_addr)) {
-						continue;
-					}
-					addr.in6.sin6_addr = *((struct in6_addr *)*he_addr);
+					addr.in6.sin6_addr = addrs.addr[i].addr.in6;
 					sa = (struct sockaddr *)&addr.in6;
 					salen = sizeof addr.in6;
 				}
@@ -68,62 +68,38 @@ static struct hostent * get_hostent_from_file(const char *hostname) {
 }
 
 static struct hostent * get_hostent_from_net(const char *hostname) {
-	int ret, addr_len;
+	int ret, i;
 	struct hostent *he;
-	struct dns_result result;
-	struct dns_rr *rr;
-	size_t i;
+	struct dns_addrs addrs;
 
-	ret = dns_query(hostname, DNS_RR_TYPE_A, DNS_RR_CLASS_IN, &result);
+	/* answers are cached by the resolver */
+	ret = dns_lookup(hostname, AF_INET, &addrs);
 	if (ret != 0) {
 		h_errno = HOST_NOT_FOUND;
 		return NULL;
 	}
 
-	addr_len = result.an->rdlength;
-
 	if (((he = hostent_create()) == NULL)
 			|| (hostent_set_name(he, hostname) != 0)
-			|| (hostent_set_addr_info(he, AF_INET, addr_len) != 0)) {
-		dns_result_free(&result);
+			|| (hostent_set_addr_info(he, AF_INET,
+					sizeof addrs.addr[0].addr.in) != 0)) {
 		return NULL;
 	}
 
-	for (i = 0, rr = result.an; i < result.ancount; ++i, ++rr) {
-
-		if (rr->rdlength != addr_len) {
-			continue;
-		}
-
-		switch (rr->rtype) {
-		default:
-			ret = 0;
-			break;
-		case DNS_RR_TYPE_A:
-			ret = hostent_add_addr(he, &rr->rdata.a.address[0]);
-			break;
-		case DNS_RR_TYPE_AAAA:
-			ret = hostent_add_addr(he, &rr->rdata.aaaa.address[0]);
-			break;
-		}
-
-		switch(ret) {
+	for (i = 0; i < addrs.count; ++i) {
+		switch (hostent_add_addr(he, (char *)&addrs.addr[i].addr.in)) {
 		case 0:
 			/* continue processing */
 			break;
 		case -ENOMEM:
 		case -ERANGE:
 			/* some addresses can't be inserted, return he as is */
-			goto out_rr_loop;
+			return he;
 		default:
 			/* don't know what to do, through he out */
-			he = NULL;
-			goto out_rr_loop;
+			return NULL;
 		}
 	}
-out_rr_loop:
-
-	dns_result_free(&result);
 
 	return he;
 }
@@ -11,6 +11,7 @@
 #include <string.h>
 #include <errno.h>
 #include <stddef.h>
+#include <unistd.h>
 #include <sys/uio.h>
 #include <sys/socket.h>
 
@@ -66,6 +67,36 @@ int socket(int domain, int type, int protocol) {
 
 	return sockfd;
 }
+
+int socketpair(int domain, int type, int protocol, int sv[2]) {
+	struct sock *sk[2];
+	int ret;
+
+	if (sv == NULL) {
+		return SET_ERRNO(EINVAL);
+	}
+
+	ret = ksocketpair(domain, type, protocol, sk);
+	if (ret != 0) {
+		return SET_ERRNO(-ret);
+	}
+
+	sv[0] = get_index(sk[0]);
+	if (sv[0] < 0) {
+		ksocket_close(sk[0]);
+		ksocket_close(sk[1]);
+		return SET_ERRNO(EMFILE);
+	}
+
+	sv[1] = get_index(sk[1]);
+	if (sv[1] < 0) {
+		close(sv[0]);
+		ksocket_close(sk[1]);
+		return SET_ERRNO(EMFILE);
+	}
+
+	return 0;
+}
 /* fcntl */
 int bind(int sockfd, const struct sockaddr *addr,
 		socklen_t addrlen) {
@@ -171,6 +202,8 @@ ssize_t send(int sockfd, const void *buff, size_t size,
 	msg.msg_namelen = 0;
 	msg.msg_iov = &iov;
 	msg.msg_iovlen = 1;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
 	msg.msg_flags = flags;
 
 	iov.iov_base = (void *)buff;
@@ -210,6 +243,8 @@ ssize_t sendto(int sockfd, const void *buff, size_t size,
 	msg.msg_namelen = addrlen;
 	msg.msg_iov = &iov;
 	msg.msg_iovlen = 1;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
 	msg.msg_flags = flags;
 
 	iov.iov_base = (void *)buff;
@@ -276,6 +311,8 @@ ssize_t recv(int sockfd, void *buff, size_t size, int flags) {
 	msg.msg_namelen = 0;
 	msg.msg_iov = &iov;
 	msg.msg_iovlen = 1;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
 	msg.msg_flags = flags;
 
 	iov.iov_base = buff;
@@ -313,6 +350,8 @@ ssize_t recvfrom(int sockfd, void *buff, size_t size,
 	msg.msg_namelen = addrlen != NULL ? *addrlen : 0;
 	msg.msg_iov = &iov;
 	msg.msg_iovlen = 1;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
 	msg.msg_flags = flags;
 
 	iov.iov_base = buff;
@@ -363,6 +402,7 @@ ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
 
 	msg->msg_name = msg_.msg_name;
 	msg->msg_namelen = msg_.msg_namelen;
+	msg->msg_controllen = msg_.msg_controllen;
 	msg->msg_flags = msg_.msg_flags;
 
 	return ret;
@@ -20,9 +20,6 @@
 const struct idesc_ops task_idx_ops_socket;
 
 static ssize_t socket_read(struct idesc *desc, const struct iovec *iov, int cnt) {
-	int ret;
-	ssize_t ret_size;
-	int i;
 	struct msghdr msg;
 	struct sock *sk = (struct sock *)desc;
 
@@ -37,19 +34,12 @@ static ssize_t socket_read(struct idesc *desc, const struct iovec *iov, int cnt)
 	msg.msg_namelen = 0;
 	msg.msg_iov = (struct iovec *)iov;
 	msg.msg_iovlen = cnt;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
 	msg.msg_flags = 0;
 
-	ret = krecvmsg(sk, &msg, desc->idesc_flags);
-	if (ret != 0) {
-		return ret;
-	}
-
-	ret_size = 0;
-	for (i = 0; i < cnt; i++) {
-		ret_size += iov[i].iov_len;
-	}
-
-	return ret_size;
+	/* Bytes received, zero at the end of the stream */
+	return krecvmsg(sk, &msg, desc->idesc_flags);
 }
 
 static ssize_t socket_write(struct idesc *desc, const struct iovec *iov, int cnt) {
@@ -69,6 +59,8 @@ static ssize_t socket_write(struct idesc *desc, const struct iovec *iov, int cnt
 	msg.msg_namelen = 0;
 	msg.msg_iov = (struct iovec *)iov;
 	msg.msg_iovlen = cnt;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
 	msg.msg_flags = 0;
 
 	ret = ksendmsg(sk, &msg, desc->idesc_flags);
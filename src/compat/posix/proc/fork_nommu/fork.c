@@ -68,7 +68,7 @@ void _NORETURN fork_body(struct pt_regs *ptregs) {
 		 * different task as data source */
 		fork_stack_store(child_adrspc, child->tsk_main);
 		fork_heap_store(&child_adrspc->heap_space, task_self());
-		fork_static_store(&child_adrspc->static_space);
+		fork_static_store(&child_adrspc->static_space, task_self());
 
 		memcpy(&child_adrspc->pt_entry, ptregs, sizeof(*ptregs));
 
@@ -12,12 +12,46 @@
 #include "fork_copy_addr_space.h"
 #include <kernel/task/resource.h>
 #include <kernel/task/resource/task_fork.h>
+#include <kernel/task/resource/module_ptr.h>
 #include <mem/sysmalloc.h>
 
+/* Forked tasks share one memory and take turns in it, even on targets with
+ * an MMU. mmap_full gives each task its own vmem context and mmap_inherit()
+ * maps the parent's pages into the child's, but nothing makes that a
+ * copy-on-write fork yet:
+ *  - thread switch doesn't load the context of the task being run
+ *  - there is no page fault handler to copy a page written to
+ *  - inherited pages are mapped writable into both tasks
+ * Until then the swapping below is kept as cheap as it can be. */
+
+/* Address space whose heap and static data currently occupy the memory.
+ * Heap and statics are swapped out lazily, only when some other address
+ * space which shares the same memory is going to be run, so switching
+ * between threads of the same task or to unrelated tasks costs nothing. */
+static struct addr_space *fork_live_adrspc;
+
 static int fork_addr_space_is_shared(struct addr_space *adrspc) {
 	return adrspc->parent_addr_space || adrspc->child_count;
 }
 
+static int fork_addr_space_same_app(struct addr_space *adrspc, struct task *tk) {
+	return task_module_ptr_get(adrspc->task) == task_module_ptr_get(tk);
+}
+
+static void fork_addr_space_evict(void) {
+	struct addr_space *live;
+
+	live = fork_live_adrspc;
+	if (!live) {
+		return;
+	}
+
+	fork_heap_store(&live->heap_space, live->task);
+	fork_static_store(&live->static_space, live->task);
+
+	fork_live_adrspc = NULL;
+}
+
 void fork_addr_space_prepare_switch() {
 	struct addr_space *adrspc;
 
@@ -29,10 +63,11 @@ void fork_addr_space_prepare_switch() {
 	if (!fork_addr_space_is_shared(adrspc))
 		return;
 
-	fork_addr_space_store(adrspc);
+	/* Stack is shared with the thread we are going to switch to,
+	 * so it can't be left in place. */
+	fork_stack_store(adrspc, thread_self());
 }
 
-
 void fork_addr_space_finish_switch(void *safe_point) {
 	struct addr_space *adrspc;
 
@@ -40,10 +75,23 @@ void fork_addr_space_finish_switch(void *safe_point) {
 
 	adrspc = fork_addr_space_get(task_self());
 	if (!adrspc) {
+		/* Task without own address space still runs the same
+		 * application code, so it would clobber static data */
+		if (fork_live_adrspc &&
+				fork_addr_space_same_app(fork_live_adrspc, task_self())) {
+			fork_addr_space_evict();
+		}
 		return;
 	}
 
-	fork_addr_space_restore(adrspc, safe_point);
+	fork_stack_restore(adrspc, safe_point);
+
+	if (fork_live_adrspc != adrspc) {
+		fork_addr_space_evict();
+		fork_heap_restore(&adrspc->heap_space);
+		fork_static_restore(&adrspc->static_space, task_self());
+		fork_live_adrspc = adrspc;
+	}
 
 	if (!fork_addr_space_is_shared(adrspc)) {
 		fork_addr_space_delete(task_self());
@@ -61,6 +109,11 @@ struct addr_space *fork_addr_space_create(struct addr_space *parent) {
 	if (parent) {
 		adrspc->parent_addr_space = parent;
 		parent->child_count++;
+	} else {
+		/* Memory is owned by the task which creates the first
+		 * address space, i.e. by the forking parent */
+		fork_addr_space_evict();
+		fork_live_adrspc = adrspc;
 	}
 
 	return adrspc;
@@ -69,15 +122,22 @@ struct addr_space *fork_addr_space_create(struct addr_space *parent) {
 void fork_addr_space_store(struct addr_space *adrspc) {
 	fork_stack_store(adrspc, thread_self());
 	fork_heap_store(&adrspc->heap_space, task_self());
-	fork_static_store(&adrspc->static_space);
+	fork_static_store(&adrspc->static_space, task_self());
 }
 
 void fork_addr_space_restore(struct addr_space *adrspc, void *stack_safe_point) {
 	assert(adrspc);
 	assert(stack_safe_point);
+
+	if (fork_live_adrspc != adrspc) {
+		fork_addr_space_evict();
+	}
+
 	fork_stack_restore(adrspc, stack_safe_point);
 	fork_heap_restore(&adrspc->heap_space);
-	fork_static_restore(&adrspc->static_space);
+	fork_static_restore(&adrspc->static_space, task_self());
+
+	fork_live_adrspc = adrspc;
 }
 
 static void fork_addr_space_child_del(struct addr_space *child) {
@@ -123,6 +183,10 @@ void fork_addr_space_set(struct task *tk, struct addr_space *adrspc) {
 	struct addr_space **adrspc_p;
 	adrspc_p = task_resource(tk, &fork_addr_space);
 	*adrspc_p = adrspc;
+
+	if (adrspc) {
+		adrspc->task = tk;
+	}
 }
 
 void fork_addr_space_delete(struct task *task) {
@@ -138,6 +202,10 @@ void fork_addr_space_delete(struct task *task) {
 
 	fork_addr_space_child_del(adrspc);
 
+	if (fork_live_adrspc == adrspc) {
+		fork_live_adrspc = NULL;
+	}
+
 	sysfree(adrspc);
 
 	fork_addr_space_set(task, NULL);
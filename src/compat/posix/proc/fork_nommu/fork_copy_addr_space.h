@@ -39,6 +39,8 @@ struct addr_space {
 	struct addr_space *parent_addr_space;
 	unsigned int child_count;
 
+	struct task *task;
+
 	struct pt_regs pt_entry;
 
 	struct dlist_head stack_space_head;
@@ -67,8 +69,8 @@ extern void fork_heap_restore(struct heap_space *hpspc);
 extern void fork_heap_cleanup(struct heap_space *hpspc);
 
 /* Static */
-extern void fork_static_store(struct static_space *sspc);
-extern void fork_static_restore(struct static_space *sspc);
+extern void fork_static_store(struct static_space *sspc, struct task *tk);
+extern void fork_static_restore(struct static_space *sspc, struct task *tk);
 extern void fork_static_cleanup(struct static_space *sspc);
 
 #endif /* FORK_COPY_ADDR_SPACE_H_ */
@@ -17,12 +17,23 @@
 #define IOCTL_GETDEVSIZE        2
 #define IOCTL_GETGEOMETRY       3
 #define IOCTL_REVALIDATE        4
+/* Contents of the blocks are not needed anymore, args is
+ * struct block_dev_range. Drivers not supporting it return -ENOSYS */
+#define IOCTL_DISCARD           5
+/* Data the driver buffered goes to the medium. Drivers which write
+ * through return -ENOSYS */
+#define IOCTL_FLUSH             6
 
 #define NODEV                 (-1)
 #define DEV_TYPE_STREAM         1
 #define DEV_TYPE_BLOCK          2
 #define DEV_TYPE_PACKET         3
 
+struct block_dev_range {
+	blkno_t blkno;
+	size_t count;
+};
+
 struct file_operations;
 typedef struct block_dev {
 	dev_t id;
@@ -82,10 +93,31 @@ extern struct block_dev *block_dev(void *bdev);
 extern block_dev_cache_t *block_dev_cache_init(void *bdev, int blocks);
 extern block_dev_cache_t *block_dev_cached_read(void *bdev, blkno_t blkno);
 extern int block_dev_read(void *bdev, char *buffer, size_t count, blkno_t blkno);
+/**
+ * Reads @a count bytes (must be a multiple of block size) starting from
+ * @a blkno. Runs of blocks absent in the buffer cache are read with
+ * a single device request and are not cached, the rest is copied from
+ * the cache. Intended for bulk file data.
+ */
+extern int block_dev_read_direct(void *bdev, char *buffer, size_t count, blkno_t blkno);
+/**
+ * Writes @a count bytes (must be a multiple of block size) starting from
+ * @a blkno. Runs of blocks absent in the buffer cache are written with
+ * a single device request, cached ones are updated through the cache.
+ * If blocks are encrypted, @a buffer is encrypted in a copy of it.
+ */
+extern int block_dev_write_direct(void *bdev, const char *buffer, size_t count, blkno_t blkno);
 extern int block_dev_read_buffered(struct block_dev *bdev, char *buffer, size_t count, size_t offset);
 extern int block_dev_write_buffered(struct block_dev *bdev, const char *buffer, size_t count, size_t offset);
 extern int block_dev_write(void *bdev, const char *buffer, size_t count, blkno_t blkno);
 extern int block_dev_ioctl(void *bdev, int cmd, void *args, size_t size);
+/**
+ * Tells the device @a count blocks starting from @a blkno are unused.
+ * It's just a hint, so it's not an error if the device ignores it.
+ */
+extern int block_dev_discard(void *bdev, blkno_t blkno, size_t count);
+/** Writes out whatever the driver of @a bdev keeps buffered */
+extern int block_dev_flush(void *bdev);
 extern int block_dev_close(void *bdev);
 extern int block_dev_destroy(void *bdev);
 extern int block_dev_named(const char *name, struct indexator *indexator);
@@ -20,8 +20,11 @@
 #include <util/indexator.h>
 #include <util/math.h>
 
+#include <module/embox/fs/buffer_crypt_api.h>
+
 #define DEFAULT_BDEV_BLOCK_SIZE OPTION_GET(NUMBER, default_block_size)
 #define MAX_DEV_QUANTITY OPTION_GET(NUMBER, dev_quantity)
+#define MAX_RUN_BLOCKS OPTION_GET(NUMBER, max_run_blocks)
 
 ARRAY_SPREAD_DEF(const struct block_dev_module, __block_dev_registry);
 POOL_DEF(cache_pool, struct block_dev_cache, MAX_DEV_QUANTITY);
@@ -267,6 +270,200 @@ int block_dev_write(void *dev, const char *buffer, size_t count, blkno_t blkno)
 	return block_dev_write_buffered(bdev, buffer, count, blkno * blksize);
 }
 
+/*
+ * Read up to max blocks starting from blkno, which are not in the buffer
+ * cache, with a single request right into the caller's buffer.
+ * Returns the number of blocks read.
+ */
+static int block_dev_read_run(struct block_dev *bdev, char *buffer,
+		int blksize, int max, blkno_t blkno) {
+	struct buffer_head bh;
+	int n, i, res;
+
+	max = min(max, MAX_RUN_BLOCKS);
+	for (n = 0; n < max; n++) {
+		if (bcache_cached(bdev, blkno + n)) {
+			break;
+		}
+	}
+	if (n == 0) {
+		return 0;
+	}
+
+	res = bdev->driver->read(bdev, buffer, n * blksize, blkno);
+	if (res != n * blksize) {
+		return res < 0 ? res : -EIO;
+	}
+
+	/* Cached blocks are kept decrypted, do the same for the caller */
+	for (i = 0; i < n; i++) {
+		bh = (struct buffer_head) {
+			.bdev = bdev,
+			.block = blkno + i,
+			.blocksize = blksize,
+			.data = buffer + i * blksize,
+		};
+		if (0 != (res = buffer_decrypt(&bh))) {
+			return res;
+		}
+	}
+
+	return n;
+}
+
+int block_dev_read_direct(void *dev, char *buffer, size_t count, blkno_t blkno) {
+	struct block_dev *bdev;
+	int blksize, res;
+	size_t cursor;
+
+	if (NULL == dev) {
+		return -ENODEV;
+	}
+	bdev = block_dev(dev);
+
+	assert(bdev->driver);
+	if (NULL == bdev->driver->read) {
+		return -ENOSYS;
+	}
+
+	blksize = block_dev_ioctl(bdev, IOCTL_GETBLKSIZE, NULL, 0);
+	if (blksize < 0) {
+		return blksize;
+	}
+	if (count % blksize || (blkno + count / blksize) * blksize > bdev->size) {
+		return -EINVAL;
+	}
+
+	for (cursor = 0; cursor < count; cursor += res * blksize, blkno += res) {
+		res = block_dev_read_run(bdev, buffer + cursor, blksize,
+				(count - cursor) / blksize, blkno);
+		if (res < 0) {
+			return res;
+		}
+		if (res == 0) {
+			/* Cached one, it may be newer than the disk copy */
+			res = block_dev_read_buffered(bdev, buffer + cursor, blksize,
+					blkno * blksize);
+			if (res < 0) {
+				return res;
+			}
+			res = 1;
+		}
+	}
+
+	return cursor;
+}
+
+#ifndef __MODULE__embox__fs__buffer_no_crypt__H_
+/* Encrypts @a n blocks in a bounce buffer and writes them from there,
+ * the caller's data is left as is */
+static int block_dev_write_encrypted(struct block_dev *bdev,
+		const char *buffer, int blksize, int n, blkno_t blkno) {
+	struct buffer_head bh;
+	size_t pages;
+	char *bounce;
+	int i, res;
+
+	pages = (n * blksize + PAGE_SIZE() - 1) / PAGE_SIZE();
+	bounce = phymem_alloc(pages);
+	if (NULL == bounce) {
+		return -ENOMEM;
+	}
+	memcpy(bounce, buffer, n * blksize);
+
+	/* Same as the buffered write does with a cached block */
+	for (i = 0; i < n; i++) {
+		bh = (struct buffer_head) {
+			.bdev = bdev,
+			.block = blkno + i,
+			.blocksize = blksize,
+			.data = bounce + i * blksize,
+		};
+		buffer_encrypt(&bh);
+	}
+	res = bdev->driver->write(bdev, bounce, n * blksize, blkno);
+
+	phymem_free(bounce, pages);
+
+	return res;
+}
+#endif
+
+/*
+ * Write up to max blocks starting from blkno, which are not in the buffer
+ * cache, with a single request right from the caller's buffer.
+ * Returns the number of blocks written.
+ */
+static int block_dev_write_run(struct block_dev *bdev, const char *buffer,
+		int blksize, int max, blkno_t blkno) {
+	int n, res;
+
+	max = min(max, MAX_RUN_BLOCKS);
+	for (n = 0; n < max; n++) {
+		if (bcache_cached(bdev, blkno + n)) {
+			break;
+		}
+	}
+	if (n == 0) {
+		return 0;
+	}
+
+#ifdef __MODULE__embox__fs__buffer_no_crypt__H_
+	/* Drivers don't modify the data they write */
+	res = bdev->driver->write(bdev, (char *) buffer, n * blksize, blkno);
+#else
+	res = block_dev_write_encrypted(bdev, buffer, blksize, n, blkno);
+#endif
+	if (res != n * blksize) {
+		return res < 0 ? res : -EIO;
+	}
+
+	return n;
+}
+
+int block_dev_write_direct(void *dev, const char *buffer, size_t count, blkno_t blkno) {
+	struct block_dev *bdev;
+	int blksize, res;
+	size_t cursor;
+
+	if (NULL == dev) {
+		return -ENODEV;
+	}
+	bdev = block_dev(dev);
+
+	assert(bdev->driver);
+	if (NULL == bdev->driver->write) {
+		return -ENOSYS;
+	}
+
+	blksize = block_dev_ioctl(bdev, IOCTL_GETBLKSIZE, NULL, 0);
+	if (blksize < 0) {
+		return blksize;
+	}
+	if (count % blksize || (blkno + count / blksize) * blksize > bdev->size) {
+		return -EINVAL;
+	}
+
+	for (cursor = 0; cursor < count; cursor += res * blksize, blkno += res) {
+		res = block_dev_write_run(bdev, buffer + cursor, blksize,
+				(count - cursor) / blksize, blkno);
+		if (res < 0) {
+			return res;
+		}
+		if (res == 0) {
+			/* Cached one, its copy in the cache must be updated too */
+			res = block_dev_write_buffered(bdev, buffer + cursor, blksize,
+					blkno * blksize);
+			if (res < 0) {
+				return res;
+			}
+			res = 1;
+		}
+	}
+
+	return cursor;
+}
+
 int block_dev_ioctl(void *dev, int cmd, void *args, size_t size) {
 	struct block_dev *bdev;
 
@@ -290,6 +487,26 @@ int block_dev_ioctl(void *dev, int cmd, void *args, size_t size) {
 	}
 }
 
+int block_dev_discard(void *dev, blkno_t blkno, size_t count) {
+	struct block_dev_range range = {
+		.blkno = blkno,
+		.count = count,
+	};
+	int res;
+
+	res = block_dev_ioctl(dev, IOCTL_DISCARD, &range, sizeof(range));
+
+	return res == -ENOSYS || res == -EINVAL ? 0 : res;
+}
+
+int block_dev_flush(void *dev) {
+	int res;
+
+	res = block_dev_ioctl(dev, IOCTL_FLUSH, NULL, 0);
+
+	return res == -ENOSYS ? 0 : res;
+}
+
 block_dev_cache_t *block_dev_cache_init(void *dev, int blocks) {
 	int pagecnt;
 	block_dev_cache_t *cache;
@@ -0,0 +1,803 @@
+/**
+ * @file
+ * @brief Log-structured flash translation layer
+ *
+ * Every erase block starts with a header area: struct ftl_block_hdr
+ * followed by a tag per data sector holding the number of the logical
+ * sector stored there. Sectors are appended to the open erase block, the
+ * data is programmed before its tag, so the tag works as a commit record:
+ * an old copy of a sector stays valid until the tag of the new one is on
+ * the flash. Each header word is programmed once after erase.
+ *
+ * The mapping is rebuilt on creation from the tags. Of several copies of
+ * a sector the one in the erase block with the greater sequence number
+ * wins, in the same erase block the later one does.
+ *
+ * Written sectors are collected in a write-back buffer and go to the flash
+ * in the order they entered it. A background thread flushes the buffer
+ * after flush_delay_ms and reclaims erase blocks in advance, so a writer
+ * rarely has to wait for the garbage collector.
+ *
+ * @date 19.10.2026
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <drivers/block_dev.h>
+#include <drivers/flash/flash.h>
+#include <drivers/flash/ftl.h>
+#include <framework/mod/options.h>
+#include <kernel/kstat.h>
+#include <kernel/sched/schedee_priority.h>
+#include <kernel/thread.h>
+#include <kernel/thread/sync/mutex.h>
+#include <kernel/time/ktime.h>
+#include <mem/sysmalloc.h>
+#include <util/err.h>
+#include <util/log.h>
+#include <util/math.h>
+
+#define FTL_SECTOR_SIZE     OPTION_GET(NUMBER, sector_size)
+#define FTL_RESERVED_BLOCKS OPTION_GET(NUMBER, reserved_blocks)
+#define FTL_WB_SECTORS      OPTION_GET(NUMBER, wb_sectors)
+#define FTL_FLUSH_DELAY     OPTION_GET(NUMBER, flush_delay_ms)
+#define FTL_GC_PERIOD       OPTION_GET(NUMBER, gc_period_ms)
+#define FTL_GC_FREE_BLOCKS  OPTION_GET(NUMBER, gc_free_blocks)
+#define FTL_WL_THRESHOLD    OPTION_GET(NUMBER, wl_threshold)
+
+/* One block is needed by the garbage collector to move sectors to,
+ * one more to keep writing while there are no obsolete sectors yet */
+static_assert(FTL_RESERVED_BLOCKS >= 3);
+
+#define FTL_MAGIC 0x46544c31 /* "FTL1" */
+#define FTL_NONE  0xffffffff /* erased word: free block, unused tag */
+
+struct ftl_block_hdr {
+	uint32_t magic;
+	uint32_t erase_count;
+	uint32_t seq;         /* programmed when the block is opened */
+	uint32_t reserved;
+};
+
+struct ftl_eb {
+	uint32_t erase_count;
+	uint32_t seq;         /* FTL_NONE for free blocks */
+	uint16_t valid;       /* sectors which are still mapped here */
+	uint16_t next;        /* sector to program next */
+};
+
+struct ftl {
+	struct flash_dev *flash;
+	struct block_dev *bdev;
+	struct mutex lock;
+
+	uint32_t eb_size;
+	uint32_t eb_count;
+	uint32_t hdr_size;    /* header area, multiple of the sector size */
+	uint32_t pages;       /* data sectors per erase block */
+	uint32_t sectors;     /* logical sectors exported */
+
+	uint32_t *map;        /* logical sector -> erase block * pages + page */
+	struct ftl_eb *eb;
+	uint32_t free_blocks;
+	int open;
+	uint32_t seq;
+
+	uint32_t wb_lsn[FTL_WB_SECTORS];
+	char *wb_data;
+	int wb_count;
+	time64_t wb_stamp;    /* when the oldest buffered sector was written */
+
+	char *page_buf;
+	uint32_t *tag_buf;
+
+	struct thread *thread;
+	int stop;
+
+	struct ftl_stats stats;
+};
+
+static int ftl_bdev_ioctl(struct block_dev *bdev, int cmd, void *args, size_t size);
+static int ftl_bdev_read(struct block_dev *bdev, char *buffer, size_t count, blkno_t blkno);
+static int ftl_bdev_write(struct block_dev *bdev, char *buffer, size_t count, blkno_t blkno);
+
+static block_dev_driver_t ftl_driver = {
+	"ftl_drv",
+	ftl_bdev_ioctl,
+	ftl_bdev_read,
+	ftl_bdev_write
+};
+
+KSTAT_COUNTER_DEF(ftl_host_writes, "ftl/host_writes");
+KSTAT_COUNTER_DEF(ftl_flash_writes, "ftl/flash_writes");
+KSTAT_COUNTER_DEF(ftl_erases, "ftl/erases");
+
+static inline uint32_t ftl_eb_offset(struct ftl *ftl, int eb) {
+	return eb * ftl->eb_size;
+}
+
+static inline uint32_t ftl_tag_offset(struct ftl *ftl, int eb, int page) {
+	return ftl_eb_offset(ftl, eb) + sizeof(struct ftl_block_hdr)
+		+ page * sizeof(uint32_t);
+}
+
+static inline uint32_t ftl_page_offset(struct ftl *ftl, uint32_t ppn) {
+	return ftl_eb_offset(ftl, ppn / ftl->pages) + ftl->hdr_size
+		+ (ppn % ftl->pages) * FTL_SECTOR_SIZE;
+}
+
+static inline int ftl_open_full(struct ftl *ftl) {
+	return ftl->open < 0 || ftl->eb[ftl->open].next == ftl->pages;
+}
+
+static int ftl_erase(struct ftl *ftl, int eb) {
+	struct ftl_block_hdr hdr;
+	int err;
+
+	err = flash_erase(ftl->flash, eb);
+	if (err) {
+		log_error("erase of block %d failed", eb);
+		return err;
+	}
+
+	ftl->eb[eb].erase_count++;
+	ftl->eb[eb].seq = FTL_NONE;
+	ftl->eb[eb].valid = 0;
+	ftl->eb[eb].next = 0;
+	ftl->free_blocks++;
+
+	ftl->stats.erases++;
+	kstat_inc(&ftl_erases);
+
+	/* Sequence number is left erased until the block is opened */
+	hdr.magic = FTL_MAGIC;
+	hdr.erase_count = ftl->eb[eb].erase_count;
+
+	return flash_write(ftl->flash, ftl_eb_offset(ftl, eb), &hdr,
+			offsetof(struct ftl_block_hdr, seq));
+}
+
+/* Free block with the least erase count is taken (dynamic wear leveling) */
+static int ftl_open_block(struct ftl *ftl) {
+	int i, best = -1;
+	uint32_t seq;
+
+	for (i = 0; i < ftl->eb_count; i++) {
+		if (ftl->eb[i].seq != FTL_NONE) {
+			continue;
+		}
+		if (best < 0 || ftl->eb[i].erase_count < ftl->eb[best].erase_count) {
+			best = i;
+		}
+	}
+
+	if (best < 0) {
+		return -ENOSPC;
+	}
+
+	seq = ftl->seq++;
+	ftl->eb[best].seq = seq;
+	ftl->eb[best].next = 0;
+	ftl->free_blocks--;
+	ftl->open = best;
+
+	return flash_write(ftl->flash,
+			ftl_eb_offset(ftl, best) + offsetof(struct ftl_block_hdr, seq),
+			&seq, sizeof(seq));
+}
+
+static void ftl_unmap(struct ftl *ftl, uint32_t lsn) {
+	uint32_t ppn = ftl->map[lsn];
+
+	if (ppn != FTL_NONE) {
+		ftl->eb[ppn / ftl->pages].valid--;
+		ftl->map[lsn] = FTL_NONE;
+	}
+}
+
+/* Appends sector to the open erase block */
+static int ftl_prog(struct ftl *ftl, uint32_t lsn, const void *data) {
+	struct ftl_eb *eb;
+	uint32_t ppn;
+	int err;
+
+	if (ftl_open_full(ftl)) {
+		err = ftl_open_block(ftl);
+		if (err) {
+			return err;
+		}
+	}
+
+	eb = &ftl->eb[ftl->open];
+	ppn = ftl->open * ftl->pages + eb->next;
+	/* Sector is used even if programming fails */
+	eb->next++;
+
+	err = flash_write(ftl->flash, ftl_page_offset(ftl, ppn), data,
+			FTL_SECTOR_SIZE);
+	if (err) {
+		return err;
+	}
+	err = flash_write(ftl->flash, ftl_tag_offset(ftl, ftl->open,
+			ppn % ftl->pages), &lsn, sizeof(lsn));
+	if (err) {
+		return err;
+	}
+
+	ftl_unmap(ftl, lsn);
+	ftl->map[lsn] = ppn;
+	eb->valid++;
+
+	ftl->stats.flash_writes++;
+	kstat_inc(&ftl_flash_writes);
+
+	return 0;
+}
+
+/* Moves sectors still mapped to @a victim away and erases it */
+static int ftl_gc_block(struct ftl *ftl, int victim) {
+	uint32_t ppn, lsn;
+	int page, err;
+
+	err = flash_read(ftl->flash, ftl_tag_offset(ftl, victim, 0),
+			ftl->tag_buf, ftl->pages * sizeof(uint32_t));
+	if (err) {
+		return err;
+	}
+
+	for (page = 0; page < ftl->pages && ftl->eb[victim].valid; page++) {
+		lsn = ftl->tag_buf[page];
+		ppn = victim * ftl->pages + page;
+		if (lsn >= ftl->sectors || ftl->map[lsn] != ppn) {
+			continue;
+		}
+
+		err = flash_read(ftl->flash, ftl_page_offset(ftl, ppn),
+				ftl->page_buf, FTL_SECTOR_SIZE);
+		if (err) {
+			return err;
+		}
+		err = ftl_prog(ftl, lsn, ftl->page_buf);
+		if (err) {
+			return err;
+		}
+
+		ftl->stats.gc_copies++;
+	}
+
+	assert(ftl->eb[victim].valid == 0);
+	ftl->stats.gc_runs++;
+
+	return ftl_erase(ftl, victim);
+}
+
+/* Greedy choice: the block with the least valid sectors */
+static int ftl_gc_victim(struct ftl *ftl) {
+	int i, best = -1;
+
+	for (i = 0; i < ftl->eb_count; i++) {
+		if (ftl->eb[i].seq == FTL_NONE || i == ftl->open) {
+			continue;
+		}
+		if (best < 0 || ftl->eb[i].valid < ftl->eb[best].valid) {
+			best = i;
+		}
+	}
+
+	if (best < 0 || ftl->eb[best].valid == ftl->pages) {
+		/* Nothing to gain */
+		return -1;
+	}
+
+	return best;
+}
+
+/* Static wear leveling: the least worn block holding data is moved if the
+ * difference with the most worn one has grown too large */
+static int ftl_wl_victim(struct ftl *ftl) {
+	uint32_t max_ec = 0;
+	int i, cold = -1;
+
+	for (i = 0; i < ftl->eb_count; i++) {
+		max_ec = max(max_ec, ftl->eb[i].erase_count);
+
+		if (ftl->eb[i].seq == FTL_NONE || i == ftl->open) {
+			continue;
+		}
+		if (cold < 0 || ftl->eb[i].erase_count < ftl->eb[cold].erase_count) {
+			cold = i;
+		}
+	}
+
+	if (cold < 0 || max_ec - ftl->eb[cold].erase_count <= FTL_WL_THRESHOLD) {
+		return -1;
+	}
+
+	return cold;
+}
+
+static int ftl_make_room(struct ftl *ftl, uint32_t free_blocks) {
+	int victim, err;
+
+	while (ftl->free_blocks < free_blocks) {
+		victim = ftl_gc_victim(ftl);
+		if (victim < 0) {
+			break;
+		}
+
+		err = ftl_gc_block(ftl, victim);
+		if (err) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static int ftl_write_sector(struct ftl *ftl, uint32_t lsn, const void *data) {
+	int err;
+
+	if (ftl_open_full(ftl)) {
+		/* Opening a block must leave one for the garbage collector */
+		err = ftl_make_room(ftl, 2);
+		if (err) {
+			return err;
+		}
+	}
+
+	return ftl_prog(ftl, lsn, data);
+}
+
+static int ftl_flush(struct ftl *ftl) {
+	int i, err = 0;
+
+	for (i = 0; i < ftl->wb_count; i++) {
+		err = ftl_write_sector(ftl, ftl->wb_lsn[i],
+				ftl->wb_data + i * FTL_SECTOR_SIZE);
+		if (err) {
+			break;
+		}
+	}
+
+	/* Keep what was not written, in the same order */
+	memmove(ftl->wb_lsn, ftl->wb_lsn + i, (ftl->wb_count - i) * sizeof(uint32_t));
+	memmove(ftl->wb_data, ftl->wb_data + i * FTL_SECTOR_SIZE,
+			(ftl->wb_count - i) * FTL_SECTOR_SIZE);
+	ftl->wb_count -= i;
+
+	return err;
+}
+
+/* Returns the newest entry of @a lsn */
+static int ftl_wb_find(struct ftl *ftl, uint32_t lsn) {
+	int i;
+
+	for (i = ftl->wb_count - 1; i >= 0; i--) {
+		if (ftl->wb_lsn[i] == lsn) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static void ftl_wb_drop(struct ftl *ftl, int idx) {
+	int tail = ftl->wb_count - idx - 1;
+
+	memmove(ftl->wb_lsn + idx, ftl->wb_lsn + idx + 1, tail * sizeof(uint32_t));
+	memmove(ftl->wb_data + idx * FTL_SECTOR_SIZE,
+			ftl->wb_data + (idx + 1) * FTL_SECTOR_SIZE,
+			tail * FTL_SECTOR_SIZE);
+	ftl->wb_count--;
+}
+
+/* Sectors are flushed in the order they were written. A rewrite of a
+ * sector that isn't the last one buffered is a new entry, so the older
+ * data still goes to flash before the sectors written after it. */
+static int ftl_wb_write(struct ftl *ftl, uint32_t lsn, const char *data) {
+	int idx, err;
+
+	idx = ftl_wb_find(ftl, lsn);
+	if (idx < 0 || idx != ftl->wb_count - 1) {
+		if (ftl->wb_count == FTL_WB_SECTORS) {
+			err = ftl_flush(ftl);
+			if (err) {
+				return err;
+			}
+		}
+
+		if (!ftl->wb_count) {
+			ftl->wb_stamp = ktime_get_ns();
+		}
+		idx = ftl->wb_count++;
+		ftl->wb_lsn[idx] = lsn;
+	}
+
+	memcpy(ftl->wb_data + idx * FTL_SECTOR_SIZE, data, FTL_SECTOR_SIZE);
+
+	ftl->stats.host_writes++;
+	kstat_inc(&ftl_host_writes);
+
+	return 0;
+}
+
+static int ftl_read_sector(struct ftl *ftl, uint32_t lsn, char *data) {
+	uint32_t ppn;
+	int idx;
+
+	idx = ftl_wb_find(ftl, lsn);
+	if (idx >= 0) {
+		memcpy(data, ftl->wb_data + idx * FTL_SECTOR_SIZE, FTL_SECTOR_SIZE);
+		return 0;
+	}
+
+	ppn = ftl->map[lsn];
+	if (ppn == FTL_NONE) {
+		memset(data, 0, FTL_SECTOR_SIZE);
+		return 0;
+	}
+
+	return flash_read(ftl->flash, ftl_page_offset(ftl, ppn), data,
+			FTL_SECTOR_SIZE);
+}
+
+static void ftl_discard(struct ftl *ftl, uint32_t lsn) {
+	int idx;
+
+	while ((idx = ftl_wb_find(ftl, lsn)) >= 0) {
+		ftl_wb_drop(ftl, idx);
+	}
+
+	ftl_unmap(ftl, lsn);
+	ftl->stats.discards++;
+}
+
+/* Rebuilds the mapping from the erase block headers. Blocks without valid
+ * header (never used or erase was interrupted) are formatted. */
+static int ftl_scan(struct ftl *ftl) {
+	struct ftl_block_hdr hdr;
+	uint64_t ec_total = 0;
+	uint32_t ec_known = 0;
+	uint32_t lsn, cur;
+	int i, page, err;
+
+	ftl->seq = 0;
+	for (i = 0; i < ftl->eb_count; i++) {
+		err = flash_read(ftl->flash, ftl_eb_offset(ftl, i), &hdr, sizeof(hdr));
+		if (err) {
+			return err;
+		}
+
+		if (hdr.magic != FTL_MAGIC) {
+			ftl->eb[i].erase_count = FTL_NONE;
+			ftl->eb[i].seq = FTL_NONE;
+			continue;
+		}
+
+		ftl->eb[i].erase_count = hdr.erase_count;
+		ftl->eb[i].seq = hdr.seq;
+		ec_total += hdr.erase_count;
+		ec_known++;
+
+		if (hdr.seq != FTL_NONE && hdr.seq >= ftl->seq) {
+			ftl->seq = hdr.seq + 1;
+		}
+	}
+
+	for (i = 0; i < ftl->eb_count; i++) {
+		if (ftl->eb[i].erase_count == FTL_NONE) {
+			ftl->eb[i].erase_count = ec_known ? ec_total / ec_known : 0;
+			err = ftl_erase(ftl, i);
+			if (err) {
+				return err;
+			}
+			continue;
+		}
+
+		if (ftl->eb[i].seq == FTL_NONE) {
+			ftl->eb[i].next = 0;
+			ftl->free_blocks++;
+			continue;
+		}
+
+		/* Never append to blocks found written: a sector may be
+		 * programmed there without its tag */
+		ftl->eb[i].next = ftl->pages;
+
+		err = flash_read(ftl->flash, ftl_tag_offset(ftl, i, 0),
+				ftl->tag_buf, ftl->pages * sizeof(uint32_t));
+		if (err) {
+			return err;
+		}
+
+		for (page = 0; page < ftl->pages; page++) {
+			lsn = ftl->tag_buf[page];
+			if (lsn >= ftl->sectors) {
+				continue;
+			}
+
+			cur = ftl->map[lsn];
+			if (cur == FTL_NONE || cur / ftl->pages == i
+					|| ftl->eb[cur / ftl->pages].seq < ftl->eb[i].seq) {
+				ftl->map[lsn] = i * ftl->pages + page;
+			}
+		}
+	}
+
+	for (lsn = 0; lsn < ftl->sectors; lsn++) {
+		if (ftl->map[lsn] != FTL_NONE) {
+			ftl->eb[ftl->map[lsn] / ftl->pages].valid++;
+		}
+	}
+
+	return 0;
+}
+
+static void ftl_background(struct ftl *ftl) {
+	int victim;
+
+	if (ftl->wb_count
+			&& ktime_get_ns() - ftl->wb_stamp >= FTL_FLUSH_DELAY * 1000000LL) {
+		ftl_flush(ftl);
+	}
+
+	ftl_make_room(ftl, max(FTL_GC_FREE_BLOCKS, 2));
+
+	/* Moving a fully valid block takes a whole free one */
+	if (ftl->free_blocks > 2) {
+		victim = ftl_wl_victim(ftl);
+		if (victim >= 0) {
+			ftl_gc_block(ftl, victim);
+		}
+	}
+}
+
+static void *ftl_thread_run(void *arg) {
+	struct ftl *ftl = arg;
+	int stop;
+
+	do {
+		ksleep(FTL_GC_PERIOD);
+
+		mutex_lock(&ftl->lock);
+		stop = ftl->stop;
+		if (!stop) {
+			ftl_background(ftl);
+		}
+		mutex_unlock(&ftl->lock);
+	} while (!stop);
+
+	return NULL;
+}
+
+static void ftl_free(struct ftl *ftl) {
+	sysfree(ftl->tag_buf);
+	sysfree(ftl->page_buf);
+	sysfree(ftl->wb_data);
+	sysfree(ftl->eb);
+	sysfree(ftl->map);
+	sysfree(ftl);
+}
+
+struct block_dev *ftl_create(const char *name, struct flash_dev *flash) {
+	struct ftl *ftl;
+	struct thread *t;
+	int err;
+
+	assert(flash);
+	assert(flash->num_block_infos == 1); /* NIY for num_block_infos > 1 */
+
+	ftl = syscalloc(1, sizeof(*ftl));
+	if (!ftl) {
+		return err_ptr(ENOMEM);
+	}
+
+	ftl->flash = flash;
+	ftl->eb_size = flash->block_info[0].block_size;
+	ftl->eb_count = flash->block_info[0].blocks;
+	ftl->open = -1;
+
+	/* Grow header area until tags of the remaining sectors fit there */
+	for (ftl->hdr_size = FTL_SECTOR_SIZE; ftl->hdr_size < ftl->eb_size;
+			ftl->hdr_size += FTL_SECTOR_SIZE) {
+		ftl->pages = (ftl->eb_size - ftl->hdr_size) / FTL_SECTOR_SIZE;
+		if (sizeof(struct ftl_block_hdr) + ftl->pages * sizeof(uint32_t)
+				<= ftl->hdr_size) {
+			break;
+		}
+	}
+
+	if (ftl->hdr_size >= ftl->eb_size || ftl->pages > UINT16_MAX
+			|| ftl->eb_count <= FTL_RESERVED_BLOCKS) {
+		log_error("flash geometry %u x %u is not supported",
+				ftl->eb_count, ftl->eb_size);
+		err = EINVAL;
+		goto out_free;
+	}
+
+	ftl->sectors = (ftl->eb_count - FTL_RESERVED_BLOCKS) * ftl->pages;
+
+	ftl->map = sysmalloc(ftl->sectors * sizeof(uint32_t));
+	ftl->eb = syscalloc(ftl->eb_count, sizeof(struct ftl_eb));
+	ftl->wb_data = sysmalloc(FTL_WB_SECTORS * FTL_SECTOR_SIZE);
+	ftl->page_buf = sysmalloc(FTL_SECTOR_SIZE);
+	ftl->tag_buf = sysmalloc(ftl->pages * sizeof(uint32_t));
+	if (!ftl->map || !ftl->eb || !ftl->wb_data || !ftl->page_buf
+			|| !ftl->tag_buf) {
+		err = ENOMEM;
+		goto out_free;
+	}
+
+	memset(ftl->map, 0xff, ftl->sectors * sizeof(uint32_t));
+	mutex_init(&ftl->lock);
+
+	err = ftl_scan(ftl);
+	if (err) {
+		err = -err;
+		goto out_free;
+	}
+
+	ftl->bdev = block_dev_create(name, &ftl_driver, ftl);
+	if (!ftl->bdev) {
+		err = EIO;
+		goto out_free;
+	}
+	ftl->bdev->size = ftl->sectors * FTL_SECTOR_SIZE;
+	ftl->bdev->block_size = FTL_SECTOR_SIZE;
+
+	t = thread_create(0, ftl_thread_run, ftl);
+	if (err(t)) {
+		err = -err(t);
+		goto out_destroy;
+	}
+	schedee_priority_set(&t->schedee, SCHED_PRIORITY_LOW);
+	ftl->thread = t;
+
+	return ftl->bdev;
+
+out_destroy:
+	block_dev_destroy(ftl->bdev);
+out_free:
+	ftl_free(ftl);
+	return err_ptr(err);
+}
+
+static struct ftl *ftl_by_bdev(struct block_dev *bdev) {
+	if (!bdev || bdev->driver != &ftl_driver) {
+		return NULL;
+	}
+
+	return bdev->privdata;
+}
+
+int ftl_sync(struct block_dev *bdev) {
+	struct ftl *ftl;
+	int err;
+
+	if (!(ftl = ftl_by_bdev(bdev))) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&ftl->lock);
+	err = ftl_flush(ftl);
+	mutex_unlock(&ftl->lock);
+
+	return err;
+}
+
+int ftl_delete(struct block_dev *bdev) {
+	struct ftl *ftl;
+	int err;
+
+	if (!(ftl = ftl_by_bdev(bdev))) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&ftl->lock);
+	ftl->stop = 1;
+	mutex_unlock(&ftl->lock);
+	thread_join(ftl->thread, NULL);
+
+	err = ftl_flush(ftl);
+
+	block_dev_destroy(ftl->bdev);
+	ftl_free(ftl);
+
+	return err;
+}
+
+int ftl_get_stats(struct block_dev *bdev, struct ftl_stats *stats) {
+	struct ftl *ftl;
+	int i;
+
+	if (!(ftl = ftl_by_bdev(bdev))) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&ftl->lock);
+	{
+		memcpy(stats, &ftl->stats, sizeof(*stats));
+		stats->free_blocks = ftl->free_blocks;
+		stats->erase_min = FTL_NONE;
+		stats->erase_max = 0;
+		for (i = 0; i < ftl->eb_count; i++) {
+			stats->erase_min = min(stats->erase_min, ftl->eb[i].erase_count);
+			stats->erase_max = max(stats->erase_max, ftl->eb[i].erase_count);
+		}
+	}
+	mutex_unlock(&ftl->lock);
+
+	return 0;
+}
+
+static int ftl_bdev_read(struct block_dev *bdev,
+		char *buffer, size_t count, blkno_t blkno) {
+	struct ftl *ftl = bdev->privdata;
+	size_t i, n = count / FTL_SECTOR_SIZE;
+	int err = 0;
+
+	if (count % FTL_SECTOR_SIZE || blkno + n > ftl->sectors) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&ftl->lock);
+	for (i = 0; i < n && !err; i++) {
+		err = ftl_read_sector(ftl, blkno + i, buffer + i * FTL_SECTOR_SIZE);
+	}
+	mutex_unlock(&ftl->lock);
+
+	return err ? err : count;
+}
+
+static int ftl_bdev_write(struct block_dev *bdev,
+		char *buffer, size_t count, blkno_t blkno) {
+	struct ftl *ftl = bdev->privdata;
+	size_t i, n = count / FTL_SECTOR_SIZE;
+	int err = 0;
+
+	if (count % FTL_SECTOR_SIZE || blkno + n > ftl->sectors) {
+		return -EINVAL;
+	}
+
+	mutex_lock(&ftl->lock);
+	for (i = 0; i < n && !err; i++) {
+		err = ftl_wb_write(ftl, blkno + i, buffer + i * FTL_SECTOR_SIZE);
+	}
+	mutex_unlock(&ftl->lock);
+
+	return err ? err : count;
+}
+
+static int ftl_bdev_ioctl(struct block_dev *bdev, int cmd,
+		void *args, size_t size) {
+	struct ftl *ftl = bdev->privdata;
+	struct block_dev_range *range;
+	size_t i;
+
+	switch (cmd) {
+	case IOCTL_GETBLKSIZE:
+		return FTL_SECTOR_SIZE;
+	case IOCTL_GETDEVSIZE:
+		return ftl->sectors * FTL_SECTOR_SIZE;
+	case IOCTL_DISCARD:
+		range = args;
+		if (range->blkno + range->count > ftl->sectors) {
+			return -EINVAL;
+		}
+
+		mutex_lock(&ftl->lock);
+		for (i = 0; i < range->count; i++) {
+			ftl_discard(ftl, range->blkno + i);
+		}
+		mutex_unlock(&ftl->lock);
+
+		return 0;
+	case IOCTL_FLUSH:
+		return ftl_sync(bdev);
+	default:
+		return -ENOSYS;
+	}
+}
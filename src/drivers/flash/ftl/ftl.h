@@ -0,0 +1,43 @@
+/**
+ * @file
+ * @brief Flash translation layer: flash device exported as a block device
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef DRIVERS_FLASH_FTL_H_
+#define DRIVERS_FLASH_FTL_H_
+
+#include <stdint.h>
+
+struct block_dev;
+struct flash_dev;
+
+struct ftl_stats {
+	uint32_t host_writes;  /**< Sectors written by the block device user */
+	uint32_t flash_writes; /**< Sectors programmed, including GC copies */
+	uint32_t gc_copies;    /**< Sectors moved by the garbage collector */
+	uint32_t gc_runs;      /**< Erase blocks reclaimed */
+	uint32_t erases;
+	uint32_t discards;     /**< Sectors dropped by IOCTL_DISCARD */
+	uint32_t free_blocks;
+	uint32_t erase_min;    /**< Erase counters over the whole device */
+	uint32_t erase_max;
+};
+
+/**
+ * Creates block device @a name on top of @a flash. The flash contents
+ * written by a previous instance are picked up, the rest is formatted.
+ * @return Block device or err_ptr() on error.
+ */
+extern struct block_dev *ftl_create(const char *name, struct flash_dev *flash);
+
+/** Writes all buffered sectors and destroys the block device. */
+extern int ftl_delete(struct block_dev *bdev);
+
+/** Writes all buffered sectors to the flash, as IOCTL_FLUSH does. */
+extern int ftl_sync(struct block_dev *bdev);
+
+extern int ftl_get_stats(struct block_dev *bdev, struct ftl_stats *stats);
+
+#endif /* DRIVERS_FLASH_FTL_H_ */
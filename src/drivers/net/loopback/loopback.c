@@ -16,18 +16,21 @@
 #include <net/inetdevice.h>
 #include <net/skbuff.h>
 #include <net/l0/net_entry.h>
+#include <sys/time.h>
+#include <kernel/time/ktime.h>
+#include <kernel/time/timer.h>
+
+#include <framework/mod/options.h>
+
+#define LOOPBACK_DROP_RATE OPTION_GET(NUMBER, drop_rate)
+#define LOOPBACK_DELAY     OPTION_GET(NUMBER, delay)
 
 EMBOX_UNIT_INIT(loopback_init);
 
-static int loopback_xmit(struct net_device *dev,
-		struct sk_buff *skb) {
+static void loopback_rx(struct net_device *dev, struct sk_buff *skb) {
 	struct net_device_stats *lb_stats;
 	size_t skb_len;
 
-	if ((skb == NULL) || (dev == NULL)) {
-		return -EINVAL;
-	}
-
 	skb_len = skb->len;
 
 	lb_stats = &dev->stats;
@@ -38,6 +41,81 @@ static int loopback_xmit(struct net_device *dev,
 	} else {
 		lb_stats->rx_err++;
 	}
+}
+
+#if LOOPBACK_DELAY > 0
+static struct sk_buff_head loopback_delayed;
+static struct sys_timer loopback_timer;
+
+/* Packets are delayed equally, so the queue is ordered by deadline
+ * kept in tstamp */
+static void loopback_timer_handler(struct sys_timer *timer, void *param) {
+	struct sk_buff *skb;
+	struct timeval now;
+
+	ktime_get_timeval(&now);
+	while ((skb = skb_queue_front(&loopback_delayed))
+			&& !timercmp(&skb->tstamp, &now, >)) {
+		skb = skb_queue_pop(&loopback_delayed);
+		loopback_rx(skb->dev, skb);
+	}
+}
+
+static int loopback_delay_init(void) {
+	skb_queue_init(&loopback_delayed);
+	return timer_init_start_msec(&loopback_timer, TIMER_PERIODIC, 1,
+			loopback_timer_handler, NULL);
+}
+
+static void loopback_delay(struct net_device *dev, struct sk_buff *skb) {
+	struct timeval delay = {
+		.tv_sec = LOOPBACK_DELAY / 1000,
+		.tv_usec = (LOOPBACK_DELAY % 1000) * 1000
+	};
+	struct timeval now;
+
+	ktime_get_timeval(&now);
+	timeradd(&now, &delay, &skb->tstamp);
+	skb->dev = dev;
+	skb_queue_push(&loopback_delayed, skb);
+}
+#else
+static inline int loopback_delay_init(void) {
+	return 0;
+}
+
+static inline void loopback_delay(struct net_device *dev,
+		struct sk_buff *skb) {
+	loopback_rx(dev, skb);
+}
+#endif
+
+#if LOOPBACK_DROP_RATE > 0
+static int loopback_drop(void) {
+	static uint32_t seed = 1;
+
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % 1000 < LOOPBACK_DROP_RATE;
+}
+#else
+static inline int loopback_drop(void) {
+	return 0;
+}
+#endif
+
+static int loopback_xmit(struct net_device *dev,
+		struct sk_buff *skb) {
+	if ((skb == NULL) || (dev == NULL)) {
+		return -EINVAL;
+	}
+
+	if (loopback_drop()) {
+		dev->stats.tx_dropped++;
+		skb_free(skb);
+		return 0;
+	}
+
+	loopback_delay(dev, skb);
 
 	return 0;
 }
@@ -79,5 +157,5 @@ static int loopback_init(void) {
 		return ret;
 	}
 
-	return 0;
+	return loopback_delay_init();
 }
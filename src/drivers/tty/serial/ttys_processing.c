@@ -5,14 +5,13 @@
  * @author Anton Bondarev
  */
 
-#include <mem/misc/pool.h>
-#include <util/dlist.h>
-
 #include <drivers/tty.h>
 #include <drivers/ttys.h>
 #include <drivers/serial/uart_device.h>
 
 #include <kernel/lthread/lthread.h>
+#include <util/member.h>
+#include <util/mpmc_ring.h>
 
 #include <embox/unit.h>
 
@@ -28,12 +27,13 @@ static struct lthread uart_rx_irq_handler;
 struct uart_rx {
 	struct uart *uart;
 	int data;
-	struct dlist_head lnk;
 };
 
-POOL_DEF(uart_rx_buff, struct uart_rx, UART_DATA_BUFF_SZ);
-
-static DLIST_DEFINE(uart_rx_list);
+/* Interrupts of different UARTs may come on different CPUs, they all
+ * put chars here without taking a lock */
+static uint64_t uart_rx_storage[MPMC_RING_STORAGE_SIZE(sizeof(struct uart_rx),
+		UART_DATA_BUFF_SZ) / sizeof(uint64_t)];
+static struct mpmc_ring uart_rx_ring;
 
 static inline struct uart *tty2uart(struct tty *tty) {
 	struct tty_uart *tu;
@@ -42,47 +42,13 @@ static inline struct uart *tty2uart(struct tty *tty) {
 }
 
 static int uart_rx_buff_put(struct uart *dev, int c) {
-	struct uart_rx *rx;
-
-	irq_lock();
-	{
-		rx = pool_alloc(&uart_rx_buff);
-		if (!rx) {
-			irq_unlock();
-			return -1;
-		}
+	struct uart_rx rx = { .uart = dev, .data = c };
 
-		rx->uart = dev;
-		rx->data = c;
-		dlist_add_prev(dlist_head_init(&rx->lnk), &uart_rx_list);
-	}
-	irq_unlock();
-
-	return 0;
+	return mpmc_ring_enqueue(&uart_rx_ring, &rx, 1) ? 0 : -1;
 }
 
 static int uart_rx_buff_get(struct uart_rx *rx_data) {
-	struct uart_rx *rx;
-
-	if (dlist_empty(&uart_rx_list)) {
-		return -1;
-	}
-
-	irq_lock();
-	{
-		rx = dlist_next_entry_or_null(&uart_rx_list, struct uart_rx, lnk);
-		if (!rx) {
-			irq_unlock();
-			return -1;
-		}
-
-		*rx_data = *rx;
-		dlist_del(&rx->lnk);
-		pool_free(&uart_rx_buff, rx);
-	}
-	irq_unlock();
-
-	return 0;
+	return mpmc_ring_dequeue(&uart_rx_ring, rx_data, 1) ? 0 : -1;
 }
 
 static int uart_rx_action(struct lthread *self) {
@@ -109,6 +75,8 @@ irq_return_t uart_irq_handler(unsigned int irq_nr, void *data) {
 }
 
 static int idesc_serial_init(void) {
+	mpmc_ring_init(&uart_rx_ring, uart_rx_storage, sizeof(struct uart_rx),
+			UART_DATA_BUFF_SZ);
 	lthread_init(&uart_rx_irq_handler, &uart_rx_action);
 	schedee_priority_set(&uart_rx_irq_handler.schedee, UART_RX_HND_PRIORITY);
 	return 0;
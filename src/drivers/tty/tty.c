@@ -123,7 +123,7 @@ size_t tty_read(struct tty *t, char *buff, size_t size) {
 			 * tty_rx_locked can be called already. */
 			ipl = ipl_save();
 			{
-				if (ring_empty(&t->rx_ring)) {
+				if (spsc_ring_empty(&t->rx_ring)) {
 					rc = sched_wait_timeout(timeout, NULL);
 				}
 			}
@@ -265,7 +265,8 @@ struct tty *tty_init(struct tty *t, const struct tty_ops *ops) {
 
 	mutex_init(&t->lock);
 
-	ring_init(&t->rx_ring);
+	spsc_ring_init(&t->rx_ring, t->rx_buff, sizeof(t->rx_buff[0]),
+			TTY_RX_BUFF_SZ);
 	ring_init(&t->i_ring);
 	ring_init(&t->i_canon_ring);
 	ring_init(&t->o_ring);
@@ -276,7 +277,7 @@ struct tty *tty_init(struct tty *t, const struct tty_ops *ops) {
 }
 
 int tty_rx_locked(struct tty *t, char ch, unsigned char flag) {
-	uint16_t *slot = t->rx_buff + t->rx_ring.head;
+	uint16_t slot;
 
 	/* Some input must be processed immediatly, like Ctrl-C.
 	 * All other data will be stored as unprocecessed (raw) data
@@ -285,37 +286,36 @@ int tty_rx_locked(struct tty *t, char ch, unsigned char flag) {
 
 	tty_task_break_check(t, ch);
 
-	if (!ring_write(&t->rx_ring, TTY_RX_BUFF_SZ, 1)) {
+	slot = (flag<<CHAR_BIT) | (unsigned char) ch;
+
+	if (!spsc_ring_enqueue(&t->rx_ring, &slot, 1)) {
 		return -1;
 	}
 
-	*slot = (flag<<CHAR_BIT) | (unsigned char) ch;
-
 	tty_notify(t, POLLIN);
 
 	return 0;
 }
 
 int tty_rx_dequeue(struct tty *t) {
-	uint16_t *slot = t->rx_buff + t->rx_ring.tail;
+	uint16_t slot;
 
-	if (!ring_read(&t->rx_ring, TTY_RX_BUFF_SZ, 1)) {
+	if (!spsc_ring_dequeue(&t->rx_ring, &slot, 1)) {
 		return -1;
 	}
 
-	if (TTY_I(t, IGNCR) && *slot == '\r') {
-		t->rx_ring.tail += TTY_RX_BUFF_SZ - 1;
-		ring_fixup_tail(&t->rx_ring, TTY_RX_BUFF_SZ);
+	if (TTY_I(t, IGNCR) && slot == '\r') {
+		/* Dropped, take the next one */
 		return tty_rx_dequeue(t);
 	}
 
-	if (TTY_I(t, ICRNL) && *slot == '\r') {
-		*slot = '\n';
-	} else if (TTY_I(t, INLCR) && *slot == '\n') {
-		*slot = '\r';
+	if (TTY_I(t, ICRNL) && slot == '\r') {
+		slot = '\n';
+	} else if (TTY_I(t, INLCR) && slot == '\n') {
+		slot = '\r';
 	}
 
-	return (int) *slot;
+	return (int) slot;
 }
 
 int tty_out_getc(struct tty *t) {
@@ -0,0 +1,265 @@
+/**
+ * @file
+ * @brief Asynchronous I/O through submission and completion queues
+ *
+ * Every worker thread has its own queue of requests. A request goes to
+ * the worker chosen by its descriptor, that keeps requests to one
+ * descriptor in order and off each other's cursor.
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <embox/unit.h>
+#include <framework/mod/options.h>
+#include <fs/aioq.h>
+#include <fs/idesc.h>
+#include <fs/index_descriptor.h>
+#include <kernel/sched.h>
+#include <kernel/thread.h>
+#include <kernel/thread/ring_wait.h>
+#include <mem/sysmalloc.h>
+#include <util/err.h>
+#include <util/mpmc_ring.h>
+#include <util/spsc_ring.h>
+
+#define AIOQ_WORKERS  OPTION_GET(NUMBER, workers)
+#define AIOQ_REQUESTS OPTION_GET(NUMBER, max_requests)
+
+EMBOX_UNIT_INIT(aioq_init);
+
+struct aioq_req {
+	struct aioq *q;
+	struct idesc *idesc;
+	struct aioq_sqe sqe;
+};
+
+struct aioq_worker {
+	struct mpmc_ring reqs;
+	struct ring_waitq wait;
+	uint64_t storage[MPMC_RING_STORAGE_SIZE(sizeof(struct aioq_req *),
+			AIOQ_REQUESTS) / sizeof(uint64_t)];
+};
+
+static struct aioq_req aioq_reqs[AIOQ_REQUESTS];
+static struct aioq_worker aioq_workers[AIOQ_WORKERS];
+
+/* Free requests, taken by submitters and returned by workers */
+static uint64_t aioq_free_storage[MPMC_RING_STORAGE_SIZE(
+		sizeof(struct aioq_req *), AIOQ_REQUESTS) / sizeof(uint64_t)];
+static struct mpmc_ring aioq_free;
+
+static unsigned int aioq_cq_size(struct aioq *q) {
+	return q->cq.mask + 1;
+}
+
+static void aioq_complete(struct aioq *q, uint64_t user_data, int res) {
+	struct aioq_cqe cqe = { .user_data = user_data, .res = res };
+
+	/* Never full, submission keeps outstanding within its size */
+	mpmc_ring_enqueue_notify(&q->cq, &q->cq_wait, &cqe, 1);
+	__atomic_sub_fetch(&q->inflight, 1, __ATOMIC_RELEASE);
+}
+
+static void aioq_idesc_put(struct idesc *idesc) {
+	if (!__atomic_sub_fetch(&idesc->idesc_count, 1, __ATOMIC_ACQ_REL)) {
+		idesc->idesc_ops->close(idesc);
+	}
+}
+
+static int aioq_run(struct aioq_req *req) {
+	struct aioq_sqe *sqe = &req->sqe;
+	struct iovec iov;
+
+	switch (sqe->opcode) {
+	case AIOQ_OP_NOP:
+	case AIOQ_OP_FSYNC:
+		/* Nothing is cached above idesc */
+		return 0;
+	case AIOQ_OP_READ:
+		iov.iov_base = sqe->addr;
+		iov.iov_len = sqe->len;
+		return idesc_preadv(req->idesc, &iov, 1, sqe->off);
+	case AIOQ_OP_WRITE:
+		iov.iov_base = sqe->addr;
+		iov.iov_len = sqe->len;
+		return idesc_pwritev(req->idesc, &iov, 1, sqe->off);
+	case AIOQ_OP_READV:
+		return idesc_preadv(req->idesc, sqe->addr, sqe->len, sqe->off);
+	case AIOQ_OP_WRITEV:
+		return idesc_pwritev(req->idesc, sqe->addr, sqe->len, sqe->off);
+	default:
+		return -EINVAL;
+	}
+}
+
+static void *aioq_worker_run(void *arg) {
+	struct aioq_worker *w = arg;
+	struct aioq_req *req;
+	int res;
+
+	while (1) {
+		if (1 != mpmc_ring_dequeue_wait(&w->reqs, &w->wait, &req, 1,
+				SCHED_TIMEOUT_INFINITE)) {
+			continue;
+		}
+
+		res = aioq_run(req);
+
+		if (req->idesc) {
+			aioq_idesc_put(req->idesc);
+		}
+		aioq_complete(req->q, req->sqe.user_data, res);
+
+		mpmc_ring_enqueue(&aioq_free, &req, 1);
+	}
+
+	return NULL;
+}
+
+struct aioq *aioq_create(unsigned int entries) {
+	struct aioq *q;
+	size_t cq_size;
+
+	if (!entries || (entries & (entries - 1))) {
+		return err_ptr(EINVAL);
+	}
+
+	q = sysmalloc(sizeof(*q));
+	if (!q) {
+		return err_ptr(ENOMEM);
+	}
+
+	cq_size = MPMC_RING_STORAGE_SIZE(sizeof(struct aioq_cqe), 2 * entries);
+	q->storage = sysmalloc(cq_size + entries * sizeof(struct aioq_sqe));
+	if (!q->storage) {
+		sysfree(q);
+		return err_ptr(ENOMEM);
+	}
+
+	mpmc_ring_init(&q->cq, q->storage, sizeof(struct aioq_cqe), 2 * entries);
+	spsc_ring_init(&q->sq, (char *) q->storage + cq_size,
+			sizeof(struct aioq_sqe), entries);
+	ring_waitq_init(&q->cq_wait);
+	q->inflight = 0;
+	q->outstanding = 0;
+
+	return q;
+}
+
+int aioq_destroy(struct aioq *q) {
+	if (__atomic_load_n(&q->inflight, __ATOMIC_ACQUIRE)) {
+		return -EBUSY;
+	}
+
+	sysfree(q->storage);
+	sysfree(q);
+
+	return 0;
+}
+
+unsigned int aioq_queue(struct aioq *q, const struct aioq_sqe *sqes,
+		unsigned int n) {
+	return spsc_ring_enqueue(&q->sq, sqes, n);
+}
+
+int aioq_submit(struct aioq *q) {
+	struct aioq_worker *w;
+	struct aioq_req *req;
+	struct aioq_sqe sqe;
+	struct idesc *idesc;
+	int done = 0;
+
+	/* Completions not reaped yet hold their CQ slots too */
+	while (__atomic_load_n(&q->outstanding, __ATOMIC_ACQUIRE) < aioq_cq_size(q)) {
+		if (!mpmc_ring_dequeue(&aioq_free, &req, 1)) {
+			break;
+		}
+		if (!spsc_ring_dequeue(&q->sq, &sqe, 1)) {
+			mpmc_ring_enqueue(&aioq_free, &req, 1);
+			break;
+		}
+		__atomic_add_fetch(&q->outstanding, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&q->inflight, 1, __ATOMIC_RELAXED);
+		done++;
+
+		idesc = NULL;
+		if (sqe.opcode != AIOQ_OP_NOP) {
+			idesc = idesc_index_valid(sqe.fd)
+				? index_descriptor_get(sqe.fd) : NULL;
+			if (!idesc) {
+				aioq_complete(q, sqe.user_data, -EBADF);
+				mpmc_ring_enqueue(&aioq_free, &req, 1);
+				continue;
+			}
+			/* Stays open until the request completes */
+			__atomic_add_fetch(&idesc->idesc_count, 1, __ATOMIC_RELAXED);
+		}
+
+		req->q = q;
+		req->idesc = idesc;
+		req->sqe = sqe;
+
+		w = &aioq_workers[((uintptr_t) idesc / sizeof(void *)) % AIOQ_WORKERS];
+		mpmc_ring_enqueue_notify(&w->reqs, &w->wait, &req, 1);
+	}
+
+	if (!done && !spsc_ring_empty(&q->sq)) {
+		return -EAGAIN;
+	}
+
+	return done;
+}
+
+int aioq_reap(struct aioq *q, struct aioq_cqe *cqes, unsigned int min,
+		unsigned int max, int timeout) {
+	unsigned int done;
+	int ret;
+
+	done = mpmc_ring_dequeue(&q->cq, cqes, max);
+	while (done < min) {
+		ret = mpmc_ring_dequeue_wait(&q->cq, &q->cq_wait, cqes + done,
+				max - done, timeout);
+		if (ret < 0) {
+			return done ? done : ret;
+		}
+		done += ret;
+	}
+
+	if (done) {
+		__atomic_sub_fetch(&q->outstanding, done, __ATOMIC_RELEASE);
+	}
+
+	return done;
+}
+
+static int aioq_init(void) {
+	struct aioq_req *req;
+	struct thread *t;
+	int i;
+
+	mpmc_ring_init(&aioq_free, aioq_free_storage, sizeof(struct aioq_req *),
+			AIOQ_REQUESTS);
+	for (i = 0; i < AIOQ_REQUESTS; i++) {
+		req = &aioq_reqs[i];
+		mpmc_ring_enqueue(&aioq_free, &req, 1);
+	}
+
+	for (i = 0; i < AIOQ_WORKERS; i++) {
+		mpmc_ring_init(&aioq_workers[i].reqs, aioq_workers[i].storage,
+				sizeof(struct aioq_req *), AIOQ_REQUESTS);
+		ring_waitq_init(&aioq_workers[i].wait);
+
+		t = thread_create(0, aioq_worker_run, &aioq_workers[i]);
+		if (err(t)) {
+			return err(t);
+		}
+	}
+
+	return 0;
+}
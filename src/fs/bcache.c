@@ -16,6 +16,7 @@
 #include <mem/sysmalloc.h>
 
 #include <fs/bcache.h>
+#include <kernel/kstat.h>
 
 
 #include <embox/unit.h>
@@ -26,6 +27,9 @@ EMBOX_UNIT_INIT(bcache_init);
 POOL_DEF(buffer_head_pool, struct buffer_head, BCACHE_SIZE);
 static DLIST_DEFINE(bh_list);
 
+KSTAT_COUNTER_DEF(bcache_hits, "fs/bcache/hits");
+KSTAT_COUNTER_DEF(bcache_misses, "fs/bcache/misses");
+
 
 static size_t bh_hash(void *key);
 static int bh_cmp(void *key1, void *key2);
@@ -49,11 +53,13 @@ struct buffer_head *bcache_getblk_locked(struct block_dev *bdev, int block, size
 
 		if (bh) {
 			assert(size == bh->blocksize);
+			kstat_inc(&bcache_hits);
 			bcache_buffer_lock(bh);
 			mutex_unlock(&bcache_mutex);
 			return bh;
 		}
 
+		kstat_inc(&bcache_misses);
 		while (-1 == graw_buffers(bdev, block, size)) {
 			free_more_memory(size);
 		}
@@ -64,6 +70,17 @@ struct buffer_head *bcache_getblk_locked(struct block_dev *bdev, int block, size
 	return NULL;
 }
 
+int bcache_cached(struct block_dev *bdev, int block) {
+	struct buffer_head key = { .bdev = bdev, .block = block };
+	int res;
+
+	mutex_lock(&bcache_mutex);
+	res = NULL != hashtable_get(bcache, &key);
+	mutex_unlock(&bcache_mutex);
+
+	return res;
+}
+
 static void free_more_memory(size_t size) {
 	struct buffer_head *bh;
 	struct hashtable_item *ht_item;
@@ -26,6 +26,7 @@
 
 #include <util/array.h>
 #include <util/err.h>
+#include <util/math.h>
 #include <embox/unit.h>
 #include <drivers/block_dev.h>
 #include <mem/misc/pool.h>
@@ -141,12 +142,18 @@ static struct idesc *ext2fs_open(struct node *node, struct file_desc *file_desc,
 static int ext2fs_close(struct file_desc *desc);
 static size_t ext2fs_read(struct file_desc *desc, void *buf, size_t size);
 static size_t ext2fs_write(struct file_desc *desc, void *buf, size_t size);
+static ssize_t ext2fs_pread(struct file_desc *desc, void *buf, size_t size,
+		off_t pos);
+static ssize_t ext2fs_pwrite(struct file_desc *desc, void *buf, size_t size,
+		off_t pos);
 
 static struct file_operations ext2_fop = {
 	.open = ext2fs_open,
 	.close = ext2fs_close,
 	.read = ext2fs_read,
 	.write = ext2fs_write,
+	.pread = ext2fs_pread,
+	.pwrite = ext2fs_pwrite,
 };
 
 /*
@@ -231,6 +238,42 @@ int ext2_write_sector(struct nas *nas, char *buffer, uint32_t count,
 	return count;
 }
 
+/*
+ * Read a part of a metadata block. Goes through the buffer cache, so
+ * repeated lookups of the same inode or indirect block don't touch
+ * the device.
+ */
+static int ext2_read_meta(struct nas *nas, void *buf, size_t len,
+		uint32_t block, size_t off) {
+	struct ext2_fs_info *fsi = nas->fs->fsi;
+
+	if (len != block_dev_read_buffered(nas->fs->bdev, buf, len,
+			(size_t) block * fsi->s_block_size + off)) {
+		return EIO;
+	}
+	return 0;
+}
+
+/*
+ * Read file data blocks. Runs of blocks which are not in the buffer cache
+ * go to the device as a single request and don't pollute the cache.
+ */
+static int ext2_read_data(struct nas *nas, char *buffer, uint32_t count,
+		uint32_t block) {
+	struct ext2_fs_info *fsi = nas->fs->fsi;
+
+	if (0 > block_dev_read_direct(nas->fs->bdev, buffer,
+			count * fsi->s_block_size, fsbtodb(fsi, block))) {
+		return -1;
+	}
+	return count;
+}
+
+static inline void ext2_map_invalidate(struct ext2_file_info *fi) {
+	fi->f_ind_cache_block = ~0;
+	fi->f_map_len = 0;
+}
+
 static uint32_t ext2_rd_indir(char *buf, int index) {
 	return b_ind(buf) [index];
 }
@@ -477,18 +520,23 @@ static int ext2fs_close(struct file_desc *desc) {
 	return ext2_close(nas);
 }
 
-static size_t ext2fs_read(struct file_desc *desc, void *buff, size_t size) {
+static ssize_t ext2fs_pread(struct file_desc *desc, void *buff, size_t size,
+		off_t pos) {
 	int rc;
 	size_t csize;
 	char *buf;
 	size_t buf_size;
 	char *addr = buff;
+	int32_t file_block;
+	uint32_t disk_block, count;
 	struct nas *nas;
 	struct ext2_file_info *fi;
+	struct ext2_fs_info *fsi;
 
 	nas = desc->node->nas;
 	fi = nas->fi->privdata;
-	fi->f_pointer = desc->cursor;
+	fsi = nas->fs->fsi;
+	fi->f_pointer = pos;
 
 	while (size != 0) {
 		/* XXX should handle LARGEFILE */
@@ -496,9 +544,31 @@ static size_t ext2fs_read(struct file_desc *desc, void *buff, size_t size) {
 			break;
 		}
 
+		csize = min(size, (size_t) (fi->f_di.i_size - fi->f_pointer));
+		if (0 == blkoff(fsi, fi->f_pointer) && csize >= fsi->s_block_size) {
+			/* Whole blocks are read straight into the user buffer */
+			file_block = lblkno(fsi, fi->f_pointer);
+			if (0 != (rc = ext2_block_map(nas, file_block, &disk_block))) {
+				return -rc;
+			}
+
+			if (disk_block != 0) {
+				count = ext2_block_run(nas, file_block, disk_block,
+						csize / fsi->s_block_size);
+				if (count != ext2_read_data(nas, addr, count, disk_block)) {
+					return -EIO;
+				}
+
+				csize = count * fsi->s_block_size;
+				fi->f_pointer += csize;
+				addr += csize;
+				size -= csize;
+				continue;
+			}
+		}
+
 		if (0 != (rc = ext2_buf_read_file(nas, &buf, &buf_size))) {
-			SET_ERRNO(rc);
-			return 0;
+			return -rc;
 		}
 
 		csize = size;
@@ -513,28 +583,48 @@ static size_t ext2fs_read(struct file_desc *desc, void *buff, size_t size) {
 		size -= csize;
 	}
 
-	desc->cursor = fi->f_pointer;
-
 	return (addr - (char *) buff);
 }
 
-static size_t ext2fs_write(struct file_desc *desc, void *buff, size_t size) {
+static ssize_t ext2fs_pwrite(struct file_desc *desc, void *buff, size_t size,
+		off_t pos) {
 	uint32_t bytecount;
 	struct nas *nas;
 	struct ext2_file_info *fi;
 
 	nas = desc->node->nas;
 	fi = nas->fi->privdata;
-	fi->f_pointer = desc->cursor;
+	fi->f_pointer = pos;
 
 	bytecount = ext2_write_file(nas, buff, size);
 
-	desc->cursor = fi->f_pointer;
 	nas->fi->ni.size = fi->f_di.i_size;
 
 	return bytecount;
 }
 
+static size_t ext2fs_read(struct file_desc *desc, void *buf, size_t size) {
+	ssize_t ret;
+
+	ret = ext2fs_pread(desc, buf, size, desc->cursor);
+	if (ret < 0) {
+		SET_ERRNO(-ret);
+		return 0;
+	}
+	desc->cursor += ret;
+
+	return ret;
+}
+
+static size_t ext2fs_write(struct file_desc *desc, void *buf, size_t size) {
+	ssize_t ret;
+
+	ret = ext2fs_pwrite(desc, buf, size, desc->cursor);
+	desc->cursor += ret;
+
+	return ret;
+}
+
 static int ext2_create(struct nas *nas, struct nas * parents_nas);
 static int ext2_mkdir(struct nas *nas, struct nas * parents_nas);
 static int ext2_unlink(struct nas *dir_nas, struct nas *nas);
@@ -983,34 +1073,25 @@ extern void e2fs_i_bswap(struct ext2fs_dinode *old, struct ext2fs_dinode *new);
  * Read a new inode into a file structure.
  */
 static int ext2_read_inode(struct nas *nas, uint32_t inumber) {
-	char *buf;
-	size_t rsize;
-	int64_t inode_sector;
-	struct ext2fs_dinode *dip;
+	struct ext2fs_dinode di;
 	struct ext2_file_info *fi;
 	struct ext2_fs_info *fsi;
 
 	fi = nas->fi->privdata;
 	fsi = nas->fs->fsi;
 
-	inode_sector = ino_to_fsba(fsi, inumber);
-
-	/* Read inode and save it */
-	buf = fi->f_buf;
-	rsize = ext2_read_sector(nas, buf, 1, inode_sector);
-	if (rsize * fsi->s_block_size != fsi->s_block_size) {
+	/* Read only the inode itself, the rest of the block stays in bcache */
+	if (ext2_read_meta(nas, &di, sizeof(di), ino_to_fsba(fsi, inumber),
+			EXT2_DINODE_SIZE(fsi) * ino_to_fsbo(fsi, inumber))) {
 		return EIO;
 	}
 
-	/* set pointer to inode struct in read buffer */
-	dip = (struct ext2fs_dinode *) (buf
-			+ EXT2_DINODE_SIZE(fsi) * ino_to_fsbo(fsi, inumber));
-	e2fs_i_bswap(dip, dip);
+	e2fs_i_bswap(&di, &di);
 	/* load inode struct to file info */
-	e2fs_iload(dip, &fi->f_di);
+	e2fs_iload(&di, &fi->f_di);
 
 	/* Clear out the old buffers */
-	fi->f_ind_cache_block = ~0;
+	ext2_map_invalidate(fi);
 	fi->f_buf_blkno = -1;
 	return 0;
 }
@@ -1019,19 +1100,14 @@ static int ext2_read_inode(struct nas *nas, uint32_t inumber) {
  * Given an offset in a file, find the disk block number that
  * contains that block.
  */
-static int ext2_block_map(struct nas *nas, int32_t file_block,
+static int __ext2_block_map(struct nas *nas, int32_t file_block,
 		uint32_t *disk_block_p) {
 	uint level;
 	int32_t ind_cache;
 	int32_t ind_block_num;
-	size_t rsize;
-	int32_t *buf;
 	struct ext2_file_info *fi;
-	struct ext2_fs_info *fsi;
 
 	fi = nas->fi->privdata;
-	fsi = nas->fs->fsi;
-	buf = (void *) fi->f_buf;
 
 	/*
 	 * Index structure of an inode:
@@ -1095,33 +1171,85 @@ static int ext2_block_map(struct nas *nas, int32_t file_block,
 			return 0;
 		}
 
-		/*
-		 * If we were feeling brave, we could work out the number
-		 * of the disk sector and read a single disk sector instead
-		 * of a filesystem block.
-		 * However we don't do this very often anyway...
-		 */
-		rsize = ext2_read_sector(nas, (char *) buf, 1, ind_block_num);
-
-		if (rsize * fsi->s_block_size != fsi->s_block_size) {
-			return EIO;
-		}
-		ind_block_num = fs2h32(buf[file_block >> level]);
 		if (0 == level) {
 			break;
 		}
+
+		/* Only the needed entry is read, the block stays in bcache */
+		if (ext2_read_meta(nas, &ind_block_num, sizeof(ind_block_num),
+				ind_block_num, (file_block >> level) * sizeof(int32_t))) {
+			return EIO;
+		}
+		ind_block_num = fs2h32(ind_block_num);
 		file_block &= (1 << level) - 1;
 	}
 
 	/* Save the part of the block that contains this sector */
-	memcpy(fi->f_ind_cache, &buf[file_block & ~IND_CACHE_MASK],
-			IND_CACHE_SZ * sizeof fi->f_ind_cache[0]);
+	if (ext2_read_meta(nas, fi->f_ind_cache, sizeof(fi->f_ind_cache),
+			ind_block_num, (file_block & ~IND_CACHE_MASK) * sizeof(int32_t))) {
+		return EIO;
+	}
 	fi->f_ind_cache_block = ind_cache;
 
-	*disk_block_p = ind_block_num;
+	*disk_block_p = fs2h32(fi->f_ind_cache[file_block & IND_CACHE_MASK]);
 	return 0;
 }
 
+/*
+ * Same as __ext2_block_map() but remembers the run of contiguous blocks
+ * the result belongs to, so sequential access and seeks within a run
+ * don't look into indirect blocks.
+ */
+static int ext2_block_map(struct nas *nas, int32_t file_block,
+		uint32_t *disk_block_p) {
+	struct ext2_file_info *fi = nas->fi->privdata;
+	int rc;
+
+	if (fi->f_map_len && file_block >= fi->f_map_lblk
+			&& file_block < fi->f_map_lblk + fi->f_map_len) {
+		*disk_block_p = fi->f_map_pblk + (file_block - fi->f_map_lblk);
+		return 0;
+	}
+
+	if (0 != (rc = __ext2_block_map(nas, file_block, disk_block_p))) {
+		return rc;
+	}
+
+	if (*disk_block_p == 0) {
+		/* Hole */
+		return 0;
+	}
+
+	if (fi->f_map_len && file_block == fi->f_map_lblk + fi->f_map_len
+			&& *disk_block_p == fi->f_map_pblk + fi->f_map_len) {
+		fi->f_map_len++;
+	} else {
+		fi->f_map_lblk = file_block;
+		fi->f_map_pblk = *disk_block_p;
+		fi->f_map_len = 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Count how many blocks starting from file_block (mapped to disk_block)
+ * lie on the disk contiguously, but no more than max.
+ */
+static uint32_t ext2_block_run(struct nas *nas, int32_t file_block,
+		uint32_t disk_block, uint32_t max) {
+	uint32_t count, next;
+
+	for (count = 1; count < max; count++) {
+		if (0 != ext2_block_map(nas, file_block + count, &next)
+				|| next != disk_block + count) {
+			break;
+		}
+	}
+
+	return count;
+}
+
 /*
  * Read a portion of a file into an internal buffer.
  * Return the location in the buffer and the amount in the buffer.
@@ -1152,7 +1280,7 @@ static int ext2_buf_read_file(struct nas *nas, char **buf_p, size_t *size_p) {
 			fi->f_buf_size = block_size;
 		}
 		else {
-			if (1 != ext2_read_sector(nas, fi->f_buf, 1, disk_block)) {
+			if (1 != ext2_read_data(nas, fi->f_buf, 1, disk_block)) {
 				return EIO;
 			}
 		}
@@ -1238,8 +1366,9 @@ static size_t ext2_write_file(struct nas *nas, char *buf, size_t size) {
 			}
 		}
 
-		/* one 4096-bytes block read operation */
-		if (1 != ext2_read_sector(nas, fi->f_buf, 1, disk_block)) {
+		/* whole block is overwritten, no need to read it */
+		if (cnt != block_size &&
+				1 != ext2_read_data(nas, fi->f_buf, 1, disk_block)) {
 			bytecount = 0;
 			break;
 		}
@@ -1586,6 +1715,9 @@ int ext2_write_map(struct nas *nas, long position,
 	fi = nas->fi->privdata;
 	fsi = nas->fs->fsi;
 
+	/* Mapping is going to change */
+	ext2_map_invalidate(fi);
+
 	old_block = b1 = b2 = b3 = NO_BLOCK;
 	single = triple = 0;
 	new_ind = new_dbl = new_triple = 0;
@@ -16,6 +16,7 @@
 
 #include <util/array.h>
 #include <util/err.h>
+#include <util/math.h>
 #include <embox/unit.h>
 #include <drivers/block_dev.h>
 #include <mem/misc/pool.h>
@@ -160,106 +161,192 @@ static struct file_operations ext4_fop = {
 	.write = ext4fs_write,
 };
 
-/* Calculates the physical block from a given logical block and extent */
-static uint64_t ext4_extent_get_block_from_ees(struct ext4_extent *ee,
-		uint32_t n_ee, uint32_t lblock, uint32_t *len) {
-	uint32_t block_ext_index = 0;
-	uint32_t block_ext_offset = 0;
-	uint32_t i;
-
-	/* Skip to the right extent entry */
-	for (i = 0; i < n_ee; i++) {
-		if (ee[i].ee_block + ee[i].ee_len > lblock) {
-			block_ext_index = i;
-			block_ext_offset = lblock - ee[i].ee_block;
-			if (len) {
-				*len = ee[i].ee_block + ee[i].ee_len - lblock;
-			}
-			return ee[block_ext_index].ee_start_lo + block_ext_offset;
-		}
-	}
+/*
+ * Read a part of a metadata block. Goes through the buffer cache, so
+ * repeated lookups of the same inode or extent block don't touch the device.
+ */
+static int ext4_read_meta(struct nas *nas, void *buf, size_t len,
+		uint32_t block, size_t off) {
+	struct ext4_fs_info *fsi = nas->fs->fsi;
 
+	if (len != block_dev_read_buffered(nas->fs->bdev, buf, len,
+			(size_t) block * fsi->s_block_size + off)) {
+		return EIO;
+	}
 	return 0;
 }
 
-/* Fetches a block that stores extent info and returns an array of extents
- * _with_ its header. */
-static void *ext4_extent_get_extents_in_block(struct nas *nas, uint32_t block) {
-	struct ext4_extent_header eh;
-	void *exts;
-	uint32_t extents_len;
-	struct ext4_fs_info *fsi;
+/*
+ * Read file data blocks. Runs of blocks which are not in the buffer cache
+ * go to the device as a single request and don't pollute the cache.
+ */
+static int ext4_read_data(struct nas *nas, char *buffer, uint32_t count,
+		uint32_t block) {
+	struct ext4_fs_info *fsi = nas->fs->fsi;
 
-	fsi = nas->fs->fsi;
+	if (0 > block_dev_read_direct(nas->fs->bdev, buffer,
+			count * fsi->s_block_size, fsbtodb(fsi, block))) {
+		return -1;
+	}
+	return count;
+}
 
-	block_dev_read_buffered(nas->fs->bdev, (char*)&eh,
-			sizeof(struct ext4_extent_header), block * fsi->s_block_size);
+static inline uint32_t ext4_extent_len(struct ext4_extent *ee) {
+	return ee->ee_len > EXT4_EXT_INIT_MAX_LEN ?
+			ee->ee_len - EXT4_EXT_INIT_MAX_LEN : ee->ee_len;
+}
 
-	extents_len = eh.eh_entries * sizeof(struct ext4_extent)
-			+ sizeof(struct ext4_extent_header);
+/*
+ * Read k-th entry of the extent tree node stored in block (or in the
+ * inode itself if block is 0). Leaf and index entries have the same size.
+ */
+static int ext4_extent_read_entry(struct nas *nas, uint32_t block, int k,
+		struct ext4_extent *ee) {
+	struct ext4_file_info *fi = nas->fi->privdata;
+	size_t off;
 
-	exts = sysmalloc(extents_len);
+	off = sizeof(struct ext4_extent_header) + k * sizeof(struct ext4_extent);
+	if (block == 0) {
+		memcpy(ee, (char *) fi->f_di.i_block + off, sizeof(*ee));
+		return 0;
+	}
 
-	block_dev_read_buffered(nas->fs->bdev, exts, extents_len,
-			block * fsi->s_block_size);
+	return ext4_read_meta(nas, ee, sizeof(*ee), block, off);
+}
 
-	return exts;
+/*
+ * Find the last entry of a node with the first logical block not greater
+ * than lblock. Entries are sorted, so it's a binary search and only
+ * log2(entries) of them are read.
+ */
+static int ext4_extent_search(struct nas *nas, uint32_t block, int entries,
+		uint32_t lblock, struct ext4_extent *res) {
+	struct ext4_extent ee;
+	int lo, hi, mid, rc;
+
+	rc = ENOENT;
+	lo = 0;
+	hi = entries - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (ext4_extent_read_entry(nas, block, mid, &ee)) {
+			return EIO;
+		}
+
+		/* ee_block and ei_block are at the same place */
+		if (ee.ee_block <= lblock) {
+			memcpy(res, &ee, sizeof(ee));
+			rc = 0;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	return rc;
 }
 
-/* Returns the physical block number */
-static uint64_t ext4_extent_get_pblock(struct nas *nas, void *extents, uint32_t lblock,
-		uint32_t *len) {
-	struct ext4_extent_header *eh = extents;
-	struct ext4_extent *ee_array;
-	uint64_t ret;
+/*
+ * Walk the extent tree down to the leaf covering lblock.
+ * *pblock is set to 0 for holes and uninitialized extents,
+ * *len is the number of blocks the result stays valid for.
+ */
+static int ext4_extent_get_pblock(struct nas *nas, uint32_t lblock,
+		uint32_t *pblock, uint32_t *len) {
+	struct ext4_file_info *fi = nas->fi->privdata;
+	struct ext4_extent_header eh;
+	struct ext4_extent ee;
+	struct ext4_extent_idx *ei;
+	uint32_t block, ee_len;
+	int rc;
 
-	if (eh->eh_depth == 0) {
-		ee_array = extents + sizeof(struct ext4_extent_header);
-		ret = ext4_extent_get_block_from_ees(ee_array, eh->eh_entries, lblock,
-				len);
-	} else {
-		struct ext4_extent_idx *ei_array = extents
-				+ sizeof(struct ext4_extent_header);
-		struct ext4_extent_idx *recurse_ei = NULL;
-		void *leaf_extents;
+	*pblock = EXT4_NO_BLOCK;
+	*len = 1;
 
-		for (int i = 0; i < eh->eh_entries; i++) {
-			assert(ei_array[i].ei_leaf_hi == 0);
+	memcpy(&eh, fi->f_di.i_block, sizeof(eh));
+	block = 0;
 
-			if (ei_array[i].ei_block > lblock) {
-				break;
-			}
+	while (1) {
+		rc = ext4_extent_search(nas, block, eh.eh_entries, lblock, &ee);
+		if (rc) {
+			/* Hole before the first extent */
+			return rc == ENOENT ? 0 : rc;
+		}
 
-			recurse_ei = &ei_array[i];
+		if (eh.eh_depth == 0) {
+			break;
 		}
 
-		assert(recurse_ei);
+		ei = (struct ext4_extent_idx *) &ee;
+		assert(ei->ei_leaf_hi == 0);
+		block = ei->ei_leaf_lo;
+		if (ext4_read_meta(nas, &eh, sizeof(eh), block, 0)) {
+			return EIO;
+		}
+	}
 
-		leaf_extents = ext4_extent_get_extents_in_block(nas,
-				recurse_ei->ei_leaf_lo);
-		ret = ext4_extent_get_pblock(nas, leaf_extents, lblock, len);
-		sysfree(leaf_extents);
+	ee_len = ext4_extent_len(&ee);
+	if (lblock >= ee.ee_block + ee_len) {
+		/* Hole after the extent */
+		return 0;
 	}
 
-	return ret;
+	*len = ee.ee_block + ee_len - lblock;
+	if (ee.ee_len <= EXT4_EXT_INIT_MAX_LEN) {
+		assert(ee.ee_start_hi == 0);
+		*pblock = ee.ee_start_lo + (lblock - ee.ee_block);
+	}
+
+	return 0;
 }
 
-static void ext4_extent_add_block(struct nas *nas, uint32_t lblock, uint64_t pblock) {
+/*
+ * Append a block to the extent list stored in the inode. Only the depth 0
+ * tree is supported, the block is merged into the last extent if possible.
+ */
+static int ext4_extent_add_block(struct nas *nas, uint32_t lblock, uint64_t pblock) {
 	struct ext4_file_info *fi = nas->fi->privdata;
 	void *extents = fi->f_di.i_block;
 	struct ext4_extent_header *eh = extents;
-	struct ext4_extent *ee_array;
+	struct ext4_extent *ee_array, *last;
 	int current_ee;
 
 	ee_array = extents + sizeof(struct ext4_extent_header);
 
-	eh->eh_depth = 0;
+	if (eh->eh_magic != EXT4_EXT_MAGIC) {
+		/* Inode created without an extent header */
+		eh->eh_magic = EXT4_EXT_MAGIC;
+		eh->eh_max = (sizeof(fi->f_di.i_block) - sizeof(*eh))
+				/ sizeof(struct ext4_extent);
+		eh->eh_depth = 0;
+		fi->f_di.i_flags |= EXT4_EXTENTS_FL;
+	}
+	if (eh->eh_depth != 0) {
+		return ENOSPC;
+	}
+
+	if (eh->eh_entries) {
+		last = &ee_array[eh->eh_entries - 1];
+		if (last->ee_len < EXT4_EXT_INIT_MAX_LEN
+				&& lblock == last->ee_block + last->ee_len
+				&& pblock == last->ee_start_lo + last->ee_len) {
+			last->ee_len++;
+			return 0;
+		}
+	}
+
+	if (eh->eh_entries >= eh->eh_max) {
+		return ENOSPC;
+	}
+
 	current_ee = eh->eh_entries++;
 
 	ee_array[current_ee].ee_block = lblock;
 	ee_array[current_ee].ee_len = 1;
 	ee_array[current_ee].ee_start_lo = pblock;
 	ee_array[current_ee].ee_start_hi = 0;
+
+	return 0;
 }
 
 static void *ext4_buff_alloc(struct nas *nas, size_t size) {
@@ -587,11 +674,15 @@ static size_t ext4fs_read(struct file_desc *desc, void *buff, size_t size) {
 	char *buf;
 	size_t buf_size;
 	char *addr = buff;
+	int32_t file_block;
+	uint32_t disk_block, count;
 	struct nas *nas;
 	struct ext4_file_info *fi;
+	struct ext4_fs_info *fsi;
 
 	nas = desc->node->nas;
 	fi = nas->fi->privdata;
+	fsi = nas->fs->fsi;
 	fi->f_pointer = desc->cursor;
 
 	while (size != 0) {
@@ -600,6 +691,31 @@ static size_t ext4fs_read(struct file_desc *desc, void *buff, size_t size) {
 			break;
 		}
 
+		csize = min(size, (size_t) (ext4_file_size(fi->f_di) - fi->f_pointer));
+		if (0 == blkoff(fsi, fi->f_pointer) && csize >= fsi->s_block_size) {
+			/* Whole blocks are read straight into the user buffer */
+			file_block = lblkno(fsi, fi->f_pointer);
+			if (0 != (rc = ext4_block_map(nas, file_block, &disk_block))) {
+				SET_ERRNO(rc);
+				return 0;
+			}
+
+			if (disk_block != EXT4_NO_BLOCK) {
+				count = ext4_block_run(nas, file_block, disk_block,
+						csize / fsi->s_block_size);
+				if (count != ext4_read_data(nas, addr, count, disk_block)) {
+					SET_ERRNO(EIO);
+					return 0;
+				}
+
+				csize = count * fsi->s_block_size;
+				fi->f_pointer += csize;
+				addr += csize;
+				size -= csize;
+				continue;
+			}
+		}
+
 		if (0 != (rc = ext4_buf_read_file(nas, &buf, &buf_size))) {
 			SET_ERRNO(rc);
 			return 0;
@@ -892,35 +1008,26 @@ static int ext4_umount_entry(struct nas *nas) {
  * Read a new inode into a file structure.
  */
 static int ext4_read_inode(struct nas *nas, uint32_t inumber) {
-	char *buf;
-	size_t rsize;
-	int64_t inode_sector;
-	struct ext4_inode *dip;
+	struct ext4_inode di;
 	struct ext4_file_info *fi;
 	struct ext4_fs_info *fsi;
 
 	fi = nas->fi->privdata;
 	fsi = nas->fs->fsi;
 
-	rsize = EXT4_DINODE_SIZE(fsi);
-
-	inode_sector = ext4_ino_to_fsba(fsi, inumber);
-
-	/* Read inode and save it */
-	buf = fi->f_buf;
-	rsize = ext4_read_sector(nas, buf, 1, inode_sector);
-	if (rsize * fsi->s_block_size != fsi->s_block_size) {
+	/* Read only the inode itself, the rest of the block stays in bcache */
+	memset(&di, 0, sizeof(di));
+	if (ext4_read_meta(nas, &di, min(sizeof(di), (size_t) EXT4_DINODE_SIZE(fsi)),
+			ext4_ino_to_fsba(fsi, inumber),
+			EXT4_DINODE_SIZE(fsi) * ext4_ino_to_fsbo(fsi, inumber))) {
 		return EIO;
 	}
-
-	/* set pointer to inode struct in read buffer */
-	dip = (struct ext4_inode *) (buf
-			+ EXT4_DINODE_SIZE(fsi) * ext4_ino_to_fsbo(fsi, inumber));
 	/* load inode struct to file info */
-	e4fs_iload(dip, &fi->f_di);
+	e4fs_iload(&di, &fi->f_di);
 
 	/* Clear out the old buffers */
 	fi->f_ind_cache_block = ~0;
+	fi->f_map_len = 0;
 	fi->f_buf_blkno = -1;
 	return 0;
 }
@@ -932,13 +1039,47 @@ static int ext4_read_inode(struct nas *nas, uint32_t inumber) {
 static int ext4_block_map(struct nas *nas, int32_t file_block,
 		uint32_t *disk_block_p) {
 	uint32_t len;
+	int rc;
 	struct ext4_file_info *fi = nas->fi->privdata;
 
-	*disk_block_p = ext4_extent_get_pblock(nas, fi->f_di.i_block, file_block, &len);
+	/* The whole extent is remembered, so the tree is walked once per extent */
+	if (fi->f_map_len && file_block >= fi->f_map_lblk
+			&& file_block < fi->f_map_lblk + fi->f_map_len) {
+		*disk_block_p = fi->f_map_pblk + (file_block - fi->f_map_lblk);
+		return 0;
+	}
+
+	if (0 != (rc = ext4_extent_get_pblock(nas, file_block, disk_block_p, &len))) {
+		return rc;
+	}
+
+	if (*disk_block_p != EXT4_NO_BLOCK) {
+		fi->f_map_lblk = file_block;
+		fi->f_map_pblk = *disk_block_p;
+		fi->f_map_len = len;
+	}
 
 	return 0;
 }
 
+/*
+ * Count how many blocks starting from file_block (mapped to disk_block)
+ * lie on the disk contiguously, but no more than max.
+ */
+static uint32_t ext4_block_run(struct nas *nas, int32_t file_block,
+		uint32_t disk_block, uint32_t max) {
+	uint32_t count, next;
+
+	for (count = 1; count < max; count++) {
+		if (0 != ext4_block_map(nas, file_block + count, &next)
+				|| next != disk_block + count) {
+			break;
+		}
+	}
+
+	return count;
+}
+
 /*
  * Read a portion of a file into an internal buffer.
  * Return the location in the buffer and the amount in the buffer.
@@ -970,7 +1111,7 @@ static int ext4_buf_read_file(struct nas *nas, char **buf_p, size_t *size_p) {
 			fi->f_buf_size = block_size;
 		}
 		else {
-			if (1 != ext4_read_sector(nas, fi->f_buf, 1, disk_block)) {
+			if (1 != ext4_read_data(nas, fi->f_buf, 1, disk_block)) {
 				return EIO;
 			}
 		}
@@ -1056,8 +1197,9 @@ static size_t ext4_write_file(struct nas *nas, char *buf, size_t size) {
 			}
 		}
 
-		/* one 4096-bytes block read operation */
-		if (1 != ext4_read_sector(nas, fi->f_buf, 1, disk_block)) {
+		/* whole block is overwritten, no need to read it */
+		if (cnt != block_size &&
+				1 != ext4_read_data(nas, fi->f_buf, 1, disk_block)) {
 			bytecount = 0;
 			break;
 		}
@@ -1431,7 +1573,10 @@ static int ext4_new_block(struct nas *nas, long position) {
 			return ENOSPC;
 		}
 
-		ext4_extent_add_block(nas, lblock, b);
+		if (0 != (rc = ext4_extent_add_block(nas, lblock, b))) {
+			ext4_free_block(nas, b);
+			return rc;
+		}
 	}
 	return 0;
 }
@@ -64,6 +64,11 @@
 
 #define EXT4_NO_BLOCK ((uint32_t) 0)
 
+#define EXT4_EXTENTS_FL       0x00080000 /* Inode uses extents */
+#define EXT4_EXT_MAGIC        0xf30a
+/* Extents longer than this are uninitialized (preallocated) ones */
+#define EXT4_EXT_INIT_MAX_LEN (1 << 15)
+
 struct ext4_super_block {
 /*00*/	__le32	s_inodes_count;		/* Inodes count */
 	__le32	s_blocks_count;	/* Blocks count */
@@ -303,6 +308,12 @@ typedef struct ext4_file_info {
 	int32_t		f_ind_cache_block;
 	int32_t		f_ind_cache[EXT4_IND_CACHE_SZ];
 
+	/* Last found run of contiguous blocks: file blocks starting from
+	 * f_map_lblk lie on the disk starting from f_map_pblk */
+	int32_t		f_map_lblk;
+	uint32_t	f_map_pblk;
+	uint32_t	f_map_len;
+
 	char		*f_buf;		/* buffer for data block */
 	size_t		f_buf_size;	/* size of data block */
 	int64_t		f_buf_blkno;/* block number of data block */
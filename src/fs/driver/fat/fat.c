@@ -25,16 +25,72 @@
 #include <drivers/block_dev.h>
 
 extern size_t bdev_blk_sz(struct block_dev *bdev);
+
+/*
+ * File data. Runs of sectors go with one request straight between the
+ * device and the buffer, only blocks already in the buffer cache are
+ * copied through it. Sectors smaller than a device block can only go
+ * through the cache.
+ */
+int fat_read_sectors(struct fat_fs_info *fsi, uint8_t *buffer,
+		uint32_t sector, uint32_t count) {
+	int dev_blk_size, sec_size, ret;
+
+	assert(fsi);
+	assert(fsi->bdev);
+	assert(fsi->vi.bytepersec);
+
+	dev_blk_size = bdev_blk_sz(fsi->bdev);
+	assert(dev_blk_size > 0);
+	sec_size = fsi->vi.bytepersec;
+
+	if (sec_size % dev_blk_size) {
+		ret = block_dev_read(fsi->bdev, (char *) buffer, sec_size * count,
+				sector * sec_size / dev_blk_size);
+	} else {
+		ret = block_dev_read_direct(fsi->bdev, (char *) buffer,
+				sec_size * count, sector * sec_size / dev_blk_size);
+	}
+
+	return 0 > ret ? DFS_ERRMISC : DFS_OK;
+}
+
+int fat_write_sectors(struct fat_fs_info *fsi, uint8_t *buffer,
+		uint32_t sector, uint32_t count) {
+	int dev_blk_size, sec_size, ret;
+
+	assert(fsi->bdev);
+	assert(fsi->vi.bytepersec);
+
+	dev_blk_size = bdev_blk_sz(fsi->bdev);
+	assert(dev_blk_size > 0);
+	sec_size = fsi->vi.bytepersec;
+
+	if (sec_size % dev_blk_size) {
+		ret = block_dev_write(fsi->bdev, (char *) buffer, sec_size * count,
+				sector * sec_size / dev_blk_size);
+	} else {
+		ret = block_dev_write_direct(fsi->bdev, (const char *) buffer,
+				sec_size * count, sector * sec_size / dev_blk_size);
+	}
+
+	return 0 > ret ? DFS_ERRMISC : DFS_OK;
+}
+
+/* FAT, directory and partial data sectors, kept in the buffer cache */
 int fat_read_sector(struct fat_fs_info *fsi, uint8_t *buffer, uint32_t sector) {
+	int dev_blk_size, sec_size;
+
 	assert(fsi);
 	assert(fsi->bdev);
 	assert(fsi->vi.bytepersec);
 
-	int dev_blk_size = bdev_blk_sz(fsi->bdev);
+	dev_blk_size = bdev_blk_sz(fsi->bdev);
 	assert(dev_blk_size > 0);
-	int sec_size = fsi->vi.bytepersec;
+	sec_size = fsi->vi.bytepersec;
 
-	if (0 > block_dev_read(fsi->bdev, (char *) buffer, sec_size, sector * sec_size / dev_blk_size)) {
+	if (0 > block_dev_read(fsi->bdev, (char *) buffer, sec_size,
+				sector * sec_size / dev_blk_size)) {
 		return DFS_ERRMISC;
 	} else {
 		return DFS_OK;
@@ -42,21 +98,23 @@ int fat_read_sector(struct fat_fs_info *fsi, uint8_t *buffer, uint32_t sector) {
 }
 
 int fat_write_sector(struct fat_fs_info *fsi, uint8_t *buffer, uint32_t sector) {
+	int dev_blk_size, sec_size;
+
 	assert(fsi->bdev);
 	assert(fsi->vi.bytepersec);
 
-	int dev_blk_size = bdev_blk_sz(fsi->bdev);
+	dev_blk_size = bdev_blk_sz(fsi->bdev);
 	assert(dev_blk_size > 0);
-	int sec_size = fsi->vi.bytepersec;
+	sec_size = fsi->vi.bytepersec;
 
-	if (0 > block_dev_write(fsi->bdev, (char *) buffer, sec_size, sector * sec_size / dev_blk_size)) {
+	if (0 > block_dev_write(fsi->bdev, (char *) buffer, sec_size,
+				sector * sec_size / dev_blk_size)) {
 		return DFS_ERRMISC;
 	} else {
 		return DFS_OK;
 	}
 }
 
-extern uint8_t fat_sector_buff[FAT_MAX_SECTOR_SIZE];
 static int fat_create_dir_entry(struct nas *parent_nas);
 /* VFS-independent functions */
 static struct fat_file_info *fat_fi_alloc(struct nas *nas, void *fs) {
@@ -95,7 +153,10 @@ static int fat_mount_files(struct nas *dir_nas) {
 	if (fat_get_volinfo(dir_nas->fs->bdev, &fsi->vi, pstart)) {
 		return -1;
 	}
-	di.p_scratch = fat_sector_buff;
+	if (fat_fs_init(fsi)) {
+		return -1;
+	}
+	di.p_scratch = fsi->sector_buff;
 	if (fat_open_dir(fsi, (uint8_t *) ROOT_DIR, &di)) {
 		return -EBUSY;
 	}
@@ -222,12 +283,18 @@ static struct idesc *fatfs_open(struct node *node, struct file_desc *file_desc,
 static int    fatfs_close(struct file_desc *desc);
 static size_t fatfs_read(struct file_desc *desc, void *buf, size_t size);
 static size_t fatfs_write(struct file_desc *desc, void *buf, size_t size);
+static ssize_t fatfs_pread(struct file_desc *desc, void *buf, size_t size,
+		off_t pos);
+static ssize_t fatfs_pwrite(struct file_desc *desc, void *buf, size_t size,
+		off_t pos);
 
 static struct file_operations fatfs_fop = {
 	.open = fatfs_open,
 	.close = fatfs_close,
 	.read = fatfs_read,
 	.write = fatfs_write,
+	.pread = fatfs_pread,
+	.pwrite = fatfs_pwrite,
 };
 
 /*
@@ -237,17 +304,22 @@ static struct idesc *fatfs_open(struct node *node, struct file_desc *desc,  int
 	struct nas *nas;
 	char path [PATH_MAX];
 	struct fat_file_info *fi;
+	struct fat_fs_info *fsi;
 	int res;
 
 	nas = node->nas;
 	fi = nas->fi->privdata;
+	fsi = nas->fs->fsi;
 
 	vfs_get_relative_path(node, path, PATH_MAX);
 
 	while (path[0] == '/') {
 		strcpy(path, path + 1);
 	}
-	res = fat_open_file(fi, (uint8_t *) path, flag, fat_sector_buff, &nas->fi->ni.size);
+	fi->fsi = fsi;
+	mutex_lock(&fsi->lock);
+	res = fat_open_file(fi, (uint8_t *) path, flag, fsi->sector_buff, &nas->fi->ni.size);
+	mutex_unlock(&fsi->lock);
 	if (DFS_OK == res) {
 		fi->pointer = desc->cursor;
 		return &desc->idesc;
@@ -260,46 +332,82 @@ static int fatfs_close(struct file_desc *desc) {
 	return 0;
 }
 
-static size_t fatfs_read(struct file_desc *desc, void *buf, size_t size) {
+static ssize_t fatfs_pread(struct file_desc *desc, void *buf, size_t size,
+		off_t pos) {
 	size_t rezult;
 	uint32_t bytecount;
 	struct nas *nas;
 	struct fat_file_info *fi;
+	struct fat_fs_info *fsi;
 
 	nas = desc->node->nas;
 	fi = nas->fi->privdata;
-	fi->pointer = desc->cursor;
-	fi->fsi     = nas->fs->fsi;
+	fsi = nas->fs->fsi;
+
+	mutex_lock(&fsi->lock);
 	/* Don't try to read past EOF */
-	if (size > nas->fi->ni.size - fi->pointer) {
-		size = nas->fi->ni.size - fi->pointer;
+	if (pos >= nas->fi->ni.size) {
+		mutex_unlock(&fsi->lock);
+		return 0;
 	}
-
-	rezult = fat_read_file(fi, fat_sector_buff, buf, &bytecount, size);
-	if (DFS_OK == rezult) {
-		desc->cursor = fi->pointer;
-		return bytecount;
+	if (size > nas->fi->ni.size - pos) {
+		size = nas->fi->ni.size - pos;
 	}
-	return rezult;
+
+	fi->pointer = pos;
+	fi->fsi     = fsi;
+	rezult = fat_read_file(fi, fsi->sector_buff, buf, &bytecount, size);
+	mutex_unlock(&fsi->lock);
+
+	return DFS_OK == rezult ? bytecount : -EIO;
 }
 
-static size_t fatfs_write(struct file_desc *desc, void *buf, size_t size) {
+static ssize_t fatfs_pwrite(struct file_desc *desc, void *buf, size_t size,
+		off_t pos) {
 	size_t rezult;
 	uint32_t bytecount;
 	struct nas *nas;
 	struct fat_file_info *fi;
+	struct fat_fs_info *fsi;
 
 	nas = desc->node->nas;
 	fi = nas->fi->privdata;
-	fi->pointer = desc->cursor;
-	fi->fsi = nas->fs->fsi;
-	rezult = fat_write_file(fi, fat_sector_buff, (uint8_t *)buf,
+	fsi = nas->fs->fsi;
+
+	mutex_lock(&fsi->lock);
+	fi->pointer = pos;
+	fi->fsi = fsi;
+	rezult = fat_write_file(fi, fsi->sector_buff, (uint8_t *)buf,
 			&bytecount, size, &nas->fi->ni.size);
-	if (DFS_OK == rezult) {
-		desc->cursor = fi->pointer;
-		return bytecount;
+	mutex_unlock(&fsi->lock);
+
+	return DFS_OK == rezult ? bytecount : -EIO;
+}
+
+static size_t fatfs_read(struct file_desc *desc, void *buf, size_t size) {
+	ssize_t ret;
+
+	ret = fatfs_pread(desc, buf, size, desc->cursor);
+	if (ret < 0) {
+		SET_ERRNO(-ret);
+		return 0;
+	}
+	desc->cursor += ret;
+
+	return ret;
+}
+
+static size_t fatfs_write(struct file_desc *desc, void *buf, size_t size) {
+	ssize_t ret;
+
+	ret = fatfs_pwrite(desc, buf, size, desc->cursor);
+	if (ret < 0) {
+		SET_ERRNO(-ret);
+		return 0;
 	}
-	return rezult;
+	desc->cursor += ret;
+
+	return ret;
 }
 
 static int fat_mount_files (struct nas *dir_nas);
@@ -414,10 +522,10 @@ static int fatfs_mount(void *dev, void *dir) {
 static inline int read_dir_buf(struct fat_fs_info *fsi, struct dirinfo *di) {
 	struct volinfo *vi = &fsi->vi;
 	if (vi->filesystem == FAT32)
-		return fat_read_sector(fsi, fat_sector_buff,
+		return fat_read_sector(fsi, fsi->sector_buff,
 		                       vi->dataarea + (di->currentcluster - 2) * vi->secperclus);
 	else
-		return fat_read_sector(fsi, fat_sector_buff, vi->rootdir);
+		return fat_read_sector(fsi, fsi->sector_buff, vi->rootdir);
 }
 
 static int fatfs_create(struct node *parent_node, struct node *node) {
@@ -429,40 +537,48 @@ static int fatfs_create(struct node *parent_node, struct node *node) {
 	char dir_path[PATH_MAX];
 	char *dpath;
 	char tmppath[PATH_MAX];
+	int res;
 
 	assert(parent_node && node);
 
 	nas = node->nas;
 	parent_nas = parent_node->nas;
 	nas->fi->ni.size = 0;
+	fsi = parent_nas->fs->fsi;
 
 	memset(&di,0, sizeof(di));
 	di.p_scratch = (uint8_t *) dir_buff;
 
 	vfs_get_relative_path(parent_nas->node, dir_path, PATH_MAX);
 	dpath = basename(dir_path);
-	if (fat_open_dir(parent_nas->fs->fsi, (uint8_t *) dpath, &di)) {
-		return -ENODEV;
+
+	mutex_lock(&fsi->lock);
+	if (fat_open_dir(fsi, (uint8_t *) dpath, &di)) {
+		res = -ENODEV;
+		goto out;
 	}
 
 	if (NULL == fat_fi_alloc(nas, parent_nas->fs)) {
-		return -ENOMEM;
+		res = -ENOMEM;
+		goto out;
 	}
 
 	vfs_get_relative_path(node, tmppath, PATH_MAX);
 
 	fi = nas->fi->privdata;
-	fsi = nas->fs->fsi;
 	*fi = (struct fat_file_info) {
 		.fsi = fsi,
 		.volinfo = &fsi->vi,
 	};
 
+	res = 0;
 	if (0 != fat_create_file(fi, &di, tmppath, node->mode)) {
-		return -EIO;
+		res = -EIO;
 	}
 
-	return 0;
+out:
+	mutex_unlock(&fsi->lock);
+	return res;
 }
 
 static int fatfs_delete(struct node *node) {
@@ -483,16 +599,20 @@ static int fatfs_delete(struct node *node) {
 	if (path[root_path_len] == '\0') {
 		fat_fs_free(fsi);
 	} else {
+		int res;
+
+		mutex_lock(&fsi->lock);
 		if (node_is_directory(node)) {
-			if (fat_unlike_directory(fi, (uint8_t *) path + root_path_len,
-				(uint8_t *) fat_sector_buff)) {
-				return -1;
-			}
+			res = fat_unlike_directory(fi, (uint8_t *) path + root_path_len,
+				fsi->sector_buff);
 		} else {
-			if (fat_unlike_file(fi, (uint8_t *) path + root_path_len,
-				(uint8_t *) fat_sector_buff)) {
-				return -1;
-			}
+			res = fat_unlike_file(fi, (uint8_t *) path + root_path_len,
+				fsi->sector_buff);
+		}
+		mutex_unlock(&fsi->lock);
+
+		if (res) {
+			return -1;
 		}
 	}
 	fat_file_free(fi);
@@ -12,6 +12,11 @@
 #include <stdint.h>
 
 #include <fs/mbr.h>
+#include <framework/mod/options.h>
+#include <kernel/thread/sync/mutex.h>
+
+#define FAT_MAX_SECTOR_SIZE OPTION_MODULE_GET(embox__fs__driver__fat, NUMBER, fat_max_sector_size)
+#define FAT_FILE_EXTENTS    OPTION_MODULE_GET(embox__fs__driver__fat, NUMBER, file_extents)
 
 #define DIR_SEPARATOR   '/'	/* character separating directory components*/
 #define ROOT_DIR        "/"
@@ -233,10 +238,34 @@ struct volinfo {
  */
 #define DFS_DI_BLANKENT		0x01	/* Searching for blank entry */
 
+/*
+ *	Per-mount state. Everything below is protected by the lock, which is
+ *	taken by VFS glue (fat.c, fat_dvfs.c) around every operation, functions
+ *	from fat_common.c expect it to be held.
+ */
 struct fat_fs_info {
 	struct volinfo vi;
 	struct block_dev *bdev;
 	struct node *root;
+
+	struct mutex lock;
+	/* Scratch sector for directory and partial sector I/O */
+	uint8_t sector_buff[FAT_MAX_SECTOR_SIZE] __attribute__((aligned(16)));
+
+	/* In-memory copy of the FAT, NULL if the volume is too large. Disk FAT
+	 * is still written through on every change. */
+	uint32_t *fat_cache;
+	unsigned long *free_map;	/* bit is set for a free cluster */
+	uint32_t free_hint;			/* where to start looking for a free cluster */
+};
+
+/*
+ *	Run of contiguous clusters of a file
+ */
+struct fat_extent {
+	uint32_t fclus;		/* index of the first cluster within the file */
+	uint32_t dclus;		/* its number on disk */
+	uint32_t len;		/* number of clusters */
 };
 
 struct fat_file_info {
@@ -250,6 +279,10 @@ struct fat_file_info {
 
 	uint32_t cluster;			/* current cluster */
 	uint32_t pointer;			/* current (BYTE) pointer */
+
+	/* Cluster chain from the beginning of the file, filled in lazily */
+	struct fat_extent ext[FAT_FILE_EXTENTS];
+	int ext_n;
 };
 
 /*
@@ -264,9 +297,6 @@ struct dirinfo {
 	uint8_t flags;				/* internal DOSFS flags */
 };
 
-#include <framework/mod/options.h>
-#define FAT_MAX_SECTOR_SIZE OPTION_MODULE_GET(embox__fs__driver__fat, NUMBER, fat_max_sector_size)
-
 extern void fat_set_filetime(struct fat_dirent *de);
 extern void fat_get_filename(char *tmppath, char *filename);
 extern int fat_check_filename(char *filename);
@@ -276,6 +306,10 @@ extern char *path_canonical_to_dir(char *dest, char *src);
 extern char *path_dir_to_canonical(char *dest, char *src, char dir);
 extern int      fat_write_sector(struct fat_fs_info *fsi, uint8_t *buffer, uint32_t sector);
 extern int      fat_read_sector(struct fat_fs_info *fsi, uint8_t *buffer, uint32_t sector);
+extern int      fat_write_sectors(struct fat_fs_info *fsi, uint8_t *buffer,
+                                  uint32_t sector, uint32_t count);
+extern int      fat_read_sectors(struct fat_fs_info *fsi, uint8_t *buffer,
+                                 uint32_t sector, uint32_t count);
 extern uint32_t fat_get_next(struct fat_fs_info *fsi,
                              struct dirinfo * dirinfo, struct fat_dirent * dirent);
 extern uint32_t fat_get_next_long(struct fat_fs_info *fsi,
@@ -292,7 +326,8 @@ extern uint32_t fat_open_dir(struct fat_fs_info *fsi,
                              uint8_t *dirname, struct dirinfo *dirinfo);
 extern uint32_t fat_get_free_dir_ent(struct fat_fs_info *fsi, uint8_t *path,
                              struct dirinfo *di, struct fat_dirent *de);
-extern void     fat_set_direntry (uint32_t dir_cluster, uint32_t cluster);
+extern void     fat_set_direntry(uint8_t *p_scratch, uint32_t dir_cluster,
+                                 uint32_t cluster);
 extern uint32_t fat_open_file(struct fat_file_info *fi, uint8_t *path, int mode,
 		uint8_t *p_scratch, size_t *size);
 extern uint32_t fat_read_file(struct fat_file_info *fi, uint8_t *p_scratch,
@@ -307,6 +342,7 @@ extern int      fat_unlike_directory(struct fat_file_info *fi, uint8_t *path,
 
 extern struct fat_fs_info *fat_fs_alloc(void);
 extern void fat_fs_free(struct fat_fs_info *fsi);
+extern int fat_fs_init(struct fat_fs_info *fsi);
 extern struct fat_file_info *fat_file_alloc(void);
 extern void fat_file_free(struct fat_file_info *fi);
 extern struct dirinfo *fat_dirinfo_alloc(void);
@@ -18,6 +18,8 @@
 #include <kernel/printk.h>
 #include <fs/fat.h>
 #include <mem/misc/pool.h>
+#include <mem/sysmalloc.h>
+#include <util/bitmap.h>
 #include <util/math.h>
 
 #define FAT_USE_LONG_NAMES OPTION_GET(BOOLEAN, fat_max_sector_size)
@@ -27,7 +29,11 @@
 #define SYSTEM16 "FAT16   "
 #define SYSTEM32 "FAT32   "
 
-uint8_t fat_sector_buff[FAT_MAX_SECTOR_SIZE] __attribute__((aligned(16)));
+#define FAT_CACHE_MAX_CLUSTERS OPTION_GET(NUMBER, fat_cache_max_clusters)
+
+/* Only for formatting and probing a volume, when there is no fat_fs_info
+ * with its own buffer yet */
+static uint8_t fat_sector_buff[FAT_MAX_SECTOR_SIZE] __attribute__((aligned(16)));
 
 size_t bdev_blk_sz(struct block_dev *bdev) {
 	return bdev->block_size;
@@ -52,6 +58,19 @@ static int fat_sec_by_clus(struct fat_fs_info *fsi, int clus) {
 	return clus > 2 ? (clus - 2) * fsi->vi.secperclus + fsi->vi.dataarea : 0;
 }
 
+/* Lets the device (e.g. flash translation layer) drop the freed cluster */
+static void fat_discard_cluster(struct fat_fs_info *fsi, uint32_t clus) {
+	uint32_t blkpersec = fsi->vi.bytepersec / fsi->bdev->block_size;
+
+	if (clus < 2 || clus >= fsi->vi.numclusters + 2) {
+		return;
+	}
+
+	block_dev_discard(fsi->bdev,
+			((clus - 2) * fsi->vi.secperclus + fsi->vi.dataarea) * blkpersec,
+			fsi->vi.secperclus * blkpersec);
+}
+
 extern int fat_read_sector(struct fat_fs_info *fsi, uint8_t *buffer, uint32_t sector);
 extern int fat_write_sector(struct fat_fs_info *fsi, uint8_t *buffer, uint32_t sector);
 
@@ -335,6 +354,13 @@ uint32_t fat_get_fat_(struct fat_fs_info *fsi,
 	uint32_t offset, sector, result;
 	struct volinfo *volinfo = &fsi->vi;
 
+	if (fsi->fat_cache) {
+		if (cluster >= volinfo->numclusters + 2) {
+			return DFS_BAD_CLUS;
+		}
+		return fsi->fat_cache[cluster];
+	}
+
 	switch (volinfo->filesystem) {
 		case FAT12:
 			offset = cluster + (cluster / 2);
@@ -450,6 +476,17 @@ uint32_t fat_set_fat_(struct fat_fs_info *fsi, uint8_t *p_scratch,
 		default:
 			return DFS_ERRMISC;
 	}
+
+	if (fsi->fat_cache && cluster >= 2 && cluster < volinfo->numclusters + 2) {
+		fsi->fat_cache[cluster] = new_contents;
+		if (new_contents) {
+			bitmap_clear_bit(fsi->free_map, cluster);
+		} else {
+			bitmap_set_bit(fsi->free_map, cluster);
+			fsi->free_hint = min(fsi->free_hint, cluster);
+		}
+	}
+
 	/*
 	 * at this point, offset is the BYTE offset of the desired sector from
 	 * the start of the FAT.
@@ -628,6 +665,17 @@ static void fat_append_longname(char *name, struct fat_dirent *di) {
  */
 uint32_t fat_get_free_fat_(struct fat_fs_info *fsi, uint8_t *p_scratch) {
 	uint32_t i, result = 0xffffffff, p_scratchcache = 0;
+
+	if (fsi->free_map) {
+		i = bitmap_find_bit(fsi->free_map, fsi->vi.numclusters + 2,
+				fsi->free_hint);
+		if (i >= fsi->vi.numclusters + 2) {
+			return DFS_BAD_CLUS;
+		}
+		fsi->free_hint = i;
+		return i;
+	}
+
 	/*
 	 * Search starts at cluster 2, which is the first usable cluster
 	 * NOTE: This search can't terminate at a bad cluster, because there might
@@ -979,8 +1027,11 @@ uint32_t fat_get_free_dir_ent(struct fat_fs_info *fsi, uint8_t *path,
 	return DFS_ERRMISC;
 }
 
-void fat_set_direntry (uint32_t dir_cluster, uint32_t cluster) {
-	struct fat_dirent *de = (struct fat_dirent *) fat_sector_buff;
+void fat_set_direntry(uint8_t *p_scratch, uint32_t dir_cluster,
+		uint32_t cluster) {
+	struct fat_dirent *de = (struct fat_dirent *) p_scratch;
+
+	memset(p_scratch, 0, FAT_MAX_SECTOR_SIZE);
 
 	de[0] = (struct fat_dirent) {
 		.name = MSDOS_DOT,
@@ -1006,7 +1057,7 @@ void fat_set_direntry (uint32_t dir_cluster, uint32_t cluster) {
 
 int fat_root_dir_record(void *bdev) {
 	uint32_t cluster;
-	struct fat_fs_info fsi;
+	struct fat_fs_info fsi = { };
 	uint32_t pstart, psize;
 	uint8_t pactive, ptype;
 	struct fat_dirent de;
@@ -1085,133 +1136,247 @@ int fat_root_dir_record(void *bdev) {
 	return DFS_OK;
 }
 
+static inline int fat_is_eoc(struct volinfo *vi, uint32_t cluster) {
+	switch (vi->filesystem) {
+	case FAT12:
+		return cluster < 2 || cluster >= 0x0ff7;
+	case FAT16:
+		return cluster < 2 || cluster >= 0xfff7;
+	default:
+		return cluster < 2 || cluster >= 0x0ffffff7;
+	}
+}
+
+static inline uint32_t fat_eoc_mark(struct volinfo *vi) {
+	switch (vi->filesystem) {
+	case FAT12:
+		return 0xfff;
+	case FAT16:
+		return 0xffff;
+	default:
+		return 0x0fffffff;
+	}
+}
+
+static inline uint32_t fat_clus_to_sec(struct volinfo *vi, uint32_t cluster) {
+	return vi->dataarea + (cluster - 2) * vi->secperclus;
+}
+
+/*
+ * Allocate a cluster, preferably the one right after prev, and append it
+ * to the chain ending with prev.
+ * Returns DFS_BAD_CLUS if there is no free cluster.
+ */
+static uint32_t fat_alloc_cluster(struct fat_fs_info *fsi,
+		uint8_t *p_scratch, uint32_t prev) {
+	struct volinfo *vi = &fsi->vi;
+	uint32_t cluster, cache = 0;
+
+	cluster = prev + 1;
+	if (cluster >= vi->numclusters + 2 ||
+			fat_get_fat_(fsi, p_scratch, &cache, cluster)) {
+		cluster = fat_get_free_fat_(fsi, p_scratch);
+		if (cluster == DFS_BAD_CLUS) {
+			return DFS_BAD_CLUS;
+		}
+	}
+
+	cache = 0;
+	if (fat_set_fat_(fsi, p_scratch, &cache, cluster, fat_eoc_mark(vi)) ||
+			fat_set_fat_(fsi, p_scratch, &cache, prev, cluster)) {
+		return DFS_BAD_CLUS;
+	}
+
+	return cluster;
+}
+
+/*
+ * Get disk cluster number of the idx-th cluster of the file. If the chain
+ * is shorter, a value fat_is_eoc() is true for is returned.
+ * fi->ext describes the beginning of the chain as runs of contiguous
+ * clusters, it's extended as the chain is walked further. So seeking within
+ * already visited part of a file doesn't read the FAT at all.
+ */
+static uint32_t fat_file_cluster(struct fat_file_info *fi,
+		uint8_t *p_scratch, uint32_t idx) {
+	struct fat_fs_info *fsi = fi->fsi;
+	struct volinfo *vi = fi->volinfo;
+	struct fat_extent *ext;
+	uint32_t cur, cur_idx, next, cache = 0;
+	int i;
+
+	for (i = 0; i < fi->ext_n; i++) {
+		ext = &fi->ext[i];
+		if (idx < ext->fclus + ext->len) {
+			return ext->dclus + (idx - ext->fclus);
+		}
+	}
+
+	if (fi->ext_n == 0) {
+		if (fat_is_eoc(vi, fi->firstcluster)) {
+			return fi->firstcluster;
+		}
+		fi->ext[0] = (struct fat_extent) {
+			.fclus = 0,
+			.dclus = fi->firstcluster,
+			.len   = 1,
+		};
+		fi->ext_n = 1;
+	}
+
+	ext = &fi->ext[fi->ext_n - 1];
+	cur_idx = ext->fclus + ext->len - 1;
+	cur = ext->dclus + ext->len - 1;
+
+	while (cur_idx < idx) {
+		next = fat_get_fat_(fsi, p_scratch, &cache, cur);
+		if (fat_is_eoc(vi, next)) {
+			return next;
+		}
+		cur_idx++;
+
+		if (ext && next == cur + 1) {
+			ext->len++;
+		} else if (ext && fi->ext_n < FAT_FILE_EXTENTS) {
+			ext = &fi->ext[fi->ext_n++];
+			*ext = (struct fat_extent) {
+				.fclus = cur_idx,
+				.dclus = next,
+				.len   = 1,
+			};
+		} else {
+			/* Too fragmented, the rest of the chain is walked each time */
+			ext = NULL;
+		}
+		cur = next;
+	}
+
+	return cur;
+}
+
+/*
+ * Count how many sectors (but no more than max) starting from sector secoff
+ * of cluster idx of the file lie on the disk contiguously.
+ */
+static uint32_t fat_file_run(struct fat_file_info *fi, uint8_t *p_scratch,
+		uint32_t idx, uint32_t cluster, uint32_t secoff, uint32_t max) {
+	struct volinfo *vi = fi->volinfo;
+	uint32_t next, count;
+
+	count = vi->secperclus - secoff;
+
+	while (count < max) {
+		next = fat_file_cluster(fi, p_scratch, ++idx);
+		if (next != cluster + 1) {
+			break;
+		}
+		count += vi->secperclus;
+		cluster = next;
+	}
+
+	return min(count, max);
+}
+
+/*
+ * Make the cluster chain of the file long enough to keep len bytes.
+ * All the clusters are allocated at once, so they are likely to be
+ * contiguous and written with a single request afterwards.
+ */
+static uint32_t fat_file_extend(struct fat_file_info *fi, uint8_t *p_scratch,
+		uint32_t len) {
+	struct fat_fs_info *fsi = fi->fsi;
+	struct volinfo *vi = fi->volinfo;
+	struct fat_extent *ext;
+	uint32_t need, last, last_idx, next, cache = 0;
+
+	if (len == 0) {
+		return DFS_OK;
+	}
+	need = (len - 1) / (vi->secperclus * vi->bytepersec);
+
+	if (!fat_is_eoc(vi, fat_file_cluster(fi, p_scratch, need))) {
+		return DFS_OK;
+	}
+	if (fi->ext_n == 0) {
+		/* File has no clusters at all */
+		return DFS_ERRMISC;
+	}
+
+	ext = &fi->ext[fi->ext_n - 1];
+	last_idx = ext->fclus + ext->len - 1;
+	last = ext->dclus + ext->len - 1;
+	while (!fat_is_eoc(vi, next = fat_get_fat_(fsi, p_scratch, &cache, last))) {
+		last = next;
+		last_idx++;
+	}
+
+	while (last_idx < need) {
+		last = fat_alloc_cluster(fsi, p_scratch, last);
+		if (fat_is_eoc(vi, last)) {
+			return DFS_ERRMISC;
+		}
+		last_idx++;
+	}
+
+	return DFS_OK;
+}
+
 /*
  * Read an open file
  * You must supply a prepopulated file_info_t as provided by fat_open_file,
  * and a pointer to a volinfo->bytepersec scratch buffer.
  * 	Note that returning DFS_EOF is not an error condition. This function
  * 	updates the	successcount field with the number of bytes actually read.
+ * 	Reading starts from fi->pointer, fi->cluster is looked up by it.
  */
 uint32_t fat_read_file(struct fat_file_info *fi, uint8_t *p_scratch,
 		uint8_t *buffer, uint32_t *successcount, uint32_t len) {
-	uint32_t remain;
-	uint32_t result;
-	uint32_t sector;
-	uint32_t bytesread;
-	uint32_t clastersize;
-	struct fat_fs_info *fsi;
-	fsi = fi->fsi;
+	struct fat_fs_info *fsi = fi->fsi;
+	struct volinfo *vi = fi->volinfo;
+	uint32_t clustersize = vi->secperclus * vi->bytepersec;
+	uint32_t remain, idx, secoff, offset, sector, nsec, bytesread;
 
-	result = DFS_OK;
 	remain = len;
 	*successcount = 0;
-	clastersize = fi->volinfo->secperclus * fi->volinfo->bytepersec;
-
-	while (remain && result == DFS_OK) {
-		/* This is a bit complicated. The sector we want to read is addressed
-		 * at a cluster granularity by the fi->cluster member. The file
-		 * pointer tells us how many extra sectors to add to that number.
-		 */
-		sector = fi->volinfo->dataarea +
-		  ((fi->cluster - 2) * fi->volinfo->secperclus) +
-		  div(div(fi->pointer, clastersize).rem, fi->volinfo->bytepersec).quot;
-
-		/* Case 1 - File pointer is not on a sector boundary */
-		if (div(fi->pointer, fi->volinfo->bytepersec).rem) {
-			uint16_t tempreadsize;
-
-			/* We always have to go through scratch in this case */
-			result = fat_read_sector(fsi, p_scratch, sector);
 
-			/*
-			 * This is the number of bytes that we actually care about in the
-			 * sector just read.
-			 */
-			tempreadsize = fi->volinfo->bytepersec -
-					(div(fi->pointer, fi->volinfo->bytepersec).rem);
+	while (remain) {
+		idx = fi->pointer / clustersize;
+		fi->cluster = fat_file_cluster(fi, p_scratch, idx);
+		if (fat_is_eoc(vi, fi->cluster)) {
+			return DFS_EOF;
+		}
 
-			/* Case 1A - We want the entire remainder of the sector. After this
-			 * point, all passes through the read loop will be aligned on a
-			 * sector boundary, which allows us to go through the optimal path
-			 *  2A below.
-			 */
-		   	if (remain >= tempreadsize) {
-				memcpy(buffer, p_scratch + (fi->volinfo->bytepersec - tempreadsize),
-						tempreadsize);
-				bytesread = tempreadsize;
-				buffer += tempreadsize;
-				fi->pointer += tempreadsize;
-				remain -= tempreadsize;
-			}
-			/* Case 1B - This read concludes the file read operation */
-			else {
-				memcpy(buffer, p_scratch +
-						(fi->volinfo->bytepersec - tempreadsize), remain);
+		secoff = (fi->pointer % clustersize) / vi->bytepersec;
+		offset = fi->pointer % vi->bytepersec;
+		sector = fat_clus_to_sec(vi, fi->cluster) + secoff;
 
-				buffer += remain;
-				fi->pointer += remain;
-				bytesread = remain;
-				remain = 0;
-			}
-		}
-		/* Case 2 - File pointer is on sector boundary */
-		else {
-			/*
-			 * Case 2A - We have at least one more full sector to read and
-			 * don't have to go through the scratch buffer. You could insert
-			 * optimizations here to read multiple sectors at a time, if you
-			 * were thus inclined (note that the maximum multi-read you could
-			 * perform is a single cluster, so it would be advantageous to have
-			 * code similar to case 1A above that would round the pointer to a
-			 * cluster boundary the first pass through, so all subsequent
-			 * [large] read requests would be able to go a cluster at a time).
-			 */
-			 if (remain >= fi->volinfo->bytepersec) {
-				result = fat_read_sector(fsi, buffer, sector);
-				remain -= fi->volinfo->bytepersec;
-				buffer += fi->volinfo->bytepersec;
-				fi->pointer += fi->volinfo->bytepersec;
-				bytesread = fi->volinfo->bytepersec;
+		if (offset || remain < vi->bytepersec) {
+			/* Partial sector always goes through scratch */
+			if (fat_read_sector(fsi, p_scratch, sector)) {
+				return DFS_ERRMISC;
 			}
-			/* Case 2B - We are only reading a partial sector */
-			else {
-				result = fat_read_sector(fsi, p_scratch, sector);
-				memcpy(buffer, p_scratch, remain);
-				buffer += remain;
-				fi->pointer += remain;
-				bytesread = remain;
-				remain = 0;
+			bytesread = min(vi->bytepersec - offset, remain);
+			memcpy(buffer, p_scratch + offset, bytesread);
+		} else {
+			/* Whole sectors are read straight into the user buffer,
+			 * as many contiguous ones as possible with one request */
+			nsec = fat_file_run(fi, p_scratch, idx, fi->cluster, secoff,
+					remain / vi->bytepersec);
+			if (fat_read_sectors(fsi, buffer, sector, nsec)) {
+				return DFS_ERRMISC;
 			}
+			bytesread = nsec * vi->bytepersec;
 		}
 
+		buffer += bytesread;
+		fi->pointer += bytesread;
+		remain -= bytesread;
 		*successcount += bytesread;
-		/* check to see if we stepped over a cluster boundary */
-		if (div(fi->pointer - bytesread, clastersize).quot !=
-			div(fi->pointer, clastersize).quot) {
-			/*
-			 * An act of minor evil - we use bytesread as a scratch integer,
-			 * knowing that its value is not used after updating *successcount
-			 * above
-			 */
-			bytesread = 0;
-			if (((fi->volinfo->filesystem == FAT12) &&
-					(fi->cluster >= 0xff8)) ||
-					((fi->volinfo->filesystem == FAT16) &&
-							(fi->cluster >= 0xfff8)) ||
-							((fi->volinfo->filesystem == FAT32) &&
-									(fi->cluster >= 0x0ffffff8))) {
-				result = DFS_EOF;
-			}
-			else {
-				fi->cluster = fat_get_fat_(fsi, p_scratch, &bytesread, fi->cluster);
-			}
-		}
 	}
 
-	return result;
+	return DFS_OK;
 }
 
-
 /*
  * Write an open file
  * You must supply a prepopulated file_info_t as provided by
@@ -1221,14 +1386,11 @@ uint32_t fat_read_file(struct fat_file_info *fi, uint8_t *p_scratch,
  */
 uint32_t fat_write_file(struct fat_file_info *fi, uint8_t *p_scratch,
 		uint8_t *buffer, uint32_t *successcount, uint32_t len, size_t *size) {
-	uint32_t remain;
-	uint32_t result = DFS_OK;
-	uint32_t sector;
-	uint32_t byteswritten;
-	uint32_t lastcluster, nextcluster;
-	uint32_t clastersize;
-	struct fat_fs_info *fsi;
-	fsi = fi->fsi;
+	struct fat_fs_info *fsi = fi->fsi;
+	struct volinfo *vi = fi->volinfo;
+	uint32_t clustersize = vi->secperclus * vi->bytepersec;
+	uint32_t remain, idx, secoff, offset, sector, nsec, byteswritten;
+	uint32_t result;
 
 	if (!(fi->mode & O_WRONLY) && !(fi->mode & O_APPEND) && !(fi->mode & O_RDWR)) {
 		return DFS_ERRMISC;
@@ -1236,206 +1398,54 @@ uint32_t fat_write_file(struct fat_file_info *fi, uint8_t *p_scratch,
 
 	remain = len;
 	*successcount = 0;
-	clastersize = fi->volinfo->secperclus * fi->volinfo->bytepersec;
 
-	while (remain && result == DFS_OK) {
-		/*
-		 * This is a bit complicated. The sector we want to read is addressed
-		 * at a cluster granularity by  the fi->cluster member.
-		 * The file pointer tells us how many extra sectors to add to that
-		 * number.
-		 */
-		sector = fi->volinfo->dataarea +
-		  ((fi->cluster - 2) * fi->volinfo->secperclus) +
-		  div(div(fi->pointer, clastersize).rem, fi->volinfo->bytepersec).quot;
-
-		/* Case 1 - File pointer is not on a sector boundary */
-		if (div(fi->pointer, fi->volinfo->bytepersec).rem) {
-			uint16_t tempsize;
-
-			/* We always have to go through scratch in this case */
-			result = fat_read_sector(fsi, p_scratch, sector);
-
-			/*
-			 * This is the number of bytes that we don't want to molest in the
-			 * scratch sector just read.
-			 */
-			tempsize = div(fi->pointer, fi->volinfo->bytepersec).rem;
+	result = fat_file_extend(fi, p_scratch, fi->pointer + len);
 
-			/*
-			 * Case 1A - We are writing the entire remainder of the sector.
-			 * After this point, all passes through the read loop will be
-			 * aligned on a sector boundary, which allows us to go through the
-			 * optimal path
-			 * 2A below.
-			 */
-		   	if (remain >= fi->volinfo->bytepersec - tempsize) {
-				memcpy(p_scratch + tempsize, buffer, fi->volinfo->bytepersec - tempsize);
-				if (!result) {
-					result = fat_write_sector(fsi, p_scratch, sector);
-				}
+	while (remain && result == DFS_OK) {
+		idx = fi->pointer / clustersize;
+		fi->cluster = fat_file_cluster(fi, p_scratch, idx);
+		if (fat_is_eoc(vi, fi->cluster)) {
+			result = DFS_ERRMISC;
+			break;
+		}
 
-				byteswritten = fi->volinfo->bytepersec - tempsize;
-				buffer += fi->volinfo->bytepersec - tempsize;
-				fi->pointer += fi->volinfo->bytepersec - tempsize;
-				if (*size < fi->pointer) {
-					*size = fi->pointer;
-				}
-				remain -= fi->volinfo->bytepersec - tempsize;
-			}
-			/* Case 1B - This concludes the file write operation */
-			else {
-				memcpy(p_scratch + tempsize, buffer, remain);
-				if (!result) {
-					result = fat_write_sector(fsi, p_scratch, sector);
-				}
+		secoff = (fi->pointer % clustersize) / vi->bytepersec;
+		offset = fi->pointer % vi->bytepersec;
+		sector = fat_clus_to_sec(vi, fi->cluster) + secoff;
 
-				buffer += remain;
-				fi->pointer += remain;
-				if (*size < fi->pointer) {
-					*size = fi->pointer;
-				}
-				byteswritten = remain;
-				remain = 0;
-			}
-		} /* case 1 */
-		/* Case 2 - File pointer is on sector boundary */
-		else {
-			/* Case 2A - We have at least one more full sector to write and
-			 * don't have to go through the scratch buffer. You could insert
-			 * optimizations here to write multiple sectors at a time, if you
-			 * were thus inclined. Refer to similar notes in fat_read_file.
-			 */
-			if (remain >= fi->volinfo->bytepersec) {
-				result = fat_write_sector(fsi, buffer, sector);
-				remain -= fi->volinfo->bytepersec;
-				buffer += fi->volinfo->bytepersec;
-				fi->pointer += fi->volinfo->bytepersec;
-				if (*size < fi->pointer) {
-					*size = fi->pointer;
-				}
-				byteswritten = fi->volinfo->bytepersec;
+		if (offset || remain < vi->bytepersec) {
+			/* Partial sector: read-modify-write unless it's beyond EOF */
+			if (offset || fi->pointer < *size) {
+				result = fat_read_sector(fsi, p_scratch, sector);
+			} else {
+				memset(p_scratch, 0, vi->bytepersec);
 			}
-			/*
-			 * Case 2B - We are only writing a partial sector and potentially
-			 * need to go through the scratch buffer.
-			 */
-			else {
-				/* If the current file pointer is not yet at or beyond the file
-				 * length, we are writing somewhere in the middle of the file
-				 * and need to load the original sector to do
-				 * a read-modify-write.
-				 */
-				if (fi->pointer < *size) {
-					result = fat_read_sector(fsi, p_scratch, sector);
-					if (!result) {
-						memcpy(p_scratch, buffer, remain);
-						result = fat_write_sector(fsi, p_scratch, sector);
-					}
-				}
-				else {
-					memset(p_scratch, 0, fi->volinfo->bytepersec);
-					memcpy(p_scratch, buffer, remain);
-					result = fat_write_sector(fsi, p_scratch, sector);
-				}
-
-				buffer += remain;
-				fi->pointer += remain;
-				if (*size < fi->pointer) {
-					*size = fi->pointer;
-				}
-				byteswritten = remain;
-				remain = 0;
+			byteswritten = min(vi->bytepersec - offset, remain);
+			memcpy(p_scratch + offset, buffer, byteswritten);
+			if (!result) {
+				result = fat_write_sector(fsi, p_scratch, sector);
 			}
+		} else {
+			nsec = fat_file_run(fi, p_scratch, idx, fi->cluster, secoff,
+					remain / vi->bytepersec);
+			result = fat_write_sectors(fsi, buffer, sector, nsec);
+			byteswritten = nsec * vi->bytepersec;
 		}
 
-		*successcount += byteswritten;
-
-		/* check to see if we stepped over a cluster boundary */
-		if (div(fi->pointer - byteswritten, clastersize).quot !=
-				div(fi->pointer, clastersize).quot) {
-
-		  	/* We've transgressed into another cluster. If we were already
-		  	 * at EOF, we need to allocate a new cluster.
-		  	 * An act of minor evil - we use byteswritten as a scratch integer,
-		  	 * knowing that its value is not used after updating *successcount
-		  	 * above
-		  	 */
-		  	byteswritten = 0;
-
-			lastcluster = fi->cluster;
-			fi->cluster = fat_get_fat_(fsi, p_scratch,
-					&byteswritten, fi->cluster);
-
-			/* Allocate a new cluster? */
-			if (((fi->volinfo->filesystem == FAT12) &&
-					(fi->cluster >= 0xff8)) ||
-					((fi->volinfo->filesystem == FAT16) &&
-					(fi->cluster >= 0xfff8)) ||
-					((fi->volinfo->filesystem == FAT32) &&
-					(fi->cluster >= 0x0ffffff8))) {
-			  	uint32_t tempclus;
-				tempclus = fat_get_free_fat_(fsi, p_scratch);
-				byteswritten = 0; /* invalidate cache */
-				if (tempclus == DFS_BAD_CLUS)
-					return DFS_ERRMISC;
-				/* Link new cluster onto file */
-				fat_set_fat_(fsi, p_scratch,
-						&byteswritten, lastcluster, tempclus);
-				fi->cluster = tempclus;
-
-				/* Mark newly allocated cluster as end of chain */
-				switch(fi->volinfo->filesystem) {
-					case FAT12:		tempclus = 0xfff;	break;
-					case FAT16:		tempclus = 0xffff;	break;
-					case FAT32:		tempclus = 0x0fffffff;	break;
-					default:		return DFS_ERRMISC;
-				}
-				fat_set_fat_(fsi, p_scratch,
-						&byteswritten, fi->cluster, tempclus);
-
-				result = DFS_OK;
-			}
+		if (result) {
+			break;
 		}
-	}
-	/* If cleared, then mark free clusters*/
-	// TODO implement fat truncate
-	if (0 && *size > fi->pointer) {
-		if (div(*size, clastersize).quot !=
-			div(fi->pointer, clastersize).quot) {
-
-			byteswritten = 0;/* invalidate cache */
-			nextcluster = fat_get_fat_(fsi, p_scratch,
-					&byteswritten, fi->cluster);
-
-			switch(fi->volinfo->filesystem) {
-				case FAT12:		lastcluster = 0xfff;	break;
-				case FAT16:		lastcluster = 0xfff;	break;
-				case FAT32:		lastcluster = 0x0fffffff;	break;
-				default:		return DFS_ERRMISC;
-			}
-			fat_set_fat_(fsi, p_scratch, &byteswritten,
-					fi->cluster, lastcluster);
-
-			/* Now follow the cluster chain to free the file space */
-			while (!((fi->volinfo->filesystem == FAT12 &&
-					nextcluster >= 0x0ff7) ||
-					(fi->volinfo->filesystem == FAT16 &&
-					nextcluster >= 0xfff7) ||
-					(fi->volinfo->filesystem == FAT32 &&
-					nextcluster >= 0x0ffffff7))) {
-				lastcluster = nextcluster;
-				nextcluster = fat_get_fat_(fsi, p_scratch,
-						&byteswritten, nextcluster);
-
-				fat_set_fat_(fsi, p_scratch,
-						&byteswritten, lastcluster, 0);
-			}
 
+		buffer += byteswritten;
+		fi->pointer += byteswritten;
+		remain -= byteswritten;
+		*successcount += byteswritten;
+		if (*size < fi->pointer) {
+			*size = fi->pointer;
 		}
 	}
 
-	//*size = fi->pointer; // TODO implement fat truncate
+	// TODO implement fat truncate
 
 	/* Update directory entry */
 	if (fat_read_sector(fsi, p_scratch, fi->dirsector)) {
@@ -1539,6 +1549,7 @@ uint32_t fat_open_file(struct fat_file_info *fi, uint8_t *path, int mode,
 				  ((uint32_t) de.startclus_l_h) << 8;
 			}
 			fi->firstcluster = fi->cluster;
+			fi->ext_n = 0;
 			fi->filelen = (uint32_t) de.filesize_0 |
 			              ((uint32_t) de.filesize_1) << 8 |
 			              ((uint32_t) de.filesize_2) << 16 |
@@ -1588,6 +1599,7 @@ int fat_unlike_file(struct fat_file_info *fi, uint8_t *path,
 				&cache, fi->firstcluster);
 		//assert(nas->fs->bdev == fsi->bdev);
 		fat_set_fat_(fsi, p_scratch, &cache, tempclus, 0);
+		fat_discard_cluster(fsi, tempclus);
 	}
 	return DFS_OK;
 }
@@ -1632,6 +1644,7 @@ int fat_unlike_directory(struct fat_file_info *fi, uint8_t *path,
 				&cache, fi->firstcluster);
 		//assert(nas->fs->bdev == fsi->bdev);
 		fat_set_fat_(fsi, p_scratch, &cache, tempclus, 0);
+		fat_discard_cluster(fsi, tempclus);
 	}
 	return DFS_OK;
 }
@@ -1648,10 +1661,10 @@ static int fat_dirent_by_file(struct fat_file_info *fi, struct fat_dirent *de) {
 	struct fat_fs_info *fsi = fi->fsi;
 	void *de_src;
 
-	if (fat_read_sector(fsi, fat_sector_buff, fi->dirsector))
+	if (fat_read_sector(fsi, fsi->sector_buff, fi->dirsector))
 		return -1;
 
-	de_src = &(((struct fat_dirent *)fat_sector_buff)[fi->diroffset]);
+	de_src = &(((struct fat_dirent *)fsi->sector_buff)[fi->diroffset]);
 	memcpy(de, de_src, sizeof(struct fat_dirent));
 
 	return 0;
@@ -1762,7 +1775,7 @@ int fat_create_file(struct fat_file_info *fi, struct dirinfo *di, char *name, in
 		}
 	}
 
-	cluster = fat_get_free_fat_(fsi, fat_sector_buff);
+	cluster = fat_get_free_fat_(fsi, fsi->sector_buff);
 	de = (struct fat_dirent) {
 		.attr = S_ISDIR(mode) ? ATTR_DIRECTORY : 0,
 		.startclus_l_l = cluster & 0xff,
@@ -1787,6 +1800,7 @@ int fat_create_file(struct fat_file_info *fi, struct dirinfo *di, char *name, in
 	fi->diroffset = di->currententry;
 	fi->cluster = cluster;
 	fi->firstcluster = cluster;
+	fi->ext_n = 0;
 
 	/*
 	 * write the directory entry
@@ -1794,12 +1808,12 @@ int fat_create_file(struct fat_file_info *fi, struct dirinfo *di, char *name, in
 	 * entry, tragically, so we have to re-read it
 	 */
 
-	if (fat_read_sector(fsi, fat_sector_buff, fi->dirsector)) {
+	if (fat_read_sector(fsi, fsi->sector_buff, fi->dirsector)) {
 		return DFS_ERRMISC;
 	}
-	memcpy(&(((struct fat_dirent*) fat_sector_buff)[fi->diroffset]),
+	memcpy(&(((struct fat_dirent*) fsi->sector_buff)[fi->diroffset]),
 			&de, sizeof(struct fat_dirent));
-	if (fat_write_sector(fsi, fat_sector_buff, fi->dirsector)) {
+	if (fat_write_sector(fsi, fsi->sector_buff, fi->dirsector)) {
 		return DFS_ERRMISC;
 	}
 	/* Mark newly allocated cluster as end of chain */
@@ -1812,14 +1826,14 @@ int fat_create_file(struct fat_file_info *fi, struct dirinfo *di, char *name, in
 
 	temp = 0;
 	fat_set_fat_(fsi,
-			fat_sector_buff, &temp, fi->cluster, cluster);
+			fsi->sector_buff, &temp, fi->cluster, cluster);
 
 	if (S_ISDIR(mode)) {
 		/* create . and ..  files of this catalog */
-		fat_set_direntry(di->currentcluster, fi->cluster);
+		fat_set_direntry(fsi->sector_buff, di->currentcluster, fi->cluster);
 		cluster = fi->volinfo->dataarea +
 				  ((fi->cluster - 2) * fi->volinfo->secperclus);
-		if (fat_write_sector(fsi, fat_sector_buff, cluster)) {
+		if (fat_write_sector(fsi, fsi->sector_buff, cluster)) {
 			return DFS_ERRMISC;
 		}
 	}
@@ -2066,9 +2080,64 @@ struct fat_fs_info *fat_fs_alloc(void) {
 }
 
 void fat_fs_free(struct fat_fs_info *fsi) {
+	if (fsi->fat_cache) {
+		sysfree(fsi->fat_cache);
+	}
+	if (fsi->free_map) {
+		sysfree(fsi->free_map);
+	}
 	pool_free(&fat_fs_pool, fsi);
 }
 
+/**
+ * @brief Prepare per-mount state once volinfo is read
+ *
+ * Reads the whole FAT into memory if the volume is not larger than
+ * fat_cache_max_clusters. If there is not enough memory FAT is just
+ * accessed on the disk.
+ *
+ * @return Negative error code or zero if succeed
+ */
+int fat_fs_init(struct fat_fs_info *fsi) {
+	uint32_t nclus = fsi->vi.numclusters + 2;
+	uint32_t *fat_cache, i, cache = 0;
+	unsigned long *free_map;
+
+	mutex_init(&fsi->lock);
+	fsi->fat_cache = NULL;
+	fsi->free_map = NULL;
+	fsi->free_hint = 2;
+
+	if (fsi->vi.numclusters > FAT_CACHE_MAX_CLUSTERS) {
+		return 0;
+	}
+
+	fat_cache = sysmalloc(nclus * sizeof(*fat_cache));
+	free_map = sysmalloc(BITMAP_SIZE(nclus) * sizeof(*free_map));
+	if (!fat_cache || !free_map) {
+		if (fat_cache) {
+			sysfree(fat_cache);
+		}
+		if (free_map) {
+			sysfree(free_map);
+		}
+		return 0;
+	}
+
+	bitmap_clear_all(free_map, nclus);
+	for (i = 0; i < nclus; i++) {
+		fat_cache[i] = fat_get_fat_(fsi, fsi->sector_buff, &cache, i);
+		if (i >= 2 && fat_cache[i] == 0) {
+			bitmap_set_bit(free_map, i);
+		}
+	}
+
+	fsi->fat_cache = fat_cache;
+	fsi->free_map = free_map;
+
+	return 0;
+}
+
 struct fat_file_info *fat_file_alloc(void) {
 	return pool_alloc(&fat_file_pool);
 }
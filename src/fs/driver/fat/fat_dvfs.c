@@ -22,10 +22,43 @@
 
 #define DEFAULT_FAT_VERSION OPTION_GET(NUMBER, default_fat_version)
 
-extern uint8_t fat_sector_buff[FAT_MAX_SECTOR_SIZE];
-
 extern struct file_operations fat_fops;
 
+/*
+ * File data. Runs of sectors go with one request straight between the
+ * device and the buffer, only blocks already in the buffer cache are
+ * copied through it.
+ */
+int fat_read_sectors(struct fat_fs_info *fsi, uint8_t *buffer,
+		uint32_t sector, uint32_t count) {
+	size_t ret;
+	int blk;
+	int blkpersec = fsi->vi.bytepersec / fsi->bdev->block_size;
+
+	blk = sector * blkpersec;
+
+	ret = block_dev_read_direct(fsi->bdev, (char*) buffer, fsi->vi.bytepersec * count, blk);
+	if (ret != fsi->vi.bytepersec * count)
+		return DFS_ERRMISC;
+	else
+		return DFS_OK;
+}
+
+int fat_write_sectors(struct fat_fs_info *fsi, uint8_t *buffer,
+		uint32_t sector, uint32_t count) {
+	size_t ret;
+	int blk;
+	int blkpersec = fsi->vi.bytepersec / fsi->bdev->block_size;
+
+	blk = sector * blkpersec;
+	ret = block_dev_write_direct(fsi->bdev, (const char *) buffer, fsi->vi.bytepersec * count, blk);
+	if (ret != fsi->vi.bytepersec * count)
+		return DFS_ERRMISC;
+	else
+		return DFS_OK;
+}
+
+/* FAT, directory and partial data sectors, kept in the buffer cache */
 int fat_read_sector(struct fat_fs_info *fsi, uint8_t *buffer, uint32_t sector) {
 	size_t ret;
 	int blk;
@@ -106,7 +139,7 @@ static int fat_fill_inode(struct inode *inode, struct fat_dirent *de, struct dir
 			goto err_out;
 
 		memset(new_di, 0, sizeof(struct dirinfo));
-		new_di->p_scratch = fat_sector_buff;
+		new_di->p_scratch = fsi->sector_buff;
 		inode->flags |= S_IFDIR;
 
 		new_di->currentcluster = (uint32_t) de->startclus_l_l |
@@ -178,7 +211,7 @@ static inline int read_dir_buf(struct fat_fs_info *fsi, struct dirinfo *di) {
  *
  * @return Pointer of inode or NULL if not found
  */
-static struct inode *fat_ilookup(char const *name, struct dentry const *dir) {
+static struct inode *__fat_ilookup(char const *name, struct dentry const *dir) {
 	struct dirinfo *di;
 	struct fat_dirent de;
 	struct super_block *sb;
@@ -236,6 +269,17 @@ succ_out:
 	return node;
 }
 
+static struct inode *fat_ilookup(char const *name, struct dentry const *dir) {
+	struct fat_fs_info *fsi = dir->d_sb->sb_data;
+	struct inode *node;
+
+	mutex_lock(&fsi->lock);
+	node = __fat_ilookup(name, dir);
+	mutex_unlock(&fsi->lock);
+
+	return node;
+}
+
 /* @brief Create new file or directory
  * @param i_new Inode to be filled
  * @param i_dir Inode realted to the parent
@@ -243,7 +287,7 @@ succ_out:
  *
  * @return Negative error code
  */
-static int fat_create(struct inode *i_new, struct inode *i_dir, int mode) {
+static int __fat_create(struct inode *i_new, struct inode *i_dir, int mode) {
 	int res;
 	uint32_t temp;
 	struct fat_file_info *fi;
@@ -296,7 +340,7 @@ static int fat_create(struct inode *i_new, struct inode *i_dir, int mode) {
 		}
 	}
 
-	cluster = fat_get_free_fat_(fsi, fat_sector_buff);
+	cluster = fat_get_free_fat_(fsi, fsi->sector_buff);
 	/* We need to write 8.3 entry anyway, even for long-name descritors */
 	/* Be carefully, this functions explicitly erases de.attr */
 	path_canonical_to_dir((char*) de.name, name);
@@ -309,7 +353,7 @@ static int fat_create(struct inode *i_new, struct inode *i_dir, int mode) {
 	if (FILE_TYPE(mode, S_IFDIR)) {
 		if (!(new_di = fat_dirinfo_alloc()))
 			return -ENOMEM;
-		di->p_scratch = fat_sector_buff;
+		di->p_scratch = fsi->sector_buff;
 		fi = &new_di->fi;
 	} else {
 		if (!(fi = fat_file_alloc()))
@@ -327,12 +371,12 @@ static int fat_create(struct inode *i_new, struct inode *i_dir, int mode) {
 		.firstcluster = cluster,
 	};
 
-	if (fat_read_sector(fsi, fat_sector_buff, fi->dirsector))
+	if (fat_read_sector(fsi, fsi->sector_buff, fi->dirsector))
 		return -1;
 
-	memcpy(&(((struct fat_dirent *) fat_sector_buff)[fi->diroffset]),
+	memcpy(&(((struct fat_dirent *) fsi->sector_buff)[fi->diroffset]),
 			&de, sizeof(struct fat_dirent));
-	if (fat_write_sector(fsi, fat_sector_buff, fi->dirsector))
+	if (fat_write_sector(fsi, fsi->sector_buff, fi->dirsector))
 		return -1;
 
 	/* Mark newly allocated cluster as end of chain */
@@ -344,33 +388,64 @@ static int fat_create(struct inode *i_new, struct inode *i_dir, int mode) {
 	}
 
 	temp = 0;
-	fat_set_fat_(fsi, fat_sector_buff, &temp, fi->cluster, cluster);
+	fat_set_fat_(fsi, fsi->sector_buff, &temp, fi->cluster, cluster);
 
 	return ENOERR;
 }
 
+static int fat_create(struct inode *i_new, struct inode *i_dir, int mode) {
+	struct fat_fs_info *fsi = i_dir->i_sb->sb_data;
+	int res;
+
+	mutex_lock(&fsi->lock);
+	res = __fat_create(i_new, i_dir, mode);
+	mutex_unlock(&fsi->lock);
+
+	return res;
+}
+
 static int fat_close(struct file *desc) {
 	return 0;
 }
 
-static size_t fat_read(struct file *desc, void *buf, size_t size) {
+static ssize_t fat_pread(struct file *desc, void *buf, size_t size, off_t pos) {
 	uint32_t res;
 	struct fat_file_info *fi = desc->f_inode->i_data;
-	fi->pointer = desc->pos;
-	fat_read_file(fi, fat_sector_buff, buf, &res, min(size, fi->filelen - desc->pos));
+	struct fat_fs_info *fsi = fi->fsi;
+
+	mutex_lock(&fsi->lock);
+	if (pos >= fi->filelen) {
+		mutex_unlock(&fsi->lock);
+		return 0;
+	}
+	fi->pointer = pos;
+	fat_read_file(fi, fsi->sector_buff, buf, &res, min(size, fi->filelen - pos));
+	mutex_unlock(&fsi->lock);
 	return res;
 }
 
-static size_t fat_write(struct file *desc, void *buf, size_t size) {
+static ssize_t fat_pwrite(struct file *desc, void *buf, size_t size, off_t pos) {
 	uint32_t res;
 	struct fat_file_info *fi = desc->f_inode->i_data;
+	struct fat_fs_info *fsi = fi->fsi;
+
+	mutex_lock(&fsi->lock);
 	fi->mode = O_RDWR; /* XXX */
-	fi->pointer = desc->pos;
-	fat_write_file(fi, fat_sector_buff, buf, &res, size, &desc->f_inode->length);
+	fi->pointer = pos;
+	fat_write_file(fi, fsi->sector_buff, buf, &res, size, &desc->f_inode->length);
 	fi->filelen = desc->f_inode->length;
+	mutex_unlock(&fsi->lock);
 	return res;
 }
 
+static size_t fat_read(struct file *desc, void *buf, size_t size) {
+	return fat_pread(desc, buf, size, desc->pos);
+}
+
+static size_t fat_write(struct file *desc, void *buf, size_t size) {
+	return fat_pwrite(desc, buf, size, desc->pos);
+}
+
 /* @brief Get next inode in directory
  * @param inode   Structure to be filled
  * @param parent  Inode of parent directory
@@ -378,7 +453,7 @@ static size_t fat_write(struct file *desc, void *buf, size_t size) {
  *
  * @return Error code
  */
-static int fat_iterate(struct inode *next, struct inode *parent, struct dir_ctx *ctx) {
+static int __fat_iterate(struct inode *next, struct inode *parent, struct dir_ctx *ctx) {
 	struct fat_fs_info *fsi;
 	struct dirinfo *dirinfo;
 	struct fat_dirent de;
@@ -421,32 +496,49 @@ static int fat_iterate(struct inode *next, struct inode *parent, struct dir_ctx
 	}
 }
 
+static int fat_iterate(struct inode *next, struct inode *parent, struct dir_ctx *ctx) {
+	struct fat_fs_info *fsi = parent->i_sb->sb_data;
+	int res;
+
+	mutex_lock(&fsi->lock);
+	res = __fat_iterate(next, parent, ctx);
+	mutex_unlock(&fsi->lock);
+
+	return res;
+}
+
 static int fat_remove(struct inode *inode) {
+	struct fat_fs_info *fsi = inode->i_sb->sb_data;
 	struct fat_file_info *fi;
 	struct dirinfo *di;
 	int res;
 
+	mutex_lock(&fsi->lock);
 	if (FILE_TYPE(inode->flags, S_IFDIR)) {
 		di = inode->i_data;
-		res = fat_unlike_directory(&di->fi, NULL, (uint8_t*) fat_sector_buff);
+		res = fat_unlike_directory(&di->fi, NULL, fsi->sector_buff);
 	} else {
 		fi = inode->i_data;
-		res = fat_unlike_file(fi, NULL, (uint8_t*) fat_sector_buff);
+		res = fat_unlike_file(fi, NULL, fsi->sector_buff);
 	}
+	mutex_unlock(&fsi->lock);
+
 	return res;
 }
 
 static int fat_pathname(struct inode *inode, char *buf, int flags) {
 	struct fat_file_info *fi;
+	int res;
 
 	switch (flags) {
 	case DVFS_NAME:
 		fi = inode->i_data;
 
-		if (DFS_OK != fat_read_filename(fi, fat_sector_buff, buf)) {
-			return -1;
-		}
-		return 0;
+		mutex_lock(&fi->fsi->lock);
+		res = fat_read_filename(fi, fi->fsi->sector_buff, buf);
+		mutex_unlock(&fi->fsi->lock);
+
+		return res == DFS_OK ? 0 : -1;
 	default:
 		/* NIY */
 		return -ENOSYS;
@@ -473,6 +565,8 @@ struct file_operations fat_fops = {
 	.close = fat_close,
 	.write = fat_write,
 	.read = fat_read,
+	.pread = fat_pread,
+	.pwrite = fat_pwrite,
 };
 
 static int fat_destroy_inode(struct inode *inode) {
@@ -527,6 +621,9 @@ static int fat_fill_sb(struct super_block *sb, struct file *bdev_file) {
 	if (fat_get_volinfo(dev, &fsi->vi, 0))
 		goto err_out;
 
+	if (fat_fs_init(fsi))
+		goto err_out;
+
 	return 0;
 
 err_out:
@@ -553,9 +650,9 @@ static int fat_mount_end(struct super_block *sb) {
 	if (NULL == (di = fat_dirinfo_alloc()))
 		return -ENOMEM;
 
-	di->p_scratch = fat_sector_buff;
-
 	fsi = sb->sb_data;
+	di->p_scratch = fsi->sector_buff;
+
 	if (fat_open_dir(fsi, tmp, di))
 		return -1;
 
@@ -26,6 +26,7 @@
 #include <mem/misc/pool.h>
 #include <kernel/printk.h>
 #include <util/array.h>
+#include <util/math.h>
 #include <embox/unit.h>
 
 
@@ -66,6 +67,38 @@ static size_t initfs_read(struct file_desc *desc, void *buf, size_t size) {
 	return size;
 }
 
+static ssize_t initfs_pread(struct file_desc *desc, void *buf, size_t size,
+		off_t off) {
+	struct initfs_file_info *fi;
+
+	fi = (struct initfs_file_info *) desc->node->nas->fi;
+
+	if (off < 0) {
+		return -EINVAL;
+	}
+	if (off >= fi->ni.size) {
+		return 0;
+	}
+	size = min(size, (size_t) (fi->ni.size - off));
+
+	memcpy(buf, fi->addr + off, size);
+
+	return size;
+}
+
+static void *initfs_mmap(struct file_desc *desc, size_t len, off_t off) {
+	struct initfs_file_info *fi;
+
+	fi = (struct initfs_file_info *) desc->node->nas->fi;
+
+	if (off < 0 || off > fi->ni.size || len > fi->ni.size - off) {
+		return NULL;
+	}
+
+	/* The image is read-only and never goes away */
+	return fi->addr + off;
+}
+
 static int initfs_ioctl(struct file_desc *desc, int request, void *data) {
 	struct nas *nas;
 	struct initfs_file_info *fi;
@@ -137,6 +170,9 @@ static struct file_operations initfs_fop = {
 	.close = initfs_close,
 	.read = initfs_read,
 	.ioctl = initfs_ioctl,
+	.mmap = initfs_mmap,
+	.lookup = initfs_mmap,
+	.pread = initfs_pread,
 };
 
 static struct fsop_desc initfs_fsop = {
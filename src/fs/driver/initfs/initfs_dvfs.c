@@ -32,6 +32,9 @@
 #include <fs/dvfs.h>
 #include <mem/misc/pool.h>
 #include <util/array.h>
+#include <util/math.h>
+
+#include "initfs_index.h"
 
 #define INITFS_MAX_NAMELEN 32
 
@@ -61,6 +64,34 @@ static size_t initfs_read(struct file *desc, void *buf, size_t size) {
 	return size;
 }
 
+static ssize_t initfs_pread(struct file *desc, void *buf, size_t size,
+		off_t off) {
+	struct inode *inode = desc->f_inode;
+
+	if (off < 0) {
+		return -EINVAL;
+	}
+	if (off >= inode->length) {
+		return 0;
+	}
+	size = min(size, (size_t) (inode->length - off));
+
+	memcpy(buf, (char *) (uintptr_t) (inode->start_pos + off), size);
+
+	return size;
+}
+
+static void *initfs_mmap(struct file *desc, size_t len, off_t off) {
+	struct inode *inode = desc->f_inode;
+
+	if (off < 0 || off > inode->length || len > inode->length - off) {
+		return NULL;
+	}
+
+	/* The image is read-only and never goes away */
+	return (char *) (uintptr_t) (inode->start_pos + off);
+}
+
 static int initfs_ioctl(struct file *desc, int request, void *data) {
 	struct inode *inode = desc->f_inode;
 	char **p_addr;
@@ -111,30 +142,23 @@ static struct initfs_dir_info *child_dir(struct initfs_dir_info *parent,
 }
 
 static struct inode *initfs_lookup(char const *name, struct dentry const *dir) {
-	extern char _initfs_start;
-	char *cpio = &_initfs_start;
+	char *cpio;
 	struct cpio_entry entry;
 	struct inode *node;
 	struct initfs_dir_info *di = dir->d_inode->i_data;
 
-	while ((cpio = cpio_parse_entry(cpio, &entry)))
-		if (!memcmp(di->path, entry.name, di->path_len) &&
-		    !strncmp(name,
-		             entry.name + di->path_len + (*(entry.name + di->path_len) == '/' ? 1 : 0),
-		             strlen(name)) &&
-			strrchr(entry.name + di->path_len + 1, '/') == NULL) {
-			if (NULL == (node = dvfs_alloc_inode(dir->d_sb)))
-				return NULL;
+	cpio = initfs_index_lookup(di->path, di->path_len, name, strlen(name));
+	if (!cpio || !cpio_parse_entry(cpio, &entry)) {
+		return NULL;
+	}
 
-			initfs_fill_inode_entry(node,
-			                        cpio,
-			                        &entry,
-			                        child_dir(di, &entry));
+	if (NULL == (node = dvfs_alloc_inode(dir->d_sb))) {
+		return NULL;
+	}
 
-			return node;
-		}
+	initfs_fill_inode_entry(node, cpio, &entry, child_dir(di, &entry));
 
-	return NULL;
+	return node;
 }
 
 static int initfs_iterate(struct inode *next, struct inode *parent, struct dir_ctx *ctx) {
@@ -195,6 +219,12 @@ static int initfs_pathname(struct inode *inode, char *buf, int flags) {
 
 static int initfs_mount_end(struct super_block *sb) {
 	struct initfs_dir_info *di;
+	int ret;
+
+	ret = initfs_index_build();
+	if (ret < 0) {
+		return ret;
+	}
 
 	di = pool_alloc(&initfs_dir_pool);
 	assert(di);
@@ -226,6 +256,8 @@ struct inode_operations initfs_iops = {
 struct file_operations initfs_fops = {
 	.read  = initfs_read,
 	.ioctl = initfs_ioctl,
+	.mmap  = initfs_mmap,
+	.pread = initfs_pread,
 };
 
 static int initfs_fill_sb(struct super_block *sb, struct file *bdev_file) {
@@ -0,0 +1,180 @@
+/**
+ * @file
+ * @brief Hashed path index of the initfs cpio image
+ *
+ * Cpio stores a flat list of full paths, so looking a name up means
+ * parsing the archive from its start. The index is built by a single
+ * pass at mount and maps a full path to the entry header in O(1).
+ * Names are not copied, keys point into the image.
+ *
+ * @date 19.10.2026
+ */
+
+#include <cpio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <framework/mod/options.h>
+#include <kernel/time/ktime.h>
+#include <mem/sysmalloc.h>
+#include <util/hashtable.h>
+#include <util/log.h>
+
+#include "initfs_index.h"
+
+#define INITFS_INDEX_BUCKETS OPTION_GET(NUMBER, index_buckets)
+
+/* Path is @a dir, '/' and @a name, or just @a name if @a dir is empty.
+ * Lookups compare it in place instead of building the full path. */
+struct initfs_index_key {
+	const char *dir;
+	size_t dir_len;
+	const char *name;
+	size_t len;
+};
+
+struct initfs_index_entry {
+	struct hashtable_item item;
+	struct initfs_index_key key;
+	char *hdr;
+};
+
+static size_t initfs_index_hash(void *key);
+static int initfs_index_cmp(void *key1, void *key2);
+HASHTABLE_DEF(initfs_index_ht, INITFS_INDEX_BUCKETS,
+		initfs_index_hash, initfs_index_cmp);
+
+static struct initfs_index_entry *initfs_index;
+static int initfs_index_n = -1;
+
+static size_t initfs_index_key_len(struct initfs_index_key *k) {
+	return k->dir_len ? k->dir_len + 1 + k->len : k->len;
+}
+
+static char initfs_index_key_char(struct initfs_index_key *k, size_t i) {
+	if (!k->dir_len) {
+		return k->name[i];
+	}
+	if (i < k->dir_len) {
+		return k->dir[i];
+	}
+	return i == k->dir_len ? '/' : k->name[i - k->dir_len - 1];
+}
+
+/* FNV-1a */
+static size_t initfs_index_hash(void *key) {
+	struct initfs_index_key *k = key;
+	uint32_t h = 2166136261U;
+	size_t i, len;
+
+	len = initfs_index_key_len(k);
+	for (i = 0; i < len; i++) {
+		h = (h ^ (unsigned char) initfs_index_key_char(k, i)) * 16777619U;
+	}
+
+	return h;
+}
+
+static int initfs_index_cmp(void *key1, void *key2) {
+	struct initfs_index_key *k1 = key1, *k2 = key2;
+	size_t i, len;
+
+	len = initfs_index_key_len(k1);
+	if (len != initfs_index_key_len(k2)) {
+		return 1;
+	}
+	for (i = 0; i < len; i++) {
+		if (initfs_index_key_char(k1, i) != initfs_index_key_char(k2, i)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Drops "./" prefixes and trailing '/' which some cpio tools leave */
+static void initfs_index_name_trim(const char **name, size_t *len) {
+	while (*len >= 2 && (*name)[0] == '.' && (*name)[1] == '/') {
+		*name += 2;
+		*len -= 2;
+	}
+	while (*len && (*name)[*len - 1] == '/') {
+		(*len)--;
+	}
+}
+
+static void initfs_index_key_init(struct initfs_index_key *key,
+		const char *dir, size_t dir_len, const char *name, size_t len) {
+	initfs_index_name_trim(&dir, &dir_len);
+	initfs_index_name_trim(&name, &len);
+
+	key->dir = dir;
+	key->dir_len = dir_len;
+	key->name = name;
+	key->len = len;
+}
+
+int initfs_index_build(void) {
+	extern char _initfs_start, _initfs_end;
+	struct initfs_index_entry *e;
+	struct cpio_entry entry;
+	char *cpio, *prev;
+	uint64_t start;
+	int n;
+
+	if (initfs_index_n >= 0) {
+		return initfs_index_n;
+	}
+	if (&_initfs_start == &_initfs_end) {
+		return 0;
+	}
+
+	start = ktime_get_ns();
+
+	n = 0;
+	for (cpio = &_initfs_start; (cpio = cpio_parse_entry(cpio, &entry)); ) {
+		n++;
+	}
+
+	if (!n) {
+		/* Archive without entries, nothing to look up */
+		initfs_index_n = 0;
+		return 0;
+	}
+
+	initfs_index = sysmalloc(n * sizeof(*initfs_index));
+	if (!initfs_index) {
+		return -ENOMEM;
+	}
+
+	e = initfs_index;
+	for (cpio = &_initfs_start; (prev = cpio,
+				cpio = cpio_parse_entry(cpio, &entry)); e++) {
+		e->hdr = prev;
+		initfs_index_key_init(&e->key, NULL, 0, entry.name,
+				strnlen(entry.name, entry.name_len));
+		hashtable_item_init(&e->item, &e->key, e);
+		hashtable_put(&initfs_index_ht, &e->item);
+	}
+	initfs_index_n = n;
+
+	log_debug("%d entries indexed in %u us", n,
+			(unsigned) ((ktime_get_ns() - start) / 1000));
+
+	return n;
+}
+
+char *initfs_index_lookup(const char *dir, size_t dir_len,
+		const char *name, size_t len) {
+	struct initfs_index_key key;
+	struct initfs_index_entry *e;
+
+	if (initfs_index_n <= 0) {
+		return NULL;
+	}
+
+	initfs_index_key_init(&key, dir, dir_len, name, len);
+	e = hashtable_get(&initfs_index_ht, &key);
+
+	return e ? e->hdr : NULL;
+}
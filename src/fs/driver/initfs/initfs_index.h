@@ -0,0 +1,35 @@
+/**
+ * @file
+ * @brief Hashed path index of the initfs cpio image
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef INITFS_INDEX_H_
+#define INITFS_INDEX_H_
+
+#include <stddef.h>
+
+/**
+ * Parses the image once and hashes the full path of every entry.
+ * Does nothing if the index is built already.
+ *
+ * @return Number of entries or -errno
+ */
+extern int initfs_index_build(void);
+
+/**
+ * Looks up @a name in directory @a dir of the image.
+ *
+ * @param dir      Directory path relative to the image root, may be empty.
+ * @param dir_len  Bytes of @a dir to take.
+ * @param name     Name in the directory.
+ * @param len      Bytes of @a name to take.
+ *
+ * @return Header of the cpio entry, to be parsed with cpio_parse_entry(),
+ *         or NULL if there is no such path.
+ */
+extern char *initfs_index_lookup(const char *dir, size_t dir_len,
+		const char *name, size_t len);
+
+#endif /* INITFS_INDEX_H_ */
@@ -285,6 +285,11 @@ static void jffs2_calc_trigger_levels(struct jffs2_sb_info *c) {
 	/* When do we let the GC thread run in the background */
 
 	c->resv_blocks_gctrigger = c->resv_blocks_write + 1;
+	/* Start background GC earlier if asked to, never later */
+	if (JFFS2_GC_TRIGGER_BLOCKS > c->resv_blocks_gctrigger) {
+		c->resv_blocks_gctrigger = min_t(uint32_t, JFFS2_GC_TRIGGER_BLOCKS,
+				UINT8_MAX);
+	}
 
 	/* When do we allow garbage collection to merge nodes to make
 	   long-term progress at the expense of short-term space exhaustion? */
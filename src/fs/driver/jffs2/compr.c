@@ -414,6 +414,9 @@ int jffs2_compressors_init(void) {
 #ifdef CONFIG_JFFS2_ZLIB
         jffs2_zlib_init();
 #endif
+#ifdef CONFIG_JFFS2_LZ4
+        jffs2_lz4_init();
+#endif
 #ifdef CONFIG_JFFS2_RTIME
         jffs2_rtime_init();
 #endif
@@ -446,6 +449,9 @@ int jffs2_compressors_exit(void)
 #ifdef CONFIG_JFFS2_RTIME
         jffs2_rtime_exit();
 #endif
+#ifdef CONFIG_JFFS2_LZ4
+        jffs2_lz4_exit();
+#endif
 #ifdef CONFIG_JFFS2_ZLIB
         jffs2_zlib_exit();
 #endif
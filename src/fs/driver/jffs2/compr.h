@@ -30,6 +30,7 @@
 #define JFFS2_LZO_PRIORITY       40
 #define JFFS2_RTIME_PRIORITY     50
 #define JFFS2_ZLIB_PRIORITY      60
+#define JFFS2_LZ4_PRIORITY       70 /* Tried before zlib when enabled */
 
 #define JFFS2_RUBINMIPS_DISABLED /* RUBINs will be used only */
 #define JFFS2_DYNRUBIN_DISABLED  /*        for decompression */
@@ -100,5 +101,9 @@ void jffs2_rtime_exit(void);
 int jffs2_zlib_init(void);
 void jffs2_zlib_exit(void);
 #endif
+#ifdef CONFIG_JFFS2_LZ4
+int jffs2_lz4_init(void);
+void jffs2_lz4_exit(void);
+#endif
 
 #endif /* __JFFS2_COMPR_H__ */
@@ -0,0 +1,227 @@
+/**
+ * @file
+ * @brief LZ4 block format compressor for JFFS2
+ *
+ * Much faster than zlib both ways for a somewhat worse ratio. Output is
+ * a plain LZ4 block, only the id it's stored under is ours, see
+ * JFFS2_COMPR_LZ4.
+ *
+ * @date 19.10.2026
+ */
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+#include <fs/jffs2.h>
+#include "compr.h"
+
+#define LZ4_MIN_MATCH   4
+#define LZ4_MAX_OFFSET  0xffff
+#define LZ4_HASH_BITS   10
+/* Format wants the last match to start 12 bytes before the end at least
+ * and the last 5 bytes to be literals */
+#define LZ4_MF_LIMIT    12
+#define LZ4_LAST_LITERALS 5
+
+static inline uint32_t lz4_read32(const unsigned char *p) {
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t lz4_hash(uint32_t v) {
+	return (v * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+/* Writes the 255-byte continuation of a length which didn't fit 4 bits */
+static int lz4_put_length(unsigned char *out, uint32_t *op, uint32_t outlen,
+		uint32_t len) {
+	for (; len >= 255; len -= 255) {
+		if (*op >= outlen) {
+			return -1;
+		}
+		out[(*op)++] = 255;
+	}
+	if (*op >= outlen) {
+		return -1;
+	}
+	out[(*op)++] = len;
+	return 0;
+}
+
+static int lz4_put_sequence(unsigned char *out, uint32_t *op, uint32_t outlen,
+		const unsigned char *lit, uint32_t litlen,
+		uint32_t offset, uint32_t matchlen) {
+	unsigned char *token;
+
+	if (*op >= outlen) {
+		return -1;
+	}
+	token = &out[(*op)++];
+	*token = min_t(uint32_t, litlen, 15) << 4;
+
+	if (litlen >= 15 && lz4_put_length(out, op, outlen, litlen - 15)) {
+		return -1;
+	}
+	if (*op + litlen > outlen) {
+		return -1;
+	}
+	memcpy(&out[*op], lit, litlen);
+	*op += litlen;
+
+	if (!matchlen) {
+		/* Last sequence has literals only */
+		return 0;
+	}
+
+	if (*op + 2 > outlen) {
+		return -1;
+	}
+	out[(*op)++] = offset & 0xff;
+	out[(*op)++] = offset >> 8;
+
+	matchlen -= LZ4_MIN_MATCH;
+	*token |= min_t(uint32_t, matchlen, 15);
+	if (matchlen >= 15 && lz4_put_length(out, op, outlen, matchlen - 15)) {
+		return -1;
+	}
+	return 0;
+}
+
+/* Only compresses all of the input, fails if it doesn't get smaller */
+static int jffs2_lz4_compress(unsigned char *data_in,
+		unsigned char *cpage_out, uint32_t *sourcelen,
+		uint32_t *dstlen, void *model) {
+	uint16_t table[1 << LZ4_HASH_BITS];
+	uint32_t srclen = *sourcelen, outlen = *dstlen;
+	uint32_t ip = 0, anchor = 0, op = 0;
+	uint32_t cand, len, h;
+
+	if (srclen <= LZ4_MF_LIMIT || srclen > LZ4_MAX_OFFSET) {
+		/* Too short to bother, or positions don't fit 16 bits */
+		return -1;
+	}
+	if (outlen >= srclen) {
+		outlen = srclen - 1;
+	}
+
+	memset(table, 0, sizeof(table));
+
+	while (ip < srclen - LZ4_MF_LIMIT) {
+		h = lz4_hash(lz4_read32(&data_in[ip]));
+		cand = table[h];
+		table[h] = ip;
+
+		if (cand >= ip || lz4_read32(&data_in[cand]) != lz4_read32(&data_in[ip])) {
+			ip++;
+			continue;
+		}
+
+		len = LZ4_MIN_MATCH;
+		while (ip + len < srclen - LZ4_LAST_LITERALS
+				&& data_in[cand + len] == data_in[ip + len]) {
+			len++;
+		}
+
+		if (lz4_put_sequence(cpage_out, &op, outlen, &data_in[anchor],
+				ip - anchor, ip - cand, len)) {
+			return -1;
+		}
+		ip += len;
+		anchor = ip;
+	}
+
+	if (lz4_put_sequence(cpage_out, &op, outlen, &data_in[anchor],
+			srclen - anchor, 0, 0)) {
+		return -1;
+	}
+
+	*dstlen = op;
+	return 0;
+}
+
+static int lz4_get_length(unsigned char *in, uint32_t *ip, uint32_t inlen,
+		uint32_t *len) {
+	unsigned char b;
+
+	do {
+		if (*ip >= inlen) {
+			return -1;
+		}
+		b = in[(*ip)++];
+		*len += b;
+	} while (b == 255);
+	return 0;
+}
+
+static int jffs2_lz4_decompress(unsigned char *data_in,
+		unsigned char *cpage_out, uint32_t srclen, uint32_t destlen,
+		void *model) {
+	uint32_t ip = 0, op = 0;
+	uint32_t lit, len, offset;
+	unsigned char token;
+
+	while (ip < srclen) {
+		token = data_in[ip++];
+
+		lit = token >> 4;
+		if (lit == 15 && lz4_get_length(data_in, &ip, srclen, &lit)) {
+			return -EIO;
+		}
+		if (ip + lit > srclen || op + lit > destlen) {
+			return -EIO;
+		}
+		memcpy(&cpage_out[op], &data_in[ip], lit);
+		ip += lit;
+		op += lit;
+
+		if (ip == srclen) {
+			break;
+		}
+
+		if (ip + 2 > srclen) {
+			return -EIO;
+		}
+		offset = data_in[ip] | (data_in[ip + 1] << 8);
+		ip += 2;
+		if (!offset || offset > op) {
+			return -EIO;
+		}
+
+		len = token & 15;
+		if (len == 15 && lz4_get_length(data_in, &ip, srclen, &len)) {
+			return -EIO;
+		}
+		len += LZ4_MIN_MATCH;
+		if (op + len > destlen) {
+			return -EIO;
+		}
+
+		/* Byte by byte, the match may overlap the output */
+		for (; len; len--, op++) {
+			cpage_out[op] = cpage_out[op - offset];
+		}
+	}
+
+	return op == destlen ? 0 : -EIO;
+}
+
+static struct jffs2_compressor jffs2_lz4_comp = {
+	.priority = JFFS2_LZ4_PRIORITY,
+	.name = "lz4",
+	.compr = JFFS2_COMPR_LZ4,
+	.compress = &jffs2_lz4_compress,
+	.decompress = &jffs2_lz4_decompress,
+	/* Always there to read what was written with it */
+	.disabled = !OPTION_GET(BOOLEAN, lz4),
+};
+
+int jffs2_lz4_init(void) {
+	return jffs2_register_compressor(&jffs2_lz4_comp);
+}
+
+void jffs2_lz4_exit(void) {
+	jffs2_unregister_compressor(&jffs2_lz4_comp);
+}
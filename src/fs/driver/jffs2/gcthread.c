@@ -12,108 +12,92 @@
  */
 #include <linux/kernel.h>
 #include "nodelist.h"
-//#include <cyg/kernel/kapi.h>
 
-#define GC_THREAD_FLAG_TRIG 1
-#define GC_THREAD_FLAG_STOP 2
-#define GC_THREAD_FLAG_HAS_EXIT 4
-
-static cyg_thread_entry_t jffs2_garbage_collect_thread;
-
-void jffs2_garbage_collect_trigger(struct jffs2_sb_info *c) {
-     struct super_block *sb=OFNI_BS_2SFFJ(c);
-
-     /* Wake up the thread */
-     D1(printk("jffs2_garbage_collect_trigger\n"));
-
-     cyg_flag_setbits(&sb->s_gc_thread_flags,GC_THREAD_FLAG_TRIG);
+#include <kernel/sched.h>
+#include <kernel/thread.h>
+#include <kernel/time/ktime.h>
+#include <util/err.h>
+
+/* The thread wakes up every JFFS2_GC_PERIOD ms, erases the blocks
+ * waiting for it and collects garbage while jffs2_thread_should_wake()
+ * says the free blocks are below the GC trigger level. So writers mostly
+ * find erased blocks ready instead of collecting them inline.
+ * Collection takes the alloc_sem just like the inline one in
+ * jffs2_reserve_space() does, and the s_lock before it to keep off the
+ * inode cache while VFS calls use it. The lock is dropped between passes.
+ */
+static void *jffs2_garbage_collect_thread(void *data) {
+	struct jffs2_sb_info *c = data;
+	struct super_block *sb;
+	int ret;
+
+	sb = member_cast_out(c, struct super_block, jffs2_sb);
+
+	D1(printk("jffs2_garbage_collect_thread START\n"));
+
+	while (!sb->s_gc_thread_stop) {
+		ksleep(JFFS2_GC_PERIOD);
+
+		if (c->nr_erasing_blocks) {
+			jffs2_sb_lock(sb);
+			down(&c->alloc_sem);
+			jffs2_erase_pending_blocks(c, 0);
+			up(&c->alloc_sem);
+			jffs2_sb_unlock(sb);
+		}
+
+		while (!sb->s_gc_thread_stop && jffs2_thread_should_wake(c)) {
+			D1(printk("jffs2: GC THREAD GC BEGIN\n"));
+			jffs2_sb_lock(sb);
+			ret = jffs2_garbage_collect_pass(c);
+			jffs2_sb_unlock(sb);
+			if (ret == -ENOSPC) {
+				printk("No space for garbage collection. "
+						"Aborting JFFS2 GC thread\n");
+				return NULL;
+			}
+			D1(printk("jffs2: GC THREAD GC END\n"));
+		}
+	}
+
+	D1(printk("jffs2_garbage_collect_thread EXIT\n"));
+	return NULL;
 }
 
-
 void jffs2_start_garbage_collect_thread(struct jffs2_sb_info *c) {
-     struct super_block *sb=OFNI_BS_2SFFJ(c);
-
-     CYG_ASSERTC(c);
-     CYG_ASSERTC(!sb->s_gc_thread_handle);
-
-     cyg_flag_init(&sb->s_gc_thread_flags);
-     cyg_mutex_init(&sb->s_lock);
-
-     D1(printk("jffs2_start_garbage_collect_thread\n"));
-     /* Start the thread. Doesn't matter if it fails -- it's only an
-      * optimisation anyway */
-     cyg_thread_create(CYGNUM_JFFS2_GC_THREAD_PRIORITY,
-                       jffs2_garbage_collect_thread,
-                       (cyg_addrword_t)c,"jffs2 gc thread",
-                       (void*)sb->s_gc_thread_stack,
-                       sizeof(sb->s_gc_thread_stack),
-                       &sb->s_gc_thread_handle,
-                       &sb->s_gc_thread);
-
-     cyg_thread_resume(sb->s_gc_thread_handle);
-}
-
-void jffs2_stop_garbage_collect_thread(struct jffs2_sb_info *c) {
-     struct super_block *sb=OFNI_BS_2SFFJ(c);
+	struct super_block *sb;
+	struct thread *t;
 
-     CYG_ASSERTC(sb->s_gc_thread_handle);
+	sb = member_cast_out(c, struct super_block, jffs2_sb);
 
-     D1(printk("jffs2_stop_garbage_collect_thread\n"));
-     /* Stop the thread and wait for it if necessary */
+	D1(printk("jffs2_start_garbage_collect_thread\n"));
 
-     cyg_flag_setbits(&sb->s_gc_thread_flags,GC_THREAD_FLAG_STOP);
+	sb->s_gc_thread_stop = 0;
+	/* Doesn't matter if it fails -- it's only an optimisation anyway */
+	t = thread_create(THREAD_FLAG_SUSPENDED, jffs2_garbage_collect_thread, c);
+	if (err(t)) {
+		printk(KERN_NOTICE "JFFS2: failed to start GC thread: %d\n", err(t));
+		sb->s_gc_thread = NULL;
+		return;
+	}
+	schedee_priority_set(&t->schedee, SCHED_PRIORITY_LOW);
+	thread_launch(t);
 
-     D1(printk("jffs2_stop_garbage_collect_thread wait\n"));
-
-     cyg_flag_wait(&sb->s_gc_thread_flags,
-                   GC_THREAD_FLAG_HAS_EXIT,
-                   CYG_FLAG_WAITMODE_OR| CYG_FLAG_WAITMODE_CLR);
-
-     /* Kill and free the resources ...  this is safe due to the flag
-      * from the thread.
-      */
-     cyg_thread_kill(sb->s_gc_thread_handle);
-     cyg_thread_delete(sb->s_gc_thread_handle);
-
-     cyg_mutex_destroy(&sb->s_lock);
-     cyg_flag_destroy(&sb->s_gc_thread_flags);
+	sb->s_gc_thread = t;
 }
 
+void jffs2_stop_garbage_collect_thread(struct jffs2_sb_info *c) {
+	struct super_block *sb;
 
-static void jffs2_garbage_collect_thread(cyg_addrword_t data) {
-     struct jffs2_sb_info *c=(struct jffs2_sb_info *)data;
-     struct super_block *sb=OFNI_BS_2SFFJ(c);
-     cyg_flag_value_t flag;
-     cyg_mtab_entry *mte;
-
-     D1(printk("jffs2_garbage_collect_thread START\n"));
-
-     while(1) {
-          flag=cyg_flag_timed_wait(&sb->s_gc_thread_flags,
-                                   GC_THREAD_FLAG_TRIG|GC_THREAD_FLAG_STOP,
-                                   CYG_FLAG_WAITMODE_OR| CYG_FLAG_WAITMODE_CLR,
-                                   cyg_current_time()+
-                                   CYGNUM_JFFS2_GS_THREAD_TICKS);
-
-          if (flag & GC_THREAD_FLAG_STOP) {
-        	  break;
-          }
-
-          D1(printk("jffs2: GC THREAD GC BEGIN\n"));
+	sb = member_cast_out(c, struct super_block, jffs2_sb);
 
-          mte=cyg_fs_root_lookup((cyg_dir *) sb->s_root);
-          CYG_ASSERT(mte, "Bad mount point");
-          cyg_fs_lock(mte, mte->fs->syncmode);
+	if (!sb->s_gc_thread) {
+		return;
+	}
 
-          if (jffs2_garbage_collect_pass(c) == -ENOSPC) {
-               printf("No space for garbage collection. "
-                      "Aborting JFFS2 GC thread\n");
-               break;
-          }
-          cyg_fs_unlock(mte, mte->fs->syncmode);
-          D1(printk("jffs2: GC THREAD GC END\n"));
-     }
+	D1(printk("jffs2_stop_garbage_collect_thread\n"));
 
-     D1(printk("jffs2_garbage_collect_thread EXIT\n"));
-     cyg_flag_setbits(&sb->s_gc_thread_flags,GC_THREAD_FLAG_HAS_EXIT);
+	sb->s_gc_thread_stop = 1;
+	thread_join(sb->s_gc_thread, NULL);
+	sb->s_gc_thread = NULL;
 }
@@ -17,6 +17,7 @@
 #include <linux/pagemap.h>
 #include <linux/crc32.h>
 #include "compr.h"
+#include "summary.h"
 #include <errno.h>
 #include <string.h>
 
@@ -276,7 +277,7 @@ static int jffs2_read_super(struct super_block *sb) {
 	c = &sb->jffs2_sb;
 
 	c->flash_size = sb->bdev->size < 4096 ? 4096 : sb->bdev->size;
-	c->sector_size = sb->bdev->block_size < 4096 ? 4096 : sb->bdev->size;
+	c->sector_size = sb->bdev->block_size < 4096 ? 4096 : sb->bdev->block_size;
 	/* Number 4096 is used here beacuse actually there are no real flash
 	 * drives with less than 4KiB erasable block. But if device is provided
 	 * with QEMU, than it's just a block device with 512 bytes block size.
@@ -291,6 +292,12 @@ static int jffs2_read_super(struct super_block *sb) {
 	if (err) {
 		return -err;
 	}
+	D1(printk( "jffs2: %u blocks (%u by summary) scanned\n",
+			c->nr_blocks, c->sum_blocks));
+
+	if (jffs2_sum_init(c)) {
+		printk(KERN_NOTICE "jffs2: no memory for summaries\n");
+	}
 	D1(printk( "jffs2_read_super(): Getting root inode\n"));
 	sb->s_root = jffs2_iget(sb, 1);
 	if (IS_ERR(sb->s_root)) {
@@ -303,6 +310,7 @@ static int jffs2_read_super(struct super_block *sb) {
 	return 0;
 
     out_nodes:
+	jffs2_sum_exit(c);
 	jffs2_free_ino_caches(c);
 	jffs2_free_raw_node_refs(c);
 	sysfree(c->blocks);
@@ -329,6 +337,9 @@ static int jffs2_mount(struct nas *dir_nas) {
 	memset(jffs2_sb, 0, sizeof (struct super_block));
 
 	jffs2_sb->bdev = dir_nas->fs->bdev;
+#ifdef CYGOPT_FS_JFFS2_GCTHREAD
+	mutex_init(&jffs2_sb->s_lock);
+#endif
 
 	c->inocache_list = sysmalloc(sizeof(struct jffs2_inode_cache *) * INOCACHE_HASHSIZE);
 	if (!c->inocache_list) {
@@ -338,6 +349,9 @@ static int jffs2_mount(struct nas *dir_nas) {
 
 	spin_init(&c->inocache_lock, __SPIN_UNLOCKED);
 	spin_init(&c->erase_completion_lock, __SPIN_UNLOCKED);
+	/* GC thread and writers do contend for these */
+	init_MUTEX(&c->alloc_sem);
+	init_MUTEX(&c->erase_free_sem);
 
 	if (n_fs_mounted++ == 0) {
 		jffs2_create_slab_caches(); /* No error check, cannot fail */
@@ -413,15 +427,19 @@ static int jffs2_umount(struct nas *dir_nas) {
 
 	/* Only really umount if this is the only mount */
 	if (jffs2_sb->s_mount_count == 1) {
+#ifdef CYGOPT_FS_JFFS2_GCTHREAD
+		/* Nobody else uses the inode cache after that */
+		jffs2_stop_garbage_collect_thread(c);
+#endif
 		icache_evict(root, NULL);
 
 		if (root->i_count != 1) {
 			printf("Ino #1 has use count %d\n", root->i_count);
-			return EBUSY;
-		}
 #ifdef CYGOPT_FS_JFFS2_GCTHREAD
-		jffs2_stop_garbage_collect_thread(c);
+			jffs2_start_garbage_collect_thread(c);
 #endif
+			return EBUSY;
+		}
 		jffs2_iput(root);	/* Time to free the root inode */
 
 		/* free directory entries */
@@ -433,6 +451,7 @@ static int jffs2_umount(struct nas *dir_nas) {
 		sysfree(root);
 
 		/* Clean up the super block and root inode */
+		jffs2_sum_exit(c);
 		jffs2_free_ino_caches(c);
 		jffs2_free_raw_node_refs(c);
 		sysfree(c->blocks);
@@ -856,9 +875,10 @@ static int jffs2_truncate_file (struct _inode *inode) {
      return 0;
 }
 
-static int jffs2_fo_write(struct file_desc *desc, char *buf, ssize_t size) {
+/* Returns the number of bytes written or -errno */
+static ssize_t jffs2_fo_write(struct file_desc *desc, char *buf, ssize_t size,
+		off_t pos) {
 	struct _inode *inode;
-	off_t pos = desc->cursor;
 	ssize_t resid = size;
 	struct jffs2_raw_inode ri;
 	struct jffs2_inode_info *f;
@@ -878,8 +898,7 @@ static int jffs2_fo_write(struct file_desc *desc, char *buf, ssize_t size) {
 	c = &inode->i_sb->jffs2_sb;
 
 	if (pos < 0) {
-		SET_ERRNO(EINVAL);
-		return 0;
+		return -EINVAL;
 	}
 
 	memset(&ri, 0, sizeof(ri));
@@ -894,8 +913,7 @@ static int jffs2_fo_write(struct file_desc *desc, char *buf, ssize_t size) {
 		ri.version = cpu_to_je32(++f->highest_version);
 		err = jffs2_extend_file(inode, &ri, pos);
 		if (err) {
-			SET_ERRNO(-err);
-			return 0;
+			return err;
 		}
 
 	}
@@ -910,13 +928,11 @@ static int jffs2_fo_write(struct file_desc *desc, char *buf, ssize_t size) {
 					  pos, len, &writtenlen);
 
 	if (err) {
-		SET_ERRNO(-err);
-		return 0;
+		return err;
 	}
 
 	if (writtenlen != len) {
-		SET_ERRNO(ENOSPC);
-		return 0;
+		return -ENOSPC;
 	}
 
 	pos += len;
@@ -931,8 +947,6 @@ static int jffs2_fo_write(struct file_desc *desc, char *buf, ssize_t size) {
 		inode->i_size = pos;
 	}
 
-	desc->cursor = pos;
-
 	return writtenlen;
 }
 
@@ -1367,12 +1381,18 @@ static struct idesc *jffs2fs_open(struct node *node, struct file_desc *file_desc
 static int jffs2fs_close(struct file_desc *desc);
 static size_t jffs2fs_read(struct file_desc *desc, void *buf, size_t size);
 static size_t jffs2fs_write(struct file_desc *desc, void *buf, size_t size);
+static ssize_t jffs2fs_pread(struct file_desc *desc, void *buf, size_t size,
+		off_t pos);
+static ssize_t jffs2fs_pwrite(struct file_desc *desc, void *buf, size_t size,
+		off_t pos);
 
 static struct file_operations jffs2_fop = {
 	.open = jffs2fs_open,
 	.close = jffs2fs_close,
 	.read = jffs2fs_read,
 	.write = jffs2fs_write,
+	.pread = jffs2fs_pread,
+	.pwrite = jffs2fs_pwrite,
 };
 
 /*
@@ -1389,11 +1409,12 @@ static struct idesc *jffs2fs_open(struct node *node, struct file_desc *desc, int
 	fi = nas->fi->privdata;
 	fsi = nas->fs->fsi;
 
-	nas->fi->ni.size = fi->_inode->i_size;
-
 	vfs_get_relative_path(nas->node, path, PATH_MAX);
 
+	jffs2_sb_lock(&fsi->jffs2_sb);
+	nas->fi->ni.size = fi->_inode->i_size;
 	res = jffs2_open(fsi->jffs2_sb.s_root, path, flags);
+	jffs2_sb_unlock(&fsi->jffs2_sb);
 	if (res) {
 		return err_ptr(-res);
 	}
@@ -1403,18 +1424,26 @@ static struct idesc *jffs2fs_open(struct node *node, struct file_desc *desc, int
 static int jffs2fs_close(struct file_desc *desc) {
 	struct nas *nas;
 	struct jffs2_file_info *fi;
+	struct super_block *sb;
+	int rc;
 
 	if (NULL == desc) {
 		return 0;
 	}
 	nas = desc->node->nas;
 	fi = nas->fi->privdata;
+	sb = fi->_inode->i_sb;
+
+	jffs2_sb_lock(sb);
 	nas->fi->ni.size = fi->_inode->i_size;
+	rc = jffs2_fo_close(fi->_inode);
+	jffs2_sb_unlock(sb);
 
-	return jffs2_fo_close(fi->_inode);
+	return rc;
 }
 
-static size_t jffs2fs_read(struct file_desc *desc, void *buff, size_t size) {
+static ssize_t jffs2fs_pread(struct file_desc *desc, void *buff, size_t size,
+		off_t pos) {
 	int rc;
 	struct nas *nas;
 	struct jffs2_file_info *fi;
@@ -1428,32 +1457,62 @@ static size_t jffs2fs_read(struct file_desc *desc, void *buff, size_t size) {
 	f = JFFS2_INODE_INFO(fi->_inode);
 	c = &fi->_inode->i_sb->jffs2_sb;
 
-	len = min(size, fi->_inode->i_size - desc->cursor);
-
-	if (0 != (rc = jffs2_read_inode_range(c, f,
-			(unsigned char *) buff, desc->cursor, len))) {
-		SET_ERRNO(rc);
+	jffs2_sb_lock(fi->_inode->i_sb);
+	if (pos >= fi->_inode->i_size) {
+		jffs2_sb_unlock(fi->_inode->i_sb);
 		return 0;
 	}
-
-	desc->cursor += len;
+	len = min(size, fi->_inode->i_size - pos);
+	rc = jffs2_read_inode_range(c, f, (unsigned char *) buff, pos, len);
+	jffs2_sb_unlock(fi->_inode->i_sb);
+	if (0 != rc) {
+		return rc;
+	}
 
 	return len;
 }
 
-static size_t jffs2fs_write(struct file_desc *desc, void *buff, size_t size) {
-	uint32_t bytecount;
+static ssize_t jffs2fs_pwrite(struct file_desc *desc, void *buff, size_t size,
+		off_t pos) {
+	ssize_t ret;
 	struct nas *nas;
 	struct jffs2_file_info *fi;
 
 	nas = desc->node->nas;
 	fi = nas->fi->privdata;
 
-	bytecount = jffs2_fo_write(desc, buff, size);
-
+	jffs2_sb_lock(fi->_inode->i_sb);
+	ret = jffs2_fo_write(desc, buff, size, pos);
 	nas->fi->ni.size = fi->_inode->i_size;
+	jffs2_sb_unlock(fi->_inode->i_sb);
+
+	return ret;
+}
+
+static size_t jffs2fs_read(struct file_desc *desc, void *buff, size_t size) {
+	ssize_t ret;
+
+	ret = jffs2fs_pread(desc, buff, size, desc->cursor);
+	if (ret < 0) {
+		SET_ERRNO(-ret);
+		return 0;
+	}
+	desc->cursor += ret;
 
-	return bytecount;
+	return ret;
+}
+
+static size_t jffs2fs_write(struct file_desc *desc, void *buff, size_t size) {
+	ssize_t ret;
+
+	ret = jffs2fs_pwrite(desc, buff, size, desc->cursor);
+	if (ret < 0) {
+		SET_ERRNO(-ret);
+		return 0;
+	}
+	desc->cursor += ret;
+
+	return ret;
 }
 
 static int jffs2_free_fs(struct nas *nas) {
@@ -1575,32 +1634,41 @@ static int jffs2fs_create(struct node *parent_node, struct node *node) {
 	int rc;
 	struct nas *nas;
 	struct jffs2_file_info *fi, *parents_fi;
+	struct super_block *sb;
 
 	nas = node->nas;
 	parents_fi = parent_node->nas->fi->privdata;
+	sb = parents_fi->_inode->i_sb;
 
+	jffs2_sb_lock(sb);
 	if (node_is_directory(node)) {
 		node->mode |= S_IRUGO|S_IXUGO|S_IWUSR;
 		if (0 != (rc = jffs2_ops_mkdir(parents_fi->_inode,
 				(const char *) &node->name, node->mode))) {
-			return -rc;
+			rc = -rc;
+			goto out;
 		}
 		/* file info for new dir will be allocate into */
 		if (0 != (rc = mount_vfs_dir_enty(parent_node->nas))) {
-			return -rc;
+			rc = -rc;
+			goto out;
 		}
 	} else {
 		if (NULL == (fi = jffs2_fi_alloc(nas, parent_node->nas->fs))) {
 				nas->fi->privdata = (void *) fi;
-				return ENOMEM;
+				rc = ENOMEM;
+				goto out;
 			}
 		if (0 != (rc = jffs2_create(parents_fi->_inode,
 				(const unsigned char *) &node->name,
 								node->mode, &fi->_inode))) {
-			return -rc;
+			rc = -rc;
+			goto out;
 		}
 	}
-	return 0;
+out:
+	jffs2_sb_unlock(sb);
+	return rc;
 }
 
 static int jffs2fs_delete(struct node *node) {
@@ -1615,16 +1683,15 @@ static int jffs2fs_delete(struct node *node) {
 
 	par_fi = parents->nas->fi->privdata;
 	fi = node->nas->fi->privdata;
+	jffs2_sb_lock(par_fi->_inode->i_sb);
 	if (node_is_directory(node)) {
-		if (0 != (rc = jffs2_ops_rmdir(par_fi->_inode,
-						(const char *) node->name))) {
-			return -rc;
-		}
+		rc = jffs2_ops_rmdir(par_fi->_inode, (const char *) node->name);
 	} else {
-		if (0 != (rc = jffs2_ops_unlink(par_fi->_inode,
-						(const char *) node->name))) {
-			return -rc;
-		}
+		rc = jffs2_ops_unlink(par_fi->_inode, (const char *) node->name);
+	}
+	jffs2_sb_unlock(par_fi->_inode->i_sb);
+	if (0 != rc) {
+		return -rc;
 	}
 
 	if(NULL != (fi = node->nas->fi->privdata)) {
@@ -1725,7 +1792,11 @@ static int jffs2fs_mount(void *dev, void *dir) {
 	dir_nas->fi->privdata = fi;
 	fi->_inode = fsi->jffs2_sb.s_root;
 
-	if(0 != (rc = mount_vfs_dir_enty(dir_nas))) {
+	/* GC thread is already running */
+	jffs2_sb_lock(&fsi->jffs2_sb);
+	rc = mount_vfs_dir_enty(dir_nas);
+	jffs2_sb_unlock(&fsi->jffs2_sb);
+	if (0 != rc) {
 		goto error;
 	}
 
@@ -1744,7 +1815,9 @@ static int jffs2fs_truncate (struct node *node, off_t length) {
 	nas->fi->ni.size = length;
 
 	fi = nas->fi->privdata;
+	jffs2_sb_lock(fi->_inode->i_sb);
 	jffs2_truncate_file(fi->_inode);
+	jffs2_sb_unlock(fi->_inode->i_sb);
 
 	return 0;
 }
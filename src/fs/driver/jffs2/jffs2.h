@@ -39,6 +39,8 @@
 
 #include <kernel/time/clock_source.h>
 #include <kernel/thread.h>
+#include <kernel/thread/sync/mutex.h>
+#include <framework/mod/options.h>
 
 #include <linux/types.h>
 #include <linux/list.h>
@@ -77,6 +79,8 @@
 #define JFFS2_COMPR_COPY	0x04
 #define JFFS2_COMPR_DYNRUBIN	0x05
 #define JFFS2_COMPR_ZLIB	0x06
+/* 0x07 is LZO in Linux, LZ4 has no id there */
+#define JFFS2_COMPR_LZ4		0x08
 /* Compatibility flags. */
 #define JFFS2_COMPAT_MASK 0xc000      /* What do to if an unknown nodetype is found */
 #define JFFS2_NODE_ACCURATE 0x2000
@@ -181,6 +185,7 @@ union jffs2_node_union {
 #define JFFS2_SB_FLAG_BUILDING 4 /* File system building is in progress */
 
 struct jffs2_inodirty;
+struct jffs2_summary;
 
 /* A struct for the overall file system control.  Pointers to
  * jffs2_sb_info structs are named `c' in the source code.
@@ -256,6 +261,10 @@ struct jffs2_sb_info {
 	   to an obsoleted node. I don't like this. Alternatives welcomed. */
 	struct semaphore erase_free_sem;
 
+	/* Summary being collected for the nextblock, see summary.c */
+	struct jffs2_summary *summary;
+	uint32_t sum_blocks;	/* Blocks mounted from their summaries */
+
 #ifdef CONFIG_JFFS2_FS_WRITEBUFFER
 	/* Write-behind buffer for NAND flash */
 	unsigned char *wbuf;
@@ -317,13 +326,12 @@ struct jffs2_inode_info {
 #define get_seconds clock_sys_ticks
 
 #define CONFIG_JFFS2_ZLIB 1
-//#define CYGOPT_FS_JFFS2_GCTHREAD 0
-#define CYGNUM_JFFS2_GC_THREAD_PRIORITY 30
-#define CYGNUM_JFFS2_GC_THREAD_PRIORITY_30
-#define CYGNUM_JFFS2_GC_THREAD_STACK_SIZE 8192
-#define CYGNUM_JFFS2_GC_THREAD_STACK_SIZE_8192
-#define CYGNUM_JFFS2_GS_THREAD_TICKS 100
-#define CYGNUM_JFFS2_GS_THREAD_TICKS_100
+#define CONFIG_JFFS2_LZ4 1
+#if OPTION_GET(BOOLEAN, gc_thread)
+#define CYGOPT_FS_JFFS2_GCTHREAD 1
+#endif
+#define JFFS2_GC_PERIOD         OPTION_GET(NUMBER, gc_period_ms)
+#define JFFS2_GC_TRIGGER_BLOCKS OPTION_GET(NUMBER, gc_trigger_blocks)
 #define CYGOPT_FS_JFFS2_DEBUG 0
 #define CYGOPT_FS_JFFS2_DEBUG_0
 #define CONFIG_JFFS2_FS_DEBUG 0
@@ -395,25 +403,36 @@ struct super_block {
 
 #ifdef CYGOPT_FS_JFFS2_GCTHREAD
 	struct mutex s_lock;        /* Lock the inode cache */
-	struct thread s_gc_thread;
-    char s_gc_thread_stack[CYGNUM_JFFS2_GC_THREAD_STACK_SIZE];
-//       mtab_entry *mte;
+	struct thread *s_gc_thread;
+	volatile int s_gc_thread_stop;
 #endif
 };
 
+/* The GC thread walks the inode cache and the erase block lists, so it
+ * and every VFS call that may touch them hold the s_lock */
+static inline void jffs2_sb_lock(struct super_block *sb) {
+#ifdef CYGOPT_FS_JFFS2_GCTHREAD
+	mutex_lock(&sb->s_lock);
+#endif
+}
+
+static inline void jffs2_sb_unlock(struct super_block *sb) {
+#ifdef CYGOPT_FS_JFFS2_GCTHREAD
+	mutex_unlock(&sb->s_lock);
+#endif
+}
+
 #define sleep_on_spinunlock(wq, sl) spin_unlock(sl)
 #define EBADFD 32767
 
-/* background.c */
+/* gcthread.c */
 #ifdef CYGOPT_FS_JFFS2_GCTHREAD
-void jffs2_garbage_collect_trigger(struct jffs2_sb_info *c);
 void jffs2_start_garbage_collect_thread(struct jffs2_sb_info *c);
 void jffs2_stop_garbage_collect_thread(struct jffs2_sb_info *c);
-#else
+#endif
 static inline void jffs2_garbage_collect_trigger(struct jffs2_sb_info *c) {
-	/* We don't have a GC thread */
+	/* GC thread, if any, polls jffs2_thread_should_wake() by itself */
 }
-#endif
 
 struct _inode *jffs2_new_inode (struct _inode *dir_i,
 					int mode, struct jffs2_raw_inode *ri);
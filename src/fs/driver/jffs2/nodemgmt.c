@@ -17,6 +17,7 @@
 #include <linux/compiler.h>
 #include <linux/sched.h> /* For cond_resched() */
 #include "nodelist.h"
+#include "summary.h"
 
 /**
  *	jffs2_reserve_space - request physical space to write nodes to flash
@@ -172,7 +173,16 @@ static int jffs2_do_reserve_space(struct jffs2_sb_info *c,
 	struct jffs2_eraseblock *jeb = c->nextblock;
 
  restart:
-	if (jeb && minsize > jeb->free_size) {
+	if (jeb && minsize + jffs2_sum_reserve(c, minsize) > jeb->free_size) {
+		/* Close the block with its summary. It's refiled by
+		 * jffs2_add_physical_node_ref() if it is full now */
+		if (jffs2_sum_reserve(c, 0)) {
+			spin_unlock(&c->erase_completion_lock);
+			jffs2_sum_write(c, jeb);
+			spin_lock(&c->erase_completion_lock);
+			jeb = c->nextblock;
+			goto restart;
+		}
 		/* Skip the end of this block and file it as having some dirty space */
 		/* If there's a pending write to it, flush now */
 		if (jffs2_wbuf_dirty(c)) {
@@ -273,11 +283,14 @@ static int jffs2_do_reserve_space(struct jffs2_sb_info *c,
 			printk(KERN_WARNING "Eep. Block 0x%08x taken from free_list had free_size of 0x%08x!!\n", jeb->offset, jeb->free_size);
 			goto restart;
 		}
+		/* Check again, the summary needs room in it now */
+		jffs2_sum_reset(c, jeb);
+		goto restart;
 	}
 	/* OK, jeb (==c->nextblock) is now pointing at a block which definitely has
 	   enough space */
 	*ofs = jeb->offset + (c->sector_size - jeb->free_size);
-	*len = jeb->free_size;
+	*len = jeb->free_size - jffs2_sum_reserve(c, minsize);
 
 	if (c->cleanmarker_size && jeb->used_size == c->cleanmarker_size &&
 	    !jeb->first_node->next_in_ino) {
@@ -327,6 +340,8 @@ int jffs2_add_physical_node_ref(struct jffs2_sb_info *c,
 		return -EINVAL;
 	}
 #endif
+	jffs2_sum_add_node(c, jeb, new, len);
+
 	spin_lock(&c->erase_completion_lock);
 
 	if (!jeb->first_node) {
@@ -18,6 +18,9 @@
 #include <linux/crc32.h>
 #include <linux/compiler.h>
 #include "nodelist.h"
+#include "summary.h"
+
+#include <mem/sysmalloc.h>
 
 #define DEFAULT_EMPTY_SCAN_SIZE 1024
 
@@ -57,6 +60,8 @@ static int jffs2_scan_inode_node(struct jffs2_sb_info *c, struct jffs2_erasebloc
 				 struct jffs2_raw_inode *ri, uint32_t ofs);
 static int jffs2_scan_dirent_node(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
 				 struct jffs2_raw_dirent *rd, uint32_t ofs);
+static int jffs2_scan_summary(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
+				 unsigned char *buf, uint32_t buf_size);
 
 #define BLK_STATE_ALLFF		0
 #define BLK_STATE_CLEAN		1
@@ -315,6 +320,16 @@ static int jffs2_scan_eraseblock (struct jffs2_sb_info *c,
 		}
 	}
 #endif
+	/* A block closed with a summary needs no scanning */
+	err = jffs2_scan_summary(c, jeb, buf, buf_size);
+	if (err < 0) {
+		return err;
+	}
+	if (err > 0) {
+		c->sum_blocks++;
+		goto scan_done;
+	}
+
 	buf_ofs = jeb->offset;
 
 	if (!buf_size) {
@@ -623,7 +638,7 @@ scan_more:
 		}
 	}
 
-
+ scan_done:
 	D1(printk( "Block at 0x%08x: free 0x%08x, dirty 0x%08x, unchecked 0x%08x, used 0x%08x\n", jeb->offset,
 		  jeb->free_size, jeb->dirty_size, jeb->unchecked_size, jeb->used_size));
 
@@ -828,6 +843,275 @@ static int jffs2_scan_dirent_node(struct jffs2_sb_info *c, struct jffs2_eraseblo
 	return 0;
 }
 
+/* Entries are checked before anything is built from them, the summary
+ * is either used as a whole or the block is scanned.
+ */
+static int jffs2_sum_entries_valid(struct jffs2_sb_info *c, unsigned char *p,
+				   uint32_t len, uint32_t num, uint32_t sum_ofs)
+{
+	struct jffs2_sum_inode_flash *ie;
+	struct jffs2_sum_dirent_flash *de;
+	uint32_t ofs, totlen, esize, end = 0;
+
+	while (num--) {
+		if (len < sizeof(jint16_t))
+			return 0;
+
+		switch (je16_to_cpu(((struct jffs2_sum_inode_flash *)p)->nodetype)) {
+		case JFFS2_NODETYPE_INODE:
+			ie = (void *)p;
+			esize = sizeof(*ie);
+			if (len < esize)
+				return 0;
+			ofs = je32_to_cpu(ie->offset);
+			totlen = je32_to_cpu(ie->totlen);
+			if (totlen < sizeof(struct jffs2_raw_inode))
+				return 0;
+			break;
+
+		case JFFS2_NODETYPE_DIRENT:
+			de = (void *)p;
+			if (len < sizeof(*de))
+				return 0;
+			esize = sizeof(*de) + de->nsize;
+			if (len < esize)
+				return 0;
+			ofs = je32_to_cpu(de->offset);
+			totlen = je32_to_cpu(de->totlen);
+			if (totlen < sizeof(struct jffs2_raw_dirent) + de->nsize)
+				return 0;
+			break;
+
+		default:
+			return 0;
+		}
+
+		if ((ofs & 3) || ofs < end || totlen > sum_ofs ||
+		    ofs > sum_ofs - PAD(totlen))
+			return 0;
+
+		end = ofs + PAD(totlen);
+		p += esize;
+		len -= esize;
+	}
+	return len == 0;
+}
+
+static void jffs2_scan_link_node(struct jffs2_eraseblock *jeb,
+				 struct jffs2_raw_node_ref *raw)
+{
+	if (!jeb->first_node)
+		jeb->first_node = raw;
+	if (jeb->last_node)
+		jeb->last_node->next_phys = raw;
+	jeb->last_node = raw;
+}
+
+static int jffs2_scan_sum_inode(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
+				struct jffs2_sum_inode_flash *ie)
+{
+	struct jffs2_raw_node_ref *raw;
+	struct jffs2_inode_cache *ic;
+	uint32_t totlen = PAD(je32_to_cpu(ie->totlen));
+
+	raw = jffs2_alloc_raw_node_ref();
+	if (!raw) {
+		return -ENOMEM;
+	}
+	ic = jffs2_scan_make_ino_cache(c, je32_to_cpu(ie->inode));
+	if (!ic) {
+		jffs2_free_raw_node_ref(raw);
+		return -ENOMEM;
+	}
+
+	/* As in jffs2_scan_inode_node(), the node is checked later. That
+	   also catches nodes obsoleted after the summary was written */
+	raw->flash_offset = (jeb->offset + je32_to_cpu(ie->offset)) | REF_UNCHECKED;
+	raw->__totlen = totlen;
+	raw->next_phys = NULL;
+	raw->next_in_ino = ic->nodes;
+	ic->nodes = raw;
+	jffs2_scan_link_node(jeb, raw);
+
+	pseudo_random += je32_to_cpu(ie->version);
+
+	UNCHECKED_SPACE(totlen);
+	return 0;
+}
+
+static int jffs2_scan_sum_dirent(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
+				 struct jffs2_sum_dirent_flash *de)
+{
+	struct jffs2_unknown_node node;
+	struct jffs2_raw_node_ref *raw;
+	struct jffs2_full_dirent *fd;
+	struct jffs2_inode_cache *ic;
+	uint32_t ofs = jeb->offset + je32_to_cpu(de->offset);
+	uint32_t totlen = PAD(je32_to_cpu(de->totlen));
+
+	/* Dirents are counted as links right away, so one obsoleted after
+	   the summary was written must not come back */
+	if (jffs2_fill_scan_buf(c, (unsigned char *)&node, ofs, sizeof(node)) ||
+	    je16_to_cpu(node.nodetype) != JFFS2_NODETYPE_DIRENT) {
+		D1(printk("jffs2_scan_sum_dirent(): Node at 0x%08x is obsolete\n", ofs));
+		DIRTY_SPACE(totlen);
+		return 0;
+	}
+
+	fd = jffs2_alloc_full_dirent(de->nsize+1);
+	if (!fd) {
+		return -ENOMEM;
+	}
+	memcpy(&fd->name, de->name, de->nsize);
+	fd->name[de->nsize] = 0;
+
+	raw = jffs2_alloc_raw_node_ref();
+	if (!raw) {
+		jffs2_free_full_dirent(fd);
+		return -ENOMEM;
+	}
+	ic = jffs2_scan_make_ino_cache(c, je32_to_cpu(de->pino));
+	if (!ic) {
+		jffs2_free_full_dirent(fd);
+		jffs2_free_raw_node_ref(raw);
+		return -ENOMEM;
+	}
+
+	raw->__totlen = totlen;
+	raw->flash_offset = ofs | REF_PRISTINE;
+	raw->next_phys = NULL;
+	raw->next_in_ino = ic->nodes;
+	ic->nodes = raw;
+	jffs2_scan_link_node(jeb, raw);
+
+	pseudo_random += je32_to_cpu(de->version);
+
+	fd->raw = raw;
+	fd->next = NULL;
+	fd->version = je32_to_cpu(de->version);
+	fd->ino = je32_to_cpu(de->ino);
+	fd->nhash = full_name_hash(fd->name, de->nsize);
+	fd->type = de->type;
+	USED_SPACE(totlen);
+	jffs2_add_fd_to_list(c, fd, &ic->scan_dents);
+
+	return 0;
+}
+
+/* Returns 1 if the block was built from its summary, 0 if it has to be
+ * scanned, or an error.
+ */
+static int jffs2_scan_summary(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
+			      unsigned char *buf, uint32_t buf_size)
+{
+	struct jffs2_sum_marker marker;
+	struct jffs2_raw_summary *sum;
+	struct jffs2_raw_node_ref *raw;
+	unsigned char *sumbuf, *p;
+	uint32_t sum_ofs, sum_len, padded, entries_len, num, ofs, pos;
+	int err, ret = 0;
+
+	if (c->sector_size < sizeof(*sum) + sizeof(marker))
+		return 0;
+
+	if (jffs2_fill_scan_buf(c, (unsigned char *)&marker,
+				jeb->offset + c->sector_size - sizeof(marker), sizeof(marker)))
+		return 0;
+	if (je32_to_cpu(marker.magic) != JFFS2_SUM_MAGIC)
+		return 0;
+
+	sum_ofs = je32_to_cpu(marker.offset);
+	if ((sum_ofs & 3) || sum_ofs > c->sector_size - sizeof(*sum) - sizeof(marker))
+		return 0;
+	sum_len = c->sector_size - sum_ofs;
+
+	sumbuf = buf;
+	if (buf_size < sum_len) {
+		sumbuf = sysmalloc(sum_len);
+		if (!sumbuf)
+			return -ENOMEM;
+	}
+
+	if (jffs2_fill_scan_buf(c, sumbuf, jeb->offset + sum_ofs, sum_len))
+		goto out;
+
+	sum = (void *)sumbuf;
+	if (je16_to_cpu(sum->magic) != JFFS2_MAGIC_BITMASK ||
+	    je16_to_cpu(sum->nodetype) != JFFS2_NODETYPE_SUMMARY ||
+	    je32_to_cpu(sum->totlen) != sum_len ||
+	    je32_to_cpu(sum->hdr_crc) != crc32(0, sum, sizeof(struct jffs2_unknown_node) - 4) ||
+	    je32_to_cpu(sum->node_crc) != crc32(0, sum, sizeof(*sum) - 8)) {
+		printk(KERN_NOTICE "jffs2_scan_summary(): Bad summary node at 0x%08x\n",
+		       jeb->offset + sum_ofs);
+		goto out;
+	}
+
+	padded = je32_to_cpu(sum->padded);
+	if (padded > sum_len - sizeof(*sum) - sizeof(marker))
+		goto out;
+	entries_len = sum_len - sizeof(*sum) - sizeof(marker) - padded;
+	num = je32_to_cpu(sum->sum_num);
+
+	if (je32_to_cpu(sum->sum_crc) != crc32(0, sum->sum, entries_len) ||
+	    !jffs2_sum_entries_valid(c, (unsigned char *)sum->sum, entries_len, num, sum_ofs)) {
+		printk(KERN_NOTICE "jffs2_scan_summary(): Bad summary entries at 0x%08x\n",
+		       jeb->offset + sum_ofs);
+		goto out;
+	}
+
+	D1(printk("jffs2_scan_summary(): %u nodes in block at 0x%08x\n", num, jeb->offset));
+
+	/* Holes between the nodes are obsoleted nodes and such */
+	pos = 0;
+	p = (unsigned char *)sum->sum;
+	while (num--) {
+		if (je16_to_cpu(((struct jffs2_sum_inode_flash *)p)->nodetype) == JFFS2_NODETYPE_INODE) {
+			struct jffs2_sum_inode_flash *ie = (void *)p;
+
+			ofs = je32_to_cpu(ie->offset);
+			if (ofs > pos)
+				DIRTY_SPACE(ofs - pos);
+			err = jffs2_scan_sum_inode(c, jeb, ie);
+			pos = ofs + PAD(je32_to_cpu(ie->totlen));
+			p += sizeof(*ie);
+		} else {
+			struct jffs2_sum_dirent_flash *de = (void *)p;
+
+			ofs = je32_to_cpu(de->offset);
+			if (ofs > pos)
+				DIRTY_SPACE(ofs - pos);
+			err = jffs2_scan_sum_dirent(c, jeb, de);
+			pos = ofs + PAD(je32_to_cpu(de->totlen));
+			p += sizeof(*de) + de->nsize;
+		}
+		if (err) {
+			ret = err;
+			goto out;
+		}
+	}
+	if (sum_ofs > pos)
+		DIRTY_SPACE(sum_ofs - pos);
+
+	/* The summary itself, it has no inode and GC just drops it */
+	raw = jffs2_alloc_raw_node_ref();
+	if (!raw) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	raw->flash_offset = (jeb->offset + sum_ofs) | REF_NORMAL;
+	raw->__totlen = sum_len;
+	raw->next_phys = NULL;
+	raw->next_in_ino = NULL;
+	jffs2_scan_link_node(jeb, raw);
+	USED_SPACE(sum_len);
+
+	ret = 1;
+ out:
+	if (sumbuf != buf)
+		sysfree(sumbuf);
+	return ret;
+}
+
 static int count_list(struct list_head *l)
 {
 	uint32_t count = 0;
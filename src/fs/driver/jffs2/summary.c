@@ -0,0 +1,265 @@
+/**
+ * @file
+ * @brief Collecting and writing JFFS2 erase block summaries
+ *
+ * Entries are collected in RAM for the nextblock as nodes get written
+ * to it, room for them is kept at the end of the block by
+ * jffs2_do_reserve_space(). When the block can't take the next node,
+ * the summary is written into the rest of it. Anything the summary
+ * can't describe (unknown nodes, a block partly written before mount,
+ * a failed write) just leaves the block without a summary, it's fully
+ * scanned on mount then. Mount side is jffs2_scan_summary() in scan.c.
+ *
+ * @date 19.10.2026
+ */
+
+#include <linux/kernel.h>
+#include <linux/crc32.h>
+#include "nodelist.h"
+#include "summary.h"
+
+#include <sys/uio.h>
+
+#include <mem/sysmalloc.h>
+
+#define JFFS2_SUMMARY OPTION_GET(BOOLEAN, summary)
+
+#define JFFS2_SUM_FRAME_SIZE \
+	(sizeof(struct jffs2_raw_summary) + sizeof(struct jffs2_sum_marker))
+
+struct jffs2_summary {
+	struct jffs2_eraseblock *jeb; /* Block being described, NULL if none */
+	uint32_t sum_num;
+	uint32_t sum_size;            /* Bytes of entries in buf */
+	uint32_t buf_size;
+	unsigned char *buf;
+};
+
+int jffs2_sum_init(struct jffs2_sb_info *c) {
+	struct jffs2_summary *s;
+
+	if (!JFFS2_SUMMARY) {
+		return 0;
+	}
+
+	s = sysmalloc(sizeof(*s));
+	if (!s) {
+		return -ENOMEM;
+	}
+	memset(s, 0, sizeof(*s));
+
+	/* Entries are at most 24 + 254 bytes for a 40 + 254 bytes dirent
+	 * node, so half a block is enough unless the block is packed with
+	 * short named dirents. Such a block gets no summary.
+	 */
+	s->buf_size = c->sector_size / 2;
+	s->buf = sysmalloc(s->buf_size);
+	if (!s->buf) {
+		sysfree(s);
+		return -ENOMEM;
+	}
+
+	c->summary = s;
+	return 0;
+}
+
+void jffs2_sum_exit(struct jffs2_sb_info *c) {
+	if (!c->summary) {
+		return;
+	}
+	sysfree(c->summary->buf);
+	sysfree(c->summary);
+	c->summary = NULL;
+}
+
+void jffs2_sum_reset(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb) {
+	struct jffs2_summary *s = c->summary;
+
+	if (!s) {
+		return;
+	}
+	s->jeb = jeb;
+	s->sum_num = 0;
+	s->sum_size = 0;
+}
+
+/* Largest entry a node of len bytes may need */
+static uint32_t jffs2_sum_entry_max(uint32_t len) {
+	uint32_t nsize = 0;
+
+	if (len > sizeof(struct jffs2_raw_dirent)) {
+		nsize = min_t(uint32_t, len - sizeof(struct jffs2_raw_dirent),
+				JFFS2_MAX_NAME_LEN);
+	}
+	if (sizeof(struct jffs2_sum_dirent_flash) + nsize
+			< sizeof(struct jffs2_sum_inode_flash)) {
+		return sizeof(struct jffs2_sum_inode_flash);
+	}
+	return sizeof(struct jffs2_sum_dirent_flash) + nsize;
+}
+
+uint32_t jffs2_sum_reserve(struct jffs2_sb_info *c, uint32_t minsize) {
+	struct jffs2_summary *s = c->summary;
+
+	if (!s || !s->jeb || s->jeb != c->nextblock) {
+		return 0;
+	}
+	return PAD(JFFS2_SUM_FRAME_SIZE + s->sum_size
+			+ jffs2_sum_entry_max(minsize));
+}
+
+void jffs2_sum_add_node(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
+		struct jffs2_raw_node_ref *ref, uint32_t len) {
+	struct jffs2_summary *s = c->summary;
+	union {
+		union jffs2_node_union n;
+		unsigned char raw[sizeof(struct jffs2_raw_dirent) + JFFS2_MAX_NAME_LEN];
+	} node;
+	struct jffs2_sum_inode_flash *ie;
+	struct jffs2_sum_dirent_flash *de;
+	size_t rlen, retlen;
+	uint32_t esize;
+
+	if (!s || s->jeb != jeb) {
+		return;
+	}
+	if (ref_obsolete(ref)) {
+		/* Mount will see a hole between entries, that is dirty space */
+		return;
+	}
+
+	/* The node is still in the buffer cache, it has just been written */
+	rlen = min_t(uint32_t, len, sizeof(node));
+	if (jffs2_flash_read(c, ref_offset(ref), rlen, &retlen, node.raw)
+			|| retlen != rlen || rlen < sizeof(struct jffs2_unknown_node)) {
+		goto no_summary;
+	}
+
+	switch (je16_to_cpu(node.n.u.nodetype)) {
+	case JFFS2_NODETYPE_INODE:
+		if (rlen < sizeof(struct jffs2_raw_inode)) {
+			goto no_summary;
+		}
+		esize = sizeof(*ie);
+		break;
+	case JFFS2_NODETYPE_DIRENT:
+		if (rlen < sizeof(struct jffs2_raw_dirent) + node.n.d.nsize) {
+			goto no_summary;
+		}
+		esize = sizeof(*de) + node.n.d.nsize;
+		break;
+	default:
+		goto no_summary;
+	}
+
+	if (s->sum_size + esize > s->buf_size
+			|| jeb->free_size < len + JFFS2_SUM_FRAME_SIZE + s->sum_size + esize) {
+		goto no_summary;
+	}
+
+	if (je16_to_cpu(node.n.u.nodetype) == JFFS2_NODETYPE_INODE) {
+		ie = (void *) (s->buf + s->sum_size);
+		ie->nodetype = node.n.i.nodetype;
+		ie->inode = node.n.i.ino;
+		ie->version = node.n.i.version;
+		ie->offset = cpu_to_je32(ref_offset(ref) - jeb->offset);
+		ie->totlen = node.n.i.totlen;
+	} else {
+		de = (void *) (s->buf + s->sum_size);
+		de->nodetype = node.n.d.nodetype;
+		de->totlen = node.n.d.totlen;
+		de->offset = cpu_to_je32(ref_offset(ref) - jeb->offset);
+		de->pino = node.n.d.pino;
+		de->version = node.n.d.version;
+		de->ino = node.n.d.ino;
+		de->nsize = node.n.d.nsize;
+		de->type = node.n.d.type;
+		memcpy(de->name, node.n.d.name, node.n.d.nsize);
+	}
+	s->sum_size += esize;
+	s->sum_num++;
+	return;
+
+no_summary:
+	D1(printk("jffs2_sum_add_node(): no summary for block at 0x%08x\n",
+			jeb->offset));
+	s->jeb = NULL;
+}
+
+int jffs2_sum_write(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb) {
+	struct jffs2_summary *s = c->summary;
+	struct jffs2_raw_summary sum;
+	struct jffs2_sum_marker marker;
+	struct jffs2_raw_node_ref *raw;
+	struct iovec vecs[2];
+	uint32_t sum_ofs, infosize;
+	size_t retlen;
+	int ret;
+
+	if (!s || s->jeb != jeb) {
+		return 0;
+	}
+	/* Nothing is collected for this block from now on */
+	s->jeb = NULL;
+
+	infosize = jeb->free_size;
+	if (!s->sum_num || infosize < JFFS2_SUM_FRAME_SIZE + s->sum_size) {
+		return 0;
+	}
+	sum_ofs = c->sector_size - jeb->free_size;
+
+	raw = jffs2_alloc_raw_node_ref();
+	if (!raw) {
+		return -ENOMEM;
+	}
+
+	memset(&sum, 0, sizeof(sum));
+	sum.magic = cpu_to_je16(JFFS2_MAGIC_BITMASK);
+	sum.nodetype = cpu_to_je16(JFFS2_NODETYPE_SUMMARY);
+	sum.totlen = cpu_to_je32(infosize);
+	sum.hdr_crc = cpu_to_je32(crc32(0, &sum,
+				sizeof(struct jffs2_unknown_node) - 4));
+	sum.sum_num = cpu_to_je32(s->sum_num);
+	sum.cln_mkr = cpu_to_je32(0);
+	sum.padded = cpu_to_je32(infosize - JFFS2_SUM_FRAME_SIZE - s->sum_size);
+	sum.sum_crc = cpu_to_je32(crc32(0, s->buf, s->sum_size));
+	sum.node_crc = cpu_to_je32(crc32(0, &sum, sizeof(sum) - 8));
+
+	marker.offset = cpu_to_je32(sum_ofs);
+	marker.magic = cpu_to_je32(JFFS2_SUM_MAGIC);
+
+	vecs[0].iov_base = (unsigned char *) &sum;
+	vecs[0].iov_len = sizeof(sum);
+	vecs[1].iov_base = s->buf;
+	vecs[1].iov_len = s->sum_size;
+
+	/* Padding is left erased. Marker goes last, so a summary cut by
+	 * power loss is never found.
+	 */
+	ret = jffs2_flash_direct_writev(c, vecs, 2, jeb->offset + sum_ofs, &retlen);
+	if (!ret && retlen == sizeof(sum) + s->sum_size) {
+		ret = jffs2_flash_write(c,
+				jeb->offset + c->sector_size - sizeof(marker),
+				sizeof(marker), &retlen, (unsigned char *) &marker);
+		if (!ret && retlen != sizeof(marker)) {
+			ret = -EIO;
+		}
+	} else if (!ret) {
+		ret = -EIO;
+	}
+
+	if (ret) {
+		printk(KERN_NOTICE "Write of summary at 0x%08x failed: %d\n",
+				jeb->offset + sum_ofs, ret);
+	}
+
+	/* Summary has no inode, GC just drops it */
+	raw->flash_offset = (jeb->offset + sum_ofs) | (ret ? REF_OBSOLETE : REF_NORMAL);
+	raw->__totlen = infosize;
+	raw->next_phys = NULL;
+	raw->next_in_ino = NULL;
+
+	jffs2_add_physical_node_ref(c, raw);
+
+	return ret;
+}
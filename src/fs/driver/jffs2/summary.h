@@ -0,0 +1,93 @@
+/**
+ * @file
+ * @brief JFFS2 erase block summaries
+ *
+ * Every erase block filled by the file system ends with a summary node
+ * listing the inode and dirent nodes of the block, so mount reads one
+ * node per block instead of scanning all of them. The layout follows
+ * the summary nodes of Linux JFFS2, but it's not meant to be compatible.
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef JFFS2_SUMMARY_H_
+#define JFFS2_SUMMARY_H_
+
+#include <stdint.h>
+
+#include <fs/jffs2.h>
+
+#define JFFS2_NODETYPE_SUMMARY \
+	(JFFS2_FEATURE_RWCOMPAT_DELETE | JFFS2_NODE_ACCURATE | 6)
+
+#define JFFS2_SUM_MAGIC 0x02851885
+
+/* Last bytes of the erase block, point to the summary node */
+struct jffs2_sum_marker {
+	jint32_t offset;    /* Of the summary node from the block start */
+	jint32_t magic;     /* == JFFS2_SUM_MAGIC */
+} __attribute__((packed));
+
+/* Summary node runs up to the end of the erase block, marker included */
+struct jffs2_raw_summary {
+	jint16_t magic;
+	jint16_t nodetype;  /* == JFFS2_NODETYPE_SUMMARY */
+	jint32_t totlen;
+	jint32_t hdr_crc;
+	jint32_t sum_num;   /* Number of entries */
+	jint32_t cln_mkr;   /* Not used, always zero */
+	jint32_t padded;    /* Erased bytes between the entries and marker */
+	jint32_t sum_crc;   /* CRC of the entries */
+	jint32_t node_crc;  /* CRC of this header */
+	jint32_t sum[0];
+} __attribute__((packed));
+
+struct jffs2_sum_inode_flash {
+	jint16_t nodetype;  /* == JFFS2_NODETYPE_INODE */
+	jint32_t inode;
+	jint32_t version;
+	jint32_t offset;    /* Of the node from the block start */
+	jint32_t totlen;
+} __attribute__((packed));
+
+struct jffs2_sum_dirent_flash {
+	jint16_t nodetype;  /* == JFFS2_NODETYPE_DIRENT */
+	jint32_t totlen;
+	jint32_t offset;
+	jint32_t pino;
+	jint32_t version;
+	jint32_t ino;
+	uint8_t nsize;
+	uint8_t type;
+	uint8_t name[0];
+} __attribute__((packed));
+
+struct jffs2_sb_info;
+struct jffs2_eraseblock;
+struct jffs2_raw_node_ref;
+
+/* Both are no-op if summaries are disabled */
+extern int jffs2_sum_init(struct jffs2_sb_info *c);
+extern void jffs2_sum_exit(struct jffs2_sb_info *c);
+
+/** Starts collecting the summary of a freshly erased @a jeb. */
+extern void jffs2_sum_reset(struct jffs2_sb_info *c,
+		struct jffs2_eraseblock *jeb);
+
+/**
+ * Space to keep at the end of the nextblock for its summary, should
+ * a node of @a minsize bytes be written there.
+ * @return Zero if the nextblock gets no summary.
+ */
+extern uint32_t jffs2_sum_reserve(struct jffs2_sb_info *c, uint32_t minsize);
+
+/** Adds the node just written to @a jeb to its summary. */
+extern void jffs2_sum_add_node(struct jffs2_sb_info *c,
+		struct jffs2_eraseblock *jeb, struct jffs2_raw_node_ref *ref,
+		uint32_t len);
+
+/** Writes the summary into the rest of @a jeb and closes the block. */
+extern int jffs2_sum_write(struct jffs2_sb_info *c,
+		struct jffs2_eraseblock *jeb);
+
+#endif /* JFFS2_SUMMARY_H_ */
@@ -0,0 +1,135 @@
+/**
+ * @file
+ *
+ * @brief Read-only file system exposing kernel statistics
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <fs/fs_driver.h>
+#include <fs/vfs.h>
+#include <fs/file_desc.h>
+#include <fs/file_operation.h>
+#include <kernel/kstat.h>
+#include <mem/misc/pool.h>
+
+#define KSTATFS_NAME     "kstatfs"
+#define KSTATFS_BUF_SIZE 512
+
+struct kstatfs_file_info {
+	struct node_info ni; /* must be the first member */
+	const struct kstat_desc *desc;
+};
+
+POOL_DEF(kstatfs_fi_pool, struct kstatfs_file_info,
+		OPTION_GET(NUMBER, node_quantity));
+
+static struct idesc *kstatfs_open(struct node *nod, struct file_desc *desc,
+		int flags) {
+	return &desc->idesc;
+}
+
+static int kstatfs_close(struct file_desc *desc) {
+	return 0;
+}
+
+/* Value is printed anew on each read, so the file always shows
+ * the current state */
+static size_t kstatfs_read(struct file_desc *desc, void *buf, size_t size) {
+	struct kstatfs_file_info *fi;
+	char text[KSTATFS_BUF_SIZE];
+	int len;
+
+	fi = (struct kstatfs_file_info *) desc->node->nas->fi;
+	if (!fi) {
+		return -ENOENT;
+	}
+
+	len = kstat_snprint(fi->desc, text, sizeof(text));
+	if (desc->cursor >= len) {
+		return 0;
+	}
+
+	if (size > len - desc->cursor) {
+		size = len - desc->cursor;
+	}
+
+	memcpy(buf, text + desc->cursor, size);
+	desc->cursor += size;
+
+	return size;
+}
+
+static int kstatfs_mount(void *dev, void *dir) {
+	struct node *dir_node = dir;
+	struct node *node;
+	struct kstatfs_file_info *fi;
+	const struct kstat_desc *kdesc;
+
+	if (NULL == (dir_node->nas->fs = filesystem_create(KSTATFS_NAME))) {
+		return -ENOMEM;
+	}
+
+	kstat_foreach(kdesc) {
+		node = vfs_subtree_create_intermediate(dir_node, kdesc->name,
+				S_IFREG | S_IRUSR | S_IRGRP | S_IROTH);
+		if (!node) {
+			return -ENOMEM;
+		}
+
+		fi = pool_alloc(&kstatfs_fi_pool);
+		if (!fi) {
+			return -ENOMEM;
+		}
+		memset(fi, 0, sizeof(*fi));
+		fi->desc = kdesc;
+
+		node->nas->fi = (struct node_fi *) fi;
+		node->nas->fs = dir_node->nas->fs;
+	}
+
+	return 0;
+}
+
+static void kstatfs_subtree_del(struct node *dir_node) {
+	struct node *child;
+
+	while (NULL != (child = vfs_subtree_get_child_next(dir_node, NULL))) {
+		kstatfs_subtree_del(child);
+
+		if (child->nas->fi) {
+			pool_free(&kstatfs_fi_pool, child->nas->fi);
+		}
+		vfs_del_leaf(child);
+	}
+}
+
+static int kstatfs_umount(void *dir) {
+	kstatfs_subtree_del(dir);
+
+	return 0;
+}
+
+static struct file_operations kstatfs_fop = {
+	.open = kstatfs_open,
+	.close = kstatfs_close,
+	.read = kstatfs_read,
+};
+
+static struct fsop_desc kstatfs_fsop = {
+	.mount = kstatfs_mount,
+	.umount = kstatfs_umount,
+};
+
+static struct fs_driver kstatfs_driver = {
+	.name = KSTATFS_NAME,
+	.file_op = &kstatfs_fop,
+	.fsop = &kstatfs_fsop,
+	.mount_dev_by_string = true,
+};
+
+DECLARE_FILE_SYSTEM_DRIVER(kstatfs_driver);
@@ -2,6 +2,9 @@
  * @file
  * @brief Tmp file system
  *
+ * Files are kept in pages taken right from the page allocator, there is
+ * no backing block device. Directories are VFS tree nodes.
+ *
  * @date 12.11.12
  * @author Andrey Gazukin
  */
@@ -16,16 +19,16 @@
 
 #include <util/array.h>
 #include <util/indexator.h>
+#include <util/math.h>
 
 #include <embox/unit.h>
 
+#include <kernel/thread/sync/mutex.h>
+
 #include <mem/misc/pool.h>
 #include <mem/phymem.h>
 #include <mem/page.h>
 
-#include <drivers/block_dev.h>
-#include <drivers/block_dev/ramdisk/ramdisk.h>
-
 #include <fs/file_system.h>
 #include <fs/file_desc.h>
 #include <fs/fs_driver.h>
@@ -44,72 +47,228 @@ POOL_DEF(tmpfs_file_pool, struct tmpfs_file_info, OPTION_GET(NUMBER,inode_quanti
 
 INDEX_DEF(tmpfs_file_idx,0,OPTION_GET(NUMBER,inode_quantity));
 
-/* define sizes in 4096 blocks */
+/* define sizes in pages */
 #define MAX_FILE_SIZE OPTION_GET(NUMBER,tmpfs_file_size)
 #define FILESYSTEM_SIZE OPTION_GET(NUMBER,tmpfs_filesystem_size)
 
 #define TMPFS_NAME "tmpfs"
-#define TMPFS_DEV  "/dev/ram#"
 #define TMPFS_DIR  "/tmp"
 
-static char sector_buff[PAGE_SIZE()];/* TODO */
-static char tmpfs_dev[] = TMPFS_DEV;
+/* Number of pointers in a radix tree node page */
+#define TMPFS_SLOTS (PAGE_SIZE() / sizeof(void *))
 
-static int tmpfs_format(void *path);
 static int tmpfs_mount(void *dev, void *dir);
 
 static int tmpfs_init(void * par) {
 	struct path dir_path;
-	struct node *dev_node;
-	int res;
-	struct ramdisk *ramdisk;
 
 	if (!par) {
 		return 0;
 	}
 
-	/*TODO */
-
 	if (0 != vfs_lookup(TMPFS_DIR, &dir_path)) {
 		return -ENOENT;
 	}
 
-	ramdisk = ramdisk_create(tmpfs_dev, FILESYSTEM_SIZE * PAGE_SIZE());
-	if (0 != (res = err(ramdisk))) {
-		return res;
+	return tmpfs_mount(NULL, dir_path.node);
+}
+
+static int tmp_fs_init(void) {
+	return tmpfs_init(TMPFS_DIR);
+}
+
+EMBOX_UNIT_INIT(tmp_fs_init);
+
+static void *tmpfs_page_alloc(struct tmpfs_fs_info *fsi) {
+	void *page;
+
+	mutex_lock(&fsi->lock);
+	if (fsi->used_pages >= fsi->max_pages) {
+		mutex_unlock(&fsi->lock);
+		return NULL;
 	}
+	fsi->used_pages++;
+	mutex_unlock(&fsi->lock);
+
+	if (NULL == (page = phymem_alloc(1))) {
+		mutex_lock(&fsi->lock);
+		fsi->used_pages--;
+		mutex_unlock(&fsi->lock);
+		return NULL;
+	}
+	memset(page, 0, PAGE_SIZE());
+
+	return page;
+}
+
+static void tmpfs_page_free(struct tmpfs_fs_info *fsi, void *page) {
+	phymem_free(page, 1);
+
+	mutex_lock(&fsi->lock);
+	fsi->used_pages--;
+	mutex_unlock(&fsi->lock);
+}
+
+/* Number of pages covered by a subtree of the given height */
+static size_t tmpfs_radix_span(int height) {
+	size_t span = 1;
 
-	dev_node = ramdisk->bdev->dev_vfs_info;
-	if (!dev_node) {
-		return -1;
+	while (height--) {
+		span *= TMPFS_SLOTS;
 	}
 
-	/* format filesystem */
-	if (0 != (res = tmpfs_format((void *) dev_node))) {
-		return res;
+	return span;
+}
+
+/*
+ * Get the slot pointing to data page idx of the file. If alloc is set,
+ * the tree is grown and missing nodes are allocated on the way, otherwise
+ * NULL is returned for a hole.
+ */
+static void **tmpfs_page_slot(struct tmpfs_fs_info *fsi,
+		struct tmpfs_file_info *fi, size_t idx, int alloc) {
+	void **slot, **node;
+	size_t span;
+	int h;
+
+	while (idx >= tmpfs_radix_span(fi->height)) {
+		if (!alloc) {
+			return NULL;
+		}
+		if (fi->root) {
+			if (NULL == (node = tmpfs_page_alloc(fsi))) {
+				return NULL;
+			}
+			node[0] = fi->root;
+			fi->root = node;
+		}
+		fi->height++;
+	}
+
+	slot = &fi->root;
+	for (h = fi->height; h > 0; h--) {
+		if (!*slot) {
+			if (!alloc || NULL == (*slot = tmpfs_page_alloc(fsi))) {
+				return NULL;
+			}
+		}
+		span = tmpfs_radix_span(h - 1);
+		slot = &((void **) *slot)[idx / span];
+		idx %= span;
+	}
+
+	return slot;
+}
+
+static char *tmpfs_page_lookup(struct tmpfs_file_info *fi, size_t idx) {
+	void **slot;
+
+	slot = tmpfs_page_slot(NULL, fi, idx, 0);
+
+	return slot ? *slot : NULL;
+}
+
+static char *tmpfs_page_get(struct tmpfs_fs_info *fsi,
+		struct tmpfs_file_info *fi, size_t idx) {
+	void **slot;
+
+	if (NULL == (slot = tmpfs_page_slot(fsi, fi, idx, 1))) {
+		return NULL;
+	}
+	if (!*slot) {
+		*slot = tmpfs_page_alloc(fsi);
 	}
 
-	/* mount filesystem */
-	return tmpfs_mount(dev_node, dir_path.node);
+	return *slot;
 }
 
-static int tmp_ramdisk_fs_init(void) {
-	return tmpfs_init(tmpfs_dev);
+/*
+ * Free all data pages of the subtree starting from index start and
+ * the nodes left empty. Returns non-zero if the whole subtree is freed.
+ */
+static int tmpfs_radix_trim(struct tmpfs_fs_info *fsi, void **slot,
+		int height, size_t start) {
+	void **node = *slot;
+	size_t span, i;
+	int empty;
+
+	if (!node) {
+		return 1;
+	}
+
+	if (height == 0) {
+		if (start != 0) {
+			return 0;
+		}
+		tmpfs_page_free(fsi, node);
+		*slot = NULL;
+		return 1;
+	}
+
+	span = tmpfs_radix_span(height - 1);
+	empty = 1;
+	for (i = 0; i < TMPFS_SLOTS; i++) {
+		if (!node[i]) {
+			continue;
+		}
+		if ((i + 1) * span <= start) {
+			empty = 0;
+			continue;
+		}
+		if (!tmpfs_radix_trim(fsi, &node[i], height - 1,
+				start > i * span ? start - i * span : 0)) {
+			empty = 0;
+		}
+	}
+
+	if (empty) {
+		tmpfs_page_free(fsi, node);
+		*slot = NULL;
+	}
+
+	return empty;
 }
 
-EMBOX_UNIT_INIT(tmp_ramdisk_fs_init); /*TODO*/
+static void tmpfs_file_trim(struct tmpfs_fs_info *fsi,
+		struct tmpfs_file_info *fi, off_t length) {
+	char *page;
 
+	tmpfs_radix_trim(fsi, &fi->root, fi->height,
+			(length + PAGE_SIZE() - 1) / PAGE_SIZE());
+	if (!fi->root) {
+		fi->height = 0;
+	}
+
+	/* Tail of the last page must read as zeroes if file grows again */
+	if (length % PAGE_SIZE()) {
+		page = tmpfs_page_lookup(fi, length / PAGE_SIZE());
+		if (page) {
+			memset(page + length % PAGE_SIZE(), 0,
+					PAGE_SIZE() - length % PAGE_SIZE());
+		}
+	}
+}
 
 static struct idesc *tmpfs_open(struct node *node, struct file_desc *file_desc, int flags);
 static int    tmpfs_close(struct file_desc *desc);
 static size_t tmpfs_read(struct file_desc *desc, void *buf, size_t size);
 static size_t tmpfs_write(struct file_desc *desc, void *buf, size_t size);
+static void  *tmpfs_mmap(struct file_desc *desc, size_t len, off_t off);
+static void  *tmpfs_lookup(struct file_desc *desc, size_t len, off_t off);
+static ssize_t tmpfs_pread(struct file_desc *desc, void *buf, size_t size,
+		off_t pos);
+static ssize_t tmpfs_pwrite(struct file_desc *desc, void *buf, size_t size,
+		off_t pos);
 
 static struct file_operations tmpfs_fop = {
 	.open = tmpfs_open,
 	.close = tmpfs_close,
 	.read = tmpfs_read,
 	.write = tmpfs_write,
+	.mmap = tmpfs_mmap,
+	.lookup = tmpfs_lookup,
+	.pread = tmpfs_pread,
+	.pwrite = tmpfs_pwrite,
 };
 
 /*
@@ -124,43 +283,46 @@ static int tmpfs_close(struct file_desc *desc) {
 	return 0;
 }
 
-static int tmpfs_read_sector(struct nas *nas, char *buffer,
-		uint32_t count, uint32_t sector) {
-	struct tmpfs_fs_info *fsi;
+static ssize_t tmpfs_pread(struct file_desc *desc, void *buf, size_t size,
+		off_t pos) {
+	size_t len, done, cnt, off;
+	char *page, *dst = buf;
+	struct nas *nas;
+	struct tmpfs_file_info *fi;
 
-	fsi = nas->fs->fsi;
+	nas = desc->node->nas;
+	fi = nas->fi->privdata;
 
-	if(0 > block_dev_read_buffered(nas->fs->bdev, buffer,
-			count * fsi->block_size, sector * fsi->block_size)) {
-		return -1;
-	}
-	else {
-		return count;
+	if (pos < 0) {
+		return -EINVAL;
 	}
-}
-
-static int tmpfs_write_sector(struct nas *nas, char *buffer,
-		uint32_t count, uint32_t sector) {
-	struct tmpfs_fs_info *fsi;
-
-	fsi = nas->fs->fsi;
-
-	if(0 > block_dev_write_buffered(nas->fs->bdev, buffer,
-			count * fsi->block_size, sector * fsi->block_size)) {
-		return -1;
+	/* Don't try to read past EOF */
+	if (pos >= nas->fi->ni.size) {
+		return 0;
 	}
-	else {
-		return count;
+	len = min(size, (size_t) (nas->fi->ni.size - pos));
+
+	mutex_lock(&fi->lock);
+	for (done = 0; done < len; done += cnt) {
+		off = (pos + done) % PAGE_SIZE();
+		cnt = min(len - done, PAGE_SIZE() - off);
+
+		page = tmpfs_page_lookup(fi, (pos + done) / PAGE_SIZE());
+		if (page) {
+			memcpy(dst + done, page + off, cnt);
+		} else {
+			memset(dst + done, 0, cnt);
+		}
 	}
+	mutex_unlock(&fi->lock);
+
+	return len;
 }
 
-static size_t tmpfs_read(struct file_desc *desc, void *buf, size_t size) {
-	size_t len;
-	size_t current, cnt;
-	uint32_t end_pointer;
-	blkno_t blk;
-	uint32_t bytecount;
-	uint32_t start_block;		/* start of file */
+static ssize_t tmpfs_pwrite(struct file_desc *desc, void *buf, size_t size,
+		off_t pos) {
+	size_t len, done, cnt, off;
+	char *page, *src = buf;
 	struct nas *nas;
 	struct tmpfs_fs_info *fsi;
 	struct tmpfs_file_info *fi;
@@ -169,210 +331,175 @@ static size_t tmpfs_read(struct file_desc *desc, void *buf, size_t size) {
 	fi = nas->fi->privdata;
 	fsi = nas->fs->fsi;
 
-	len = size;
-
-	/* Don't try to read past EOF */
-	if (len > nas->fi->ni.size - desc->cursor) {
-		len = nas->fi->ni.size - desc->cursor;
+	if (pos < 0) {
+		return -EINVAL;
 	}
+	if (pos >= MAX_FILE_SIZE * PAGE_SIZE()) {
+		return -EFBIG;
+	}
+	len = min(size, (size_t) (MAX_FILE_SIZE * PAGE_SIZE() - pos));
 
-	end_pointer = desc->cursor + len;
-	bytecount = 0;
-	start_block = fi->index * fsi->block_per_file;
+	mutex_lock(&fi->lock);
+	for (done = 0; done < len; done += cnt) {
+		off = (pos + done) % PAGE_SIZE();
+		cnt = min(len - done, PAGE_SIZE() - off);
 
-	while(len) {
-		blk = desc->cursor / fsi->block_size;
-		/* check if block over the file */
-		if(blk >= fsi->block_per_file) {
-			bytecount = 0;
-			break;
-		}
-		else {
-			blk += start_block;
-		}
-		/* check if block over the filesystem */
-		if(blk >= fsi->numblocks) {
-			bytecount = 0;
+		page = tmpfs_page_get(fsi, fi, (pos + done) / PAGE_SIZE());
+		if (!page) {
 			break;
 		}
-		/* calculate pointer in scratch buffer */
-		current = desc->cursor % fsi->block_size;
+		memcpy(page + off, src + done, cnt);
+	}
+	/* if we write over the last EOF, set new filelen */
+	if (done && nas->fi->ni.size < pos + done) {
+		nas->fi->ni.size = pos + done;
+	}
+	mutex_unlock(&fi->lock);
 
-		/* set the counter how many bytes read from block */
-		if(end_pointer - desc->cursor > fsi->block_size) {
-			if(current) {
-				cnt = fsi->block_size - current;
-			}
-			else {
-				cnt = fsi->block_size;
-			}
-		}
-		else {
-			cnt = end_pointer - desc->cursor;
-		}
+	if (done == 0 && len != 0) {
+		return -ENOSPC;
+	}
 
-		/* one 4096-bytes block read operation */
-		if(1 != tmpfs_read_sector(nas, sector_buff, 1, blk)) {
-			bytecount = 0;
-			break;
-		}
-		/* get data from block */
-		memcpy (buf, sector_buff + current, cnt);
+	return done;
+}
 
-		bytecount += cnt;
-		/* shift the pointer */
-		desc->cursor += cnt;
-		if(end_pointer >= desc->cursor) {
-			break;
-		}
+static size_t tmpfs_read(struct file_desc *desc, void *buf, size_t size) {
+	ssize_t ret;
+
+	ret = tmpfs_pread(desc, buf, size, desc->cursor);
+	if (ret > 0) {
+		desc->cursor += ret;
 	}
 
-	return bytecount;
+	return ret;
 }
 
-
 static size_t tmpfs_write(struct file_desc *desc, void *buf, size_t size) {
-	tmpfs_file_info_t *fi;
-	size_t len;
-	size_t current, cnt;
-	uint32_t end_pointer;
-	blkno_t blk;
-	uint32_t bytecount;
-	uint32_t start_block;
+	ssize_t ret;
+
+	ret = tmpfs_pwrite(desc, buf, size, desc->cursor);
+	if (ret < 0) {
+		SET_ERRNO(-ret);
+		return 0;
+	}
+	desc->cursor += ret;
+
+	return ret;
+}
+
+/*
+ * The file range is returned as is if its pages are contiguous. Otherwise
+ * they are moved once to a contiguous chunk, so the mapping is shared with
+ * read()/write() afterwards. Once any page was handed out an earlier
+ * mapping may still use it, so pages are not moved any more and such a
+ * range can't be mapped. The mapping is valid until the range is
+ * truncated or the file is removed.
+ */
+static void *tmpfs_mmap(struct file_desc *desc, size_t len, off_t off) {
+	size_t first, n, i;
+	char *base, *page;
+	void **slot;
 	struct nas *nas;
 	struct tmpfs_fs_info *fsi;
+	struct tmpfs_file_info *fi;
 
 	nas = desc->node->nas;
-	fi = (tmpfs_file_info_t *)nas->fi->privdata;
+	fi = nas->fi->privdata;
 	fsi = nas->fs->fsi;
 
-	bytecount = 0;
+	if (len == 0 || off % PAGE_SIZE()
+			|| off + len > MAX_FILE_SIZE * PAGE_SIZE()) {
+		return NULL;
+	}
+	first = off / PAGE_SIZE();
+	n = (len + PAGE_SIZE() - 1) / PAGE_SIZE();
 
-	len = size;
-	end_pointer = desc->cursor + len;
-	start_block = fi->index * fsi->block_per_file;
+	mutex_lock(&fi->lock);
 
-	while(1) {
-		if(0 == fsi->block_size) {
-			break;
-		}
-		blk = desc->cursor / fsi->block_size;
-		/* check if block over the file */
-		if(blk >= fsi->block_per_file) {
-			bytecount = 0;
-			break;
-		}
-		else {
-			blk += start_block;
-		}
-		/* calculate pointer in scratch buffer */
-		current = desc->cursor % fsi->block_size;
-
-		/* set the counter how many bytes written in block */
-		if(end_pointer - desc->cursor > fsi->block_size) {
-			if(current) {
-				cnt = fsi->block_size - current;
-			}
-			else {
-				cnt = fsi->block_size;
-			}
-		}
-		else {
-			cnt = end_pointer - desc->cursor;
-			/* over the block ? */
-			if((current + cnt) > fsi->block_size) {
-				cnt -= (current + cnt) % fsi->block_size;
-			}
+	/* Populate holes */
+	for (i = 0; i < n; i++) {
+		if (!tmpfs_page_get(fsi, fi, first + i)) {
+			base = NULL;
+			goto out;
 		}
+	}
 
-		/* one 4096-bytes block read operation */
-		if(1 != tmpfs_read_sector(nas, sector_buff, 1, blk)) {
-			bytecount = 0;
+	base = tmpfs_page_lookup(fi, first);
+	for (i = 1; i < n; i++) {
+		if (tmpfs_page_lookup(fi, first + i) != base + i * PAGE_SIZE()) {
 			break;
 		}
-		/* set new data in block */
-		memcpy (sector_buff + current, buf, cnt);
+	}
+	if (i == n) {
+		fi->mapped = 1;
+		goto out;
+	}
+	if (fi->mapped) {
+		base = NULL;
+		goto out;
+	}
 
-		/* write one block to device */
-		if(1 != tmpfs_write_sector(nas, sector_buff, 1, blk)) {
-			bytecount = 0;
-			break;
-		}
-		bytecount += cnt;
-		/* shift the pointer */
-		desc->cursor += cnt;
-		if(end_pointer <= desc->cursor) {
-			break;
-		}
+	/* Pages are freed one by one later, page allocator allows that */
+	mutex_lock(&fsi->lock);
+	if (fsi->used_pages + n > fsi->max_pages) {
+		mutex_unlock(&fsi->lock);
+		base = NULL;
+		goto out;
 	}
-	/* if we write over the last EOF, set new filelen */
-	if (nas->fi->ni.size < desc->cursor) {
-		nas->fi->ni.size = desc->cursor;
+	fsi->used_pages += n;
+	mutex_unlock(&fsi->lock);
+
+	if (NULL == (base = phymem_alloc(n))) {
+		mutex_lock(&fsi->lock);
+		fsi->used_pages -= n;
+		mutex_unlock(&fsi->lock);
+		goto out;
 	}
 
-	return bytecount;
-}
+	for (i = 0; i < n; i++) {
+		slot = tmpfs_page_slot(fsi, fi, first + i, 0);
+		page = *slot;
+		memcpy(base + i * PAGE_SIZE(), page, PAGE_SIZE());
+		*slot = base + i * PAGE_SIZE();
+		tmpfs_page_free(fsi, page);
+	}
+	fi->mapped = 1;
 
+out:
+	mutex_unlock(&fi->lock);
+	return base;
+}
 
-/*
-static int tmpfs_seek(void *file, long offset, int whence);
-static int tmpfs_stat(void *file, void *buff);
+/* As tmpfs_mmap, but holes are not filled and pages are not moved */
+static void *tmpfs_lookup(struct file_desc *desc, size_t len, off_t off) {
+	size_t first, n, i;
+	char *base;
+	struct tmpfs_file_info *fi;
 
-static int tmpfs_fseek(void *file, long offset, int whence) {
-	struct file_desc *desc;
-	tmpfs_file_info_t *fi;
-	uint32_t curr_offset;
+	fi = desc->node->nas->fi->privdata;
 
-	curr_offset = offset;
+	if (len == 0 || off % PAGE_SIZE()
+			|| off + len > MAX_FILE_SIZE * PAGE_SIZE()) {
+		return NULL;
+	}
+	first = off / PAGE_SIZE();
+	n = (len + PAGE_SIZE() - 1) / PAGE_SIZE();
 
-	desc = (struct file_desc *) file;
-	fi = (tmpfs_file_info_t *)desc->node->fi;
+	mutex_lock(&fi->lock);
 
-	switch (whence) {
-	case SEEK_SET:
-		break;
-	case SEEK_CUR:
-		curr_offset += fi->pointer;
-		break;
-	case SEEK_END:
-		curr_offset = fi->filelen + offset;
-		break;
-	default:
-		return -1;
+	base = tmpfs_page_lookup(fi, first);
+	for (i = 1; base && i < n; i++) {
+		if (tmpfs_page_lookup(fi, first + i) != base + i * PAGE_SIZE()) {
+			base = NULL;
+		}
 	}
-
-	if (curr_offset > fi->filelen) {
-		curr_offset = fi->filelen;
+	if (base) {
+		fi->mapped = 1;
 	}
-	fi->pointer = curr_offset;
-	return 0;
-}
-static int tmpfs_stat(void *file, void *buff) {
-	struct file_desc *desc;
-	tmpfs_file_info_t *fi;
-	struct stat *buffer;
-
-	desc = (struct file_desc *) file;
-	fi = (tmpfs_file_info_t *)desc->node->fi;
-	buffer = (struct stat *) buff;
-
-	if (buffer) {
-			memset(buffer, 0, sizeof(struct stat));
-
-			buffer->st_mode = fi->mode;
-			buffer->st_ino = fi->index;
-			buffer->st_nlink = 1;
-			buffer->st_dev = *(int *) fsi->bdev;
-			buffer->st_atime = buffer->st_mtime = buffer->st_ctime = 0;
-			buffer->st_size = fi->filelen;
-			buffer->st_blksize = fsi->block_size;
-			buffer->st_blocks = fsi->numblocks;
-		}
 
-	return fi->filelen;
+	mutex_unlock(&fi->lock);
+	return base;
 }
-*/
-
 
 static int tmpfs_init(void * par);
 static int tmpfs_format(void *path);
@@ -395,6 +522,7 @@ static struct fs_driver tmpfs_driver = {
 	.name = TMPFS_NAME,
 	.file_op = &tmpfs_fop,
 	.fsop = &tmpfs_fsop,
+	.mount_dev_by_string = true,
 };
 
 static tmpfs_file_info_t *tmpfs_create_file(struct nas *nas) {
@@ -412,7 +540,9 @@ static tmpfs_file_info_t *tmpfs_create_file(struct nas *nas) {
 		return NULL;
 	}
 
+	memset(fi, 0, sizeof(*fi));
 	fi->index = fi_index;
+	mutex_init(&fi->lock);
 	nas->fi->ni.size = 0;
 
 	return fi;
@@ -442,6 +572,7 @@ static int tmpfs_delete(struct node *node) {
 	fi = nas->fi->privdata;
 
 	if (!node_is_directory(node)) {
+		tmpfs_file_trim(nas->fs->fsi, fi, 0);
 		index_free(&tmpfs_file_idx, fi->index);
 		pool_free(&tmpfs_file_pool, fi);
 	}
@@ -453,57 +584,39 @@ static int tmpfs_delete(struct node *node) {
 
 static int tmpfs_truncate(struct node *node, off_t length) {
 	struct nas *nas = node->nas;
+	struct tmpfs_file_info *fi = nas->fi->privdata;
 
 	if (length > MAX_FILE_SIZE * PAGE_SIZE()) {
 		return -EFBIG;
 	}
 
+	if (length < nas->fi->ni.size) {
+		mutex_lock(&fi->lock);
+		tmpfs_file_trim(nas->fs->fsi, fi, length);
+		mutex_unlock(&fi->lock);
+	}
 	nas->fi->ni.size = length;
 
 	return 0;
 }
 
 static int tmpfs_format(void *dev) {
-	node_t *dev_node;
-	struct nas *dev_nas;
-	struct node_fi *dev_fi;
-
-	if (NULL == (dev_node = dev)) {
-		return -ENODEV;/*device not found*/
-	}
-
-	if(!node_is_block_dev(dev_node)) {
-		return -ENODEV;
-	}
-	dev_nas = dev_node->nas;
-	dev_fi = dev_nas->fi;
-
-	if(MAX_FILE_SIZE > block_dev(dev_fi->privdata)->size / PAGE_SIZE()) {
-		return -ENOSPC;
-	}
+	/* Nothing to format, pages are allocated on demand */
 	return 0;
 }
 
 static int tmpfs_mount(void *dev, void *dir) {
-	struct node *dir_node, *dev_node;
-	struct nas *dir_nas, *dev_nas;
+	struct node *dir_node;
+	struct nas *dir_nas;
 	struct tmpfs_file_info *fi;
 	struct tmpfs_fs_info *fsi;
-	struct node_fi *dev_fi;
 
-	dev_node = dev;
-	dev_nas = dev_node->nas;
 	dir_node = dir;
 	dir_nas = dir_node->nas;
 
-	if (NULL == (dev_fi = dev_nas->fi)) {
-		return -ENODEV;
-	}
-
 	if (NULL == (dir_nas->fs = filesystem_create("tmpfs"))) {
 		return -ENOMEM;
 	}
-	dir_nas->fs->bdev = dev_fi->privdata;
 
 	/* allocate this fs info */
 	if(NULL == (fsi = pool_alloc(&tmpfs_fs_pool))) {
@@ -511,18 +624,19 @@ static int tmpfs_mount(void *dev, void *dir) {
 		return -ENOMEM;
 	}
 	memset(fsi, 0, sizeof(struct tmpfs_fs_info));
+	fsi->max_pages = FILESYSTEM_SIZE;
+	mutex_init(&fsi->lock);
 	dir_nas->fs->fsi = fsi;
 
-	fsi->block_per_file = MAX_FILE_SIZE;
-	fsi->block_size = PAGE_SIZE();
-	fsi->numblocks = block_dev(dev_fi->privdata)->size / PAGE_SIZE();
-
 	/* allocate this directory info */
 	if(NULL == (fi = pool_alloc(&tmpfs_file_pool))) {
+		pool_free(&tmpfs_fs_pool, fsi);
+		filesystem_free(dir_nas->fs);
 		return -ENOMEM;
 	}
 	memset(fi, 0, sizeof(struct tmpfs_file_info));
 	fi->index = fi->mode = 0;
+	mutex_init(&fi->lock);
 	dir_nas->fi->privdata = (void *) fi;
 
 	return 0;
@@ -9,8 +9,11 @@
 #ifndef TMPFS_H_
 #define TMPFS_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <kernel/thread/sync/mutex.h>
+
 /* DOS attribute bits  */
 #define ATTR_READ_ONLY	0x01
 #define ATTR_HIDDEN		0x02
@@ -22,14 +25,23 @@
 ATTR_VOLUME_ID)
 
 typedef struct tmpfs_fs_info {
-	uint32_t numblocks;			/* number of block in volume */
-	uint32_t block_size;		/* size of block */
-	uint32_t block_per_file;	/* max number of blocks filesize*/
+	size_t max_pages;           /* pages the mount is allowed to take */
+	size_t used_pages;          /* data and radix tree node pages in use */
+	struct mutex lock;          /* protects used_pages */
 } tmpfs_fs_info_t;
 
+/*
+ * File contents is a sparse radix tree of pages. A tree of height 0 is
+ * a single data page (or nothing), every level above is a page of
+ * pointers to the subtrees. Missing pages read as zeroes.
+ */
 typedef struct tmpfs_file_info {
 	int     index;		        /* number of file in FS*/
 	int     mode;				/* mode in which this file was opened */
+	void   *root;               /* radix tree of file pages */
+	int     height;             /* height of the tree */
+	struct mutex lock;          /* protects the tree */
+	int     mapped;             /* pages were handed out, don't move them */
 } tmpfs_file_info_t;
 
 
@@ -140,6 +140,13 @@ struct file_operations {
 	size_t (*read)(struct file *desc, void *buf, size_t size);
 	size_t (*write)(struct file *desc, void *buf, size_t size);
 	int    (*ioctl)(struct file *desc, int request, void *data);
+	/* Returns address of the file contents at @a off if they can be
+	 * accessed directly, NULL otherwise */
+	void  *(*mmap)(struct file *desc, size_t len, off_t off);
+	/* Optional. Read or write at @a off without touching the position,
+	 * return the number of bytes done or -errno */
+	ssize_t (*pread)(struct file *desc, void *buf, size_t size, off_t off);
+	ssize_t (*pwrite)(struct file *desc, void *buf, size_t size, off_t off);
 };
 
 struct dumb_fs_driver {
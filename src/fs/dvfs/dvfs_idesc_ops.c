@@ -24,35 +24,109 @@ static void idesc_file_ops_close(struct idesc *idesc) {
 }
 
 static ssize_t idesc_file_ops_read(struct idesc *idesc, const struct iovec *iov, int cnt) {
-	void *buf;
-	size_t nbyte;
+	ssize_t ret, done;
+	int i;
 
 	assert(idesc);
 	assert(idesc->idesc_ops == &idesc_file_ops);
 
 	assert(iov);
-	assert(cnt == 1);
 
-	buf = iov->iov_base;
-	nbyte = iov->iov_len;
-
-	return dvfs_read((struct file *) idesc, buf, nbyte);
+	for (i = 0, done = 0; i < cnt; i++) {
+		ret = dvfs_read((struct file *) idesc, iov[i].iov_base, iov[i].iov_len);
+		if (ret < 0) {
+			return done ? done : ret;
+		}
+		done += ret;
+		if (ret < iov[i].iov_len) {
+			break;
+		}
+	}
+
+	return done;
 }
 
 static ssize_t idesc_file_ops_write(struct idesc *idesc, const struct iovec *iov, int cnt) {
-	void *buf;
-	size_t nbyte;
+	ssize_t ret, done;
+	int i;
 
 	assert(idesc);
 	assert(idesc->idesc_ops == &idesc_file_ops);
 
 	assert(iov);
-	assert(cnt == 1);
 
-	buf = iov->iov_base;
-	nbyte = iov->iov_len;
+	for (i = 0, done = 0; i < cnt; i++) {
+		ret = dvfs_write((struct file *) idesc, iov[i].iov_base, iov[i].iov_len);
+		if (ret < 0) {
+			return done ? done : ret;
+		}
+		done += ret;
+		if (ret < iov[i].iov_len) {
+			break;
+		}
+	}
+
+	return done;
+}
+
+/* The position is shared with read() and lseek() of other threads, so
+ * only drivers that can do I/O at an offset support these */
+static ssize_t idesc_file_ops_preadv(struct idesc *idesc,
+		const struct iovec *iov, int cnt, off_t off) {
+	struct file *file = (struct file *) idesc;
+	ssize_t ret, done;
+	int i;
 
-	return dvfs_write((struct file *)idesc, (char *)buf, nbyte);
+	assert(idesc);
+	assert(idesc->idesc_ops == &idesc_file_ops);
+	assert(iov);
+
+	if (!file->f_ops || !file->f_ops->pread) {
+		return -ESPIPE;
+	}
+
+	for (i = 0, done = 0; i < cnt; i++) {
+		ret = file->f_ops->pread(file, iov[i].iov_base, iov[i].iov_len,
+				off + done);
+		if (ret < 0) {
+			return done ? done : ret;
+		}
+		done += ret;
+		if (ret < iov[i].iov_len) {
+			break;
+		}
+	}
+
+	return done;
+}
+
+static ssize_t idesc_file_ops_pwritev(struct idesc *idesc,
+		const struct iovec *iov, int cnt, off_t off) {
+	struct file *file = (struct file *) idesc;
+	ssize_t ret, done;
+	int i;
+
+	assert(idesc);
+	assert(idesc->idesc_ops == &idesc_file_ops);
+	assert(iov);
+
+	if (!file->f_ops || !file->f_ops->pwrite) {
+		return -ESPIPE;
+	}
+
+	for (i = 0, done = 0; i < cnt; i++) {
+		ret = file->f_ops->pwrite(file, iov[i].iov_base, iov[i].iov_len,
+				off + done);
+		if (ret < 0) {
+			return done ? done : ret;
+		}
+		done += ret;
+		if (ret < iov[i].iov_len) {
+			break;
+		}
+	}
+
+	return done;
 }
 
 static int idesc_file_ops_stat(struct idesc *idesc, void *buf) {
@@ -73,6 +147,20 @@ static int idesc_file_ops_status(struct idesc *idesc, int mask) {
 	return 1;
 }
 
+static void *idesc_file_ops_mmap(struct idesc *idesc, void *addr, size_t len,
+		int prot, int flags, int fd, off_t off) {
+	struct file *file = (struct file *) idesc;
+
+	assert(idesc);
+	assert(idesc->idesc_ops == &idesc_file_ops);
+
+	if (!file->f_ops->mmap) {
+		return NULL;
+	}
+
+	return file->f_ops->mmap(file, len, off);
+}
+
 const struct idesc_ops idesc_file_ops = {
 	.close = idesc_file_ops_close,
 	.id_readv  = idesc_file_ops_read,
@@ -80,5 +168,8 @@ const struct idesc_ops idesc_file_ops = {
 	.ioctl = idesc_file_ops_ioctl,
 	.fstat = idesc_file_ops_stat,
 	.status = idesc_file_ops_status,
+	.idesc_mmap = idesc_file_ops_mmap,
+	.id_preadv = idesc_file_ops_preadv,
+	.id_pwritev = idesc_file_ops_pwritev,
 };
 
@@ -5,16 +5,24 @@
  * @author: Anton Bondarev
  */
 
+#include <assert.h>
 #include <errno.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <util/dlist.h>
+#include <util/math.h>
 
+#include <framework/mod/options.h>
 #include <kernel/task.h>
 #include <kernel/task/resource/idesc_table.h>
+#include <mem/sysmalloc.h>
 #include <fs/idesc.h>
 
+#define SPLICE_BUF_SIZE OPTION_GET(NUMBER, splice_buf_size)
+
 int idesc_init(struct idesc *idesc, const struct idesc_ops *ops, mode_t amode) {
 
 	memset(idesc, 0, sizeof(struct idesc));
@@ -43,6 +51,112 @@ int idesc_close(struct idesc *idesc, int fd) {
 	return 0;
 }
 
+ssize_t idesc_splice_copy(struct idesc *in, off_t *off, struct idesc *out,
+		size_t count) {
+	struct iovec iov;
+	char *buf;
+	ssize_t done, rlen, wlen, ret;
+
+	assert(off ? in->idesc_ops->id_preadv != NULL
+			: in->idesc_ops->id_readv != NULL);
+	assert(out->idesc_ops->id_writev);
+
+	buf = sysmalloc(SPLICE_BUF_SIZE);
+	if (!buf) {
+		return -ENOMEM;
+	}
+
+	for (done = 0, ret = 0; done < count; done += rlen) {
+		iov.iov_base = buf;
+		iov.iov_len = min(count - done, (size_t) SPLICE_BUF_SIZE);
+		if (off) {
+			rlen = in->idesc_ops->id_preadv(in, &iov, 1, *off + done);
+		} else {
+			rlen = in->idesc_ops->id_readv(in, &iov, 1);
+		}
+		if (rlen <= 0) {
+			ret = rlen;
+			break;
+		}
+
+		for (wlen = 0; wlen < rlen; wlen += ret) {
+			iov.iov_base = buf + wlen;
+			iov.iov_len = rlen - wlen;
+			ret = out->idesc_ops->id_writev(out, &iov, 1);
+			if (ret <= 0) {
+				break;
+			}
+		}
+		if (wlen < rlen) {
+			/* What was read and not written is lost, as for write() */
+			done += wlen;
+			ret = ret ? ret : -EIO;
+			break;
+		}
+		ret = 0;
+	}
+
+	sysfree(buf);
+
+	if (off) {
+		*off += done;
+	}
+
+	return done ? done : ret;
+}
+
+ssize_t idesc_splice(struct idesc *in, off_t *off, struct idesc *out,
+		size_t count) {
+	ssize_t ret;
+
+	if (!idesc_check_mode(in, S_IROTH) || !idesc_check_mode(out, S_IWOTH)) {
+		return -EBADF;
+	}
+
+	if (in->idesc_ops->id_splice) {
+		ret = in->idesc_ops->id_splice(in, off, out, count);
+		if (ret != -ENOTSUP) {
+			return ret;
+		}
+	}
+
+	if (off && !in->idesc_ops->id_preadv) {
+		return -ESPIPE;
+	}
+
+	return idesc_splice_copy(in, off, out, count);
+}
+
+ssize_t idesc_preadv(struct idesc *idesc, const struct iovec *iov, int cnt,
+		off_t off) {
+	if (!idesc_check_mode(idesc, S_IROTH) || !idesc->idesc_ops->id_readv) {
+		return -EBADF;
+	}
+
+	if (off < 0) {
+		return idesc->idesc_ops->id_readv(idesc, iov, cnt);
+	}
+	if (!idesc->idesc_ops->id_preadv) {
+		return -ESPIPE;
+	}
+	return idesc->idesc_ops->id_preadv(idesc, iov, cnt, off);
+}
+
+ssize_t idesc_pwritev(struct idesc *idesc, const struct iovec *iov, int cnt,
+		off_t off) {
+	if (!idesc_check_mode(idesc, S_IWOTH) || !idesc->idesc_ops->id_writev) {
+		return -EBADF;
+	}
+
+	if (off < 0) {
+		return idesc->idesc_ops->id_writev(idesc, iov, cnt);
+	}
+	if (!idesc->idesc_ops->id_pwritev) {
+		return -ESPIPE;
+	}
+	return idesc->idesc_ops->id_pwritev(idesc, iov, cnt, off);
+}
+
 static int idesc_xattr_check(struct idesc *idesc) {
 	if (!idesc) {
 		return -EBADF;
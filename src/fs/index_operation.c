@@ -11,10 +11,18 @@
 #include <errno.h>
 #include <sys/uio.h>
 
+#include <util/math.h>
+
 #include <fs/kfile.h>
+#include <fs/file_operation.h>
+#include <fs/node.h>
+#include <mem/page.h>
 
 #include <fs/idesc.h>
 
+/* Longest run of adjacent pages given to a single write */
+#define SPLICE_WRITE_MAX 0x10000
+
 
 static void idesc_file_ops_close(struct idesc *idesc) {
 	assert(idesc);
@@ -23,33 +31,104 @@ static void idesc_file_ops_close(struct idesc *idesc) {
 }
 
 static ssize_t idesc_file_ops_read(struct idesc *idesc, const struct iovec *iov, int cnt) {
-	void *buf;
-	size_t nbyte;
+	ssize_t ret, done;
+	int i;
 
 	assert(idesc);
 	assert(iov);
-	assert(cnt == 1);
 
-	buf = iov->iov_base;
-	nbyte = iov->iov_len;
+	for (i = 0, done = 0; i < cnt; i++) {
+		ret = kread(iov[i].iov_base, iov[i].iov_len, (struct file_desc *)idesc);
+		if (ret < 0) {
+			return done ? done : ret;
+		}
+		done += ret;
+		if (ret < iov[i].iov_len) {
+			break;
+		}
+	}
 
-	return kread(buf, nbyte, (struct file_desc *)idesc);
+	return done;
 }
 
 static ssize_t idesc_file_ops_write(struct idesc *idesc, const struct iovec *iov, int cnt) {
-	void *buf;
-	size_t nbyte;
+	ssize_t ret, done;
+	int i;
 
 	assert(idesc);
 	assert(iov);
-	assert(cnt == 1);
 
-	buf = iov->iov_base;
-	nbyte = iov->iov_len;
+	for (i = 0, done = 0; i < cnt; i++) {
+		ret = kwrite(iov[i].iov_base, iov[i].iov_len, (struct file_desc *)idesc);
+		if (ret < 0) {
+			return done ? done : ret;
+		}
+		done += ret;
+		if (ret < iov[i].iov_len) {
+			break;
+		}
+	}
+
+	return done;
+}
+
+/* The cursor is shared with read() and lseek() of other threads, so only
+ * drivers that can do I/O at an offset support these */
+static ssize_t idesc_file_ops_preadv(struct idesc *idesc,
+		const struct iovec *iov, int cnt, off_t off) {
+	struct file_desc *desc = (struct file_desc *) idesc;
+	ssize_t ret, done;
+	int i;
+
+	assert(desc);
+	assert(iov);
+
+	if (!desc->ops->pread) {
+		return -ESPIPE;
+	}
+
+	for (i = 0, done = 0; i < cnt; i++) {
+		ret = desc->ops->pread(desc, iov[i].iov_base, iov[i].iov_len,
+				off + done);
+		if (ret < 0) {
+			return done ? done : ret;
+		}
+		done += ret;
+		if (ret < iov[i].iov_len) {
+			break;
+		}
+	}
 
-	return kwrite(buf, nbyte, (struct file_desc *)idesc);
+	return done;
 }
 
+static ssize_t idesc_file_ops_pwritev(struct idesc *idesc,
+		const struct iovec *iov, int cnt, off_t off) {
+	struct file_desc *desc = (struct file_desc *) idesc;
+	ssize_t ret, done;
+	int i;
+
+	assert(desc);
+	assert(iov);
+
+	if (!desc->ops->pwrite) {
+		return -ESPIPE;
+	}
+
+	for (i = 0, done = 0; i < cnt; i++) {
+		ret = desc->ops->pwrite(desc, iov[i].iov_base, iov[i].iov_len,
+				off + done);
+		if (ret < 0) {
+			return done ? done : ret;
+		}
+		done += ret;
+		if (ret < iov[i].iov_len) {
+			break;
+		}
+	}
+
+	return done;
+}
 
 static int idesc_file_ops_stat(struct idesc *idesc, void *buf) {
 	assert(idesc);
@@ -69,6 +148,116 @@ static int idesc_file_ops_status(struct idesc *idesc, int mask) {
 	return 1;
 }
 
+static void *idesc_file_ops_mmap(struct idesc *idesc, void *addr, size_t len,
+		int prot, int flags, int fd, off_t off) {
+	struct file_desc *desc = (struct file_desc *) idesc;
+
+	assert(desc);
+	assert(desc->ops);
+
+	if (!desc->ops->mmap) {
+		return NULL;
+	}
+
+	return desc->ops->mmap(desc, len, off);
+}
+
+/* Looks file contents up page by page and hands them to @a out as they
+ * are. Pages that happen to be adjacent go out in one write, so a socket
+ * gets full segments. Lookup doesn't fill holes, so reading a sparse file
+ * takes no memory; from the first hole on the rest is copied.
+ */
+static ssize_t idesc_file_ops_splice(struct idesc *idesc, off_t *off,
+		struct idesc *out, size_t count) {
+	struct file_desc *desc = (struct file_desc *) idesc;
+	struct iovec iov;
+	size_t size, pos, done, in_page, len;
+	off_t copied;
+	char *p;
+	ssize_t ret;
+
+	assert(desc);
+	assert(desc->ops);
+	assert(out->idesc_ops->id_writev);
+
+	pos = off ? *off : desc->cursor;
+	size = desc->node->nas->fi->ni.size;
+	if (pos >= size) {
+		return 0;
+	}
+	count = min(count, size - pos);
+
+	done = 0;
+	ret = 0;
+	iov.iov_base = NULL;
+	iov.iov_len = 0;
+	while (desc->ops->lookup && done + iov.iov_len < count) {
+		in_page = (pos + done + iov.iov_len) % PAGE_SIZE();
+		len = min(count - done - iov.iov_len, PAGE_SIZE() - in_page);
+
+		p = desc->ops->lookup(desc, in_page + len,
+				pos + done + iov.iov_len - in_page);
+		if (p && iov.iov_base + iov.iov_len == p + in_page
+				&& iov.iov_len < SPLICE_WRITE_MAX) {
+			iov.iov_len += len;
+			continue;
+		}
+
+		if (iov.iov_len) {
+			ret = out->idesc_ops->id_writev(out, &iov, 1);
+			if (ret <= 0) {
+				goto out;
+			}
+			done += ret;
+			if (ret < iov.iov_len) {
+				goto out;
+			}
+		}
+
+		if (!p) {
+			break;
+		}
+		iov.iov_base = p + in_page;
+		iov.iov_len = len;
+	}
+
+	if (iov.iov_len) {
+		ret = out->idesc_ops->id_writev(out, &iov, 1);
+		if (ret <= 0) {
+			goto out;
+		}
+		done += ret;
+		if (ret < iov.iov_len) {
+			goto out;
+		}
+	}
+
+	if (done < count) {
+		copied = pos + done;
+		if (desc->ops->pread) {
+			ret = idesc_splice_copy(idesc, &copied, out, count - done);
+		} else if (!off) {
+			/* Only mapped data was sent, the cursor is still at pos */
+			desc->cursor = copied;
+			ret = idesc_splice_copy(idesc, NULL, out, count - done);
+		} else {
+			ret = -ESPIPE;
+		}
+		if (ret > 0) {
+			done += ret;
+		}
+	}
+
+out:
+	if (off) {
+		*off = pos + done;
+	} else {
+		desc->cursor = pos + done;
+	}
+
+	return done ? done : ret;
+}
+
 const struct idesc_ops idesc_file_ops = {
 	.close = idesc_file_ops_close,
 	.id_readv  = idesc_file_ops_read,
@@ -76,5 +265,9 @@ const struct idesc_ops idesc_file_ops = {
 	.ioctl = idesc_file_ops_ioctl,
 	.fstat = idesc_file_ops_stat,
 	.status = idesc_file_ops_status,
+	.idesc_mmap = idesc_file_ops_mmap,
+	.id_splice = idesc_file_ops_splice,
+	.id_preadv = idesc_file_ops_preadv,
+	.id_pwritev = idesc_file_ops_pwritev,
 };
 
@@ -16,6 +16,7 @@
 #include <kernel/irq_lock.h>
 #include <kernel/thread/sync/mutex.h>
 #include <util/ring.h>
+#include <util/spsc_ring.h>
 
 #include <framework/mod/options.h>
 #include <module/embox/driver/tty/tty.h>
@@ -38,7 +39,9 @@ struct tty {
 
 	struct mutex      lock; /* serialize operations on tty, also used in pty */
 
-	struct ring       rx_ring;
+	/* Filled by tty_rx_locked() (usually from an interrupt), drained by
+	 * tty_read() under the lock, so it's lock-free */
+	struct spsc_ring  rx_ring;
 	uint16_t          rx_buff[TTY_RX_BUFF_SZ]; /* flag (MSB) and char (LSB) */
 
 	struct ring       i_ring;
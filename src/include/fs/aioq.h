@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @brief Asynchronous I/O through submission and completion queues
+ *
+ * The task puts requests (SQEs) into the submission ring of an aioq
+ * and hands all of them to the kernel with one aioq_submit(). Kernel
+ * workers run them through idesc, so files, sockets and pipes are all
+ * fine, and put results (CQEs) into the completion ring. aioq_reap()
+ * takes many completions at once, waiting for them if asked to.
+ *
+ * Both rings are plain memory shared by the task and the kernel. The
+ * submission ring is SPSC: requests are queued by one thread at a time.
+ * Completions may be reaped by any thread.
+ *
+ * Requests to the same descriptor are run one after another in the
+ * order they are submitted. A request that blocks, like a read from an
+ * idle socket, holds up the worker it's on, so keep aioq_workers above
+ * the number of such requests expected at once.
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef FS_AIOQ_H_
+#define FS_AIOQ_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <kernel/thread/ring_wait.h>
+#include <util/mpmc_ring.h>
+#include <util/spsc_ring.h>
+
+#define AIOQ_OP_NOP     0
+#define AIOQ_OP_READ    1  /* addr is a buffer of len bytes */
+#define AIOQ_OP_WRITE   2
+#define AIOQ_OP_READV   3  /* addr is an array of len iovecs */
+#define AIOQ_OP_WRITEV  4
+/* Completes after all requests to fd submitted before it */
+#define AIOQ_OP_FSYNC   5
+
+/** Submission queue entry */
+struct aioq_sqe {
+	uint8_t opcode;
+	int fd;
+	off_t off;           /**< Negative for the current position */
+	void *addr;
+	uint32_t len;
+	uint64_t user_data;  /**< Returned as is in the completion */
+};
+
+/** Completion queue entry */
+struct aioq_cqe {
+	uint64_t user_data;
+	int32_t res;         /**< As returned by read()/write(), or -errno */
+};
+
+struct aioq {
+	struct spsc_ring sq;
+	struct mpmc_ring cq;
+	struct ring_waitq cq_wait;
+	unsigned int inflight;  /**< Submitted and not completed */
+	unsigned int outstanding; /**< Submitted and not reaped */
+	void *storage;
+};
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/**
+ * @param entries Submission queue size, power of two. Completion queue
+ *    is twice as big, no more requests than that are submitted and not
+ *    reaped at once.
+ */
+extern struct aioq *aioq_create(unsigned int entries);
+
+/** @return -EBUSY if requests are still running */
+extern int aioq_destroy(struct aioq *q);
+
+/**
+ * Puts @a n requests into the submission ring, nothing runs yet.
+ * @return Number of requests queued
+ */
+extern unsigned int aioq_queue(struct aioq *q, const struct aioq_sqe *sqes,
+		unsigned int n);
+
+/**
+ * Hands the queued requests to the workers. Descriptors are looked up
+ * here, in the calling task. A request with a bad one completes at once
+ * with -EBADF.
+ * @return Number of requests taken from the submission ring
+ */
+extern int aioq_submit(struct aioq *q);
+
+/**
+ * Takes up to @a max completions, waiting for @a min of them at most
+ * @a timeout ms (SCHED_TIMEOUT_INFINITE to wait forever).
+ * @return Number of completions, or -ETIMEDOUT/-EINTR if there are none
+ */
+extern int aioq_reap(struct aioq *q, struct aioq_cqe *cqes, unsigned int min,
+		unsigned int max, int timeout);
+
+__END_DECLS
+
+#endif /* FS_AIOQ_H_ */
@@ -28,4 +28,11 @@ static inline void bcache_buffer_unlock(struct buffer_head *bh) {
  */
 extern struct buffer_head *bcache_getblk_locked(struct block_dev *bdev, int block, size_t size);
 
+/**
+ * @return
+ *   Non-zero if block @a block of device @a bdev is present in the cache.
+ *   Nothing is allocated, block state may change right after the call.
+ */
+extern int bcache_cached(struct block_dev *bdev, int block);
+
 #endif /* FS_BCACHE_H_ */
@@ -570,6 +570,12 @@ typedef struct ext2_file_info {
 	int32_t		f_ind_cache_block;
 	int32_t		f_ind_cache[IND_CACHE_SZ];
 
+	/* Last found run of contiguous blocks: file blocks starting from
+	 * f_map_lblk lie on the disk starting from f_map_pblk */
+	int32_t		f_map_lblk;
+	uint32_t	f_map_pblk;
+	uint32_t	f_map_len;
+
 	char		*f_buf;		/* buffer for data block */
 	size_t		f_buf_size;	/* size of data block */
 	int64_t		f_buf_blkno;/* block number of data block */
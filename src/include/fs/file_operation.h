@@ -10,6 +10,7 @@
 #define FS_FILE_OPERATION_H_
 
 #include <stddef.h>
+#include <sys/types.h>
 
 struct node;
 struct file_desc;
@@ -20,6 +21,16 @@ struct file_operations {
 	size_t (*read)(struct file_desc *desc, void *buf, size_t size);
 	size_t (*write)(struct file_desc *desc, void *buf, size_t size);
 	int    (*ioctl)(struct file_desc *desc, int request, void *data);
+	/* Returns address of the file contents at @a off if they can be
+	 * accessed directly, NULL otherwise */
+	void  *(*mmap)(struct file_desc *desc, size_t len, off_t off);
+	/* Optional. As mmap, but only for contents that are already in memory:
+	 * never allocates, returns NULL for a hole */
+	void  *(*lookup)(struct file_desc *desc, size_t len, off_t off);
+	/* Optional. Read or write at @a off without touching the cursor,
+	 * return the number of bytes done or -errno */
+	ssize_t (*pread)(struct file_desc *desc, void *buf, size_t size, off_t off);
+	ssize_t (*pwrite)(struct file_desc *desc, void *buf, size_t size, off_t off);
 };
 
 #endif /* FS_FILE_OPERATION_H_ */
@@ -37,6 +37,17 @@ struct idesc_ops {
 	int (*status)(struct idesc *idesc, int mask);
 	void *(*idesc_mmap)(struct idesc *idesc, void *addr, size_t len, int prot,
 			int flags, int fd, off_t off);
+	/* Optional. Sends up to @a count bytes starting at @a *off, or at the
+	 * current position if @a off is NULL, to @a out without a bounce
+	 * buffer. -ENOTSUP makes idesc_splice() copy instead */
+	ssize_t (*id_splice)(struct idesc *idesc, off_t *off, struct idesc *out,
+			size_t count);
+	/* Optional, only for seekable ones. Read or write at @a off and leave
+	 * the current position as it was */
+	ssize_t (*id_preadv)(struct idesc *idesc, const struct iovec *iov,
+			int cnt, off_t off);
+	ssize_t (*id_pwritev)(struct idesc *idesc, const struct iovec *iov,
+			int cnt, off_t off);
 };
 
 struct idesc_xattrops {
@@ -66,6 +77,32 @@ extern int idesc_removexattr(struct idesc *idesc, const char *name);
 
 extern int idesc_close(struct idesc *idesc, int fd);
 
+/**
+ * Moves up to @a count bytes from @a in to @a out inside the kernel. Uses
+ * id_splice of @a in if there is one, copies through a kernel buffer
+ * otherwise. @a off may be non-NULL only if @a in supports it.
+ *
+ * @return Bytes moved, 0 at the end of @a in, or -errno
+ */
+extern ssize_t idesc_splice(struct idesc *in, off_t *off, struct idesc *out,
+		size_t count);
+
+/**
+ * Copying part of idesc_splice(). Reads @a in at @a *off with id_preadv
+ * and advances @a *off, or at its current position if @a off is NULL.
+ */
+extern ssize_t idesc_splice_copy(struct idesc *in, off_t *off,
+		struct idesc *out, size_t count);
+
+/**
+ * Vectored I/O at @a off, or at the current position if @a off is
+ * negative. Positioned I/O fails with -ESPIPE if @a idesc can't seek.
+ */
+extern ssize_t idesc_preadv(struct idesc *idesc, const struct iovec *iov,
+		int cnt, off_t off);
+extern ssize_t idesc_pwritev(struct idesc *idesc, const struct iovec *iov,
+		int cnt, off_t off);
+
 __END_DECLS
 
 #endif /* FS_IDESC_H_ */
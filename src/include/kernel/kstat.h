@@ -0,0 +1,40 @@
+/**
+ * @file
+ * @brief Kernel statistics counters
+ *
+ * Statistics are defined in the file using them:
+ *
+ *   KSTAT_COUNTER_DEF(sched_switches, "sched/switches");
+ *   ...
+ *   kstat_inc(&sched_switches);
+ *
+ * Per-CPU values are summed up only when the statistic is read. With
+ * embox.kernel.kstat.kstat_none implementation selected (the default)
+ * everything compiles out.
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef KERNEL_KSTAT_H_
+#define KERNEL_KSTAT_H_
+
+#include <module/embox/kernel/kstat/kstat_api.h>
+
+/** Defines increment-only counter named @a name */
+#define KSTAT_COUNTER_DEF(counter, name) \
+	__KSTAT_COUNTER_DEF(counter, name)
+
+/** Defines histogram with power of two buckets named @a name */
+#define KSTAT_HIST_DEF(hist, name) \
+	__KSTAT_HIST_DEF(hist, name)
+
+#define kstat_add(counter, n) \
+	__kstat_add(counter, n)
+
+#define kstat_inc(counter) \
+	__kstat_add(counter, 1)
+
+#define kstat_hist_add(hist, val) \
+	__kstat_hist_add(hist, val)
+
+#endif /* KERNEL_KSTAT_H_ */
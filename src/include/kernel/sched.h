@@ -17,6 +17,7 @@
 
 #include <kernel/sched/sched_lock.h>
 #include <kernel/sched/sched_timing.h>
+#include <kernel/sched/sched_latency.h>
 #include <kernel/sched/affinity.h>
 #include <kernel/sched/schedee_priority.h>
 
@@ -69,6 +70,7 @@ struct schedee {
 
 	struct affinity         affinity;
 	struct sched_timing     sched_timing;
+	struct sched_latency    sched_latency;
 	struct schedee_priority priority;
 
 	struct waitq_link waitq_link; /**< Used as a link in different waitqs. */
@@ -0,0 +1,61 @@
+/**
+ * @file
+ * @brief Scheduling latency accounting
+ *
+ * Every time a schedee gets a CPU the scheduler accounts how long it has
+ * been sitting in the runq (run delay). If it was queued by a wake up, the
+ * same interval is also put into the wake up latency histogram.
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef SCHED_LATENCY_H_
+#define SCHED_LATENCY_H_
+
+#include <stdint.h>
+
+/* Bucket 0 counts latencies below 1us, bucket i counts [2^(i-1), 2^i) us,
+ * the last one counts everything above */
+#define SCHED_LATENCY_BUCKETS 16
+
+struct sched_latency_stat {
+	unsigned long runs;     /**< Times the CPU was got from the runq. */
+	unsigned long wakeups;  /**< Of them after a wake up. */
+	uint64_t delay_total;   /**< Total time spent in the runq, ns. */
+	uint32_t delay_max;     /**< ns */
+	uint32_t wakeup_max;    /**< ns */
+	unsigned long hist[SCHED_LATENCY_BUCKETS]; /**< Wake up latencies. */
+};
+
+#include <module/embox/kernel/sched/latency/latency.h>
+
+struct schedee;
+
+extern void sched_latency_init(struct schedee *s);
+
+/** Called with runq locked when @p s is put into the runq. */
+extern void sched_latency_ready(struct schedee *s, int wakeup);
+
+/** Called with IRQs off when @p s is switched to. */
+extern void sched_latency_run(struct schedee *s);
+
+/**
+ * Copies statistics of @p s.
+ * @return -ENOSYS if latency accounting is disabled.
+ */
+extern int sched_latency_get(struct schedee *s,
+		struct sched_latency_stat *stat);
+
+/**
+ * Copies statistics accumulated by all schedees of the priority @p group.
+ * Group i contains priorities starting from
+ * i * SCHED_PRIORITY_TOTAL / sched_latency_prio_groups().
+ */
+extern int sched_latency_prio_get(int group, struct sched_latency_stat *stat);
+
+extern int sched_latency_prio_groups(void);
+
+/** Resets per-priority statistics. Per-schedee ones live as long as schedee. */
+extern void sched_latency_reset(void);
+
+#endif /* SCHED_LATENCY_H_ */
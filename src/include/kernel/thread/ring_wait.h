@@ -0,0 +1,130 @@
+/**
+ * @file
+ * @brief Blocking enqueue/dequeue on lock-free rings
+ *
+ * The rings themselves never sleep. These wrappers put the thread on a
+ * waitq until the ring has room (or data) and wake the other side after
+ * moving elements. Producers in interrupt handlers use the _notify
+ * variants, which never block.
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef KERNEL_THREAD_RING_WAIT_H_
+#define KERNEL_THREAD_RING_WAIT_H_
+
+#include <kernel/sched/waitq.h>
+#include <kernel/thread/waitq.h>
+#include <util/mpmc_ring.h>
+#include <util/spsc_ring.h>
+
+struct ring_waitq {
+	struct waitq not_empty;
+	struct waitq not_full;
+};
+
+#define RING_WAITQ_INIT(rwq) { \
+	.not_empty = WAITQ_INIT(rwq.not_empty), \
+	.not_full = WAITQ_INIT(rwq.not_full), \
+}
+
+static inline void ring_waitq_init(struct ring_waitq *rwq) {
+	waitq_init(&rwq->not_empty);
+	waitq_init(&rwq->not_full);
+}
+
+/* All of them return the number of elements moved, or -ETIMEDOUT or
+ * -EINTR if nothing could be moved. Blocking ones return as soon as
+ * some elements are moved, not necessarily all @a n. @a timeout is in ms. */
+
+static inline int spsc_ring_enqueue_notify(struct spsc_ring *r,
+		struct ring_waitq *rwq, const void *elems, unsigned int n) {
+	unsigned int cnt;
+
+	cnt = spsc_ring_enqueue(r, elems, n);
+	if (cnt) {
+		waitq_wakeup_all(&rwq->not_empty);
+	}
+	return cnt;
+}
+
+static inline int spsc_ring_enqueue_wait(struct spsc_ring *r,
+		struct ring_waitq *rwq, const void *elems, unsigned int n,
+		int timeout) {
+	int ret;
+
+	ret = WAITQ_WAIT_TIMEOUT(&rwq->not_full, spsc_ring_space(r), timeout);
+	if (ret) {
+		return ret;
+	}
+	return spsc_ring_enqueue_notify(r, rwq, elems, n);
+}
+
+static inline int spsc_ring_dequeue_wait(struct spsc_ring *r,
+		struct ring_waitq *rwq, void *elems, unsigned int n, int timeout) {
+	unsigned int cnt;
+	int ret;
+
+	ret = WAITQ_WAIT_TIMEOUT(&rwq->not_empty, !spsc_ring_empty(r), timeout);
+	if (ret) {
+		return ret;
+	}
+
+	cnt = spsc_ring_dequeue(r, elems, n);
+	if (cnt) {
+		waitq_wakeup_all(&rwq->not_full);
+	}
+	return cnt;
+}
+
+static inline int mpmc_ring_enqueue_notify(struct mpmc_ring *r,
+		struct ring_waitq *rwq, const void *elems, unsigned int n) {
+	unsigned int cnt;
+
+	cnt = mpmc_ring_enqueue(r, elems, n);
+	if (cnt) {
+		waitq_wakeup_all(&rwq->not_empty);
+	}
+	return cnt;
+}
+
+static inline int mpmc_ring_enqueue_wait(struct mpmc_ring *r,
+		struct ring_waitq *rwq, const void *elems, unsigned int n,
+		int timeout) {
+	int cnt, ret;
+
+	/* Room seen by the condition may be taken by another producer */
+	do {
+		ret = WAITQ_WAIT_TIMEOUT(&rwq->not_full, mpmc_ring_can_enqueue(r),
+				timeout);
+		if (ret) {
+			return ret;
+		}
+		cnt = mpmc_ring_enqueue_notify(r, rwq, elems, n);
+	} while (!cnt);
+
+	return cnt;
+}
+
+static inline int mpmc_ring_dequeue_wait(struct mpmc_ring *r,
+		struct ring_waitq *rwq, void *elems, unsigned int n, int timeout) {
+	unsigned int cnt;
+	int ret;
+
+	/* An element may be taken by another consumer. A claimed slot that
+	 * isn't filled yet doesn't satisfy the condition, so this sleeps
+	 * rather than spins until its producer notifies */
+	do {
+		ret = WAITQ_WAIT_TIMEOUT(&rwq->not_empty, mpmc_ring_can_dequeue(r),
+				timeout);
+		if (ret) {
+			return ret;
+		}
+		cnt = mpmc_ring_dequeue(r, elems, n);
+	} while (!cnt);
+
+	waitq_wakeup_all(&rwq->not_full);
+	return cnt;
+}
+
+#endif /* KERNEL_THREAD_RING_WAIT_H_ */
@@ -0,0 +1,54 @@
+/**
+ * @file
+ * @brief Reassembly of IPv4 and IPv6 fragments
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef NET_L3_INET_FRAG_H_
+#define NET_L3_INET_FRAG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+struct sk_buff;
+
+/**
+ * Datagram the fragment belongs to
+ */
+struct inet_frag_key {
+	int family;      /* AF_INET or AF_INET6 */
+	union {
+		struct in_addr in;
+		struct in6_addr in6;
+	} saddr, daddr;
+	uint32_t id;
+	uint8_t proto;   /* Protocol of the datagram's payload */
+};
+
+/**
+ * Fragment to add
+ */
+struct inet_frag_info {
+	unsigned int offset;  /* Of the data in the datagram */
+	unsigned int len;     /* Of the data */
+	size_t data_off;      /* Of the data from skb->mac.raw */
+	size_t hdr_len;       /* Headers of the datagram from skb->mac.raw */
+	int last;             /* No more fragments after this one */
+};
+
+/**
+ * Queues the fragment @a skb of the datagram @a key
+ *
+ * Overlapping fragments drop the whole datagram (RFC 5722), a duplicate
+ * is dropped alone.
+ *
+ * @return Complete datagram or NULL. Its headers are @c hdr_len bytes of
+ *    the first fragment, skb->h.raw points past them, the caller fixes
+ *    their lengths and flags.
+ */
+extern struct sk_buff *inet_frag_add(const struct inet_frag_key *key,
+		struct sk_buff *skb, const struct inet_frag_info *info);
+
+#endif /* NET_L3_INET_FRAG_H_ */
@@ -11,11 +11,6 @@
 #include <stdint.h>
 #include <net/skbuff.h>
 
-/* 1 second - Minimum Segment Lifetime. Just some suitable constant,
- * not from any document */
-#define   MSL          1
-
-
 struct sk_buff;
 
 /**
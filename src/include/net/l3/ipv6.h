@@ -39,10 +39,31 @@ typedef struct ip6hdr {
 
 #define IP6_HEADER_SIZE   (sizeof(struct ip6hdr))
 
+/* Next header values of extension headers */
+#define IP6_NEXTHDR_FRAGMENT 44
+
+/**
+ * Fragment header (RFC 8200, 4.5)
+ */
+typedef struct ip6_frag_hdr {
+	__u8 nexthdr;
+	__u8 reserved;
+	__be16 frag_off;  /* Offset in 8 bytes units and flags */
+	__be32 identification;
+} __attribute__((packed)) ip6_frag_hdr_t;
+
+#define IP6_FRAG_MF     0x0001 /* More fragments */
+#define IP6_FRAG_OFFSET 0xfff8 /* Offset in bytes */
+
 static inline ip6hdr_t *ip6_hdr(const struct sk_buff *skb) {
 	return skb->nh.ip6h;
 }
 
+/**
+ * Takes a fragment, returns the reassembled datagram or NULL
+ */
+extern struct sk_buff *ip6_defrag(struct sk_buff *skb);
+
 struct net_pack_out_ops;
 /**
  * IPV6 packet outgoing options
@@ -17,6 +17,7 @@
 
 #include <linux/types.h>
 #include <linux/list.h>
+#include <kernel/time/timer.h>
 #include <net/socket/inet_sock.h>
 #include <net/socket/inet6_sock.h>
 
@@ -73,6 +74,22 @@ enum tcp_sock_state {
 	TCP_MAX_STATE
 };
 
+struct tcp_cong_ops;
+struct tcp_listen;
+
+/* Timers of a socket, multiplexed on the one sys_timer */
+enum tcp_timer {
+	TCP_TIMER_REXMIT,    /* Retransmission, handshake timeout */
+	TCP_TIMER_PERSIST,   /* Zero window probes */
+	TCP_TIMER_KEEPALIVE,
+	TCP_TIMER_DELACK,    /* Delayed ACK */
+	TCP_TIMER_CORK,      /* Limit of holding back a small segment */
+	TCP_TIMER_MAX
+};
+
+/* Private state of the congestion control algorithm, see tcp_cong.h */
+#define TCP_CONG_PRIV_SIZE 32
+
 struct tcp_wind {
 	uint16_t value;
 	uint8_t factor;
@@ -91,21 +108,59 @@ typedef struct tcp_sock {
 	struct tcp_seq_state rem;   /* Informations about remote socket */
 	uint32_t last_ack;          /* Last acknowledged sequence number */
 	uint32_t ack_flag;          /* Acknowledgment for flags (SYN or FIN) */
-	struct tcp_sock *parent;    /* Listening socket to which it belongs */
-	union {
-		struct list_head conn_lnk;   /* Link for conn_xxx lists */
-		struct list_head conn_ready; /* Queue of incoming ready connections */
-	};
-	struct list_head conn_wait; /* Queue of incoming waiting connections */
-	struct list_head conn_free; /* Queue of free sockets for incoming connections */
-	unsigned int free_wait_queue_len; /* @a conn_wait length plus @a conn_free length */
-	unsigned int free_wait_queue_max; /* Maximum @a conn_wait length plus @a conn_free length */
+	struct tcp_sock *parent;    /* Listener while in its accept queue */
+	struct tcp_listen *listen;  /* SYN and accept queues of a listener */
 	unsigned int lock;          /* Tool for synchronization */
 	struct timeval syn_time;    /* The time when synchronization started */
-	struct timeval ack_time;    /* The time when message was ACKed */
-	struct timeval rcv_time;    /* The time when last message was received (ONLY FOR TCP_TIMEWAIT) */
+	struct timeval rcv_time;    /* The time when last message was received */
 	unsigned int dup_ack;       /* Amount of duplicated packets */
 	unsigned int rexmit_mode;   /* Socket in rexmit mode */
+	/* RTT estimation (RFC 6298) */
+	uint32_t srtt;              /* Smoothed RTT in us, zero until the first sample */
+	uint32_t rttvar;            /* RTT variation in us */
+	uint32_t rto;               /* Retransmission timeout in ms */
+	uint32_t rtt_seq;           /* ACK of it ends the timed segment */
+	struct timeval rtt_time;    /* When the timed segment was sent */
+	unsigned int rtt_timing;    /* A segment is being timed */
+	/* Congestion control, in bytes */
+	uint32_t mss;               /* Remote maximum segment size */
+	uint32_t cwnd;              /* Congestion window */
+	uint32_t ssthresh;          /* Slow start threshold */
+	uint32_t cwnd_acked;        /* ACKed towards the next increase in avoidance */
+	uint32_t recover;           /* self.seq when loss recovery started */
+	const struct tcp_cong_ops *cong; /* Congestion control algorithm */
+	uint64_t cong_priv[TCP_CONG_PRIV_SIZE / sizeof(uint64_t)];
+	/* Timers */
+	struct sys_timer timer;     /* Started for the earliest armed timer */
+	uint32_t timer_expires;     /* When @a timer fires, in ms of tcp_now() */
+	uint32_t timer_due[TCP_TIMER_MAX];
+	unsigned int timer_armed;   /* Bit per enum tcp_timer */
+	unsigned int probes;        /* Unanswered zero window probes */
+	unsigned int keep_probes;   /* Unanswered keepalive probes */
+	uint32_t keep_idle;         /* Seconds of silence before keepalive probes */
+	uint32_t keep_intvl;        /* Seconds between keepalive probes */
+	uint32_t keep_cnt;          /* Probes before the connection is dropped */
+	/* Options agreed in SYN (RFC 7323, RFC 2018) */
+	unsigned int opt_flags;     /* TCP_OPT_F_xxx */
+	uint32_t ts_recent;         /* Timestamp of the peer to echo */
+	/* Receive side */
+	struct sk_buff_head ofo_queue; /* Segments after a hole, sorted by seq */
+	uint32_t ofo_len;           /* Data bytes in @a ofo_queue */
+	uint32_t ofo_recent;        /* seq of the latest segment put to @a ofo_queue */
+	uint32_t rcv_buf;           /* Receive buffer, the window is its free part */
+	uint32_t rcv_adv;           /* Right edge of the advertised window */
+	uint32_t rcv_mss;           /* Largest segment received */
+	uint32_t rcv_rtt;           /* RTT seen by the receiver through timestamps, us */
+	uint32_t rcv_copied;        /* Read by the application since @a rcv_space_time */
+	struct timeval rcv_space_time; /* Start of the receive buffer measurement */
+	/* Delayed ACK (RFC 1122) */
+	uint32_t ack_pending;       /* Bytes received, but not ACKed yet */
+	unsigned int quickack;      /* ACKs to send without delay */
+	/* Coalescing of small writes (RFC 896) */
+	unsigned int nodelay;       /* TCP_NODELAY, Nagle's algorithm is off */
+	unsigned int cork;          /* TCP_CORK, only full segments are sent */
+	struct sk_buff *tx_unsent;  /* Segment held back, not in tx_queue yet */
+	unsigned int tx_unsent_corked; /* Held by cork or MSG_MORE, not by Nagle */
 } tcp_sock_t;
 
 static inline struct tcp_sock * to_tcp_sock(
@@ -114,28 +169,55 @@ static inline struct tcp_sock * to_tcp_sock(
 }
 
 enum {
+	TCP_OPT_KIND_EOL  = 0, /* End of option list */
 	TCP_OPT_KIND_NOP  = 1, /* No-Operation */
 	TCP_OPT_KIND_MSS  = 2, /* Maximum segment size */
 	TCP_OPT_KIND_WS   = 3, /* Window scale */
 	TCP_OPT_KIND_SACK = 4, /* SACK Permission */
+	TCP_OPT_KIND_SACK_BLOCK = 5, /* SACK blocks */
 	TCP_OPT_KIND_TS   = 8  /* Timestamp */
 };
 
+/* Options of the connection agreed in SYN */
+#define TCP_OPT_F_WS    0x01 /* Window scale */
+#define TCP_OPT_F_SACK  0x02 /* Selective acknowledgments */
+#define TCP_OPT_F_TS    0x04 /* Timestamps */
+
+#define TCP_OPT_LEN_TS        12 /* NOP, NOP, timestamps */
+#define TCP_SACK_BLOCKS_MAX    4 /* Fit 40 bytes of options */
+
 /* Delays in milliseconds */
-#define TCP_TIMER_FREQUENCY   1000  /* Frequency for tcp_tmr_default */
+#define TCP_TIMER_GRANULARITY   10  /* Least delay of the socket timer */
 #define TCP_TIMEWAIT_DELAY    2000  /* Delay for TIME-WAIT state */
-#define TCP_REXMIT_DELAY      2000  /* Delay between rexmitting */
 #define TCP_SYNC_TIMEOUT      5000  /* Synchronization timeout */
+#define TCP_COOKIE_PERIOD    64000  /* Time counter of SYN cookies ticks */
+#define TCP_RTO_INIT          1000  /* RTO before the first RTT sample */
+#define TCP_RTO_MIN            200  /* RFC 6298 says 1 s, Linux uses 200 ms */
+#define TCP_RTO_MAX          60000
+#define TCP_DELACK_DELAY        40  /* RFC 1122 allows up to 500 ms */
+#define TCP_CORK_DELAY         200  /* Corked data is sent anyway after it */
+
+#define TCP_REXMIT_DUP_ACK       3  /* Fast rexmit after n duplicate ack */
 
-#define TCP_REXMIT_DUP_ACK       5  /* Rexmit after n duplicate ack */
+#define TCP_KEEPIDLE_DEFAULT  7200  /* Seconds, as RFC 1122 says */
+#define TCP_KEEPINTVL_DEFAULT   75
+#define TCP_KEEPCNT_DEFAULT      9
+
+#define TCP_QUICKACK_SEGS        8  /* Quick ACKs at start and after a hole */
+
+#define TCP_MSS_DEFAULT        536  /* If the peer didn't send MSS option */
+#define TCP_INIT_CWND           10  /* Initial window in segments, RFC 6928 */
 
 #define TCP_WINDOW_VALUE_DEFAULT  16384 /* Default size of widnow */
 #define TCP_WINDOW_FACTOR_DEFAULT     7 /* Default factor of widnow */
+#define TCP_WINDOW_FACTOR_MAX        14 /* RFC 7323 */
+
+#define TCP_MSS_ADVERTISED     16396 /* MSS sent in SYN */
+#define TCP_RCVBUF_INIT        65536 /* Receive buffer before autotuning */
 
 /* Synchronization flags */
 #define TCP_SYNC_WRITE_QUEUE  0x01 /* Synchronization flag for socket sk_write_queue */
 #define TCP_SYNC_STATE        0x02 /* Synchronization flag for socket sk_state */
-#define TCP_SYNC_CONN_QUEUE   0x04 /* Synchronization flag for socket conn_wait */
 #define TCP_SYNC_SOCK_TABLE   0x08 /* Synchronization flag for tcp_table (set on tcp_sock_default) */
 
 /* Status of TCP connection */
@@ -165,6 +247,34 @@ extern int alloc_prep_skb(struct tcp_sock *tcp_sk, size_t opt_len,
 		size_t *data_len, struct sk_buff **out_skb);
 extern void send_seq_from_sock(struct tcp_sock *tcp_sk, struct sk_buff *skb);
 extern int tcp_sock_get_status(struct tcp_sock *tcp_sk);
+
+/** Length of options of an outgoing segment, SACK blocks only if @a sack */
+extern size_t tcp_opt_len(struct tcp_sock *tcp_sk, int syn, int sack);
+/** Writes @a opt_len bytes of options after @a tcph (SYN ones if it's SYN) */
+extern void tcp_opt_build(struct tcp_sock *tcp_sk, struct tcphdr *tcph,
+		size_t opt_len);
+/** Sends ACK with the current window and SACK blocks. */
+extern void tcp_send_ack(struct tcp_sock *tcp_sk);
+/** Application has read @a copied bytes, tunes the receive buffer. */
+extern void tcp_rcvbuf_update(struct tcp_sock *tcp_sk, size_t copied);
+/** Sends the segment held back by Nagle's algorithm or cork, if any. */
+extern void tcp_push_unsent(struct tcp_sock *tcp_sk);
+/** Sets up SYN and accept queues for @a backlog connections. */
+extern int tcp_sock_listen(struct tcp_sock *tcp_sk, int backlog);
+/** Takes a connection from the accept queue, NULL if it's empty. */
+extern struct tcp_sock *tcp_sock_accept(struct tcp_sock *tcp_sk);
+
+extern void tcp_timer_init(struct tcp_sock *tcp_sk);
+/** Arms @a which timer of @a tcp_sk to fire in @a msec. */
+extern void tcp_timer_set(struct tcp_sock *tcp_sk, enum tcp_timer which,
+		uint32_t msec);
+extern void tcp_timer_clear(struct tcp_sock *tcp_sk, enum tcp_timer which);
+static inline int tcp_timer_pending(const struct tcp_sock *tcp_sk,
+		enum tcp_timer which) {
+	return tcp_sk->timer_armed & (1 << which);
+}
+/** Starts or stops keepalive as SO_KEEPALIVE and the state say. */
+extern void tcp_keepalive_update(struct tcp_sock *tcp_sk);
 extern void debug_print(__u8 code, const char *msg, ...);
 
 #endif /* NET_L4_TCP_H_ */
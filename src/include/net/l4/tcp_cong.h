@@ -0,0 +1,73 @@
+/**
+ * @file
+ * @brief Pluggable TCP congestion control
+ *
+ * TCP core keeps cwnd and ssthresh of the socket in bytes and does slow
+ * start itself. An algorithm decides how cwnd grows in congestion
+ * avoidance and where ssthresh goes on loss. Algorithms are registered
+ * with TCP_CONG_OPS_REGISTER() and selected per socket by name with
+ * setsockopt(IPPROTO_TCP, TCP_CONGESTION).
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef NET_L4_TCP_CONG_H_
+#define NET_L4_TCP_CONG_H_
+
+#include <stdint.h>
+
+#include <util/array.h>
+#include <net/l4/tcp.h>
+
+struct tcp_cong_ops {
+	const char *name;
+	/* Resets private state, called on socket init and when switching */
+	void (*init)(struct tcp_sock *tcp_sk);
+	/* @a acked bytes were newly ACKed while cwnd >= ssthresh */
+	void (*cong_avoid)(struct tcp_sock *tcp_sk, uint32_t acked);
+	/* Returns new ssthresh in bytes on loss (dup ACKs or timeout) */
+	uint32_t (*ssthresh)(struct tcp_sock *tcp_sk);
+	/* Optional, called with every RTT sample in microseconds */
+	void (*rtt_sample)(struct tcp_sock *tcp_sk, uint32_t rtt_us);
+};
+
+ARRAY_SPREAD_DECLARE(const struct tcp_cong_ops *const, __tcp_cong_registry);
+
+#define tcp_cong_foreach(ops) \
+	array_spread_foreach(ops, __tcp_cong_registry)
+
+#define TCP_CONG_OPS_REGISTER(ops) \
+	ARRAY_SPREAD_DECLARE(const struct tcp_cong_ops *const,    \
+			__tcp_cong_registry);                             \
+	ARRAY_SPREAD_ADD(__tcp_cong_registry, ops)
+
+extern const struct tcp_cong_ops *tcp_cong_find(const char *name);
+/** Switches @a tcp_sk to the algorithm named @a name. */
+extern int tcp_cong_set(struct tcp_sock *tcp_sk, const char *name);
+/** Algorithm new sockets get, chosen by the tcp module option. */
+extern const struct tcp_cong_ops *tcp_cong_default(void);
+
+/* Used by TCP core */
+
+extern void tcp_cong_sock_init(struct tcp_sock *tcp_sk);
+/** Peer told its MSS in SYN, initial window is set up from it. */
+extern void tcp_cong_set_mss(struct tcp_sock *tcp_sk, uint32_t mss);
+/** @a acked bytes of new data were ACKed. */
+extern void tcp_cong_ack(struct tcp_sock *tcp_sk, uint32_t acked);
+/** Loss detected by duplicate ACKs or by @a timeout, before rexmit. */
+extern void tcp_cong_loss(struct tcp_sock *tcp_sk, int timeout);
+
+/* Helpers for algorithms */
+
+/** Reno style increase by one segment per @a cnt segments ACKed. */
+extern void tcp_cong_avoid_ai(struct tcp_sock *tcp_sk, uint32_t cnt,
+		uint32_t acked);
+/** Bytes in flight, ssthresh of Reno is a half of it. */
+extern uint32_t tcp_cong_flight(const struct tcp_sock *tcp_sk);
+
+/* Private state must fit TCP_CONG_PRIV_SIZE bytes */
+static inline void *tcp_cong_priv(struct tcp_sock *tcp_sk) {
+	return &tcp_sk->cong_priv[0];
+}
+
+#endif /* NET_L4_TCP_CONG_H_ */
@@ -14,6 +14,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <linux/types.h>
+#include <netinet/in.h>
 #include <net/l3/ipv4/ip.h>
 
 /**
@@ -25,6 +26,12 @@
 #define DNS_PORT_NUMBER    53
 #define DNS_LABEL_MASK     0xC0
 
+/**
+ * Resolver's limits
+ */
+#define DNS_NAMESERVERS_MAX 3 /* in the list of dns_get_nameserver() */
+#define DNS_ADDRS_MAX       8 /* addresses of a name */
+
 /**
  * Types of messages
  */
@@ -208,6 +215,82 @@ struct dns_result {
 	struct dns_rr *ar;
 };
 
+/**
+ * Addresses of a name
+ */
+struct dns_addrs {
+	int count;
+	uint32_t ttl;          /* seconds the addresses are valid for */
+	struct dns_addr {
+		int family;        /* AF_INET or AF_INET6 */
+		union {
+			struct in_addr in;
+			struct in6_addr in6;
+		} addr;
+	} addr[DNS_ADDRS_MAX];
+};
+
+/**
+ * Asynchronous lookup of addresses, see dns_lookup_start()
+ */
+struct dns_lookup {
+	int sock;              /* poll it for POLLIN, -1 when the lookup is done */
+	int err;               /* result of the done lookup */
+	struct dns_addrs addrs;
+
+	/* Private part */
+	char name[DNS_MAX_NAME_SZ];
+	unsigned int pending;  /* bits of queries waiting for a reply */
+	uint16_t id[2];
+	struct dns_addrs an[2];
+	struct sockaddr_in ns[DNS_NAMESERVERS_MAX];
+	int ns_count;
+	int ns_cur;
+	int64_t retry_at;      /* ms */
+	int64_t deadline;      /* ms */
+};
+
+/**
+ * dns_lookup_start - start lookup of addresses of @a name
+ *
+ * A and AAAA records for AF_UNSPEC are queried in parallel. Answers,
+ * negative ones too, are cached for their TTL, a query is not sent if the
+ * cache has the answer. Nameservers are tried in turn until one answers.
+ *
+ * @return 0 when the lookup is done without errors, -EINPROGRESS when the
+ *    caller has to call dns_lookup_process() upon POLLIN on @c l->sock or
+ *    after dns_lookup_timeout() ms, negative errno when the lookup failed:
+ *    -ENOENT if there is no such name, -ETIMEDOUT if no nameserver answered
+ */
+extern int dns_lookup_start(struct dns_lookup *l, const char *name, int family);
+
+/**
+ * dns_lookup_process - handle replies and timeouts of the lookup
+ *
+ * @return Same as dns_lookup_start()
+ */
+extern int dns_lookup_process(struct dns_lookup *l);
+
+/**
+ * dns_lookup_timeout - ms until dns_lookup_process() has to be called
+ */
+extern int dns_lookup_timeout(const struct dns_lookup *l);
+
+/**
+ * dns_lookup_cancel - stop the lookup that is not done
+ */
+extern void dns_lookup_cancel(struct dns_lookup *l);
+
+/**
+ * dns_lookup - blocking lookup of addresses of @a name
+ */
+extern int dns_lookup(const char *name, int family, struct dns_addrs *out_addrs);
+
+/**
+ * dns_cache_flush - forget all cached answers
+ */
+extern void dns_cache_flush(void);
+
 /**
  * dns_query - make query with specified type and class
  */
@@ -220,7 +303,7 @@ extern int dns_query(const char *query, enum dns_type qtype, enum dns_class qcla
 extern int dns_result_free(struct dns_result *result);
 
 /**
- * dns_get_nameserver - get dns nameserver
+ * dns_get_nameserver - get dns nameservers, separated by spaces or commas
  */
 extern const char * dns_get_nameserver(void);
 
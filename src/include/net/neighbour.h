@@ -11,28 +11,44 @@
 
 #include <net/netdevice.h>
 #include <time.h>
+#include <kernel/time/timer.h>
 #include <util/dlist.h>
 
+/* Bytes of the cached hardware header */
+#define NEIGHBOUR_HH_MAX 16
+
 /**
  * Neighbour entity
  */
 struct neighbour {
 	struct dlist_head lnk;             /* lnk */
+	struct neighbour *hash_next;       /* Chain of the bucket, read locklessly */
 	unsigned short ptype;              /* protocol */
 	unsigned char paddr[MAX_ADDR_LEN]; /* protocol address */
 	unsigned char plen;                /* protocol address len  */
 	struct net_device *dev;            /* net device */
-	int incomplete;                    /* is incomplete */
+	unsigned int state;                /* NEIGHBOUR_xxx below */
 	unsigned short htype;              /* hw space */
 	unsigned char haddr[MAX_ADDR_LEN]; /* hw address */
 	unsigned char hlen;                /* hw address len */
 	unsigned int flags;                /* flags */
 	struct sk_buff_head w_queue;       /* waiting queue */
-	unsigned long expire;              /* lifetime */
-	unsigned long resend;              /* resend timeout */
+	struct sys_timer tmr;              /* Timer of the current state */
 	unsigned int sent_times;           /* how much times request was sent */
+	unsigned char hh[NEIGHBOUR_HH_MAX]; /* Hardware header, built once */
+	unsigned char hh_len;              /* Zero until it's built */
+	unsigned char hh_src[MAX_ADDR_LEN]; /* Device address in the header */
 };
 
+/**
+ * Neighbour states (RFC 4861, 7.3.2)
+ */
+#define NEIGHBOUR_INCOMPLETE 0 /* Address is being resolved */
+#define NEIGHBOUR_REACHABLE  1 /* Confirmed recently */
+#define NEIGHBOUR_STALE      2 /* Usable, is checked once used */
+#define NEIGHBOUR_DELAY      3 /* Used while stale, waits for a confirmation */
+#define NEIGHBOUR_PROBE      4 /* Is asked again */
+
 /**
  * Neighbour flags
  */
@@ -71,6 +87,16 @@ typedef int (*neighbour_foreach_ft)(const struct neighbour *nbr,
 
 extern int neighbour_foreach(neighbour_foreach_ft func, void *args);
 
+/**
+ * Writes the hardware header to @a skb for a resolved neighbour
+ *
+ * @return 0 on success, -ENOENT if there is no such neighbour,
+ *    -EINPROGRESS if it's being resolved
+ */
+extern int neighbour_build_hdr(unsigned short ptype,
+		const void *paddr, struct net_device *dev,
+		struct sk_buff *skb);
+
 extern int neighbour_send_after_resolve(unsigned short ptype,
 		const void *paddr, unsigned char plen,
 		struct net_device *dev, struct sk_buff *skb);
@@ -50,6 +50,7 @@ struct sock_opt {
 	int so_domain;
 	int so_dontroute;
 	int so_error;
+	int so_keepalive;
 	struct linger so_linger;
 	int so_oobinline;
 	int so_protocol;
@@ -67,6 +68,7 @@ struct sock_opt {
 #define SOCK_OPT_DEFAULT_SNDTIMEO { .tv_sec = 0, .tv_usec = 0 }
 	int so_type;
 	int so_reuseaddr;
+	int so_reuseport;
 };
 
 /* Base class for family sockets */
@@ -124,6 +126,7 @@ struct sock_family_ops {
 	int (*setsockopt)(struct sock *sk, int level, int optname,
 			const void *optval, socklen_t optlen);
 	int (*shutdown)(struct sock *sk, int how);
+	int (*socketpair)(struct sock *sk1, struct sock *sk2);
 	struct pool *sock_pool;
 };
 
@@ -207,6 +210,11 @@ typedef int (*sock_addr_tester_ft)(const struct sockaddr *addr1,
 extern int sock_addr_is_busy(const struct sock_proto_ops *p_ops,
 		sock_addr_tester_ft tester, const struct sockaddr *addr,
 		socklen_t addrlen);
+/** As sock_addr_is_busy(), but the address may be shared by sockets
+ * with SO_REUSEPORT, @a sk too */
+extern int sock_addr_is_busy_for(const struct sock *sk,
+		sock_addr_tester_ft tester, const struct sockaddr *addr,
+		socklen_t addrlen);
 extern int sock_addr_alloc_port(const struct sock_proto_ops *p_ops,
 		in_port_t *addrport, sock_addr_tester_ft tester,
 		const struct sockaddr *addr, socklen_t addrlen);
@@ -38,6 +38,16 @@ struct msghdr;
  */
 extern struct sock * ksocket(int family, int type, int protocol);
 
+/**
+ * Create a pair of sockets connected to each other.
+ * Call socketpair callback from family_ops.
+ *
+ * @param sv - the sockets on return
+ * @return 0 on success, minus posix errno on failure
+ */
+extern int ksocketpair(int family, int type, int protocol,
+		struct sock *sv[2]);
+
 /**
  * Close socket method in kernel layer.
  * Calls socket's native release method if present and
@@ -0,0 +1,17 @@
+/**
+ * @file
+ * @brief Cache line size to keep data of different CPUs apart
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef UTIL_CACHELINE_H_
+#define UTIL_CACHELINE_H_
+
+/* Largest data cache line of supported targets. Fields written by
+ * different CPUs are put this far apart so they don't share a line. */
+#define CACHELINE_SIZE 64
+
+#define __cacheline_aligned __attribute__((aligned(CACHELINE_SIZE)))
+
+#endif /* UTIL_CACHELINE_H_ */
@@ -0,0 +1,111 @@
+/**
+ * @file
+ * @brief Lock-free multi-producer/multi-consumer ring
+ *
+ * Bounded queue with a sequence number per slot. A producer claims the
+ * slots at @c head with a single compare-and-swap for the whole batch,
+ * as many as the slots' sequences say have been freed, copies the
+ * elements and bumps the sequences to hand them to consumers. Consumers
+ * do the same on @c tail. Nobody spins on
+ * another context holding a lock, so it's usable from interrupts too.
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef UTIL_MPMC_RING_H_
+#define UTIL_MPMC_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <util/cacheline.h>
+
+/* Slot is the sequence number followed by the element, 8 bytes aligned */
+#define MPMC_RING_SLOT_SIZE(elem_size) \
+	(sizeof(uint64_t) + (((elem_size) + 7) & ~7))
+
+/** Bytes of storage for @a count elements of @a elem_size */
+#define MPMC_RING_STORAGE_SIZE(elem_size, count) \
+	(MPMC_RING_SLOT_SIZE(elem_size) * (count))
+
+struct mpmc_ring {
+	/* Set at init, only read afterwards */
+	uint32_t mask;
+	uint32_t elem_size;
+	uint32_t slot_size;
+	char *storage;
+
+	uint32_t head __cacheline_aligned;
+	uint32_t tail __cacheline_aligned;
+};
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/**
+ * @param storage At least MPMC_RING_STORAGE_SIZE(elem_size, count) bytes,
+ *    8 bytes aligned
+ * @param count Number of slots, a power of two
+ */
+extern void mpmc_ring_init(struct mpmc_ring *r, void *storage,
+		size_t elem_size, unsigned int count);
+
+/** @return Number of elements enqueued, up to @a n */
+extern unsigned int mpmc_ring_enqueue(struct mpmc_ring *r, const void *elems,
+		unsigned int n);
+
+/** @return Number of elements dequeued, up to @a n */
+extern unsigned int mpmc_ring_dequeue(struct mpmc_ring *r, void *elems,
+		unsigned int n);
+
+__END_DECLS
+
+static inline uint32_t *mpmc_ring_slot_seq(struct mpmc_ring *r, uint32_t pos) {
+	return (uint32_t *) (r->storage + (pos & r->mask) * r->slot_size);
+}
+
+/* An estimate, may be stale as soon as it's returned */
+static inline unsigned int mpmc_ring_count(struct mpmc_ring *r) {
+	uint32_t tail, cnt;
+
+	tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	cnt = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;
+
+	return cnt > r->mask + 1 ? r->mask + 1 : cnt;
+}
+
+static inline int mpmc_ring_empty(struct mpmc_ring *r) {
+	return mpmc_ring_count(r) == 0;
+}
+
+/* Whether the oldest element is filled in and can be dequeued. Unlike
+ * mpmc_ring_empty() it's false while the producer that claimed the slot
+ * is still copying, so it's the one to sleep on */
+static inline int mpmc_ring_can_dequeue(struct mpmc_ring *r) {
+	uint32_t pos, seq;
+
+	do {
+		pos = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		seq = __atomic_load_n(mpmc_ring_slot_seq(r, pos), __ATOMIC_ACQUIRE);
+		/* Taken by another consumer after tail was read */
+	} while ((int32_t) (seq - (pos + 1)) > 0);
+
+	return seq == pos + 1;
+}
+
+/* Whether the next slot is free, that is not full and not still being
+ * copied out by a consumer */
+static inline int mpmc_ring_can_enqueue(struct mpmc_ring *r) {
+	uint32_t pos, seq;
+
+	do {
+		pos = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		seq = __atomic_load_n(mpmc_ring_slot_seq(r, pos), __ATOMIC_ACQUIRE);
+		/* Taken by another producer after head was read */
+	} while ((int32_t) (seq - pos) > 0);
+
+	return seq == pos;
+}
+
+#endif /* UTIL_MPMC_RING_H_ */
@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @brief Lock-free single-producer/single-consumer ring
+ *
+ * One context enqueues and one dequeues, e.g. an interrupt handler and a
+ * thread, or two threads on different CPUs. Neither side takes a lock
+ * or disables interrupts: the producer publishes @c head with release
+ * ordering after filling the slots and the consumer publishes @c tail
+ * after reading them. If there is more than one producer (or consumer),
+ * they have to be serialized by the caller, or use mpmc_ring.
+ *
+ * Indices run free and wrap at 2^32, the number of slots must be a
+ * power of two. All slots are usable.
+ *
+ * The same ring can carry variable-length records instead of elements:
+ * a record is reserved in place, filled and committed, and the consumer
+ * reads it in place too. Records need a ring of bytes (@c elem_size 1)
+ * and must not be mixed with enqueue/dequeue of elements.
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef UTIL_SPSC_RING_H_
+#define UTIL_SPSC_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <util/cacheline.h>
+
+struct spsc_ring {
+	/* Set at init, only read afterwards */
+	uint32_t mask;
+	uint32_t elem_size;
+	char *storage;
+
+	/* Producer side */
+	uint32_t head __cacheline_aligned;
+	uint32_t reserved;  /* head after the record being filled */
+
+	/* Consumer side */
+	uint32_t tail __cacheline_aligned;
+};
+
+#define SPSC_RING_DEF(name, elem_type, count) \
+	static elem_type name##_storage[count];        \
+	static struct spsc_ring name = {               \
+		.mask = (count) - 1,                       \
+		.elem_size = sizeof(elem_type),            \
+		.storage = (char *) name##_storage,        \
+	}
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/**
+ * @param count Number of slots in @a storage, a power of two
+ */
+extern void spsc_ring_init(struct spsc_ring *r, void *storage,
+		size_t elem_size, unsigned int count);
+
+/** Producer side. @return Number of elements enqueued, up to @a n */
+extern unsigned int spsc_ring_enqueue(struct spsc_ring *r, const void *elems,
+		unsigned int n);
+
+/** Consumer side. @return Number of elements dequeued, up to @a n */
+extern unsigned int spsc_ring_dequeue(struct spsc_ring *r, void *elems,
+		unsigned int n);
+
+/**
+ * Producer side. Reserves a contiguous record of @a len bytes.
+ * @return Where to put the record, NULL if there is no room yet or
+ *    err_ptr(EMSGSIZE) if the record can never fit
+ */
+extern void *spsc_ring_reserve(struct spsc_ring *r, size_t len);
+
+/** Producer side. Makes the reserved record visible to the consumer. */
+extern void spsc_ring_commit(struct spsc_ring *r);
+
+/**
+ * Consumer side. Returns the oldest record without taking it.
+ * @return The record or NULL if the ring is empty
+ */
+extern void *spsc_ring_peek(struct spsc_ring *r, size_t *len);
+
+/** Consumer side. Frees the record returned by spsc_ring_peek(). */
+extern void spsc_ring_release(struct spsc_ring *r);
+
+__END_DECLS
+
+/* Exact only when called by the producer or the consumer, an estimate
+ * for anybody else */
+static inline unsigned int spsc_ring_count(struct spsc_ring *r) {
+	uint32_t tail, cnt;
+
+	/* Tail first, so head read later is never behind it */
+	tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	cnt = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;
+
+	return cnt > r->mask + 1 ? r->mask + 1 : cnt;
+}
+
+static inline unsigned int spsc_ring_space(struct spsc_ring *r) {
+	return r->mask + 1 - spsc_ring_count(r);
+}
+
+static inline int spsc_ring_empty(struct spsc_ring *r) {
+	return spsc_ring_count(r) == 0;
+}
+
+#endif /* UTIL_SPSC_RING_H_ */
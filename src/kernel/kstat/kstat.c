@@ -0,0 +1,81 @@
+/**
+ * @file
+ * @brief Aggregation of per-CPU kernel statistics
+ *
+ * @date 19.10.2026
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <hal/cpu.h>
+#include <kernel/kstat.h>
+
+ARRAY_SPREAD_DEF(const struct kstat_desc *const, __kstat_registry);
+
+unsigned long kstat_counter_read(const struct kstat_counter *counter) {
+	unsigned long sum = 0;
+	int cpu;
+
+	for (cpu = 0; cpu < NCPU; cpu++) {
+		sum += counter->val[cpu];
+	}
+
+	return sum;
+}
+
+void kstat_hist_read(const struct kstat_hist *hist,
+		unsigned long buckets[KSTAT_HIST_BUCKETS]) {
+	int cpu, i;
+
+	memset(buckets, 0, sizeof(buckets[0]) * KSTAT_HIST_BUCKETS);
+
+	for (cpu = 0; cpu < NCPU; cpu++) {
+		for (i = 0; i < KSTAT_HIST_BUCKETS; i++) {
+			buckets[i] += hist->val[cpu][i];
+		}
+	}
+}
+
+static int kstat_hist_snprint(const struct kstat_hist *hist, char *buf,
+		size_t len) {
+	unsigned long buckets[KSTAT_HIST_BUCKETS];
+	int i, ret, off = 0;
+
+	kstat_hist_read(hist, buckets);
+
+	for (i = 0; i < KSTAT_HIST_BUCKETS; i++) {
+		if (!buckets[i]) {
+			continue;
+		}
+
+		if (i == 0) {
+			ret = snprintf(buf + off, len - off, "0 %lu\n", buckets[i]);
+		} else if (i == KSTAT_HIST_BUCKETS - 1) {
+			ret = snprintf(buf + off, len - off, "%lu- %lu\n",
+					1ul << (i - 1), buckets[i]);
+		} else {
+			ret = snprintf(buf + off, len - off, "%lu-%lu %lu\n",
+					1ul << (i - 1), (1ul << i) - 1, buckets[i]);
+		}
+
+		if (ret < 0 || ret >= len - off) {
+			break;
+		}
+		off += ret;
+	}
+
+	return off;
+}
+
+int kstat_snprint(const struct kstat_desc *desc, char *buf, size_t len) {
+	switch (desc->type) {
+	case KSTAT_COUNTER:
+		return snprintf(buf, len, "%lu\n", kstat_counter_read(desc->data));
+	case KSTAT_HIST:
+		return kstat_hist_snprint(desc->data, buf, len);
+	}
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file
+ * @brief Per-CPU kernel statistics
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef KERNEL_KSTAT_IMPL_H_
+#define KERNEL_KSTAT_IMPL_H_
+
+#include <hal/cpu.h>
+#include <util/array.h>
+
+/* Bucket 0 counts zeroes, bucket i counts values in [2^(i-1), 2^i),
+ * the last one counts everything above */
+#define KSTAT_HIST_BUCKETS 24
+
+enum kstat_type {
+	KSTAT_COUNTER,
+	KSTAT_HIST,
+};
+
+/* Each CPU updates its own slot without any locking, so an increment
+ * racing with an interrupt handler on the same CPU may be lost on
+ * architectures without memory increment instruction. */
+struct kstat_counter {
+	unsigned long val[NCPU];
+};
+
+struct kstat_hist {
+	unsigned long val[NCPU][KSTAT_HIST_BUCKETS];
+};
+
+struct kstat_desc {
+	const char *name;
+	enum kstat_type type;
+	void *data;
+};
+
+ARRAY_SPREAD_DECLARE(const struct kstat_desc *const, __kstat_registry);
+
+#define __KSTAT_DEF(var, nm, tp, data_type) \
+	static data_type var; \
+	static const struct kstat_desc var ## _kstat_desc = { \
+		.name = nm, \
+		.type = tp, \
+		.data = &var, \
+	}; \
+	ARRAY_SPREAD_DECLARE(const struct kstat_desc *const, __kstat_registry); \
+	ARRAY_SPREAD_ADD(__kstat_registry, &var ## _kstat_desc)
+
+#define __KSTAT_COUNTER_DEF(counter, name) \
+	__KSTAT_DEF(counter, name, KSTAT_COUNTER, struct kstat_counter)
+
+#define __KSTAT_HIST_DEF(hist, name) \
+	__KSTAT_DEF(hist, name, KSTAT_HIST, struct kstat_hist)
+
+static inline void __kstat_add(struct kstat_counter *counter, unsigned long n) {
+	counter->val[cpu_get_id()] += n;
+}
+
+static inline int kstat_hist_bucket(unsigned long val) {
+	int bucket;
+
+	if (!val) {
+		return 0;
+	}
+
+	bucket = 8 * sizeof(val) - __builtin_clzl(val);
+
+	return bucket < KSTAT_HIST_BUCKETS ? bucket : KSTAT_HIST_BUCKETS - 1;
+}
+
+static inline void __kstat_hist_add(struct kstat_hist *hist, unsigned long val) {
+	hist->val[cpu_get_id()][kstat_hist_bucket(val)]++;
+}
+
+#define kstat_foreach(desc) \
+	array_spread_foreach(desc, __kstat_registry)
+
+/** Sum of the counter over all CPUs */
+extern unsigned long kstat_counter_read(const struct kstat_counter *counter);
+
+/** Sum of the histogram over all CPUs */
+extern void kstat_hist_read(const struct kstat_hist *hist,
+		unsigned long buckets[KSTAT_HIST_BUCKETS]);
+
+/** Prints aggregated value of a statistic in text form */
+extern int kstat_snprint(const struct kstat_desc *desc, char *buf, size_t len);
+
+#endif /* KERNEL_KSTAT_IMPL_H_ */
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @brief Disabled kernel statistics
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef KERNEL_KSTAT_NONE_IMPL_H_
+#define KERNEL_KSTAT_NONE_IMPL_H_
+
+#define __KSTAT_COUNTER_DEF(counter, name) \
+	extern char __kstat_unused_ ## counter
+
+#define __KSTAT_HIST_DEF(hist, name) \
+	extern char __kstat_unused_ ## hist
+
+#define __kstat_add(counter, n)     ((void) 0)
+
+#define __kstat_hist_add(hist, val) ((void) 0)
+
+#endif /* KERNEL_KSTAT_NONE_IMPL_H_ */
@@ -0,0 +1,232 @@
+/**
+ * @file
+ * @brief Deferred logging output
+ *
+ * Callers format a message into the ring of the CPU they are running on
+ * and return immediately, the console is written by a low priority drain
+ * thread. Each ring has exactly one producer (the owning CPU, interrupts
+ * disabled while a record is stored) and one consumer (the drain thread),
+ * so head and tail are synchronized with release/acquire only.
+ *
+ * Rings are global so their contents can be examined from a debugger
+ * or a memory dump after a crash.
+ *
+ * @date 19.10.2026
+ */
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <embox/unit.h>
+#include <framework/mod/options.h>
+#include <hal/clock.h>
+#include <hal/cpu.h>
+#include <hal/ipl.h>
+#include <kernel/printk.h>
+#include <kernel/sched/schedee_priority.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <kernel/time/ktime.h>
+#include <util/err.h>
+#include <util/logging.h>
+#include <util/logging_output.h>
+
+#define LOG_RING_SIZE      OPTION_GET(NUMBER, ring_size)
+#define LOG_MSG_MAX_LEN    OPTION_GET(NUMBER, msg_max_len)
+#define LOG_RATELIMIT      OPTION_GET(NUMBER, ratelimit)
+#define LOG_DRAIN_PERIOD   OPTION_GET(NUMBER, drain_period_ms)
+
+#define LOG_RING_MAGIC     0x4c4f4752 /* "LOGR" */
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0);
+static_assert(LOG_MSG_MAX_LEN < 256);
+
+/* Record is a byte of message length followed by the message itself */
+struct log_ring {
+	uint32_t magic;
+	uint32_t head;      /* written by producer only */
+	uint32_t tail;      /* written by consumer only */
+	uint32_t dropped;   /* messages not fit into the ring */
+	uint32_t dropped_reported;
+	char buf[LOG_RING_SIZE];
+};
+
+struct log_ring log_deferred_rings[NCPU];
+
+static struct thread *log_drain_thread;
+
+/* Rate limit counters of a logger are shared by all CPUs */
+static spinlock_t log_ratelimit_lock = SPIN_STATIC_UNLOCKED;
+
+static void log_ring_put(struct log_ring *ring, uint32_t pos, const char *data,
+		size_t len) {
+	uint32_t off;
+	size_t chunk;
+
+	off = pos & (LOG_RING_SIZE - 1);
+	chunk = LOG_RING_SIZE - off;
+	if (chunk > len) {
+		chunk = len;
+	}
+
+	memcpy(&ring->buf[off], data, chunk);
+	memcpy(&ring->buf[0], data + chunk, len - chunk);
+}
+
+static void log_ring_get(struct log_ring *ring, uint32_t pos, char *data,
+		size_t len) {
+	uint32_t off;
+	size_t chunk;
+
+	off = pos & (LOG_RING_SIZE - 1);
+	chunk = LOG_RING_SIZE - off;
+	if (chunk > len) {
+		chunk = len;
+	}
+
+	memcpy(data, &ring->buf[off], chunk);
+	memcpy(data + chunk, &ring->buf[0], len - chunk);
+}
+
+/* Errors and more severe messages are never suppressed */
+static int log_ratelimit_pass(struct logging *logging, int level) {
+	unsigned int now;
+	int pass = 1;
+	ipl_t ipl;
+
+	if (!LOG_RATELIMIT || level <= LOG_ERROR) {
+		return 1;
+	}
+
+	now = clock_sys_sec();
+
+	ipl = spin_lock_ipl(&log_ratelimit_lock);
+	{
+		if (logging->rl_stamp != now) {
+			logging->rl_stamp = now;
+			logging->rl_count = 0;
+		}
+
+		if (logging->rl_count >= LOG_RATELIMIT) {
+			logging->rl_suppressed++;
+			pass = 0;
+		} else {
+			logging->rl_count++;
+		}
+	}
+	spin_unlock_ipl(&log_ratelimit_lock, ipl);
+
+	return pass;
+}
+
+void logging_vprint(struct logging *logging, int level,
+		const char *fmt, va_list args) {
+	struct log_ring *ring;
+	char msg[LOG_MSG_MAX_LEN + 1];
+	unsigned char len;
+	uint32_t head, tail;
+	int ret;
+	ipl_t ipl;
+
+	if (!log_drain_thread) {
+		/* Too early, nobody will drain the ring */
+		vprintk(fmt, args);
+		return;
+	}
+
+	/* Don't format what is dropped anyway */
+	if (!log_ratelimit_pass(logging, level)) {
+		return;
+	}
+
+	ret = vsnprintf(msg, sizeof(msg), fmt, args);
+	if (ret <= 0) {
+		return;
+	}
+	len = ret > LOG_MSG_MAX_LEN ? LOG_MSG_MAX_LEN : ret;
+
+	ipl = ipl_save();
+	{
+		ring = &log_deferred_rings[cpu_get_id()];
+		head = ring->head;
+		tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+		if (LOG_RING_SIZE - (head - tail) < len + 1) {
+			ring->dropped++;
+		} else {
+			/* The record is published whole, drain never sees a part */
+			log_ring_put(ring, head, (char *) &len, 1);
+			log_ring_put(ring, head + 1, msg, len);
+			__atomic_store_n(&ring->head, head + 1 + len, __ATOMIC_RELEASE);
+		}
+	}
+	ipl_restore(ipl);
+}
+
+static int log_ring_drain(struct log_ring *ring) {
+	char msg[LOG_MSG_MAX_LEN + 1];
+	unsigned char len;
+	uint32_t head, tail, dropped;
+	int cnt = 0;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	tail = ring->tail;
+
+	while (tail != head) {
+		log_ring_get(ring, tail, (char *) &len, 1);
+		log_ring_get(ring, tail + 1, msg, len);
+		msg[len] = '\0';
+
+		tail += 1 + len;
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+		printk("%s", msg);
+		cnt++;
+	}
+
+	dropped = ring->dropped;
+	if (dropped != ring->dropped_reported) {
+		printk("log: %u messages dropped\n",
+				(unsigned) (dropped - ring->dropped_reported));
+		ring->dropped_reported = dropped;
+	}
+
+	return cnt;
+}
+
+static void *log_drain_thread_run(void *arg) {
+	int cpu;
+
+	while (1) {
+		for (cpu = 0; cpu < NCPU; cpu++) {
+			log_ring_drain(&log_deferred_rings[cpu]);
+		}
+
+		ksleep(LOG_DRAIN_PERIOD);
+	}
+
+	return NULL;
+}
+
+EMBOX_UNIT_INIT(log_deferred_init);
+static int log_deferred_init(void) {
+	struct thread *t;
+	int cpu;
+
+	for (cpu = 0; cpu < NCPU; cpu++) {
+		log_deferred_rings[cpu].magic = LOG_RING_MAGIC;
+	}
+
+	t = thread_create(0, log_drain_thread_run, NULL);
+	if (err(t)) {
+		return err(t);
+	}
+	schedee_priority_set(&t->schedee, SCHED_PRIORITY_LOW);
+
+	log_drain_thread = t;
+
+	return 0;
+}
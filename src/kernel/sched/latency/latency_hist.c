@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @brief Run delay and wake up latency histograms
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <hal/ipl.h>
+#include <kernel/sched.h>
+#include <kernel/sched/sched_latency.h>
+#include <kernel/sched/schedee_priority.h>
+#include <kernel/time/ktime.h>
+
+#include <framework/mod/options.h>
+
+#define PRIO_GROUPS OPTION_GET(NUMBER, prio_groups)
+
+/* Protected by runq lock, see sched_latency_run() */
+static struct sched_latency_stat prio_stat[PRIO_GROUPS];
+
+static int latency_bucket(uint32_t ns) {
+	uint32_t us = ns / 1000;
+	int bucket;
+
+	if (!us) {
+		return 0;
+	}
+
+	bucket = 32 - __builtin_clz(us);
+
+	return bucket < SCHED_LATENCY_BUCKETS ? bucket : SCHED_LATENCY_BUCKETS - 1;
+}
+
+static void latency_account(struct sched_latency_stat *stat, uint32_t delay,
+		int wakeup) {
+	stat->runs++;
+	stat->delay_total += delay;
+	if (delay > stat->delay_max) {
+		stat->delay_max = delay;
+	}
+
+	if (wakeup) {
+		stat->wakeups++;
+		stat->hist[latency_bucket(delay)]++;
+		if (delay > stat->wakeup_max) {
+			stat->wakeup_max = delay;
+		}
+	}
+}
+
+void sched_latency_init(struct schedee *s) {
+	memset(&s->sched_latency, 0, sizeof(s->sched_latency));
+}
+
+void sched_latency_ready(struct schedee *s, int wakeup) {
+	s->sched_latency.ready_stamp = ktime_get_ns();
+	s->sched_latency.wakeup = wakeup;
+}
+
+void sched_latency_run(struct schedee *s) {
+	struct sched_latency *lat = &s->sched_latency;
+	int64_t delta;
+	uint32_t delay;
+	int group;
+
+	if (!lat->ready_stamp) {
+		/* Has never been queued, e.g. boot or idle schedee */
+		return;
+	}
+
+	delta = ktime_get_ns() - lat->ready_stamp;
+	lat->ready_stamp = 0;
+
+	delay = delta > UINT32_MAX ? UINT32_MAX : (delta < 0 ? 0 : delta);
+	group = (schedee_priority_get(s) - SCHED_PRIORITY_MIN)
+			* PRIO_GROUPS / SCHED_PRIORITY_TOTAL;
+
+	latency_account(&lat->stat, delay, lat->wakeup);
+	latency_account(&prio_stat[group], delay, lat->wakeup);
+}
+
+int sched_latency_get(struct schedee *s, struct sched_latency_stat *stat) {
+	ipl_t ipl;
+
+	ipl = ipl_save();
+	memcpy(stat, &s->sched_latency.stat, sizeof(*stat));
+	ipl_restore(ipl);
+
+	return 0;
+}
+
+int sched_latency_prio_get(int group, struct sched_latency_stat *stat) {
+	ipl_t ipl;
+
+	if (group < 0 || group >= PRIO_GROUPS) {
+		return -EINVAL;
+	}
+
+	ipl = ipl_save();
+	memcpy(stat, &prio_stat[group], sizeof(*stat));
+	ipl_restore(ipl);
+
+	return 0;
+}
+
+int sched_latency_prio_groups(void) {
+	return PRIO_GROUPS;
+}
+
+void sched_latency_reset(void) {
+	ipl_t ipl;
+
+	ipl = ipl_save();
+	memset(prio_stat, 0, sizeof(prio_stat));
+	ipl_restore(ipl);
+}
@@ -0,0 +1,20 @@
+/**
+ * @file
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef SCHED_LATENCY_HIST_H_
+#define SCHED_LATENCY_HIST_H_
+
+#include <stdint.h>
+
+#include <kernel/sched/sched_latency.h>
+
+struct sched_latency {
+	int64_t ready_stamp;  /**< When entered runq, ns. Zero if not queued. */
+	int wakeup;           /**< Entered runq by wake up, not by preemption. */
+	struct sched_latency_stat stat;
+};
+
+#endif /* SCHED_LATENCY_HIST_H_ */
@@ -0,0 +1,42 @@
+/**
+ * @file
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef SCHED_LATENCY_NONE_H_
+#define SCHED_LATENCY_NONE_H_
+
+#include <errno.h>
+#include <sys/cdefs.h>
+
+struct schedee;
+struct sched_latency_stat;
+
+struct sched_latency {
+	EMPTY_STRUCT_BODY
+};
+
+static inline void sched_latency_init(struct schedee *s) { }
+
+static inline void sched_latency_ready(struct schedee *s, int wakeup) { }
+
+static inline void sched_latency_run(struct schedee *s) { }
+
+static inline int sched_latency_get(struct schedee *s,
+		struct sched_latency_stat *stat) {
+	return -ENOSYS;
+}
+
+static inline int sched_latency_prio_get(int group,
+		struct sched_latency_stat *stat) {
+	return -ENOSYS;
+}
+
+static inline int sched_latency_prio_groups(void) {
+	return 0;
+}
+
+static inline void sched_latency_reset(void) { }
+
+#endif /* SCHED_LATENCY_NONE_H_ */
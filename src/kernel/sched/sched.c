@@ -29,6 +29,7 @@
 #include <hal/ipl.h>
 
 #include <kernel/critical.h>
+#include <kernel/kstat.h>
 #include <kernel/spinlock.h>
 #include <kernel/sched/sched_strategy.h>
 #include <kernel/sched/current.h>
@@ -48,6 +49,11 @@ CRITICAL_DISPATCHER_DEF(sched_critical, sched_preempt, CRITICAL_SCHED_LOCK);
 
 //TODO these variable for scheduler (may be create object scheduler?)
 static struct runq rq;
+static unsigned int rq_len; /* protected by rq.lock */
+
+KSTAT_COUNTER_DEF(sched_switches, "sched/switches");
+KSTAT_COUNTER_DEF(sched_wakeups, "sched/wakeups");
+KSTAT_HIST_DEF(sched_runq_len, "sched/runq_len");
 
 void sched_post_switch(void) {
 	critical_request_dispatch(&sched_critical);
@@ -83,6 +89,7 @@ int schedee_init(struct schedee *schedee, int priority,
 	schedee_priority_init(schedee, priority);
 	sched_affinity_init(&schedee->affinity);
 	sched_timing_init(schedee);
+	sched_latency_init(schedee);
 
 	return 0;
 }
@@ -106,16 +113,19 @@ static void sched_check_preempt(struct schedee *t) {
 /** Locks: IPL, thread, runq. */
 static void __sched_enqueue(struct schedee *s) {
 	runq_insert(&rq.queue, s);
+	rq_len++;
 }
 
 /** Locks: IPL, thread, runq. */
 static void __sched_dequeue(struct schedee *s) {
 	runq_remove(&rq.queue, s);
+	rq_len--;
 }
 
 /** Locks: IPL, thread, runq. */
 static void __sched_enqueue_set_ready(struct schedee *s) {
 	__sched_enqueue(s);
+	sched_latency_ready(s, true);
 	s->ready = true;  /* let rq to see the previous state */
 }
 
@@ -289,6 +299,8 @@ static int __sched_wakeup_ready(struct schedee *s) {
 static void __sched_wakeup_waiting(struct schedee *s) {
 	assert(s && s->waiting);
 
+	kstat_inc(&sched_wakeups);
+
 	spin_lock(&rq.lock);
 	__sched_enqueue_set_ready(s);
 	__sched_wokenup_clear_waiting(s);
@@ -376,20 +388,26 @@ static void __schedule(int preempt) {
 	assert(!sched_in_interrupt());
 	ipl = spin_lock_ipl(&rq.lock);
 
-	if (!preempt && prev->waiting)
+	if (!preempt && prev->waiting) {
 		prev->ready = false;
 		/* In SMP kernel starting from this point and until clearing
 		 * prev->active state (which is done by '__sched_deactivate')
 		 * any CPU waking prev will move it to TW_SMP_WAKING state
 		 * without really waking it up.
 		 * 'sched_finish_switch' will sort out what to do in such case. */
-	else
+	} else {
 		__sched_enqueue(prev);
+		sched_latency_ready(prev, false);
+	}
 
 	sched_timing_stop(prev);
 
+	kstat_hist_add(&sched_runq_len, rq_len);
+
 	while (1) {
 		next = runq_extract(&rq.queue);
+		rq_len--;
+		sched_latency_run(next);
 
 		/* Runq is unlocked as soon as possible, but interrupts remain disabled
 		 * during the 'sched_switch' (if any). */
@@ -409,6 +427,10 @@ static void __schedule(int preempt) {
 		spin_lock_ipl_disable(&rq.lock);
 	}
 
+	if (next != prev) {
+		kstat_inc(&sched_switches);
+	}
+
 	sched_timing_start(next);
 
 	/* Restoring ipl is vital as __schedule() can be called both with IRQs
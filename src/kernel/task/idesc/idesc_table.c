@@ -34,7 +34,7 @@ int idesc_table_add(struct idesc_table *t, struct idesc *idesc, int cloexec) {
 		return -EMFILE;
 	}
 
-	idesc->idesc_count++;
+	__atomic_add_fetch(&idesc->idesc_count, 1, __ATOMIC_RELAXED);
 
 	if (cloexec) {
 		idesc_cloexec_set(idesc);
@@ -53,7 +53,7 @@ int idesc_table_lock(struct idesc_table *t, struct idesc *idesc, int idx, int cl
 
 	index_lock(&t->indexator, idx);
 
-	idesc->idesc_count++;
+	__atomic_add_fetch(&idesc->idesc_count, 1, __ATOMIC_RELAXED);
 
 	if (cloexec) {
 		idesc_cloexec_set(idesc);
@@ -81,7 +81,8 @@ void idesc_table_del(struct idesc_table *t, int idx) {
 	assert(idesc);
 	assert(idesc->idesc_ops && idesc->idesc_ops->close);
 
-	if (!(--idesc->idesc_count)) {
+	/* AIO workers drop their references from other threads */
+	if (!__atomic_sub_fetch(&idesc->idesc_count, 1, __ATOMIC_ACQ_REL)) {
 		idesc->idesc_ops->close(idesc);
 	}
 
@@ -63,6 +63,13 @@
 #define PT_LOPROC       0x70000000
 #define PT_HIPROC       0x7fffffff
 
+/*
+ * p_flags
+ */
+#define PF_X            0x1
+#define PF_W            0x2
+#define PF_R            0x4
+
 
 /*
  * d_type
@@ -24,6 +24,21 @@
 #include <kernel/task/resource/mmap.h>
 #include <kernel/task/resource/task_phymem.h>
 
+#include <fs/idesc.h>
+#include <fs/index_descriptor.h>
+
+#include <module/embox/fs/fs_api.h>
+#ifdef __MODULE__embox__fs__core__H_
+#include <fs/file_desc.h>
+#include <fs/file_system.h>
+#include <fs/fs_driver.h>
+#include <fs/node.h>
+#else
+#include <fs/dvfs.h>
+#endif
+
+#include "exec_image.h"
+
 #define AT_NULL		0		/* End of vector */
 #define AT_IGNORE	1		/* Entry should be ignored */
 #define AT_EXECFD	2		/* File descriptor of program */
@@ -198,106 +213,288 @@ static int load_interp(char *filename, exec_t *exec) {
 	return ENOERR;
 }
 
-static int load_exec(const char *filename, exec_t *exec) {
-	Elf32_Ehdr header;
+static int load_segment_private(int fd, Elf32_Phdr *ph) {
 	size_t size;
-	Elf32_Phdr *ph_table;
-	Elf32_Phdr *ph;
+	void *paddr;
 	int err;
+
+	size = binalign_bound(ph->p_memsz, MMU_PAGE_SIZE);
+	if (mmap_place(task_self_resource_mmap(), ph->p_vaddr, size,
+				PROT_EXEC | PROT_READ | PROT_WRITE)) {
+		return -ENOMEM;
+	}
+
+	paddr = phymem_alloc(size / MMU_PAGE_SIZE);
+	if (!paddr) {
+		mmap_release(task_self_resource_mmap(), ph->p_vaddr);
+		return -ENOMEM;
+	}
+	task_resource_phymem_add(task_self(), paddr, size / MMU_PAGE_SIZE);
+
+	vmem_map_region(vmem_current_context(),
+			(mmu_paddr_t) paddr,
+			ph->p_vaddr,
+			size,
+			PROT_WRITE | PROT_READ | PROT_EXEC | VMEM_PAGE_USERMODE);
+
+	if ((err = elf_read_segment(fd, ph, (void *) ph->p_vaddr))) {
+		/* Pages stay with the task and are freed when it exits */
+		vmem_unmap_region(vmem_current_context(), ph->p_vaddr, size);
+		mmu_flush_tlb();
+		mmap_release(task_self_resource_mmap(), ph->p_vaddr);
+	}
+
+	return err;
+}
+
+/* Bounds of the initfs image, if there is one. It's read-only and is
+ * never freed, so its pages can be mapped to tasks as they are. */
+extern char _initfs_start __attribute__((weak));
+extern char _initfs_end __attribute__((weak));
+
+extern const struct idesc_ops idesc_file_ops;
+
+/* Other file systems may allocate pages to map a file, so only initfs
+ * files are mapped at all */
+static int exec_file_on_initfs(struct idesc *idesc) {
+	const char *fs_name;
+
+	if (idesc->idesc_ops != &idesc_file_ops) {
+		return 0;
+	}
+
+#ifdef __MODULE__embox__fs__core__H_
+	{
+		struct file_desc *desc = (struct file_desc *) idesc;
+
+		if (!desc->node->nas->fs) {
+			return 0;
+		}
+		fs_name = desc->node->nas->fs->drv->name;
+	}
+#else
+	{
+		struct file *file = (struct file *) idesc;
+
+		fs_name = file->f_inode->i_sb->fs_drv->name;
+	}
+#endif
+
+	return !strcmp(fs_name, "initfs");
+}
+
+/* Executes in place the read-only segment which lies page aligned in the
+ * initfs image. Anything else, or a segment with bss, is not mapped. */
+static void *load_segment_xip(int fd, struct exec_image_seg *seg,
+		Elf32_Phdr *ph) {
+	struct idesc *idesc;
+	size_t lead;
+	char *addr;
+
+	lead = ph->p_vaddr - seg->vaddr;
+	if (!&_initfs_start || ph->p_filesz != ph->p_memsz
+			|| ph->p_offset < lead) {
+		return NULL;
+	}
+
+	idesc = index_descriptor_get(fd);
+	if (!idesc || !exec_file_on_initfs(idesc)
+			|| !idesc->idesc_ops->idesc_mmap) {
+		return NULL;
+	}
+
+	addr = idesc->idesc_ops->idesc_mmap(idesc, NULL, lead + ph->p_filesz,
+			PROT_READ | PROT_EXEC, MAP_SHARED, fd, ph->p_offset - lead);
+	if (!addr || addr == MAP_FAILED
+			|| ((uintptr_t) addr & MMU_PAGE_MASK)
+			|| addr < &_initfs_start
+			|| addr + seg->size > &_initfs_end) {
+		return NULL;
+	}
+
+	return addr;
+}
+
+/* Read-only segments are read from file only by the first task running
+ * the executable, the others just map the same pages. */
+static int load_segment_shared(int fd, struct exec_image *img, Elf32_Phdr *ph) {
+	struct exec_image_seg *seg;
 	void *paddr;
-	char interp[255];
-	int has_interp = 0;
+	int err;
 
-	int fd = open(filename, O_RDONLY);
+	seg = exec_image_seg_find(img, ph);
+	if (seg) {
+		if (mmap_place(task_self_resource_mmap(), seg->vaddr, seg->size,
+					PROT_EXEC | PROT_READ)) {
+			return -ENOMEM;
+		}
 
-	if (fd == -1) {
-		return -EBADF;
+		vmem_map_region(vmem_current_context(),
+				(mmu_paddr_t) seg->paddr,
+				seg->vaddr,
+				seg->size,
+				PROT_READ | PROT_EXEC | VMEM_PAGE_USERMODE);
+		return ENOERR;
 	}
 
-	if ((err = elf_read_header(fd, &header))) {
-		return err;
+	seg = exec_image_seg_add(img, ph, NULL);
+	if (!seg) {
+		return load_segment_private(fd, ph);
 	}
 
-	if (header.e_type != ET_EXEC) {
-		return -EBADF;
+	paddr = load_segment_xip(fd, seg, ph);
+	if (paddr) {
+		if (mmap_place(task_self_resource_mmap(), seg->vaddr, seg->size,
+					PROT_EXEC | PROT_READ)) {
+			img->seg_n--;
+			return -ENOMEM;
+		}
+
+		vmem_map_region(vmem_current_context(),
+				(mmu_paddr_t) paddr,
+				seg->vaddr,
+				seg->size,
+				PROT_READ | PROT_EXEC | VMEM_PAGE_USERMODE);
+
+		seg->paddr = paddr;
+		seg->xip = 1;
+		return ENOERR;
 	}
 
-	size = header.e_phnum * header.e_phentsize;
-	if (!(ph_table = malloc(size))) {
+	paddr = phymem_alloc(seg->size / MMU_PAGE_SIZE);
+	if (!paddr) {
+		img->seg_n--;
 		return -ENOMEM;
 	}
-	elf_read_ph_table(fd, &header, ph_table);
 
-	for (int i = 0; i < header.e_phnum; i++) {
-		ph = &ph_table[i];
+	if (mmap_place(task_self_resource_mmap(), seg->vaddr, seg->size,
+				PROT_EXEC | PROT_READ)) {
+		phymem_free(paddr, seg->size / MMU_PAGE_SIZE);
+		img->seg_n--;
+		return -ENOMEM;
+	}
 
-		if (ph->p_type == PT_PHDR) {
-			exec->phdr = ph->p_vaddr;
+	vmem_map_region(vmem_current_context(),
+			(mmu_paddr_t) paddr,
+			seg->vaddr,
+			seg->size,
+			PROT_WRITE | PROT_READ | PROT_EXEC | VMEM_PAGE_USERMODE);
+
+	memset((void *) seg->vaddr, 0, ph->p_vaddr - seg->vaddr);
+	if ((err = elf_read_segment(fd, ph, (void *) ph->p_vaddr))) {
+		vmem_unmap_region(vmem_current_context(), seg->vaddr, seg->size);
+		mmu_flush_tlb();
+		mmap_release(task_self_resource_mmap(), seg->vaddr);
+		phymem_free(paddr, seg->size / MMU_PAGE_SIZE);
+		img->seg_n--;
+		return err;
+	}
+
+	vmem_set_flags(vmem_current_context(), seg->vaddr, seg->size,
+			PROT_READ | PROT_EXEC | VMEM_PAGE_USERMODE);
+	mmu_flush_tlb();
+
+	seg->paddr = paddr;
+
+	return ENOERR;
+}
+
+/* Unmaps the segments loaded for the first @a n program headers, before
+ * the image, which may own their pages, is put */
+static void unload_segments(struct exec_image *img, int n) {
+	struct exec_image_seg *seg;
+	Elf32_Phdr *ph;
+	uintptr_t vaddr;
+	size_t size;
+
+	for (int i = 0; i < n; i++) {
+		ph = &img->ph_table[i];
+		if (ph->p_type != PT_LOAD) {
 			continue;
 		}
 
-		if (ph->p_type == PT_INTERP) {
-			if ((err = elf_read_interp(fd, ph, interp))) {
-				free(ph_table);
-				return err;
-			}
-			has_interp = 1;
+		seg = exec_image_seg_shareable(img, ph)
+			? exec_image_seg_find(img, ph) : NULL;
+		if (seg) {
+			vaddr = seg->vaddr;
+			size = seg->size;
+		} else {
+			vaddr = ph->p_vaddr;
+			size = binalign_bound(ph->p_memsz, MMU_PAGE_SIZE);
+		}
+
+		vmem_unmap_region(vmem_current_context(), vaddr, size);
+		mmap_release(task_self_resource_mmap(), vaddr);
+	}
+	mmu_flush_tlb();
+}
 
+static int load_exec(const char *filename, exec_t *exec) {
+	struct exec_image *img;
+	Elf32_Phdr *ph;
+	int err = ENOERR;
+	int i;
+	int fd = open(filename, O_RDONLY);
+
+	if (fd == -1) {
+		return -EBADF;
+	}
+
+	img = exec_image_get(filename, fd);
+	if (!img) {
+		close(fd);
+		return -EBADF;
+	}
+
+	for (i = 0; i < img->header.e_phnum; i++) {
+		ph = &img->ph_table[i];
+
+		if (ph->p_type == PT_PHDR) {
+			exec->phdr = ph->p_vaddr;
 			continue;
 		}
 
 		if (ph->p_type != PT_LOAD) {
 			continue;
 		}
-#if 0
-		pa = mmap((void *)ph->p_vaddr, ph->p_memsz, PROT_EXEC | PROT_READ | PROT_WRITE, MAP_FIXED, 0, 0);
-		if (MAP_FAILED == pa) {
-			free(ph_table);
-			return -1;
+
+		if (exec_image_seg_shareable(img, ph)) {
+			err = load_segment_shared(fd, img, ph);
+		} else {
+			err = load_segment_private(fd, ph);
 		}
-#else
-		size = binalign_bound(ph->p_memsz, MMU_PAGE_SIZE);
-		if (mmap_place(task_self_resource_mmap(), ph->p_vaddr, size,
-					PROT_EXEC | PROT_READ | PROT_WRITE)) {
-			free(ph_table);
-			return -ENOMEM;
+		if (err) {
+			goto out;
 		}
 
-		paddr = phymem_alloc(size);
-		task_resource_phymem_add(task_self(), paddr, size / MMU_PAGE_SIZE);
-
-		vmem_map_region(vmem_current_context(),
-				(mmu_paddr_t) paddr,
-				ph->p_vaddr,
-				size,
-				PROT_WRITE | PROT_READ | PROT_EXEC | VMEM_PAGE_USERMODE);
-
 		/* XXX brk is a max of ph's right sides. It unaligned now! */
 		mmap_set_brk(task_self_resource_mmap(),
 			max(mmap_get_brk(task_self_resource_mmap()), (void *) ph->p_vaddr + ph->p_memsz));
+	}
 
-#endif
-		if ((err = elf_read_segment(fd, ph, (void *) ph->p_vaddr))) {
-			free(ph_table);
-			return err;
+	if (img->has_interp) {
+		if ((err = load_interp(img->interp, exec))) {
+			goto out;
 		}
 	}
 
-	free(ph_table);
+	exec->filename = filename;
+	exec->entry = img->header.e_entry;
+	exec->phent = img->header.e_phentsize;
+	exec->phnum = img->header.e_phnum;
+
+out:
 	close(fd);
 
-	if (has_interp) {
-		if ((err = load_interp(interp, exec))) {
-			return err;
-		}
+	if (err) {
+		/* The segment that failed has unwound itself */
+		unload_segments(img, i);
+		exec_image_put(img);
+	} else {
+		exec_image_bind(img);
 	}
 
-	exec->filename = filename;
-	exec->entry = header.e_entry;
-	exec->phent = header.e_phentsize;
-	exec->phnum = header.e_phnum;
-
-	return ENOERR;
+	return err;
 }
 
 uint32_t mmap_create_stack(struct emmap *mmap) {
@@ -0,0 +1,318 @@
+/**
+ * @file
+ * @brief Cache of parsed executables with shared read-only segments
+ *
+ * Executables started more than once are not re-parsed: ELF header,
+ * program headers and interpreter path are kept here. Read-only PT_LOAD
+ * segments (text, rodata) are read from the file only once, their pages
+ * are mapped to every task running the same executable.
+ *
+ * All the functions are called from execve_syscall() with scheduler locked.
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <framework/mod/options.h>
+#include <kernel/task.h>
+#include <kernel/task/resource.h>
+#include <mem/phymem.h>
+#include <mem/sysmalloc.h>
+#include <mem/vmem.h>
+#include <util/binalign.h>
+#include <util/dlist.h>
+#include <util/log.h>
+
+#include "exec_image.h"
+
+#define EXEC_IMAGE_IDLE_MAX OPTION_GET(NUMBER, image_cache_size)
+
+/* Most recently used images go first */
+static DLIST_DEFINE(exec_image_list);
+static int exec_image_idle_n;
+
+static inline Elf32_Addr ph_page_start(Elf32_Phdr *ph) {
+	return ph->p_vaddr & ~MMU_PAGE_MASK;
+}
+
+static inline Elf32_Addr ph_page_end(Elf32_Phdr *ph) {
+	return binalign_bound(ph->p_vaddr + ph->p_memsz, MMU_PAGE_SIZE);
+}
+
+static void exec_image_free(struct exec_image *img) {
+	int i;
+
+	assert(img->refcnt == 0);
+
+	for (i = 0; i < img->seg_n; i++) {
+		if (!img->segs[i].xip) {
+			phymem_free(img->segs[i].paddr, img->segs[i].size / MMU_PAGE_SIZE);
+		}
+	}
+
+	sysfree(img->ph_table);
+	sysfree(img);
+}
+
+/* Images which are not in the list are stale and are freed on last put */
+static inline int exec_image_cached(struct exec_image *img) {
+	return !dlist_empty(&img->lnk);
+}
+
+static void exec_image_uncache(struct exec_image *img) {
+	dlist_del_init(&img->lnk);
+
+	if (img->refcnt == 0) {
+		exec_image_idle_n--;
+		exec_image_free(img);
+	}
+}
+
+static struct exec_image *exec_image_lru_idle(void) {
+	struct exec_image *img, *lru = NULL;
+
+	dlist_foreach_entry(img, &exec_image_list, lnk) {
+		if (img->refcnt == 0) {
+			lru = img;
+		}
+	}
+
+	return lru;
+}
+
+static void exec_image_shrink(void) {
+	struct exec_image *img;
+
+	while (exec_image_idle_n > EXEC_IMAGE_IDLE_MAX) {
+		img = exec_image_lru_idle();
+		if (!img) {
+			break;
+		}
+
+		exec_image_uncache(img);
+	}
+}
+
+static struct exec_image *exec_image_lookup(const char *path,
+		const struct stat *st) {
+	struct exec_image *img;
+
+	dlist_foreach_entry(img, &exec_image_list, lnk) {
+		if (strcmp(img->path, path)) {
+			continue;
+		}
+
+		if (img->ino != st->st_ino || img->size != st->st_size
+				|| img->mtime != st->st_mtime) {
+			log_debug("%s changed, drop cached image", path);
+			exec_image_uncache(img);
+			return NULL;
+		}
+
+		return img;
+	}
+
+	return NULL;
+}
+
+static struct exec_image *exec_image_load(const char *path, int fd,
+		const struct stat *st) {
+	struct exec_image *img;
+	Elf32_Phdr *ph;
+	size_t size;
+	int i;
+
+	if (strlen(path) >= sizeof(img->path)) {
+		return NULL;
+	}
+
+	img = sysmalloc(sizeof(*img));
+	if (!img) {
+		return NULL;
+	}
+	memset(img, 0, sizeof(*img));
+	dlist_head_init(&img->lnk);
+
+	if (elf_read_header(fd, &img->header)) {
+		goto out_free;
+	}
+
+	if (img->header.e_type != ET_EXEC) {
+		goto out_free;
+	}
+
+	size = img->header.e_phnum * img->header.e_phentsize;
+	if (!(img->ph_table = sysmalloc(size))) {
+		goto out_free;
+	}
+	if (elf_read_ph_table(fd, &img->header, img->ph_table)) {
+		goto out_free;
+	}
+
+	for (i = 0; i < img->header.e_phnum; i++) {
+		ph = &img->ph_table[i];
+
+		if (ph->p_type != PT_INTERP) {
+			continue;
+		}
+		if (ph->p_filesz >= sizeof(img->interp)) {
+			goto out_free;
+		}
+		if (elf_read_interp(fd, ph, img->interp)) {
+			goto out_free;
+		}
+		img->interp[ph->p_filesz] = '\0';
+		img->has_interp = 1;
+	}
+
+	strcpy(img->path, path);
+	img->ino = st->st_ino;
+	img->size = st->st_size;
+	img->mtime = st->st_mtime;
+
+	return img;
+
+out_free:
+	sysfree(img->ph_table);
+	sysfree(img);
+	return NULL;
+}
+
+struct exec_image *exec_image_get(const char *path, int fd) {
+	struct exec_image *img;
+	struct stat st;
+
+	if (fstat(fd, &st)) {
+		return NULL;
+	}
+
+	img = exec_image_lookup(path, &st);
+	if (img) {
+		dlist_del_init(&img->lnk);
+	} else {
+		img = exec_image_load(path, fd, &st);
+		if (!img) {
+			return NULL;
+		}
+		exec_image_idle_n++;
+	}
+
+	dlist_add_next(&img->lnk, &exec_image_list);
+
+	if (img->refcnt++ == 0) {
+		exec_image_idle_n--;
+	}
+
+	return img;
+}
+
+void exec_image_put(struct exec_image *img) {
+	assert(img);
+	assert(img->refcnt > 0);
+
+	if (--img->refcnt) {
+		return;
+	}
+
+	if (!exec_image_cached(img)) {
+		exec_image_free(img);
+		return;
+	}
+
+	exec_image_idle_n++;
+	exec_image_shrink();
+}
+
+int exec_image_seg_shareable(struct exec_image *img, Elf32_Phdr *ph) {
+	Elf32_Phdr *other;
+	int i;
+
+	if (ph->p_type != PT_LOAD || (ph->p_flags & PF_W)) {
+		return 0;
+	}
+
+	/* Pages of shared segment must not be touched by any other segment */
+	for (i = 0; i < img->header.e_phnum; i++) {
+		other = &img->ph_table[i];
+
+		if (other == ph || other->p_type != PT_LOAD) {
+			continue;
+		}
+
+		if (ph_page_start(other) < ph_page_end(ph)
+				&& ph_page_start(ph) < ph_page_end(other)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+struct exec_image_seg *exec_image_seg_find(struct exec_image *img,
+		Elf32_Phdr *ph) {
+	int i;
+
+	for (i = 0; i < img->seg_n; i++) {
+		if (img->segs[i].vaddr == ph_page_start(ph)) {
+			return &img->segs[i];
+		}
+	}
+
+	return NULL;
+}
+
+struct exec_image_seg *exec_image_seg_add(struct exec_image *img,
+		Elf32_Phdr *ph, void *paddr) {
+	struct exec_image_seg *seg;
+
+	if (img->seg_n == EXEC_IMAGE_SEG_MAX) {
+		return NULL;
+	}
+
+	seg = &img->segs[img->seg_n++];
+	seg->vaddr = ph_page_start(ph);
+	seg->size = ph_page_end(ph) - seg->vaddr;
+	seg->paddr = paddr;
+	seg->xip = 0;
+
+	return seg;
+}
+
+static void task_exec_image_init(const struct task *task, void *space) {
+	struct exec_image **img_p = space;
+
+	*img_p = NULL;
+}
+
+static void task_exec_image_deinit(const struct task *task);
+
+TASK_RESOURCE_DECLARE(static,
+		task_exec_image,
+		struct exec_image *,
+	.init = task_exec_image_init,
+	.deinit = task_exec_image_deinit,
+);
+
+static void task_exec_image_deinit(const struct task *task) {
+	struct exec_image **img_p;
+
+	img_p = task_resource(task, &task_exec_image);
+	if (*img_p) {
+		exec_image_put(*img_p);
+		*img_p = NULL;
+	}
+}
+
+void exec_image_bind(struct exec_image *img) {
+	struct exec_image **img_p;
+
+	img_p = task_self_resource(&task_exec_image);
+	if (*img_p) {
+		exec_image_put(*img_p);
+	}
+	*img_p = img;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file
+ * @brief Cache of loaded executables
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef LIB_EXEC_EXEC_IMAGE_H_
+#define LIB_EXEC_EXEC_IMAGE_H_
+
+#include <limits.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <lib/libelf.h>
+#include <util/dlist.h>
+
+#define EXEC_IMAGE_SEG_MAX   4
+#define EXEC_IMAGE_INTERP_SZ 255
+
+/* Read-only PT_LOAD segment which pages are shared by all
+ * the tasks running the same executable */
+struct exec_image_seg {
+	Elf32_Addr vaddr;    /* page aligned */
+	size_t size;         /* page aligned */
+	void *paddr;
+	int xip;             /* paddr points into the file image, not owned */
+};
+
+struct exec_image {
+	struct dlist_head lnk;
+
+	char path[PATH_MAX];
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+
+	Elf32_Ehdr header;
+	Elf32_Phdr *ph_table;
+
+	int has_interp;
+	char interp[EXEC_IMAGE_INTERP_SZ];
+
+	struct exec_image_seg segs[EXEC_IMAGE_SEG_MAX];
+	int seg_n;
+
+	int refcnt;
+};
+
+/**
+ * @brief Lookup the image of executable @a path opened as @a fd.
+ * Parses and caches ELF header and program headers if the file is not
+ * in the cache yet or if it was changed since it was cached.
+ *
+ * @return Referenced image or NULL if file is not a valid ELF executable
+ */
+extern struct exec_image *exec_image_get(const char *path, int fd);
+
+/** @brief Drop reference obtained with exec_image_get() */
+extern void exec_image_put(struct exec_image *img);
+
+/**
+ * @brief Find shared pages for read-only segment @a ph
+ *
+ * @return Segment descriptor or NULL if segment can't be shared
+ */
+extern struct exec_image_seg *exec_image_seg_find(struct exec_image *img,
+		Elf32_Phdr *ph);
+
+/** @brief Add shared pages of read-only segment @a ph to the image */
+extern struct exec_image_seg *exec_image_seg_add(struct exec_image *img,
+		Elf32_Phdr *ph, void *paddr);
+
+/** @brief Whether segment @a ph can be mapped shared between tasks */
+extern int exec_image_seg_shareable(struct exec_image *img, Elf32_Phdr *ph);
+
+/** @brief Bind image to the current task, previously bound image is put */
+extern void exec_image_bind(struct exec_image *img);
+
+#endif /* LIB_EXEC_EXEC_IMAGE_H_ */
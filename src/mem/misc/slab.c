@@ -23,6 +23,7 @@
 #include <mem/heap.h>
 #include <framework/mod/ops.h>
 #include <mem/phymem.h>
+#include <kernel/kstat.h>
 
 #include <embox/unit.h>
 
@@ -298,6 +299,9 @@ int cache_destroy(cache_t *cachep) {
 	return 0;
 }
 
+KSTAT_COUNTER_DEF(slab_alloc_fast, "mem/slab/alloc_fast");
+KSTAT_COUNTER_DEF(slab_alloc_slow, "mem/slab/alloc_slow");
+
 void *cache_alloc(cache_t *cachep) {
 	slab_t * slabp;
 	void *objp;
@@ -312,8 +316,10 @@ void *cache_alloc(cache_t *cachep) {
 			}
 		}
 		slabp = dlist_entry(cachep->slabs_free.next, slab_t, cache_link);
+		kstat_inc(&slab_alloc_slow);
 	} else {
 		slabp = dlist_entry(cachep->slabs_partial.next, slab_t, cache_link);
+		kstat_inc(&slab_alloc_fast);
 	}
 
 	objp = (void *)slist_remove_first_link(&slabp->free_blocks);
@@ -41,7 +41,17 @@ static int nt_build_hdr(struct sk_buff *skb,
 		hdr_info->src_hw = &dev->dev_addr[0];
 	}
 	if (hdr_info->dst_hw == NULL) {
-		if (hdr_info->dst_p != NULL) {
+		if ((hdr_info->dst_p != NULL)
+				&& (hdr_info->src_hw == &dev->dev_addr[0])) {
+			/* cached header of the neighbour is copied */
+			ret = neighbour_build_hdr(hdr_info->type,
+					hdr_info->dst_p, dev, skb);
+			if (ret == 0) {
+				return 0;
+			} else if (ret != -ENOENT || !(dev->flags & IFF_NOARP)) {
+				return ret;
+			}
+		} else if (hdr_info->dst_p != NULL) {
 			ret = neighbour_get_haddr(hdr_info->type,
 					hdr_info->dst_p, dev, dev->type,
 					ARRAY_SIZE(dst_haddr), &dst_haddr[0]);
@@ -0,0 +1,458 @@
+/**
+ * @file
+ * @brief Reassembly of IPv4 and IPv6 fragments
+ *
+ * Datagrams under reassembly are hashed by addresses, id and protocol.
+ * Fragments of a datagram are kept in an AVL tree by offset. They never
+ * overlap, so the search path of a new fragment meets any fragment it
+ * overlaps. All the queues are on a LRU list ordered by the time of
+ * their last fragment: the oldest one is evicted when the memory cap
+ * is hit, and expires first, so one timer serves all of them.
+ *
+ * @date 19.10.2026
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <util/dlist.h>
+#include <util/log.h>
+#include <util/math.h>
+
+#include <mem/misc/pool.h>
+#include <kernel/kstat.h>
+#include <kernel/sched/sched_lock.h>
+#include <kernel/time/ktime.h>
+#include <kernel/time/time.h>
+#include <kernel/time/timer.h>
+
+#include <net/skbuff.h>
+#include <net/l3/inet_frag.h>
+
+#include <embox/unit.h>
+#include <framework/mod/options.h>
+
+#define MODOPS_AMOUNT_QUEUE OPTION_GET(NUMBER, amount_queue)
+#define MODOPS_HASH_SIZE    OPTION_GET(NUMBER, hash_size)
+#define MODOPS_MEM_MAX      OPTION_GET(NUMBER, mem_max)
+#define MODOPS_TIMEOUT      OPTION_GET(NUMBER, timeout)
+
+/* Largest datagram, both for IPv4 and IPv6 without jumbograms */
+#define FRAG_DATA_MAX 0xffff
+
+/* Node of the tree, kept in skb->cb of a queued fragment */
+struct frag_node {
+	struct sk_buff *left, *right;
+	unsigned int offset, end;   /* Data of the fragment, [offset, end) */
+	unsigned short data_off;    /* Of the data from skb->mac.raw */
+	unsigned short hdr_len;     /* Of the headers from skb->mac.raw */
+	int height;
+};
+static_assert(sizeof(struct frag_node) <= sizeof(((struct sk_buff *)0)->cb));
+
+struct frag_queue {
+	struct dlist_head hash_lnk;
+	struct dlist_head lru_lnk;
+	struct inet_frag_key key;
+	struct sk_buff *root;       /* Fragments by offset */
+	unsigned int meat;          /* Bytes of data received */
+	unsigned int len;           /* Of the datagram, zero until the last one */
+	size_t mem;                 /* skb->len of the fragments */
+	uint32_t expires;           /* In ms */
+};
+
+POOL_DEF(frag_queue_pool, struct frag_queue, MODOPS_AMOUNT_QUEUE);
+static struct dlist_head frag_hash[MODOPS_HASH_SIZE];
+static DLIST_DEFINE(frag_lru);
+static struct sys_timer frag_timer;
+static size_t frag_mem;
+static uint32_t frag_secret;
+
+EMBOX_UNIT_INIT(inet_frag_init);
+
+KSTAT_COUNTER_DEF(frag_reasm_fails, "net/frag/reasm_fails");
+KSTAT_COUNTER_DEF(frag_evictions, "net/frag/evictions");
+
+static inline struct frag_node *frag_node(const struct sk_buff *skb) {
+	return (struct frag_node *)skb->cb;
+}
+
+static uint32_t frag_now(void) {
+	return ktime_get_ns() / NSEC_PER_MSEC;
+}
+
+/************************ AVL tree of fragments ************************/
+static inline int frag_height(const struct sk_buff *skb) {
+	return skb != NULL ? frag_node(skb)->height : 0;
+}
+
+static void frag_update(struct sk_buff *skb) {
+	struct frag_node *n = frag_node(skb);
+
+	n->height = 1 + max(frag_height(n->left), frag_height(n->right));
+}
+
+static struct sk_buff *frag_rotate_right(struct sk_buff *skb) {
+	struct sk_buff *l;
+
+	l = frag_node(skb)->left;
+	frag_node(skb)->left = frag_node(l)->right;
+	frag_node(l)->right = skb;
+	frag_update(skb);
+	frag_update(l);
+
+	return l;
+}
+
+static struct sk_buff *frag_rotate_left(struct sk_buff *skb) {
+	struct sk_buff *r;
+
+	r = frag_node(skb)->right;
+	frag_node(skb)->right = frag_node(r)->left;
+	frag_node(r)->left = skb;
+	frag_update(skb);
+	frag_update(r);
+
+	return r;
+}
+
+static struct sk_buff *frag_balance(struct sk_buff *skb) {
+	struct frag_node *n = frag_node(skb);
+	int bal;
+
+	frag_update(skb);
+	bal = frag_height(n->left) - frag_height(n->right);
+	if (bal > 1) {
+		if (frag_height(frag_node(n->left)->left)
+				< frag_height(frag_node(n->left)->right)) {
+			n->left = frag_rotate_left(n->left);
+		}
+		return frag_rotate_right(skb);
+	}
+	if (bal < -1) {
+		if (frag_height(frag_node(n->right)->right)
+				< frag_height(frag_node(n->right)->left)) {
+			n->right = frag_rotate_right(n->right);
+		}
+		return frag_rotate_left(skb);
+	}
+
+	return skb;
+}
+
+/**
+ * @return New root. @a err is -EEXIST for a duplicate and -EINVAL if the
+ *    fragment overlaps another one, the tree isn't changed then.
+ */
+static struct sk_buff *frag_insert(struct sk_buff *root, struct sk_buff *skb,
+		int *err) {
+	struct frag_node *r, *n;
+
+	n = frag_node(skb);
+	if (root == NULL) {
+		n->left = n->right = NULL;
+		n->height = 1;
+		return skb;
+	}
+
+	r = frag_node(root);
+	if (n->end <= r->offset) {
+		r->left = frag_insert(r->left, skb, err);
+	}
+	else if (n->offset >= r->end) {
+		r->right = frag_insert(r->right, skb, err);
+	}
+	else {
+		*err = (n->offset == r->offset) && (n->end == r->end)
+				? -EEXIST : -EINVAL;
+		return root;
+	}
+
+	return *err ? root : frag_balance(root);
+}
+
+static void frag_tree_free(struct sk_buff *skb) {
+	if (skb != NULL) {
+		frag_tree_free(frag_node(skb)->left);
+		frag_tree_free(frag_node(skb)->right);
+		skb_free(skb);
+	}
+}
+
+/* Copies data of fragments in order and frees them */
+static void frag_tree_copy(struct sk_buff *skb, unsigned char *data) {
+	struct frag_node *n;
+
+	if (skb != NULL) {
+		n = frag_node(skb);
+		frag_tree_copy(n->left, data);
+		frag_tree_copy(n->right, data);
+		memcpy(data + n->offset, skb->mac.raw + n->data_off,
+				n->end - n->offset);
+		skb_free(skb);
+	}
+}
+
+static struct sk_buff *frag_tree_first(struct sk_buff *skb) {
+	while (frag_node(skb)->left != NULL) {
+		skb = frag_node(skb)->left;
+	}
+	return skb;
+}
+
+/************************ Queues ***************************************/
+/* Jenkins's one-at-a-time hash */
+static uint32_t frag_hash_add(uint32_t h, const void *data, size_t len) {
+	const uint8_t *ptr;
+
+	for (ptr = data; len != 0; len--) {
+		h += *ptr++;
+		h += h << 10;
+		h ^= h >> 6;
+	}
+	return h;
+}
+
+static struct dlist_head *frag_bucket(const struct inet_frag_key *key) {
+	uint32_t h;
+
+	if (frag_secret == 0) {
+		/* Fragments are sent by anybody, buckets shouldn't be guessed */
+		frag_secret = (uint32_t)ktime_get_ns() | 1;
+	}
+
+	h = frag_hash_add(frag_secret, key, sizeof *key);
+	h += h << 3;
+	h ^= h >> 11;
+	h += h << 15;
+
+	return &frag_hash[h % MODOPS_HASH_SIZE];
+}
+
+static void frag_timer_start(void) {
+	struct frag_queue *q;
+	int32_t due;
+
+	if (dlist_empty(&frag_lru)) {
+		timer_stop(&frag_timer);
+		return;
+	}
+
+	q = dlist_first_entry(&frag_lru, struct frag_queue, lru_lnk);
+	due = q->expires - frag_now();
+	timer_start(&frag_timer, ms2jiffies(max(due, (int32_t)1)));
+}
+
+static void frag_queue_free(struct frag_queue *q) {
+	frag_tree_free(q->root);
+	assert(frag_mem >= q->mem);
+	frag_mem -= q->mem;
+	dlist_del_init(&q->hash_lnk);
+	dlist_del_init(&q->lru_lnk);
+	pool_free(&frag_queue_pool, q);
+}
+
+static struct frag_queue *frag_queue_find(const struct inet_frag_key *key) {
+	struct dlist_head *bucket;
+	struct frag_queue *q;
+
+	bucket = frag_bucket(key);
+	dlist_foreach_entry(q, bucket, hash_lnk) {
+		if (!memcmp(&q->key, key, sizeof *key)) {
+			return q;
+		}
+	}
+
+	q = pool_alloc(&frag_queue_pool);
+	if (q == NULL) {
+		return NULL;
+	}
+
+	memset(q, 0, sizeof *q);
+	memcpy(&q->key, key, sizeof *key);
+	dlist_head_init(&q->hash_lnk);
+	dlist_head_init(&q->lru_lnk);
+	dlist_add_prev(&q->hash_lnk, bucket);
+	dlist_add_prev(&q->lru_lnk, &frag_lru);
+
+	return q;
+}
+
+/* The oldest queues but @a keep are dropped until the memory is enough */
+static void frag_evict(const struct frag_queue *keep) {
+	struct frag_queue *q;
+
+	dlist_foreach_entry(q, &frag_lru, lru_lnk) {
+		if (frag_mem <= MODOPS_MEM_MAX) {
+			break;
+		}
+		if (q != keep) {
+			log_debug("evict %p", q);
+			kstat_inc(&frag_evictions);
+			frag_queue_free(q);
+		}
+	}
+}
+
+static void frag_timer_handler(struct sys_timer *timer, void *param) {
+	struct frag_queue *q;
+	uint32_t now;
+
+	sched_lock();
+	{
+		now = frag_now();
+		dlist_foreach_entry(q, &frag_lru, lru_lnk) {
+			if ((int32_t)(q->expires - now) > 0) {
+				break;
+			}
+			log_debug("expired %p", q);
+			kstat_inc(&frag_reasm_fails);
+			frag_queue_free(q);
+		}
+		frag_timer_start();
+	}
+	sched_unlock();
+}
+
+static struct sk_buff *frag_build(struct frag_queue *q) {
+	struct sk_buff *skb, *first;
+	struct frag_node *n;
+
+	first = frag_tree_first(q->root);
+	n = frag_node(first);
+	assert(n->offset == 0);
+
+	skb = skb_alloc(n->hdr_len + q->len);
+	if (skb == NULL) {
+		return NULL;
+	}
+
+	memcpy(skb->mac.raw, first->mac.raw, n->hdr_len);
+	skb->dev = first->dev;
+	skb->nh.raw = skb->mac.raw + (first->nh.raw - first->mac.raw);
+	skb->h.raw = skb->mac.raw + n->hdr_len;
+
+	frag_tree_copy(q->root, skb->h.raw);
+	q->root = NULL;
+
+	return skb;
+}
+
+struct sk_buff *inet_frag_add(const struct inet_frag_key *key,
+		struct sk_buff *skb, const struct inet_frag_info *info) {
+	struct frag_queue *q;
+	struct frag_node *n;
+	struct sk_buff *max_skb, *out;
+	int err;
+
+	assert(key != NULL);
+	assert(skb != NULL);
+	assert(info != NULL);
+
+	if ((info->offset + info->len > FRAG_DATA_MAX)
+			|| (info->hdr_len + info->offset + info->len > skb_max_size())
+			|| (!info->last && (info->len % 8 != 0))
+			|| (info->len == 0) || (skb->len > MODOPS_MEM_MAX)) {
+		kstat_inc(&frag_reasm_fails);
+		skb_free(skb);
+		return NULL; /* error: can't be reassembled */
+	}
+
+	n = frag_node(skb);
+	memset(n, 0, sizeof *n);
+	n->offset = info->offset;
+	n->end = info->offset + info->len;
+	n->data_off = info->data_off;
+	n->hdr_len = info->hdr_len;
+
+	out = NULL;
+	sched_lock();
+	{
+		q = frag_queue_find(key);
+		if ((q == NULL) && !dlist_empty(&frag_lru)) {
+			/* The oldest one is given up */
+			kstat_inc(&frag_evictions);
+			frag_queue_free(dlist_first_entry(&frag_lru, struct frag_queue,
+					lru_lnk));
+			q = frag_queue_find(key);
+		}
+		if (q == NULL) {
+			kstat_inc(&frag_reasm_fails);
+			skb_free(skb);
+			goto out;
+		}
+
+		if (info->last ? ((q->len != 0) && (q->len != n->end))
+					: ((q->len != 0) && (n->end > q->len))) {
+			goto drop; /* error: length doesn't match */
+		}
+		if (info->last && (q->root != NULL)) {
+			for (max_skb = q->root; frag_node(max_skb)->right != NULL;
+					max_skb = frag_node(max_skb)->right) { }
+			if (frag_node(max_skb)->end > n->end) {
+				goto drop;
+			}
+		}
+
+		err = 0;
+		q->root = frag_insert(q->root, skb, &err);
+		if (err == -EEXIST) {
+			skb_free(skb);
+			goto out;
+		}
+		else if (err != 0) {
+			goto drop; /* error: overlap */
+		}
+
+		if (info->last) {
+			q->len = n->end;
+		}
+		q->meat += n->end - n->offset;
+		q->mem += skb->len;
+		frag_mem += skb->len;
+		q->expires = frag_now() + MODOPS_TIMEOUT;
+		/* The newest one is the last */
+		dlist_del_init(&q->lru_lnk);
+		dlist_add_prev(&q->lru_lnk, &frag_lru);
+
+		if ((q->len != 0) && (q->meat == q->len)) {
+			out = frag_build(q);
+			if (out == NULL) {
+				kstat_inc(&frag_reasm_fails);
+			}
+			frag_queue_free(q);
+		}
+		else {
+			frag_evict(q);
+			if (frag_mem > MODOPS_MEM_MAX) {
+				kstat_inc(&frag_evictions);
+				frag_queue_free(q);
+			}
+		}
+
+		frag_timer_start();
+		goto out;
+drop:
+		log_debug("drop %p", q);
+		kstat_inc(&frag_reasm_fails);
+		skb_free(skb);
+		frag_queue_free(q);
+		frag_timer_start();
+	}
+out:
+	sched_unlock();
+
+	return out;
+}
+
+static int inet_frag_init(void) {
+	int i;
+
+	for (i = 0; i < MODOPS_HASH_SIZE; i++) {
+		dlist_init(&frag_hash[i]);
+	}
+
+	return timer_init(&frag_timer, TIMER_ONESHOT, frag_timer_handler, NULL);
+}
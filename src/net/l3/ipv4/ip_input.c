@@ -15,6 +15,8 @@
 
 #include <util/log.h>
 
+#include <kernel/kstat.h>
+
 #include <net/l3/ipv4/ip.h>
 #include <net/l3/ipv4/ip_options.h>
 #include <net/l3/icmpv4.h>
@@ -32,6 +34,8 @@
 
 EMBOX_NET_PACK(ETH_P_IP, ip_rcv);
 
+KSTAT_COUNTER_DEF(ip_rx_drops, "net/ipv4/rx_drops");
+
 static int ip_rcv(struct sk_buff *skb, struct net_device *dev) {
 	net_device_stats_t *stats = &dev->stats;
 	const struct net_proto *nproto;
@@ -54,6 +58,7 @@ static int ip_rcv(struct sk_buff *skb, struct net_device *dev) {
 			|| skb->len < dev->hdr_len + IP_HEADER_SIZE(iph)) {
 		log_debug("ip_rcv: invalid IPv4 header length");
 		stats->rx_length_errors++;
+		kstat_inc(&ip_rx_drops);
 		skb_free(skb);
 		return 0; /* error: invalid header length */
 	}
@@ -62,6 +67,7 @@ static int ip_rcv(struct sk_buff *skb, struct net_device *dev) {
 	if (iph->version != 4) {
 		log_debug("ip_rcv: invalid IPv4 version");
 		stats->rx_err++;
+		kstat_inc(&ip_rx_drops);
 		skb_free(skb);
 		return 0; /* error: not ipv4 */
 	}
@@ -72,6 +78,7 @@ static int ip_rcv(struct sk_buff *skb, struct net_device *dev) {
 		log_debug("ip_rcv: invalid checksum %hx(%hx)",
 				ntohs(old_check), ntohs(iph->check));
 		stats->rx_crc_errors++;
+		kstat_inc(&ip_rx_drops);
 		skb_free(skb);
 		return 0; /* error: invalid crc */
 	}
@@ -81,6 +88,7 @@ static int ip_rcv(struct sk_buff *skb, struct net_device *dev) {
 			|| skb->len < dev->hdr_len + ip_len) {
 		log_debug("ip_rcv: invalid IPv4 length");
 		stats->rx_length_errors++;
+		kstat_inc(&ip_rx_drops);
 		skb_free(skb);
 		return 0; /* error: invalid length */
 	}
@@ -92,6 +100,7 @@ static int ip_rcv(struct sk_buff *skb, struct net_device *dev) {
 	if (0 != nf_test_skb(NF_CHAIN_INPUT, NF_TARGET_ACCEPT, skb)) {
 		log_debug("ip_rcv: dropped by input netfilter");
 		stats->rx_dropped++;
+		kstat_inc(&ip_rx_drops);
 		skb_free(skb);
 		return 0; /* error: dropped */
 	}
@@ -100,6 +109,7 @@ static int ip_rcv(struct sk_buff *skb, struct net_device *dev) {
 	assert(skb->dev);
 	if (!inetdev_get_by_dev(skb->dev)) {
 		log_debug("ip_rcv: dropped by input  because inet_dev is not set");
+		kstat_inc(&ip_rx_drops);
 		skb_free(skb);
 		return 0; /* didn't set inet dev yet */
 	}
@@ -118,6 +128,7 @@ static int ip_rcv(struct sk_buff *skb, struct net_device *dev) {
 			if (0 != nf_test_skb(NF_CHAIN_FORWARD, NF_TARGET_ACCEPT, skb)) {
 				log_debug("ip_rcv: dropped by forward netfilter");
 				stats->rx_dropped++;
+				kstat_inc(&ip_rx_drops);
 				skb_free(skb);
 				return 0; /* error: dropped */
 			}
@@ -140,12 +151,14 @@ static int ip_rcv(struct sk_buff *skb, struct net_device *dev) {
 		if (ip_options_compile(skb, opts)) {
 			log_debug("ip_rcv: invalid options");
 			stats->rx_err++;
+			kstat_inc(&ip_rx_drops);
 			skb_free(skb);
 			return 0; /* error: bad ops */
 		}
 		if (ip_options_handle_srr(skb)) {
 			log_debug("ip_rcv: can't handle options");
 			stats->tx_err++;
+			kstat_inc(&ip_rx_drops);
 			skb_free(skb);
 			return 0; /* error: can't handle ops */
 		}
@@ -176,6 +189,7 @@ static int ip_rcv(struct sk_buff *skb, struct net_device *dev) {
 	}
 
 	log_debug("ip_rcv: unknown protocol %d", iph->proto);
+	kstat_inc(&ip_rx_drops);
 	skb_free(skb);
 	return 0; /* error: nobody wants this packet */
 }
@@ -0,0 +1,69 @@
+/**
+ * @file
+ * @brief Reassembly of IPv6 fragments
+ *
+ * @date 19.10.2026
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <net/skbuff.h>
+#include <net/l3/ipv6.h>
+#include <net/l3/inet_frag.h>
+
+struct sk_buff *ip6_defrag(struct sk_buff *skb) {
+	struct inet_frag_key key;
+	struct inet_frag_info info;
+	struct ip6hdr *ip6h;
+	struct ip6_frag_hdr *fh;
+	size_t payload_len;
+
+	assert(skb != NULL);
+
+	ip6h = ip6_hdr(skb);
+	assert(ip6h->nexthdr == IP6_NEXTHDR_FRAGMENT);
+
+	/* Fragment header follows the fixed one, others aren't parsed */
+	payload_len = ntohs(ip6h->payload_len);
+	if (payload_len <= sizeof *fh) {
+		skb_free(skb);
+		return NULL; /* error: invalid length */
+	}
+	fh = (struct ip6_frag_hdr *)(skb->nh.raw + IP6_HEADER_SIZE);
+
+	memset(&key, 0, sizeof key);
+	key.family = AF_INET6;
+	memcpy(&key.saddr.in6, &ip6h->saddr, sizeof key.saddr.in6);
+	memcpy(&key.daddr.in6, &ip6h->daddr, sizeof key.daddr.in6);
+	key.id = ntohl(fh->identification);
+	key.proto = fh->nexthdr;
+
+	info.offset = ntohs(fh->frag_off) & IP6_FRAG_OFFSET;
+	info.len = payload_len - sizeof *fh;
+	info.data_off = (unsigned char *)(fh + 1) - skb->mac.raw;
+	/* Fragment header isn't a part of the datagram */
+	info.hdr_len = skb->nh.raw + IP6_HEADER_SIZE - skb->mac.raw;
+	info.last = !(ntohs(fh->frag_off) & IP6_FRAG_MF);
+
+	if ((info.offset == 0) && info.last) {
+		/* Atomic fragment (RFC 6946) */
+		memmove(fh, fh + 1, info.len);
+		ip6h->nexthdr = key.proto;
+		ip6h->payload_len = htons(info.len);
+		skb->len -= sizeof *fh;
+		return skb;
+	}
+
+	skb = inet_frag_add(&key, skb, &info);
+	if (skb == NULL) {
+		return NULL;
+	}
+
+	ip6h = ip6_hdr(skb);
+	ip6h->nexthdr = key.proto;
+	ip6h->payload_len = htons(skb->len - info.hdr_len);
+
+	return skb;
+}
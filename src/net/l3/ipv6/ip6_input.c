@@ -48,6 +48,14 @@ static int ip6_rcv(struct sk_buff *skb, struct net_device *dev) {
 //		return 0; /* error: not for us */
 	}
 
+	if (ip6h->nexthdr == IP6_NEXTHDR_FRAGMENT) {
+		skb = ip6_defrag(skb);
+		if (skb == NULL) {
+			return 0; /* ok: waits for the rest */
+		}
+		ip6h = ip6_hdr(skb);
+	}
+
 	/* Setup transport layer header */
 	skb->h.raw = skb->nh.raw + IP6_HEADER_SIZE;
 
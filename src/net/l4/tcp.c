@@ -20,6 +20,7 @@
 #include <arpa/inet.h>
 
 #include <net/l4/tcp.h>
+#include <net/l4/tcp_cong.h>
 #include <net/skbuff.h>
 #include <net/sock.h>
 
@@ -34,9 +35,19 @@
 #include <net/lib/ipv6.h>
 #include <net/lib/tcp.h>
 
+#include <util/array.h>
+#include <util/math.h>
+#include <util/dlist.h>
+#include <util/err.h>
+#include <util/member.h>
+#include <util/mpmc_ring.h>
+#include <mem/misc/pool.h>
+
+#include <kernel/time/time.h>
 #include <kernel/time/timer.h>
 #include <kernel/sched/sched_lock.h>
 #include <kernel/time/ktime.h>
+#include <kernel/kstat.h>
 
 #include <fs/idesc.h>
 #include <fs/idesc_event.h>
@@ -53,6 +64,27 @@ EMBOX_NET_PROTO(ETH_P_IPV6, IPPROTO_TCP, tcp_rcv,
 		net_proto_handle_error_none);
 
 #define MODOPS_VERIFY_CHKSUM OPTION_GET(BOOLEAN, verify_chksum)
+#define MODOPS_AMOUNT_TW_SOCK OPTION_GET(NUMBER, amount_tw_sock)
+#define MODOPS_SACK           OPTION_GET(BOOLEAN, sack)
+#define MODOPS_TIMESTAMPS     OPTION_GET(BOOLEAN, timestamps)
+#define MODOPS_WINDOW_SCALING OPTION_GET(BOOLEAN, window_scaling)
+#define MODOPS_RCVBUF_MAX     OPTION_GET(NUMBER, rcvbuf_max)
+#define MODOPS_AMOUNT_REQ_SOCK    OPTION_GET(NUMBER, amount_req_sock)
+#define MODOPS_AMOUNT_LISTEN_SOCK OPTION_GET(NUMBER, amount_listen_sock)
+#define MODOPS_ACCEPT_QUEUE_LEN   OPTION_GET(NUMBER, accept_queue_len)
+#define MODOPS_SYN_COOKIES        OPTION_GET(BOOLEAN, syn_cookies)
+
+/* Options offered in SYN */
+#define TCP_OPT_F_SUPPORTED \
+	((MODOPS_WINDOW_SCALING ? TCP_OPT_F_WS : 0) \
+		| (MODOPS_SACK ? TCP_OPT_F_SACK : 0) \
+		| (MODOPS_TIMESTAMPS ? TCP_OPT_F_TS : 0))
+
+KSTAT_COUNTER_DEF(tcp_retransmits, "net/tcp/retransmits");
+KSTAT_COUNTER_DEF(tcp_rst_sent, "net/tcp/rst_sent");
+KSTAT_COUNTER_DEF(tcp_rx_drops, "net/tcp/rx_drops");
+KSTAT_COUNTER_DEF(tcp_listen_drops, "net/tcp/listen_drops");
+KSTAT_COUNTER_DEF(tcp_syncookies_sent, "net/tcp/syncookies_sent");
 
 #if OPTION_GET(NUMBER, log_level) >= LOG_DEBUG
 #define TCP_DEBUG 1
@@ -88,17 +120,47 @@ enum tcp_ret_code {
 	TCP_RET_FREE      /* drop packet and free socket */
 };
 
+/* Scoreboard of a segment in tx_queue (RFC 6675), kept in skb->cb */
+struct tcp_skb_cb {
+	unsigned int sacked;  /* Peer has it, as SACK says */
+	unsigned int lost;    /* To be retransmitted */
+	unsigned int retrans; /* Retransmitted since marked lost */
+};
+static_assert(sizeof(struct tcp_skb_cb) <= member_sizeof(struct sk_buff, cb));
+
+static inline struct tcp_skb_cb *tcp_skb_cb(struct sk_buff *skb) {
+	return (struct tcp_skb_cb *)&skb->cb[0];
+}
+
+struct tcp_sack_block {
+	uint32_t start;
+	uint32_t end;
+};
+
+/* Options of a received segment */
+struct tcp_opts {
+	unsigned int flags;         /* TCP_OPT_F_xxx present */
+	uint16_t mss;               /* Zero if not present */
+	uint8_t wscale;
+	uint32_t tsval;
+	uint32_t tsecr;
+	unsigned int sack_cnt;
+	struct tcp_sack_block sack[TCP_SACK_BLOCKS_MAX];
+};
+
 /* Type of TCP state handlers */
 typedef enum tcp_ret_code (*tcp_handler_t)(struct tcp_sock *tcp_sk,
 		const struct tcphdr *tcph, struct sk_buff *skb,
 		struct tcphdr *out_tcph);
 
-static struct sys_timer tcp_tmr_default; /* Timer structure for rexmitting or TIME-WAIT satate */
-
 /* Prototypes */
 static int tcp_handle(struct tcp_sock *tcp_sk, struct sk_buff *skb, tcp_handler_t hnd);
 static const tcp_handler_t tcp_st_handler[];
 static void tcp_get_now(struct timeval *out_now);
+static void tcp_listen_release(struct tcp_sock *tcp_sk);
+static void tcp_req_syn(struct tcp_sock *listener, struct sk_buff *skb);
+static enum tcp_ret_code tcp_req_ack(struct tcp_sock *listener,
+		struct sk_buff *skb);
 
 /************************ Debug functions ******************************/
 #if !TCP_DEBUG
@@ -183,10 +245,8 @@ void tcp_sock_unlock(struct tcp_sock *tcp_sk, unsigned int obj) {
 
 void tcp_seq_state_set_wind_value(struct tcp_seq_state *tcp_seq_st,
 		uint16_t value) {
-	if (tcp_seq_st->wind.value != value) {
-		tcp_seq_st->wind.value = value;
-		tcp_seq_st->wind.size = value << tcp_seq_st->wind.factor;
-	}
+	tcp_seq_st->wind.value = value;
+	tcp_seq_st->wind.size = (uint32_t)value << tcp_seq_st->wind.factor;
 }
 
 void tcp_seq_state_set_wind_factor(struct tcp_seq_state *tcp_seq_st,
@@ -197,19 +257,116 @@ void tcp_seq_state_set_wind_factor(struct tcp_seq_state *tcp_seq_st,
 	}
 }
 
-static void tcp_sock_rcv(struct tcp_sock *tcp_sk,
+/* Passes new data of the segment to the socket, advances rem.seq */
+static void tcp_sock_rcv_data(struct tcp_sock *tcp_sk,
 		struct sk_buff *skb) {
-	size_t seq_off;
+	size_t seq_off, data_len;
 
 	assert(tcp_sk != NULL);
 	assert(skb != NULL);
 	assert(tcp_sk->rem.seq >= ntohl(skb->h.th->seq)); /* FIXME */
 	seq_off = tcp_sk->rem.seq - ntohl(skb->h.th->seq);
+	data_len = tcp_data_length(skb->h.th, skb->nh.raw);
 
-	assert(tcp_data_length(skb->h.th, skb->nh.raw) > seq_off);
+	assert(data_len > seq_off);
+	tcp_sk->rcv_mss = max(tcp_sk->rcv_mss, (uint32_t)data_len);
+	tcp_sk->rem.seq += data_len - seq_off;
 	sock_rcv(to_sock(tcp_sk), skb, skb->h.raw
 			+ TCP_HEADER_SIZE(skb->h.th) + seq_off,
-			tcp_data_length(skb->h.th, skb->nh.raw) - seq_off);
+			data_len - seq_off);
+}
+
+/**
+ * Keeps a segment that came after a hole, sorted by sequence number.
+ * There is no balanced tree here, but segments mostly extend the last
+ * block, so the list is searched from the tail.
+ */
+static void tcp_ofo_queue(struct tcp_sock *tcp_sk, struct sk_buff *skb) {
+	struct sk_buff_head *queue;
+	struct sk_buff *pos;
+	uint32_t seq, len, pos_seq;
+
+	queue = &tcp_sk->ofo_queue;
+	seq = ntohl(skb->h.th->seq);
+	len = tcp_data_length(skb->h.th, skb->nh.raw);
+
+	if (tcp_sk->ofo_len + len > tcp_sk->rcv_buf) {
+		skb_free(skb); /* no space */
+		return;
+	}
+
+	for (pos = queue->prev; !skb_queue_end(pos, queue);
+			pos = pos->lnk.prev) {
+		pos_seq = ntohl(pos->h.th->seq);
+		if ((int32_t)(seq - pos_seq) >= 0) {
+			if ((int32_t)(seq + len - pos_seq
+					- tcp_data_length(pos->h.th, pos->nh.raw)) <= 0) {
+				skb_free(skb); /* already have it */
+				return;
+			}
+			break;
+		}
+	}
+
+	list_move((struct list_head *)skb, (struct list_head *)pos);
+	tcp_sk->ofo_len += len;
+	tcp_sk->ofo_recent = seq;
+	/* The peer needs ACKs to recover quickly */
+	tcp_sk->quickack = TCP_QUICKACK_SEGS;
+}
+
+/* Moves segments the hole no longer separates to the socket */
+static void tcp_ofo_drain(struct tcp_sock *tcp_sk) {
+	struct sk_buff *skb;
+	uint32_t seq, len;
+
+	while (NULL != (skb = skb_queue_front(&tcp_sk->ofo_queue))) {
+		seq = ntohl(skb->h.th->seq);
+		if ((int32_t)(seq - tcp_sk->rem.seq) > 0) {
+			break;
+		}
+		len = tcp_data_length(skb->h.th, skb->nh.raw);
+		tcp_sk->ofo_len -= len;
+		if ((int32_t)(seq + len - tcp_sk->rem.seq) <= 0) {
+			skb_free(skb);
+			continue;
+		}
+		tcp_sock_rcv_data(tcp_sk, skb);
+	}
+}
+
+/* Returns non-zero if the data came when there was a hole */
+static int tcp_sock_rcv(struct tcp_sock *tcp_sk,
+		struct sk_buff *skb) {
+	tcp_sock_rcv_data(tcp_sk, skb);
+	if (tcp_sk->ofo_len != 0) {
+		tcp_ofo_drain(tcp_sk);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * In-order data was received. ACK is sent at once for every second
+ * full-sized segment, in quick ACK mode and when the data is about a
+ * hole. Otherwise it waits for data to piggyback on (RFC 1122).
+ */
+static enum tcp_ret_code tcp_ack_rcvd(struct tcp_sock *tcp_sk,
+		struct tcphdr *out_tcph, size_t data_len, int hole) {
+	tcp_sk->ack_pending += data_len;
+	if (!hole && (tcp_sk->quickack == 0)
+			&& (tcp_sk->ack_pending < 2 * tcp_sk->rcv_mss)) {
+		if (!tcp_timer_pending(tcp_sk, TCP_TIMER_DELACK)) {
+			tcp_timer_set(tcp_sk, TCP_TIMER_DELACK, TCP_DELACK_DELAY);
+		}
+		return TCP_RET_OK;
+	}
+
+	if (tcp_sk->quickack != 0) {
+		--tcp_sk->quickack;
+	}
+	tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+	return TCP_RET_SEND_ALLOC;
 }
 
 void tcp_sock_set_state(struct tcp_sock *tcp_sk,
@@ -254,19 +411,9 @@ void tcp_sock_set_state(struct tcp_sock *tcp_sk,
 	case TCP_ESTABIL: /* new connection */
 		/* enable writing when connection is established */
 		sock_notify(sk, POLLOUT); /* FIXME tcp_sock was notified earlier at line 911 */
-		/* enable reading for listening (parent) socket */
-		if (tcp_sk->parent != NULL) {
-			tcp_sock_lock(tcp_sk->parent, TCP_SYNC_CONN_QUEUE);
-			{
-				list_move_tail(&tcp_sk->conn_lnk, &tcp_sk->parent->conn_ready);
-			}
-			tcp_sock_unlock(tcp_sk->parent, TCP_SYNC_CONN_QUEUE);
-			assert(to_sock(tcp_sk->parent) != NULL);
-
-			//FIXME tcp_accept must notify without rx_data_len
-			to_sock(tcp_sk->parent)->rx_data_len++;
-			sock_notify(to_sock(tcp_sk->parent), POLLIN);
-		}
+		tcp_keepalive_update(tcp_sk);
+		/* Don't delay ACKs while the peer is in slow start */
+		tcp_sk->quickack = TCP_QUICKACK_SEGS;
 		break;
 	case TCP_CLOSEWAIT: /* throw error: can't read */
 		sock_update_err(sk, ECONNRESET);
@@ -310,906 +457,2619 @@ static void tcp_get_now(struct timeval *out_now) {
 	ktime_get_timeval(out_now);
 }
 
-static int tcp_is_expired(struct timeval *since, useconds_t limit_msec) {
-	struct timeval now, delta, limit;
+static uint32_t tcp_usec_since(const struct timeval *since) {
+	struct timeval now, delta;
 
 	ktime_get_timeval(&now);
 	timersub(&now, since, &delta);
-	limit.tv_sec = limit_msec / MSEC_PER_SEC;
-	limit.tv_usec = (limit_msec % MSEC_PER_SEC) * USEC_PER_MSEC;
 
-	return timercmp(&delta, &limit, >=);
+	return delta.tv_sec * USEC_PER_SEC + delta.tv_usec;
 }
 
-static void tcp_xmit(struct sk_buff *skb,
-		const struct tcp_sock *tcp_sk,
-		const struct net_pack_out_ops *out_ops) {
-	assert(skb != NULL);
+/* RFC 6298 */
+static void tcp_rtt_sample(struct tcp_sock *tcp_sk, uint32_t rtt) {
+	uint32_t err, rto;
 
-	packet_print(tcp_sk, skb, "<=",
-			ip_hdr(skb)->version == 4 ? AF_INET : AF_INET6,
-			ip_hdr(skb)->version == 4 ?
-					(void *)&ip_hdr(skb)->daddr : (void *)&ip6_hdr(skb)->daddr,
-			tcp_hdr(skb)->dest);
+	if (tcp_sk->srtt == 0) {
+		tcp_sk->srtt = max(rtt, 1U);
+		tcp_sk->rttvar = rtt / 2;
+	}
+	else {
+		err = tcp_sk->srtt > rtt ? tcp_sk->srtt - rtt : rtt - tcp_sk->srtt;
+		tcp_sk->rttvar = (3 * tcp_sk->rttvar + err) / 4;
+		tcp_sk->srtt = max((7 * tcp_sk->srtt + rtt) / 8, 1U);
+	}
 
-	out_ops = out_ops != NULL ? out_ops :
-			tcp_sk != NULL ? to_sock(tcp_sk)->o_ops : NULL;
+	/* Variation is never less than the timer granularity */
+	rto = tcp_sk->srtt + max(4 * tcp_sk->rttvar,
+			(uint32_t)(TCP_TIMER_GRANULARITY * USEC_PER_MSEC));
+	tcp_sk->rto = clamp(rto / (uint32_t)USEC_PER_MSEC,
+			(uint32_t)TCP_RTO_MIN, (uint32_t)TCP_RTO_MAX);
 
-	if (out_ops != NULL) {
-		int ret = out_ops->snd_pack(skb);
-		if (ret != 0) {
-			log_debug("snd_pack = %d", ret);
-		}
+	if (tcp_sk->cong->rtt_sample) {
+		tcp_sk->cong->rtt_sample(tcp_sk, rtt);
 	}
+
+	log_debug("sk %p rtt %u srtt %u rttvar %u rto %u", to_sock(tcp_sk),
+			rtt, tcp_sk->srtt, tcp_sk->rttvar, tcp_sk->rto);
 }
 
-static void tcp_rexmit(struct tcp_sock *tcp_sk) {
-	struct sk_buff *skb, *skb_send;
+static uint32_t tcp_now(void) {
+	return ktime_get_ns() / NSEC_PER_MSEC;
+}
 
-	tcp_sock_lock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
-	{
-		skb = skb_queue_front(&to_sock(tcp_sk)->tx_queue);
-		if (skb == NULL) {
-			/**
-			 * TODO
-			 * self.seq is set in the function up the stack,
-			 * so assert may trigger falsely. Need add lock
-			 * and after that it will be correct.
-			 */
-			/* assert(sock.tcp_sk->last_ack == sock.tcp_sk->self.seq); */
-			tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
-			return;
+/************************ TCP options **********************************/
+static inline uint32_t tcp_opt_get32(const uint8_t *ptr) {
+	return ((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16)
+			| ((uint32_t)ptr[2] << 8) | ptr[3];
+}
+
+static inline void tcp_opt_put32(uint8_t *ptr, uint32_t val) {
+	ptr[0] = val >> 24;
+	ptr[1] = val >> 16;
+	ptr[2] = val >> 8;
+	ptr[3] = val;
+}
+
+static void tcp_opts_parse(const struct tcphdr *tcph,
+		struct tcp_opts *opts) {
+	const uint8_t *ptr, *end;
+	unsigned int i, len;
+
+	memset(opts, 0, sizeof *opts);
+
+	ptr = (const uint8_t *)&tcph->options[0];
+	end = (const uint8_t *)tcph + TCP_HEADER_SIZE(tcph);
+	while ((ptr < end) && (*ptr != TCP_OPT_KIND_EOL)) {
+		if (*ptr == TCP_OPT_KIND_NOP) {
+			++ptr;
+			continue;
 		}
-		skb_send = skb_clone(skb);
-		if (skb_send == NULL) {
-			tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
-			return;
+		if ((end - ptr < 2) || (ptr[1] < 2) || (ptr[1] > end - ptr)) {
+			break; /* malformed */
+		}
+		len = ptr[1];
+		switch (*ptr) {
+		case TCP_OPT_KIND_MSS:
+			if (len == 4) {
+				opts->mss = (ptr[2] << 8) | ptr[3];
+			}
+			break;
+		case TCP_OPT_KIND_WS:
+			if (len == 3) {
+				opts->flags |= TCP_OPT_F_WS;
+				opts->wscale = min(ptr[2], (uint8_t)TCP_WINDOW_FACTOR_MAX);
+			}
+			break;
+		case TCP_OPT_KIND_SACK:
+			if (len == 2) {
+				opts->flags |= TCP_OPT_F_SACK;
+			}
+			break;
+		case TCP_OPT_KIND_SACK_BLOCK:
+			for (i = 0; (i < (len - 2) / 8)
+					&& (opts->sack_cnt < TCP_SACK_BLOCKS_MAX); i++) {
+				opts->sack[opts->sack_cnt].start
+						= tcp_opt_get32(ptr + 2 + 8 * i);
+				opts->sack[opts->sack_cnt].end
+						= tcp_opt_get32(ptr + 6 + 8 * i);
+				opts->sack_cnt++;
+			}
+			break;
+		case TCP_OPT_KIND_TS:
+			if (len == 10) {
+				opts->flags |= TCP_OPT_F_TS;
+				opts->tsval = tcp_opt_get32(ptr + 2);
+				opts->tsecr = tcp_opt_get32(ptr + 6);
+			}
+			break;
 		}
-		log_debug("send skb %p, postponed %p", skb_send, skb);
+		ptr += len;
 	}
-	tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
-
-	tcp_xmit(skb_send, tcp_sk, NULL);
 }
 
-static void send_rst_reply(struct sk_buff *skb) {
-	struct tcphdr old_tcph, *tcph;
-	size_t tcph_size, old_seq_len;
-	const struct net_pack_out_ops *out_ops;
-
-	memcpy(&old_tcph, tcp_hdr(skb), sizeof old_tcph);
-	old_seq_len = tcp_seq_length(&old_tcph, skb->nh.raw);
-	tcph_size = TCP_MIN_HEADER_SIZE;
+static uint8_t *tcp_opt_find(struct tcphdr *tcph, uint8_t kind) {
+	uint8_t *ptr, *end;
 
-	out_ops = ip_hdr(skb)->version == 4 ? ip_out_ops : ip6_out_ops;
-	if (out_ops == NULL) {
-		return; /* error: not implemented */
+	ptr = (uint8_t *)&tcph->options[0];
+	end = (uint8_t *)tcph + TCP_HEADER_SIZE(tcph);
+	while ((ptr < end) && (*ptr != TCP_OPT_KIND_EOL)) {
+		if (*ptr == TCP_OPT_KIND_NOP) {
+			++ptr;
+			continue;
+		}
+		if ((end - ptr < 2) || (ptr[1] < 2)) {
+			break;
+		}
+		if (*ptr == kind) {
+			return ptr;
+		}
+		ptr += ptr[1];
 	}
+	return NULL;
+}
 
-	/* make packet with L3 header */
-	assert(out_ops->make_pack != NULL);
-	if (0 != out_ops->make_pack(NULL, NULL, &tcph_size, &skb)) {
-		return; /* error: see ret */
+/* Puts @a cur to @a blocks, the block with the latest segment first */
+static void tcp_sack_block_add(struct tcp_sock *tcp_sk,
+		struct tcp_sack_block *blocks, unsigned int *cnt,
+		unsigned int max_cnt, const struct tcp_sack_block *cur) {
+	unsigned int i;
+
+	if (((int32_t)(tcp_sk->ofo_recent - cur->start) >= 0)
+			&& ((int32_t)(tcp_sk->ofo_recent - cur->end) < 0)) {
+		i = *cnt < max_cnt ? (*cnt)++ : max_cnt - 1;
+		for (; i > 0; i--) {
+			blocks[i] = blocks[i - 1];
+		}
+		blocks[0] = *cur;
 	}
-	else if (tcph_size < TCP_MIN_HEADER_SIZE) {
-		skb_free(skb);
-		return; /* error: no memory */
+	else if (*cnt < max_cnt) {
+		blocks[(*cnt)++] = *cur;
 	}
+}
 
-	/* build TCP header */
-	tcph = tcp_hdr(skb);
-	tcp_build(tcph, old_tcph.source, old_tcph.dest, TCP_MIN_HEADER_SIZE, 0);
-
-	tcph->rst = 1;
-	if (old_tcph.ack) {
-		tcp_set_seq_field(tcph, ntohl(old_tcph.ack_seq));
+/* Blocks of data kept in ofo_queue (RFC 2018) */
+static unsigned int tcp_sack_blocks(struct tcp_sock *tcp_sk,
+		struct tcp_sack_block *blocks, unsigned int max_cnt) {
+	struct sk_buff_head *queue;
+	struct sk_buff *skb;
+	struct tcp_sack_block cur;
+	unsigned int cnt;
+	uint32_t seq, end;
+
+	cnt = 0;
+	queue = &tcp_sk->ofo_queue;
+	if ((max_cnt == 0) || (tcp_sk->ofo_len == 0)) {
+		return 0;
 	}
-	else {
-		tcp_set_seq_field(tcph, 0);
-		tcp_set_ack_field(tcph, ntohl(old_tcph.seq) + old_seq_len);
+
+	cur.start = cur.end = ntohl(queue->next->h.th->seq);
+	for (skb = queue->next; !skb_queue_end(skb, queue);
+			skb = skb_queue_next(skb)) {
+		seq = ntohl(skb->h.th->seq);
+		end = seq + tcp_data_length(skb->h.th, skb->nh.raw);
+		if ((int32_t)(seq - cur.end) > 0) {
+			tcp_sack_block_add(tcp_sk, blocks, &cnt, max_cnt, &cur);
+			cur.start = seq;
+		}
+		if ((int32_t)(end - cur.end) > 0) {
+			cur.end = end;
+		}
 	}
-	tcp_set_check_field(tcph, skb->nh.raw);
+	tcp_sack_block_add(tcp_sk, blocks, &cnt, max_cnt, &cur);
 
-	/* send over L3 */
-	tcp_xmit(skb, NULL, out_ops);
+	return cnt;
 }
 
-/**
- * Send any packet without sequence (i.e. seq_len is 0)
- */
-static void send_nonseq_from_sock(struct tcp_sock *tcp_sk,
-		struct sk_buff *skb) {
-	log_debug("send %p", skb);
-	tcp_set_seq_field(skb->h.th, tcp_sk->self.seq);
-	tcp_set_check_field(skb->h.th, skb->nh.raw);
-	tcp_xmit(skb, tcp_sk, NULL);
+static size_t tcp_opt_len_syn(unsigned int flags) {
+	flags &= TCP_OPT_F_SUPPORTED;
+	/* MSS, SACK permitted with timestamps, window scale */
+	return 4 + (flags & TCP_OPT_F_TS ? TCP_OPT_LEN_TS
+				: flags & TCP_OPT_F_SACK ? 4 : 0)
+			+ (flags & TCP_OPT_F_WS ? 4 : 0);
 }
 
-/**
- * Send a data, only
- */
-void send_seq_from_sock(struct tcp_sock *tcp_sk, struct sk_buff *skb) {
-	struct sk_buff *skb_send;
-
-	assert(tcp_sk != NULL);
-	assert(skb != NULL);
-
-	skb_send = skb_clone(skb);
+size_t tcp_opt_len(struct tcp_sock *tcp_sk, int syn, int sack) {
+	struct tcp_sack_block blocks[TCP_SACK_BLOCKS_MAX];
+	unsigned int cnt;
+	size_t len;
 
-	log_debug("send %p = %p", skb, skb_send);
+	if (syn) {
+		return tcp_opt_len_syn(tcp_sk->opt_flags);
+	}
 
-	tcp_sock_lock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
-	{
-		tcp_set_seq_field(skb->h.th, tcp_sk->self.seq);
-		tcp_set_check_field(skb->h.th, skb->nh.raw);
-		if (skb_send != NULL) {
-			/* set to cloned pkg */
-			memcpy(skb_send->h.th, skb->h.th, sizeof *skb->h.th);
+	len = tcp_sk->opt_flags & TCP_OPT_F_TS ? TCP_OPT_LEN_TS : 0;
+	if (sack && (tcp_sk->opt_flags & TCP_OPT_F_SACK)) {
+		cnt = tcp_sack_blocks(tcp_sk, blocks, (40 - len - 4) / 8);
+		if (cnt != 0) {
+			len += 4 + 8 * cnt;
 		}
-		assert(to_sock(tcp_sk) != NULL);
-		skb_queue_push(&to_sock(tcp_sk)->tx_queue, skb);
-		tcp_sk->self.seq += tcp_seq_length(skb->h.th, skb->nh.raw);
 	}
-	tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+	return len;
+}
 
-	if (skb_send != NULL) {
-		tcp_xmit(skb_send, tcp_sk, NULL);
+/* SYN is also sent for a connection without a socket yet, so all
+ * that goes to the options is passed */
+static uint8_t *tcp_opt_build_syn(uint8_t *ptr, unsigned int flags,
+		uint8_t wscale, uint32_t ts_recent) {
+	flags &= TCP_OPT_F_SUPPORTED;
+
+	*ptr++ = TCP_OPT_KIND_MSS;
+	*ptr++ = 4;
+	*ptr++ = TCP_MSS_ADVERTISED >> 8;
+	*ptr++ = TCP_MSS_ADVERTISED & 0xff;
+	if (flags & TCP_OPT_F_TS) {
+		if (flags & TCP_OPT_F_SACK) {
+			*ptr++ = TCP_OPT_KIND_SACK;
+			*ptr++ = 2;
+		}
+		else {
+			*ptr++ = TCP_OPT_KIND_NOP;
+			*ptr++ = TCP_OPT_KIND_NOP;
+		}
+		*ptr++ = TCP_OPT_KIND_TS;
+		*ptr++ = 10;
+		tcp_opt_put32(ptr, tcp_now());
+		tcp_opt_put32(ptr + 4, ts_recent);
+		ptr += 8;
+	}
+	else if (flags & TCP_OPT_F_SACK) {
+		*ptr++ = TCP_OPT_KIND_NOP;
+		*ptr++ = TCP_OPT_KIND_NOP;
+		*ptr++ = TCP_OPT_KIND_SACK;
+		*ptr++ = 2;
 	}
+	if (flags & TCP_OPT_F_WS) {
+		*ptr++ = TCP_OPT_KIND_NOP;
+		*ptr++ = TCP_OPT_KIND_WS;
+		*ptr++ = 3;
+		*ptr++ = wscale;
+	}
+
+	return ptr;
 }
 
-void tcp_sock_release(struct tcp_sock *tcp_sk) {
-	struct tcp_sock *anticipant;
+void tcp_opt_build(struct tcp_sock *tcp_sk, struct tcphdr *tcph,
+		size_t opt_len) {
+	struct tcp_sack_block blocks[TCP_SACK_BLOCKS_MAX];
+	uint8_t *ptr, *end;
+	unsigned int i, cnt;
 
-	if (tcp_sk->parent == NULL) {
-		tcp_sock_lock(tcp_sk, TCP_SYNC_CONN_QUEUE);
-		{
-			list_for_each_entry(anticipant,
-					&tcp_sk->conn_wait, conn_lnk) {
-				sock_release(to_sock(anticipant));
-			}
-			list_for_each_entry(anticipant, &tcp_sk->conn_ready, conn_lnk) {
-				sock_release(to_sock(anticipant));
-			}
-			list_for_each_entry(anticipant, &tcp_sk->conn_free, conn_lnk) {
-				sock_release(to_sock(anticipant));
-			}
+	assert((opt_len & 3) == 0);
+	tcph->doff = (TCP_MIN_HEADER_SIZE + opt_len) / 4;
+
+	ptr = (uint8_t *)&tcph->options[0];
+	end = ptr + opt_len;
+
+	if (tcph->syn) {
+		if (opt_len >= tcp_opt_len(tcp_sk, 1, 0)) {
+			ptr = tcp_opt_build_syn(ptr, tcp_sk->opt_flags,
+					tcp_sk->self.wind.factor, tcp_sk->ts_recent);
 		}
-		tcp_sock_unlock(tcp_sk, TCP_SYNC_CONN_QUEUE);
 	}
 	else {
-		tcp_sock_lock(tcp_sk->parent, TCP_SYNC_CONN_QUEUE);
-		{
-			if (!list_empty(&tcp_sk->conn_lnk)) {
-				list_del(&tcp_sk->conn_lnk);
-				assert(tcp_sk->parent->free_wait_queue_len > 0);
-				--tcp_sk->parent->free_wait_queue_len;
+		if ((tcp_sk->opt_flags & TCP_OPT_F_TS)
+				&& (end - ptr >= TCP_OPT_LEN_TS)) {
+			*ptr++ = TCP_OPT_KIND_NOP;
+			*ptr++ = TCP_OPT_KIND_NOP;
+			*ptr++ = TCP_OPT_KIND_TS;
+			*ptr++ = 10;
+			tcp_opt_put32(ptr, tcp_now());
+			tcp_opt_put32(ptr + 4, tcp_sk->ts_recent);
+			ptr += 8;
+		}
+		if ((tcp_sk->opt_flags & TCP_OPT_F_SACK) && (end - ptr >= 12)) {
+			cnt = tcp_sack_blocks(tcp_sk, blocks, (end - ptr - 4) / 8);
+			if (cnt != 0) {
+				*ptr++ = TCP_OPT_KIND_NOP;
+				*ptr++ = TCP_OPT_KIND_NOP;
+				*ptr++ = TCP_OPT_KIND_SACK_BLOCK;
+				*ptr++ = 2 + 8 * cnt;
+				for (i = 0; i < cnt; i++) {
+					tcp_opt_put32(ptr, blocks[i].start);
+					tcp_opt_put32(ptr + 4, blocks[i].end);
+					ptr += 8;
+				}
 			}
 		}
-		tcp_sock_unlock(tcp_sk->parent, TCP_SYNC_CONN_QUEUE);
 	}
 
-	sock_release(to_sock(tcp_sk));
+	memset(ptr, TCP_OPT_KIND_EOL, end - ptr);
 }
 
+/* Window is the free part of the receive buffer */
+static uint32_t tcp_rcv_space(struct tcp_sock *tcp_sk) {
+	uint32_t used;
 
-/****************** Handlers of TCP states ***********************/
-static enum tcp_ret_code tcp_st_closed(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph, struct sk_buff *skb,
-		struct tcphdr *out_tcph) {
-	log_debug("call tcp_st_closed");
-	assert(tcp_sk->state == TCP_CLOSED);
+	used = to_sock(tcp_sk)->rx_data_len + tcp_sk->ofo_len;
+	return tcp_sk->rcv_buf > used ? tcp_sk->rcv_buf - used : 0;
+}
 
-	return TCP_RET_RST;
+static uint16_t tcp_rcv_window(struct tcp_sock *tcp_sk, int syn) {
+	uint32_t space;
+
+	space = tcp_rcv_space(tcp_sk);
+	if (syn) {
+		/* Window of SYN is never scaled */
+		tcp_sk->self.wind.value = min(space, 0xffffU);
+		tcp_sk->self.wind.size = tcp_sk->self.wind.value;
+	}
+	else {
+		tcp_seq_state_set_wind_value(&tcp_sk->self,
+				min(space >> tcp_sk->self.wind.factor, 0xffffU));
+	}
+	tcp_sk->rcv_adv = tcp_sk->rem.seq + tcp_sk->self.wind.size;
+
+	return tcp_sk->self.wind.value;
 }
 
-static enum tcp_ret_code tcp_st_listen(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph, struct sk_buff *skb,
-		struct tcphdr *out_tcph) {
-	union {
-		struct inet_sock *in;
-		struct inet6_sock *in6;
-	} newsk;
-	struct tcp_sock *tcp_newsk;
+/* ACK, window and timestamps are taken when a segment goes out */
+static void tcp_hdr_refresh(struct tcp_sock *tcp_sk, struct tcphdr *tcph) {
+	uint8_t *ts;
 
-	log_debug("call tcp_st_listen");
-	assert(tcp_sk->state == TCP_LISTEN);
+	tcph->window = htons(tcp_rcv_window(tcp_sk, tcph->syn));
 
-	if (tcph->syn) {
-		/* Check max length of accept queue and reserve 1 place */
-		tcp_sock_lock(tcp_sk, TCP_SYNC_CONN_QUEUE);
-		{
-			if (!list_empty(&tcp_sk->conn_free)) {
-				tcp_newsk = mcast_out(tcp_sk->conn_free.next, struct tcp_sock, conn_lnk);
-				list_del_init(&tcp_newsk->conn_lnk);
-				/* will add it to conn_wait list, no free_wait_queue_len adjustment */
-			} else {
-				log_error("tcp_st_listen: can't alloc socket\n");
-				tcp_newsk = NULL;
-				/* maybe calling thread could allocate more? */
-				sock_notify(to_sock(tcp_sk), POLLIN);
-			}
+	if (tcph->ack) {
+		tcp_set_ack_field(tcph, tcp_sk->rem.seq);
+		if (tcp_sk->ack_pending != 0) {
+			/* Delayed ACK goes with this segment */
+			tcp_sk->ack_pending = 0;
+			tcp_timer_clear(tcp_sk, TCP_TIMER_DELACK);
 		}
-		tcp_sock_unlock(tcp_sk, TCP_SYNC_CONN_QUEUE);
+	}
 
-		if (!tcp_newsk) {
-			return TCP_RET_DROP; /* error: see ret */
+	if (TCP_HEADER_SIZE(tcph) != TCP_MIN_HEADER_SIZE) {
+		ts = tcp_opt_find(tcph, TCP_OPT_KIND_TS);
+		if (ts != NULL) {
+			tcp_opt_put32(ts + 2, tcp_now());
+			tcp_opt_put32(ts + 6, tcp_sk->ts_recent);
 		}
+	}
+}
 
-		log_debug("append sk %p for skb %p to sk %p queue",
-				to_sock(tcp_newsk), skb, to_sock(tcp_sk));
-		/* Set up new socket */
-		if (to_sock(tcp_sk)->opt.so_domain == AF_INET) {
-			assert(ip_hdr(skb)->version == 4);
-			newsk.in = to_inet_sock(to_sock(tcp_newsk));
-			newsk.in->src_in.sin_family = AF_INET;
-			newsk.in->src_in.sin_port = tcph->dest;
-			memcpy(&newsk.in->src_in.sin_addr,
-					&ip_hdr(skb)->daddr,
-					sizeof newsk.in->src_in.sin_addr);
-			newsk.in->dst_in.sin_family = AF_INET;
-			newsk.in->dst_in.sin_port = tcph->source;
-			memcpy(&newsk.in->dst_in.sin_addr,
-					&ip_hdr(skb)->saddr,
-					sizeof newsk.in->dst_in.sin_addr);
-		}
-		else {
-			assert(to_sock(tcp_sk)->opt.so_domain == AF_INET6);
-			assert(ip6_hdr(skb)->version == 6);
-			newsk.in6 = to_inet6_sock(to_sock(tcp_newsk));
-			newsk.in6->src_in6.sin6_family = AF_INET6;
-			newsk.in6->src_in6.sin6_port = tcph->dest;
-			memcpy(&newsk.in6->src_in6.sin6_addr,
-					&ip6_hdr(skb)->daddr,
-					sizeof newsk.in6->src_in6.sin6_addr);
-			newsk.in6->dst_in6.sin6_family = AF_INET6;
-			newsk.in6->dst_in6.sin6_port = tcph->source;
-			memcpy(&newsk.in6->dst_in6.sin6_addr,
-					&ip6_hdr(skb)->saddr,
-					sizeof newsk.in6->dst_in6.sin6_addr);
-		}
-		/* Save new socket to accept queue */
-		tcp_sock_lock(tcp_sk, TCP_SYNC_CONN_QUEUE);
-		{
-			tcp_newsk->parent = tcp_sk;
-			list_add_tail(&tcp_newsk->conn_lnk, &tcp_sk->conn_wait);
-		}
-		tcp_sock_unlock(tcp_sk, TCP_SYNC_CONN_QUEUE);
-		/* Handling skb */
-		tcp_sock_lock(tcp_sk, TCP_SYNC_STATE); /* FIXME */
-		{
-			tcp_sock_set_state(tcp_newsk, TCP_SYN_RECV_PRE); /* TODO remove this */
-			tcp_handle(tcp_newsk, skb, tcp_st_handler[TCP_SYN_RECV_PRE]);
-		}
-		tcp_sock_unlock(tcp_sk, TCP_SYNC_STATE);
+/* Agrees options and takes the window from SYN of the peer */
+static void tcp_syn_rcv(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph) {
+	struct tcp_opts opts;
 
-		return TCP_RET_OK;
+	tcp_opts_parse(tcph, &opts);
+
+	tcp_sk->opt_flags &= opts.flags & TCP_OPT_F_SUPPORTED;
+	if (opts.mss != 0) {
+		tcp_cong_set_mss(tcp_sk, opts.mss);
+	}
+	if (tcp_sk->opt_flags & TCP_OPT_F_TS) {
+		tcp_sk->ts_recent = opts.tsval;
+	}
+	if (!(tcp_sk->opt_flags & TCP_OPT_F_WS)) {
+		/* Both sides scale or none */
+		opts.wscale = 0;
+		tcp_seq_state_set_wind_factor(&tcp_sk->self, 0);
 	}
 
-	return TCP_RET_DROP;
+	/* Window of SYN is never scaled */
+	tcp_sk->rem.wind.factor = opts.wscale;
+	tcp_sk->rem.wind.value = ntohs(tcph->window);
+	tcp_sk->rem.wind.size = tcp_sk->rem.wind.value;
+
+	log_debug("sk %p options %x mss %u wscale %u", to_sock(tcp_sk),
+			tcp_sk->opt_flags, tcp_sk->mss, opts.wscale);
 }
 
-static enum tcp_ret_code tcp_st_syn_sent(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph, struct sk_buff *skb,
-		struct tcphdr *out_tcph) {
-	log_debug("call tcp_st_syn_sent");
-	assert(tcp_sk->state == TCP_SYN_SENT);
+static void tcp_xmit(struct sk_buff *skb,
+		const struct tcp_sock *tcp_sk,
+		const struct net_pack_out_ops *out_ops) {
+	assert(skb != NULL);
 
-	if (tcph->syn) {
-		tcp_sk->rem.seq = ntohl(tcph->seq) + 1;
-		tcp_seq_state_set_wind_value(&tcp_sk->rem,
-				ntohs(tcph->window));
-		if (tcph->ack) {
-			tcp_sock_set_state(tcp_sk, TCP_ESTABIL);
-		} else {
-			tcp_sock_set_state(tcp_sk, TCP_SYN_RECV);
+	packet_print(tcp_sk, skb, "<=",
+			ip_hdr(skb)->version == 4 ? AF_INET : AF_INET6,
+			ip_hdr(skb)->version == 4 ?
+					(void *)&ip_hdr(skb)->daddr : (void *)&ip6_hdr(skb)->daddr,
+			tcp_hdr(skb)->dest);
+
+	out_ops = out_ops != NULL ? out_ops :
+			tcp_sk != NULL ? to_sock(tcp_sk)->o_ops : NULL;
+
+	if (out_ops != NULL) {
+		int ret = out_ops->snd_pack(skb);
+		if (ret != 0) {
+			log_debug("snd_pack = %d", ret);
 		}
-		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
-		return TCP_RET_SEND;
 	}
-
-	return TCP_RET_DROP;
 }
 
-static enum tcp_ret_code tcp_st_syn_recv_pre(
-		struct tcp_sock *tcp_sk, const struct tcphdr *tcph,
-		struct sk_buff *skb, struct tcphdr *out_tcph) {
-	log_debug("call tcp_st_syn_recv_pre");
-	assert(tcp_sk->state == TCP_SYN_RECV_PRE);
+/* Sends a copy of @a skb from tx_queue with fresh ACK, window and TS */
+static void tcp_rexmit_skb(struct tcp_sock *tcp_sk, struct sk_buff *skb) {
+	struct sk_buff *skb_send;
 
-	if (tcph->syn) {
-		tcp_sk->rem.seq = ntohl(tcph->seq) + 1;
-		tcp_seq_state_set_wind_value(&tcp_sk->rem,
-				ntohs(tcph->window));
-		tcp_sock_set_state(tcp_sk, TCP_SYN_RECV);
-		out_tcph->syn = 1;
-		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
-		return TCP_RET_SEND_SEQ;
+	skb_send = skb_clone(skb);
+	if (skb_send == NULL) {
+		return;
 	}
-	return TCP_RET_DROP;
-}
+	log_debug("send skb %p, postponed %p", skb_send, skb);
 
-static enum tcp_ret_code tcp_st_syn_recv(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph, struct sk_buff *skb,
-		struct tcphdr *out_tcph) {
-	log_debug("call tcp_st_syn_recv");
-	assert(tcp_sk->state == TCP_SYN_RECV);
+	tcp_hdr_refresh(tcp_sk, skb_send->h.th);
+	tcp_set_check_field(skb_send->h.th, skb_send->nh.raw);
 
-	if (tcph->ack) {
-		tcp_sock_set_state(tcp_sk, TCP_ESTABIL);
-	}
+	tcp_skb_cb(skb)->retrans = 1;
+	/* Karn's algorithm: ACK of rexmitted data isn't a RTT sample */
+	tcp_sk->rtt_timing = 0;
 
-	return TCP_RET_DROP;
+	kstat_inc(&tcp_retransmits);
+	tcp_xmit(skb_send, tcp_sk, NULL);
 }
 
-static enum tcp_ret_code tcp_st_estabil(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph, struct sk_buff *skb,
-		struct tcphdr *out_tcph) {
-	size_t data_len;
-
-	log_debug("call tcp_st_estabil");
-	assert(tcp_sk->state == TCP_ESTABIL);
+static void tcp_rexmit(struct tcp_sock *tcp_sk) {
+	struct sk_buff *skb;
 
-	data_len = tcp_data_length(skb->h.th, skb->nh.raw);
-	if (data_len > 0) {
-		/* Save current sk_buff_t with data */
-		log_debug("\t received %d", data_len);
-		tcp_sock_rcv(tcp_sk, skb);
-		tcp_sk->rem.seq += data_len;
-		if (tcph->fin) {
-			tcp_sk->rem.seq += 1;
-			tcp_sock_set_state(tcp_sk, TCP_CLOSEWAIT);
+	tcp_sock_lock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+	{
+		skb = skb_queue_front(&to_sock(tcp_sk)->tx_queue);
+		if (skb != NULL) {
+			/**
+			 * TODO
+			 * self.seq is set in the function up the stack,
+			 * so assert may trigger falsely. Need add lock
+			 * and after that it will be correct.
+			 */
+			/* assert(sock.tcp_sk->last_ack == sock.tcp_sk->self.seq); */
+			tcp_rexmit_skb(tcp_sk, skb);
 		}
-		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
-		return TCP_RET_SEND_ALLOC;
-	} else if (tcph->fin) {
-		tcp_sk->rem.seq += 1;
-		tcp_sock_set_state(tcp_sk, TCP_CLOSEWAIT);
-		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
-		return TCP_RET_SEND;
 	}
-
-	return TCP_RET_DROP;
+	tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
 }
 
-static enum tcp_ret_code tcp_st_finwait_1(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph, struct sk_buff *skb,
-		struct tcphdr *out_tcph) {
-	size_t data_len;
-
-	log_debug("call tcp_st_finwait_1");
-	assert(tcp_sk->state == TCP_FINWAIT_1);
+/* Sends an ACK with options and @a seq, not kept for rexmit */
+static void tcp_xmit_ack(struct tcp_sock *tcp_sk, uint32_t seq) {
+	struct sk_buff *skb;
+	struct tcphdr *tcph;
+	size_t opt_len;
 
-	data_len = tcp_data_length(skb->h.th, skb->nh.raw);
-	if (data_len > 0) {
-		/* Save current sk_buff_t with data */
-		log_debug("\t received %d", data_len);
-		tcp_sock_rcv(tcp_sk, skb);
-		tcp_sk->rem.seq += data_len;
-		if (tcph->fin) {
-			tcp_sk->rem.seq += 1;
-			if (tcph->ack) {
-				tcp_sock_set_state(tcp_sk, TCP_TIMEWAIT);
-			} else {
-				tcp_sock_set_state(tcp_sk, TCP_CLOSING);
-			}
-		} else if (tcph->ack) {
-			tcp_sock_set_state(tcp_sk, TCP_FINWAIT_2);
-		}
-		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
-		return TCP_RET_SEND_ALLOC;
-	} else if (tcph->fin) {
-		tcp_sk->rem.seq += 1;
-		if (tcph->ack) {
-			tcp_sock_set_state(tcp_sk, TCP_TIMEWAIT);
-		} else {
-			tcp_sock_set_state(tcp_sk, TCP_CLOSING);
-		}
-		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
-		return TCP_RET_SEND;
-	} else if (tcph->ack) {
-		tcp_sock_set_state(tcp_sk, TCP_FINWAIT_2);
+	opt_len = tcp_opt_len(tcp_sk, 0, 1);
+	if (0 != alloc_prep_skb(tcp_sk, opt_len, NULL, &skb)) {
+		return;
 	}
 
-	return TCP_RET_DROP;
+	tcph = tcp_hdr(skb);
+	tcp_build(tcph, sock_inet_get_dst_port(to_sock(tcp_sk)),
+			sock_inet_get_src_port(to_sock(tcp_sk)),
+			TCP_MIN_HEADER_SIZE + opt_len, 0);
+	tcp_opt_build(tcp_sk, tcph, opt_len);
+	tcp_set_ack_field(tcph, tcp_sk->rem.seq);
+	tcp_set_seq_field(tcph, seq);
+	tcp_hdr_refresh(tcp_sk, tcph);
+	tcp_set_check_field(tcph, skb->nh.raw);
+	tcp_xmit(skb, tcp_sk, NULL);
 }
 
-static enum tcp_ret_code tcp_st_finwait_2(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph, struct sk_buff *skb,
-		struct tcphdr *out_tcph) {
-	size_t data_len;
+void tcp_send_ack(struct tcp_sock *tcp_sk) {
+	tcp_xmit_ack(tcp_sk, tcp_sk->self.seq);
+}
 
-	log_debug("call tcp_st_finwait_2");
-	assert(tcp_sk->state == TCP_FINWAIT_2);
+/**
+ * The application read @a copied bytes. The buffer grows to twice of
+ * what is read per RTT, so the window doesn't limit the sender
+ * (dynamic right-sizing), and the peer learns about the freed space.
+ */
+void tcp_rcvbuf_update(struct tcp_sock *tcp_sk, size_t copied) {
+	uint32_t rtt, limit, right;
+	int update;
 
-	data_len = tcp_data_length(skb->h.th, skb->nh.raw);
-	if (data_len > 0) {
-		/* Save current sk_buff_t with data */
-		log_debug("\t received %d\n", data_len);
-		tcp_sock_rcv(tcp_sk, skb);
-		tcp_sk->rem.seq += data_len;
-		if (tcph->fin) {
-			tcp_sk->rem.seq += 1;
-			tcp_sock_set_state(tcp_sk, TCP_TIMEWAIT);
+	update = 0;
+	tcp_sock_lock(tcp_sk, TCP_SYNC_STATE);
+	{
+		if (tcp_sock_get_status(tcp_sk) == TCP_ST_SYNC) {
+			tcp_sk->rcv_copied += copied;
+			rtt = tcp_sk->rcv_rtt != 0 ? tcp_sk->rcv_rtt : tcp_sk->srtt;
+			if (!timerisset(&tcp_sk->rcv_space_time)) {
+				tcp_get_now(&tcp_sk->rcv_space_time);
+			}
+			else if ((rtt != 0)
+					&& (tcp_usec_since(&tcp_sk->rcv_space_time) >= rtt)) {
+				if (2 * tcp_sk->rcv_copied > tcp_sk->rcv_buf) {
+					limit = min((uint32_t)MODOPS_RCVBUF_MAX,
+							0xffffU << tcp_sk->self.wind.factor);
+					tcp_sk->rcv_buf = min(2 * tcp_sk->rcv_copied, limit);
+				}
+				tcp_sk->rcv_copied = 0;
+				tcp_get_now(&tcp_sk->rcv_space_time);
+			}
+
+			right = tcp_sk->rem.seq + min(tcp_rcv_space(tcp_sk),
+					0xffffU << tcp_sk->self.wind.factor);
+			update = (int32_t)(right - tcp_sk->rcv_adv) >= (int32_t)min(
+					tcp_sk->rcv_buf / 2, 2 * tcp_sk->rcv_mss);
 		}
-		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
-		return TCP_RET_SEND_ALLOC;
-	} else if (tcph->fin) {
-		tcp_sk->rem.seq += 1;
-		tcp_sock_set_state(tcp_sk, TCP_TIMEWAIT);
-		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
-		return TCP_RET_SEND;
 	}
+	tcp_sock_unlock(tcp_sk, TCP_SYNC_STATE);
 
-	return TCP_RET_DROP;
+	if (update) {
+		/* Window update */
+		tcp_send_ack(tcp_sk);
+	}
 }
 
-static enum tcp_ret_code tcp_st_closewait(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph, struct sk_buff *skb,
-		struct tcphdr *out_tcph) {
-	log_debug("call tcp_st_closewait");
-	assert(tcp_sk->state == TCP_CLOSEWAIT);
-
-	return TCP_RET_DROP;
+/************************ SACK scoreboard *****************************/
+static inline uint32_t tcp_skb_seq(struct sk_buff *skb) {
+	return ntohl(skb->h.th->seq);
 }
 
-static enum tcp_ret_code tcp_st_closing(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph, struct sk_buff *skb,
-		struct tcphdr *out_tcph) {
-	log_debug("call tcp_st_closing");
-	assert(tcp_sk->state == TCP_CLOSING);
+static inline uint32_t tcp_skb_seq_len(struct sk_buff *skb) {
+	return tcp_seq_length(skb->h.th, skb->nh.raw);
+}
 
-	if (tcph->ack) {
-		tcp_sock_set_state(tcp_sk, TCP_TIMEWAIT);
+/* Marks segments in tx_queue covered by SACK blocks of the peer and
+ * the ones considered lost: with DupThresh segments or more than
+ * (DupThresh - 1) * MSS bytes SACKed above them (RFC 6675 IsLost). */
+static void tcp_sack_update(struct tcp_sock *tcp_sk,
+		const struct tcp_opts *opts) {
+	struct sk_buff_head *queue;
+	struct sk_buff *skb;
+	uint32_t seq, end, sacked_len;
+	unsigned int i, sacked_cnt;
+
+	queue = &to_sock(tcp_sk)->tx_queue;
+
+	for (skb = skb_queue_front(queue); (skb != NULL)
+				&& !skb_queue_end(skb, queue);
+			skb = skb_queue_next(skb)) {
+		seq = tcp_skb_seq(skb);
+		end = seq + tcp_skb_seq_len(skb);
+		for (i = 0; i < opts->sack_cnt; i++) {
+			if ((int32_t)(opts->sack[i].end - tcp_sk->last_ack) <= 0) {
+				continue; /* D-SACK or an old block */
+			}
+			if (((int32_t)(seq - opts->sack[i].start) >= 0)
+					&& ((int32_t)(end - opts->sack[i].end) <= 0)) {
+				tcp_skb_cb(skb)->sacked = 1;
+				break;
+			}
+		}
 	}
 
-	return TCP_RET_DROP;
+	sacked_cnt = sacked_len = 0;
+	for (skb = queue->prev; !skb_queue_end(skb, queue);
+			skb = skb->lnk.prev) {
+		if (tcp_skb_cb(skb)->sacked) {
+			sacked_cnt++;
+			sacked_len += tcp_skb_seq_len(skb);
+		}
+		else if ((sacked_cnt >= TCP_REXMIT_DUP_ACK)
+				|| (sacked_len > (TCP_REXMIT_DUP_ACK - 1) * tcp_sk->mss)) {
+			tcp_skb_cb(skb)->lost = 1;
+		}
+	}
 }
 
-static enum tcp_ret_code tcp_st_lastack(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph, struct sk_buff *skb,
-		struct tcphdr *out_tcph) {
-	log_debug("call tcp_st_lastack");
-	assert(tcp_sk->state == TCP_LASTACK);
-
-	if (tcph->ack) {
-		tcp_sock_set_state(tcp_sk, TCP_CLOSED);
-		return TCP_RET_FREE;
-	}
+static inline int tcp_sack_head_lost(struct tcp_sock *tcp_sk) {
+	struct sk_buff *skb;
 
-	return TCP_RET_DROP;
+	skb = skb_queue_front(&to_sock(tcp_sk)->tx_queue);
+	return (skb != NULL) && tcp_skb_cb(skb)->lost;
 }
 
-static enum tcp_ret_code tcp_st_timewait(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph, struct sk_buff *skb,
-		struct tcphdr *out_tcph) {
-	log_debug("call tcp_st_timewait");
-	assert(tcp_sk->state == TCP_TIMEWAIT);
+/* Retransmits lost segments while the pipe is below cwnd, at least
+ * one if @a force is set (RFC 6675, NextSeg rule 1 only) */
+static void tcp_sack_rexmit(struct tcp_sock *tcp_sk, int force) {
+	struct sk_buff_head *queue;
+	struct sk_buff *skb;
+	struct tcp_skb_cb *cb;
+	uint32_t pipe;
 
-	/* timeout 2msl and set TCP_CLOSED state */
+	tcp_sock_lock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+	{
+		queue = &to_sock(tcp_sk)->tx_queue;
+
+		pipe = 0;
+		for (skb = skb_queue_front(queue); (skb != NULL)
+					&& !skb_queue_end(skb, queue);
+				skb = skb_queue_next(skb)) {
+			cb = tcp_skb_cb(skb);
+			if (!cb->sacked && !cb->lost) {
+				pipe += tcp_skb_seq_len(skb);
+			}
+			if (cb->retrans) {
+				pipe += tcp_skb_seq_len(skb);
+			}
+		}
 
-	return TCP_RET_DROP;
+		for (skb = skb_queue_front(queue); (skb != NULL)
+					&& !skb_queue_end(skb, queue)
+					&& (force || (pipe < tcp_sk->cwnd));
+				skb = skb_queue_next(skb)) {
+			cb = tcp_skb_cb(skb);
+			if (!cb->lost || cb->sacked || cb->retrans) {
+				continue;
+			}
+			tcp_rexmit_skb(tcp_sk, skb);
+			pipe += tcp_skb_seq_len(skb);
+			force = 0;
+		}
+	}
+	tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
 }
 
+/* Loss recovery: the first unacknowledged segment is lost for sure */
+static void tcp_sack_recover(struct tcp_sock *tcp_sk, int force) {
+	struct sk_buff *skb;
 
-/************************ Process functions ****************************/
-static enum tcp_ret_code process_rst(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph) {
-	switch (tcp_sk->state) {
-	default:
-		break;
-	case TCP_LASTACK:
-	case TCP_FINWAIT_1:
-	case TCP_FINWAIT_2:
-	case TCP_TIMEWAIT: /* don't wait for tcp_timer to collect
-						  the socket */
-		/* socket have a state only after close call.
-		 * It could be freed only here */
-		return TCP_RET_FREE;
-	case TCP_SYN_SENT:
-		if (tcp_sk->self.seq != ntohl(tcph->ack_seq)) {
-			/* invalid reset */
-			break;
-		}
-		/* PASSTHROUGH */
-	case TCP_SYN_RECV:
-	case TCP_ESTABIL:
-	case TCP_CLOSEWAIT:
-	case TCP_CLOSING:
-		tcp_sock_set_state(tcp_sk, TCP_CLOSED);
-		if (!list_empty(&tcp_sk->conn_lnk)) {
-			assert(tcp_sk->parent != NULL);
-			return TCP_RET_FREE;
+	tcp_sock_lock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+	{
+		skb = skb_queue_front(&to_sock(tcp_sk)->tx_queue);
+		if ((skb != NULL) && !tcp_skb_cb(skb)->sacked) {
+			tcp_skb_cb(skb)->lost = 1;
 		}
-		break;
 	}
+	tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
 
-	return TCP_RET_DROP;
+	tcp_sack_rexmit(tcp_sk, force);
 }
 
-static void confirm_ack(struct tcp_sock *tcp_sk, uint32_t ack) {
-	struct sk_buff *sent_skb;
-	uint32_t ack2seq, seq_len;
+/* RTO: everything not SACKed is considered lost and sent again */
+static void tcp_sack_rto(struct tcp_sock *tcp_sk) {
+	struct sk_buff_head *queue;
+	struct sk_buff *skb;
 
-	log_debug("sk %p ack %u", to_sock(tcp_sk), ack);
 	tcp_sock_lock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
 	{
-		do {
-			sent_skb = skb_queue_front(&to_sock(tcp_sk)->tx_queue);
-			assert(sent_skb != NULL);
-			ack2seq = ack - ntohl(sent_skb->h.th->seq);
-			seq_len = tcp_seq_length(sent_skb->h.th,
-					sent_skb->nh.raw);
-			if (ack2seq >= seq_len) {
-				log_debug("confirm_ack: remove skb %p\n",
-						sent_skb);
-				skb_free(sent_skb); /* list_del_init will done
-									   at skb_free */
-			}
-		} while (ack2seq > seq_len);
+		queue = &to_sock(tcp_sk)->tx_queue;
+		for (skb = skb_queue_front(queue); (skb != NULL)
+					&& !skb_queue_end(skb, queue);
+				skb = skb_queue_next(skb)) {
+			tcp_skb_cb(skb)->lost = !tcp_skb_cb(skb)->sacked;
+			tcp_skb_cb(skb)->retrans = 0;
+		}
 	}
 	tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
-}
 
-static enum tcp_ret_code process_ack(struct tcp_sock *tcp_sk,
+	if (tcp_sk->opt_flags & TCP_OPT_F_SACK) {
+		tcp_sack_rexmit(tcp_sk, 1);
+	}
+	else {
+		tcp_rexmit(tcp_sk);
+	}
+}
+
+static void send_rst_reply(struct sk_buff *skb) {
+	struct tcphdr old_tcph, *tcph;
+	size_t tcph_size, old_seq_len;
+	const struct net_pack_out_ops *out_ops;
+
+	kstat_inc(&tcp_rst_sent);
+
+	memcpy(&old_tcph, tcp_hdr(skb), sizeof old_tcph);
+	old_seq_len = tcp_seq_length(&old_tcph, skb->nh.raw);
+	tcph_size = TCP_MIN_HEADER_SIZE;
+
+	out_ops = ip_hdr(skb)->version == 4 ? ip_out_ops : ip6_out_ops;
+	if (out_ops == NULL) {
+		return; /* error: not implemented */
+	}
+
+	/* make packet with L3 header */
+	assert(out_ops->make_pack != NULL);
+	if (0 != out_ops->make_pack(NULL, NULL, &tcph_size, &skb)) {
+		return; /* error: see ret */
+	}
+	else if (tcph_size < TCP_MIN_HEADER_SIZE) {
+		skb_free(skb);
+		return; /* error: no memory */
+	}
+
+	/* build TCP header */
+	tcph = tcp_hdr(skb);
+	tcp_build(tcph, old_tcph.source, old_tcph.dest, TCP_MIN_HEADER_SIZE, 0);
+
+	tcph->rst = 1;
+	if (old_tcph.ack) {
+		tcp_set_seq_field(tcph, ntohl(old_tcph.ack_seq));
+	}
+	else {
+		tcp_set_seq_field(tcph, 0);
+		tcp_set_ack_field(tcph, ntohl(old_tcph.seq) + old_seq_len);
+	}
+	tcp_set_check_field(tcph, skb->nh.raw);
+
+	/* send over L3 */
+	tcp_xmit(skb, NULL, out_ops);
+}
+
+/**
+ * Send any packet without sequence (i.e. seq_len is 0)
+ */
+static void send_nonseq_from_sock(struct tcp_sock *tcp_sk,
+		struct sk_buff *skb) {
+	log_debug("send %p", skb);
+	tcp_set_seq_field(skb->h.th, tcp_sk->self.seq);
+	tcp_hdr_refresh(tcp_sk, skb->h.th);
+	tcp_set_check_field(skb->h.th, skb->nh.raw);
+	tcp_xmit(skb, tcp_sk, NULL);
+}
+
+/**
+ * Send a data, only
+ */
+void send_seq_from_sock(struct tcp_sock *tcp_sk, struct sk_buff *skb) {
+	struct sk_buff *skb_send;
+	uint32_t seq_len;
+
+	assert(tcp_sk != NULL);
+	assert(skb != NULL);
+
+	skb_send = skb_clone(skb);
+
+	log_debug("send %p = %p", skb, skb_send);
+
+	tcp_sock_lock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+	{
+		tcp_set_seq_field(skb->h.th, tcp_sk->self.seq);
+		tcp_hdr_refresh(tcp_sk, skb->h.th);
+		tcp_set_check_field(skb->h.th, skb->nh.raw);
+		if (skb_send != NULL) {
+			/* set to cloned pkg */
+			memcpy(skb_send->h.th, skb->h.th, TCP_HEADER_SIZE(skb->h.th));
+		}
+		memset(tcp_skb_cb(skb), 0, sizeof(struct tcp_skb_cb));
+		assert(to_sock(tcp_sk) != NULL);
+		if (tcp_sk->last_ack == tcp_sk->self.seq) {
+			/* Nothing was in flight, start the rexmit timer */
+			tcp_timer_set(tcp_sk, TCP_TIMER_REXMIT, tcp_sk->rto);
+		}
+		seq_len = tcp_seq_length(skb->h.th, skb->nh.raw);
+		if (!tcp_sk->rtt_timing && (seq_len != 0)) {
+			tcp_sk->rtt_timing = 1;
+			tcp_sk->rtt_seq = tcp_sk->self.seq + seq_len;
+			tcp_get_now(&tcp_sk->rtt_time);
+		}
+		skb_queue_push(&to_sock(tcp_sk)->tx_queue, skb);
+		tcp_sk->self.seq += seq_len;
+	}
+	tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+
+	if (skb_send != NULL) {
+		tcp_xmit(skb_send, tcp_sk, NULL);
+	}
+}
+
+void tcp_push_unsent(struct tcp_sock *tcp_sk) {
+	struct sk_buff *skb;
+
+	tcp_sock_lock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+	{
+		skb = tcp_sk->tx_unsent;
+		tcp_sk->tx_unsent = NULL;
+		if (skb != NULL) {
+			skb->h.th->psh = 1;
+			send_seq_from_sock(tcp_sk, skb);
+		}
+	}
+	tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+
+	if (skb != NULL) {
+		tcp_timer_clear(tcp_sk, TCP_TIMER_CORK);
+	}
+}
+
+static void tcp_sock_free(struct tcp_sock *tcp_sk) {
+	tcp_sk->timer_armed = 0;
+	timer_stop(&tcp_sk->timer);
+	skb_queue_purge(&tcp_sk->ofo_queue);
+	skb_free(tcp_sk->tx_unsent);
+	tcp_sk->tx_unsent = NULL;
+	sock_release(to_sock(tcp_sk));
+}
+
+void tcp_sock_release(struct tcp_sock *tcp_sk) {
+	/* Connection in the accept queue is only closed by the listener
+	 * or by accept() that finds it reset */
+	assert(tcp_sk->parent == NULL);
+
+	if (tcp_sk->listen != NULL) {
+		tcp_listen_release(tcp_sk);
+	}
+
+	tcp_sock_free(tcp_sk);
+}
+
+/************************ Socket timers ********************************/
+/* Starts the socket timer for the earliest armed deadline. A timer
+ * that fires earlier is left as is, the handler looks what is due. */
+static void tcp_timer_schedule(struct tcp_sock *tcp_sk, uint32_t now) {
+	uint32_t due;
+	int i, armed;
+
+	due = 0;
+	armed = 0;
+	for (i = 0; i < TCP_TIMER_MAX; i++) {
+		if (tcp_timer_pending(tcp_sk, i) && (!armed
+				|| ((int32_t)(tcp_sk->timer_due[i] - due) < 0))) {
+			due = tcp_sk->timer_due[i];
+			armed = 1;
+		}
+	}
+
+	if (!armed) {
+		timer_stop(&tcp_sk->timer);
+		return;
+	}
+	if (timer_is_started(&tcp_sk->timer)
+			&& ((int32_t)(tcp_sk->timer_expires - due) <= 0)) {
+		return;
+	}
+
+	tcp_sk->timer_expires = due;
+	timer_start(&tcp_sk->timer, ms2jiffies(max((int32_t)(due - now),
+			(int32_t)TCP_TIMER_GRANULARITY)));
+}
+
+void tcp_timer_set(struct tcp_sock *tcp_sk, enum tcp_timer which,
+		uint32_t msec) {
+	uint32_t now;
+
+	assert(which < TCP_TIMER_MAX);
+
+	sched_lock();
+	{
+		now = tcp_now();
+		tcp_sk->timer_due[which] = now + msec;
+		tcp_sk->timer_armed |= 1 << which;
+		tcp_timer_schedule(tcp_sk, now);
+	}
+	sched_unlock();
+}
+
+void tcp_timer_clear(struct tcp_sock *tcp_sk, enum tcp_timer which) {
+	assert(which < TCP_TIMER_MAX);
+
+	sched_lock();
+	{
+		tcp_sk->timer_armed &= ~(1 << which);
+		if (!tcp_sk->timer_armed) {
+			timer_stop(&tcp_sk->timer);
+		}
+	}
+	sched_unlock();
+}
+
+/* Segment with an already ACKed sequence number, the peer answers
+ * with ACK telling its window. Used for zero window and keepalive. */
+static void tcp_send_probe(struct tcp_sock *tcp_sk) {
+	tcp_xmit_ack(tcp_sk, tcp_sk->self.seq - 1);
+}
+
+/* Timer handlers return non-zero if the socket was released */
+static int tcp_rexmit_timeout(struct tcp_sock *tcp_sk) {
+	if ((tcp_sock_get_status(tcp_sk) == TCP_ST_NOTEXIST)
+			|| (tcp_sk->last_ack == tcp_sk->self.seq)) {
+		return 0;
+	}
+
+	log_debug("rexmit sk %p rto %u", to_sock(tcp_sk), tcp_sk->rto);
+	tcp_cong_loss(tcp_sk, 1);
+	tcp_sk->rexmit_mode = 1;
+	tcp_sk->recover = tcp_sk->self.seq;
+	/* Back off until ACK of new data gives a new RTT sample */
+	tcp_sk->rto = min(2 * tcp_sk->rto, (uint32_t)TCP_RTO_MAX);
+	tcp_timer_set(tcp_sk, TCP_TIMER_REXMIT, tcp_sk->rto);
+	tcp_sack_rto(tcp_sk);
+
+	return 0;
+}
+
+static int tcp_persist_timeout(struct tcp_sock *tcp_sk) {
+	if ((tcp_sock_get_status(tcp_sk) != TCP_ST_SYNC)
+			|| (tcp_sk->rem.wind.size != 0)) {
+		tcp_sk->probes = 0;
+		sock_notify(to_sock(tcp_sk), POLLOUT);
+		return 0;
+	}
+
+	log_debug("zero window probe sk %p", to_sock(tcp_sk));
+	tcp_send_probe(tcp_sk);
+	tcp_sk->probes++;
+	tcp_timer_set(tcp_sk, TCP_TIMER_PERSIST,
+			min(tcp_sk->rto << min(tcp_sk->probes, 10U),
+				(uint32_t)TCP_RTO_MAX));
+
+	return 0;
+}
+
+static int tcp_keepalive_timeout(struct tcp_sock *tcp_sk) {
+	struct sk_buff *skb;
+	uint32_t idle, idle_limit;
+
+	if (!to_sock(tcp_sk)->opt.so_keepalive
+			|| ((tcp_sk->state != TCP_ESTABIL)
+				&& (tcp_sk->state != TCP_CLOSEWAIT))) {
+		return 0;
+	}
+
+	idle = tcp_usec_since(&tcp_sk->rcv_time) / USEC_PER_MSEC;
+	idle_limit = tcp_sk->keep_idle * MSEC_PER_SEC;
+	if ((tcp_sk->keep_probes == 0) && (idle < idle_limit)) {
+		/* Something was received since the timer was set */
+		tcp_timer_set(tcp_sk, TCP_TIMER_KEEPALIVE, idle_limit - idle);
+		return 0;
+	}
+
+	if (tcp_sk->keep_probes >= tcp_sk->keep_cnt) {
+		log_debug("keepalive timeout sk %p", to_sock(tcp_sk));
+		skb = NULL;
+		if (0 == alloc_prep_skb(tcp_sk, 0, NULL, &skb)) {
+			tcp_build(skb->h.th,
+					sock_inet_get_dst_port(to_sock(tcp_sk)),
+					sock_inet_get_src_port(to_sock(tcp_sk)),
+					TCP_MIN_HEADER_SIZE, 0);
+			skb->h.th->rst = 1;
+			send_nonseq_from_sock(tcp_sk, skb);
+		}
+		tcp_sock_set_state(tcp_sk, TCP_CLOSED);
+		sock_update_err(to_sock(tcp_sk), ETIMEDOUT);
+		return 0;
+	}
+
+	tcp_send_probe(tcp_sk);
+	tcp_sk->keep_probes++;
+	tcp_timer_set(tcp_sk, TCP_TIMER_KEEPALIVE,
+			tcp_sk->keep_intvl * MSEC_PER_SEC);
+
+	return 0;
+}
+
+static int tcp_delack_timeout(struct tcp_sock *tcp_sk) {
+	if ((tcp_sk->ack_pending != 0)
+			&& (tcp_sock_get_status(tcp_sk) == TCP_ST_SYNC)) {
+		tcp_send_ack(tcp_sk);
+	}
+
+	return 0;
+}
+
+static int tcp_cork_timeout(struct tcp_sock *tcp_sk) {
+	if (tcp_sock_get_status(tcp_sk) == TCP_ST_SYNC) {
+		tcp_push_unsent(tcp_sk);
+	}
+
+	return 0;
+}
+
+static int (*const tcp_timer_handlers[TCP_TIMER_MAX])(struct tcp_sock *) = {
+	[ TCP_TIMER_REXMIT ] = tcp_rexmit_timeout,
+	[ TCP_TIMER_PERSIST ] = tcp_persist_timeout,
+	[ TCP_TIMER_KEEPALIVE ] = tcp_keepalive_timeout,
+	[ TCP_TIMER_DELACK ] = tcp_delack_timeout,
+	[ TCP_TIMER_CORK ] = tcp_cork_timeout
+};
+
+static void tcp_timer_handler(struct sys_timer *timer, void *param) {
+	struct tcp_sock *tcp_sk;
+	uint32_t now;
+	int i;
+
+	tcp_sk = param;
+	assert(tcp_sk != NULL);
+
+	now = tcp_now();
+	for (i = 0; i < TCP_TIMER_MAX; i++) {
+		if (!tcp_timer_pending(tcp_sk, i)
+				|| ((int32_t)(tcp_sk->timer_due[i] - now) > 0)) {
+			continue;
+		}
+		tcp_sk->timer_armed &= ~(1 << i);
+		if (tcp_timer_handlers[i](tcp_sk)) {
+			return;
+		}
+	}
+
+	sched_lock();
+	{
+		tcp_timer_schedule(tcp_sk, now);
+	}
+	sched_unlock();
+}
+
+void tcp_timer_init(struct tcp_sock *tcp_sk) {
+	tcp_sk->timer_armed = 0;
+	tcp_sk->probes = tcp_sk->keep_probes = 0;
+	timer_init(&tcp_sk->timer, TIMER_ONESHOT, tcp_timer_handler, tcp_sk);
+}
+
+void tcp_keepalive_update(struct tcp_sock *tcp_sk) {
+	if (to_sock(tcp_sk)->opt.so_keepalive
+			&& ((tcp_sk->state == TCP_ESTABIL)
+				|| (tcp_sk->state == TCP_CLOSEWAIT))) {
+		if (!tcp_timer_pending(tcp_sk, TCP_TIMER_KEEPALIVE)) {
+			tcp_timer_set(tcp_sk, TCP_TIMER_KEEPALIVE,
+					tcp_sk->keep_idle * MSEC_PER_SEC);
+		}
+	}
+	else {
+		tcp_timer_clear(tcp_sk, TCP_TIMER_KEEPALIVE);
+	}
+}
+
+
+/****************** Handlers of TCP states ***********************/
+static enum tcp_ret_code tcp_st_closed(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		struct tcphdr *out_tcph) {
+	log_debug("call tcp_st_closed");
+	assert(tcp_sk->state == TCP_CLOSED);
+
+	return TCP_RET_RST;
+}
+
+static enum tcp_ret_code tcp_st_listen(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		struct tcphdr *out_tcph) {
+	log_debug("call tcp_st_listen");
+	assert(tcp_sk->state == TCP_LISTEN);
+
+	if (tcph->syn && !tcph->ack) {
+		/* Socket is created when the handshake completes */
+		tcp_req_syn(tcp_sk, skb);
+		return TCP_RET_DROP;
+	}
+	else if (tcph->ack) {
+		return tcp_req_ack(tcp_sk, skb);
+	}
+
+	return TCP_RET_DROP;
+}
+
+static enum tcp_ret_code tcp_st_syn_sent(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		struct tcphdr *out_tcph) {
+	log_debug("call tcp_st_syn_sent");
+	assert(tcp_sk->state == TCP_SYN_SENT);
+
+	if (tcph->syn) {
+		tcp_sk->rem.seq = ntohl(tcph->seq) + 1;
+		tcp_syn_rcv(tcp_sk, tcph);
+		if (tcph->ack) {
+			tcp_sock_set_state(tcp_sk, TCP_ESTABIL);
+		} else {
+			tcp_sock_set_state(tcp_sk, TCP_SYN_RECV);
+		}
+		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+		return TCP_RET_SEND;
+	}
+
+	return TCP_RET_DROP;
+}
+
+static enum tcp_ret_code tcp_st_syn_recv_pre(
+		struct tcp_sock *tcp_sk, const struct tcphdr *tcph,
+		struct sk_buff *skb, struct tcphdr *out_tcph) {
+	log_debug("call tcp_st_syn_recv_pre");
+	assert(tcp_sk->state == TCP_SYN_RECV_PRE);
+
+	if (tcph->syn) {
+		tcp_sk->rem.seq = ntohl(tcph->seq) + 1;
+		tcp_syn_rcv(tcp_sk, tcph);
+		tcp_sock_set_state(tcp_sk, TCP_SYN_RECV);
+		out_tcph->syn = 1;
+		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+		return TCP_RET_SEND_SEQ;
+	}
+	return TCP_RET_DROP;
+}
+
+static enum tcp_ret_code tcp_st_syn_recv(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		struct tcphdr *out_tcph) {
+	log_debug("call tcp_st_syn_recv");
+	assert(tcp_sk->state == TCP_SYN_RECV);
+
+	if (tcph->ack) {
+		tcp_sock_set_state(tcp_sk, TCP_ESTABIL);
+	}
+
+	return TCP_RET_DROP;
+}
+
+static enum tcp_ret_code tcp_st_estabil(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		struct tcphdr *out_tcph) {
+	size_t data_len;
+	int hole;
+
+	log_debug("call tcp_st_estabil");
+	assert(tcp_sk->state == TCP_ESTABIL);
+
+	data_len = tcp_data_length(skb->h.th, skb->nh.raw);
+	if (data_len > 0) {
+		/* Save current sk_buff_t with data */
+		log_debug("\t received %d", data_len);
+		hole = tcp_sock_rcv(tcp_sk, skb);
+		if (!tcph->fin) {
+			return tcp_ack_rcvd(tcp_sk, out_tcph, data_len, hole);
+		}
+		tcp_sk->rem.seq += 1;
+		tcp_sock_set_state(tcp_sk, TCP_CLOSEWAIT);
+		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+		return TCP_RET_SEND_ALLOC;
+	} else if (tcph->fin) {
+		tcp_sk->rem.seq += 1;
+		tcp_sock_set_state(tcp_sk, TCP_CLOSEWAIT);
+		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+		return TCP_RET_SEND;
+	}
+
+	return TCP_RET_DROP;
+}
+
+static enum tcp_ret_code tcp_st_finwait_1(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		struct tcphdr *out_tcph) {
+	size_t data_len;
+
+	log_debug("call tcp_st_finwait_1");
+	assert(tcp_sk->state == TCP_FINWAIT_1);
+
+	data_len = tcp_data_length(skb->h.th, skb->nh.raw);
+	if (data_len > 0) {
+		/* Save current sk_buff_t with data */
+		log_debug("\t received %d", data_len);
+		tcp_sock_rcv(tcp_sk, skb);
+		if (tcph->fin) {
+			tcp_sk->rem.seq += 1;
+			if (tcph->ack) {
+				tcp_sock_set_state(tcp_sk, TCP_TIMEWAIT);
+			} else {
+				tcp_sock_set_state(tcp_sk, TCP_CLOSING);
+			}
+		} else if (tcph->ack) {
+			tcp_sock_set_state(tcp_sk, TCP_FINWAIT_2);
+		}
+		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+		return TCP_RET_SEND_ALLOC;
+	} else if (tcph->fin) {
+		tcp_sk->rem.seq += 1;
+		if (tcph->ack) {
+			tcp_sock_set_state(tcp_sk, TCP_TIMEWAIT);
+		} else {
+			tcp_sock_set_state(tcp_sk, TCP_CLOSING);
+		}
+		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+		return TCP_RET_SEND;
+	} else if (tcph->ack) {
+		tcp_sock_set_state(tcp_sk, TCP_FINWAIT_2);
+	}
+
+	return TCP_RET_DROP;
+}
+
+static enum tcp_ret_code tcp_st_finwait_2(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		struct tcphdr *out_tcph) {
+	size_t data_len;
+
+	log_debug("call tcp_st_finwait_2");
+	assert(tcp_sk->state == TCP_FINWAIT_2);
+
+	data_len = tcp_data_length(skb->h.th, skb->nh.raw);
+	if (data_len > 0) {
+		/* Save current sk_buff_t with data */
+		log_debug("\t received %d\n", data_len);
+		tcp_sock_rcv(tcp_sk, skb);
+		if (tcph->fin) {
+			tcp_sk->rem.seq += 1;
+			tcp_sock_set_state(tcp_sk, TCP_TIMEWAIT);
+		}
+		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+		return TCP_RET_SEND_ALLOC;
+	} else if (tcph->fin) {
+		tcp_sk->rem.seq += 1;
+		tcp_sock_set_state(tcp_sk, TCP_TIMEWAIT);
+		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+		return TCP_RET_SEND;
+	}
+
+	return TCP_RET_DROP;
+}
+
+static enum tcp_ret_code tcp_st_closewait(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		struct tcphdr *out_tcph) {
+	log_debug("call tcp_st_closewait");
+	assert(tcp_sk->state == TCP_CLOSEWAIT);
+
+	return TCP_RET_DROP;
+}
+
+static enum tcp_ret_code tcp_st_closing(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		struct tcphdr *out_tcph) {
+	log_debug("call tcp_st_closing");
+	assert(tcp_sk->state == TCP_CLOSING);
+
+	if (tcph->ack) {
+		tcp_sock_set_state(tcp_sk, TCP_TIMEWAIT);
+	}
+
+	return TCP_RET_DROP;
+}
+
+static enum tcp_ret_code tcp_st_lastack(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		struct tcphdr *out_tcph) {
+	log_debug("call tcp_st_lastack");
+	assert(tcp_sk->state == TCP_LASTACK);
+
+	if (tcph->ack) {
+		tcp_sock_set_state(tcp_sk, TCP_CLOSED);
+		return TCP_RET_FREE;
+	}
+
+	return TCP_RET_DROP;
+}
+
+static enum tcp_ret_code tcp_st_timewait(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		struct tcphdr *out_tcph) {
+	log_debug("call tcp_st_timewait");
+	assert(tcp_sk->state == TCP_TIMEWAIT);
+
+	/* timeout 2msl and set TCP_CLOSED state */
+
+	return TCP_RET_DROP;
+}
+
+
+/************************ Process functions ****************************/
+static enum tcp_ret_code process_rst(struct tcp_sock *tcp_sk,
 		const struct tcphdr *tcph) {
+	switch (tcp_sk->state) {
+	default:
+		break;
+	case TCP_LASTACK:
+	case TCP_FINWAIT_1:
+	case TCP_FINWAIT_2:
+	case TCP_TIMEWAIT: /* don't wait for tcp_timer to collect
+						  the socket */
+		/* socket have a state only after close call.
+		 * It could be freed only here */
+		return TCP_RET_FREE;
+	case TCP_SYN_SENT:
+		if (tcp_sk->self.seq != ntohl(tcph->ack_seq)) {
+			/* invalid reset */
+			break;
+		}
+		/* PASSTHROUGH */
+	case TCP_SYN_RECV:
+	case TCP_ESTABIL:
+	case TCP_CLOSEWAIT:
+	case TCP_CLOSING:
+		/* Released by close() or, if it's still in the accept
+		 * queue, by accept() */
+		tcp_sock_set_state(tcp_sk, TCP_CLOSED);
+		break;
+	}
+
+	return TCP_RET_DROP;
+}
+
+static void confirm_ack(struct tcp_sock *tcp_sk, uint32_t ack) {
+	struct sk_buff *sent_skb;
+	uint32_t ack2seq, seq_len;
+
+	log_debug("sk %p ack %u", to_sock(tcp_sk), ack);
+	tcp_sock_lock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+	{
+		do {
+			sent_skb = skb_queue_front(&to_sock(tcp_sk)->tx_queue);
+			assert(sent_skb != NULL);
+			ack2seq = ack - ntohl(sent_skb->h.th->seq);
+			seq_len = tcp_seq_length(sent_skb->h.th,
+					sent_skb->nh.raw);
+			if (ack2seq >= seq_len) {
+				log_debug("confirm_ack: remove skb %p\n",
+						sent_skb);
+				skb_free(sent_skb); /* list_del_init will done
+									   at skb_free */
+			}
+		} while (ack2seq > seq_len);
+	}
+	tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+}
+
+static enum tcp_ret_code process_ack(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		const struct tcp_opts *opts) {
 	uint32_t ack, ack2last_ack, seq;
+	int sack;
+
+	/* Resetting if recv ack in this state */
+	switch (tcp_sk->state) {
+	default:
+		break;
+	case TCP_CLOSED:
+		return TCP_RET_RST;
+	case TCP_LISTEN:
+		return TCP_RET_OK; /* Completes the handshake, see tcp_req_ack */
+	}
+
+	ack = ntohl(tcph->ack_seq);
+	ack2last_ack = ack - tcp_sk->last_ack;
+	seq = tcp_sk->self.seq;
+
+	sack = tcp_sk->opt_flags & TCP_OPT_F_SACK;
+	if (sack && (opts->sack_cnt != 0)) {
+		tcp_sock_lock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+		{
+			tcp_sack_update(tcp_sk, opts);
+		}
+		tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+	}
+
+	if (ack2last_ack == 0) {
+		/* no new acknowledgments, segments with data aren't duplicates */
+		if ((seq != ack) && (tcp_data_length(tcph, skb->nh.raw) == 0)) {
+			if (!tcp_sk->rexmit_mode) {
+				++tcp_sk->dup_ack;
+				if ((tcp_sk->dup_ack == TCP_REXMIT_DUP_ACK)
+						|| (sack && tcp_sack_head_lost(tcp_sk))) {
+					/* Fast retransmit */
+					tcp_cong_loss(tcp_sk, 0);
+					tcp_sk->rexmit_mode = 1;
+					tcp_sk->recover = seq;
+					if (sack) {
+						tcp_sack_recover(tcp_sk, 1);
+					}
+					else {
+						tcp_rexmit(tcp_sk);
+					}
+				}
+			}
+			else if (sack) {
+				/* SACKed data left the network, fill the pipe */
+				tcp_sack_rexmit(tcp_sk, 0);
+			}
+		}
+	}
+	else if (ack2last_ack <= seq - tcp_sk->last_ack) {
+		confirm_ack(tcp_sk, ack);
+		if (tcp_sk->rtt_timing
+				&& (tcp_sk->rtt_seq - tcp_sk->last_ack <= ack2last_ack)) {
+			tcp_sk->rtt_timing = 0;
+			tcp_rtt_sample(tcp_sk, tcp_usec_since(&tcp_sk->rtt_time));
+		}
+		else if (!tcp_sk->rtt_timing && (opts->flags & TCP_OPT_F_TS)
+				&& (opts->tsecr != 0)) {
+			/* Echoed timestamp is valid for rexmitted data too */
+			tcp_rtt_sample(tcp_sk,
+					(tcp_now() - opts->tsecr) * USEC_PER_MSEC);
+		}
+		tcp_cong_ack(tcp_sk, ack2last_ack);
+		tcp_sk->last_ack = ack;
+		if (seq == ack) {
+			tcp_timer_clear(tcp_sk, TCP_TIMER_REXMIT);
+			if ((tcp_sk->tx_unsent != NULL) && !tcp_sk->tx_unsent_corked) {
+				/* Nagle: everything is ACKed, small segment may go */
+				tcp_push_unsent(tcp_sk);
+			}
+		}
+		else {
+			tcp_timer_set(tcp_sk, TCP_TIMER_REXMIT, tcp_sk->rto);
+		}
+		if (!tcp_sk->rexmit_mode) {
+			tcp_sk->dup_ack = 0;
+			sock_notify(to_sock(tcp_sk), POLLOUT);
+		}
+		else {
+			if (seq == ack) {
+				tcp_sk->rexmit_mode = 0;
+				tcp_sk->dup_ack = 0;
+				sock_notify(to_sock(tcp_sk), POLLOUT);
+			}
+			else if (sack) {
+				/* Partial ACK, the next hole is lost too */
+				tcp_sack_recover(tcp_sk, 0);
+			}
+			else {
+				tcp_rexmit(tcp_sk);
+			}
+		}
+	}
+	else if (ack - seq <= ack2last_ack) {
+		/* package with non-last acknowledgment */
+	}
+	else {
+		assert(seq - tcp_sk->last_ack < ack2last_ack);
+		/* assert(ack > tcp_sk->self.seq); -- without overflow checks */
+		log_debug("invalid acknowledgments: last_ack=%u ack=%u seq=%u",
+				tcp_sk->last_ack, ack, seq);
+		switch (tcp_sk->state) {
+		default:
+			break;
+		case TCP_SYN_SENT:
+		case TCP_SYN_RECV_PRE:
+		case TCP_SYN_RECV:
+			return TCP_RET_RST;
+		}
+		return TCP_RET_DROP;
+	}
+
+	/* Check ack flag for our state */
+	switch (tcp_sk->state) {
+	default:
+		break;
+	case TCP_SYN_SENT:
+	case TCP_SYN_RECV:
+	case TCP_FINWAIT_1:
+	case TCP_CLOSING:
+	case TCP_LASTACK:
+		if (ack - tcp_sk->ack_flag <= seq - tcp_sk->ack_flag) {
+			/* All ok, our flag was confirmed */
+		}
+		else { /* Else unmark ack flag */
+			log_debug("sk %p unmark ack\n",
+					to_sock(tcp_sk));
+			/* XXX remove const qualifier */
+			((struct tcphdr *)tcph)->ack = 0;
+		}
+		break;
+	}
+
+	return TCP_RET_OK;
+}
+
+#if 0
+static inline int tcp_opt_process(struct tcphdr *tcph, struct tcphdr *otcph, struct tcp_sock *tcp_sk) {
+	char *ptr = (char *) &tcph->options;
+	for(;;) {
+		switch(*ptr) {
+		case TCP_OPT_KIND_EOL:
+			return (int) ptr - (int) &tcph->options;
+		case TCP_OPT_KIND_NOP:
+			ptr++;
+			break;
+		case TCP_OPT_KIND_MSS:
+			ptr+=2;
+			tcp_sk->mss = ntohs((__be16) *ptr);
+		}
+	}
+	return 0;
+}
+#endif
+
+static enum tcp_ret_code pre_process(struct tcp_sock *tcp_sk,
+		const struct tcphdr *tcph, struct sk_buff *skb,
+		struct tcphdr *out_tcph) {
+	int ret, ofo;
+	uint32_t seq2rem_seq, seq_len, seq_last2rem_seq, rem_len, rtt;
+	struct tcp_opts opts;
+
+	/* Check CRC */
+	if (MODOPS_VERIFY_CHKSUM) {
+		uint16_t old_check;
+		old_check = tcph->check;
+		/* XXX remove const qualifier */
+		tcp_set_check_field((struct tcphdr *)tcph, skb->nh.raw);
+		if (old_check != tcph->check) {
+			log_error("invalid checksum %hx(%hx) sk %p skb %p",
+						ntohs(old_check), ntohs(tcph->check),
+						to_sock(tcp_sk), skb);
+			return TCP_RET_DROP;
+		}
+	}
+
+	tcp_opts_parse(tcph, &opts);
+	if (!(tcp_sk->opt_flags & TCP_OPT_F_TS)) {
+		opts.flags &= ~TCP_OPT_F_TS;
+	}
+
+	/* Process RST */
+	if (tcph->rst) {
+		ret = process_rst(tcp_sk, tcph);
+		if (ret != TCP_RET_OK) {
+			return ret;
+		}
+	}
+
+	/* Analyze sequence */
+	ofo = 0;
+	switch (tcp_sk->state) {
+	default:
+		break;
+	case TCP_SYN_RECV:
+	case TCP_ESTABIL:
+	case TCP_FINWAIT_1:
+	case TCP_FINWAIT_2:
+	case TCP_CLOSEWAIT:
+	case TCP_CLOSING:
+	case TCP_LASTACK:
+	case TCP_TIMEWAIT:
+		if ((opts.flags & TCP_OPT_F_TS) && !tcph->rst
+				&& ((int32_t)(opts.tsval - tcp_sk->ts_recent) < 0)) {
+			/* PAWS (RFC 7323): an old duplicate from the previous
+			 * wrap of sequence numbers */
+			log_debug("sk %p paws tsval %u ts_recent %u", to_sock(tcp_sk),
+					opts.tsval, tcp_sk->ts_recent);
+			tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+			return TCP_RET_SEND;
+		}
+		seq2rem_seq = ntohl(tcph->seq) - tcp_sk->rem.seq;
+		seq_len = tcp_seq_length(skb->h.th, skb->nh.raw);;
+		seq_last2rem_seq = seq2rem_seq + seq_len;
+		rem_len = tcp_sk->self.wind.size;
+		if (seq2rem_seq < rem_len) {
+			if (seq2rem_seq != 0) {
+				/* Some segments were lost, data after the hole
+				 * is kept until it is filled */
+				if (tcp_data_length(tcph, skb->nh.raw) == 0) {
+					return TCP_RET_DROP;
+				}
+				else if (tcph->syn || tcph->fin) {
+					tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+					return TCP_RET_SEND;
+				}
+				ofo = 1;
+			}
+		}
+		else if ((seq_last2rem_seq != 0)
+				&& (seq_last2rem_seq <= rem_len)) { }
+		else {
+			log_debug("received old package:"
+						" rem_seq=%u seq=%u seq_last=%u rem_last=%u\n",
+					tcp_sk->rem.seq, ntohl(tcph->seq),
+					ntohl(tcph->seq) + seq_len,
+					tcp_sk->rem.seq + rem_len);
+			if ((seq_len == 0) || (seq2rem_seq <= -seq_len)) {
+				/* Send segment with ack flag if this packet
+				 * is duplicated or is a window/keepalive probe */
+				tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+				return TCP_RET_SEND;
+			}
+			return TCP_RET_DROP;
+		}
+
+		if (opts.flags & TCP_OPT_F_TS) {
+			if ((int32_t)seq2rem_seq <= 0) {
+				tcp_sk->ts_recent = opts.tsval;
+			}
+			if ((seq_len != 0) && (opts.tsecr != 0)) {
+				/* RTT as the receiver sees it, for buffer tuning */
+				rtt = (tcp_now() - opts.tsecr) * USEC_PER_MSEC;
+				tcp_sk->rcv_rtt = tcp_sk->rcv_rtt == 0 ? rtt
+						: (7 * tcp_sk->rcv_rtt + rtt) / 8;
+			}
+		}
+		break;
+	}
+
+	/* Porcess ACK */
+	if (tcph->ack) {
+		ret = process_ack(tcp_sk, tcph, skb, &opts);
+		if (ret != TCP_RET_OK) {
+			return ret;
+		}
+	}
+
+	/* Update window */
+	switch (tcp_sock_get_status(tcp_sk)) {
+	default:
+		break;
+	case TCP_ST_SYNC:
+		if (tcph->syn) {
+			break; /* Window of SYN is never scaled */
+		}
+		tcp_seq_state_set_wind_value(&tcp_sk->rem,
+				ntohs(tcph->window));
+		if ((tcp_sk->rem.wind.size != 0)
+				&& tcp_timer_pending(tcp_sk, TCP_TIMER_PERSIST)) {
+			/* Window is open again */
+			tcp_timer_clear(tcp_sk, TCP_TIMER_PERSIST);
+			tcp_sk->probes = 0;
+			sock_notify(to_sock(tcp_sk), POLLOUT);
+		}
+		break;
+	}
+
+	if (ofo) {
+		tcp_ofo_queue(tcp_sk, skb);
+		/* Duplicate ACK, its SACK blocks tell about the hole */
+		tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
+		return TCP_RET_SEND_ALLOC;
+	}
+
+	return TCP_RET_OK;
+}
+
+/************************ Handlers table *******************************/
+static const tcp_handler_t tcp_st_handler[TCP_MAX_STATE] = {
+		[ TCP_CLOSED ] = tcp_st_closed,
+		[ TCP_LISTEN ] = tcp_st_listen,
+		[ TCP_SYN_SENT ] = tcp_st_syn_sent,
+		[ TCP_SYN_RECV_PRE ] = tcp_st_syn_recv_pre,
+		[ TCP_SYN_RECV ] = tcp_st_syn_recv,
+		[ TCP_ESTABIL ] = tcp_st_estabil,
+		[ TCP_FINWAIT_1 ] = tcp_st_finwait_1,
+		[ TCP_FINWAIT_2 ] = tcp_st_finwait_2,
+		[ TCP_CLOSEWAIT ] = tcp_st_closewait,
+		[ TCP_CLOSING ] = tcp_st_closing,
+		[ TCP_LASTACK ] = tcp_st_lastack,
+		[ TCP_TIMEWAIT ] = tcp_st_timewait
+};
+
+static int tcp_handle(struct tcp_sock *tcp_sk, struct sk_buff *skb,
+		tcp_handler_t hnd) {
+	/* If result is not TCP_RET_OK then further processing
+	 * can't be made */
+	enum tcp_ret_code ret;
+	struct tcphdr out_tcph;
+	struct sk_buff *out_skb;
+	size_t opt_len;
+
+	tcp_build(&out_tcph, skb->h.th->source, skb->h.th->dest,
+			TCP_MIN_HEADER_SIZE, tcp_sk->self.wind.value);
+	out_skb = NULL;
+
+	/**
+	 * If we want to use the current package (to save for example),
+	 * we must create a new package to send a response (if we need
+	 * to send a response). After this the handler may do anything
+	 * with current sk_buff_t.
+	 * If hnd is NULL we use synchronization tools.
+	 */
+	assert(tcp_sk->state < TCP_MAX_STATE);
+	assert(tcp_st_handler[tcp_sk->state] != NULL);
+	hnd = hnd != NULL ? hnd : tcp_st_handler[tcp_sk->state];
+
+	tcp_sock_lock(tcp_sk, TCP_SYNC_STATE);
+	{
+		ret = hnd(tcp_sk, skb->h.th, skb, &out_tcph);
+	}
+	tcp_sock_unlock(tcp_sk, TCP_SYNC_STATE);
+
+	log_debug("ret %d skb %p sk %p",
+			ret,
+			out_skb != NULL ? out_skb : skb,
+			to_sock(tcp_sk));
+
+	switch (ret) {
+	case TCP_RET_FREE:
+		/* skb may be listed in sock, so they must be free exactly
+ 		 * in this order */
+		skb_free(skb);
+		tcp_sock_release(tcp_sk);
+		break;
+	case TCP_RET_DROP:
+		skb_free(skb);
+		break;
+	case TCP_RET_SEND_SEQ:
+	case TCP_RET_SEND:
+		if (NULL == skb_declone(skb)) {
+			skb_free(skb);
+			return TCP_RET_DROP; /* error: ENOMEM */
+		}
+		/* fallthrough */
+	case TCP_RET_SEND_ALLOC:
+		out_skb = ret != TCP_RET_SEND_ALLOC ? skb : NULL;
+		opt_len = out_tcph.syn ? tcp_opt_len(tcp_sk, 1, 0)
+				: tcp_opt_len(tcp_sk, 0, 1);
+		if (0 != alloc_prep_skb(tcp_sk, opt_len, NULL, &out_skb)) {
+			return TCP_RET_DROP; /* error: see ret */
+		}
+		memcpy(out_skb->h.th, &out_tcph, sizeof out_tcph);
+		tcp_opt_build(tcp_sk, out_skb->h.th, opt_len);
+		if (ret == TCP_RET_SEND_SEQ) {
+			send_seq_from_sock(tcp_sk, out_skb);
+		}
+		else {
+			send_nonseq_from_sock(tcp_sk, out_skb);
+		}
+		break;
+	case TCP_RET_RST: /* this processing in tcp_process */
+	case TCP_RET_OK:
+		break;
+	}
+
+	return ret;
+}
+
+/************************ TIME-WAIT ************************************/
+#define TCP_TW_HASH_SIZE 64
+
+/**
+ * What is left of a connection in TIME-WAIT: enough to ACK the FIN if
+ * the peer retransmits it. The full tcp_sock is released on entering.
+ */
+struct tcp_tw_sock {
+	struct dlist_head hash_lnk;
+	struct dlist_head expiry_lnk; /* Ordered by @a expires */
+	uint32_t expires;             /* In ms of tcp_now() */
+	int family;
+	union {
+		struct in_addr in;
+		struct in6_addr in6;
+	} laddr, raddr;
+	in_port_t lport, rport;       /* Network byte order */
+	uint32_t snd_nxt;
+	uint32_t rcv_nxt;
+	uint16_t wind;
+};
 
-	/* Resetting if recv ack in this state */
-	switch (tcp_sk->state) {
-	default:
-		break;
-	case TCP_CLOSED:
-	case TCP_LISTEN:
-		return TCP_RET_RST;
+POOL_DEF(tcp_tw_pool, struct tcp_tw_sock, MODOPS_AMOUNT_TW_SOCK);
+static struct dlist_head tcp_tw_hash[TCP_TW_HASH_SIZE];
+/* Delay is the same for all, so the list is in order of expiry */
+static DLIST_DEFINE(tcp_tw_expiry);
+static struct sys_timer tcp_tw_timer;
+
+static unsigned int tcp_tw_hashfn(const void *raddr, size_t addr_len,
+		in_port_t rport, in_port_t lport) {
+	uint32_t h;
+
+	memcpy(&h, (const char *)raddr + addr_len - sizeof h, sizeof h);
+	h ^= ((uint32_t)rport << 16) | lport;
+	h ^= h >> 16;
+	h ^= h >> 8;
+
+	return h % TCP_TW_HASH_SIZE;
+}
+
+static void tcp_tw_timer_start(uint32_t now) {
+	struct tcp_tw_sock *tw;
+
+	tw = dlist_first_entry_or_null(&tcp_tw_expiry,
+			struct tcp_tw_sock, expiry_lnk);
+	if (tw == NULL) {
+		timer_stop(&tcp_tw_timer);
+		return;
 	}
+	timer_start(&tcp_tw_timer, ms2jiffies(max((int32_t)(tw->expires - now),
+			(int32_t)TCP_TIMER_GRANULARITY)));
+}
 
-	ack = ntohl(tcph->ack_seq);
-	ack2last_ack = ack - tcp_sk->last_ack;
-	seq = tcp_sk->self.seq;
+static void tcp_tw_free(struct tcp_tw_sock *tw) {
+	dlist_del_init(&tw->hash_lnk);
+	dlist_del_init(&tw->expiry_lnk);
+	pool_free(&tcp_tw_pool, tw);
+}
 
-	if (ack2last_ack == 0) {
-		/* no new acknowledgments */
-		if ((seq != ack) && !tcp_sk->rexmit_mode) {
-			++tcp_sk->dup_ack;
-			if (tcp_sk->dup_ack == TCP_REXMIT_DUP_ACK) {
-				tcp_sk->rexmit_mode = 1;
-				tcp_rexmit(tcp_sk);
+static void tcp_tw_timer_handler(struct sys_timer *timer, void *param) {
+	struct tcp_tw_sock *tw;
+	uint32_t now;
+
+	sched_lock();
+	{
+		now = tcp_now();
+		dlist_foreach_entry(tw, &tcp_tw_expiry, expiry_lnk) {
+			if ((int32_t)(tw->expires - now) > 0) {
+				break;
 			}
+			log_debug("release timewait %p", tw);
+			tcp_tw_free(tw);
 		}
+		tcp_tw_timer_start(now);
 	}
-	else if (ack2last_ack <= seq - tcp_sk->last_ack) {
-		confirm_ack(tcp_sk, ack);
-		tcp_sk->last_ack = ack;
-		tcp_get_now(&tcp_sk->ack_time);
-		if (!tcp_sk->rexmit_mode) {
-			tcp_sk->dup_ack = 0;
-			sock_notify(to_sock(tcp_sk), POLLOUT);
-		}
-		else {
-			if (seq == ack) {
-				tcp_sk->rexmit_mode = 0;
-				tcp_sk->dup_ack = 0;
-				sock_notify(to_sock(tcp_sk), POLLOUT);
+	sched_unlock();
+}
+
+static void tcp_tw_restart(struct tcp_tw_sock *tw, uint32_t now) {
+	tw->expires = now + TCP_TIMEWAIT_DELAY;
+	dlist_del_init(&tw->expiry_lnk);
+	dlist_add_prev(&tw->expiry_lnk, &tcp_tw_expiry);
+	if (!timer_is_started(&tcp_tw_timer)) {
+		tcp_tw_timer_start(now);
+	}
+}
+
+/* Moves the closed connection to a minisock and releases the socket */
+static void tcp_tw_enter(struct tcp_sock *tcp_sk) {
+	struct tcp_tw_sock *tw;
+	struct sock *sk;
+	size_t addr_len;
+
+	sk = to_sock(tcp_sk);
+
+	sched_lock();
+	{
+		tw = pool_alloc(&tcp_tw_pool);
+		if (tw != NULL) {
+			tw->family = sk->opt.so_domain;
+			if (tw->family == AF_INET) {
+				tw->laddr.in = to_inet_sock(sk)->src_in.sin_addr;
+				tw->raddr.in = to_inet_sock(sk)->dst_in.sin_addr;
+				addr_len = sizeof tw->raddr.in;
 			}
 			else {
-				tcp_rexmit(tcp_sk);
+				tw->laddr.in6 = to_inet6_sock(sk)->src_in6.sin6_addr;
+				tw->raddr.in6 = to_inet6_sock(sk)->dst_in6.sin6_addr;
+				addr_len = sizeof tw->raddr.in6;
 			}
+			tw->lport = sock_inet_get_src_port(sk);
+			tw->rport = sock_inet_get_dst_port(sk);
+			tw->snd_nxt = tcp_sk->self.seq;
+			tw->rcv_nxt = tcp_sk->rem.seq;
+			tw->wind = tcp_sk->self.wind.value;
+
+			dlist_head_init(&tw->hash_lnk);
+			dlist_head_init(&tw->expiry_lnk);
+			dlist_add_prev(&tw->hash_lnk, &tcp_tw_hash[tcp_tw_hashfn(
+					&tw->raddr, addr_len, tw->rport, tw->lport)]);
+			tcp_tw_restart(tw, tcp_now());
 		}
 	}
-	else if (ack - seq <= ack2last_ack) {
-		/* package with non-last acknowledgment */
+	sched_unlock();
+
+	if (tw == NULL) {
+		log_debug("no room for timewait of sk %p", sk);
+	}
+	tcp_sock_release(tcp_sk);
+}
+
+static struct tcp_tw_sock *tcp_tw_lookup(const struct sk_buff *skb) {
+	struct tcp_tw_sock *tw;
+	const void *saddr, *daddr;
+	size_t addr_len;
+	int family;
+
+	if (ip_check_version(ip_hdr(skb))) {
+		family = AF_INET;
+		saddr = &ip_hdr(skb)->saddr;
+		daddr = &ip_hdr(skb)->daddr;
+		addr_len = sizeof(struct in_addr);
 	}
 	else {
-		assert(seq - tcp_sk->last_ack < ack2last_ack);
-		/* assert(ack > tcp_sk->self.seq); -- without overflow checks */
-		log_debug("invalid acknowledgments: last_ack=%u ack=%u seq=%u",
-				tcp_sk->last_ack, ack, seq);
-		switch (tcp_sk->state) {
-		default:
-			break;
-		case TCP_SYN_SENT:
-		case TCP_SYN_RECV_PRE:
-		case TCP_SYN_RECV:
-			return TCP_RET_RST;
+		family = AF_INET6;
+		saddr = &ip6_hdr(skb)->saddr;
+		daddr = &ip6_hdr(skb)->daddr;
+		addr_len = sizeof(struct in6_addr);
+	}
+
+	dlist_foreach_entry(tw, &tcp_tw_hash[tcp_tw_hashfn(saddr, addr_len,
+				tcp_hdr(skb)->source, tcp_hdr(skb)->dest)], hash_lnk) {
+		if ((tw->family == family)
+				&& (tw->rport == tcp_hdr(skb)->source)
+				&& (tw->lport == tcp_hdr(skb)->dest)
+				&& !memcmp(&tw->raddr, saddr, addr_len)
+				&& !memcmp(&tw->laddr, daddr, addr_len)) {
+			return tw;
 		}
-		return TCP_RET_DROP;
 	}
 
-	/* Check ack flag for our state */
-	switch (tcp_sk->state) {
-	default:
-		break;
-	case TCP_SYN_SENT:
-	case TCP_SYN_RECV:
-	case TCP_FINWAIT_1:
-	case TCP_CLOSING:
-	case TCP_LASTACK:
-		if (ack - tcp_sk->ack_flag <= seq - tcp_sk->ack_flag) {
-			/* All ok, our flag was confirmed */
+	return NULL;
+}
+
+static void tcp_tw_send_ack(struct tcp_tw_sock *tw, struct sk_buff *skb) {
+	struct tcphdr *tcph;
+	size_t tcph_size;
+	const struct net_pack_out_ops *out_ops;
+
+	out_ops = tw->family == AF_INET ? ip_out_ops : ip6_out_ops;
+	if (out_ops == NULL) {
+		skb_free(skb);
+		return; /* error: not implemented */
+	}
+
+	/* make packet with L3 header */
+	tcph_size = TCP_MIN_HEADER_SIZE;
+	assert(out_ops->make_pack != NULL);
+	if (0 != out_ops->make_pack(NULL, NULL, &tcph_size, &skb)) {
+		return; /* error: see ret */
+	}
+	else if (tcph_size < TCP_MIN_HEADER_SIZE) {
+		skb_free(skb);
+		return; /* error: no memory */
+	}
+
+	tcph = tcp_hdr(skb);
+	tcp_build(tcph, tw->rport, tw->lport, TCP_MIN_HEADER_SIZE, tw->wind);
+	tcp_set_seq_field(tcph, tw->snd_nxt);
+	tcp_set_ack_field(tcph, tw->rcv_nxt);
+	tcp_set_check_field(tcph, skb->nh.raw);
+
+	tcp_xmit(skb, NULL, out_ops);
+}
+
+/**
+ * Handles a segment for a connection in TIME-WAIT, if there is one.
+ * Returns zero if the segment must go the usual way.
+ */
+static int tcp_tw_rcv(struct sk_buff *skb) {
+	struct tcp_tw_sock *tw;
+	struct tcphdr *tcph;
+	uint16_t old_check;
+
+	sched_lock();
+
+	tw = tcp_tw_lookup(skb);
+	if (tw == NULL) {
+		sched_unlock();
+		return 0;
+	}
+
+	tcph = tcp_hdr(skb);
+	if (MODOPS_VERIFY_CHKSUM) {
+		old_check = tcph->check;
+		tcp_set_check_field(tcph, skb->nh.raw);
+		if (old_check != tcph->check) {
+			goto drop;
 		}
-		else { /* Else unmark ack flag */
-			log_debug("sk %p unmark ack\n",
-					to_sock(tcp_sk));
-			/* XXX remove const qualifier */
-			((struct tcphdr *)tcph)->ack = 0;
+	}
+
+	if (tcph->rst) {
+		tcp_tw_free(tw);
+		goto drop;
+	}
+	if (tcph->syn && !tcph->ack
+			&& ((int32_t)(ntohl(tcph->seq) - tw->rcv_nxt) > 0)) {
+		/* New incarnation of the connection (RFC 1122, 4.2.2.13) */
+		tcp_tw_free(tw);
+		sched_unlock();
+		return 0;
+	}
+	if (tcph->fin) {
+		/* Our last ACK was lost, stay another 2MSL */
+		tcp_tw_restart(tw, tcp_now());
+	}
+	if (tcp_seq_length(tcph, skb->nh.raw) != 0) {
+		tcp_tw_send_ack(tw, skb);
+		sched_unlock();
+		return 1;
+	}
+
+drop:
+	sched_unlock();
+	skb_free(skb);
+	return 1;
+}
+
+static int tcp_tw_init(void) {
+	int i;
+
+	for (i = 0; i < TCP_TW_HASH_SIZE; i++) {
+		dlist_init(&tcp_tw_hash[i]);
+	}
+
+	return timer_init(&tcp_tw_timer, TIMER_ONESHOT,
+			tcp_tw_timer_handler, NULL);
+}
+
+/**
+ * Main function of TCP protocol
+ */
+static void tcp_process(struct tcp_sock *tcp_sk, struct sk_buff *skb) {
+
+	if (tcp_sk != NULL) {
+		enum tcp_ret_code ret;
+
+		tcp_get_now(&tcp_sk->rcv_time);
+		tcp_sk->keep_probes = 0;
+
+		ret = tcp_handle(tcp_sk, skb, pre_process);
+		if (ret == TCP_RET_OK) {
+			ret = tcp_handle(tcp_sk, skb, NULL);
 		}
-		break;
+
+		if (ret == TCP_RET_RST) {
+			send_rst_reply(skb);
+		}
+		else if ((ret != TCP_RET_FREE)
+				&& (tcp_sk->state == TCP_TIMEWAIT)) {
+			tcp_tw_enter(tcp_sk);
+		}
+	}
+	else if (tcp_hdr(skb)->rst) {
+		/* ignore RST when socket doesn't exist */
+		kstat_inc(&tcp_rx_drops);
+		skb_free(skb);
+	}
+	else {
+		/* generate RST when socket doesn't exist */
+		send_rst_reply(skb);
 	}
+}
 
-	return TCP_RET_OK;
+/************************ SYN queue ************************************/
+#define TCP_REQ_HASH_SIZE 64
+
+/**
+ * Half-open connection: SYN is received, SYN-ACK is sent. The socket is
+ * created only when the peer ACKs, so a flood of SYNs costs no more
+ * than these. Once the queue of a listener is full, SYN cookies are
+ * sent instead, those keep nothing at all.
+ */
+struct tcp_req_sock {
+	struct dlist_head hash_lnk;
+	struct dlist_head lnk;        /* In tcp_req_list */
+	struct tcp_sock *listener;
+	uint32_t start;               /* First SYN-ACK, in ms of tcp_now() */
+	uint32_t expires;             /* Next SYN-ACK */
+	unsigned int retries;
+	int family;
+	union {
+		struct in_addr in;
+		struct in6_addr in6;
+	} laddr, raddr;
+	in_port_t lport, rport;       /* Network byte order */
+	uint32_t iss;                 /* Our initial sequence number */
+	uint32_t irs;                 /* Initial sequence number of the peer */
+	unsigned int opt_flags;       /* TCP_OPT_F_xxx agreed */
+	uint32_t ts_recent;
+	uint16_t mss;                 /* Zero if the peer didn't send it */
+	uint8_t wscale;
+};
+
+/* Queues of a listening socket */
+struct tcp_listen {
+	struct mpmc_ring accept_queue; /* Of established struct tcp_sock * */
+	uint64_t storage[MPMC_RING_STORAGE_SIZE(sizeof(struct tcp_sock *),
+			MODOPS_ACCEPT_QUEUE_LEN) / sizeof(uint64_t)];
+	unsigned int backlog;
+	unsigned int syn_queue_len;
+};
+static_assert((MODOPS_ACCEPT_QUEUE_LEN & (MODOPS_ACCEPT_QUEUE_LEN - 1)) == 0);
+
+POOL_DEF(tcp_req_pool, struct tcp_req_sock, MODOPS_AMOUNT_REQ_SOCK);
+POOL_DEF(tcp_listen_pool, struct tcp_listen, MODOPS_AMOUNT_LISTEN_SOCK);
+static struct dlist_head tcp_req_hash[TCP_REQ_HASH_SIZE];
+static DLIST_DEFINE(tcp_req_list);
+static struct sys_timer tcp_req_timer;
+static uint32_t tcp_secret;
+
+/* MSS a SYN cookie can tell, by index */
+static const uint16_t tcp_cookie_mss[] = {
+	536, 1024, 1220, 1440, 1460, 4312, 8960, 16396
+};
+static_assert(ARRAY_SIZE(tcp_cookie_mss) == 8);
+
+/* Jenkins's one-at-a-time hash */
+static uint32_t tcp_hash_add(uint32_t h, const void *data, size_t len) {
+	const uint8_t *ptr;
+
+	for (ptr = data; len != 0; len--) {
+		h += *ptr++;
+		h += h << 10;
+		h ^= h >> 6;
+	}
+	return h;
 }
 
-#if 0
-static inline int tcp_opt_process(struct tcphdr *tcph, struct tcphdr *otcph, struct tcp_sock *tcp_sk) {
-	char *ptr = (char *) &tcph->options;
-	for(;;) {
-		switch(*ptr) {
-		case TCP_OPT_KIND_EOL:
-			return (int) ptr - (int) &tcph->options;
-		case TCP_OPT_KIND_NOP:
-			ptr++;
-			break;
-		case TCP_OPT_KIND_MSS:
-			ptr+=2;
-			tcp_sk->mss = ntohs((__be16) *ptr);
+static uint32_t tcp_req_hashfn(const struct tcp_req_sock *req,
+		uint32_t salt) {
+	size_t addr_len;
+	uint32_t h;
+
+	addr_len = req->family == AF_INET ? sizeof req->raddr.in
+			: sizeof req->raddr.in6;
+	h = tcp_hash_add(salt, &req->raddr, addr_len);
+	h = tcp_hash_add(h, &req->laddr, addr_len);
+	h = tcp_hash_add(h, &req->rport, sizeof req->rport);
+	h = tcp_hash_add(h, &req->lport, sizeof req->lport);
+	h += h << 3;
+	h ^= h >> 11;
+	h += h << 15;
+
+	return h;
+}
+
+/* Taken at the first SYN, the time since boot is less predictable */
+static uint32_t tcp_secret_get(void) {
+	uint64_t ns;
+
+	if (tcp_secret == 0) {
+		ns = ktime_get_ns();
+		tcp_secret = tcp_hash_add(0x9e3779b9, &ns, sizeof ns) | 1;
+	}
+	return tcp_secret;
+}
+
+/* Addresses and ports of the connection @a skb belongs to */
+static void tcp_req_key(struct tcp_req_sock *req, const struct sk_buff *skb) {
+	memset(req, 0, sizeof *req);
+	if (ip_check_version(ip_hdr(skb))) {
+		req->family = AF_INET;
+		memcpy(&req->laddr.in, &ip_hdr(skb)->daddr, sizeof req->laddr.in);
+		memcpy(&req->raddr.in, &ip_hdr(skb)->saddr, sizeof req->raddr.in);
+	}
+	else {
+		req->family = AF_INET6;
+		memcpy(&req->laddr.in6, &ip6_hdr(skb)->daddr,
+				sizeof req->laddr.in6);
+		memcpy(&req->raddr.in6, &ip6_hdr(skb)->saddr,
+				sizeof req->raddr.in6);
+	}
+	req->lport = tcp_hdr(skb)->dest;
+	req->rport = tcp_hdr(skb)->source;
+}
+
+static struct tcp_req_sock *tcp_req_lookup(const struct tcp_req_sock *key) {
+	struct tcp_req_sock *req;
+	size_t addr_len;
+
+	addr_len = key->family == AF_INET ? sizeof key->raddr.in
+			: sizeof key->raddr.in6;
+	dlist_foreach_entry(req, &tcp_req_hash[tcp_req_hashfn(key,
+				tcp_secret_get()) % TCP_REQ_HASH_SIZE], hash_lnk) {
+		if ((req->family == key->family)
+				&& (req->rport == key->rport)
+				&& (req->lport == key->lport)
+				&& !memcmp(&req->raddr, &key->raddr, addr_len)
+				&& !memcmp(&req->laddr, &key->laddr, addr_len)) {
+			return req;
 		}
 	}
-	return 0;
+
+	return NULL;
+}
+
+/* RFC 6528: hash of the connection plus a 4 us clock */
+static uint32_t tcp_req_isn(const struct tcp_req_sock *req) {
+	return tcp_req_hashfn(req, tcp_secret_get())
+			+ (uint32_t)(ktime_get_ns() >> 12);
+}
+
+static uint32_t tcp_cookie_time(void) {
+	return tcp_now() / TCP_COOKIE_PERIOD;
+}
+
+/**
+ * SYN cookie is our ISN: the ISN of the peer plus the time counter in
+ * bits 31-27, index of MSS in bits 26-24 and hash of the connection and
+ * the counter in the rest. Other options are lost.
+ */
+static uint32_t tcp_cookie_make(struct tcp_req_sock *req, uint16_t mss) {
+	uint32_t t, i;
+
+	for (i = ARRAY_SIZE(tcp_cookie_mss) - 1;
+			(i > 0) && (tcp_cookie_mss[i] > mss); i--) { }
+	req->mss = tcp_cookie_mss[i];
+
+	t = tcp_cookie_time();
+	return req->irs + ((t & 0x1f) << 27) + (i << 24)
+			+ (tcp_req_hashfn(req, tcp_secret_get() + t) & 0xffffff);
+}
+
+/* Cookie of the current or the previous time counter is valid */
+static int tcp_cookie_check(struct tcp_req_sock *req) {
+	uint32_t val, t, age;
+
+	val = req->iss - req->irs;
+	t = tcp_cookie_time();
+	age = (t - (val >> 27)) & 0x1f;
+	if (age > 1) {
+		return 0;
+	}
+	if ((val & 0xffffff) != (tcp_req_hashfn(req,
+				tcp_secret_get() + t - age) & 0xffffff)) {
+		return 0;
+	}
+	req->mss = tcp_cookie_mss[(val >> 24) & 0x7];
+
+	return 1;
+}
+
+static void tcp_req_xmit_synack(const struct tcp_req_sock *req) {
+	union {
+		struct sockaddr sa;
+		struct sockaddr_in in;
+		struct sockaddr_in6 in6;
+	} to;
+	struct sock *sk;
+	struct sk_buff *skb;
+	struct tcphdr *tcph;
+	size_t opt_len, size;
+	uint8_t *ptr;
+
+	sk = to_sock(req->listener);
+	if (sk->o_ops == NULL) {
+		return;
+	}
+
+	memset(&to, 0, sizeof to);
+	if (req->family == AF_INET) {
+		to.in.sin_family = AF_INET;
+		to.in.sin_port = req->rport;
+		to.in.sin_addr = req->raddr.in;
+	}
+	else {
+		to.in6.sin6_family = AF_INET6;
+		to.in6.sin6_port = req->rport;
+		to.in6.sin6_addr = req->raddr.in6;
+	}
+
+	opt_len = tcp_opt_len_syn(req->opt_flags);
+	size = TCP_MIN_HEADER_SIZE + opt_len;
+	skb = NULL;
+	assert(sk->o_ops->make_pack != NULL);
+	if (0 != sk->o_ops->make_pack(sk, &to.sa, &size, &skb)) {
+		return; /* error: see ret */
+	}
+	else if (size < TCP_MIN_HEADER_SIZE + opt_len) {
+		skb_free(skb);
+		return; /* error: no memory */
+	}
+
+	tcph = tcp_hdr(skb);
+	/* Window of SYN is never scaled */
+	tcp_build(tcph, req->rport, req->lport, TCP_MIN_HEADER_SIZE + opt_len,
+			min(TCP_RCVBUF_INIT, 0xffff));
+	tcph->syn = 1;
+	tcp_set_seq_field(tcph, req->iss);
+	tcp_set_ack_field(tcph, req->irs + 1);
+	ptr = tcp_opt_build_syn((uint8_t *)&tcph->options[0], req->opt_flags,
+			req->listener->self.wind.factor, req->ts_recent);
+	assert(ptr == (uint8_t *)&tcph->options[0] + opt_len);
+	tcp_set_check_field(tcph, skb->nh.raw);
+
+	tcp_xmit(skb, NULL, sk->o_ops);
+}
+
+static void tcp_req_free(struct tcp_req_sock *req) {
+	assert(req->listener->listen->syn_queue_len > 0);
+	req->listener->listen->syn_queue_len--;
+	dlist_del_init(&req->hash_lnk);
+	dlist_del_init(&req->lnk);
+	pool_free(&tcp_req_pool, req);
+}
+
+static void tcp_req_timer_start(uint32_t now) {
+	struct tcp_req_sock *req;
+	int32_t due;
+	int armed;
+
+	due = 0;
+	armed = 0;
+	dlist_foreach_entry(req, &tcp_req_list, lnk) {
+		if (!armed || ((int32_t)(req->expires - now) < due)) {
+			due = req->expires - now;
+			armed = 1;
+		}
+	}
+	if (!armed) {
+		timer_stop(&tcp_req_timer);
+		return;
+	}
+	timer_start(&tcp_req_timer, ms2jiffies(max(due,
+			(int32_t)TCP_TIMER_GRANULARITY)));
+}
+
+/* SYN-ACK is sent again with backoff until the handshake times out */
+static void tcp_req_timer_handler(struct sys_timer *timer, void *param) {
+	struct tcp_req_sock *req;
+	uint32_t now;
+
+	sched_lock();
+	{
+		now = tcp_now();
+		dlist_foreach_entry(req, &tcp_req_list, lnk) {
+			if ((int32_t)(req->expires - now) > 0) {
+				continue;
+			}
+			if (now - req->start >= TCP_SYNC_TIMEOUT) {
+				log_debug("release half-open %p", req);
+				tcp_req_free(req);
+				continue;
+			}
+			req->retries++;
+			req->expires = now + min((uint32_t)TCP_RTO_INIT << req->retries,
+					(uint32_t)TCP_RTO_MAX);
+			kstat_inc(&tcp_retransmits);
+			tcp_req_xmit_synack(req);
+		}
+		tcp_req_timer_start(now);
+	}
+	sched_unlock();
 }
-#endif
 
-static enum tcp_ret_code process_opt(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph) {
-	char *ptr = (char *)&tcph->options[0];
-	char *end = ptr + TCP_HEADER_SIZE(tcph) - TCP_MIN_HEADER_SIZE;
-	char *prev_ptr;
+static void tcp_req_syn(struct tcp_sock *listener, struct sk_buff *skb) {
+	struct tcp_req_sock key, *req;
+	struct tcp_listen *listen;
+	struct tcp_opts opts;
+	uint32_t now;
 
-	do {
-		prev_ptr = ptr;
-		switch (*ptr) {
-		default:
-			ptr += *(ptr + 1);
-			break;
-		case TCP_OPT_KIND_NOP:
-			++ptr;
-			break;
-		case TCP_OPT_KIND_WS:
-			if (*(ptr + 1) == 3) {
-				tcp_seq_state_set_wind_factor(&tcp_sk->rem,
-						*(ptr + 2));
+	listen = listener->listen;
+	assert(listen != NULL);
+
+	tcp_req_key(&key, skb);
+	key.listener = listener;
+	key.irs = ntohl(tcp_hdr(skb)->seq);
+
+	sched_lock();
+	{
+		req = tcp_req_lookup(&key);
+		if (req != NULL) {
+			if (req->irs == key.irs) {
+				/* SYN is sent again, our SYN-ACK was lost */
+				tcp_req_xmit_synack(req);
 			}
-			ptr += *(ptr + 1);
-			break;
+			goto out;
 		}
-		// TODO this is hack to fix cycling when ptr does not change
-		if (prev_ptr == ptr) {
-			++ptr;
+		if (mpmc_ring_count(&listen->accept_queue) >= listen->backlog) {
+			/* Peer sends SYN again later */
+			kstat_inc(&tcp_listen_drops);
+			goto out;
 		}
-	} while (ptr < end);
 
-	// TODO revert this comment
-	//assert(ptr == end);
+		tcp_opts_parse(tcp_hdr(skb), &opts);
 
-	return TCP_RET_OK;
+		req = listen->syn_queue_len < listen->backlog
+				? pool_alloc(&tcp_req_pool) : NULL;
+		if (req == NULL) {
+			if (MODOPS_SYN_COOKIES) {
+				key.iss = tcp_cookie_make(&key, opts.mss);
+				kstat_inc(&tcp_syncookies_sent);
+				tcp_req_xmit_synack(&key);
+			}
+			else {
+				kstat_inc(&tcp_listen_drops);
+			}
+			goto out;
+		}
+
+		memcpy(req, &key, sizeof *req);
+		req->opt_flags = opts.flags & listener->opt_flags
+				& TCP_OPT_F_SUPPORTED;
+		req->ts_recent = opts.tsval;
+		req->mss = opts.mss;
+		req->wscale = opts.wscale;
+		req->iss = tcp_req_isn(req);
+		now = tcp_now();
+		req->start = now;
+		req->expires = now + TCP_RTO_INIT;
+		req->retries = 0;
+
+		dlist_head_init(&req->hash_lnk);
+		dlist_head_init(&req->lnk);
+		dlist_add_prev(&req->hash_lnk, &tcp_req_hash[tcp_req_hashfn(req,
+				tcp_secret_get()) % TCP_REQ_HASH_SIZE]);
+		dlist_add_prev(&req->lnk, &tcp_req_list);
+		listen->syn_queue_len++;
+
+		log_debug("half-open %p for sk %p", req, to_sock(listener));
+		tcp_req_xmit_synack(req);
+		tcp_req_timer_start(now);
+	}
+out:
+	sched_unlock();
 }
 
-static enum tcp_ret_code pre_process(struct tcp_sock *tcp_sk,
-		const struct tcphdr *tcph, struct sk_buff *skb,
-		struct tcphdr *out_tcph) {
-	int ret;
-	uint32_t seq2rem_seq, seq_len, seq_last2rem_seq, rem_len;
+/* Socket of the connection, established as the handshake completes */
+static struct tcp_sock *tcp_req_child(const struct tcp_req_sock *req,
+		const struct tcphdr *tcph) {
+	union {
+		struct inet_sock *in;
+		struct inet6_sock *in6;
+	} newsk;
+	struct tcp_sock *listener, *tcp_newsk;
+	struct sock *sk;
 
-	/* Check CRC */
-	if (MODOPS_VERIFY_CHKSUM) {
-		uint16_t old_check;
-		old_check = tcph->check;
-		/* XXX remove const qualifier */
-		tcp_set_check_field((struct tcphdr *)tcph, skb->nh.raw);
-		if (old_check != tcph->check) {
-			log_error("invalid checksum %hx(%hx) sk %p skb %p",
-						ntohs(old_check), ntohs(tcph->check),
-						to_sock(tcp_sk), skb);
-			return TCP_RET_DROP;
-		}
+	listener = req->listener;
+	sk = sock_create(req->family, SOCK_STREAM, IPPROTO_TCP);
+	if (err(sk) != 0) {
+		return NULL;
+	}
+	tcp_newsk = to_tcp_sock(sk);
+
+	if (req->family == AF_INET) {
+		newsk.in = to_inet_sock(sk);
+		newsk.in->src_in.sin_family = AF_INET;
+		newsk.in->src_in.sin_port = req->lport;
+		newsk.in->src_in.sin_addr = req->laddr.in;
+		newsk.in->dst_in.sin_family = AF_INET;
+		newsk.in->dst_in.sin_port = req->rport;
+		newsk.in->dst_in.sin_addr = req->raddr.in;
+	}
+	else {
+		newsk.in6 = to_inet6_sock(sk);
+		newsk.in6->src_in6.sin6_family = AF_INET6;
+		newsk.in6->src_in6.sin6_port = req->lport;
+		newsk.in6->src_in6.sin6_addr = req->laddr.in6;
+		newsk.in6->dst_in6.sin6_family = AF_INET6;
+		newsk.in6->dst_in6.sin6_port = req->rport;
+		newsk.in6->dst_in6.sin6_addr = req->raddr.in6;
 	}
 
-	/* Process RST */
-	if (tcph->rst) {
-		ret = process_rst(tcp_sk, tcph);
-		if (ret != TCP_RET_OK) {
-			return ret;
-		}
+	/* Settings inherited from the listener */
+	sk->opt.so_keepalive = to_sock(listener)->opt.so_keepalive;
+	sk->opt.so_reuseport = to_sock(listener)->opt.so_reuseport;
+	tcp_newsk->keep_idle = listener->keep_idle;
+	tcp_newsk->keep_intvl = listener->keep_intvl;
+	tcp_newsk->keep_cnt = listener->keep_cnt;
+	tcp_newsk->nodelay = listener->nodelay;
+
+	tcp_newsk->self.seq = tcp_newsk->last_ack = req->iss + 1;
+	tcp_newsk->rem.seq = req->irs + 1;
+	tcp_newsk->opt_flags = req->opt_flags;
+	tcp_newsk->ts_recent = req->ts_recent;
+	if (req->opt_flags & TCP_OPT_F_WS) {
+		tcp_newsk->rem.wind.factor = req->wscale;
+	}
+	else {
+		/* Both sides scale or none */
+		tcp_seq_state_set_wind_factor(&tcp_newsk->self, 0);
+		tcp_newsk->rem.wind.factor = 0;
+	}
+	tcp_seq_state_set_wind_value(&tcp_newsk->rem, ntohs(tcph->window));
+	if (req->mss != 0) {
+		tcp_cong_set_mss(tcp_newsk, req->mss);
 	}
 
-	/* Analyze sequence */
-	switch (tcp_sk->state) {
-	default:
-		break;
-	case TCP_SYN_RECV:
-	case TCP_ESTABIL:
-	case TCP_FINWAIT_1:
-	case TCP_FINWAIT_2:
-	case TCP_CLOSEWAIT:
-	case TCP_CLOSING:
-	case TCP_LASTACK:
-	case TCP_TIMEWAIT:
-		seq2rem_seq = ntohl(tcph->seq) - tcp_sk->rem.seq;
-		seq_len = tcp_seq_length(skb->h.th, skb->nh.raw);;
-		seq_last2rem_seq = seq2rem_seq + seq_len;
-		rem_len = tcp_sk->self.wind.size;
-		if (seq2rem_seq < rem_len) {
-			if (seq2rem_seq != 0) {
-				/* TODO There is correct packet (with
-				 * correct sequence number), but some packages
-				 * was lost. We should save this skb, and wait
-				 * previous packages.
-				 */
-				return TCP_RET_DROP;
+	tcp_newsk->parent = listener;
+	tcp_sock_set_state(tcp_newsk, TCP_ESTABIL);
+
+	return tcp_newsk;
+}
+
+static enum tcp_ret_code tcp_req_ack(struct tcp_sock *listener,
+		struct sk_buff *skb) {
+	struct tcp_req_sock key, *req;
+	struct tcp_sock *tcp_newsk;
+	struct tcp_listen *listen;
+	const struct tcphdr *tcph;
+
+	tcph = tcp_hdr(skb);
+	if (tcph->syn) {
+		return TCP_RET_RST;
+	}
+
+	tcp_req_key(&key, skb);
+	key.listener = listener;
+	key.irs = ntohl(tcph->seq) - 1;
+	key.iss = ntohl(tcph->ack_seq) - 1;
+
+	sched_lock();
+	{
+		req = tcp_req_lookup(&key);
+		if (req != NULL) {
+			if (req->iss != key.iss) {
+				sched_unlock();
+				return TCP_RET_RST;
 			}
+			/* SO_REUSEPORT group may have changed since SYN */
+			listener = req->listener;
+		}
+		else if (!MODOPS_SYN_COOKIES || !tcp_cookie_check(&key)) {
+			sched_unlock();
+			return TCP_RET_RST;
 		}
-		else if ((seq_last2rem_seq != 0)
-				&& (seq_last2rem_seq <= rem_len)) { }
 		else {
-			log_debug("received old package:"
-						" rem_seq=%u seq=%u seq_last=%u rem_last=%u\n",
-					tcp_sk->rem.seq, ntohl(tcph->seq),
-					ntohl(tcph->seq) + seq_len,
-					tcp_sk->rem.seq + rem_len);
-			if (seq2rem_seq <= -seq_len) {
-				/* Send segment with ack flag if this packet
-				 * is duplicated */
-				tcp_set_ack_field(out_tcph, tcp_sk->rem.seq);
-				return TCP_RET_SEND;
-			}
+			req = &key;
+		}
+
+		listen = listener->listen;
+		if (mpmc_ring_count(&listen->accept_queue) >= listen->backlog) {
+			/* Half-open connection stays, the peer ACKs SYN-ACK
+			 * sent again */
+			kstat_inc(&tcp_listen_drops);
+			sched_unlock();
 			return TCP_RET_DROP;
 		}
-		break;
-	}
 
-	/* Porcess ACK */
-	if (tcph->ack) {
-		ret = process_ack(tcp_sk, tcph);
-		if (ret != TCP_RET_OK) {
-			return ret;
+		tcp_newsk = tcp_req_child(req, tcph);
+		if (tcp_newsk == NULL) {
+			kstat_inc(&tcp_listen_drops);
+			sched_unlock();
+			return TCP_RET_DROP;
+		}
+		if (req != &key) {
+			if (req->retries == 0) {
+				/* Karn's algorithm: no sample if SYN-ACK was sent again */
+				tcp_rtt_sample(tcp_newsk,
+						(tcp_now() - req->start) * USEC_PER_MSEC);
+			}
+			tcp_req_free(req);
 		}
-	}
 
-	/* Update window */
-	switch (tcp_sock_get_status(tcp_sk)) {
-	default:
-		break;
-	case TCP_ST_SYNC:
-		tcp_seq_state_set_wind_value(&tcp_sk->rem,
-				ntohs(tcph->window));
-		break;
-	}
+		/* ACK may carry data already */
+		tcp_process(tcp_newsk, skb);
 
-	/* Process options */
-	if (TCP_HEADER_SIZE(tcph) != TCP_MIN_HEADER_SIZE) {
-		ret = process_opt(tcp_sk, tcph);
-		if (ret != TCP_RET_OK) {
-			return ret;
+		if (!mpmc_ring_enqueue(&listen->accept_queue, &tcp_newsk, 1)) {
+			kstat_inc(&tcp_listen_drops);
+			tcp_newsk->parent = NULL;
+			tcp_sock_release(tcp_newsk);
+			sched_unlock();
+			return TCP_RET_OK;
 		}
+		//FIXME tcp_accept must notify without rx_data_len
+		to_sock(listener)->rx_data_len++;
+		sock_notify(to_sock(listener), POLLIN);
 	}
+	sched_unlock();
 
 	return TCP_RET_OK;
 }
 
-/************************ Handlers table *******************************/
-static const tcp_handler_t tcp_st_handler[TCP_MAX_STATE] = {
-		[ TCP_CLOSED ] = tcp_st_closed,
-		[ TCP_LISTEN ] = tcp_st_listen,
-		[ TCP_SYN_SENT ] = tcp_st_syn_sent,
-		[ TCP_SYN_RECV_PRE ] = tcp_st_syn_recv_pre,
-		[ TCP_SYN_RECV ] = tcp_st_syn_recv,
-		[ TCP_ESTABIL ] = tcp_st_estabil,
-		[ TCP_FINWAIT_1 ] = tcp_st_finwait_1,
-		[ TCP_FINWAIT_2 ] = tcp_st_finwait_2,
-		[ TCP_CLOSEWAIT ] = tcp_st_closewait,
-		[ TCP_CLOSING ] = tcp_st_closing,
-		[ TCP_LASTACK ] = tcp_st_lastack,
-		[ TCP_TIMEWAIT ] = tcp_st_timewait
-};
+int tcp_sock_listen(struct tcp_sock *tcp_sk, int backlog) {
+	struct tcp_listen *listen;
 
-static int tcp_handle(struct tcp_sock *tcp_sk, struct sk_buff *skb,
-		tcp_handler_t hnd) {
-	/* If result is not TCP_RET_OK then further processing
-	 * can't be made */
-	enum tcp_ret_code ret;
-	struct tcphdr out_tcph;
-	struct sk_buff *out_skb;
+	assert(backlog > 0);
 
-	tcp_build(&out_tcph, skb->h.th->source, skb->h.th->dest,
-			TCP_MIN_HEADER_SIZE, tcp_sk->self.wind.value);
-	out_skb = NULL;
+	sched_lock();
+	{
+		listen = tcp_sk->listen;
+		if (listen == NULL) {
+			listen = pool_alloc(&tcp_listen_pool);
+			if (listen == NULL) {
+				sched_unlock();
+				return -ENOBUFS;
+			}
+			mpmc_ring_init(&listen->accept_queue, listen->storage,
+					sizeof(struct tcp_sock *), MODOPS_ACCEPT_QUEUE_LEN);
+			listen->syn_queue_len = 0;
+			tcp_sk->listen = listen;
+		}
+		/* Called again to change the backlog */
+		listen->backlog = min((unsigned int)backlog,
+				(unsigned int)MODOPS_ACCEPT_QUEUE_LEN);
+	}
+	sched_unlock();
 
-	/**
-	 * If we want to use the current package (to save for example),
-	 * we must create a new package to send a response (if we need
-	 * to send a response). After this the handler may do anything
-	 * with current sk_buff_t.
-	 * If hnd is NULL we use synchronization tools.
-	 */
-	assert(tcp_sk->state < TCP_MAX_STATE);
-	assert(tcp_st_handler[tcp_sk->state] != NULL);
-	hnd = hnd != NULL ? hnd : tcp_st_handler[tcp_sk->state];
+	return 0;
+}
 
-	tcp_sock_lock(tcp_sk, TCP_SYNC_STATE);
+struct tcp_sock *tcp_sock_accept(struct tcp_sock *tcp_sk) {
+	struct tcp_sock *tcp_newsk;
+
+	assert(tcp_sk->listen != NULL);
+
+	if (!mpmc_ring_dequeue(&tcp_sk->listen->accept_queue, &tcp_newsk, 1)) {
+		return NULL;
+	}
+
+	sched_lock();
 	{
-		ret = hnd(tcp_sk, skb->h.th, skb, &out_tcph);
+		tcp_newsk->parent = NULL;
+		assert(to_sock(tcp_sk)->rx_data_len > 0);
+		to_sock(tcp_sk)->rx_data_len--;
 	}
-	tcp_sock_unlock(tcp_sk, TCP_SYNC_STATE);
+	sched_unlock();
 
-	log_debug("ret %d skb %p sk %p",
-			ret,
-			out_skb != NULL ? out_skb : skb,
-			to_sock(tcp_sk));
+	return tcp_newsk;
+}
 
-	switch (ret) {
-	case TCP_RET_FREE:
-		/* skb may be listed in sock, so they must be free exactly
- 		 * in this order */
-		skb_free(skb);
-		tcp_sock_release(tcp_sk);
-		break;
-	case TCP_RET_DROP:
-		skb_free(skb);
-		break;
-	case TCP_RET_SEND_SEQ:
-	case TCP_RET_SEND:
-		if (NULL == skb_declone(skb)) {
-			skb_free(skb);
-			return TCP_RET_DROP; /* error: ENOMEM */
-		}
-		/* fallthrough */
-	case TCP_RET_SEND_ALLOC:
-		out_skb = ret != TCP_RET_SEND_ALLOC ? skb : NULL;
-		if (0 != alloc_prep_skb(tcp_sk, 0, NULL, &out_skb)) {
-			return TCP_RET_DROP; /* error: see ret */
-		}
-		memcpy(out_skb->h.th, &out_tcph, sizeof out_tcph);
-		if (ret == TCP_RET_SEND_SEQ) {
-			send_seq_from_sock(tcp_sk, out_skb);
+static void tcp_listen_release(struct tcp_sock *tcp_sk) {
+	struct tcp_req_sock *req;
+	struct tcp_sock *tcp_newsk;
+
+	sched_lock();
+	{
+		dlist_foreach_entry(req, &tcp_req_list, lnk) {
+			if (req->listener == tcp_sk) {
+				tcp_req_free(req);
+			}
 		}
-		else {
-			send_nonseq_from_sock(tcp_sk, out_skb);
+		while (mpmc_ring_dequeue(&tcp_sk->listen->accept_queue,
+					&tcp_newsk, 1)) {
+			tcp_newsk->parent = NULL;
+			tcp_sock_free(tcp_newsk);
 		}
-		break;
-	case TCP_RET_RST: /* this processing in tcp_process */
-	case TCP_RET_OK:
-		break;
+		pool_free(&tcp_listen_pool, tcp_sk->listen);
+		tcp_sk->listen = NULL;
 	}
-
-	return ret;
+	sched_unlock();
 }
 
-/**
- * Main function of TCP protocol
- */
-static void tcp_process(struct tcp_sock *tcp_sk, struct sk_buff *skb) {
+static int tcp_req_init(void) {
+	int i;
 
-	if (tcp_sk != NULL) {
-		enum tcp_ret_code ret;
+	for (i = 0; i < TCP_REQ_HASH_SIZE; i++) {
+		dlist_init(&tcp_req_hash[i]);
+	}
 
-		tcp_get_now(&tcp_sk->rcv_time);
+	return timer_init(&tcp_req_timer, TIMER_ONESHOT,
+			tcp_req_timer_handler, NULL);
+}
 
-		ret = tcp_handle(tcp_sk, skb, pre_process);
-		if (ret == TCP_RET_OK) {
-			ret = tcp_handle(tcp_sk, skb, NULL);
-		}
+/**
+ * Listener for a new connection. Listeners sharing the port with
+ * SO_REUSEPORT take connections by hash of addresses and ports.
+ */
+static struct sock *tcp_listener_lookup(const struct sk_buff *skb,
+		sock_lookup_tester_ft tester) {
+	struct tcp_req_sock key;
+	struct sock *sk, *first;
+	unsigned int cnt, i;
+
+	first = sock_lookup(NULL, tcp_sock_ops, tester, skb);
+	if ((first == NULL) || !first->opt.so_reuseport) {
+		return first;
+	}
 
-		if (ret == TCP_RET_RST) {
-			send_rst_reply(skb);
-		}
+	cnt = 0;
+	for (sk = first; sk != NULL; sk = sock_lookup(sk, tcp_sock_ops,
+				tester, skb)) {
+		cnt += sk->opt.so_reuseport
+				&& (to_tcp_sock(sk)->state == TCP_LISTEN);
 	}
-	else if (tcp_hdr(skb)->rst) {
-		/* ignore RST when socket doesn't exist */
-		skb_free(skb);
+	if (cnt == 0) {
+		return first;
 	}
-	else {
-		/* generate RST when socket doesn't exist */
-		send_rst_reply(skb);
+
+	tcp_req_key(&key, skb);
+	i = tcp_req_hashfn(&key, 0) % cnt;
+	for (sk = first; sk != NULL; sk = sock_lookup(sk, tcp_sock_ops,
+				tester, skb)) {
+		if (sk->opt.so_reuseport && (to_tcp_sock(sk)->state == TCP_LISTEN)
+				&& (i-- == 0)) {
+			return sk;
+		}
 	}
+
+	return first;
 }
 
 static int tcp4_rcv_tester_strict(const struct sock *sk,
@@ -1286,12 +3146,14 @@ static int tcp_rcv(struct sk_buff *skb) {
 				? tcp4_rcv_tester_strict
 				: tcp6_rcv_tester_strict,
 			skb);
+	if ((sk == NULL) && tcp_tw_rcv(skb)) {
+		return 0;
+	}
 	if (sk == NULL) {
-		sk = sock_lookup(NULL, tcp_sock_ops,
+		sk = tcp_listener_lookup(skb,
 				ip_check_version(ip_hdr(skb))
 					? tcp4_rcv_tester_soft
-					: tcp6_rcv_tester_soft,
-				skb);
+					: tcp6_rcv_tester_soft);
 	}
 
 	tcp_sk = sk != NULL ? to_tcp_sock(sk) : NULL;
@@ -1300,6 +3162,7 @@ static int tcp_rcv(struct sk_buff *skb) {
 		if (tcp_rcv_need_check_security(tcp_sk)) {
 			/* if we have socket with secure label we have to check secure level */
 			if (sock_get_secure_level(sk) >	skb_get_secure_level(skb)) {
+				kstat_inc(&tcp_rx_drops);
 				skb_free(skb);
 				return 0;
 			}
@@ -1318,49 +3181,13 @@ static int tcp_rcv(struct sk_buff *skb) {
 	return 0;
 }
 
-static void tcp_timer_handler(struct sys_timer *timer, void *param) {
-	struct sock *sk;
-	struct tcp_sock *tcp_sk;
-
-	(void)timer;
-	(void)param;
-
-	sock_foreach(sk, tcp_sock_ops) {
-		tcp_sk = to_tcp_sock(sk);
-		if ((tcp_sk->state == TCP_TIMEWAIT)
-				&& tcp_is_expired(&tcp_sk->rcv_time, TCP_TIMEWAIT_DELAY)) {
-
-			log_debug("release timewait sk %p", to_sock(tcp_sk));
-			tcp_sock_release(tcp_sk);
-		}
-		else if ((tcp_sock_get_status(tcp_sk) == TCP_ST_NONSYNC)
-				&& !list_empty(&tcp_sk->conn_lnk)
-				&& tcp_is_expired(&tcp_sk->syn_time, TCP_SYNC_TIMEOUT)) {
-
-			assert(tcp_sk->parent != NULL);
-			log_debug("release nonsync sk %p", to_sock(tcp_sk));
-			tcp_sock_release(tcp_sk);
-		}
-		else if ((tcp_sock_get_status(tcp_sk) != TCP_ST_NOTEXIST)
-				&& tcp_is_expired(&tcp_sk->ack_time, TCP_REXMIT_DELAY)
-				&& (tcp_sk->last_ack != tcp_sk->self.seq)) {
-
-			log_debug("rexmit sk %p", to_sock(tcp_sk));
-			tcp_sk->rexmit_mode = 1;
-			tcp_rexmit(tcp_sk);
-		}
-	}
-}
-
 static int tcp_init(void) {
 	int ret;
 
-	/* Create default timer */
-	ret = timer_init_start_msec(&tcp_tmr_default, TIMER_PERIODIC,
-			TCP_TIMER_FREQUENCY, tcp_timer_handler, NULL);
+	ret = tcp_tw_init();
 	if (ret != 0) {
 		return ret;
 	}
 
-	return 0;
+	return tcp_req_init();
 }
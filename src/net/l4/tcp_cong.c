@@ -0,0 +1,161 @@
+/**
+ * @file
+ * @brief TCP congestion control core and Reno
+ *
+ * Slow start counts ACKed bytes (RFC 3465) since a single segment may
+ * carry up to 64K here. Window doesn't grow during loss recovery.
+ *
+ * @date 19.10.2026
+ */
+
+#include <util/log.h>
+
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <util/array.h>
+#include <util/math.h>
+
+#include <net/l4/tcp.h>
+#include <net/l4/tcp_cong.h>
+
+#include <framework/mod/options.h>
+
+#define TCP_CONG_DEFAULT OPTION_STRING_GET(congestion_control)
+
+ARRAY_SPREAD_DEF(const struct tcp_cong_ops *const, __tcp_cong_registry);
+
+static const struct tcp_cong_ops tcp_reno;
+
+const struct tcp_cong_ops *tcp_cong_find(const char *name) {
+	const struct tcp_cong_ops *ops;
+
+	tcp_cong_foreach(ops) {
+		if (!strcmp(ops->name, name)) {
+			return ops;
+		}
+	}
+	return NULL;
+}
+
+const struct tcp_cong_ops *tcp_cong_default(void) {
+	static const struct tcp_cong_ops *def;
+
+	if (!def) {
+		def = tcp_cong_find(TCP_CONG_DEFAULT);
+		if (!def) {
+			log_error("no %s congestion control, using reno",
+					TCP_CONG_DEFAULT);
+			def = &tcp_reno;
+		}
+	}
+	return def;
+}
+
+static void tcp_cong_switch(struct tcp_sock *tcp_sk,
+		const struct tcp_cong_ops *ops) {
+	tcp_sk->cong = ops;
+	tcp_sk->cwnd_acked = 0;
+	memset(tcp_sk->cong_priv, 0, sizeof tcp_sk->cong_priv);
+	if (ops->init) {
+		ops->init(tcp_sk);
+	}
+}
+
+int tcp_cong_set(struct tcp_sock *tcp_sk, const char *name) {
+	const struct tcp_cong_ops *ops;
+
+	ops = tcp_cong_find(name);
+	if (!ops) {
+		return -ENOENT;
+	}
+
+	tcp_sock_lock(tcp_sk, TCP_SYNC_STATE);
+	{
+		tcp_cong_switch(tcp_sk, ops);
+	}
+	tcp_sock_unlock(tcp_sk, TCP_SYNC_STATE);
+
+	return 0;
+}
+
+void tcp_cong_sock_init(struct tcp_sock *tcp_sk) {
+	tcp_sk->mss = TCP_MSS_DEFAULT;
+	tcp_sk->cwnd = TCP_INIT_CWND * TCP_MSS_DEFAULT;
+	tcp_sk->ssthresh = UINT32_MAX;
+	tcp_sk->recover = 0;
+	tcp_cong_switch(tcp_sk, tcp_cong_default());
+}
+
+void tcp_cong_set_mss(struct tcp_sock *tcp_sk, uint32_t mss) {
+	if (mss == 0) {
+		return;
+	}
+	tcp_sk->mss = mss;
+	tcp_sk->cwnd = TCP_INIT_CWND * mss;
+}
+
+void tcp_cong_ack(struct tcp_sock *tcp_sk, uint32_t acked) {
+	uint32_t ss;
+
+	if (tcp_sk->rexmit_mode) {
+		return;
+	}
+
+	if (tcp_sk->cwnd < tcp_sk->ssthresh) {
+		ss = min(acked, tcp_sk->ssthresh - tcp_sk->cwnd);
+		tcp_sk->cwnd += ss;
+		acked -= ss;
+	}
+	if (acked) {
+		tcp_sk->cong->cong_avoid(tcp_sk, acked);
+	}
+}
+
+void tcp_cong_loss(struct tcp_sock *tcp_sk, int timeout) {
+	/* Repeated timeouts of the same data don't reduce ssthresh again */
+	if (!tcp_sk->rexmit_mode) {
+		tcp_sk->ssthresh = tcp_sk->cong->ssthresh(tcp_sk);
+	}
+	tcp_sk->cwnd = timeout ? tcp_sk->mss : tcp_sk->ssthresh;
+	tcp_sk->cwnd_acked = 0;
+
+	log_debug("sk %p %s: cwnd %u ssthresh %u", to_sock(tcp_sk),
+			timeout ? "timeout" : "fast rexmit",
+			tcp_sk->cwnd, tcp_sk->ssthresh);
+}
+
+void tcp_cong_avoid_ai(struct tcp_sock *tcp_sk, uint32_t cnt,
+		uint32_t acked) {
+	uint32_t step, inc;
+
+	step = max(cnt, 1U) * tcp_sk->mss;
+
+	tcp_sk->cwnd_acked += acked;
+	if (tcp_sk->cwnd_acked >= step) {
+		inc = tcp_sk->cwnd_acked / step;
+		tcp_sk->cwnd += inc * tcp_sk->mss;
+		tcp_sk->cwnd_acked -= inc * step;
+	}
+}
+
+uint32_t tcp_cong_flight(const struct tcp_sock *tcp_sk) {
+	return tcp_sk->self.seq - tcp_sk->last_ack;
+}
+
+/* RFC 5681 */
+static void reno_cong_avoid(struct tcp_sock *tcp_sk, uint32_t acked) {
+	tcp_cong_avoid_ai(tcp_sk, tcp_sk->cwnd / tcp_sk->mss, acked);
+}
+
+static uint32_t reno_ssthresh(struct tcp_sock *tcp_sk) {
+	return max(tcp_cong_flight(tcp_sk) / 2, 2 * tcp_sk->mss);
+}
+
+static const struct tcp_cong_ops tcp_reno = {
+	.name       = "reno",
+	.cong_avoid = reno_cong_avoid,
+	.ssthresh   = reno_ssthresh,
+};
+TCP_CONG_OPS_REGISTER(&tcp_reno);
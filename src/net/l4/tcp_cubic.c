@@ -0,0 +1,140 @@
+/**
+ * @file
+ * @brief CUBIC congestion control (RFC 8312)
+ *
+ * Window is grown along W(t) = C * (t - K)^3 + W_max, but not slower
+ * than Reno would grow it. Window is counted in segments, time in ms.
+ *
+ * @date 19.10.2026
+ */
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <util/math.h>
+
+#include <kernel/time/ktime.h>
+
+#include <net/l4/tcp.h>
+#include <net/l4/tcp_cong.h>
+
+/* C = 0.4, beta = 0.7 */
+#define CUBIC_BETA_NUM   7
+#define CUBIC_BETA_DEN  10
+/* 3 * (1 - beta) / (1 + beta) scaled by 1000 */
+#define CUBIC_ALPHA_AIMD 529
+/* Bound of |t - K| so that the cube fits 64 bits */
+#define CUBIC_T_MAX  1000000
+
+struct cubic {
+	uint32_t w_max;       /* Window before the last reduction */
+	uint32_t k;           /* Time to get back to origin, ms */
+	uint32_t origin;      /* Window at the plateau of the curve */
+	uint32_t epoch_start; /* Start of the current growth, zero if none */
+};
+static_assert(sizeof(struct cubic) <= TCP_CONG_PRIV_SIZE);
+
+static inline struct cubic *cubic_priv(struct tcp_sock *tcp_sk) {
+	return tcp_cong_priv(tcp_sk);
+}
+
+static uint32_t cubic_now(void) {
+	uint32_t now;
+
+	now = ktime_get_ns() / 1000000;
+	return now ? now : 1;
+}
+
+/* Integer cube root, Hacker's Delight */
+static uint32_t cubic_root(uint64_t x) {
+	uint64_t y, b;
+	int s;
+
+	y = 0;
+	for (s = 63; s >= 0; s -= 3) {
+		y += y;
+		b = 3 * y * (y + 1) + 1;
+		if ((x >> s) >= b) {
+			x -= b << s;
+			y++;
+		}
+	}
+	return y;
+}
+
+static void cubic_cong_avoid(struct tcp_sock *tcp_sk, uint32_t acked) {
+	struct cubic *ca = cubic_priv(tcp_sk);
+	uint32_t cwnd, now, t, rtt_ms, cnt, w_est;
+	int64_t d, target;
+
+	cwnd = max(tcp_sk->cwnd / tcp_sk->mss, 1U);
+	rtt_ms = tcp_sk->srtt / 1000;
+	now = cubic_now();
+
+	if (!ca->epoch_start) {
+		ca->epoch_start = now;
+		if (cwnd < ca->w_max) {
+			/* K = cbrt((W_max - cwnd) / C) seconds */
+			ca->k = cubic_root((uint64_t) (ca->w_max - cwnd)
+					* 2500000000ULL);
+			ca->origin = ca->w_max;
+		} else {
+			ca->k = 0;
+			ca->origin = cwnd;
+		}
+	}
+
+	/* Where the curve will be one RTT later */
+	t = now - ca->epoch_start + rtt_ms;
+	d = (int64_t) t - ca->k;
+	d = max(min(d, (int64_t) CUBIC_T_MAX), (int64_t) -CUBIC_T_MAX);
+	target = ca->origin + d * d * d * 4 / 10000000000LL;
+	if (target < 1) {
+		target = 1;
+	}
+
+	if (target > cwnd) {
+		cnt = cwnd / (target - cwnd);
+	} else {
+		/* Plateau, almost no growth */
+		cnt = 100 * cwnd;
+	}
+
+	/* TCP friendly region */
+	if (rtt_ms) {
+		w_est = ca->w_max * CUBIC_BETA_NUM / CUBIC_BETA_DEN
+				+ (uint64_t) CUBIC_ALPHA_AIMD * (now - ca->epoch_start)
+					/ (1000 * rtt_ms);
+		if (w_est > cwnd) {
+			cnt = min(cnt, cwnd / (w_est - cwnd));
+		}
+	}
+
+	tcp_cong_avoid_ai(tcp_sk, cnt, acked);
+}
+
+static uint32_t cubic_ssthresh(struct tcp_sock *tcp_sk) {
+	struct cubic *ca = cubic_priv(tcp_sk);
+	uint32_t cwnd;
+
+	cwnd = tcp_sk->cwnd / tcp_sk->mss;
+	ca->epoch_start = 0;
+
+	/* Fast convergence, release bandwidth for new flows */
+	if (cwnd < ca->w_max) {
+		ca->w_max = cwnd * (CUBIC_BETA_DEN + CUBIC_BETA_NUM)
+				/ (2 * CUBIC_BETA_DEN);
+	} else {
+		ca->w_max = cwnd;
+	}
+
+	return max(tcp_sk->cwnd / CUBIC_BETA_DEN * CUBIC_BETA_NUM,
+			2 * tcp_sk->mss);
+}
+
+static const struct tcp_cong_ops tcp_cubic = {
+	.name       = "cubic",
+	.cong_avoid = cubic_cong_avoid,
+	.ssthresh   = cubic_ssthresh,
+};
+TCP_CONG_OPS_REGISTER(&tcp_cubic);
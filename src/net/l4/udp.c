@@ -24,6 +24,7 @@
 
 #include <net/netdevice.h>
 #include <framework/mod/options.h>
+#include <kernel/kstat.h>
 
 #include <net/lib/ipv4.h>
 #include <net/lib/ipv6.h>
@@ -34,6 +35,8 @@ EMBOX_NET_PROTO(ETH_P_IP, IPPROTO_UDP, udp_rcv, udp_err);
 EMBOX_NET_PROTO(ETH_P_IPV6, IPPROTO_UDP, udp_rcv,
 		net_proto_handle_error_none);
 
+KSTAT_COUNTER_DEF(udp_rx_drops, "net/udp/rx_drops");
+
 static int udp4_rcv_tester(const struct sock *sk,
 		const struct sk_buff *skb) {
 	assert(sk != NULL);
@@ -87,6 +90,8 @@ static int udp_rcv(struct sk_buff *skb) {
 		old_check = skb->h.uh->check;
 		udp_set_check_field(skb->h.uh, skb->nh.raw);
 		if (old_check != skb->h.uh->check) {
+			kstat_inc(&udp_rx_drops);
+			skb_free(skb);
 			return 0; /* error: bad checksum */
 		}
 	}
@@ -103,10 +108,12 @@ static int udp_rcv(struct sk_buff *skb) {
 					udp_data_length(udp_hdr(skb)));
 		}
 		else {
+			kstat_inc(&udp_rx_drops);
 			skb_free(skb);
 		}
 	}
 	else {
+		kstat_inc(&udp_rx_drops);
 		icmp_discard(skb, ICMP_DEST_UNREACH, ICMP_PORT_UNREACH);
 	}
 
@@ -8,7 +8,10 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <time.h>
@@ -20,14 +23,51 @@
 
 #include <net/l3/ipv4/ip.h>
 #include <sys/socket.h>
+#include <kernel/thread/sync/mutex.h>
+#include <kernel/time/ktime.h>
+#include <util/array.h>
 #include <util/log.h>
+#include <util/math.h>
 #include <framework/mod/options.h>
 
 
 /**
- * DNS query timeout
+ * DNS query timeout, for all the nameservers
  */
 #define MODOPS_DNS_QUERY_TIMEOUT OPTION_GET(NUMBER, dns_query_timeout)
+/**
+ * Time to wait for a nameserver before the next one is asked
+ */
+#define MODOPS_DNS_RETRY_TIMEOUT OPTION_GET(NUMBER, dns_retry_timeout)
+/**
+ * Answers cached and the longest time (s) they are kept
+ */
+#define MODOPS_CACHE_SIZE        OPTION_GET(NUMBER, cache_size)
+#define MODOPS_CACHE_TTL_MAX     OPTION_GET(NUMBER, cache_ttl_max)
+#define MODOPS_CACHE_NEG_TTL_MAX OPTION_GET(NUMBER, cache_negative_ttl_max)
+
+/**
+ * Cached answer to a A or AAAA query, no addresses for the negative one
+ */
+struct dns_cache_entry {
+	char name[DNS_MAX_NAME_SZ]; /* empty for the free entry */
+	uint16_t qtype;
+	uint16_t count;
+	int64_t expire;             /* ms */
+	union {
+		struct in_addr in;
+		struct in6_addr in6;
+	} addr[DNS_ADDRS_MAX];
+};
+
+static struct dns_cache_entry dns_cache[MODOPS_CACHE_SIZE];
+static struct mutex dns_cache_lock = MUTEX_INIT(dns_cache_lock);
+
+/* Nameserver which answered last, queries are sent to it first */
+static int ns_last;
+
+/* Queries of dns_lookup, by bit of dns_lookup::pending */
+static const uint16_t lookup_qtype[2] = { DNS_RR_TYPE_A, DNS_RR_TYPE_AAAA };
 
 union dns_msg {
 	char raw[DNS_MAX_MESSAGE_SZ];
@@ -183,13 +223,60 @@ static int dns_q_format(struct dns_q *query, char *buff, size_t buff_sz) {
 	return 0;
 }
 
-static int dns_query_format(struct dns_q *query, union dns_msg *dm, size_t *out_dm_sz) {
+static int64_t dns_now(void) {
+	return ktime_get_ns() / NSEC_PER_MSEC;
+}
+
+/* Query ids are not guessable for one who does not see the queries */
+static uint16_t dns_id_next(void) {
+	static uint32_t seed;
+
+	if (seed == 0) {
+		seed = (uint32_t)ktime_get_ns() | 1;
+	}
+	seed = seed * 1103515245 + 12345;
+	return seed >> 16;
+}
+
+static int dns_nameservers_get(struct sockaddr_in *ns, int *out_count) {
+	const char *list;
+	char ip[INET_ADDRSTRLEN];
+	size_t len;
+	int count;
+
+	count = 0;
+	list = dns_get_nameserver();
+	list += strspn(list, " ,");
+	while ((*list != '\0') && (count < DNS_NAMESERVERS_MAX)) {
+		len = strcspn(list, " ,");
+		if (len < sizeof ip) {
+			memcpy(&ip[0], list, len);
+			ip[len] = '\0';
+
+			memset(&ns[count], 0, sizeof ns[count]);
+			ns[count].sin_family = AF_INET;
+			ns[count].sin_port = htons(DNS_PORT_NUMBER);
+			if (inet_aton(&ip[0], &ns[count].sin_addr)) {
+				++count;
+			}
+		}
+		list += len;
+		list += strspn(list, " ,");
+	}
+
+	*out_count = count;
+
+	return count != 0 ? 0 : -EINVAL;
+}
+
+static int dns_query_format(struct dns_q *query, uint16_t id,
+		union dns_msg *dm, size_t *out_dm_sz) {
 	int ret;
 	size_t data_sz;
 
 	/* Setup header fields */
 	memset(&dm->msg.hdr, 0, sizeof dm->msg.hdr);
-	dm->msg.hdr.id = 0x1234; /* TODO */
+	dm->msg.hdr.id = id;
 	dm->msg.hdr.qr = DNS_MSG_TYPE_QUERY;
 	dm->msg.hdr.opcode = DNS_OPER_CODE_QUERY;
 	dm->msg.hdr.rd = 1;
@@ -210,22 +297,54 @@ static int dns_query_format(struct dns_q *query, union dns_msg *dm, size_t *out_
 	return 0;
 }
 
+/**
+ * Receives a reply from one of the nameservers @a ns
+ *
+ * @return Index of the nameserver or -errno
+ */
+static int dns_reply_recv(int sock, const struct sockaddr_in *ns, int ns_count,
+		union dns_msg *rep, size_t *out_rep_sz) {
+	struct sockaddr_in from;
+	socklen_t from_len;
+	ssize_t bytes;
+	int i;
+
+	while (1) {
+		from_len = sizeof from;
+		bytes = recvfrom(sock, &rep->raw[0], sizeof *rep, 0,
+				(struct sockaddr *)&from, &from_len);
+		if (bytes == -1) {
+			return -errno;
+		}
+
+		if ((bytes < sizeof(struct dnshdr))
+				|| (rep->msg.hdr.qr != DNS_MSG_TYPE_REPLY)) {
+			continue; /* bad message, try again */
+		}
+
+		for (i = 0; i < ns_count; ++i) {
+			if ((from.sin_addr.s_addr == ns[i].sin_addr.s_addr)
+					&& (from.sin_port == ns[i].sin_port)) {
+				*out_rep_sz = (size_t)bytes;
+				return i;
+			}
+		}
+	}
+}
+
 static int dns_query_execute(union dns_msg *req, size_t req_sz,
 		union dns_msg *rep, size_t *out_rep_sz) {
 	static const struct timeval timeout = {
-		.tv_sec = MODOPS_DNS_QUERY_TIMEOUT / MSEC_PER_SEC,
-		.tv_usec = (MODOPS_DNS_QUERY_TIMEOUT % MSEC_PER_SEC) * USEC_PER_MSEC,
+		.tv_sec = MODOPS_DNS_RETRY_TIMEOUT / MSEC_PER_SEC,
+		.tv_usec = (MODOPS_DNS_RETRY_TIMEOUT % MSEC_PER_SEC) * USEC_PER_MSEC,
 	};
-	int sock;
+	int sock, ret, tries, ns_cur, ns_count;
 	ssize_t bytes;
-	struct sockaddr_in nameserver_addr;
+	struct sockaddr_in ns[DNS_NAMESERVERS_MAX];
 
-	/* Setup dns_host structure */
-	memset(&nameserver_addr, 0, sizeof nameserver_addr);
-	nameserver_addr.sin_family = AF_INET;
-	nameserver_addr.sin_port = htons(DNS_PORT_NUMBER);
-	if (!inet_aton(dns_get_nameserver(), &nameserver_addr.sin_addr)) {
-		return -EINVAL;
+	ret = dns_nameservers_get(&ns[0], &ns_count);
+	if (ret != 0) {
+		return ret;
 	}
 
 	/* Create socket */
@@ -234,51 +353,47 @@ static int dns_query_execute(union dns_msg *req, size_t req_sz,
 		return -errno;
 	}
 
-	if (-1 == connect(sock, (struct sockaddr *)&nameserver_addr,
-				sizeof nameserver_addr)) {
-		close(sock);
-		return -errno;
-	}
-
 	if (-1 == setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO,
 				&timeout, sizeof timeout)) {
 		close(sock);
 		return -errno;
 	}
 
-	while (1) {
+	/* Each try waits for the next nameserver */
+	tries = max(MODOPS_DNS_QUERY_TIMEOUT / MODOPS_DNS_RETRY_TIMEOUT, 1);
+	ns_cur = ns_last % ns_count;
+
+	while (tries-- > 0) {
 		/* Send request */
-		bytes = send(sock, &req->raw[0], req_sz, 0);
+		bytes = sendto(sock, &req->raw[0], req_sz, 0,
+				(struct sockaddr *)&ns[ns_cur], sizeof ns[ns_cur]);
 		if (bytes != req_sz) {
-			close(sock);
-			return -errno;
+			ret = -errno;
+			break;
 		}
 
+		/* Receive reply, is it my? */
 		do {
-			/* Receive reply */
-			bytes = recv(sock, &rep->raw[0], sizeof *rep, 0);
-			if (bytes == -1) {
-				close(sock);
-				return -errno;
-			}
-		} while (bytes < sizeof(struct dnshdr)); /* bad size, try again */
-
-		/* Is it my? */
-		if (req->msg.hdr.id != rep->msg.hdr.id) {
-			continue;
+			ret = dns_reply_recv(sock, &ns[0], ns_count, rep, out_rep_sz);
+		} while ((ret >= 0) && (req->msg.hdr.id != rep->msg.hdr.id));
+
+		if (ret >= 0) {
+			/* all ok, done */
+			ns_last = ret;
+			ret = 0;
+			break;
+		}
+		if ((ret != -EAGAIN) && (ret != -ETIMEDOUT)) {
+			break;
 		}
 
-		/* all ok, done */
-		break;
+		ns_cur = (ns_cur + 1) % ns_count;
 	}
 
 	/* Close our socket */
 	close(sock);
 
-	/* Setup result size */
-	*out_rep_sz = (size_t)bytes;
-
-	return 0;
+	return ret;
 }
 
 static int dns_q_parse(struct dns_q *q, const char *data,
@@ -343,6 +458,42 @@ static int dns_rr_cname_parse(struct dns_rr *rr, const char *data, size_t field_
 			&rr->rdata.cname.cname[0], NULL);
 }
 
+static int dns_rr_soa_parse(struct dns_rr *rr, const char *data, size_t field_sz,
+		const char *buff, size_t buff_sz) {
+	int ret;
+	size_t name_sz;
+	uint32_t field_val[5];
+	const char *end;
+
+	end = data + field_sz;
+
+	ret = label_to_name(data, buff, buff_sz, sizeof rr->rdata.soa.mname,
+			&rr->rdata.soa.mname[0], &name_sz);
+	if (ret != 0) {
+		return ret;
+	}
+	data += name_sz;
+
+	ret = label_to_name(data, buff, buff_sz, sizeof rr->rdata.soa.rname,
+			&rr->rdata.soa.rname[0], &name_sz);
+	if (ret != 0) {
+		return ret;
+	}
+	data += name_sz;
+
+	if (data + sizeof field_val != end) {
+		return -EINVAL;
+	}
+	memcpy(&field_val[0], data, sizeof field_val);
+	rr->rdata.soa.serial = ntohl(field_val[0]);
+	rr->rdata.soa.refresh = ntohl(field_val[1]);
+	rr->rdata.soa.retry = ntohl(field_val[2]);
+	rr->rdata.soa.expire = ntohl(field_val[3]);
+	rr->rdata.soa.minimum = ntohl(field_val[4]);
+
+	return 0;
+}
+
 static int dns_rr_ptr_parse(struct dns_rr *rr, const char *data, size_t field_sz,
 		const char *buff, size_t buff_sz) {
 	return label_to_name(data, buff, buff_sz, sizeof rr->rdata.ptr.ptrdname,
@@ -420,8 +571,9 @@ static int dns_rr_parse(struct dns_rr *rr, const char *data,
 	}
 	switch (rr->rtype) { /* TODO use table of methods instead */
 	default:
-		ret = -ENOSYS;
-		log_error("dns_rr_parse: error: can't parse type %d\n", rr->rtype);
+		/* skip it, the others may be parsed */
+		ret = 0;
+		log_debug("dns_rr_parse: can't parse type %d\n", rr->rtype);
 		break;
 	case DNS_RR_TYPE_A:
 		ret = dns_rr_a_parse(rr, curr, field_sz, buff, buff_sz);
@@ -432,6 +584,9 @@ static int dns_rr_parse(struct dns_rr *rr, const char *data,
 	case DNS_RR_TYPE_CNAME:
 		ret = dns_rr_cname_parse(rr, curr, field_sz, buff, buff_sz);
 		break;
+	case DNS_RR_TYPE_SOA:
+		ret = dns_rr_soa_parse(rr, curr, field_sz, buff, buff_sz);
+		break;
 	case DNS_RR_TYPE_PTR:
 		ret = dns_rr_ptr_parse(rr, curr, field_sz, buff, buff_sz);
 		break;
@@ -449,7 +604,7 @@ static int dns_rr_parse(struct dns_rr *rr, const char *data,
 	return 0;
 }
 
-static int dns_result_parse(union dns_msg *dm, size_t dm_sz,
+static int dns_msg_parse(union dns_msg *dm, size_t dm_sz,
 		struct dns_result *out_result) {
 	int ret;
 	const char *curr;
@@ -465,11 +620,6 @@ static int dns_result_parse(union dns_msg *dm, size_t dm_sz,
 		return -EINVAL;
 	}
 
-	if (dm->msg.hdr.rcode != DNS_RESP_CODE_OK) {
-		log_error("dns_result_parse: error: DNS result code is %d!\n", dm->msg.hdr.rcode);
-		return -1;
-	}
-
 	/* Parse Question section */
 	amount = htons(dm->msg.hdr.qdcount);
 	if (amount != 0) {
@@ -579,13 +729,23 @@ error:
 	return ret;
 }
 
+static int dns_result_parse(union dns_msg *dm, size_t dm_sz,
+		struct dns_result *out_result) {
+	if (dm->msg.hdr.rcode != DNS_RESP_CODE_OK) {
+		log_error("dns_result_parse: error: DNS result code is %d!\n", dm->msg.hdr.rcode);
+		return -1;
+	}
+
+	return dns_msg_parse(dm, dm_sz, out_result);
+}
+
 static int dns_execute(struct dns_q *query, struct dns_result *out_result) {
 	int ret;
 	union dns_msg msg_in, msg_out;
 	size_t msg_in_sz = 0;
 	size_t msg_out_sz;
 
-	ret = dns_query_format(query, &msg_out, &msg_out_sz);
+	ret = dns_query_format(query, dns_id_next(), &msg_out, &msg_out_sz);
 	if (ret != 0) {
 		return ret;
 	}
@@ -627,3 +787,423 @@ int dns_result_free(struct dns_result *result) {
 	free(result->ar);
 	return 0;
 }
+
+static struct dns_cache_entry * dns_cache_find(const char *name,
+		uint16_t qtype) {
+	struct dns_cache_entry *entry;
+
+	for (entry = &dns_cache[0]; entry < &dns_cache[MODOPS_CACHE_SIZE];
+			++entry) {
+		if ((entry->qtype == qtype)
+				&& (0 == strcasecmp(&entry->name[0], name))) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+static int dns_cache_get(const char *name, uint16_t qtype,
+		struct dns_addrs *out_addrs) {
+	struct dns_cache_entry *entry;
+	int64_t now;
+	int i, ret;
+
+	now = dns_now();
+	ret = -ENOENT;
+
+	mutex_lock(&dns_cache_lock);
+	entry = dns_cache_find(name, qtype);
+	if (entry != NULL) {
+		if (entry->expire <= now) {
+			entry->name[0] = '\0';
+		}
+		else {
+			out_addrs->count = entry->count;
+			out_addrs->ttl = (entry->expire - now) / MSEC_PER_SEC;
+			for (i = 0; i < entry->count; ++i) {
+				out_addrs->addr[i].family = qtype == DNS_RR_TYPE_A
+						? AF_INET : AF_INET6;
+				memcpy(&out_addrs->addr[i].addr, &entry->addr[i],
+						sizeof entry->addr[i]);
+			}
+			ret = 0;
+		}
+	}
+	mutex_unlock(&dns_cache_lock);
+
+	return ret;
+}
+
+static void dns_cache_put(const char *name, uint16_t qtype,
+		const struct dns_addrs *addrs) {
+	struct dns_cache_entry *entry, *victim;
+	int64_t now;
+	int i;
+
+	now = dns_now();
+
+	mutex_lock(&dns_cache_lock);
+	victim = dns_cache_find(name, qtype);
+	if (victim == NULL) {
+		/* a free entry, an expired one or one that expires first */
+		for (entry = &dns_cache[0]; entry < &dns_cache[MODOPS_CACHE_SIZE];
+				++entry) {
+			if ((victim == NULL) || (entry->name[0] == '\0')
+					|| (entry->expire < victim->expire)) {
+				victim = entry;
+			}
+			if ((victim->name[0] == '\0') || (victim->expire <= now)) {
+				break;
+			}
+		}
+	}
+
+	if (victim != NULL) {
+		if (addrs->ttl == 0) {
+			victim->name[0] = '\0';
+		}
+		else {
+			strcpy(&victim->name[0], name);
+			victim->qtype = qtype;
+			victim->count = addrs->count;
+			victim->expire = now + (int64_t)addrs->ttl * MSEC_PER_SEC;
+			for (i = 0; i < addrs->count; ++i) {
+				memcpy(&victim->addr[i], &addrs->addr[i].addr,
+						sizeof victim->addr[i]);
+			}
+		}
+	}
+	mutex_unlock(&dns_cache_lock);
+}
+
+void dns_cache_flush(void) {
+	struct dns_cache_entry *entry;
+
+	mutex_lock(&dns_cache_lock);
+	for (entry = &dns_cache[0]; entry < &dns_cache[MODOPS_CACHE_SIZE];
+			++entry) {
+		entry->name[0] = '\0';
+	}
+	mutex_unlock(&dns_cache_lock);
+}
+
+/**
+ * Takes addresses and their TTL from the reply, or the TTL of the negative
+ * answer (RFC 2308), and caches them
+ *
+ * @return 0, -EAGAIN if the nameserver failed, -ENOMSG if the reply is not
+ *    to this query
+ */
+static int dns_lookup_reply(struct dns_lookup *l, int q,
+		union dns_msg *rep, size_t rep_sz) {
+	struct dns_result result;
+	struct dns_addrs *addrs;
+	struct dns_rr *rr;
+	uint32_t ttl;
+	size_t i;
+
+	switch (rep->msg.hdr.rcode) {
+	case DNS_RESP_CODE_OK:
+	case DNS_RESP_CODE_NONAME:
+		break;
+	default:
+		return -EAGAIN;
+	}
+
+	if (0 != dns_msg_parse(rep, rep_sz, &result)) {
+		return -EAGAIN;
+	}
+
+	if ((result.qdcount != 1) || (result.qd->qtype != lookup_qtype[q])
+			|| (0 != strcasecmp(&result.qd->qname[0], &l->name[0]))) {
+		dns_result_free(&result);
+		return -ENOMSG;
+	}
+
+	addrs = &l->an[q];
+	addrs->count = 0;
+	ttl = MODOPS_CACHE_TTL_MAX;
+
+	if (rep->msg.hdr.rcode == DNS_RESP_CODE_OK) {
+		for (i = 0, rr = result.an; i < result.ancount; ++i, ++rr) {
+			if ((rr->rtype != lookup_qtype[q]) || (rr->rclass != DNS_RR_CLASS_IN)
+					|| (addrs->count == DNS_ADDRS_MAX)) {
+				continue;
+			}
+			if (rr->rtype == DNS_RR_TYPE_A) {
+				addrs->addr[addrs->count].family = AF_INET;
+				memcpy(&addrs->addr[addrs->count].addr.in,
+						&rr->rdata.a.address[0], sizeof rr->rdata.a.address);
+			}
+			else {
+				addrs->addr[addrs->count].family = AF_INET6;
+				memcpy(&addrs->addr[addrs->count].addr.in6,
+						&rr->rdata.aaaa.address[0], sizeof rr->rdata.aaaa.address);
+			}
+			++addrs->count;
+			ttl = min(ttl, rr->rttl);
+		}
+	}
+
+	if (addrs->count == 0) {
+		/* without SOA the negative answer is not cached */
+		ttl = 0;
+		for (i = 0, rr = result.ns; i < result.nscount; ++i, ++rr) {
+			if (rr->rtype == DNS_RR_TYPE_SOA) {
+				ttl = min(rr->rttl, (uint32_t)rr->rdata.soa.minimum);
+				ttl = min(ttl, (uint32_t)MODOPS_CACHE_NEG_TTL_MAX);
+				break;
+			}
+		}
+	}
+	addrs->ttl = ttl;
+
+	dns_result_free(&result);
+
+	dns_cache_put(&l->name[0], lookup_qtype[q], addrs);
+
+	return 0;
+}
+
+static int dns_lookup_send(struct dns_lookup *l) {
+	union dns_msg req;
+	struct dns_q query;
+	size_t req_sz;
+	ssize_t bytes;
+	int q, ret;
+
+	strcpy(&query.qname[0], &l->name[0]);
+	query.qclass = DNS_RR_CLASS_IN;
+
+	for (q = 0; q < ARRAY_SIZE(lookup_qtype); ++q) {
+		if (!(l->pending & (1 << q))) {
+			continue;
+		}
+
+		query.qtype = lookup_qtype[q];
+		ret = dns_query_format(&query, l->id[q], &req, &req_sz);
+		if (ret != 0) {
+			return ret;
+		}
+
+		bytes = sendto(l->sock, &req.raw[0], req_sz, 0,
+				(struct sockaddr *)&l->ns[l->ns_cur], sizeof l->ns[l->ns_cur]);
+		if (bytes != req_sz) {
+			return -errno;
+		}
+	}
+
+	return 0;
+}
+
+static int dns_lookup_done(struct dns_lookup *l, int err) {
+	const struct dns_addrs *an;
+	int q, i;
+
+	if (l->sock != -1) {
+		close(l->sock);
+		l->sock = -1;
+	}
+
+	/* IPv4 addresses go first */
+	l->addrs.count = 0;
+	l->addrs.ttl = MODOPS_CACHE_TTL_MAX;
+	for (q = 0, an = &l->an[0]; q < ARRAY_SIZE(l->an); ++q, ++an) {
+		for (i = 0; (i < an->count) && (l->addrs.count < DNS_ADDRS_MAX); ++i) {
+			memcpy(&l->addrs.addr[l->addrs.count++], &an->addr[i],
+					sizeof an->addr[i]);
+		}
+		if (an->count != 0) {
+			l->addrs.ttl = min(l->addrs.ttl, an->ttl);
+		}
+	}
+
+	/* a query which is answered is enough */
+	if (l->addrs.count != 0) {
+		err = 0;
+	}
+	else if (err == 0) {
+		err = -ENOENT;
+	}
+
+	l->err = err;
+
+	return err;
+}
+
+int dns_lookup_start(struct dns_lookup *l, const char *name, int family) {
+	size_t name_sz;
+	unsigned int wanted;
+	int q, ret;
+
+	memset(l, 0, sizeof *l);
+	l->sock = -1;
+
+	switch (family) {
+	default:
+		return dns_lookup_done(l, -EAFNOSUPPORT);
+	case AF_INET:
+		wanted = 1 << 0;
+		break;
+	case AF_INET6:
+		wanted = 1 << 1;
+		break;
+	case AF_UNSPEC:
+		wanted = (1 << 0) | (1 << 1);
+		break;
+	}
+
+	/* the root label is implied */
+	name_sz = strlen(name);
+	if ((name_sz != 0) && (name[name_sz - 1] == '.')) {
+		--name_sz;
+	}
+	if ((name_sz == 0) || (name_sz >= sizeof l->name)) {
+		return dns_lookup_done(l, -EINVAL);
+	}
+	memcpy(&l->name[0], name, name_sz);
+	l->name[name_sz] = '\0';
+
+	for (q = 0; q < ARRAY_SIZE(lookup_qtype); ++q) {
+		if ((wanted & (1 << q)) && (0 != dns_cache_get(&l->name[0],
+						lookup_qtype[q], &l->an[q]))) {
+			l->pending |= 1 << q;
+			l->id[q] = dns_id_next();
+		}
+	}
+	if (l->pending == 0) {
+		return dns_lookup_done(l, 0);
+	}
+
+	ret = dns_nameservers_get(&l->ns[0], &l->ns_count);
+	if (ret != 0) {
+		return dns_lookup_done(l, ret);
+	}
+	l->ns_cur = ns_last % l->ns_count;
+
+	l->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if ((l->sock == -1) || (-1 == fcntl(l->sock, F_SETFL, O_NONBLOCK))) {
+		return dns_lookup_done(l, -errno);
+	}
+
+	ret = dns_lookup_send(l);
+	if (ret != 0) {
+		return dns_lookup_done(l, ret);
+	}
+
+	l->deadline = dns_now() + MODOPS_DNS_QUERY_TIMEOUT;
+	l->retry_at = dns_now() + MODOPS_DNS_RETRY_TIMEOUT;
+
+	return -EINPROGRESS;
+}
+
+int dns_lookup_process(struct dns_lookup *l) {
+	union dns_msg rep;
+	size_t rep_sz;
+	int64_t now;
+	int q, ret;
+
+	if (l->sock == -1) {
+		return l->err;
+	}
+
+	while (l->pending != 0) {
+		ret = dns_reply_recv(l->sock, &l->ns[0], l->ns_count, &rep, &rep_sz);
+		if (ret < 0) {
+			if (ret != -EAGAIN) {
+				return dns_lookup_done(l, ret);
+			}
+			break;
+		}
+
+		for (q = 0; q < ARRAY_SIZE(lookup_qtype); ++q) {
+			if ((l->pending & (1 << q)) && (rep.msg.hdr.id == l->id[q])) {
+				break;
+			}
+		}
+		if (q == ARRAY_SIZE(lookup_qtype)) {
+			continue;
+		}
+
+		switch (dns_lookup_reply(l, q, &rep, rep_sz)) {
+		case 0:
+			l->pending &= ~(1 << q);
+			ns_last = ret;
+			break;
+		case -EAGAIN:
+			/* ask the next nameserver right now */
+			if (l->ns_count > 1) {
+				l->retry_at = 0;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (l->pending == 0) {
+		return dns_lookup_done(l, 0);
+	}
+
+	now = dns_now();
+	if (now >= l->deadline) {
+		return dns_lookup_done(l, -ETIMEDOUT);
+	}
+	if (now >= l->retry_at) {
+		l->ns_cur = (l->ns_cur + 1) % l->ns_count;
+		ret = dns_lookup_send(l);
+		if (ret != 0) {
+			return dns_lookup_done(l, ret);
+		}
+		l->retry_at = min(now + MODOPS_DNS_RETRY_TIMEOUT, l->deadline);
+	}
+
+	return -EINPROGRESS;
+}
+
+int dns_lookup_timeout(const struct dns_lookup *l) {
+	int64_t now;
+
+	if (l->sock == -1) {
+		return 0;
+	}
+
+	now = dns_now();
+
+	return l->retry_at > now ? l->retry_at - now : 0;
+}
+
+void dns_lookup_cancel(struct dns_lookup *l) {
+	if (l->sock != -1) {
+		close(l->sock);
+		l->sock = -1;
+	}
+	l->err = -EINTR;
+}
+
+int dns_lookup(const char *name, int family, struct dns_addrs *out_addrs) {
+	struct dns_lookup l;
+	struct pollfd pfd;
+	int ret;
+
+	ret = dns_lookup_start(&l, name, family);
+	while (ret == -EINPROGRESS) {
+		pfd.fd = l.sock;
+		pfd.events = POLLIN;
+		if ((-1 == poll(&pfd, 1, dns_lookup_timeout(&l)))
+				&& (errno != EINTR)) {
+			ret = -errno;
+			dns_lookup_cancel(&l);
+			return ret;
+		}
+
+		ret = dns_lookup_process(&l);
+	}
+
+	if (ret == 0) {
+		memcpy(out_addrs, &l.addrs, sizeof *out_addrs);
+	}
+
+	return ret;
+}
@@ -21,7 +21,7 @@
 #define NAMESERVER_DEFAULT OPTION_STRING_GET(nameserver)
 #define RESOLV_FILE        OPTION_STRING_GET(resolv_file)
 
-static char nameserver_ip[16]; /* only for IPv4 */
+static char nameserver_ip[16 * DNS_NAMESERVERS_MAX]; /* only for IPv4 */
 
 const char *dns_get_nameserver(void) {
 	return nameserver_ip;
@@ -16,49 +16,170 @@
 #include <util/array.h>
 #include <sys/time.h>
 #include <kernel/time/ktime.h>
+#include <kernel/time/time.h>
 #include <kernel/time/timer.h>
 #include <net/l0/net_tx.h>
 #include <util/binalign.h>
 #include <util/log.h>
 
 #include <framework/mod/options.h>
-#include <embox/unit.h>
 
 #include <net/l3/arp.h>
 #include <net/l3/ndp.h>
 #include <net/l2/ethernet.h>
+#include <netinet/in.h>
 #include <net/netdevice.h>
 #include <net/inetdevice.h>
 
-#define MODOPS_NEIGHBOUR_AMOUNT   OPTION_GET(NUMBER, neighbour_amount)
-#define MODOPS_NEIGHBOUR_EXPIRE   OPTION_GET(NUMBER, neighbour_expire)
-#define MODOPS_NEIGHBOUR_TMR_FREQ OPTION_GET(NUMBER, neighbour_tmr_freq)
-#define MODOPS_NEIGHBOUR_RESEND   OPTION_GET(NUMBER, neighbour_resend)
-#define MODOPS_NEIGHBOUR_ATTEMPT  OPTION_GET(NUMBER, neighbour_attempt)
-
-EMBOX_UNIT_INIT(neighbour_init);
+#define MODOPS_NEIGHBOUR_AMOUNT    OPTION_GET(NUMBER, neighbour_amount)
+#define MODOPS_NEIGHBOUR_EXPIRE    OPTION_GET(NUMBER, neighbour_expire)
+#define MODOPS_NEIGHBOUR_RESEND    OPTION_GET(NUMBER, neighbour_resend)
+#define MODOPS_NEIGHBOUR_ATTEMPT   OPTION_GET(NUMBER, neighbour_attempt)
+#define MODOPS_NEIGHBOUR_REACHABLE OPTION_GET(NUMBER, neighbour_reachable)
+#define MODOPS_NEIGHBOUR_DELAY     OPTION_GET(NUMBER, neighbour_delay)
+#define MODOPS_NEIGHBOUR_HASH_SIZE OPTION_GET(NUMBER, neighbour_hash_size)
 
 POOL_DEF(neighbour_pool, struct neighbour, MODOPS_NEIGHBOUR_AMOUNT);
 static DLIST_DEFINE(neighbour_list);
-static struct sys_timer neighbour_tmr;
+
+/**
+ * Entries are hashed by protocol address. Lookups on transmit don't
+ * take any lock: writers change the table and the entries under
+ * sched_lock between two increments of nbr_seq, readers retry or take
+ * the lock if it was odd or has changed. Entries are taken from the
+ * pool, so a stale pointer still points to a neighbour, and a chain
+ * is never walked further than there are entries.
+ */
+static struct neighbour *nbr_hash[MODOPS_NEIGHBOUR_HASH_SIZE];
+static unsigned int nbr_seq;
+
+static inline void nbr_write_begin(void) {
+	__atomic_store_n(&nbr_seq, nbr_seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void nbr_write_end(void) {
+	__atomic_store_n(&nbr_seq, nbr_seq + 1, __ATOMIC_RELEASE);
+}
+
+static unsigned int nbr_hashfn(unsigned short ptype, const void *paddr,
+		unsigned char plen, const struct net_device *dev) {
+	const unsigned char *ptr;
+	unsigned int h;
+
+	h = ptype ^ dev->index;
+	for (ptr = paddr; plen != 0; plen--) {
+		h = h * 31 + *ptr++;
+	}
+	return h % MODOPS_NEIGHBOUR_HASH_SIZE;
+}
+
+/* Length of protocol addresses is known by the protocol */
+static unsigned char nbr_plen(unsigned short ptype) {
+	return ptype == ETH_P_IP ? sizeof(struct in_addr)
+			: sizeof(struct in6_addr);
+}
+
+static void nbr_timer_handler(struct sys_timer *tmr, void *param);
+
+static void nbr_set_state(struct neighbour *nbr, unsigned int state) {
+	uint32_t ms;
+
+	nbr_write_begin();
+	{
+		nbr->state = state;
+	}
+	nbr_write_end();
+
+	if (nbr->flags & NEIGHBOUR_FLAG_PERMANENT) {
+		timer_stop(&nbr->tmr);
+		return;
+	}
+
+	switch (state) {
+	case NEIGHBOUR_INCOMPLETE:
+	case NEIGHBOUR_PROBE:
+		nbr->sent_times = 0;
+		ms = MODOPS_NEIGHBOUR_RESEND;
+		break;
+	case NEIGHBOUR_REACHABLE:
+		ms = MODOPS_NEIGHBOUR_REACHABLE;
+		break;
+	case NEIGHBOUR_DELAY:
+		ms = MODOPS_NEIGHBOUR_DELAY;
+		break;
+	default:
+		assert(state == NEIGHBOUR_STALE);
+		/* Collected if it's not used */
+		ms = MODOPS_NEIGHBOUR_EXPIRE;
+		break;
+	}
+	timer_start(&nbr->tmr, ms2jiffies(ms));
+}
 
 static void nbr_set_haddr(struct neighbour *nbr, const void *haddr) {
 	assert(nbr != NULL);
 
-	if (haddr != NULL) {
-		nbr->incomplete = 0;
-		memcpy(&nbr->haddr[0], haddr, nbr->hlen);
+	if ((haddr != NULL) && memcmp(&nbr->haddr[0], haddr, nbr->hlen)) {
+		nbr_write_begin();
+		{
+			memcpy(&nbr->haddr[0], haddr, nbr->hlen);
+			nbr->hh_len = 0;
+		}
+		nbr_write_end();
 	}
-	else {
-		nbr->incomplete = 1;
-		nbr->resend = MODOPS_NEIGHBOUR_RESEND;
-		nbr->sent_times = 0;
+
+	nbr_set_state(nbr, haddr != NULL ? NEIGHBOUR_REACHABLE
+			: NEIGHBOUR_INCOMPLETE);
+}
+
+static struct neighbour *nbr_alloc(unsigned short ptype,
+		const void *paddr, unsigned char plen, struct net_device *dev) {
+	struct neighbour *nbr;
+	unsigned int h;
+
+	nbr = pool_alloc(&neighbour_pool);
+	if (nbr == NULL) {
+		return NULL;
 	}
+
+	memset(nbr, 0, sizeof *nbr);
+	dlist_head_init(&nbr->lnk);
+	nbr->ptype = ptype;
+	memcpy(nbr->paddr, paddr, plen);
+	nbr->plen = plen;
+	nbr->dev = dev;
+	skb_queue_init(&nbr->w_queue);
+	timer_init(&nbr->tmr, TIMER_ONESHOT, nbr_timer_handler, nbr);
+
+	h = nbr_hashfn(ptype, paddr, plen, dev);
+	nbr->hash_next = nbr_hash[h];
+	dlist_add_prev_entry(nbr, &neighbour_list, lnk);
+	__atomic_store_n(&nbr_hash[h], nbr, __ATOMIC_RELEASE);
+
+	return nbr;
 }
 
 static void nbr_free(struct neighbour *nbr) {
+	struct neighbour **pnext;
+
 	assert(nbr != NULL);
 
+	nbr_write_begin();
+	{
+		pnext = &nbr_hash[nbr_hashfn(nbr->ptype, nbr->paddr, nbr->plen,
+					nbr->dev)];
+		while (*pnext != nbr) {
+			assert(*pnext != NULL);
+			pnext = &(*pnext)->hash_next;
+		}
+		/* Readers on it still reach the rest of the chain */
+		*pnext = nbr->hash_next;
+		nbr->state = NEIGHBOUR_INCOMPLETE;
+	}
+	nbr_write_end();
+
+	timer_stop(&nbr->tmr);
 	dlist_del_init_entry(nbr, lnk);
 	skb_queue_purge(&nbr->w_queue);
 	pool_free(&neighbour_pool, nbr);
@@ -67,16 +188,23 @@ static void nbr_free(struct neighbour *nbr) {
 static struct neighbour * nbr_lookup_by_paddr(unsigned short ptype,
 		const void *paddr, struct net_device *dev) {
 	struct neighbour *nbr;
+	unsigned char plen;
+	unsigned int steps;
 
 	assert(paddr != NULL);
 	assert(dev != NULL);
 
-	dlist_foreach_entry(nbr, &neighbour_list, lnk) {
+	plen = nbr_plen(ptype);
+	nbr = __atomic_load_n(&nbr_hash[nbr_hashfn(ptype, paddr, plen, dev)],
+			__ATOMIC_ACQUIRE);
+	for (steps = 0; (nbr != NULL) && (steps < MODOPS_NEIGHBOUR_AMOUNT);
+			steps++) {
 		if ((nbr->ptype == ptype)
-				&& (0 == memcmp(&nbr->paddr[0], paddr, nbr->plen))
+				&& (0 == memcmp(&nbr->paddr[0], paddr, plen))
 				&& (nbr->dev == dev)) {
 			return nbr;
 		}
+		nbr = __atomic_load_n(&nbr->hash_next, __ATOMIC_ACQUIRE);
 	}
 
 	return NULL; /* error: no such entity */
@@ -132,18 +260,58 @@ static int nbr_send_request(struct neighbour *nbr) {
 	}
 }
 
-static int nbr_build_and_send_pkt(struct sk_buff *skb,
-		const struct net_header_info *hdr_info) {
+/* Builds the header of a resolved neighbour, the first time with the
+ * device and then from the cache */
+static int nbr_build_hdr(struct neighbour *nbr, struct sk_buff *skb) {
+	struct net_device *dev;
+	struct net_header_info hdr_info;
+	int ret;
+
+	assert(nbr->state != NEIGHBOUR_INCOMPLETE);
+
+	dev = nbr->dev;
+	if ((nbr->hh_len != 0)
+			&& !memcmp(&nbr->hh_src[0], &dev->dev_addr[0], dev->addr_len)) {
+		memcpy(skb->mac.raw, &nbr->hh[0], nbr->hh_len);
+		return 0;
+	}
+
+	hdr_info.type = nbr->ptype;
+	hdr_info.src_hw = &dev->dev_addr[0];
+	hdr_info.dst_hw = &nbr->haddr[0];
+
+	assert(dev->ops != NULL);
+	assert(dev->ops->build_hdr != NULL);
+	ret = dev->ops->build_hdr(skb, &hdr_info);
+	if ((ret == 0) && (dev->hdr_len <= ARRAY_SIZE(nbr->hh))) {
+		nbr_write_begin();
+		{
+			memcpy(&nbr->hh[0], skb->mac.raw, dev->hdr_len);
+			memcpy(&nbr->hh_src[0], &dev->dev_addr[0], dev->addr_len);
+			nbr->hh_len = dev->hdr_len;
+		}
+		nbr_write_end();
+	}
+
+	return ret;
+}
+
+/* Traffic to a stale neighbour starts the check of it */
+static void nbr_use(struct neighbour *nbr) {
+	if (nbr->state == NEIGHBOUR_STALE) {
+		nbr_set_state(nbr, NEIGHBOUR_DELAY);
+	}
+}
+
+static int nbr_build_and_send_pkt(struct neighbour *nbr,
+		struct sk_buff *skb) {
 	int ret;
 
 	assert(skb != NULL);
-	assert(hdr_info != NULL);
 
 	/* try to rebuild */
 	assert(skb->dev != NULL);
-	assert(skb->dev->ops != NULL);
-	assert(skb->dev->ops->build_hdr != NULL);
-	ret = skb->dev->ops->build_hdr(skb, hdr_info);
+	ret = nbr_build_hdr(nbr, skb);
 	if (ret == 0) {
 		/* try to xmit */
 		ret = net_tx(skb, NULL);
@@ -163,14 +331,9 @@ static int nbr_build_and_send_pkt(struct sk_buff *skb,
 
 static void nbr_flush_w_queue(struct neighbour *nbr) {
 	struct sk_buff *skb;
-	struct net_header_info hdr_info;
-
-	hdr_info.type = nbr->ptype;
-	hdr_info.src_hw = &nbr->dev->dev_addr[0];
-	hdr_info.dst_hw = &nbr->haddr[0];
 
 	while ((skb = skb_queue_pop(&nbr->w_queue)) != NULL) {
-		(void)nbr_build_and_send_pkt(skb, &hdr_info);
+		(void)nbr_build_and_send_pkt(nbr, skb);
 	}
 }
 
@@ -178,11 +341,9 @@ int neighbour_add(unsigned short ptype, const void *paddr,
 		unsigned char plen, struct net_device *dev,
 		unsigned short htype, const void *haddr, unsigned char hlen,
 		unsigned int flags) {
-	int exist;
 	struct neighbour *nbr;
 
-	if ((paddr == NULL) || (plen == 0)
-			|| (plen > ARRAY_SIZE(nbr->paddr)) || (dev == NULL)
+	if ((paddr == NULL) || (plen != nbr_plen(ptype)) || (dev == NULL)
 			|| (haddr == NULL) || (hlen == 0)
 			|| (hlen > ARRAY_SIZE(nbr->haddr))) {
 		return -EINVAL;
@@ -191,39 +352,22 @@ int neighbour_add(unsigned short ptype, const void *paddr,
 	sched_lock();
 	{
 		nbr = nbr_lookup_by_paddr(ptype, paddr, dev);
-		exist = nbr != NULL;
 		if (nbr == NULL) {
-			nbr = pool_alloc(&neighbour_pool);
+			nbr = nbr_alloc(ptype, paddr, plen, dev);
+			if (nbr == NULL) {
+				sched_unlock();
+				return -ENOMEM;
+			}
 		}
-	}
-	sched_unlock();
-	if (nbr == NULL) {
-		return -ENOMEM;
-	}
 
-	nbr->htype = htype;
-	nbr->hlen = hlen;
-	nbr_set_haddr(nbr, haddr);
-	nbr->flags = flags;
-	nbr->expire = MODOPS_NEIGHBOUR_EXPIRE;
+		nbr->htype = htype;
+		nbr->hlen = hlen;
+		nbr->flags = flags;
+		nbr_set_haddr(nbr, haddr);
 
-	if (exist) {
 		nbr_flush_w_queue(nbr);
 	}
-	else {
-		dlist_head_init(&nbr->lnk);
-		nbr->ptype = ptype;
-		memcpy(nbr->paddr, paddr, plen);
-		nbr->plen = plen;
-		nbr->dev = dev;
-		skb_queue_init(&nbr->w_queue);
-
-		sched_lock();
-		{
-			dlist_add_prev_entry(nbr, &neighbour_list, lnk);
-		}
-		sched_unlock();
-	}
+	sched_unlock();
 
 	return 0;
 }
@@ -248,7 +392,7 @@ int neighbour_get_haddr(unsigned short ptype,  const void *paddr,
 			sched_unlock();
 			return -ENOENT;
 		}
-		else if (nbr->incomplete) {
+		else if (nbr->state == NEIGHBOUR_INCOMPLETE) {
 			sched_unlock();
 			return -EINPROGRESS;
 		}
@@ -258,6 +402,7 @@ int neighbour_get_haddr(unsigned short ptype,  const void *paddr,
 		}
 
 		memcpy(out_haddr, &nbr->haddr[0], nbr->hlen);
+		nbr_use(nbr);
 	}
 	sched_unlock();
 
@@ -360,14 +505,85 @@ int neighbour_foreach(neighbour_foreach_ft func, void *args) {
 	return 0;
 }
 
+/* Copies the cached header without locks, -EAGAIN if it can't */
+static int nbr_build_hdr_lockless(unsigned short ptype, const void *paddr,
+		struct net_device *dev, struct sk_buff *skb) {
+	struct neighbour *nbr;
+	unsigned int seq;
+	int ret;
+
+	seq = __atomic_load_n(&nbr_seq, __ATOMIC_ACQUIRE);
+	if (seq & 1) {
+		return -EAGAIN; /* Being changed, maybe by the interrupted one */
+	}
+
+	nbr = nbr_lookup_by_paddr(ptype, paddr, dev);
+	if (nbr == NULL) {
+		ret = -ENOENT;
+	}
+	else if (((nbr->state == NEIGHBOUR_REACHABLE)
+				|| (nbr->state == NEIGHBOUR_DELAY)
+				|| (nbr->state == NEIGHBOUR_PROBE))
+			&& (nbr->hh_len != 0)
+			&& (nbr->hh_len <= ARRAY_SIZE(nbr->hh))
+			&& !memcmp(&nbr->hh_src[0], &dev->dev_addr[0],
+				dev->addr_len)) {
+		memcpy(skb->mac.raw, &nbr->hh[0], nbr->hh_len);
+		ret = 0;
+	}
+	else {
+		/* Stale one changes its state, the header isn't built yet */
+		ret = -EAGAIN;
+	}
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&nbr_seq, __ATOMIC_RELAXED) != seq) {
+		return -EAGAIN;
+	}
+
+	return ret;
+}
+
+int neighbour_build_hdr(unsigned short ptype, const void *paddr,
+		struct net_device *dev, struct sk_buff *skb) {
+	struct neighbour *nbr;
+	int ret;
+
+	assert(paddr != NULL);
+	assert(dev != NULL);
+	assert(skb != NULL);
+
+	ret = nbr_build_hdr_lockless(ptype, paddr, dev, skb);
+	if (ret != -EAGAIN) {
+		return ret;
+	}
+
+	sched_lock();
+	{
+		nbr = nbr_lookup_by_paddr(ptype, paddr, dev);
+		if (nbr == NULL) {
+			ret = -ENOENT;
+		}
+		else if (nbr->state == NEIGHBOUR_INCOMPLETE) {
+			ret = -EINPROGRESS;
+		}
+		else {
+			nbr_use(nbr);
+			ret = nbr_build_hdr(nbr, skb);
+		}
+	}
+	sched_unlock();
+
+	return ret;
+}
+
 int neighbour_send_after_resolve(unsigned short ptype,
 		const void *paddr, unsigned char plen,
 		struct net_device *dev, struct sk_buff *skb) {
-	int allocated, resolved;
+	int allocated;
 	struct neighbour *nbr;
-	struct net_header_info hdr_info;
 
-	if ((paddr == NULL) || (dev == NULL) || (dev == NULL)) {
+	if ((paddr == NULL) || (plen != nbr_plen(ptype)) || (dev == NULL)) {
 		skb_free(skb);
 		return -EINVAL;
 	}
@@ -375,98 +591,67 @@ int neighbour_send_after_resolve(unsigned short ptype,
 	sched_lock();
 	{
 		nbr = nbr_lookup_by_paddr(ptype, paddr, dev);
-		if (nbr == NULL) {
-			nbr = pool_alloc(&neighbour_pool);
+		allocated = nbr == NULL;
+		if (allocated) {
+			nbr = nbr_alloc(ptype, paddr, plen, dev);
 			if (nbr == NULL) {
 				sched_unlock();
 				skb_free(skb);
 				return -ENOMEM;
 			}
-			dlist_head_init(&nbr->lnk);
-			nbr->ptype = ptype;
-			memcpy(nbr->paddr, paddr, plen);
-			nbr->plen = plen;
-			nbr->dev = dev;
 			nbr->htype = dev->type;
 			nbr->hlen = dev->addr_len;
 			nbr_set_haddr(nbr, NULL);
-			nbr->flags = 0;
-			skb_queue_init(&nbr->w_queue);
-			nbr->expire = MODOPS_NEIGHBOUR_EXPIRE;
-
-			dlist_add_prev_entry(nbr, &neighbour_list, lnk);
-
-			allocated = 1;
 		}
-		else {
-			allocated = 0;
+
+		if (nbr->state != NEIGHBOUR_INCOMPLETE) {
+			nbr_use(nbr);
+			sched_unlock();
+			return nbr_build_and_send_pkt(nbr, skb);
 		}
 
-		resolved = !nbr->incomplete;
+		skb_queue_push(&nbr->w_queue, skb);
 
-		if (!resolved) {
-			skb_queue_push(&nbr->w_queue, skb);
+		if (allocated) {
+			(void)nbr_send_request(nbr);
 		}
 	}
 	sched_unlock();
 
-	if (resolved) {
-		hdr_info.type = nbr->ptype;
-		hdr_info.src_hw = &nbr->dev->dev_addr[0];
-		hdr_info.dst_hw = &nbr->haddr[0];
-		return nbr_build_and_send_pkt(skb, &hdr_info);
-	}
-
-	if (allocated) {
-		(void)nbr_send_request(nbr);
-	}
-
 	return 0;
 }
 
 static void nbr_timer_handler(struct sys_timer *tmr, void *param) {
 	struct neighbour *nbr;
 
+	nbr = param;
+	assert(nbr != NULL);
+
 	sched_lock();
 	{
-		dlist_foreach_entry(nbr, &neighbour_list, lnk) {
-			if (nbr->flags & NEIGHBOUR_FLAG_PERMANENT) {
-				continue;
-			}
-			else if (nbr->expire <= MODOPS_NEIGHBOUR_TMR_FREQ) {
+		switch (nbr->state) {
+		case NEIGHBOUR_REACHABLE:
+			nbr_set_state(nbr, NEIGHBOUR_STALE);
+			break;
+		case NEIGHBOUR_STALE:
+			/* Unused since it got stale */
+			nbr_free(nbr);
+			break;
+		case NEIGHBOUR_DELAY:
+			nbr_set_state(nbr, NEIGHBOUR_PROBE);
+			(void)nbr_send_request(nbr);
+			break;
+		default:
+			assert((nbr->state == NEIGHBOUR_INCOMPLETE)
+					|| (nbr->state == NEIGHBOUR_PROBE));
+			if (nbr->sent_times >= MODOPS_NEIGHBOUR_ATTEMPT) {
 				nbr_free(nbr);
-				continue;
-			}
-
-			nbr->expire -= MODOPS_NEIGHBOUR_TMR_FREQ;
-
-			if (nbr->incomplete) {
-				if (nbr->resend <= MODOPS_NEIGHBOUR_TMR_FREQ) {
-					if (nbr->sent_times == MODOPS_NEIGHBOUR_ATTEMPT) {
-						nbr_free(nbr);
-					}
-					else {
-						(void)nbr_send_request(nbr);
-						nbr->resend = MODOPS_NEIGHBOUR_RESEND;
-					}
-				}
-				else {
-					nbr->resend -= MODOPS_NEIGHBOUR_TMR_FREQ;
-				}
+				break;
 			}
+			(void)nbr_send_request(nbr);
+			timer_start(&nbr->tmr, ms2jiffies(MODOPS_NEIGHBOUR_RESEND));
+			break;
 		}
 	}
 	sched_unlock();
 }
-
-static int neighbour_init(void) {
-	int ret;
-
-	ret = timer_init_start_msec(&neighbour_tmr, TIMER_PERIODIC,
-			MODOPS_NEIGHBOUR_TMR_FREQ, nbr_timer_handler, NULL);
-	if (ret != 0) {
-		return ret;
-	}
-
-	return 0;
-}
@@ -121,7 +121,7 @@ static int inet6_bind(struct sock *sk, const struct sockaddr *addr,
 		/* FIXME */
 		return -EADDRNOTAVAIL;
 	}
-	else if (sock_addr_is_busy(sk->p_ops, inet6_addr_tester, addr,
+	else if (sock_addr_is_busy_for(sk, inet6_addr_tester, addr,
 				addrlen)) {
 		return -EADDRINUSE;
 	}
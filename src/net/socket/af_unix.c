@@ -3,79 +3,1064 @@
  *
  * @brief PF_UNIX protocol family socket handler
  *
+ * There is no protocol below the sockets: the sender copies the data
+ * straight to the receive queue of the peer and the receiver copies them
+ * out. Stream writes are appended to the last buffer of the queue while it
+ * has room, so small writes do not take a buffer each.
+ *
+ * A name is abstract if sun_path starts with zero, otherwise it is a socket
+ * file created through af_unix_fs.h.
+ *
  * @date 31.01.2012
  * @author Anton Bondarev
  */
 #include <errno.h>
+#include <stddef.h>
+#include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include <util/math.h>
+#include <util/member.h>
+#include <util/dlist.h>
+#include <util/err.h>
+#include <mem/misc/pool.h>
+#include <kernel/sched/sched_lock.h>
+#include <kernel/time/time.h>
+#include <fs/idesc.h>
+#include <fs/index_descriptor.h>
+#include <kernel/task/resource/idesc_table.h>
 
 #include <net/sock.h>
+#include <net/sock_wait.h>
+#include <net/skbuff.h>
+
+#include <framework/mod/options.h>
 
 #include "family.h"
+#include "net_sock.h"
+#include "af_unix_fs.h"
+
+#define MODOPS_AMOUNT_SOCKETS  OPTION_GET(NUMBER, amount_sockets)
+#define MODOPS_AMOUNT_FDS_MSGS OPTION_GET(NUMBER, amount_fds_msgs)
+#define MODOPS_FDS_MAX         OPTION_GET(NUMBER, fds_max)
+
+static const struct sock_family_ops unix_stream_ops;
+static const struct sock_family_ops unix_dgram_ops;
+static const struct sock_family_ops unix_seqpacket_ops;
+static const struct net_family_type unix_types[] = {
+	{ SOCK_STREAM, &unix_stream_ops },
+	{ SOCK_DGRAM, &unix_dgram_ops },
+	{ SOCK_SEQPACKET, &unix_seqpacket_ops }
+};
+static const struct net_pack_out_ops *const unix_out_ops = NULL;
+EMBOX_NET_FAMILY(AF_UNIX, unix_types, unix_out_ops);
+
+/* The types share the names, connect() checks the type */
+static DLIST_DEFINE(unix_sock_list);
+EMBOX_NET_SOCK(AF_UNIX, SOCK_STREAM, 0, 1, unix_stream_sock_ops);
+EMBOX_NET_SOCK(AF_UNIX, SOCK_DGRAM, 0, 1, unix_dgram_sock_ops);
+EMBOX_NET_SOCK(AF_UNIX, SOCK_SEQPACKET, 0, 1, unix_seqpacket_sock_ops);
+static const struct sock_proto_ops unix_stream_sock_ops = {
+	.sock_list = &unix_sock_list
+};
+static const struct sock_proto_ops unix_dgram_sock_ops = {
+	.sock_list = &unix_sock_list
+};
+static const struct sock_proto_ops unix_seqpacket_sock_ops = {
+	.sock_list = &unix_sock_list
+};
+
+#define UNIX_PATH_LEN  sizeof(((struct sockaddr_un *)0)->sun_path)
+#define UNIX_ADDR_MIN  offsetof(struct sockaddr_un, sun_path)
+/* Autobound names are zero and five hex digits, as on Linux */
+#define UNIX_AUTOBIND_LEN (UNIX_ADDR_MIN + 6)
+
+/* Descriptors passed with SCM_RIGHTS, they are held open while in flight */
+struct unix_fds {
+	int count;
+	struct idesc *idesc[MODOPS_FDS_MAX];
+};
+
+POOL_DEF(unix_fds_pool, struct unix_fds, MODOPS_AMOUNT_FDS_MSGS);
 
-EMBOX_NET_FAMILY(AF_UNIX, unix_create);
+/* Control block of a queued buffer */
+struct unix_skb_cb {
+	struct unix_fds *fds;   /* Come with the first byte of the buffer */
+	socklen_t addrlen;      /* Sender's name before the data, datagrams only */
+};
 
-/* Prototypes */
-static const struct family_ops unix_dgram_ops;
-static const struct family_ops unix_stream_ops;
-static const struct family_ops unix_seqpacket_ops;
-static const struct proto unix_proto;
+#define unix_skb_cb(skb) ((struct unix_skb_cb *)(skb)->cb)
 
 struct unix_sock {
 	/* sk has to be the first member */
 	struct sock sk;
+	struct sockaddr_un addr;
+	socklen_t addrlen;          /* Zero if the socket is unnamed */
+	int bound;                  /* Owns the name, accepted sockets do not */
+	void *node;                 /* Socket file of a path name */
+	struct unix_sock *peer;
+	int peer_shut;              /* Peer shut down writing */
+	struct dlist_head conn_q;   /* Connections waiting for accept() */
+	struct dlist_head conn_lnk;
+	int backlog;
 };
 
-static int supported_sock_type(struct socket *sock) {
-	switch (sock->type) {
-	default:
-		return -ESOCKTNOSUPPORT;
-	case SOCK_STREAM:
-		sock->ops = &unix_stream_ops;
-		break;
-	case SOCK_RAW:
-		sock->type = SOCK_DGRAM;
-	case SOCK_DGRAM:
-		sock->ops = &unix_dgram_ops;
-		break;
-	case SOCK_SEQPACKET:
-		sock->ops = &unix_seqpacket_ops;
-		break;
+POOL_DEF(unix_sock_pool, struct unix_sock, MODOPS_AMOUNT_SOCKETS);
+
+static inline struct unix_sock *to_unix_sock(struct sock *sk) {
+	return member_cast_out(sk, struct unix_sock, sk);
+}
+
+static int unix_addr_check(const struct sockaddr *addr, socklen_t addrlen) {
+	if ((addrlen <= UNIX_ADDR_MIN) || (addrlen > sizeof(struct sockaddr_un))
+			|| (addr->sa_family != AF_UNIX)) {
+		return -EINVAL;
 	}
+	return 0;
+}
+
+static inline int unix_addr_abstract(const struct sockaddr_un *addr) {
+	return addr->sun_path[0] == '\0';
+}
+
+/* Copies sun_path of @a addr to @a path with the terminating zero */
+static void unix_addr_path(const struct sockaddr_un *addr, socklen_t addrlen,
+		char *path) {
+	size_t len = addrlen - UNIX_ADDR_MIN;
 
-	return ENOERR;
+	memcpy(path, addr->sun_path, len);
+	path[len] = '\0';
 }
 
-static int unix_create(struct socket *sock, int type, int protocol) {
-	int res;
+/* Fills @a addr with the name of @a usk, unnamed one has the family only */
+static void unix_addr_fill(const struct unix_sock *usk,
+		struct sockaddr *addr, socklen_t *addrlen) {
+	socklen_t len;
+
+	len = usk->addrlen != 0 ? usk->addrlen : sizeof(sa_family_t);
+	memcpy(addr, &usk->addr, min(*addrlen, len));
+	*addrlen = len;
+}
+
+/* Finds the socket file of a path name, abstract names have no file */
+static int unix_resolve(const struct sockaddr *addr, socklen_t addrlen,
+		void **node) {
+	char path[UNIX_PATH_LEN + 1];
+	int ret;
+
+	ret = unix_addr_check(addr, addrlen);
+	if (ret != 0) {
+		return ret;
+	}
+
+	*node = NULL;
+	if (unix_addr_abstract((const struct sockaddr_un *)addr)) {
+		return 0;
+	}
+
+	unix_addr_path((const struct sockaddr_un *)addr, addrlen, path);
+	return unix_fs_lookup(path, node);
+}
+
+/* Socket that owns the name, call it under sched_lock() */
+static struct unix_sock *unix_find(const struct sockaddr_un *addr,
+		socklen_t addrlen, const void *node) {
 	struct sock *sk;
+	struct unix_sock *usk;
+
+	dlist_foreach_entry(sk, &unix_sock_list, lnk) {
+		usk = to_unix_sock(sk);
+		if (!usk->bound) {
+			continue;
+		}
+		if (node != NULL ? (usk->node == node)
+				: ((usk->node == NULL) && (usk->addrlen == addrlen)
+					&& !memcmp(&usk->addr, addr, addrlen))) {
+			return usk;
+		}
+	}
+
+	return NULL;
+}
+
+static void unix_fds_put(struct unix_fds *fds) {
+	struct idesc *idesc;
+	int i;
 
-	res = supported_sock_type(sock);
-	if (res < 0) {
-		return res;
+	if (fds == NULL) {
+		return;
 	}
 
-	sk = sk_alloc(/*net,*/PF_UNIX, (struct proto *)&unix_proto);
-	if (sk == NULL) {
-		return -ENOMEM;
+	for (i = 0; i < fds->count; i++) {
+		idesc = fds->idesc[i];
+		if (!__atomic_sub_fetch(&idesc->idesc_count, 1, __ATOMIC_ACQ_REL)) {
+			idesc->idesc_ops->close(idesc);
+		}
 	}
 
-	return ENOERR;
+	sched_lock();
+	{
+		pool_free(&unix_fds_pool, fds);
+	}
+	sched_unlock();
 }
 
-static const struct family_ops unix_dgram_ops = {
-		.family =	PF_UNIX,
-};
+/* Takes the descriptors of SCM_RIGHTS messages of @a msg */
+static int unix_fds_get(const struct msghdr *msg, struct unix_fds **out) {
+	struct unix_fds *fds;
+	struct cmsghdr *cmsg;
+	struct idesc *idesc;
+	const int *fd;
+	int i, n, ret;
+
+	fds = NULL;
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+			cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if ((cmsg->cmsg_level != SOL_SOCKET)
+				|| (cmsg->cmsg_type != SCM_RIGHTS)
+				|| (cmsg->cmsg_len < CMSG_LEN(0))) {
+			ret = -EINVAL;
+			goto out_err;
+		}
+
+		if (fds == NULL) {
+			sched_lock();
+			{
+				fds = pool_alloc(&unix_fds_pool);
+			}
+			sched_unlock();
+			if (fds == NULL) {
+				return -ENOBUFS;
+			}
+			fds->count = 0;
+		}
+
+		n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		if (fds->count + n > MODOPS_FDS_MAX) {
+			ret = -ETOOMANYREFS;
+			goto out_err;
+		}
+
+		fd = (const int *)CMSG_DATA(cmsg);
+		for (i = 0; i < n; i++) {
+			idesc = idesc_index_valid(fd[i])
+				? index_descriptor_get(fd[i]) : NULL;
+			if (idesc == NULL) {
+				ret = -EBADF;
+				goto out_err;
+			}
+			__atomic_add_fetch(&idesc->idesc_count, 1, __ATOMIC_RELAXED);
+			fds->idesc[fds->count++] = idesc;
+		}
+	}
+
+	*out = fds;
+	return 0;
+
+out_err:
+	unix_fds_put(fds);
+	return ret;
+}
+
+/* Installs the received descriptors and reports them in SCM_RIGHTS
+ * message, the ones that do not fit are closed */
+static void unix_fds_recv(struct msghdr *msg, struct unix_fds *fds) {
+	struct cmsghdr *cmsg;
+	int *fd;
+	int i, n;
+
+	if (fds == NULL) {
+		msg->msg_controllen = 0;
+		return;
+	}
+
+	n = 0;
+	cmsg = CMSG_FIRSTHDR(msg);
+	if ((cmsg != NULL) && (msg->msg_controllen >= CMSG_LEN(0))) {
+		n = min((int)((msg->msg_controllen - CMSG_LEN(0)) / sizeof(int)),
+				fds->count);
+	}
+
+	fd = n != 0 ? (int *)CMSG_DATA(cmsg) : NULL;
+	for (i = 0; i < n; i++) {
+		fd[i] = index_descriptor_add(fds->idesc[i]);
+		if (fd[i] < 0) {
+			break;
+		}
+	}
+
+	if (i < fds->count) {
+		msg->msg_flags |= MSG_CTRUNC;
+	}
+	if (i != 0) {
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(i * sizeof(int));
+		msg->msg_controllen = min(msg->msg_controllen,
+				(socklen_t)CMSG_SPACE(i * sizeof(int)));
+	}
+	else {
+		msg->msg_controllen = 0;
+	}
+
+	/* The installed ones are held by the table now */
+	unix_fds_put(fds);
+}
+
+static void unix_queue_purge(struct sk_buff_head *queue) {
+	struct sk_buff *skb;
+
+	while (NULL != (skb = skb_queue_pop(queue))) {
+		unix_fds_put(unix_skb_cb(skb)->fds);
+		skb_free(skb);
+	}
+}
+
+static size_t unix_iov_len(const struct msghdr *msg) {
+	size_t len;
+	int i;
+
+	for (i = 0, len = 0; i < msg->msg_iovlen; i++) {
+		len += msg->msg_iov[i].iov_len;
+	}
+
+	return len;
+}
+
+/* Copies @a len bytes between @a buf and the iovec of @a msg at @a off */
+static void unix_iov_copy(const struct msghdr *msg, size_t off, void *buf,
+		size_t len, int to_iov) {
+	const struct iovec *iov;
+	char *p = buf, *base;
+	size_t part;
+	int i;
+
+	for (i = 0; (i < msg->msg_iovlen) && (len > 0); i++) {
+		iov = &msg->msg_iov[i];
+		if (off >= iov->iov_len) {
+			off -= iov->iov_len;
+			continue;
+		}
+
+		base = (char *)iov->iov_base + off;
+		part = min(len, iov->iov_len - off);
+		if (to_iov) {
+			memcpy(base, p, part);
+		}
+		else {
+			memcpy(p, base, part);
+		}
+
+		p += part;
+		len -= part;
+		off = 0;
+	}
+}
+
+/* Nothing more comes to the connected socket */
+static inline int unix_rcv_eof(struct unix_sock *usk) {
+	return (usk->peer == NULL) || usk->peer_shut
+			|| (usk->sk.shutdown_flag & (SHUT_RD + 1));
+}
+
+static inline int unix_rcvtimeo(struct sock *sk) {
+	return timeval_to_ms(&sk->opt.so_rcvtimeo);
+}
+
+static inline int unix_sndtimeo(struct sock *sk) {
+	return timeval_to_ms(&sk->opt.so_sndtimeo);
+}
+
+static void unix_pair(struct unix_sock *usk1, struct unix_sock *usk2) {
+	usk1->peer = usk2;
+	usk2->peer = usk1;
+}
+
+static int unix_init(struct sock *sk) {
+	struct unix_sock *usk = to_unix_sock(sk);
+
+	memset(&usk->addr, 0, sizeof usk->addr);
+	usk->addr.sun_family = AF_UNIX;
+	usk->addrlen = 0;
+	usk->bound = 0;
+	usk->node = NULL;
+	usk->peer = NULL;
+	usk->peer_shut = 0;
+	dlist_init(&usk->conn_q);
+	dlist_head_init(&usk->conn_lnk);
+	usk->backlog = 0;
+
+	return 0;
+}
+
+static int unix_close(struct sock *sk) {
+	struct unix_sock *usk = to_unix_sock(sk), *other, *conn;
+	struct dlist_head pending;
+	struct sock *s;
+
+	dlist_init(&pending);
+
+	sched_lock();
+	{
+		/* Nobody finds the socket or sends to it after this */
+		usk->bound = 0;
+		usk->peer = NULL;
+		dlist_foreach_entry(s, &unix_sock_list, lnk) {
+			other = to_unix_sock(s);
+			if (other->peer == usk) {
+				other->peer = NULL;
+				sock_notify(s, POLLIN | POLLOUT | POLLERR);
+			}
+		}
+
+		dlist_foreach_entry(conn, &usk->conn_q, conn_lnk) {
+			dlist_del_init(&conn->conn_lnk);
+			dlist_add_prev(&conn->conn_lnk, &pending);
+		}
+	}
+	sched_unlock();
+
+	/* Connections not accepted are reset */
+	dlist_foreach_entry(conn, &pending, conn_lnk) {
+		dlist_del_init(&conn->conn_lnk);
+		sock_close(&conn->sk);
+	}
+
+	unix_queue_purge(&sk->rx_queue);
+	sock_release(sk);
+
+	return 0;
+}
+
+static int unix_bind(struct sock *sk, const struct sockaddr *addr,
+		socklen_t addrlen) {
+	struct unix_sock *usk = to_unix_sock(sk), *other;
+	const struct sockaddr_un *sun = (const struct sockaddr_un *)addr;
+	char path[UNIX_PATH_LEN + 1];
+	socklen_t len;
+	void *node;
+	int ret;
+
+	ret = unix_addr_check(addr, addrlen);
+	if (ret != 0) {
+		return ret;
+	}
+
+	len = addrlen;
+	node = NULL;
+	if (!unix_addr_abstract(sun)) {
+		unix_addr_path(sun, addrlen, path);
+		ret = unix_fs_bind(path, &node);
+		if (ret != 0) {
+			return ret;
+		}
+		len = min((socklen_t)(UNIX_ADDR_MIN + strlen(path) + 1),
+				(socklen_t)sizeof(struct sockaddr_un));
+	}
+
+	sched_lock();
+	{
+		other = unix_find(sun, addrlen, node);
+		if ((other != NULL) && (node == NULL)) {
+			ret = -EADDRINUSE;
+		}
+		else {
+			if (other != NULL) {
+				/* Its file was removed and the node was reused */
+				other->bound = 0;
+			}
+			memcpy(&usk->addr, addr, addrlen);
+			usk->addrlen = len;
+			usk->node = node;
+			usk->bound = 1;
+		}
+	}
+	sched_unlock();
+
+	return ret;
+}
+
+/* Binds unnamed socket to a free abstract name */
+static int unix_bind_local(struct sock *sk) {
+	static unsigned int unix_autobind_id;
+	struct unix_sock *usk = to_unix_sock(sk);
+	struct sockaddr_un addr;
+	unsigned int id;
+	int i;
+
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+
+	sched_lock();
+	{
+		/* There are less sockets than names, so one is free */
+		do {
+			id = unix_autobind_id++;
+			for (i = UNIX_AUTOBIND_LEN - UNIX_ADDR_MIN - 1; i > 0; i--) {
+				addr.sun_path[i] = "0123456789abcdef"[id & 0xf];
+				id >>= 4;
+			}
+		} while (NULL != unix_find(&addr, UNIX_AUTOBIND_LEN, NULL));
+
+		memcpy(&usk->addr, &addr, UNIX_AUTOBIND_LEN);
+		usk->addrlen = UNIX_AUTOBIND_LEN;
+		usk->bound = 1;
+	}
+	sched_unlock();
+
+	return 0;
+}
+
+static int unix_connect(struct sock *sk, const struct sockaddr *addr,
+		socklen_t addrlen, int flags) {
+	struct unix_sock *usk = to_unix_sock(sk), *other, *conn;
+	const struct sockaddr_un *sun = (const struct sockaddr_un *)addr;
+	struct sock *new_sk;
+	void *node;
+	int ret;
+
+	ret = unix_resolve(addr, addrlen, &node);
+	if (ret != 0) {
+		return ret;
+	}
+
+	if (sk->opt.so_type == SOCK_DGRAM) {
+		sched_lock();
+		{
+			other = unix_find(sun, addrlen, node);
+			if (other == NULL) {
+				ret = -ECONNREFUSED;
+			}
+			else if (other->sk.opt.so_type != SOCK_DGRAM) {
+				ret = -EPROTOTYPE;
+			}
+			else {
+				usk->peer = other;
+			}
+		}
+		sched_unlock();
+
+		return ret;
+	}
+
+	/* The socket accept() returns is created right away, the data sent
+	 * before accept() are queued to it */
+	new_sk = sock_create(AF_UNIX, sk->opt.so_type, 0);
+	if (0 != err(new_sk)) {
+		return err(new_sk);
+	}
+	conn = to_unix_sock(new_sk);
+
+	sched_lock();
+	{
+		other = unix_find(sun, addrlen, node);
+		if ((other == NULL) || !sock_state_listening(&other->sk)) {
+			ret = -ECONNREFUSED;
+		}
+		else if (other->sk.opt.so_type != sk->opt.so_type) {
+			ret = -EPROTOTYPE;
+		}
+		else if (other->sk.rx_data_len >= other->backlog) {
+			ret = -EAGAIN;
+		}
+		else {
+			memcpy(&conn->addr, &other->addr, other->addrlen);
+			conn->addrlen = other->addrlen;
+			unix_pair(usk, conn);
+			sock_set_state(new_sk, SS_CONNECTED);
+
+			dlist_add_prev(&conn->conn_lnk, &other->conn_q);
+			/* Pending connections make the listener readable */
+			other->sk.rx_data_len++;
+			sock_notify(&other->sk, POLLIN);
+		}
+	}
+	sched_unlock();
+
+	if (ret != 0) {
+		sock_close(new_sk);
+	}
+
+	return ret;
+}
+
+static int unix_listen(struct sock *sk, int backlog) {
+	to_unix_sock(sk)->backlog = backlog;
+	return 0;
+}
+
+static int unix_accept(struct sock *sk, struct sockaddr *addr,
+		socklen_t *addrlen, int flags, struct sock **out_sk) {
+	struct unix_sock *usk = to_unix_sock(sk), *conn;
+	int ret;
+
+	ret = 0;
+	conn = NULL;
+
+	sched_lock();
+	{
+		while (NULL == (conn = dlist_first_entry_or_null(&usk->conn_q,
+						struct unix_sock, conn_lnk))) {
+			ret = sock_wait(sk, POLLIN | POLLERR, unix_rcvtimeo(sk));
+			if (ret != 0) {
+				break;
+			}
+		}
+
+		if (conn != NULL) {
+			dlist_del_init(&conn->conn_lnk);
+			sk->rx_data_len--;
+
+			if ((addr != NULL) && (conn->peer != NULL)) {
+				unix_addr_fill(conn->peer, addr, addrlen);
+			}
+			else if (addr != NULL) {
+				*addrlen = sizeof(sa_family_t);
+				addr->sa_family = AF_UNIX;
+			}
+		}
+	}
+	sched_unlock();
+
+	if (conn == NULL) {
+		return ret;
+	}
+
+	*out_sk = &conn->sk;
+	return 0;
+}
+
+/* Appends the data of @a msg from @a off to the queue of @a peer, returns
+ * bytes queued. Call it under sched_lock() */
+static int unix_stream_queue(struct unix_sock *peer, const struct msghdr *msg,
+		size_t off, size_t len, struct unix_fds **fds) {
+	struct sk_buff_head *queue = &peer->sk.rx_queue;
+	struct sk_buff *skb;
+	size_t room;
+
+	skb = queue->prev;
+	room = 0;
+	if (!skb_queue_end(skb, queue) && (*fds == NULL)) {
+		room = skb->mac.raw + skb->len - skb->p_data_end;
+	}
+
+	if (room == 0) {
+		skb = skb_alloc(skb_max_size());
+		if (skb == NULL) {
+			return -ENOBUFS;
+		}
+		skb->p_data = skb->p_data_end = skb->mac.raw;
+		unix_skb_cb(skb)->fds = *fds;
+		unix_skb_cb(skb)->addrlen = 0;
+		*fds = NULL;
+
+		skb_queue_push(queue, skb);
+		room = skb->len;
+	}
+
+	len = min(len, room);
+	unix_iov_copy(msg, off, skb->p_data_end, len, 0);
+	skb->p_data_end += len;
+
+	peer->sk.rx_data_len += len;
+	sock_notify(&peer->sk, POLLIN);
+
+	return len;
+}
+
+static int unix_stream_sendmsg(struct sock *sk, struct msghdr *msg,
+		int flags) {
+	struct unix_sock *usk = to_unix_sock(sk), *peer;
+	struct unix_fds *fds;
+	size_t len, done, room;
+	int ret;
+
+	ret = unix_fds_get(msg, &fds);
+	if (ret != 0) {
+		return ret;
+	}
+
+	len = unix_iov_len(msg);
+	done = 0;
+
+	sched_lock();
+	{
+		while (done < len) {
+			peer = usk->peer;
+			if ((peer == NULL) || (sk->shutdown_flag & (SHUT_WR + 1))
+					|| (peer->sk.shutdown_flag & (SHUT_RD + 1))) {
+				ret = -EPIPE;
+				break;
+			}
+
+			/* Waits for the peer to read */
+			if (peer->sk.rx_data_len >= peer->sk.opt.so_rcvbuf) {
+				ret = sock_wait(sk, POLLOUT | POLLERR, unix_sndtimeo(sk));
+				if (ret != 0) {
+					break;
+				}
+				continue;
+			}
+
+			room = peer->sk.opt.so_rcvbuf - peer->sk.rx_data_len;
+			ret = unix_stream_queue(peer, msg, done, min(len - done, room),
+					&fds);
+			if (ret < 0) {
+				break;
+			}
+			done += ret;
+			ret = 0;
+		}
+	}
+	sched_unlock();
+
+	/* Descriptors not sent */
+	unix_fds_put(fds);
+
+	return done != 0 ? done : ret;
+}
+
+static int unix_stream_recvmsg(struct sock *sk, struct msghdr *msg,
+		int flags) {
+	struct unix_sock *usk = to_unix_sock(sk);
+	struct unix_fds *fds;
+	struct sk_buff *skb;
+	size_t len, done, part;
+	int ret;
+
+	len = unix_iov_len(msg);
+	done = 0;
+	fds = NULL;
+	ret = 0;
+
+	sched_lock();
+	{
+		while (done < len) {
+			skb = skb_queue_front(&sk->rx_queue);
+			if (skb == NULL) {
+				if ((done != 0) || unix_rcv_eof(usk)) {
+					break;
+				}
+				ret = sock_wait(sk, POLLIN | POLLERR, unix_rcvtimeo(sk));
+				if (ret != 0) {
+					break;
+				}
+				continue;
+			}
+
+			if (unix_skb_cb(skb)->fds != NULL) {
+				/* One set of descriptors per call */
+				if (done != 0) {
+					break;
+				}
+				fds = unix_skb_cb(skb)->fds;
+				unix_skb_cb(skb)->fds = NULL;
+			}
+
+			part = min(len - done, (size_t)(skb->p_data_end - skb->p_data));
+			unix_iov_copy(msg, done, skb->p_data, part, 1);
+			skb->p_data += part;
+			sk->rx_data_len -= part;
+			done += part;
+
+			if (skb->p_data == skb->p_data_end) {
+				skb_free(skb_queue_pop(&sk->rx_queue));
+			}
+		}
+
+		if ((done != 0) && (usk->peer != NULL)) {
+			sock_notify(&usk->peer->sk, POLLOUT);
+		}
+	}
+	sched_unlock();
+
+	unix_fds_recv(msg, fds);
+
+	return done != 0 ? done : ret;
+}
+
+/* Receive queue of @a usk is full for @a len bytes more */
+static inline int unix_msg_full(struct unix_sock *usk, size_t len) {
+	return (usk->sk.rx_data_len != 0)
+			&& (usk->sk.rx_data_len + len > usk->sk.opt.so_rcvbuf);
+}
+
+/* Datagram goes with the name of the sender */
+static struct sk_buff *unix_msg_alloc(struct unix_sock *usk,
+		const struct msghdr *msg, size_t len) {
+	struct sk_buff *skb;
+	socklen_t addrlen;
+
+	addrlen = 0;
+	if (usk->sk.opt.so_type == SOCK_DGRAM) {
+		addrlen = usk->addrlen != 0 ? usk->addrlen : sizeof(sa_family_t);
+	}
+
+	/* Larger than a pool buffer takes the heap */
+	skb = skb_alloc(addrlen + len != 0 ? addrlen + len : 1);
+	if (skb == NULL) {
+		return NULL;
+	}
+
+	memcpy(skb->mac.raw, &usk->addr, addrlen);
+	skb->p_data = skb->mac.raw + addrlen;
+	skb->p_data_end = skb->p_data + len;
+	unix_iov_copy(msg, 0, skb->p_data, len, 0);
+
+	unix_skb_cb(skb)->fds = NULL;
+	unix_skb_cb(skb)->addrlen = addrlen;
+
+	return skb;
+}
+
+static int unix_msg_sendmsg(struct sock *sk, struct msghdr *msg,
+		int flags) {
+	struct unix_sock *usk = to_unix_sock(sk), *to;
+	const int noconn = sk->opt.so_type == SOCK_DGRAM
+			? -ECONNREFUSED : -EPIPE;
+	struct sk_buff *skb;
+	struct unix_fds *fds;
+	void *node;
+	size_t len;
+	int ret;
+
+	len = unix_iov_len(msg);
+	if (len > sk->opt.so_sndbuf) {
+		return -EMSGSIZE;
+	}
+
+	node = NULL;
+	if (msg->msg_name != NULL) {
+		ret = unix_resolve(msg->msg_name, msg->msg_namelen, &node);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	ret = unix_fds_get(msg, &fds);
+	if (ret != 0) {
+		return ret;
+	}
+
+	/* The copy is made before the lock, it may take the heap */
+	skb = unix_msg_alloc(usk, msg, len);
+	if (skb == NULL) {
+		unix_fds_put(fds);
+		return -ENOBUFS;
+	}
+	unix_skb_cb(skb)->fds = fds;
+
+	sched_lock();
+	{
+		if (msg->msg_name != NULL) {
+			to = unix_find(msg->msg_name, msg->msg_namelen, node);
+		}
+		else {
+			to = usk->peer;
+		}
+
+		while (ret == 0) {
+			if (to == NULL) {
+				ret = noconn;
+			}
+			else if (to->sk.opt.so_type != sk->opt.so_type) {
+				ret = -EPROTOTYPE;
+			}
+			else if (sk->shutdown_flag & (SHUT_WR + 1)) {
+				ret = -EPIPE;
+			}
+			else if (!unix_msg_full(to, len)) {
+				break;
+			}
+			else if ((to != usk->peer) || (to->peer != usk)) {
+				/* Only the peer tells when it reads */
+				ret = -EAGAIN;
+			}
+			else {
+				ret = sock_wait(sk, POLLOUT | POLLERR, unix_sndtimeo(sk));
+				to = usk->peer;
+			}
+		}
+
+		if (ret == 0) {
+			skb_queue_push(&to->sk.rx_queue, skb);
+			to->sk.rx_data_len += len;
+			sock_notify(&to->sk, POLLIN);
+			skb = NULL;
+		}
+	}
+	sched_unlock();
+
+	if (skb != NULL) {
+		unix_fds_put(unix_skb_cb(skb)->fds);
+		skb_free(skb);
+		return ret;
+	}
+
+	return len;
+}
+
+static int unix_msg_recvmsg(struct sock *sk, struct msghdr *msg,
+		int flags) {
+	struct unix_sock *usk = to_unix_sock(sk);
+	struct unix_fds *fds;
+	struct sk_buff *skb;
+	size_t len;
+	int ret;
+
+	ret = 0;
+	fds = NULL;
+
+	sched_lock();
+	{
+		while (NULL == (skb = skb_queue_pop(&sk->rx_queue))) {
+			if ((sk->opt.so_type == SOCK_SEQPACKET) && unix_rcv_eof(usk)) {
+				break;
+			}
+			ret = sock_wait(sk, POLLIN | POLLERR, unix_rcvtimeo(sk));
+			if (ret != 0) {
+				break;
+			}
+		}
+
+		if (skb != NULL) {
+			sk->rx_data_len -= skb->p_data_end - skb->p_data;
+			fds = unix_skb_cb(skb)->fds;
+			if (usk->peer != NULL) {
+				sock_notify(&usk->peer->sk, POLLOUT);
+			}
+		}
+	}
+	sched_unlock();
+
+	if (skb == NULL) {
+		return ret;
+	}
+
+	if (msg->msg_name != NULL) {
+		memcpy(msg->msg_name, skb->mac.raw,
+				min(msg->msg_namelen, unix_skb_cb(skb)->addrlen));
+		msg->msg_namelen = unix_skb_cb(skb)->addrlen;
+	}
+
+	/* The rest of the message is discarded */
+	len = skb->p_data_end - skb->p_data;
+	ret = skb_iovec_buf(msg->msg_iov, msg->msg_iovlen, skb->p_data, len);
+	if (ret < (int)len) {
+		msg->msg_flags |= MSG_TRUNC;
+	}
+
+	unix_fds_recv(msg, fds);
+	skb_free(skb);
+
+	return ret;
+}
+
+static int unix_getsockname(struct sock *sk, struct sockaddr *addr,
+		socklen_t *addrlen) {
+	sched_lock();
+	{
+		unix_addr_fill(to_unix_sock(sk), addr, addrlen);
+	}
+	sched_unlock();
+
+	return 0;
+}
+
+static int unix_getpeername(struct sock *sk, struct sockaddr *addr,
+		socklen_t *addrlen) {
+	struct unix_sock *usk = to_unix_sock(sk);
+	int ret;
+
+	ret = 0;
+	sched_lock();
+	{
+		if (usk->peer == NULL) {
+			ret = -ENOTCONN;
+		}
+		else {
+			unix_addr_fill(usk->peer, addr, addrlen);
+		}
+	}
+	sched_unlock();
+
+	return ret;
+}
+
+static int unix_shutdown(struct sock *sk, int how) {
+	struct unix_sock *usk = to_unix_sock(sk);
+
+	sched_lock();
+	{
+		if ((how != SHUT_RD) && (usk->peer != NULL)) {
+			usk->peer->peer_shut = 1;
+			sock_notify(&usk->peer->sk, POLLIN | POLLERR);
+		}
+		/* Blocked calls see the shutdown */
+		sock_notify(sk, POLLIN | POLLOUT | POLLERR);
+	}
+	sched_unlock();
+
+	return 0;
+}
+
+static int unix_socketpair(struct sock *sk1, struct sock *sk2) {
+	sched_lock();
+	{
+		unix_pair(to_unix_sock(sk1), to_unix_sock(sk2));
+	}
+	sched_unlock();
+
+	return 0;
+}
 
-static const struct family_ops unix_stream_ops = {
-		.family =	PF_UNIX,
+static const struct sock_family_ops unix_stream_ops = {
+	.init        = unix_init,
+	.close       = unix_close,
+	.bind        = unix_bind,
+	.bind_local  = unix_bind_local,
+	.connect     = unix_connect,
+	.listen      = unix_listen,
+	.accept      = unix_accept,
+	.sendmsg     = unix_stream_sendmsg,
+	.recvmsg     = unix_stream_recvmsg,
+	.getsockname = unix_getsockname,
+	.getpeername = unix_getpeername,
+	.shutdown    = unix_shutdown,
+	.socketpair  = unix_socketpair,
+	.sock_pool   = &unix_sock_pool
 };
 
-static const struct family_ops unix_seqpacket_ops = {
-		.family =	PF_UNIX,
+static const struct sock_family_ops unix_dgram_ops = {
+	.init        = unix_init,
+	.close       = unix_close,
+	.bind        = unix_bind,
+	.bind_local  = unix_bind_local,
+	.connect     = unix_connect,
+	.sendmsg     = unix_msg_sendmsg,
+	.recvmsg     = unix_msg_recvmsg,
+	.getsockname = unix_getsockname,
+	.getpeername = unix_getpeername,
+	.shutdown    = unix_shutdown,
+	.socketpair  = unix_socketpair,
+	.sock_pool   = &unix_sock_pool
 };
 
-static const struct proto unix_proto = {
-		.name = "UNIX",
-		.obj_size = sizeof(struct unix_sock),
+static const struct sock_family_ops unix_seqpacket_ops = {
+	.init        = unix_init,
+	.close       = unix_close,
+	.bind        = unix_bind,
+	.bind_local  = unix_bind_local,
+	.connect     = unix_connect,
+	.listen      = unix_listen,
+	.accept      = unix_accept,
+	.sendmsg     = unix_msg_sendmsg,
+	.recvmsg     = unix_msg_recvmsg,
+	.getsockname = unix_getsockname,
+	.getpeername = unix_getpeername,
+	.shutdown    = unix_shutdown,
+	.socketpair  = unix_socketpair,
+	.sock_pool   = &unix_sock_pool
 };
@@ -0,0 +1,56 @@
+/**
+ * @file
+ * @brief Socket files of the UNIX domain sockets on DVFS
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <fs/dvfs.h>
+
+#include "af_unix_fs.h"
+
+int unix_fs_bind(const char *path, void **node) {
+	struct lookup lu = { };
+	const char *name;
+	int res;
+
+	res = dvfs_lookup(path, &lu);
+	if (res != 0) {
+		return res;
+	}
+	if (lu.item != NULL) {
+		return -EADDRINUSE;
+	}
+
+	name = strrchr(path, '/');
+	res = dvfs_create_new(name ? name + 1 : path, &lu, S_IFSOCK);
+	if (res != 0) {
+		return res;
+	}
+
+	*node = lu.item->d_inode;
+	return 0;
+}
+
+int unix_fs_lookup(const char *path, void **node) {
+	struct lookup lu = { };
+	int res;
+
+	res = dvfs_lookup(path, &lu);
+	if (res != 0) {
+		return res;
+	}
+	if ((lu.item == NULL) || (lu.item->d_inode == NULL)) {
+		return -ENOENT;
+	}
+	if ((lu.item->d_inode->flags & S_IFMT) != S_IFSOCK) {
+		return -ECONNREFUSED;
+	}
+
+	*node = lu.item->d_inode;
+	return 0;
+}
@@ -0,0 +1,27 @@
+/**
+ * @file
+ * @brief Socket files of the UNIX domain sockets
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef NET_SOCKET_AF_UNIX_FS_H_
+#define NET_SOCKET_AF_UNIX_FS_H_
+
+/**
+ * Creates socket file @a path
+ *
+ * @param node Node of the file on return, it identifies the bound socket
+ * @return 0 on success, -EADDRINUSE if the file exists or other -errno
+ */
+extern int unix_fs_bind(const char *path, void **node);
+
+/**
+ * Finds socket file @a path
+ *
+ * @return 0 on success, -ECONNREFUSED if it is not a socket file
+ *    or other -errno
+ */
+extern int unix_fs_lookup(const char *path, void **node);
+
+#endif /* NET_SOCKET_AF_UNIX_FS_H_ */
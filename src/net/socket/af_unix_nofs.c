@@ -0,0 +1,18 @@
+/**
+ * @file
+ * @brief UNIX domain sockets without socket files, abstract names only
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+
+#include "af_unix_fs.h"
+
+int unix_fs_bind(const char *path, void **node) {
+	return -EOPNOTSUPP;
+}
+
+int unix_fs_lookup(const char *path, void **node) {
+	return -EOPNOTSUPP;
+}
@@ -28,6 +28,11 @@
 
 #define MODOPS_CONNECT_TIMEOUT OPTION_GET(NUMBER, connect_timeout)
 
+static inline int sock_connection_oriented(struct sock *sk) {
+	return (sk->opt.so_type == SOCK_STREAM)
+			|| (sk->opt.so_type == SOCK_SEQPACKET);
+}
+
 struct sock *ksocket(int family, int type, int protocol) {
 	struct sock *new_sk;
 
@@ -41,6 +46,42 @@ struct sock *ksocket(int family, int type, int protocol) {
 	return new_sk;
 }
 
+int ksocketpair(int family, int type, int protocol, struct sock *sv[2]) {
+	int ret;
+
+	assert(sv);
+
+	sv[0] = ksocket(family, type, protocol);
+	if (0 != err(sv[0])) {
+		return err(sv[0]);
+	}
+
+	sv[1] = ksocket(family, type, protocol);
+	if (0 != err(sv[1])) {
+		ret = err(sv[1]);
+		ksocket_close(sv[0]);
+		return ret;
+	}
+
+	assert(sv[0]->f_ops != NULL);
+	if (sv[0]->f_ops->socketpair == NULL) {
+		ret = -EOPNOTSUPP;
+	}
+	else {
+		ret = sv[0]->f_ops->socketpair(sv[0], sv[1]);
+	}
+	if (ret != 0) {
+		ksocket_close(sv[1]);
+		ksocket_close(sv[0]);
+		return ret;
+	}
+
+	sock_set_state(sv[0], SS_CONNECTED);
+	sock_set_state(sv[1], SS_CONNECTED);
+
+	return 0;
+}
+
 void ksocket_close(struct sock *sk) {
 	assert(sk);
 
@@ -94,7 +135,7 @@ int kconnect(struct sock *sk, const struct sockaddr *addr,
 	if (sk->opt.so_domain != addr->sa_family) {
 		return -EAFNOSUPPORT;
 	}
-	else if ((sk->opt.so_type == SOCK_STREAM)
+	else if (sock_connection_oriented(sk)
 			&& sock_state_connected(sk)) {
 		return -EISCONN;
 	}
@@ -151,7 +192,7 @@ int klisten(struct sock *sk, int backlog) {
 
 	backlog = backlog > 0 ? backlog : 1;
 
-	if (sk->opt.so_type != SOCK_STREAM) {
+	if (!sock_connection_oriented(sk)) {
 		return -EOPNOTSUPP;
 	}
 	else if (sock_state_connecting(sk)
@@ -198,7 +239,7 @@ int kaccept(struct sock *sk, struct sockaddr *addr,
 	assert(!addr || addrlen);
 	assert(!addrlen || (*addrlen > 0));
 
-	if (sk->opt.so_type != SOCK_STREAM) {
+	if (!sock_connection_oriented(sk)) {
 		return -EOPNOTSUPP;
 	}
 	else if (!sock_state_listening(sk)) {
@@ -259,6 +300,7 @@ int ksendmsg(struct sock *sk, struct msghdr *msg, int flags) {
 		}
 		break;
 	case SOCK_STREAM:
+	case SOCK_SEQPACKET:
 		if (!sock_state_connected(sk)) {
 			return -ENOTCONN;
 		}
@@ -284,7 +326,7 @@ int krecvmsg(struct sock *sk, struct msghdr *msg, int flags) {
 //		return 0;
 //	}
 
-	if ((sk->opt.so_type == SOCK_STREAM) && !sock_state_connected(sk)) {
+	if (sock_connection_oriented(sk) && !sock_state_connected(sk)) {
 		return -ENOTCONN;
 	}
 
@@ -389,6 +431,7 @@ int kgetsockopt(struct sock *sk, int level, int optname,
 	CASE_GETSOCKOPT(SO_DONTROUTE, so_dontroute, );
 	CASE_GETSOCKOPT(SO_ERROR, so_error,
 			sk->opt.so_error = 0);
+	CASE_GETSOCKOPT(SO_KEEPALIVE, so_keepalive, );
 	CASE_GETSOCKOPT(SO_LINGER, so_linger, );
 	CASE_GETSOCKOPT(SO_OOBINLINE, so_oobinline, );
 	CASE_GETSOCKOPT(SO_PROTOCOL, so_protocol, );
@@ -398,6 +441,7 @@ int kgetsockopt(struct sock *sk, int level, int optname,
 			if (*optlen > sizeof sk->opt.so_rcvtimeo) {
 				return -EDOM;
 			});
+	CASE_GETSOCKOPT(SO_REUSEPORT, so_reuseport, );
 	CASE_GETSOCKOPT(SO_SNDBUF, so_sndbuf, );
 	CASE_GETSOCKOPT(SO_SNDLOWAT, so_sndlowat, );
 	CASE_GETSOCKOPT(SO_SNDTIMEO, so_sndtimeo,
@@ -447,7 +491,19 @@ int ksetsockopt(struct sock *sk, int level, int optname,
 			sk->opt.so_bindtodevice = dev;
 			return 0;
 		}
+		case SO_KEEPALIVE:
+			if (optlen != sizeof sk->opt.so_keepalive) {
+				return -EINVAL;
+			}
+			memcpy(&sk->opt.so_keepalive, optval, optlen);
+			/* Protocol starts or stops its keepalive timer */
+			assert(sk->p_ops != NULL);
+			if (sk->p_ops->setsockopt != NULL) {
+				sk->p_ops->setsockopt(sk, level, optname, optval, optlen);
+			}
+			return 0;
 		CASE_SETSOCKOPT(SO_REUSEADDR, so_reuseaddr, );
+		CASE_SETSOCKOPT(SO_REUSEPORT, so_reuseport, );
 		CASE_SETSOCKOPT(SO_BROADCAST, so_broadcast, );
 		CASE_SETSOCKOPT(SO_DONTROUTE, so_dontroute, );
 		CASE_SETSOCKOPT(SO_LINGER, so_linger, );
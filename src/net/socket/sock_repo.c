@@ -78,6 +78,25 @@ int sock_addr_is_busy(const struct sock_proto_ops *p_ops,
 	return 0;
 }
 
+int sock_addr_is_busy_for(const struct sock *sk,
+		sock_addr_tester_ft tester, const struct sockaddr *addr,
+		socklen_t addrlen) {
+	const struct sock *other;
+
+	assert(sk != NULL);
+	assert(tester != NULL);
+
+	sock_foreach(other, sk->p_ops) {
+		if ((other->addr_len == addrlen)
+				&& tester(addr, other->src_addr)
+				&& !(sk->opt.so_reuseport && other->opt.so_reuseport)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 int sock_addr_alloc_port(const struct sock_proto_ops *p_ops,
 		in_port_t *addrport, sock_addr_tester_ft tester,
 		const struct sockaddr *addr, socklen_t addrlen) {
@@ -11,10 +11,12 @@
 #include <string.h>
 #include <poll.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #include <util/math.h>
 
 #include <net/l4/tcp.h>
+#include <net/l4/tcp_cong.h>
 #include <net/lib/tcp.h>
 #include <net/l3/ipv4/ip.h>
 #include <net/l2/ethernet.h>
@@ -32,8 +34,6 @@
 #include <fs/idesc_event.h>
 #include <net/sock_wait.h>
 
-#include <util/err.h>
-
 #include <framework/mod/options.h>
 #define MODOPS_AMOUNT_TCP_SOCK OPTION_GET(NUMBER, amount_tcp_sock)
 
@@ -76,17 +76,32 @@ static int tcp_init(struct sock *sk) {
 			sizeof tcp_sk->self.wind);
 	tcp_sk->rem.wind.factor = 0;
 	tcp_sk->parent = NULL;
-	INIT_LIST_HEAD(&tcp_sk->conn_lnk);
-	/* INIT_LIST_HEAD(&tcp_sk->conn_ready); */
-	INIT_LIST_HEAD(&tcp_sk->conn_wait);
-	INIT_LIST_HEAD(&tcp_sk->conn_free);
-	tcp_sk->free_wait_queue_len = tcp_sk->free_wait_queue_max = 0;
+	tcp_sk->listen = NULL;
 	tcp_sk->lock = 0;
 	/* timerclear(&sock.tcp_sk->syn_time); */
-	timerclear(&tcp_sk->ack_time);
 	timerclear(&tcp_sk->rcv_time);
 	tcp_sk->dup_ack = 0;
 	tcp_sk->rexmit_mode = 0;
+	tcp_sk->srtt = tcp_sk->rttvar = 0;
+	tcp_sk->rto = TCP_RTO_INIT;
+	tcp_sk->rtt_timing = 0;
+	tcp_sk->opt_flags = TCP_OPT_F_WS | TCP_OPT_F_SACK | TCP_OPT_F_TS;
+	tcp_sk->ts_recent = 0;
+	skb_queue_init(&tcp_sk->ofo_queue);
+	tcp_sk->ofo_len = 0;
+	tcp_sk->rcv_buf = TCP_RCVBUF_INIT;
+	tcp_sk->rcv_mss = TCP_MSS_DEFAULT;
+	tcp_sk->rcv_rtt = tcp_sk->rcv_copied = 0;
+	timerclear(&tcp_sk->rcv_space_time);
+	tcp_sk->ack_pending = tcp_sk->quickack = 0;
+	tcp_sk->nodelay = tcp_sk->cork = 0;
+	tcp_sk->tx_unsent = NULL;
+	tcp_sk->tx_unsent_corked = 0;
+	tcp_cong_sock_init(tcp_sk);
+	tcp_timer_init(tcp_sk);
+	tcp_sk->keep_idle = TCP_KEEPIDLE_DEFAULT;
+	tcp_sk->keep_intvl = TCP_KEEPINTVL_DEFAULT;
+	tcp_sk->keep_cnt = TCP_KEEPCNT_DEFAULT;
 
 	return 0;
 }
@@ -95,6 +110,7 @@ static int tcp_close(struct sock *sk) {
 	struct sk_buff *skb;
 	struct tcphdr *tcph;
 	struct tcp_sock *tcp_sk;
+	size_t opt_len;
 
 	tcp_sk = to_tcp_sock(sk);
 	assert(tcp_sk != NULL);
@@ -121,8 +137,11 @@ static int tcp_close(struct sock *sk) {
 		case TCP_SYN_RECV:
 		case TCP_ESTABIL:
 		case TCP_CLOSEWAIT:
+			/* Data held back goes before FIN */
+			tcp_push_unsent(tcp_sk);
 			skb = NULL; /* alloc new pkg */
-			if (0 != alloc_prep_skb(tcp_sk, 0, NULL, &skb)) {
+			opt_len = tcp_opt_len(tcp_sk, 0, 0);
+			if (0 != alloc_prep_skb(tcp_sk, opt_len, NULL, &skb)) {
 				break; /* error: see ret */
 			}
 			tcp_sock_set_state(tcp_sk,
@@ -134,6 +153,7 @@ static int tcp_close(struct sock *sk) {
 					sock_inet_get_src_port(to_sock(tcp_sk)),
 					TCP_MIN_HEADER_SIZE, tcp_sk->self.wind.value);
 			tcph->fin = 1;
+			tcp_opt_build(tcp_sk, tcph, opt_len);
 			tcp_set_ack_field(tcph, tcp_sk->rem.seq);
 			send_seq_from_sock(tcp_sk, skb);
 			break;
@@ -150,14 +170,8 @@ static int tcp_connect(struct sock *sk,
 	struct sk_buff *skb;
 	struct tcphdr *tcph;
 	struct tcp_sock *tcp_sk;
+	size_t opt_len;
 	int ret;
-	static const __u8 magic_opts[] = {
-		TCP_OPT_KIND_MSS, 0x04,     /* Maximum segment size:             */
-				0x40, 0x0C,               /* 16396 bytes         */
-		TCP_OPT_KIND_NOP,           /* No-Operation                      */
-		TCP_OPT_KIND_WS, 0x03,      /* Window scale:                     */
-				TCP_WINDOW_FACTOR_DEFAULT /* 7 (multiply by 128) */
-	};
 
 	(void)addr;
 	(void)addr_len;
@@ -178,7 +192,8 @@ static int tcp_connect(struct sock *sk,
 		case TCP_CLOSED:
 			/* make skb with options */
 			skb = NULL; /* alloc new pkg */
-			ret = alloc_prep_skb(tcp_sk, sizeof magic_opts, NULL, &skb);
+			opt_len = tcp_opt_len(tcp_sk, 1, 0);
+			ret = alloc_prep_skb(tcp_sk, opt_len, NULL, &skb);
 			if (ret != 0) {
 				break;
 			}
@@ -187,10 +202,9 @@ static int tcp_connect(struct sock *sk,
 			tcp_build(tcph,
 					sock_inet_get_dst_port(to_sock(tcp_sk)),
 					sock_inet_get_src_port(to_sock(tcp_sk)),
-					TCP_MIN_HEADER_SIZE + sizeof magic_opts,
-					tcp_sk->self.wind.value);
+					TCP_MIN_HEADER_SIZE, tcp_sk->self.wind.value);
 			tcph->syn = 1;
-			memcpy(&tcph->options, &magic_opts[0], sizeof magic_opts);
+			tcp_opt_build(tcp_sk, tcph, opt_len);
 			send_seq_from_sock(tcp_sk, skb);
 			//FIXME hack use common lock/unlock systems for socket
 			sched_lock();
@@ -220,42 +234,6 @@ static int tcp_connect(struct sock *sk,
 	return ret;
 }
 
-static int tcp_sock_alloc_missing_backlog(struct tcp_sock *tcp_sk) {
-	int to_alloc;
-
-	assert(tcp_sk != NULL);
-
-	tcp_sock_lock(tcp_sk, TCP_SYNC_CONN_QUEUE);
-	{
-		to_alloc = tcp_sk->free_wait_queue_max - tcp_sk->free_wait_queue_len;
-		/* to_alloc allowed to be negative. It could be if backlog had set and then
-		 * was reduced.
-		 */
-
-		while (to_alloc > 0) {
-			struct sock *newsk;
-			struct tcp_sock *tcp_newsk;
-
-			newsk = sock_create(to_sock(tcp_sk)->opt.so_domain,
-					SOCK_STREAM, IPPROTO_TCP);
-			if (err(newsk) != 0) {
-				break;
-			}
-
-			to_alloc--;
-
-			tcp_newsk = to_tcp_sock(newsk);
-			tcp_newsk->parent = tcp_sk;
-
-			list_add_tail(&tcp_newsk->conn_lnk, &tcp_sk->conn_free);
-			tcp_sk->free_wait_queue_len++;
-		}
-	}
-	tcp_sock_unlock(tcp_sk, TCP_SYNC_CONN_QUEUE);
-
-	return tcp_sk->free_wait_queue_len;
-}
-
 static int tcp_listen(struct sock *sk, int backlog) {
 	int ret;
 	struct tcp_sock *tcp_sk;
@@ -278,11 +256,12 @@ static int tcp_listen(struct sock *sk, int backlog) {
 				ret = -EINVAL; /* error: invalid backlog */
 				break;
 			}
-			tcp_sk->free_wait_queue_max = backlog;
 			/* this could be not first listen call, adjusting backlog queue */
-			tcp_sock_alloc_missing_backlog(tcp_sk);
+			ret = tcp_sock_listen(tcp_sk, backlog);
+			if (ret != 0) {
+				break;
+			}
 			tcp_sock_set_state(tcp_sk, TCP_LISTEN);
-			ret = 0;
 			break;
 		}
 	}
@@ -291,30 +270,6 @@ static int tcp_listen(struct sock *sk, int backlog) {
 	return ret;
 }
 
-static inline struct tcp_sock *accept_get_connection(struct tcp_sock *tcp_sk) {
-	struct tcp_sock *tcp_newsk;
-	/* get first socket from */
-
-	if (list_empty(&tcp_sk->conn_ready)) {
-		return NULL;
-	}
-
-	tcp_newsk = list_entry(tcp_sk->conn_ready.next, struct tcp_sock, conn_lnk);
-
-	/* check if reading was enabled for socket that already released */
-	if (tcp_sock_get_status(tcp_newsk) == TCP_ST_NONSYNC) {
-		//TODO have to create socket before
-		return NULL;
-	}
-
-	/* delete new socket from list */
-	list_del_init(&tcp_newsk->conn_lnk);
-	assert(tcp_sk->free_wait_queue_len > 0);
-	--tcp_sk->free_wait_queue_len;
-
-	return tcp_newsk;
-}
-
 static int tcp_accept(struct sock *sk, struct sockaddr *addr,
 		socklen_t *addr_len, int flags, struct sock **newsk) {
 	struct tcp_sock *tcp_sk, *tcp_newsk;
@@ -335,78 +290,124 @@ static int tcp_accept(struct sock *sk, struct sockaddr *addr,
 		return -EINVAL; /* error: the socket is not accepting connections */
 	}
 
-	if (0 == tcp_sock_alloc_missing_backlog(tcp_sk)) {
-		return -ENOBUFS;
-	}
-
 	/* waiting anyone */
-	tcp_newsk = NULL;
-	tcp_sock_lock(tcp_sk, TCP_SYNC_CONN_QUEUE);
+	sched_lock();
 	{
-		do {
-			tcp_newsk = accept_get_connection(tcp_sk);
-			if (tcp_newsk) {
-				break;
-			}
-			tcp_sock_alloc_missing_backlog(tcp_sk);
+		while (NULL == (tcp_newsk = tcp_sock_accept(tcp_sk))) {
 			ret = sock_wait(sk, POLLIN | POLLERR, SCHED_TIMEOUT_INFINITE);
-		} while (!ret);
-	}
-	tcp_sock_unlock(tcp_sk, TCP_SYNC_CONN_QUEUE);
-
-	if (!tcp_newsk) {
-		if (0 > ret) {
-			return ret;
-		} else {
-			return -ECONNRESET; /* FIXME */
+			if (ret != 0) {
+				sched_unlock();
+				return ret;
+			}
+			if (tcp_sk->state != TCP_LISTEN) {
+				sched_unlock();
+				return -ECONNABORTED;
+			}
 		}
 	}
+	sched_unlock();
 
 	if (tcp_sock_get_status(tcp_newsk) == TCP_ST_NOTEXIST) {
+		/* Reset while it was in the accept queue */
 		tcp_sock_release(tcp_newsk);
 		return -ECONNRESET;
 	}
 
 	assert(tcp_sock_get_status(tcp_newsk) == TCP_ST_SYNC);
-	sk->rx_data_len--;
 	*newsk = to_sock(tcp_newsk);
 
 	return 0;
 }
 
-static int tcp_write(struct tcp_sock *tcp_sk, void *buff, size_t len) {
-	void *pb;
-	struct sk_buff *skb;
-	int ret;
+/* A segment shorter than MSS is held back while data is in flight
+ * (Nagle's algorithm), while corked or if more data follows */
+static int tcp_hold(struct tcp_sock *tcp_sk, int more) {
+	return more || tcp_sk->cork || (!tcp_sk->nodelay
+			&& (tcp_sk->self.seq != tcp_sk->last_ack));
+}
 
-	pb = buff;
+/* Gathers @a len bytes of the vector starting from @a off into as few
+ * segments of the peer's MSS as possible. Data held back before goes
+ * first, the last short segment may be held back again. */
+static int tcp_write(struct tcp_sock *tcp_sk, const struct iovec *iov,
+		int iovcnt, size_t off, size_t len, int more) {
+	struct sk_buff *skb, *held;
+	size_t iov_off, seg_off, held_len, seg_len, bytes, cnt, opt_len, room;
+	char *data;
+	int ret, i, sent;
+
+	i = 0;
+	while ((off != 0) && (off >= iov[i].iov_len)) {
+		off -= iov[i++].iov_len;
+	}
+
+	sent = 0;
+	iov_off = off;
 	while (len != 0) {
 		/* Previous comment: try to send wholly msg
 		 * We must pass no more than 64k bytes to underlaying IP level */
-		size_t bytes = min(len, IP_MAX_PACKET_LEN - MAX_HEADER_SIZE);
+		opt_len = tcp_opt_len(tcp_sk, 0, 0);
+		room = min((size_t)tcp_sk->mss - opt_len,
+				(size_t)IP_MAX_PACKET_LEN - MAX_HEADER_SIZE);
+
+		tcp_sock_lock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
+		held = tcp_sk->tx_unsent;
+		tcp_sk->tx_unsent = NULL;
+		held_len = held != NULL
+				? tcp_data_length(held->h.th, held->nh.raw) : 0;
+		assert(held_len < room);
+		bytes = min(len, room - held_len);
+		seg_len = held_len + bytes;
 		skb = NULL; /* alloc new pkg */
 
-		ret = alloc_prep_skb(tcp_sk, 0, &bytes, &skb);
+		ret = alloc_prep_skb(tcp_sk, opt_len, &seg_len, &skb);
 		if (ret != 0) {
+			tcp_sk->tx_unsent = held;
+			tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
 			break;
 		}
 
-		log_debug("sending len %d", bytes);
+		log_debug("sending len %d held %d", bytes, held_len);
 
 		tcp_build(skb->h.th,
 				sock_inet_get_dst_port(to_sock(tcp_sk)),
 				sock_inet_get_src_port(to_sock(tcp_sk)),
 				TCP_MIN_HEADER_SIZE, tcp_sk->self.wind.value);
+		tcp_opt_build(tcp_sk, skb->h.th, opt_len);
 
-		memcpy(skb->h.th + 1, pb, bytes);
-		pb += bytes;
+		data = (char *) skb->h.th + TCP_HEADER_SIZE(skb->h.th);
+		if (held != NULL) {
+			memcpy(data, (char *) held->h.th + TCP_HEADER_SIZE(held->h.th),
+					held_len);
+			skb_free(held);
+		}
+		for (seg_off = held_len; seg_off < seg_len; seg_off += cnt) {
+			while (iov_off == iov[i].iov_len) {
+				i++;
+				iov_off = 0;
+			}
+			cnt = min(seg_len - seg_off, iov[i].iov_len - iov_off);
+			memcpy(data + seg_off, (char *) iov[i].iov_base + iov_off, cnt);
+			iov_off += cnt;
+		}
+		sent += bytes;
 		len -= bytes;
 		/* Fill TCP header */
-		skb->h.th->psh = (len == 0);
 		tcp_set_ack_field(skb->h.th, tcp_sk->rem.seq);
-		send_seq_from_sock(tcp_sk, skb);
+		if ((len == 0) && (seg_len < room) && tcp_hold(tcp_sk, more)) {
+			tcp_sk->tx_unsent = skb;
+			tcp_sk->tx_unsent_corked = more || tcp_sk->cork;
+			if (!tcp_timer_pending(tcp_sk, TCP_TIMER_CORK)) {
+				tcp_timer_set(tcp_sk, TCP_TIMER_CORK, TCP_CORK_DELAY);
+			}
+		}
+		else {
+			skb->h.th->psh = (len == 0);
+			send_seq_from_sock(tcp_sk, skb);
+		}
+		tcp_sock_unlock(tcp_sk, TCP_SYNC_WRITE_QUEUE);
 	}
-	return pb - buff;
+	return sent;
 }
 
 #if MAX_SIMULTANEOUS_TX_PACK > 0
@@ -433,12 +434,22 @@ static inline int tcp_wait_tx_ready(struct sock *sk, int timeout) {
 #endif
 
 #define REM_WIND_MAX_SIZE (1460 * 100) /* FIXME use txqueuelen for netdev */
+
+/* Bytes allowed to send now by both receiver and congestion windows */
+static size_t tcp_send_window(struct tcp_sock *tcp_sk) {
+	uint32_t wnd, flight;
+
+	wnd = min(min(tcp_sk->rem.wind.size, (uint32_t)REM_WIND_MAX_SIZE),
+			tcp_sk->cwnd);
+	flight = tcp_sk->self.seq - tcp_sk->last_ack;
+
+	return wnd > flight ? wnd - flight : 0;
+}
+
 static int tcp_sendmsg(struct sock *sk, struct msghdr *msg, int flags) {
 	struct tcp_sock *tcp_sk;
-	size_t len;
-	int ret, timeout;
-
-	(void)flags;
+	size_t len, sent, wnd;
+	int ret, timeout, i;
 
 	assert(sk);
 	assert(msg);
@@ -469,21 +480,45 @@ sendmsg_again:
 		goto sendmsg_again;
 	case TCP_ESTABIL:
 	case TCP_CLOSEWAIT:
-		sched_lock();
-		{
-			while ((min(tcp_sk->rem.wind.size, REM_WIND_MAX_SIZE)
-						<= tcp_sk->self.seq - tcp_sk->last_ack)
-					|| tcp_sk->rexmit_mode) {
-				ret = sock_wait(sk, POLLOUT | POLLERR, timeout);
-				if (ret != 0) {
-					sched_unlock();
-					return ret;
+		len = 0;
+		for (i = 0; i < msg->msg_iovlen; i++) {
+			len += msg->msg_iov[i].iov_len;
+		}
+
+		/* Data goes out as the windows open, a part at a time */
+		for (sent = 0; sent < len; sent += ret) {
+			sched_lock();
+			{
+				while (!(wnd = tcp_send_window(tcp_sk))
+						|| tcp_sk->rexmit_mode) {
+					if ((tcp_sk->rem.wind.size == 0)
+							&& (tcp_sk->self.seq == tcp_sk->last_ack)
+							&& !tcp_timer_pending(tcp_sk,
+								TCP_TIMER_PERSIST)) {
+						/* Only a probe learns when zero window opens */
+						tcp_timer_set(tcp_sk, TCP_TIMER_PERSIST,
+								tcp_sk->rto);
+					}
+					ret = sock_wait(sk, POLLOUT | POLLERR, timeout);
+					if ((ret == 0) && (tcp_sk->state != TCP_ESTABIL)
+							&& (tcp_sk->state != TCP_CLOSEWAIT)) {
+						ret = -EPIPE;
+					}
+					if (ret != 0) {
+						sched_unlock();
+						return sent ? sent : ret;
+					}
 				}
 			}
+			sched_unlock();
+
+			ret = tcp_write(tcp_sk, msg->msg_iov, msg->msg_iovlen,
+					sent, min(wnd, len - sent), flags & MSG_MORE);
+			if (ret == 0) {
+				return sent ? sent : -ENOMEM;
+			}
 		}
-		sched_unlock();
 
-		len = tcp_write(tcp_sk, msg->msg_iov->iov_base, msg->msg_iov->iov_len);
 		ret = tcp_wait_tx_ready(sk, timeout);
 		if (0 > ret) {
 			return ret;
@@ -501,6 +536,7 @@ sendmsg_again:
 static int tcp_recvmsg(struct sock *sk, struct msghdr *msg,
 		int flags) {
 	struct tcp_sock *tcp_sk;
+	int ret;
 
 	assert(sk);
 	assert(msg);
@@ -522,7 +558,11 @@ static int tcp_recvmsg(struct sock *sk, struct msghdr *msg,
 	case TCP_ESTABIL:
 	case TCP_FINWAIT_1:
 	case TCP_FINWAIT_2:
-		return sock_stream_recvmsg(to_sock(tcp_sk), msg, flags);
+		ret = sock_stream_recvmsg(to_sock(tcp_sk), msg, flags);
+		if (ret > 0) {
+			tcp_rcvbuf_update(tcp_sk, ret);
+		}
+		return ret;
 	case TCP_CLOSING:
 	case TCP_LASTACK:
 	case TCP_TIMEWAIT:
@@ -544,10 +584,111 @@ static int tcp_shutdown(struct sock *sk, int how) {
 
 static int tcp_setsockopt(struct sock *sk, int level, int optname,
 			const void *optval, socklen_t optlen) {
+	struct tcp_sock *tcp_sk;
+	char name[TCP_CA_NAME_MAX];
+	int val;
+
+	tcp_sk = to_tcp_sock(sk);
+
+	if (level == SOL_SOCKET) {
+		/* Value is already in sk->opt */
+		if (optname == SO_KEEPALIVE) {
+			tcp_keepalive_update(tcp_sk);
+			return 0;
+		}
+		return -ENOPROTOOPT;
+	}
 
 	switch (optname) {
 	case TCP_NODELAY:
-		/* TODO just ignoring for now... */
+	case TCP_CORK:
+	case TCP_QUICKACK:
+		if (optlen != sizeof val) {
+			return -EINVAL;
+		}
+		memcpy(&val, optval, sizeof val);
+		if (optname == TCP_NODELAY) {
+			tcp_sk->nodelay = (val != 0);
+			if (tcp_sk->nodelay && !tcp_sk->tx_unsent_corked) {
+				tcp_push_unsent(tcp_sk);
+			}
+		}
+		else if (optname == TCP_CORK) {
+			tcp_sk->cork = (val != 0);
+			if (!tcp_sk->cork) {
+				tcp_push_unsent(tcp_sk);
+			}
+		}
+		else {
+			tcp_sk->quickack = val != 0 ? TCP_QUICKACK_SEGS : 0;
+			if ((val != 0) && (tcp_sk->ack_pending != 0)) {
+				tcp_send_ack(tcp_sk);
+			}
+		}
+		break;
+	case TCP_KEEPIDLE:
+	case TCP_KEEPINTVL:
+	case TCP_KEEPCNT:
+		if (optlen != sizeof val) {
+			return -EINVAL;
+		}
+		memcpy(&val, optval, sizeof val);
+		if (val <= 0) {
+			return -EINVAL;
+		}
+		if (optname == TCP_KEEPIDLE) {
+			tcp_sk->keep_idle = val;
+		}
+		else if (optname == TCP_KEEPINTVL) {
+			tcp_sk->keep_intvl = val;
+		}
+		else {
+			tcp_sk->keep_cnt = val;
+		}
+		break;
+	case TCP_CONGESTION:
+		if (optlen <= 0) {
+			return -EINVAL;
+		}
+		optlen = min(optlen, (socklen_t)sizeof(name) - 1);
+		memcpy(name, optval, optlen);
+		name[optlen] = '\0';
+		return tcp_cong_set(tcp_sk, name);
+	default:
+		return -ENOPROTOOPT;
+	}
+
+	return 0;
+}
+
+static int tcp_getsockopt(struct sock *sk, int level, int optname,
+			void *optval, socklen_t *optlen) {
+	const char *name;
+	int val;
+
+	switch (optname) {
+	case TCP_NODELAY:
+	case TCP_CORK:
+	case TCP_QUICKACK:
+		val = optname == TCP_NODELAY ? to_tcp_sock(sk)->nodelay
+				: optname == TCP_CORK ? to_tcp_sock(sk)->cork
+				: (to_tcp_sock(sk)->quickack != 0);
+		*optlen = min(*optlen, (socklen_t)sizeof val);
+		memcpy(optval, &val, *optlen);
+		break;
+	case TCP_KEEPIDLE:
+	case TCP_KEEPINTVL:
+	case TCP_KEEPCNT:
+		val = optname == TCP_KEEPIDLE ? to_tcp_sock(sk)->keep_idle
+				: optname == TCP_KEEPINTVL ? to_tcp_sock(sk)->keep_intvl
+				: to_tcp_sock(sk)->keep_cnt;
+		*optlen = min(*optlen, (socklen_t)sizeof val);
+		memcpy(optval, &val, *optlen);
+		break;
+	case TCP_CONGESTION:
+		name = to_tcp_sock(sk)->cong->name;
+		*optlen = min(*optlen, (socklen_t)strlen(name) + 1);
+		memcpy(optval, name, *optlen);
 		break;
 	default:
 		return -ENOPROTOOPT;
@@ -567,6 +708,7 @@ static const struct sock_proto_ops tcp_sock_ops_struct = {
 	.accept     = tcp_accept,
 	.sendmsg    = tcp_sendmsg,
 	.recvmsg    = tcp_recvmsg,
+	.getsockopt = tcp_getsockopt,
 	.setsockopt = tcp_setsockopt,
 	.shutdown   = tcp_shutdown,
 	.sock_pool  = &tcp_sock_pool,
@@ -8,12 +8,13 @@
  */
 
 #include <embox/unit.h>
-#include <util/ring_buff.h>
+#include <errno.h>
 #include <stdio.h>
 
 #include <kernel/thread.h>
+#include <kernel/thread/ring_wait.h>
 #include <util/err.h>
-#include <kernel/event.h>
+#include <util/mpmc_ring.h>
 
 #include <pnet/core/core.h>
 #include <pnet/pack/pnet_pack.h>
@@ -33,12 +34,16 @@ static int running[PNET_PRIORITY_COUNT];
 static int sleeping[PNET_PRIORITY_COUNT];
 #endif
 
+/* Packets come from interrupt handlers and from other rx threads at once,
+ * so the queue is a lock-free MPMC ring */
 struct pnet_wait_unit {
-	struct event event;
-	struct ring_buff buff;
+	struct ring_waitq wait;
+	struct mpmc_ring ring;
 };
 
-static net_packet_t pack_bufs[PNET_PRIORITY_COUNT][RX_THRD_BUF_SIZE];
+static uint64_t pack_bufs[PNET_PRIORITY_COUNT]
+	[MPMC_RING_STORAGE_SIZE(sizeof(net_packet_t), RX_THRD_BUF_SIZE)
+		/ sizeof(uint64_t)];
 static struct pnet_wait_unit pack_storage[PNET_PRIORITY_COUNT];
 
 static void *pnet_rx_thread_hnd(void *args) {
@@ -46,12 +51,10 @@ static void *pnet_rx_thread_hnd(void *args) {
 	struct pnet_pack *pack;
 
 	while (1) {
-		if (unit->buff.cnt == 0) {
-			EVENT_WAIT(&unit->event, unit->buff.cnt, EVENT_TIMEOUT_INFINITE);
-			continue;
+		if (mpmc_ring_dequeue_wait(&unit->ring, &unit->wait, &pack, 1,
+				SCHED_TIMEOUT_INFINITE) == 1) {
+			pnet_process(pack);
 		}
-		ring_buff_dequeue(&unit->buff, &pack, 1);
-		pnet_process(pack);
 	}
 	return NULL;
 }
@@ -59,10 +62,9 @@ static void *pnet_rx_thread_hnd(void *args) {
 static int rx_thread_init(void) {
 	for (size_t i = 0; i < PNET_PRIORITY_COUNT; i++) {
 
-		event_init(&pack_storage[i].event, "pack_arrived");
-
-		ring_buff_init(&pack_storage[i].buff, sizeof(net_packet_t), RX_THRD_BUF_SIZE,
-				(void *) pack_bufs[i]);
+		ring_waitq_init(&pack_storage[i].wait);
+		mpmc_ring_init(&pack_storage[i].ring, pack_bufs[i],
+				sizeof(net_packet_t), RX_THRD_BUF_SIZE);
 		pnet_rx_threads[i] = thread_create(0, pnet_rx_thread_hnd, &pack_storage[i]);
 		if(err(pnet_rx_threads[i])) {
 			return -1;
@@ -92,8 +94,10 @@ int pnet_rx_thread_add(struct pnet_pack *pack) {
 		pack->stat.last_sync = thread_get_running_time(pnet_rx_threads[prio]);
 	}
 
-	ring_buff_enqueue(&pack_storage[prio].buff, &pack, 1);
-	event_notify(&pack_storage[prio].event);
+	if (!mpmc_ring_enqueue_notify(&pack_storage[prio].ring,
+			&pack_storage[prio].wait, &pack, 1)) {
+		return -ENOBUFS;
+	}
 
 	return 0;
 }
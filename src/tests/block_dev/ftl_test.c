@@ -0,0 +1,155 @@
+/**
+ * @file
+ * @brief Flash translation layer on top of the flash emulator
+ *
+ * @date 19.10.2026
+ */
+
+#include <string.h>
+
+#include <drivers/block_dev.h>
+#include <drivers/flash/emulator.h>
+#include <drivers/flash/flash.h>
+#include <drivers/flash/ftl.h>
+#include <embox/test.h>
+#include <util/err.h>
+
+EMBOX_TEST_SUITE("flash translation layer test");
+
+TEST_SETUP_SUITE(suite_setup);
+TEST_TEARDOWN_SUITE(suite_teardown);
+
+#define FLASH_NAME       "ftltest"
+#define FLASH_BLOCKS     16
+#define FLASH_BLOCK_SIZE 4096
+
+static struct flash_dev *flash;
+static struct block_dev *bdev;
+static char buf[4096];
+
+/* Driver is called directly, the buffer cache would hide what's on flash */
+static int ftl_test_write(blkno_t blkno, int round) {
+	memset(buf, blkno ^ round, bdev->block_size);
+	return bdev->driver->write(bdev, buf, bdev->block_size, blkno);
+}
+
+static int ftl_test_check(blkno_t blkno, int round) {
+	int i;
+
+	if (bdev->block_size != bdev->driver->read(bdev, buf,
+			bdev->block_size, blkno)) {
+		return -1;
+	}
+	for (i = 0; i < bdev->block_size; i++) {
+		if (buf[i] != (char) (blkno ^ round)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+TEST_CASE("Sectors rewritten many times read back correctly") {
+	struct ftl_stats stats;
+	blkno_t blk, blocks = bdev->size / bdev->block_size;
+	int round;
+
+	for (round = 0; round < 20; round++) {
+		for (blk = 0; blk < blocks; blk++) {
+			test_assert_equal(bdev->block_size, ftl_test_write(blk, round));
+		}
+		for (blk = 0; blk < blocks; blk++) {
+			test_assert_zero(ftl_test_check(blk, round));
+		}
+	}
+
+	test_assert_zero(ftl_get_stats(bdev, &stats));
+	test_assert(stats.erases > 0);
+	test_assert(stats.flash_writes <= stats.host_writes + stats.gc_copies);
+}
+
+TEST_CASE("Written sectors persist after FTL is recreated") {
+	blkno_t blk, blocks = bdev->size / bdev->block_size;
+
+	for (blk = 0; blk < blocks; blk++) {
+		test_assert_equal(bdev->block_size, ftl_test_write(blk, 0x5a));
+	}
+
+	test_assert_zero(ftl_delete(bdev));
+	bdev = ftl_create(FLASH_NAME "_ftl", flash);
+	test_assert_zero(err(bdev));
+
+	for (blk = 0; blk < blocks; blk++) {
+		test_assert_zero(ftl_test_check(blk, 0x5a));
+	}
+}
+
+TEST_CASE("Discarded sectors read as zeroes") {
+	int i;
+
+	test_assert_equal(bdev->block_size, ftl_test_write(3, 1));
+	test_assert_equal(bdev->block_size, ftl_test_write(4, 1));
+	test_assert_zero(block_dev_discard(bdev, 3, 1));
+
+	test_assert_equal(bdev->block_size,
+			bdev->driver->read(bdev, buf, bdev->block_size, 3));
+	for (i = 0; i < bdev->block_size; i++) {
+		test_assert_zero(buf[i]);
+	}
+	test_assert_zero(ftl_test_check(4, 1));
+}
+
+TEST_CASE("Rewritten buffered sector reaches flash on IOCTL_FLUSH") {
+	struct ftl_stats before, after;
+
+	test_assert_zero(block_dev_flush(bdev));
+	test_assert_zero(ftl_get_stats(bdev, &before));
+
+	test_assert_equal(bdev->block_size, ftl_test_write(5, 1));
+	test_assert_equal(bdev->block_size, ftl_test_write(6, 1));
+	test_assert_equal(bdev->block_size, ftl_test_write(5, 2));
+	test_assert_zero(block_dev_flush(bdev));
+
+	/* The first data of sector 5 is written before sector 6 */
+	test_assert_zero(ftl_get_stats(bdev, &after));
+	test_assert(after.flash_writes - before.flash_writes >= 3);
+
+	test_assert_zero(ftl_test_check(5, 2));
+	test_assert_zero(ftl_test_check(6, 1));
+}
+
+static struct flash_dev *ftl_test_flash(void) {
+	struct flash_dev *fdev;
+	int i;
+
+	for (i = 0; i < flash_max_id(); i++) {
+		fdev = flash_by_id(i);
+		if (fdev && fdev->bdev
+				&& !strncmp(fdev->bdev->name, FLASH_NAME, strlen(FLASH_NAME))) {
+			return fdev;
+		}
+	}
+	return NULL;
+}
+
+static int suite_setup(void) {
+	if (!flash) {
+		if (flash_emu_dev_create(FLASH_NAME, FLASH_BLOCKS, FLASH_BLOCK_SIZE)) {
+			return -1;
+		}
+		flash = ftl_test_flash();
+		if (!flash) {
+			return -1;
+		}
+	}
+
+	bdev = ftl_create(FLASH_NAME "_ftl", flash);
+	if (err(bdev)) {
+		return err(bdev);
+	}
+
+	return bdev->block_size <= sizeof(buf) ? 0 : -1;
+}
+
+static int suite_teardown(void) {
+	return ftl_delete(bdev);
+}
@@ -11,6 +11,7 @@
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/sendfile.h>
 
 #include <embox/test.h>
 
@@ -192,6 +193,81 @@ TEST_CASE("Test lseek") {
 	test_assert_zero(remove_test_file());
 }
 
+TEST_CASE("Hole in a sparse file reads as zeroes") {
+	char test_buff[SIZE_OF_FILE];
+	char zero_buff[SIZE_OF_FILE];
+	const off_t hole = 3 * 4096 + 5;
+	int fd;
+
+	memset(zero_buff, 0, sizeof(zero_buff));
+	test_assert_zero(create_test_file());
+
+	test_assert(0 <= (fd = open(test_file_filename, O_RDWR)));
+	test_assert_equal(hole, lseek(fd, hole, SEEK_SET));
+	test_assert_equal(SIZE_OF_FILE, write(fd, test_file_contents, SIZE_OF_FILE));
+
+	test_assert_equal(2 * 4096, lseek(fd, 2 * 4096, SEEK_SET));
+	test_assert_equal(SIZE_OF_FILE, read(fd, test_buff, SIZE_OF_FILE));
+	test_assert_zero(memcmp(test_buff, zero_buff, SIZE_OF_FILE));
+
+	test_assert_equal(hole, lseek(fd, hole, SEEK_SET));
+	test_assert_equal(SIZE_OF_FILE, read(fd, test_buff, SIZE_OF_FILE));
+	test_assert_zero(strncmp(test_buff, test_file_contents, SIZE_OF_FILE));
+	test_assert_zero(close(fd));
+
+	test_assert_zero(remove_test_file());
+}
+
+TEST_CASE("Data cut by truncate doesn't show up again") {
+	char test_buff[SIZE_OF_FILE];
+	char zero_buff[SIZE_OF_FILE];
+	int fd;
+
+	memset(zero_buff, 0, sizeof(zero_buff));
+	test_assert_zero(create_test_file());
+
+	test_assert_zero(truncate(test_file_filename, 1));
+	test_assert_zero(truncate(test_file_filename, SIZE_OF_FILE));
+
+	test_assert(0 <= (fd = open(test_file_filename, O_RDONLY)));
+	test_assert_equal(SIZE_OF_FILE, read(fd, test_buff, SIZE_OF_FILE));
+	test_assert_equal(test_file_contents[0], test_buff[0]);
+	test_assert_zero(memcmp(test_buff + 1, zero_buff, SIZE_OF_FILE - 1));
+	test_assert_zero(close(fd));
+
+	test_assert_zero(remove_test_file());
+}
+
+TEST_CASE("sendfile() hands file pages to a pipe") {
+	char test_buff[SIZE_OF_FILE];
+	off_t off = 1;
+	int fd, pipefd[2];
+
+	memset(test_buff, 0, sizeof(test_buff));
+	test_assert_zero(create_test_file());
+	test_assert_zero(pipe(pipefd));
+
+	test_assert(0 <= (fd = open(test_file_filename, O_RDONLY)));
+	test_assert_equal(SIZE_OF_FILE - 1,
+			sendfile(pipefd[1], fd, &off, SIZE_OF_FILE));
+	test_assert_equal(SIZE_OF_FILE, off);
+	/* File position is left where it was */
+	test_assert_equal(SIZE_OF_FILE, sendfile(pipefd[1], fd, NULL, 100));
+	test_assert_zero(sendfile(pipefd[1], fd, NULL, 100));
+
+	test_assert_equal(SIZE_OF_FILE - 1,
+			read(pipefd[0], test_buff, SIZE_OF_FILE - 1));
+	test_assert_zero(strncmp(test_buff, test_file_contents + 1,
+			SIZE_OF_FILE - 1));
+	test_assert_equal(SIZE_OF_FILE, read(pipefd[0], test_buff, SIZE_OF_FILE));
+	test_assert_zero(strncmp(test_buff, test_file_contents, SIZE_OF_FILE));
+
+	test_assert_zero(close(fd));
+	test_assert_zero(close(pipefd[0]));
+	test_assert_zero(close(pipefd[1]));
+	test_assert_zero(remove_test_file());
+}
+
 TEST_CASE("Test fcntl") {
 }
 
@@ -0,0 +1,100 @@
+/**
+ * @file
+ * @brief Cyclictest-like measurement of the periodic thread wake up latency
+ *
+ * A high priority thread sleeps until the next period boundary and
+ * measures how late it really got the CPU.
+ *
+ * @date 19.10.2026
+ */
+
+#include <embox/test.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <kernel/thread.h>
+#include <kernel/sched.h>
+#include <kernel/sched/sched_latency.h>
+#include <kernel/time/ktime.h>
+#include <framework/mod/options.h>
+
+#include <util/err.h>
+
+EMBOX_TEST_SUITE("cyclic wake up latency test");
+
+#define LOOPS          OPTION_GET(NUMBER, loops)
+#define INTERVAL_MS    OPTION_GET(NUMBER, interval_ms)
+#define MAX_LATENCY_US OPTION_GET(NUMBER, max_latency_us)
+
+struct cyclic_result {
+	unsigned int loops;
+	int64_t min;
+	int64_t max;
+	int64_t total;
+	int has_stat;
+	struct sched_latency_stat stat;
+};
+
+static void *cyclic_run(void *arg) {
+	struct cyclic_result *res = arg;
+	int64_t next, now, lat;
+	int i;
+
+	next = ktime_get_ns();
+	for (i = 0; i < LOOPS; i++) {
+		next += INTERVAL_MS * 1000000LL;
+
+		now = ktime_get_ns();
+		if (next > now) {
+			/* ksleep() has millisecond granularity, round up */
+			ksleep((next - now + 999999) / 1000000);
+		}
+
+		lat = ktime_get_ns() - next;
+		if (lat < 0) {
+			lat = 0;
+		}
+
+		if (!res->loops || lat < res->min) {
+			res->min = lat;
+		}
+		if (lat > res->max) {
+			res->max = lat;
+		}
+		res->total += lat;
+		res->loops++;
+	}
+
+	/* Thread structure is gone after join, so take the stats now */
+	res->has_stat = !sched_latency_get(&thread_self()->schedee, &res->stat);
+
+	return NULL;
+}
+
+TEST_CASE("Periodic thread is woken up in time") {
+	struct cyclic_result res = { 0 };
+	struct thread *t;
+
+	t = thread_create(THREAD_FLAG_SUSPENDED, cyclic_run, &res);
+	test_assert_zero(err(t));
+	test_assert_zero(schedee_priority_set(&t->schedee, SCHED_PRIORITY_HIGH));
+	test_assert_zero(thread_launch(t));
+	test_assert_zero(thread_join(t, NULL));
+
+	test_assert_equal(res.loops, LOOPS);
+
+	printf("\ncyclictest: loops %u interval %dms "
+			"min %lldus avg %lldus max %lldus\n",
+			res.loops, INTERVAL_MS,
+			(long long) res.min / 1000,
+			(long long) res.total / res.loops / 1000,
+			(long long) res.max / 1000);
+
+	if (res.has_stat && res.stat.wakeups) {
+		printf("cyclictest: scheduler wakeup latency max %uus\n",
+				(unsigned) (res.stat.wakeup_max / 1000));
+	}
+
+	test_assert(res.max / 1000 <= MAX_LATENCY_US);
+}
@@ -0,0 +1,180 @@
+/**
+ * @file
+ * @brief UNIX domain sockets
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <embox/test.h>
+
+EMBOX_TEST_SUITE("AF_UNIX sockets test");
+
+static int sv[2];
+
+TEST_SETUP(case_setup);
+TEST_TEARDOWN(case_teardown);
+
+static socklen_t abstract_addr(struct sockaddr_un *addr, const char *name) {
+	memset(addr, 0, sizeof *addr);
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path + 1, name);
+	return offsetof(struct sockaddr_un, sun_path) + 1 + strlen(name);
+}
+
+TEST_CASE("socketpair() stream goes both ways and ends with EOF") {
+	char buf[8];
+
+	test_assert_zero(socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	test_assert_equal(3, send(sv[0], "abc", 3, 0));
+	test_assert_equal(2, send(sv[0], "de", 2, 0));
+	test_assert_equal(5, recv(sv[1], buf, sizeof buf, 0));
+	test_assert_zero(memcmp(buf, "abcde", 5));
+
+	test_assert_equal(2, send(sv[1], "xy", 2, 0));
+	test_assert_equal(2, recv(sv[0], buf, sizeof buf, 0));
+
+	test_assert_zero(close(sv[0]));
+	sv[0] = -1;
+	test_assert_zero(recv(sv[1], buf, sizeof buf, 0));
+}
+
+TEST_CASE("seqpacket keeps message boundaries") {
+	char buf[4];
+	struct msghdr msg;
+	struct iovec iov = { .iov_base = buf, .iov_len = sizeof buf };
+
+	test_assert_zero(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv));
+	test_assert_equal(6, send(sv[0], "123456", 6, 0));
+	test_assert_equal(2, send(sv[0], "78", 2, 0));
+
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	test_assert_equal(4, recvmsg(sv[1], &msg, 0));
+	test_assert(msg.msg_flags & MSG_TRUNC);
+	test_assert_equal(2, recv(sv[1], buf, sizeof buf, 0));
+	test_assert_zero(memcmp(buf, "78", 2));
+}
+
+TEST_CASE("datagram comes with the name of the sender") {
+	struct sockaddr_un addr, from;
+	socklen_t addrlen, fromlen;
+	char buf[8];
+
+	sv[0] = socket(AF_UNIX, SOCK_DGRAM, 0);
+	sv[1] = socket(AF_UNIX, SOCK_DGRAM, 0);
+	test_assert(sv[0] >= 0 && sv[1] >= 0);
+
+	addrlen = abstract_addr(&addr, "af_unix_test.rcv");
+	test_assert_zero(bind(sv[1], (struct sockaddr *)&addr, addrlen));
+	test_assert_equal(-1, bind(sv[0], (struct sockaddr *)&addr, addrlen));
+	test_assert_equal(EADDRINUSE, errno);
+
+	test_assert_equal(3, sendto(sv[0], "abc", 3, 0,
+				(struct sockaddr *)&addr, addrlen));
+
+	fromlen = sizeof from;
+	test_assert_equal(3, recvfrom(sv[1], buf, sizeof buf, 0,
+				(struct sockaddr *)&from, &fromlen));
+	/* The sender was bound to an abstract name on sending */
+	test_assert(fromlen > offsetof(struct sockaddr_un, sun_path));
+	test_assert_equal(AF_UNIX, from.sun_family);
+	test_assert_zero(from.sun_path[0]);
+}
+
+TEST_CASE("connect() to a listening socket and accept()") {
+	struct sockaddr_un addr;
+	socklen_t addrlen;
+	int lsock, conn;
+	char buf[4];
+
+	lsock = socket(AF_UNIX, SOCK_STREAM, 0);
+	test_assert(lsock >= 0);
+	addrlen = abstract_addr(&addr, "af_unix_test.lsn");
+	test_assert_zero(bind(lsock, (struct sockaddr *)&addr, addrlen));
+	test_assert_zero(listen(lsock, 1));
+
+	sv[0] = socket(AF_UNIX, SOCK_STREAM, 0);
+	test_assert(sv[0] >= 0);
+	test_assert_zero(connect(sv[0], (struct sockaddr *)&addr, addrlen));
+	/* Data sent before accept() wait for it */
+	test_assert_equal(2, send(sv[0], "hi", 2, 0));
+
+	conn = accept(lsock, NULL, NULL);
+	close(lsock);
+	test_assert(conn >= 0);
+	sv[1] = conn;
+
+	test_assert_equal(2, recv(sv[1], buf, sizeof buf, 0));
+	test_assert_zero(memcmp(buf, "hi", 2));
+}
+
+TEST_CASE("SCM_RIGHTS passes an open descriptor") {
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} ctl;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	int pair[2], fd;
+	char c, buf[4];
+
+	test_assert_zero(socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	test_assert_zero(socketpair(AF_UNIX, SOCK_DGRAM, 0, pair));
+
+	memset(&msg, 0, sizeof msg);
+	c = 'x';
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof ctl.buf;
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &pair[1], sizeof(int));
+	test_assert_equal(1, sendmsg(sv[0], &msg, 0));
+
+	/* The descriptor in flight holds the socket open */
+	close(pair[1]);
+
+	memset(&ctl, 0, sizeof ctl);
+	msg.msg_controllen = sizeof ctl.buf;
+	test_assert_equal(1, recvmsg(sv[1], &msg, 0));
+	cmsg = CMSG_FIRSTHDR(&msg);
+	test_assert_not_null(cmsg);
+	test_assert_equal(SCM_RIGHTS, cmsg->cmsg_type);
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+	test_assert_equal(2, send(fd, "ok", 2, 0));
+	test_assert_equal(2, recv(pair[0], buf, sizeof buf, 0));
+	test_assert_zero(memcmp(buf, "ok", 2));
+
+	close(fd);
+	close(pair[0]);
+}
+
+static int case_setup(void) {
+	sv[0] = sv[1] = -1;
+	return 0;
+}
+
+static int case_teardown(void) {
+	if (sv[0] >= 0) {
+		close(sv[0]);
+	}
+	if (sv[1] >= 0) {
+		close(sv[1]);
+	}
+	return 0;
+}
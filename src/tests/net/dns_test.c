@@ -0,0 +1,241 @@
+/**
+ * @file
+ * @brief Resolver against a stand-in nameserver on the loopback
+ *
+ * The resolver has to be configured with 127.0.0.1 as its nameserver.
+ *
+ * @date 19.10.2026
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <embox/test.h>
+#include <net/lib/dns.h>
+
+EMBOX_TEST_SUITE("dns resolver test");
+
+TEST_SETUP_SUITE(suite_setup);
+TEST_TEARDOWN_SUITE(suite_teardown);
+
+TEST_SETUP(case_setup);
+
+/* Names the stand-in knows, the others do not exist */
+#define HOST_NAME   "host.test"
+#define HOST_LABEL  "\4host\4test"
+#define TTL0_NAME   "ttl0.test"
+#define TTL0_LABEL  "\4ttl0\4test"
+#define NX_NAME     "nx.test"
+
+#define HOST_ADDR   0x0a000001
+#define HOST_TTL    60
+
+static int ns_sock;
+static pthread_t ns_thread;
+static volatile int ns_stop;
+static volatile int ns_queries;
+
+static const struct in6_addr host_addr6 = {{{
+	0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01 }}};
+
+static char * put16(char *p, uint16_t val) {
+	val = htons(val);
+	memcpy(p, &val, sizeof val);
+	return p + sizeof val;
+}
+
+static char * put32(char *p, uint32_t val) {
+	val = htonl(val);
+	memcpy(p, &val, sizeof val);
+	return p + sizeof val;
+}
+
+/* Turns the query in @a msg to the reply, returns size of the reply */
+static size_t ns_reply(char *msg, size_t len) {
+	struct dnshdr *hdr;
+	char *qname, *p;
+	uint16_t qtype;
+	uint32_t ttl;
+
+	hdr = (struct dnshdr *)msg;
+	qname = msg + sizeof *hdr;
+	for (p = qname; (*p != 0) && (p < msg + len); p += *p + 1);
+	++p;
+	memcpy(&qtype, p, sizeof qtype);
+	qtype = ntohs(qtype);
+	p += 2 * sizeof(uint16_t);
+
+	hdr->qr = DNS_MSG_TYPE_REPLY;
+	hdr->ra = 1;
+	hdr->ancount = hdr->nscount = hdr->arcount = 0;
+
+	if (!strcmp(qname, HOST_LABEL) || !strcmp(qname, TTL0_LABEL)) {
+		ttl = !strcmp(qname, HOST_LABEL) ? HOST_TTL : 0;
+		hdr->ancount = htons(1);
+		p = put16(p, 0xc000 | sizeof *hdr); /* pointer to qname */
+		p = put16(p, qtype);
+		p = put16(p, DNS_RR_CLASS_IN);
+		p = put32(p, ttl);
+		if (qtype == DNS_RR_TYPE_A) {
+			p = put16(p, sizeof(uint32_t));
+			p = put32(p, HOST_ADDR);
+		}
+		else {
+			p = put16(p, sizeof host_addr6);
+			memcpy(p, &host_addr6, sizeof host_addr6);
+			p += sizeof host_addr6;
+		}
+	}
+	else {
+		/* NXDOMAIN with SOA of the root zone */
+		hdr->rcode = DNS_RESP_CODE_NONAME;
+		hdr->nscount = htons(1);
+		p = put16(p, 0xc000 | sizeof *hdr);
+		p = put16(p, DNS_RR_TYPE_SOA);
+		p = put16(p, DNS_RR_CLASS_IN);
+		p = put32(p, HOST_TTL);
+		p = put16(p, 2 + 5 * sizeof(uint32_t));
+		*p++ = 0; /* mname */
+		*p++ = 0; /* rname */
+		p = put32(p, 1);        /* serial */
+		p = put32(p, 1800);     /* refresh */
+		p = put32(p, 900);      /* retry */
+		p = put32(p, 604800);   /* expire */
+		p = put32(p, HOST_TTL); /* minimum */
+	}
+
+	return p - msg;
+}
+
+static void * ns_serve(void *arg) {
+	char msg[DNS_MAX_MESSAGE_SZ];
+	struct sockaddr_in from;
+	socklen_t from_len;
+	ssize_t len;
+
+	while (!ns_stop) {
+		from_len = sizeof from;
+		len = recvfrom(ns_sock, msg, sizeof msg, 0,
+				(struct sockaddr *)&from, &from_len);
+		if (len < (ssize_t)sizeof(struct dnshdr)) {
+			continue;
+		}
+
+		++ns_queries;
+		len = ns_reply(msg, len);
+		sendto(ns_sock, msg, len, 0, (struct sockaddr *)&from, from_len);
+	}
+
+	return NULL;
+}
+
+TEST_CASE("A and AAAA are queried in parallel") {
+	struct dns_addrs addrs;
+
+	test_assert_zero(dns_lookup(HOST_NAME, AF_UNSPEC, &addrs));
+	test_assert_equal(2, ns_queries);
+	test_assert_equal(2, addrs.count);
+	test_assert_equal(AF_INET, addrs.addr[0].family);
+	test_assert_equal(htonl(HOST_ADDR), addrs.addr[0].addr.in.s_addr);
+	test_assert_equal(AF_INET6, addrs.addr[1].family);
+	test_assert_zero(memcmp(&host_addr6, &addrs.addr[1].addr.in6,
+				sizeof host_addr6));
+}
+
+TEST_CASE("answers are taken from the cache for their TTL") {
+	struct dns_addrs addrs;
+
+	test_assert_zero(dns_lookup(HOST_NAME, AF_INET, &addrs));
+	test_assert_zero(dns_lookup(HOST_NAME, AF_INET, &addrs));
+	test_assert_equal(1, ns_queries);
+	test_assert_equal(1, addrs.count);
+	test_assert(addrs.ttl <= HOST_TTL);
+}
+
+TEST_CASE("answers with zero TTL are not cached") {
+	struct dns_addrs addrs;
+
+	test_assert_zero(dns_lookup(TTL0_NAME, AF_INET, &addrs));
+	test_assert_zero(dns_lookup(TTL0_NAME, AF_INET, &addrs));
+	test_assert_equal(2, ns_queries);
+}
+
+TEST_CASE("negative answers are cached") {
+	struct dns_addrs addrs;
+
+	test_assert_equal(-ENOENT, dns_lookup(NX_NAME, AF_INET, &addrs));
+	test_assert_equal(-ENOENT, dns_lookup(NX_NAME, AF_INET, &addrs));
+	test_assert_equal(1, ns_queries);
+}
+
+TEST_CASE("lookup is driven by poll()") {
+	struct dns_lookup l;
+	struct pollfd pfd;
+	int ret;
+
+	ret = dns_lookup_start(&l, HOST_NAME, AF_INET6);
+	test_assert_equal(-EINPROGRESS, ret);
+
+	while (ret == -EINPROGRESS) {
+		pfd.fd = l.sock;
+		pfd.events = POLLIN;
+		test_assert_not_equal(-1, poll(&pfd, 1, dns_lookup_timeout(&l)));
+		ret = dns_lookup_process(&l);
+	}
+
+	test_assert_zero(ret);
+	test_assert_equal(-1, l.sock);
+	test_assert_equal(1, l.addrs.count);
+	test_assert_equal(AF_INET6, l.addrs.addr[0].family);
+}
+
+static int case_setup(void) {
+	dns_cache_flush();
+	ns_queries = 0;
+	return 0;
+}
+
+static int suite_setup(void) {
+	struct sockaddr_in addr;
+	struct timeval timeout = { .tv_sec = 0, .tv_usec = 100000 };
+	int ret;
+
+	ns_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (ns_sock == -1) {
+		return -errno;
+	}
+
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(DNS_PORT_NUMBER);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((-1 == bind(ns_sock, (struct sockaddr *)&addr, sizeof addr))
+			|| (-1 == setsockopt(ns_sock, SOL_SOCKET, SO_RCVTIMEO,
+					&timeout, sizeof timeout))) {
+		ret = -errno;
+		close(ns_sock);
+		return ret;
+	}
+
+	ns_stop = 0;
+	ret = pthread_create(&ns_thread, NULL, ns_serve, NULL);
+	if (ret != 0) {
+		close(ns_sock);
+		return -ret;
+	}
+
+	return 0;
+}
+
+static int suite_teardown(void) {
+	ns_stop = 1;
+	pthread_join(ns_thread, NULL);
+	dns_cache_flush();
+	return close(ns_sock);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file
+ *
+ * @date 19.10.2026
+ */
+
+#include <string.h>
+#include <netinet/in.h>
+
+#include <embox/test.h>
+#include <net/skbuff.h>
+#include <net/l3/inet_frag.h>
+
+EMBOX_TEST_SUITE("IP fragment reassembly");
+
+#define HDR      "HDR!"
+#define HDR_LEN  (sizeof(HDR) - 1)
+#define DGRAM    "0123456789abcdefghijklmnopqrstuv"
+#define DGRAM_LEN (sizeof(DGRAM) - 1)
+
+static uint32_t test_id;
+
+static void frag_key(struct inet_frag_key *key) {
+	memset(key, 0, sizeof *key);
+	key->family = AF_INET;
+	key->saddr.in.s_addr = htonl(0x0a000001);
+	key->daddr.in.s_addr = htonl(0x0a000002);
+	key->id = test_id;
+	key->proto = IPPROTO_UDP;
+}
+
+/* Sends bytes [offset, offset + len) of DGRAM */
+static struct sk_buff *frag_send(unsigned int offset, unsigned int len) {
+	struct inet_frag_key key;
+	struct inet_frag_info info;
+	struct sk_buff *skb;
+
+	skb = skb_alloc(HDR_LEN + len);
+	test_assert_not_null(skb);
+	skb->nh.raw = skb->mac.raw;
+	memcpy(skb->mac.raw, HDR, HDR_LEN);
+	memcpy(skb->mac.raw + HDR_LEN, DGRAM + offset, len);
+
+	frag_key(&key);
+	info.offset = offset;
+	info.len = len;
+	info.data_off = HDR_LEN;
+	info.hdr_len = HDR_LEN;
+	info.last = offset + len == DGRAM_LEN;
+
+	return inet_frag_add(&key, skb, &info);
+}
+
+static void dgram_check(struct sk_buff *skb) {
+	test_assert_not_null(skb);
+	test_assert_equal(skb->len, HDR_LEN + DGRAM_LEN);
+	test_assert_zero(memcmp(skb->mac.raw, HDR, HDR_LEN));
+	test_assert_equal(skb->h.raw, skb->mac.raw + HDR_LEN);
+	test_assert_zero(memcmp(skb->h.raw, DGRAM, DGRAM_LEN));
+	skb_free(skb);
+}
+
+TEST_CASE("Fragments in order are reassembled") {
+	test_id++;
+	test_assert_null(frag_send(0, 8));
+	test_assert_null(frag_send(8, 8));
+	test_assert_null(frag_send(16, 8));
+	dgram_check(frag_send(24, 8));
+}
+
+TEST_CASE("Fragments out of order are reassembled") {
+	test_id++;
+	test_assert_null(frag_send(24, 8));
+	test_assert_null(frag_send(8, 8));
+	test_assert_null(frag_send(16, 8));
+	dgram_check(frag_send(0, 8));
+}
+
+TEST_CASE("Duplicate fragment is ignored") {
+	test_id++;
+	test_assert_null(frag_send(0, 16));
+	test_assert_null(frag_send(0, 16));
+	dgram_check(frag_send(16, 16));
+}
+
+TEST_CASE("Overlapping fragment drops the datagram") {
+	test_id++;
+	test_assert_null(frag_send(0, 16));
+	test_assert_null(frag_send(8, 16));
+	/* The rest starts a new datagram with the same id */
+	test_assert_null(frag_send(16, 16));
+	dgram_check(frag_send(0, 16));
+}
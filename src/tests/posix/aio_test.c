@@ -0,0 +1,118 @@
+/**
+ * @file
+ *
+ * @date 19.10.2026
+ */
+
+#include <aio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <embox/test.h>
+
+EMBOX_TEST_SUITE("POSIX asynchronous I/O");
+
+TEST_SETUP(aio_test_setup);
+TEST_TEARDOWN(aio_test_teardown);
+
+#define AIO_TEST_FILE "/tmp/aio_test_file"
+
+static int aio_testfd[2];
+
+static int aio_test_setup(void) {
+	return pipe(aio_testfd);
+}
+
+static int aio_test_teardown(void) {
+	close(aio_testfd[0]);
+	close(aio_testfd[1]);
+	return 0;
+}
+
+static void aio_test_wait(struct aiocb *cb) {
+	const struct aiocb *list[1] = { cb };
+
+	while (aio_error(cb) == EINPROGRESS) {
+		test_assert_zero(aio_suspend(list, 1, NULL));
+	}
+}
+
+TEST_CASE("aio_read should complete after a write to the pipe") {
+	struct aiocb cb;
+	char buf[4];
+
+	memset(&cb, 0, sizeof(cb));
+	cb.aio_fildes = aio_testfd[0];
+	cb.aio_buf = buf;
+	cb.aio_nbytes = sizeof(buf);
+
+	test_assert_zero(aio_read(&cb));
+	test_assert_equal(4, write(aio_testfd[1], "abcd", 4));
+
+	aio_test_wait(&cb);
+	test_assert_zero(aio_error(&cb));
+	test_assert_equal(4, aio_return(&cb));
+	test_assert_zero(memcmp(buf, "abcd", 4));
+}
+
+TEST_CASE("lio_listio should run the whole list in order") {
+	struct aiocb wr[2], rd;
+	struct aiocb *list[2] = { &wr[0], &wr[1] };
+	char buf[8];
+
+	memset(wr, 0, sizeof(wr));
+	wr[0].aio_fildes = wr[1].aio_fildes = aio_testfd[1];
+	wr[0].aio_lio_opcode = wr[1].aio_lio_opcode = LIO_WRITE;
+	wr[0].aio_buf = "abcd";
+	wr[1].aio_buf = "efgh";
+	wr[0].aio_nbytes = wr[1].aio_nbytes = 4;
+
+	test_assert_zero(lio_listio(LIO_WAIT, list, 2, NULL));
+	test_assert_equal(4, aio_return(&wr[0]));
+	test_assert_equal(4, aio_return(&wr[1]));
+
+	memset(&rd, 0, sizeof(rd));
+	rd.aio_fildes = aio_testfd[0];
+	rd.aio_buf = buf;
+	rd.aio_nbytes = sizeof(buf);
+	test_assert_zero(aio_read(&rd));
+
+	aio_test_wait(&rd);
+	test_assert_equal(8, aio_return(&rd));
+	test_assert_zero(memcmp(buf, "abcdefgh", 8));
+}
+
+TEST_CASE("aio_write and aio_read of a regular file use the offset") {
+	struct aiocb wr, rd;
+	char buf[4];
+	int fd;
+
+	fd = open(AIO_TEST_FILE, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR);
+	test_assert(fd >= 0);
+
+	memset(&wr, 0, sizeof(wr));
+	wr.aio_fildes = fd;
+	wr.aio_buf = "abcdefgh";
+	wr.aio_nbytes = 8;
+	test_assert_zero(aio_write(&wr));
+	aio_test_wait(&wr);
+	test_assert_equal(8, aio_return(&wr));
+
+	memset(&rd, 0, sizeof(rd));
+	rd.aio_fildes = fd;
+	rd.aio_buf = buf;
+	rd.aio_nbytes = sizeof(buf);
+	rd.aio_offset = 2;
+	test_assert_zero(aio_read(&rd));
+	aio_test_wait(&rd);
+	test_assert_equal(4, aio_return(&rd));
+	test_assert_zero(memcmp(buf, "cdef", 4));
+
+	/* The file position is not used by either */
+	test_assert_zero(lseek(fd, 0, SEEK_CUR));
+
+	close(fd);
+	unlink(AIO_TEST_FILE);
+}
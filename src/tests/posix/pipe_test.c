@@ -6,6 +6,9 @@
  * @date    19.11.2013
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 #include <pthread.h>
 
@@ -98,3 +101,33 @@ TEST_CASE("read should block until data avaible") {
 
 	test_assert_emitted("abc");
 }
+
+TEST_CASE("F_SETPIPE_SZ should round capacity up to pages") {
+	int size;
+
+	size = fcntl(pipe_testfd[1], F_SETPIPE_SZ, 1);
+	test_assert(size > 0);
+	test_assert_equal(size, fcntl(pipe_testfd[0], F_GETPIPE_SZ));
+
+	test_assert_equal(-1, fcntl(pipe_testfd[1], F_SETPIPE_SZ, 0x7fffffff));
+	test_assert_equal(EPERM, errno);
+}
+
+TEST_CASE("data over several pages should come in order") {
+	static char out[3 * 4096 + 17], in[sizeof(out)];
+	size_t done;
+	int ret;
+
+	test_assert(fcntl(pipe_testfd[1], F_SETPIPE_SZ, sizeof(out)) >= (int) sizeof(out));
+
+	for (done = 0; done < sizeof(out); done++) {
+		out[done] = done * 7;
+	}
+	test_assert_equal(sizeof(out), write(pipe_testfd[1], out, sizeof(out)));
+
+	for (done = 0; done < sizeof(in); done += ret) {
+		ret = read(pipe_testfd[0], in + done, 1000);
+		test_assert(ret > 0);
+	}
+	test_assert_zero(memcmp(in, out, sizeof(out)));
+}
@@ -0,0 +1,59 @@
+/**
+ * @file
+ *
+ * @date 19.10.2026
+ */
+
+#include <embox/test.h>
+#include <stdint.h>
+#include <util/mpmc_ring.h>
+
+EMBOX_TEST_SUITE("util/mpmc_ring test");
+
+TEST_SETUP(case_setup);
+
+#define RING_LEN 8
+
+static uint64_t storage[MPMC_RING_STORAGE_SIZE(sizeof(int), RING_LEN)
+	/ sizeof(uint64_t)];
+static struct mpmc_ring test_ring;
+
+TEST_CASE("MPMC ring takes as many elements as it has slots") {
+	int val = 7, out = 0, cnt = 0;
+
+	while (mpmc_ring_enqueue(&test_ring, &val, 1)) {
+		cnt++;
+	}
+	test_assert_equal(cnt, RING_LEN);
+	test_assert_equal(mpmc_ring_count(&test_ring), RING_LEN);
+
+	while (mpmc_ring_dequeue(&test_ring, &out, 1)) {
+		test_assert_equal(out, val);
+		cnt--;
+	}
+	test_assert_zero(cnt);
+	test_assert(mpmc_ring_empty(&test_ring));
+}
+
+TEST_CASE("MPMC ring keeps order over several rounds") {
+	int in[RING_LEN - 1], out[RING_LEN - 1];
+	int i, round;
+
+	for (round = 0; round < 3; round++) {
+		for (i = 0; i < RING_LEN - 1; i++) {
+			in[i] = round * RING_LEN + i;
+		}
+		test_assert_equal(RING_LEN - 1,
+				mpmc_ring_enqueue(&test_ring, in, RING_LEN - 1));
+		test_assert_equal(RING_LEN - 1,
+				mpmc_ring_dequeue(&test_ring, out, RING_LEN));
+		for (i = 0; i < RING_LEN - 1; i++) {
+			test_assert_equal(out[i], in[i]);
+		}
+	}
+}
+
+static int case_setup(void) {
+	mpmc_ring_init(&test_ring, storage, sizeof(int), RING_LEN);
+	return 0;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file
+ *
+ * @date 19.10.2026
+ */
+
+#include <embox/test.h>
+#include <errno.h>
+#include <string.h>
+#include <util/err.h>
+#include <util/spsc_ring.h>
+
+EMBOX_TEST_SUITE("util/spsc_ring test");
+
+#define RING_LEN 16
+
+SPSC_RING_DEF(test_ring, int, RING_LEN);
+
+static char rec_storage[64];
+static struct spsc_ring rec_ring;
+
+TEST_CASE("All slots of SPSC ring are usable") {
+	int val = 5, out = 0, cnt = 0;
+
+	while (spsc_ring_enqueue(&test_ring, &val, 1)) {
+		cnt++;
+	}
+	test_assert_equal(cnt, RING_LEN);
+	test_assert_zero(spsc_ring_space(&test_ring));
+
+	while (spsc_ring_dequeue(&test_ring, &out, 1)) {
+		test_assert_equal(out, val);
+		cnt--;
+	}
+	test_assert_zero(cnt);
+	test_assert(spsc_ring_empty(&test_ring));
+}
+
+TEST_CASE("Bulk enqueue and dequeue of SPSC ring wrap around the end") {
+	int in[RING_LEN], out[RING_LEN];
+	int i;
+
+	for (i = 0; i < RING_LEN; i++) {
+		in[i] = i;
+	}
+
+	/* Move indices to the middle */
+	test_assert_equal(5, spsc_ring_enqueue(&test_ring, in, 5));
+	test_assert_equal(5, spsc_ring_dequeue(&test_ring, out, 5));
+
+	test_assert_equal(RING_LEN, spsc_ring_enqueue(&test_ring, in, RING_LEN + 3));
+	test_assert_equal(RING_LEN, spsc_ring_dequeue(&test_ring, out, RING_LEN));
+	test_assert_zero(memcmp(in, out, sizeof(in)));
+}
+
+TEST_CASE("Records of SPSC ring are contiguous and keep their length") {
+	size_t len;
+	char *rec;
+	int i;
+
+	spsc_ring_init(&rec_ring, rec_storage, 1, sizeof(rec_storage));
+
+	for (i = 0; i < 10; i++) {
+		/* 4 bytes header and 20 bytes of data, so they wrap */
+		rec = spsc_ring_reserve(&rec_ring, 17);
+		test_assert_not_null(rec);
+		memset(rec, i, 17);
+		spsc_ring_commit(&rec_ring);
+
+		rec = spsc_ring_peek(&rec_ring, &len);
+		test_assert_not_null(rec);
+		test_assert_equal(len, 17);
+		test_assert_equal(rec[0], i);
+		test_assert_equal(rec[16], i);
+		spsc_ring_release(&rec_ring);
+	}
+
+	test_assert_null(spsc_ring_peek(&rec_ring, &len));
+	test_assert_equal(-EMSGSIZE,
+			err(spsc_ring_reserve(&rec_ring, sizeof(rec_storage))));
+}
+
+TEST_CASE("Empty SPSC ring takes a record too long for its end") {
+	size_t len;
+
+	spsc_ring_init(&rec_ring, rec_storage, 1, sizeof(rec_storage));
+
+	test_assert_not_null(spsc_ring_reserve(&rec_ring, 28));
+	spsc_ring_commit(&rec_ring);
+	test_assert_not_null(spsc_ring_peek(&rec_ring, &len));
+	spsc_ring_release(&rec_ring);
+
+	/* 32 bytes are left at the end and 32 before, neither is enough */
+	test_assert_not_null(spsc_ring_reserve(&rec_ring, 36));
+	spsc_ring_commit(&rec_ring);
+	test_assert_not_null(spsc_ring_peek(&rec_ring, &len));
+	test_assert_equal(len, 36);
+	spsc_ring_release(&rec_ring);
+}
@@ -9,8 +9,8 @@
 #include <assert.h>
 #include <stdarg.h>
 
-#include <kernel/printk.h>
 #include <util/logging.h>
+#include <util/logging_output.h>
 
 char *log_levels[LOG_DEBUG] = {
 	"error",
@@ -26,7 +26,7 @@ void logging_raw(struct logging *logging, int level, const char* fmt, ...) {
 		va_list args;
 
 		va_start(args, fmt);
-		vprintk(fmt, args);
+		logging_vprint(logging, level, fmt, args);
 		va_end(args);
 	}
 }
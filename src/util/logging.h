@@ -23,6 +23,11 @@
  */
 struct logging {
 	int level; /**< Filtering log level */
+
+	/* Rate limiting state, used by logging outputs supporting it */
+	unsigned int rl_stamp;      /**< Second the counter below refers to */
+	unsigned int rl_count;      /**< Messages passed during the second */
+	unsigned int rl_suppressed; /**< Messages suppressed so far */
 };
 
 
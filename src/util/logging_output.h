@@ -0,0 +1,27 @@
+/**
+ * @file
+ * @brief Interface between logging frontend and its output
+ *
+ * @date 19.10.2026
+ */
+
+#ifndef UTIL_LOGGING_OUTPUT_H_
+#define UTIL_LOGGING_OUTPUT_H_
+
+#include <stdarg.h>
+
+struct logging;
+
+/**
+ * Emits a message which has already passed level filtering.
+ * Implemented by the selected logging_output module.
+ *
+ * @param logging Logging params of the message source
+ * @param level   Level of the message
+ * @param fmt     printf-like format of the message
+ * @param args    Arguments for @p fmt
+ */
+extern void logging_vprint(struct logging *logging, int level,
+	const char *fmt, va_list args);
+
+#endif /* UTIL_LOGGING_OUTPUT_H_ */
@@ -0,0 +1,17 @@
+/**
+ * @file
+ * @brief Synchronous logging output straight to the console
+ *
+ * @date 19.10.2026
+ */
+
+#include <stdarg.h>
+
+#include <kernel/printk.h>
+#include <util/logging.h>
+#include <util/logging_output.h>
+
+void logging_vprint(struct logging *logging, int level,
+		const char *fmt, va_list args) {
+	vprintk(fmt, args);
+}
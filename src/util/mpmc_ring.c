@@ -0,0 +1,124 @@
+/**
+ * @file
+ * @brief Lock-free multi-producer/multi-consumer ring
+ *
+ * @date 19.10.2026
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include <util/mpmc_ring.h>
+
+static inline void *mpmc_slot_elem(struct mpmc_ring *r, uint32_t pos) {
+	return r->storage + (pos & r->mask) * r->slot_size + sizeof(uint64_t);
+}
+
+void mpmc_ring_init(struct mpmc_ring *r, void *storage, size_t elem_size,
+		unsigned int count) {
+	uint32_t i;
+
+	assert(count && !(count & (count - 1)));
+	assert(!((uintptr_t) storage & 7));
+
+	r->mask = count - 1;
+	r->elem_size = elem_size;
+	r->slot_size = MPMC_RING_SLOT_SIZE(elem_size);
+	r->storage = storage;
+	r->head = 0;
+	r->tail = 0;
+
+	/* Slot i is free for the producer at position i */
+	for (i = 0; i < count; i++) {
+		*mpmc_ring_slot_seq(r, i) = i;
+	}
+}
+
+/* Number of slots from @a pos on, up to @a n, whose sequence is
+ * @a pos + @a ahead and on, i.e. which are ready for the side at @a pos.
+ * @return -1 if @a pos is stale, another context has moved past it */
+static int mpmc_ring_ready(struct mpmc_ring *r, uint32_t pos,
+		unsigned int n, uint32_t ahead) {
+	uint32_t seq;
+	int32_t diff;
+	unsigned int k;
+
+	for (k = 0; k < n; k++) {
+		seq = __atomic_load_n(mpmc_ring_slot_seq(r, pos + k), __ATOMIC_ACQUIRE);
+		diff = (int32_t) (seq - (pos + k + ahead));
+		if (diff != 0) {
+			if (diff > 0 && k == 0) {
+				return -1;
+			}
+			break;
+		}
+	}
+
+	return k;
+}
+
+/* Claims up to @a n ready slots at @a cursor with a single exchange.
+ * @return Number of slots claimed starting at @a *pos */
+static unsigned int mpmc_ring_claim(struct mpmc_ring *r, uint32_t *cursor,
+		unsigned int n, uint32_t ahead, uint32_t *pos) {
+	int k;
+
+	*pos = __atomic_load_n(cursor, __ATOMIC_RELAXED);
+	for (;;) {
+		k = mpmc_ring_ready(r, *pos, n, ahead);
+		if (k == 0) {
+			return 0;
+		}
+		if (k < 0) {
+			*pos = __atomic_load_n(cursor, __ATOMIC_RELAXED);
+			continue;
+		}
+		if (__atomic_compare_exchange_n(cursor, pos, *pos + k, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			return k;
+		}
+		/* pos is reloaded by the failed exchange */
+	}
+}
+
+unsigned int mpmc_ring_enqueue(struct mpmc_ring *r, const void *elems,
+		unsigned int n) {
+	uint32_t pos;
+	unsigned int i, k;
+
+	/* Slot is free for the producer at pos once its sequence is pos */
+	k = mpmc_ring_claim(r, &r->head, n, 0, &pos);
+
+	for (i = 0; i < k; i++) {
+		memcpy(mpmc_slot_elem(r, pos + i),
+				(const char *) elems + i * r->elem_size, r->elem_size);
+	}
+	/* Hand the slots to consumers */
+	for (i = 0; i < k; i++) {
+		__atomic_store_n(mpmc_ring_slot_seq(r, pos + i), pos + i + 1,
+				__ATOMIC_RELEASE);
+	}
+
+	return k;
+}
+
+unsigned int mpmc_ring_dequeue(struct mpmc_ring *r, void *elems,
+		unsigned int n) {
+	uint32_t pos;
+	unsigned int i, k;
+
+	/* Slot is filled for the consumer at pos once its sequence is pos + 1 */
+	k = mpmc_ring_claim(r, &r->tail, n, 1, &pos);
+
+	for (i = 0; i < k; i++) {
+		memcpy((char *) elems + i * r->elem_size,
+				mpmc_slot_elem(r, pos + i), r->elem_size);
+	}
+	/* Free for the producers of the next round */
+	for (i = 0; i < k; i++) {
+		__atomic_store_n(mpmc_ring_slot_seq(r, pos + i),
+				pos + i + r->mask + 1, __ATOMIC_RELEASE);
+	}
+
+	return k;
+}
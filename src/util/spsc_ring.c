@@ -0,0 +1,174 @@
+/**
+ * @file
+ * @brief Lock-free single-producer/single-consumer ring
+ *
+ * @date 19.10.2026
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include <util/err.h>
+#include <util/math.h>
+#include <util/spsc_ring.h>
+
+/* Record header, records are aligned to it */
+#define SPSC_REC_HDR   sizeof(uint32_t)
+/* Length of the filler put at the end when a record doesn't fit there */
+#define SPSC_REC_WRAP  0xffffffff
+
+#define SPSC_REC_SIZE(len) \
+	(SPSC_REC_HDR + (((len) + SPSC_REC_HDR - 1) & ~(SPSC_REC_HDR - 1)))
+
+void spsc_ring_init(struct spsc_ring *r, void *storage, size_t elem_size,
+		unsigned int count) {
+	assert(count && !(count & (count - 1)));
+
+	r->mask = count - 1;
+	r->elem_size = elem_size;
+	r->storage = storage;
+	r->head = r->reserved = 0;
+	r->tail = 0;
+}
+
+/* Copies @a n elements between @a buf and the ring at @a pos, wrapping */
+static void spsc_ring_copy(struct spsc_ring *r, uint32_t pos, void *buf,
+		unsigned int n, int to_ring) {
+	unsigned int off, first;
+	char *slot;
+
+	off = pos & r->mask;
+	first = min(n, r->mask + 1 - off);
+	slot = r->storage + off * r->elem_size;
+
+	if (to_ring) {
+		memcpy(slot, buf, first * r->elem_size);
+		memcpy(r->storage, (char *) buf + first * r->elem_size,
+				(n - first) * r->elem_size);
+	} else {
+		memcpy(buf, slot, first * r->elem_size);
+		memcpy((char *) buf + first * r->elem_size, r->storage,
+				(n - first) * r->elem_size);
+	}
+}
+
+unsigned int spsc_ring_enqueue(struct spsc_ring *r, const void *elems,
+		unsigned int n) {
+	uint32_t head, tail;
+
+	head = r->head;
+	tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+	n = min(n, r->mask + 1 - (head - tail));
+	if (n) {
+		spsc_ring_copy(r, head, (void *) elems, n, 1);
+		__atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+	}
+
+	return n;
+}
+
+unsigned int spsc_ring_dequeue(struct spsc_ring *r, void *elems,
+		unsigned int n) {
+	uint32_t head, tail;
+
+	tail = r->tail;
+	head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+	n = min(n, head - tail);
+	if (n) {
+		spsc_ring_copy(r, tail, elems, n, 0);
+		__atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+	}
+
+	return n;
+}
+
+void *spsc_ring_reserve(struct spsc_ring *r, size_t len) {
+	uint32_t head, tail, off, need, pad;
+	char *hdr;
+
+	assert(r->elem_size == 1);
+	assert(r->reserved == r->head);
+
+	if (len > r->mask + 1 - SPSC_REC_HDR) {
+		return err_ptr(EMSGSIZE);
+	}
+
+	head = r->head;
+	tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+	need = SPSC_REC_SIZE(len);
+	off = head & r->mask;
+	/* Records are contiguous, the end of the ring is skipped if short */
+	pad = (off + need > r->mask + 1) ? r->mask + 1 - off : 0;
+
+	if (pad && head == tail) {
+		/* Empty, so the filler would only be in the way of the record.
+		 * Both move to the start instead. The consumer doesn't touch
+		 * tail until it sees the head published after this */
+		head += pad;
+		__atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+		__atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+		r->reserved = head;
+		tail = head;
+		off = pad = 0;
+	}
+
+	if (need + pad > r->mask + 1 - (head - tail)) {
+		return NULL;
+	}
+
+	if (pad) {
+		*(uint32_t *) (r->storage + off) = SPSC_REC_WRAP;
+		off = 0;
+	}
+
+	hdr = r->storage + off;
+	*(uint32_t *) hdr = len;
+	r->reserved = head + pad + need;
+
+	return hdr + SPSC_REC_HDR;
+}
+
+void spsc_ring_commit(struct spsc_ring *r) {
+	__atomic_store_n(&r->head, r->reserved, __ATOMIC_RELEASE);
+}
+
+void *spsc_ring_peek(struct spsc_ring *r, size_t *len) {
+	uint32_t head, tail, off, rec_len;
+
+	assert(r->elem_size == 1);
+
+	/* Head first, the producer may move tail of an empty ring before
+	 * publishing a new head */
+	head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+	while ((int32_t) (head - tail) > 0) {
+		off = tail & r->mask;
+		rec_len = *(uint32_t *) (r->storage + off);
+
+		if (rec_len != SPSC_REC_WRAP) {
+			*len = rec_len;
+			return r->storage + off + SPSC_REC_HDR;
+		}
+
+		tail += r->mask + 1 - off;
+		__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+void spsc_ring_release(struct spsc_ring *r) {
+	uint32_t off, rec_len;
+
+	off = r->tail & r->mask;
+	rec_len = *(uint32_t *) (r->storage + off);
+	assert(rec_len != SPSC_REC_WRAP);
+
+	__atomic_store_n(&r->tail, r->tail + SPSC_REC_SIZE(rec_len),
+			__ATOMIC_RELEASE);
+}
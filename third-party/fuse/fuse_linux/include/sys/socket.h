@@ -10,6 +10,4 @@
 
 #include_next <sys/socket.h>
 
-#define SCM_RIGHTS 0x1
-
 #endif /* THIRD_PARTY_FUSE_FUSE_LINUX_INCLUDE_SYS_SOCKET_H_ */
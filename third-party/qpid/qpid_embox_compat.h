@@ -133,16 +133,6 @@ static inline pid_t fork() {
 
 
 #include <sys/socket.h>
-static inline
-int socketpair(int domain, int type, int protocol, int sv[2]) {
-	(void)domain;
-	(void)type;
-	(void)protocol;
-	(void)sv;
-	DPRINT();
-	errno = -EPROTONOSUPPORT;
-	return -1;
-}
 __END_DECLS
 
 #include <netinet/in.h>
@@ -82,12 +82,6 @@ int res_query(const char *dname, int class, int type,
 	return -1;
 }
 
-static inline
-int socketpair(int domain, int type, int protocol, int sv[2]) {
-	DPRINT();
-	return -1;
-}
-
 static inline
 char *mktemp(char *template) {
 	DPRINT();